@@ -7,12 +7,18 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <array>
+
 #include "loc.h"
-#include <vector>
+#include "loc_map.h"
 
 namespace dipcc {
 
-const std::vector<std::vector<Loc>> ADJ_A = {
+// Masks of the locs adjacent to each loc, for armies and fleets. The
+// *_ALL_COASTS variants include coast variants of adjacent locs, e.g.
+// BUL/EC and BUL/SC next to CON.
+
+inline constexpr LocSet ADJ_A[N_LOC_SLOTS] = {
     {},                                       // NONE
     {Loc::EDI, Loc::LON, Loc::LVP, Loc::WAL}, // YOR
     {Loc::YOR, Loc::LVP, Loc::CLY},           // EDI
@@ -100,7 +106,7 @@ const std::vector<std::vector<Loc>> ADJ_A = {
     {},                                                           // BUL/SC
 };
 
-const std::vector<std::vector<Loc>> ADJ_F = {
+inline constexpr LocSet ADJ_F[N_LOC_SLOTS] = {
     {},                                       // NONE
     {Loc::EDI, Loc::LON, Loc::NTH},           // YOR
     {Loc::YOR, Loc::NTH, Loc::CLY, Loc::NWG}, // EDI
@@ -195,7 +201,7 @@ const std::vector<std::vector<Loc>> ADJ_F = {
 // If ADJ_A[x] is "locs to which an at x could move", then
 // ADJ_A_ALL_COASTS[x] is "locs which an army at x could support-hold or
 // dislodge"
-const std::vector<std::vector<Loc>> ADJ_A_ALL_COASTS = {
+inline constexpr LocSet ADJ_A_ALL_COASTS[N_LOC_SLOTS] = {
     {},                                                       // NONE
     {Loc::EDI, Loc::LON, Loc::LVP, Loc::WAL},                 // YOR
     {Loc::YOR, Loc::LVP, Loc::CLY},                           // EDI
@@ -291,7 +297,7 @@ const std::vector<std::vector<Loc>> ADJ_A_ALL_COASTS = {
 // If ADJ_F[x] is "locs to which a fleet at x could move", then
 // ADJ_F_ALL_COASTS[x] is "locs which a fleet at x could support-hold or
 // dislodge"
-const std::vector<std::vector<Loc>> ADJ_F_ALL_COASTS = {
+inline constexpr LocSet ADJ_F_ALL_COASTS[N_LOC_SLOTS] = {
     {},                                       // NONE
     {Loc::EDI, Loc::LON, Loc::NTH},           // YOR
     {Loc::YOR, Loc::NTH, Loc::CLY, Loc::NWG}, // EDI
@@ -389,4 +395,39 @@ const std::vector<std::vector<Loc>> ADJ_F_ALL_COASTS = {
     {Loc::AEG, Loc::GRE, Loc::CON}, // BUL/SC
 };
 
+namespace detail {
+
+constexpr LocSet locs_where(const bool (&table)[N_LOC_SLOTS]) {
+  LocSet r;
+  for (size_t i = 0; i < N_LOC_SLOTS; ++i) {
+    if (table[i]) {
+      r.insert(static_cast<Loc>(i));
+    }
+  }
+  return r;
+}
+
+constexpr std::array<LocSet, N_LOC_SLOTS> make_with_coasts() {
+  std::array<LocSet, N_LOC_SLOTS> r{};
+  for (size_t i = 1; i < N_LOC_SLOTS; ++i) {
+    for (size_t j = 1; j < N_LOC_SLOTS; ++j) {
+      if (root_loc(static_cast<Loc>(i)) == root_loc(static_cast<Loc>(j))) {
+        r[i].insert(static_cast<Loc>(j));
+      }
+    }
+  }
+  return r;
+}
+
+} // namespace detail
+
+// Masks of is_water, is_coast and is_center locs
+inline constexpr LocSet WATER_LOCS = detail::locs_where(IS_WATER);
+inline constexpr LocSet COAST_LOCS = detail::locs_where(IS_COAST);
+inline constexpr LocSet CENTER_LOCS = detail::locs_where(IS_CENTER);
+
+// Mask form of expand_coasts: WITH_COASTS_MASK[BUL/EC] = {BUL, BUL/EC, BUL/SC}
+inline constexpr std::array<LocSet, N_LOC_SLOTS> WITH_COASTS_MASK =
+    detail::make_with_coasts();
+
 } // namespace dipcc
@@ -14,8 +14,10 @@ LICENSE file in the root directory of this source tree.
 
 #include "adjacencies.h"
 #include "checks.h"
+#include "convoy_paths.h"
 #include "exceptions.h"
 #include "game_state.h"
+#include "loc_map.h"
 #include "power.h"
 #include "unit.h"
 #include "util.h"
@@ -43,14 +45,14 @@ const LocCandidate NONE_LOC_CANDIDATE = {
 
 // Output of resolve()
 struct Resolution {
-  map<Loc, LocCandidate> winners;
-  set<Loc> dislodged;
-  set<Loc> contested;
+  LocMap<LocCandidate> winners;
+  LocSet dislodged;
+  LocSet contested;
 };
 
 struct MoveCycle {
   bool convoy_swap;
-  set<Loc> locs;
+  LocSet locs;
 };
 
 struct UnresolvedSupport {
@@ -59,8 +61,28 @@ struct UnresolvedSupport {
   bool pending_dislodge;
 };
 
+// All containers below are fixed-capacity and indexed by (root) Loc, so that
+// a LocCandidates object can be reset and reused across process_m calls. See
+// get_scratch_loc_candidates()
 class LocCandidates {
 public:
+  // Clear all state, keeping allocated capacity
+  void reset() {
+    cands_.clear();
+    move_reqs_.clear();
+    unresolved_supports_.clear();
+    unresolved_units_.clear();
+    unresolved_h2h_.clear();
+    unresolved_self_support_dislodges_.clear();
+    unresolved_self_dislodges_.clear();
+    maybe_convoy_orders_by_fleet_.clear();
+    maybe_convoy_orders_by_dest_.clear();
+    confirmed_convoy_fleets_.clear();
+    loc_prev_str_.clear();
+    exception_on_convoy_paradox_ = false;
+    convoy_paradox_ = false;
+  }
+
   void add_candidate(Loc dest, OwnedUnit unit, bool via, bool via_adj) {
     Loc dest_root = root_loc(dest);
     Loc src_root = root_loc(unit.loc);
@@ -113,7 +135,7 @@ public:
                         ? root_loc(order.get_dest())
                         : root_loc(order.get_target().loc);
     DLOG(INFO) << "ADD SUPPORT " << src_root << " - " << dest_root;
-    map<Loc, LocCandidate> &dest_cands = cands_.at(dest_root);
+    LocMap<LocCandidate> &dest_cands = cands_.at(dest_root);
     LocCandidate &supportee = dest_cands.at(root_loc(src_root));
 
     if (supportee.min_pending_convoy > 0) {
@@ -142,7 +164,7 @@ public:
       // unresolved support-move
       Loc dest_root = root_loc(order.get_dest());
       Loc src_root = root_loc(order.get_target().loc);
-      map<Loc, LocCandidate> &dest_cands = cands_.at(dest_root);
+      LocMap<LocCandidate> &dest_cands = cands_.at(dest_root);
       LocCandidate &supportee = dest_cands.at(src_root);
       supportee.max += 1;
     } else {
@@ -164,7 +186,7 @@ public:
       Loc dest = unresolved_support.order.get_type() == OrderType::SM
                      ? unresolved_support.order.get_dest()
                      : root_loc(unresolved_support.order.get_target().loc);
-      if (!set_contains(r.contested, dest) && !map_contains(r.winners, dest)) {
+      if (!r.contested.contains(dest) && !r.winners.contains(dest)) {
         DLOG(INFO) << "CONFIRM SUPPORT: " << supporter_loc;
         add_support(unresolved_support.order,
                     unresolved_support.supporter_power);
@@ -221,7 +243,7 @@ public:
       // support-move
       Loc dest_root = root_loc(support_order.get_dest());
       Loc src_root = root_loc(support_order.get_target().loc);
-      map<Loc, LocCandidate> &dest_cands = cands_.at(dest_root);
+      LocMap<LocCandidate> &dest_cands = cands_.at(dest_root);
       LocCandidate &supportee = dest_cands.at(src_root);
       supportee.max -= 1;
     } else {
@@ -239,21 +261,19 @@ public:
     maybe_convoy_orders_by_dest_[root_loc(order.get_dest())].insert(order);
   }
 
-  vector<LocCandidate> get_move_candidates(Loc dest) {
+  // Call f(const LocCandidate&) for each move candidate (not hold) to dest
+  template <typename F> void for_each_move_candidate(Loc dest, F f) const {
     dest = root_loc(dest);
-    vector<LocCandidate> r;
     auto it = cands_.find(dest);
     if (it == cands_.end()) {
-      return r;
+      return;
     }
     for (auto &jt : it->second) {
       Loc src = jt.first;
       if (src != dest) {
-        // include only move candidates, not hold
-        r.push_back(jt.second);
+        f(jt.second);
       }
     }
-    return r;
   }
 
   void log() {
@@ -294,7 +314,7 @@ public:
 
       for (auto &it : cands_) {
         Loc dest = it.first;
-        map<Loc, LocCandidate> &loc_cands = it.second;
+        LocMap<LocCandidate> &loc_cands = it.second;
 
         change_this_iter |= _try_resolve_loc(r, dest, loc_cands);
       }
@@ -340,8 +360,8 @@ public:
   //
   // Returns true if a change was made
   bool _try_resolve_loc(Resolution &r, Loc dest,
-                        map<Loc, LocCandidate> &loc_cands) {
-    if (map_contains(r.winners, dest)) {
+                        LocMap<LocCandidate> &loc_cands) {
+    if (r.winners.contains(dest)) {
       // dest is already resolved
       return false;
     }
@@ -366,7 +386,7 @@ public:
       // Loop through all candidate for dest, gathering data e.g.  the
       // largest min, largest max, and whether there is a unit engaging in
       // a h2h
-      map<Loc, LocCandidate>::iterator largest_min_cand;
+      LocMap<LocCandidate>::iterator largest_min_cand = loc_cands.end();
       int largest_min = -1;
       int largest_max = -1;
       for (auto loc_cand_it = loc_cands.begin(); loc_cand_it != loc_cands.end();
@@ -494,22 +514,21 @@ public:
       DLOG(WARNING) << "Considering unresolved unit: " << loc_str(loc);
       if (move_reqs_.find(loc) == move_reqs_.end()) {
         // Unit tried to hold: must be dislodged
-        JCHECK(map_contains(r.winners, loc),
-               "Unit tried to hold but loc unresolved");
+        JCHECK(r.winners.contains(loc), "Unit tried to hold but loc unresolved");
         JCHECK(root_loc(r.winners.at(loc).src) != loc,
                "Unit successfully held but still marked as unresolved");
         _resolve_dislodge(r, loc);
       } else {
         // Unit tried to move
         Loc dest = move_reqs_.at(loc);
-        if (!map_contains(r.winners, dest)) {
+        if (!r.winners.contains(dest)) {
           // Destination unresolved. Check for move cycle
           _check_and_resolve_move_cycle(r, loc);
         } else {
           // Destination resolved: must be dislodged
           JCHECK(root_loc(r.winners.at(dest).src) != loc,
                  "Unit successfully moved but still marked as unresolved");
-          JCHECK(map_contains(r.winners, loc),
+          JCHECK(r.winners.contains(loc),
                  "Unit failed to move, but their loc remains unresolved. "
                  "Why didn't they hold?");
           JCHECK(root_loc(r.winners.at(loc).src) != loc,
@@ -549,7 +568,7 @@ public:
       Loc army_src = root_loc(order.get_target().loc);
       Loc army_dest = root_loc(order.get_dest());
       maybe_convoy_orders_by_dest_[army_dest].erase(order);
-      maybe_convoy_orders_by_fleet_.erase(it);
+      maybe_convoy_orders_by_fleet_.erase(winner.src);
       LocCandidate &army_cand = cands_[army_dest][army_src];
       confirmed_convoy_fleets_[army_src].insert(winner.src);
       if (is_convoy_possible(army_src, army_dest, true)) {
@@ -599,7 +618,7 @@ public:
       } else if (loser.second.max > 0) {
         // loser mover now tries to hold their former position if it is not
         // already resolved, otherwise they are dislodged
-        if (map_contains(r.winners, loser_loc)) {
+        if (r.winners.contains(loser_loc)) {
           if (root_loc(r.winners.at(loser_loc).src) == loser_loc) {
             // unit has already successfully held: nothing to do here
           } else {
@@ -608,7 +627,7 @@ public:
             // dislodged
             _resolve_dislodge(r, loser_loc);
           }
-        } else if (set_contains(r.contested, loser_loc)) {
+        } else if (r.contested.contains(loser_loc)) {
           // unit remains in bounced location
           _resolve_winner(r, loser_loc, cands_[loser_loc][loser_loc]);
         } else {
@@ -639,7 +658,7 @@ public:
         // effect (see DATC 6.E.4)
         auto mov_it = move_reqs_.find(dest);
         if (mov_it != move_reqs_.end()) {
-          if (map_contains(unresolved_h2h_, cand_loc)) {
+          if (unresolved_h2h_.contains(cand_loc)) {
             _resolve_pending_h2h_strength(cands_.at(mov_it->second).at(dest));
           } else {
             // h2h was already resolved, which means this cand lost a h2h. Add
@@ -667,16 +686,6 @@ public:
     remove_self_dislodges_at_dest(unresolved_self_dislodges_, dest);
     remove_self_dislodges_at_dest(unresolved_self_support_dislodges_, dest);
 
-    // Remove any unresolved self-dislodges at this location
-    for (auto it = unresolved_self_dislodges_.begin();
-         it != unresolved_self_dislodges_.end();) {
-      if (root_loc(it->second) == root_loc(dest)) {
-        it = unresolved_self_dislodges_.erase(it);
-      } else {
-        ++it;
-      }
-    }
-
     // FIXME: rm
     this->log();
   }
@@ -720,15 +729,14 @@ public:
     Loc dest = Loc::NONE;
     for (Loc cur = loc; dest != loc; cur = dest) {
       dest = move_reqs_.at(cur);
-      if (!set_contains(unresolved_units_, dest) ||
-          !map_contains(move_reqs_, dest)) {
+      if (!unresolved_units_.contains(dest) || !move_reqs_.contains(dest)) {
         // not a move cycle, return empty
         cycle.locs.clear();
         return cycle;
       }
       cycle.convoy_swap |= cands_.at(dest).at(cur).via;
 
-      if (dest != loc && set_contains(cycle.locs, cur)) {
+      if (dest != loc && cycle.locs.contains(cur)) {
         // found move cycle not containing loc, return empty
         cycle.locs.clear();
         return cycle;
@@ -905,7 +913,7 @@ public:
     Loc src = root_loc(order.get_target().loc);
     Loc dest = root_loc(order.get_dest());
     maybe_convoy_orders_by_dest_[dest].erase(order);
-    maybe_convoy_orders_by_fleet_.erase(it);
+    maybe_convoy_orders_by_fleet_.erase(loc);
     if (!is_convoy_possible(order.get_target().loc, order.get_dest())) {
       bool via_adj = cands_[dest][src].via_adj;
       DLOG(INFO) << "BROKEN CONVOY " << src << " -> " << dest
@@ -928,7 +936,7 @@ public:
         // Even if unit at dest already won their loc, they may have had an
         // unresolved support which could now be confirmed.
         if (maybe_convoy_orders_by_dest_[dest].size() == 0 &&
-            map_contains(r.winners, dest) &&
+            r.winners.contains(dest) &&
             root_loc(r.winners.at(dest).src) == dest) {
           _resolve_support_if_exists(r, dest);
         }
@@ -956,58 +964,19 @@ public:
     src = root_loc(src);
 
     // Compile fleets that are attempting to convoy this route
-    const set<Loc> &confirmed_convoy_fleets = confirmed_convoy_fleets_[src];
-    set<Loc> maybe_convoy_fleets;
+    const LocSet &confirmed_convoy_fleets = confirmed_convoy_fleets_[src];
+    LocSet maybe_convoy_fleets;
     for (const Order &order : maybe_convoy_orders_by_dest_[dest]) {
       if (root_loc(order.get_target().loc) == src) {
         maybe_convoy_fleets.insert(order.get_unit().loc);
       }
     }
 
-    set<Loc> todo;
-    set<Loc> visited;
-
-    // Initialize carefully: start with adjacent convoy fleets, not with src
-    // directly, to ensure that VIA move goes through at least one fleet
-    for (Loc _src : expand_coasts(src)) {
-      for (Loc adj : ADJ_F[static_cast<size_t>(_src)]) {
-        if (set_contains(confirmed_convoy_fleets, adj) ||
-            (!only_confirmed && set_contains(maybe_convoy_fleets, adj))) {
-          todo.insert(adj);
-        }
-      }
+    LocSet fleets = confirmed_convoy_fleets;
+    if (!only_confirmed) {
+      fleets |= maybe_convoy_fleets;
     }
-
-    while (todo.size() > 0) {
-      auto it = todo.begin();
-      Loc loc = *it;
-      todo.erase(it);
-      visited.insert(loc);
-
-      for (Loc current : ADJ_F_ALL_COASTS[static_cast<size_t>(loc)]) {
-        if (root_loc(current) == root_loc(dest)) {
-          return true;
-        }
-        if (set_contains(visited, current)) {
-          continue;
-        }
-        if (set_contains(confirmed_convoy_fleets, current)) {
-          // there is a fleet at current confirmed to convoy src -> dest
-          todo.insert(current);
-          continue;
-        }
-        if (only_confirmed) {
-          continue;
-        }
-
-        // there is a fleet at current attempting to convoy src -> dest
-        if (set_contains(maybe_convoy_fleets, current)) {
-          todo.insert(current);
-          continue;
-        }
-      }
-    }
-    return false;
+    return can_convoy(fleets, src, dest);
   }
 
   // Unit @ loc is not dislodged: maybe confirm unresolved support
@@ -1064,8 +1033,7 @@ public:
       // unit @ loc was trying to move to dest
       Loc dest = root_loc(dest_it->second);
       auto dest_winner_it = r.winners.find(dest);
-      if (dest_winner_it == r.winners.end() &&
-          set_contains(r.contested, dest)) {
+      if (dest_winner_it == r.winners.end() && r.contested.contains(dest)) {
         // unit @ loc is trying to move to bounced loc, so we must prevent a
         // self-dislodge
         //
@@ -1110,20 +1078,20 @@ public:
     unresolved_self_dislodges_.clear();
     unresolved_self_support_dislodges_.clear();
 
-    set<Loc> resolved_cycle_locs;
-    vector<set<Loc>> maybe_valid_cycles;
+    LocSet resolved_cycle_locs;
+    vector<LocSet> maybe_valid_cycles;
     while (unresolved_self_dislodges.size() > 0) {
       auto it = unresolved_self_dislodges.begin();
       pair<Loc, Loc> p = *it;
       Loc src = p.first;
       Loc dest = p.second;
       DLOG(INFO) << "Consider resolving " << src << " -> " << dest;
-      if (set_contains(resolved_cycle_locs, src)) {
+      if (resolved_cycle_locs.contains(src)) {
         unresolved_self_dislodges.erase(it);
         continue;
       }
       MoveCycle cycle = _detect_unresolved_move_cycle(dest);
-      if (set_contains(cycle.locs, src) &&
+      if (cycle.locs.contains(src) &&
           (cycle.locs.size() >= 3 || cycle.convoy_swap)) {
         // self-dislodger is part of a move cycle, and therefore would not
         // dislodge dest if the cycle all moved. This is not a self-dislodge
@@ -1150,9 +1118,9 @@ public:
     }
 
     // Resolve valid move cycles if they were not later resolved by a bounce
-    for (set<Loc> &cycle : maybe_valid_cycles) {
+    for (LocSet &cycle : maybe_valid_cycles) {
       Loc loc = *cycle.begin();
-      if (!set_contains(resolved_cycle_locs, loc)) {
+      if (!resolved_cycle_locs.contains(loc)) {
         Loc dest = move_reqs_.at(loc);
         _resolve_winner(r, dest, cands_.at(dest).at(loc));
         for (Loc c : cycle) {
@@ -1186,6 +1154,7 @@ public:
       Loc convoy_fleet = it->first;
       Order &convoy_order = it->second;
       DLOG(INFO) << "CONVOY PARADOX: " << convoy_order.to_string();
+      convoy_paradox_ = true;
       if (exception_on_convoy_paradox_) {
         throw ConvoyParadoxException();
       }
@@ -1217,19 +1186,19 @@ public:
   // e.g. for the order "F STP/SC - BOT"
   // cands_[BOT][STP] = move candidate
   // cands_[STP][STP] = hold candidate (in case move fails)
-  map<Loc, map<Loc, LocCandidate>> cands_;
+  LocMap<LocMap<LocCandidate>> cands_;
 
   // Move candidates organized src -> dest
-  map<Loc, Loc> move_reqs_;
+  LocMap<Loc> move_reqs_;
 
   // Key is supporter loc
-  map<Loc, UnresolvedSupport> unresolved_supports_;
+  LocMap<UnresolvedSupport> unresolved_supports_;
 
   // Units who do not yet have a resolved destination
-  set<Loc> unresolved_units_;
+  LocSet unresolved_units_;
 
   // bidirectional map of unresolved h2h battles
-  map<Loc, Loc> unresolved_h2h_;
+  LocMap<Loc> unresolved_h2h_;
 
   // unresolved self-support dislodge moves, src -> dest,
   // i.e. dislodges that succeed only with self-support
@@ -1240,39 +1209,66 @@ public:
   set<pair<Loc, Loc>> unresolved_self_dislodges_;
 
   // Unresolved convoy orders organized by *fleet loc*
-  map<Loc, Order> maybe_convoy_orders_by_fleet_;
+  LocMap<Order> maybe_convoy_orders_by_fleet_;
 
-  // Unresolved convoy orders organized by *dest loc*
-  map<Loc, set<Order>> maybe_convoy_orders_by_dest_;
+  // Unresolved convoy orders organized by *dest loc*. The sets are empty (and
+  // so do not allocate) unless there are convoys
+  LocMap<set<Order>> maybe_convoy_orders_by_dest_;
 
   // Non-dislodged fleets organized by *army loc*
   // Map of army loc -> set of fleet locs
-  map<Loc, set<Loc>> confirmed_convoy_fleets_;
+  LocMap<LocSet> confirmed_convoy_fleets_;
 
   // Minimum strength necessary to move to a loc.
-  map<Loc, int> loc_prev_str_;
+  LocMap<int> loc_prev_str_;
 
   // For debugging: if true, raise a custom exception when a convoy paradox is
   // encountered
   bool exception_on_convoy_paradox_ = false;
-};
 
-GameState GameState::process_m(
-    const std::unordered_map<Power, std::vector<Order>> &orders,
-    bool exception_on_convoy_paradox) {
-  JCHECK(this->get_phase().phase_type == 'M',
-         "Bad phase_type: " + this->get_phase().phase_type);
-  DLOG(INFO) << "Process phase: " << this->get_phase().to_string();
+  // Whether a convoy paradox was encountered
+  bool convoy_paradox_ = false;
+};
 
-  const unordered_map<Loc, set<Order>> &all_possible_orders(
-      this->get_all_possible_orders());
+namespace {
 
-  // Build up candidate data
+// Per-thread scratch space for process_m. LocCandidates is large (its
+// containers are fixed-size arrays) so it is kept and reset between calls
+// rather than rebuilt, which also means a movement phase without convoys does
+// no heap allocation in the adjudicator.
+struct ProcessMScratch {
   LocCandidates loc_candidates;
+  LocMap<Order> orders_by_src;
   vector<pair<Order, bool>> move_via_orders;
   vector<Order> support_orders;
-  set<Loc> illegal_orderers;
-  set<Loc> unconvoyed_movers;
+};
+
+ProcessMScratch &get_process_m_scratch() {
+  thread_local ProcessMScratch scratch;
+  scratch.loc_candidates.reset();
+  scratch.orders_by_src.clear();
+  scratch.move_via_orders.clear();
+  scratch.support_orders.clear();
+  return scratch;
+}
+
+} // namespace
+
+GameState GameState::process_m(const PowerMap<std::vector<Order>> &orders,
+                                bool exception_on_convoy_paradox,
+                                bool *convoy_paradox) {
+  if (this->get_phase().phase_type != 'M') {
+    JFAIL(std::string("Bad phase_type: ") + this->get_phase().phase_type);
+  }
+  DLOG(INFO) << "Process phase: " << this->get_phase().to_string();
+
+  // Build up candidate data
+  ProcessMScratch &scratch = get_process_m_scratch();
+  LocCandidates &loc_candidates = scratch.loc_candidates;
+  vector<pair<Order, bool>> &move_via_orders = scratch.move_via_orders;
+  vector<Order> &support_orders = scratch.support_orders;
+  LocSet illegal_orderers;
+  LocSet unconvoyed_movers;
 
   // Set debugging flags
   loc_candidates.exception_on_convoy_paradox_ = exception_on_convoy_paradox;
@@ -1286,7 +1282,7 @@ GameState GameState::process_m(
   }
 
   // Organize orders by src loc
-  unordered_map<Loc, Order> orders_by_src;
+  LocMap<Order> &orders_by_src = scratch.orders_by_src;
   for (auto & [ power, porders ] : orders) {
     for (const Order order : porders) {
       Loc loc = order.get_unit().loc;
@@ -1303,11 +1299,8 @@ GameState GameState::process_m(
   // Loop through all orders and build up data structures
   for (auto & [ rloc, order ] : orders_by_src) {
     // check if order is possible
-    auto loc_possible_orders_it =
-        all_possible_orders.find(order.get_unit().loc);
-    if (loc_possible_orders_it == all_possible_orders.end() ||
-        !set_contains(loc_possible_orders_it->second, order)) {
-      if (is_implicit_via(order, all_possible_orders)) {
+    if (!is_valid_movement(order)) {
+      if (is_implicit_via(order)) {
         // set via to explicitly true and move on
         DLOG(WARNING) << "Accepting implicit via for order: "
                       << order.to_string();
@@ -1323,9 +1316,7 @@ GameState GameState::process_m(
     // check if via move is to adjacent loc (i.e. non-via move also
     // allowed)
     bool via_adj =
-        (order.get_via() &&
-         loc_possible_orders_it != all_possible_orders.end() &&
-         set_contains(loc_possible_orders_it->second, order.with_via(false)));
+        (order.get_via() && is_valid_movement(order.with_via(false)));
 
     // add all loc candidates and set aside supports
     if (order.get_type() == OrderType::H) {
@@ -1349,8 +1340,7 @@ GameState GameState::process_m(
       if (target != orders_by_src.end() &&
           target->second.get_type() == OrderType::M &&
           target->second.get_dest() == order.get_dest() &&
-          (target->second.get_via() ||
-           is_implicit_via(target->second, all_possible_orders))) {
+          (target->second.get_via() || is_implicit_via(target->second))) {
         loc_candidates.add_convoy_order(order);
       } else {
         DLOG(WARNING) << "Uncoordinated convoy: " << order.to_string();
@@ -1391,7 +1381,7 @@ GameState GameState::process_m(
     // unit that is moving, or support-moving a unit to the wrong destination
     auto target = orders_by_src.find(root_loc(order.get_target().loc));
 
-    if (set_contains(unconvoyed_movers, root_loc(order.get_target().loc))) {
+    if (unconvoyed_movers.contains(root_loc(order.get_target().loc))) {
       DLOG(WARNING) << "Support of unconvoyed mover: " << order.to_string();
       continue;
     } else if (order.get_type() == OrderType::SM &&
@@ -1405,8 +1395,8 @@ GameState GameState::process_m(
     } else if (order.get_type() == OrderType::SH &&
                (target != orders_by_src.end() &&
                 target->second.get_type() == OrderType::M &&
-                !set_contains(illegal_orderers,
-                              root_loc(target->second.get_unit().loc)))) {
+                !illegal_orderers.contains(
+                    root_loc(target->second.get_unit().loc)))) {
       DLOG(WARNING) << "Uncoordinated support-hold: " << order.to_string();
       continue;
     }
@@ -1414,13 +1404,14 @@ GameState GameState::process_m(
     // Check for support cuts.  Anyone (of a different power) trying to move
     // to any coastal variant is a cut candidate
     Power supporter_power = this->get_unit(order.get_unit().loc).power;
-    set<Loc> cut_candidates;
-    set<Loc> convoy_cut_candidates;
+    LocSet cut_candidates;
+    LocSet convoy_cut_candidates;
     for (Loc loc : expand_coasts(order.get_unit().loc)) {
-      for (LocCandidate move_cand : loc_candidates.get_move_candidates(loc)) {
+      loc_candidates.for_each_move_candidate(loc, [&](const LocCandidate
+                                                          &move_cand) {
         if (move_cand.power == supporter_power) {
           // can't cut own support
-          continue;
+          return;
         }
         if (move_cand.via) {
           DLOG(INFO) << "Convoy cut candidate " << order.to_string() << " : "
@@ -1431,7 +1422,7 @@ GameState GameState::process_m(
                      << root_loc(move_cand.src);
           cut_candidates.insert(root_loc(move_cand.src));
         }
-      }
+      });
     }
 
     if (order.get_type() == OrderType::SH) {
@@ -1472,6 +1463,9 @@ GameState GameState::process_m(
   // Resolve moves
   loc_candidates.log();
   auto resolved = loc_candidates.resolve();
+  if (convoy_paradox != nullptr) {
+    *convoy_paradox = loc_candidates.convoy_paradox_;
+  }
   return build_next_state(resolved);
 }
 
@@ -1487,8 +1481,9 @@ GameState GameState::build_next_state(const Resolution &r) const {
       continue;
     }
     auto unit = this->get_unit(cand.src);
-    JCHECK(unit.type != UnitType::NONE,
-           "Bad: dest=" + loc_str(cand.dest) + " src=" + loc_str(cand.src));
+    if (unit.type == UnitType::NONE) {
+      JFAIL("Bad: dest=" + loc_str(cand.dest) + " src=" + loc_str(cand.src));
+    }
     next.set_unit(unit.power, unit.type, cand.dest);
   }
 
@@ -1509,27 +1504,17 @@ GameState GameState::build_next_state(const Resolution &r) const {
     }
 
     // Remove disbanded units who have no retreat options
-    bool any_disbands = false;
     bool any_retreats = false;
-    const unordered_map<Loc, set<Order>> &all_possible_orders(
-        next.get_all_possible_orders());
-    for (const auto &unit : next.get_dislodged_units()) {
-      auto it = all_possible_orders.find(unit.loc);
-      if (it == all_possible_orders.end() || it->second.size() == 0) {
-        DLOG(INFO) << "Disbanded unit with no retreats: " << unit.loc;
-        next.remove_dislodged_unit(unit);
-        any_disbands = true;
+    LocMap<DislodgedUnit> dislodged_units(next.get_dislodged_units_map());
+    for (const auto &it : dislodged_units) {
+      if (!next.has_any_retreat(it.second)) {
+        DLOG(INFO) << "Disbanded unit with no retreats: " << it.first;
+        next.remove_dislodged_unit(it.second.unit);
       } else {
         any_retreats = true;
       }
     }
 
-    if (any_disbands) {
-      // Units previously thought to need a retreat are now disbanded, so
-      // recalculate possible orders
-      next.clear_all_possible_orders();
-    }
-
     if (any_retreats) {
       // Some units still need to retreat, so progress to retreat phase
       return next;
@@ -1541,6 +1526,10 @@ GameState GameState::build_next_state(const Resolution &r) const {
   if (next.get_phase().season == 'W') {
     next.maybe_skip_winter_or_finish();
   }
+  if (next.get_phase().phase_type == 'M') {
+    // Let the next movement phase reuse unaffected units' possible orders
+    next.parent_lazy_orders_ = std::atomic_load(&lazy_orders_);
+  }
 
   return next;
 }
@@ -0,0 +1,50 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <memory>
+
+#include "arena.h"
+#include "checks.h"
+
+namespace dipcc {
+
+namespace {
+
+// Enough for the scratch space of a movement phase with convoys; a job that
+// needs more gets it from upstream until the arena is reset
+const size_t INITIAL_ARENA_BYTES = 64 * 1024;
+
+struct ThreadArena {
+  std::unique_ptr<char[]> buffer{new char[INITIAL_ARENA_BYTES]};
+  std::pmr::monotonic_buffer_resource resource{
+      buffer.get(), INITIAL_ARENA_BYTES, std::pmr::new_delete_resource()};
+  int depth = 0;
+};
+
+ThreadArena &get_thread_arena() {
+  thread_local ThreadArena arena;
+  return arena;
+}
+
+} // namespace
+
+ArenaScope::ArenaScope() { ++get_thread_arena().depth; }
+
+ArenaScope::~ArenaScope() {
+  ThreadArena &arena = get_thread_arena();
+  if (--arena.depth == 0) {
+    arena.resource.release();
+  }
+}
+
+std::pmr::memory_resource *thread_arena() {
+  ThreadArena &arena = get_thread_arena();
+  JCHECK(arena.depth > 0, "thread_arena outside of an ArenaScope");
+  return &arena.resource;
+}
+
+} // namespace dipcc
@@ -0,0 +1,36 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <memory_resource>
+
+// Per-thread arena for short-lived containers, so that scratch vectors of
+// the adjudicator and possible-order loaders do not contend for malloc
+// across ThreadPool workers.
+
+namespace dipcc {
+
+// While alive, thread_arena() hands out memory from the calling thread's
+// monotonic arena. The arena is reset when the outermost scope of the thread
+// exits, e.g. after each ThreadPool job, so containers using it must not
+// outlive the scope they were made in. Nested scopes are free.
+class ArenaScope {
+public:
+  ArenaScope();
+  ~ArenaScope();
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+};
+
+// The calling thread's arena. Requires an ArenaScope on the thread, e.g.
+//
+//   ArenaScope arena_scope;
+//   std::pmr::vector<Order> orders(thread_arena());
+std::pmr::memory_resource *thread_arena();
+
+} // namespace dipcc
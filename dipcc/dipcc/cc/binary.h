@@ -0,0 +1,120 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "checks.h"
+
+namespace dipcc {
+
+// Little-endian fixed-width integers, LEB128 varints and length-prefixed
+// strings, used by Game::to_bytes / Game::from_bytes
+class BinaryWriter {
+public:
+  void write_u8(uint8_t x) { buf_.push_back(static_cast<char>(x)); }
+  void write_u16(uint16_t x) { write_fixed(x); }
+  void write_u32(uint32_t x) { write_fixed(x); }
+  void write_u64(uint64_t x) { write_fixed(x); }
+
+  void write_varint(uint64_t x) {
+    while (x >= 0x80) {
+      write_u8(static_cast<uint8_t>(x) | 0x80);
+      x >>= 7;
+    }
+    write_u8(static_cast<uint8_t>(x));
+  }
+
+  void write_string(const std::string &s) {
+    write_varint(s.size());
+    buf_.append(s);
+  }
+
+  void write_raw(const void *p, size_t n) {
+    buf_.append(static_cast<const char *>(p), n);
+  }
+
+  std::string &get() { return buf_; }
+
+private:
+  template <typename T> void write_fixed(T x) {
+    char b[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      b[i] = static_cast<char>(x >> (8 * i));
+    }
+    buf_.append(b, sizeof(T));
+  }
+
+  std::string buf_;
+};
+
+// Reads from a buffer without copying it. The buffer must outlive the reader.
+class BinaryReader {
+public:
+  BinaryReader(std::string_view data) : data_(data) {}
+
+  uint8_t read_u8() {
+    require(1);
+    return static_cast<uint8_t>(data_[pos_++]);
+  }
+  uint16_t read_u16() { return read_fixed<uint16_t>(); }
+  uint32_t read_u32() { return read_fixed<uint32_t>(); }
+  uint64_t read_u64() { return read_fixed<uint64_t>(); }
+
+  uint64_t read_varint() {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t b = read_u8();
+      x |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        return x;
+      }
+    }
+    JFAIL("BinaryReader bad varint");
+  }
+
+  std::string_view read_string() {
+    size_t n = read_varint();
+    require(n);
+    std::string_view s = data_.substr(pos_, n);
+    pos_ += n;
+    return s;
+  }
+
+  const char *read_raw(size_t n) {
+    require(n);
+    const char *p = data_.data() + pos_;
+    pos_ += n;
+    return p;
+  }
+
+  bool at_end() const { return pos_ == data_.size(); }
+
+private:
+  void require(size_t n) const {
+    JCHECK(n <= data_.size() - pos_, "BinaryReader truncated input");
+  }
+
+  template <typename T> T read_fixed() {
+    require(sizeof(T));
+    T x = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      x |= static_cast<T>(static_cast<uint8_t>(data_[pos_ + i])) << (8 * i);
+    }
+    pos_ += sizeof(T);
+    return x;
+  }
+
+  std::string_view data_;
+  size_t pos_ = 0;
+};
+
+} // namespace dipcc
@@ -0,0 +1,313 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DIPCC_X86 1
+#endif
+
+#include "cfr_kernels.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+/////////////
+// Scalar  //
+/////////////
+
+float dot_scalar(const float *a, const float *b, int n) {
+  float r = 0;
+  for (int i = 0; i < n; ++i) {
+    r += a[i] * b[i];
+  }
+  return r;
+}
+
+void scale_scalar(float *x, float c, int n) {
+  for (int i = 0; i < n; ++i) {
+    x[i] *= c;
+  }
+}
+
+float update_regrets_scalar(const float *utilities, float state_utility,
+                            float *cum_regrets, float *last_regrets,
+                            float *cum_sigma, float *sigma, bool optimistic,
+                            int n) {
+  float sum = 0;
+  for (int i = 0; i < n; ++i) {
+    float regret = utilities[i] - state_utility;
+    cum_regrets[i] += regret;
+    last_regrets[i] = regret;
+    cum_sigma[i] += sigma[i];
+    sigma[i] = max(0.0f, cum_regrets[i] + (optimistic ? regret : 0));
+    sum += sigma[i];
+  }
+  return sum;
+}
+
+void normalize_scalar(float *sigma, float sum, int n) {
+  for (int i = 0; i < n; ++i) {
+    sigma[i] = sum == 0 ? 1.0f / n : sigma[i] / sum;
+  }
+}
+
+#ifdef DIPCC_X86
+
+//////////
+// AVX2 //
+//////////
+
+__attribute__((target("avx2,fma"))) float hsum_avx2(__m256 v) {
+  __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+  x = _mm_add_ss(x, _mm_movehdup_ps(x));
+  return _mm_cvtss_f32(x);
+}
+
+__attribute__((target("avx2,fma"))) float dot_avx2(const float *a,
+                                                   const float *b, int n) {
+  __m256 acc = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+  }
+  return hsum_avx2(acc) + dot_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void scale_avx2(float *x, float c, int n) {
+  __m256 vc = _mm256_set1_ps(c);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), vc));
+  }
+  scale_scalar(x + i, c, n - i);
+}
+
+__attribute__((target("avx2,fma"))) float
+update_regrets_avx2(const float *utilities, float state_utility,
+                    float *cum_regrets, float *last_regrets, float *cum_sigma,
+                    float *sigma, bool optimistic, int n) {
+  __m256 vs = _mm256_set1_ps(state_utility);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 acc = zero;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 regret = _mm256_sub_ps(_mm256_loadu_ps(utilities + i), vs);
+    __m256 cum = _mm256_add_ps(_mm256_loadu_ps(cum_regrets + i), regret);
+    _mm256_storeu_ps(cum_regrets + i, cum);
+    _mm256_storeu_ps(last_regrets + i, regret);
+    __m256 s = _mm256_loadu_ps(sigma + i);
+    _mm256_storeu_ps(cum_sigma + i,
+                     _mm256_add_ps(_mm256_loadu_ps(cum_sigma + i), s));
+    __m256 pos =
+        _mm256_max_ps(zero, optimistic ? _mm256_add_ps(cum, regret) : cum);
+    _mm256_storeu_ps(sigma + i, pos);
+    acc = _mm256_add_ps(acc, pos);
+  }
+  return hsum_avx2(acc) +
+         update_regrets_scalar(utilities + i, state_utility, cum_regrets + i,
+                               last_regrets + i, cum_sigma + i, sigma + i,
+                               optimistic, n - i);
+}
+
+__attribute__((target("avx2,fma"))) void normalize_avx2(float *sigma,
+                                                        float sum, int n) {
+  if (sum == 0) {
+    fill(sigma, sigma + n, 1.0f / n);
+    return;
+  }
+  // Divide rather than multiply by 1 / sum, to match the scalar results
+  __m256 vsum = _mm256_set1_ps(sum);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(sigma + i,
+                     _mm256_div_ps(_mm256_loadu_ps(sigma + i), vsum));
+  }
+  for (; i < n; ++i) {
+    sigma[i] /= sum;
+  }
+}
+
+////////////
+// AVX512 //
+////////////
+
+// Like _mm512_reduce_add_ps, whose lane extracts trip -Wuninitialized in
+// GCC's headers
+__attribute__((target("avx512f"))) float hsum_avx512(__m512 v) {
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, v);
+  return hsum_avx2(
+      _mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8)));
+}
+
+__attribute__((target("avx512f"))) float dot_avx512(const float *a,
+                                                    const float *b, int n) {
+  __m512 acc = _mm512_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc);
+  }
+  if (i < n) {
+    __mmask16 mask = (1u << (n - i)) - 1;
+    acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                          _mm512_maskz_loadu_ps(mask, b + i), acc);
+  }
+  return hsum_avx512(acc);
+}
+
+__attribute__((target("avx512f"))) void scale_avx512(float *x, float c,
+                                                     int n) {
+  __m512 vc = _mm512_set1_ps(c);
+  for (int i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? 0xffff : (1u << (n - i)) - 1;
+    _mm512_mask_storeu_ps(
+        x + i, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, x + i), vc));
+  }
+}
+
+__attribute__((target("avx512f"))) float
+update_regrets_avx512(const float *utilities, float state_utility,
+                      float *cum_regrets, float *last_regrets, float *cum_sigma,
+                      float *sigma, bool optimistic, int n) {
+  __m512 vs = _mm512_set1_ps(state_utility);
+  __m512 zero = _mm512_setzero_ps();
+  __m512 acc = zero;
+  for (int i = 0; i < n; i += 16) {
+    // Masked lanes load zeros, and so add zero to acc
+    __mmask16 mask = n - i >= 16 ? 0xffff : (1u << (n - i)) - 1;
+    __m512 regret =
+        _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, utilities + i), vs);
+    __m512 cum =
+        _mm512_add_ps(_mm512_maskz_loadu_ps(mask, cum_regrets + i), regret);
+    _mm512_mask_storeu_ps(cum_regrets + i, mask, cum);
+    _mm512_mask_storeu_ps(last_regrets + i, mask, regret);
+    __m512 s = _mm512_maskz_loadu_ps(mask, sigma + i);
+    _mm512_mask_storeu_ps(
+        cum_sigma + i, mask,
+        _mm512_add_ps(_mm512_maskz_loadu_ps(mask, cum_sigma + i), s));
+    __m512 pos = _mm512_maskz_max_ps(
+        mask, zero, optimistic ? _mm512_add_ps(cum, regret) : cum);
+    _mm512_mask_storeu_ps(sigma + i, mask, pos);
+    acc = _mm512_add_ps(acc, pos);
+  }
+  return hsum_avx512(acc);
+}
+
+__attribute__((target("avx512f"))) void normalize_avx512(float *sigma,
+                                                         float sum, int n) {
+  if (sum == 0) {
+    fill(sigma, sigma + n, 1.0f / n);
+    return;
+  }
+  __m512 vsum = _mm512_set1_ps(sum);
+  for (int i = 0; i < n; i += 16) {
+    __mmask16 mask = n - i >= 16 ? 0xffff : (1u << (n - i)) - 1;
+    _mm512_mask_storeu_ps(
+        sigma + i, mask,
+        _mm512_div_ps(_mm512_maskz_loadu_ps(mask, sigma + i), vsum));
+  }
+}
+
+#endif // DIPCC_X86
+
+////////////////
+// Dispatch   //
+////////////////
+
+struct Kernels {
+  float (*dot)(const float *, const float *, int);
+  void (*scale)(float *, float, int);
+  float (*update_regrets)(const float *, float, float *, float *, float *,
+                          float *, bool, int);
+  void (*normalize)(float *, float, int);
+};
+
+const Kernels kKernels[] = {
+    {dot_scalar, scale_scalar, update_regrets_scalar, normalize_scalar},
+#ifdef DIPCC_X86
+    {dot_avx2, scale_avx2, update_regrets_avx2, normalize_avx2},
+    {dot_avx512, scale_avx512, update_regrets_avx512, normalize_avx512},
+#endif
+};
+
+SimdLevel detect_max_simd_level() {
+#ifdef DIPCC_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SimdLevel::AVX2;
+  }
+#endif
+  return SimdLevel::SCALAR;
+}
+
+// AVX-512 is opt-in: with the few hundred actions of a search, the
+// frequency drop of 512-bit instructions costs more than the wider lanes gain
+atomic<SimdLevel> simd_level{min(get_max_simd_level(), SimdLevel::AVX2)};
+
+const Kernels &kernels() {
+  return kKernels[static_cast<int>(simd_level.load(memory_order_relaxed))];
+}
+
+} // namespace
+
+SimdLevel get_max_simd_level() {
+  static const SimdLevel max_level = detect_max_simd_level();
+  return max_level;
+}
+
+SimdLevel get_simd_level() { return simd_level; }
+
+SimdLevel set_simd_level(SimdLevel level) {
+  simd_level = min(level, get_max_simd_level());
+  return simd_level;
+}
+
+const char *simd_level_name(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::SCALAR:
+    return "scalar";
+  case SimdLevel::AVX2:
+    return "avx2";
+  case SimdLevel::AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
+
+namespace cfr_kernels {
+
+float dot(const float *a, const float *b, int n) {
+  return kernels().dot(a, b, n);
+}
+
+void scale(float *x, float c, int n) { kernels().scale(x, c, n); }
+
+float update_regrets(const float *utilities, float state_utility,
+                     float *cum_regrets, float *last_regrets, float *cum_sigma,
+                     float *sigma, bool optimistic, int n) {
+  return kernels().update_regrets(utilities, state_utility, cum_regrets,
+                                  last_regrets, cum_sigma, sigma, optimistic,
+                                  n);
+}
+
+void normalize(float *sigma, float sum, int n) {
+  kernels().normalize(sigma, sum, n);
+}
+
+} // namespace cfr_kernels
+
+} // namespace dipcc
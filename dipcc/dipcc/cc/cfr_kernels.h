@@ -0,0 +1,51 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+namespace dipcc {
+
+// Instruction sets of the CFR kernels, detected at startup, so the build
+// needs no -march flags. AVX2 is used by default if supported, and AVX512
+// only if set with set_simd_level.
+enum class SimdLevel { SCALAR = 0, AVX2 = 1, AVX512 = 2 };
+
+SimdLevel get_max_simd_level();
+SimdLevel get_simd_level();
+
+// Use at most level, e.g. SCALAR to compare against the vectorized kernels.
+// Returns the level in use.
+SimdLevel set_simd_level(SimdLevel level);
+
+const char *simd_level_name(SimdLevel level);
+
+// Vectorized loops of CFRSolver over the n float values of a power's actions.
+// Vector results may differ from the scalar ones by float rounding, as sums
+// are accumulated in a different order.
+namespace cfr_kernels {
+
+// sum_i a[i] * b[i]
+float dot(const float *a, const float *b, int n);
+
+// x[i] *= c
+void scale(float *x, float c, int n);
+
+// With regret[i] = utilities[i] - state_utility:
+//   cum_regrets[i] += regret[i], last_regrets[i] = regret[i],
+//   cum_sigma[i] += sigma[i],
+//   sigma[i] = max(0, cum_regrets[i] + (optimistic ? last_regrets[i] : 0))
+// Returns the sum of the new sigma, to be passed to normalize.
+float update_regrets(const float *utilities, float state_utility,
+                     float *cum_regrets, float *last_regrets, float *cum_sigma,
+                     float *sigma, bool optimistic, int n);
+
+// sigma[i] /= sum, or sigma[i] = 1 / n if sum is 0
+void normalize(float *sigma, float sum, int n);
+
+} // namespace cfr_kernels
+
+} // namespace dipcc
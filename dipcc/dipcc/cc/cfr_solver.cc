@@ -0,0 +1,233 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "cfr_kernels.h"
+#include "cfr_solver.h"
+#include "checks.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+vector<float> normalized(vector<float> xs) {
+  float sum = 0;
+  for (float x : xs) {
+    sum += x;
+  }
+  for (float &x : xs) {
+    x = sum > 0 ? x / sum : 1.0 / xs.size();
+  }
+  return xs;
+}
+
+} // namespace
+
+CFRSolver::CFRSolver(const vector<vector<float>> &bp_probs, bool optimistic,
+                     uint64_t seed)
+    : optimistic_(optimistic), rng_(seed) {
+  JCHECK(bp_probs.size() == 7, "CFRSolver: expected bp_probs for 7 powers");
+  offsets_[0] = 0;
+  for (int p = 0; p < 7; ++p) {
+    offsets_[p + 1] = offsets_[p] + bp_probs[p].size();
+    float sum = 0;
+    for (int i = 0; i < bp_probs[p].size(); ++i) {
+      JCHECK(bp_probs[p][i] >= 0, "CFRSolver: negative bp prob");
+      sum += bp_probs[p][i];
+      action_idxs_.push_back(i);
+      bp_.push_back(bp_probs[p][i]);
+      sigma_.push_back(1.0 / bp_probs[p].size());
+    }
+    JCHECK(bp_probs[p].empty() || sum > 0, "CFRSolver: zero bp probs");
+  }
+  size_t n = offsets_[7];
+  cum_sigma_.assign(n, 0);
+  cum_regrets_.assign(n, 0);
+  last_regrets_.assign(n, 0);
+  iter_ps_.assign(n, 0);
+  sampled_.fill(-1);
+}
+
+vector<int> CFRSolver::get_action_idxs(int power) const {
+  return vector<int>(action_idxs_.begin() + offsets_[power],
+                     action_idxs_.begin() + offsets_[power + 1]);
+}
+
+double CFRSolver::start_iter() {
+  ++iter_;
+  float discount = (iter_ + 0.000001) / (iter_ + 1);
+  cfr_kernels::scale(cum_regrets_.data(), discount, cum_regrets_.size());
+  cfr_kernels::scale(cum_sigma_.data(), discount, cum_sigma_.size());
+  for (int p = 0; p < 7; ++p) {
+    if (get_n_actions(p) > 0) {
+      cum_utility_[p] *= discount;
+    }
+  }
+  iter_weight_ = iter_weight_ * discount + 1.0;
+  return iter_weight_;
+}
+
+vector<float> CFRSolver::strategy(int power) const {
+  return vector<float>(sigma_.begin() + offsets_[power],
+                       sigma_.begin() + offsets_[power + 1]);
+}
+
+vector<float> CFRSolver::avg_strategy(int power) const {
+  return normalized(vector<float>(cum_sigma_.begin() + offsets_[power],
+                                  cum_sigma_.begin() + offsets_[power + 1]));
+}
+
+vector<float> CFRSolver::bp_strategy(int power, float temperature) const {
+  vector<float> r(bp_.begin() + offsets_[power],
+                  bp_.begin() + offsets_[power + 1]);
+  if (temperature != 1.0) {
+    for (float &x : r) {
+      x = pow(x, 1.0 / temperature);
+    }
+  }
+  return normalized(move(r));
+}
+
+vector<float> CFRSolver::avg_action_utilities(int power) const {
+  vector<float> r;
+  for (int i = offsets_[power]; i < offsets_[power + 1]; ++i) {
+    r.push_back((cum_regrets_[i] + cum_utility_[power]) / iter_weight_);
+  }
+  return r;
+}
+
+float CFRSolver::avg_utility(int power) const {
+  return cum_utility_[power] / iter_weight_;
+}
+
+array<int, 7> CFRSolver::sample(const array<bool, 7> &use_bp) {
+  uniform_real_distribution<float> uniform(0, 1);
+  for (int p = 0; p < 7; ++p) {
+    int n = get_n_actions(p);
+    if (n == 0) {
+      sampled_[p] = -1;
+      continue;
+    }
+    // The blueprint is normalized over the remaining actions
+    const float *weights =
+        (use_bp[p] ? bp_.data() : sigma_.data()) + offsets_[p];
+    float *ps = iter_ps_.data() + offsets_[p];
+    float sum = 0;
+    for (int i = 0; i < n; ++i) {
+      sum += weights[i];
+    }
+    copy(weights, weights + n, ps);
+    cfr_kernels::normalize(ps, sum, n);
+
+    // Inverse CDF, falling back to the last action with a non-zero
+    // probability on rounding errors
+    float u = uniform(rng_);
+    int sampled = -1;
+    for (int i = 0; i < n; ++i) {
+      if (ps[i] > 0) {
+        sampled = i;
+        u -= ps[i];
+        if (u < 0) {
+          break;
+        }
+      }
+    }
+    sampled_[p] = sampled;
+  }
+  return sampled_;
+}
+
+vector<array<int, 7>> CFRSolver::get_joint_action_idxs() const {
+  vector<array<int, 7>> r;
+  r.reserve(offsets_[7]);
+  for (int p = 0; p < 7; ++p) {
+    for (int i = 0; i < get_n_actions(p); ++i) {
+      r.push_back(sampled_);
+      r.back()[p] = i;
+    }
+  }
+  return r;
+}
+
+array<float, 7> CFRSolver::update(const vector<array<float, 7>> &utilities) {
+  JCHECK(utilities.size() == offsets_[7],
+         "CFRSolver::update: expected one row per joint action");
+  vector<float> action_utilities;
+  array<float, 7> state_utilities{};
+  for (int p = 0; p < 7; ++p) {
+    int n = get_n_actions(p);
+    if (n == 0) {
+      continue;
+    }
+    JCHECK(sampled_[p] >= 0, "CFRSolver::update: called before sample");
+    action_utilities.resize(n);
+    for (int i = 0; i < n; ++i) {
+      action_utilities[i] = utilities[offsets_[p] + i][p];
+    }
+    float state_utility = cfr_kernels::dot(iter_ps_.data() + offsets_[p],
+                                           action_utilities.data(), n);
+    state_utilities[p] = state_utility;
+    cum_utility_[p] += state_utility;
+    update_power(p, action_utilities.data(), state_utility);
+  }
+  return state_utilities;
+}
+
+void CFRSolver::update_power(int power, const float *action_utilities,
+                             float state_utility) {
+  int start = offsets_[power], n = get_n_actions(power);
+  float sum_pos_regrets = cfr_kernels::update_regrets(
+      action_utilities, state_utility, cum_regrets_.data() + start,
+      last_regrets_.data() + start, cum_sigma_.data() + start,
+      sigma_.data() + start, optimistic_, n);
+  cfr_kernels::normalize(sigma_.data() + start, sum_pos_regrets, n);
+}
+
+vector<pair<int, int>> CFRSolver::prune(float ave_regret_thresh,
+                                        float ave_strat_thresh) {
+  vector<pair<int, int>> pruned;
+  if (iter_weight_ == 0) {
+    return pruned;
+  }
+  array<int, 8> new_offsets;
+  new_offsets[0] = 0;
+  int k = 0; // next kept slot
+  for (int p = 0; p < 7; ++p) {
+    for (int j = offsets_[p]; j < offsets_[p + 1]; ++j) {
+      if (cum_regrets_[j] / iter_weight_ < ave_regret_thresh &&
+          cum_sigma_[j] / iter_weight_ < ave_strat_thresh && sigma_[j] == 0) {
+        pruned.push_back({p, action_idxs_[j]});
+        continue;
+      }
+      action_idxs_[k] = action_idxs_[j];
+      bp_[k] = bp_[j];
+      sigma_[k] = sigma_[j];
+      cum_sigma_[k] = cum_sigma_[j];
+      cum_regrets_[k] = cum_regrets_[j];
+      last_regrets_[k] = last_regrets_[j];
+      iter_ps_[k] = iter_ps_[j];
+      ++k;
+    }
+    new_offsets[p + 1] = k;
+  }
+  for (auto *v : {&bp_, &sigma_, &cum_sigma_, &cum_regrets_, &last_regrets_,
+                  &iter_ps_}) {
+    v->resize(k);
+  }
+  action_idxs_.resize(k);
+  offsets_ = new_offsets;
+  if (!pruned.empty()) {
+    sampled_.fill(-1); // positions have moved
+  }
+  return pruned;
+}
+
+} // namespace dipcc
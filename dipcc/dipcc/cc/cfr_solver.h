@@ -0,0 +1,112 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace dipcc {
+
+// One-ply linear CFR over each power's plausible actions, as in
+// SearchBotAgent.get_all_power_prob_distributions.
+//
+// Powers are indexed 0-6 in POWERS order and actions by their position in
+// the power's plausible actions list. Per-action state is kept in flat
+// buffers, one contiguous slice per power. Pruned actions are removed from
+// the slices; get_action_idxs maps the remaining positions back to the
+// original ones.
+//
+// An iteration is:
+//   solver.start_iter();                 // linear CFR discount
+//   solver.sample(use_bp);               // opponent actions
+//   idxs = solver.get_joint_action_idxs();
+//   ... run one rollout per row of idxs ...
+//   solver.update(utilities);            // [rows, 7] rollout values
+class CFRSolver {
+public:
+  // bp_probs[power] are the blueprint probabilities of the power's actions,
+  // unnormalized. If optimistic, the current strategy is computed from the
+  // cumulative plus the last regrets. seed seeds the sampling of joint
+  // actions, so that searches are reproducible.
+  CFRSolver(const std::vector<std::vector<float>> &bp_probs, bool optimistic,
+            uint64_t seed);
+
+  int get_n_actions(int power) const {
+    return offsets_[power + 1] - offsets_[power];
+  }
+  // Original positions of the power's remaining actions
+  std::vector<int> get_action_idxs(int power) const;
+
+  int get_iter() const { return iter_; }
+  double get_iter_weight() const { return iter_weight_; }
+
+  // Discount the cumulative regrets, strategies and utilities by t / (t + 1)
+  // and start iteration t. Returns the iteration weight, i.e. the sum of the
+  // discounted iteration weights.
+  double start_iter();
+
+  // Probabilities over the power's remaining actions
+  std::vector<float> strategy(int power) const;
+  std::vector<float> avg_strategy(int power) const;
+  std::vector<float> bp_strategy(int power, float temperature = 1.0) const;
+
+  // Per power, the cumulative utility of each action over the iterations,
+  // divided by the iteration weight (see SearchBotAgent.is_loser)
+  std::vector<float> avg_action_utilities(int power) const;
+  float avg_utility(int power) const;
+
+  // Sample an action per power, from the blueprint for the powers with
+  // use_bp set and from the current strategy for the others. Returns the
+  // sampled position of each power, or -1 for powers with no actions. The
+  // sampling probabilities are kept for update().
+  std::array<int, 7> sample(const std::array<bool, 7> &use_bp);
+  const std::array<int, 7> &get_sampled() const { return sampled_; }
+
+  // Joint actions to evaluate for the sampled iteration, as positions per
+  // power: for each power in order and each of its actions, the sampled
+  // actions with the power's own replaced. Rows of powers with no actions
+  // are skipped.
+  std::vector<std::array<int, 7>> get_joint_action_idxs() const;
+
+  // Update regrets and strategies given utilities[i][p], the value for
+  // power p of joint action i of get_joint_action_idxs(). Returns the
+  // sampled state utility of each power.
+  std::array<float, 7>
+  update(const std::vector<std::array<float, 7>> &utilities);
+
+  // Remove actions not played by the current strategy whose average regret
+  // and average strategy are below the thresholds. Returns the (power,
+  // original position) of the pruned actions.
+  std::vector<std::pair<int, int>> prune(float ave_regret_thresh,
+                                         float ave_strat_thresh);
+
+private:
+  void update_power(int power, const float *action_utilities,
+                    float state_utility);
+
+  std::array<int, 8> offsets_; // power p's slice is [offsets_[p], offsets_[p+1])
+  std::vector<int> action_idxs_;
+  std::vector<float> bp_;
+  std::vector<float> sigma_;
+  std::vector<float> cum_sigma_;
+  std::vector<float> cum_regrets_;
+  std::vector<float> last_regrets_;
+  std::vector<float> iter_ps_; // sampling probabilities of this iteration
+  std::array<float, 7> cum_utility_{};
+
+  bool optimistic_;
+  int iter_ = -1;
+  double iter_weight_ = 0;
+  std::array<int, 7> sampled_;
+  std::mt19937 rng_;
+};
+
+} // namespace dipcc
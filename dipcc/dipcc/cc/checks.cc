@@ -19,6 +19,12 @@ void JCHECK(bool b, const std::string &msg) {
   }
 }
 
+void JCHECK(bool b, const char *msg) {
+  if (!b) {
+    throw std::runtime_error(msg);
+  }
+}
+
 void JCHECK(bool b) {
   if (!b) {
     throw std::runtime_error("JCHECK failed");
@@ -13,6 +13,8 @@ LICENSE file in the root directory of this source tree.
 namespace dipcc {
 
 void JCHECK(bool b, const std::string &msg);
+// Builds no string unless the check fails, for hot paths
+void JCHECK(bool b, const char *msg);
 void JCHECK(bool b);
 
 [[ noreturn ]] void JFAIL(const std::string &msg);
@@ -0,0 +1,102 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "compact_states.h"
+#include "checks.h"
+
+namespace dipcc {
+
+namespace {
+
+// Record types
+const uint8_t KEYFRAME = 0;
+const uint8_t DELTA = 1;
+
+} // namespace
+
+void StateHistoryWriter::add(std::shared_ptr<GameState> state,
+                             BinaryWriter &writer) {
+  if (prev_ == nullptr || n_ % keyframe_interval_ == 0) {
+    writer.write_u8(KEYFRAME);
+    state->to_bytes(writer);
+  } else {
+    writer.write_u8(DELTA);
+    state->to_bytes_delta(*prev_, writer);
+  }
+  prev_ = std::move(state);
+  ++n_;
+}
+
+void StateHistoryWriter::add_all(const CompactStates &compact,
+                                 BinaryWriter &writer) {
+  // Its records start with a keyframe, so they don't depend on prev_
+  if (compact.size() > 0) {
+    writer.write_raw(compact.get_data().data(), compact.get_data().size());
+    prev_ = compact.get(compact.size() - 1);
+    n_ += compact.size();
+  }
+}
+
+std::shared_ptr<GameState> StateHistoryReader::next(BinaryReader &reader) {
+  uint8_t type = reader.read_u8();
+  if (type == KEYFRAME) {
+    prev_ = std::make_shared<GameState>(reader);
+  } else {
+    JCHECK(type == DELTA && prev_ != nullptr, "from_bytes bad state record");
+    prev_ = std::make_shared<GameState>(reader, *prev_);
+  }
+  return prev_;
+}
+
+CompactStates::CompactStates(
+    const std::vector<std::shared_ptr<GameState>> &states,
+    size_t keyframe_interval)
+    : keyframe_interval_(keyframe_interval) {
+  JCHECK(keyframe_interval > 0, "CompactStates keyframe_interval must be > 0");
+  BinaryWriter writer;
+  StateHistoryWriter history_writer(keyframe_interval);
+  phases_.reserve(states.size());
+  offsets_.reserve(states.size());
+  for (auto &state : states) {
+    phases_.push_back(state->get_phase());
+    offsets_.push_back(writer.get().size());
+    history_writer.add(state, writer);
+  }
+  data_ = std::move(writer.get());
+  data_.shrink_to_fit();
+}
+
+std::shared_ptr<GameState> CompactStates::get(size_t i) const {
+  JCHECK(i < size(), "CompactStates::get out of range");
+  size_t keyframe = i - i % keyframe_interval_;
+  BinaryReader reader(
+      std::string_view(data_).substr(offsets_[keyframe]));
+  StateHistoryReader history_reader;
+  std::shared_ptr<GameState> state;
+  for (size_t k = keyframe; k <= i; ++k) {
+    state = history_reader.next(reader);
+  }
+  return state;
+}
+
+std::vector<std::shared_ptr<GameState>> CompactStates::get_all() const {
+  std::vector<std::shared_ptr<GameState>> r;
+  r.reserve(size());
+  BinaryReader reader(data_);
+  StateHistoryReader history_reader;
+  for (size_t i = 0; i < size(); ++i) {
+    r.push_back(history_reader.next(reader));
+  }
+  return r;
+}
+
+size_t CompactStates::heap_bytes() const {
+  return data_.capacity() + phases_.capacity() * sizeof(Phase) +
+         offsets_.capacity() * sizeof(uint32_t);
+}
+
+} // namespace dipcc
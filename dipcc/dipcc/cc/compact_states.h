@@ -0,0 +1,84 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "binary.h"
+#include "game_state.h"
+#include "phase.h"
+
+namespace dipcc {
+
+class CompactStates;
+
+// The states of consecutive phases of a game, encoded as in the states block
+// of Game::to_bytes: a record per state, either a keyframe (the full
+// GameState::to_bytes) or the changes since the previous state (see
+// GameState::to_bytes_delta). Consecutive phases differ by a few units, so a
+// delta is a small fraction of a keyframe.
+class StateHistoryWriter {
+public:
+  explicit StateHistoryWriter(size_t keyframe_interval)
+      : keyframe_interval_(keyframe_interval) {}
+
+  // Add the next state, which the writer keeps until the next add
+  void add(std::shared_ptr<GameState> state, BinaryWriter &writer);
+  // Add the states of compact, copying their records
+  void add_all(const CompactStates &compact, BinaryWriter &writer);
+
+private:
+  size_t keyframe_interval_;
+  size_t n_ = 0;
+  std::shared_ptr<GameState> prev_;
+};
+
+// Reads the records of a StateHistoryWriter in order
+class StateHistoryReader {
+public:
+  std::shared_ptr<GameState> next(BinaryReader &reader);
+
+private:
+  std::shared_ptr<GameState> prev_;
+};
+
+// Immutable, delta-encoded states of consecutive phases, for the history of
+// long games (see Game::compact_history). Reading a state decodes it from the
+// keyframe before it, so at most keyframe_interval records.
+class CompactStates {
+public:
+  static constexpr size_t DEFAULT_KEYFRAME_INTERVAL = 8;
+
+  // states must be in phase order
+  CompactStates(const std::vector<std::shared_ptr<GameState>> &states,
+                size_t keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+
+  size_t size() const { return phases_.size(); }
+  const std::vector<Phase> &get_phases() const { return phases_; }
+  size_t get_keyframe_interval() const { return keyframe_interval_; }
+
+  // The i-th state, decoded anew on each call
+  std::shared_ptr<GameState> get(size_t i) const;
+  // All states, decoded in one pass
+  std::vector<std::shared_ptr<GameState>> get_all() const;
+
+  // The records, as written by a StateHistoryWriter
+  const std::string &get_data() const { return data_; }
+
+  size_t heap_bytes() const;
+
+private:
+  std::string data_;
+  std::vector<Phase> phases_;
+  std::vector<uint32_t> offsets_; // of each state's record in data_
+  size_t keyframe_interval_;
+};
+
+} // namespace dipcc
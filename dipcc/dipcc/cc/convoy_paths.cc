@@ -0,0 +1,80 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <unordered_map>
+
+#include "adjacencies.h"
+#include "convoy_paths.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+// Bound on cached fleet layouts per thread. The cache is simply dropped when
+// full: in practice a few hundred layouts cover a whole rollout batch.
+const size_t MAX_CACHED_LAYOUTS = 4096;
+
+struct HashLocSet {
+  size_t operator()(const LocSet &s) const {
+    return s.words()[0] * 0x9e3779b97f4a7c15ULL ^ s.words()[1];
+  }
+};
+
+vector<ConvoyComponent> compute_convoy_components(LocSet fleets) {
+  vector<ConvoyComponent> components;
+  while (!fleets.empty()) {
+    ConvoyComponent component;
+    LocSet todo;
+    todo.insert(*fleets.begin());
+    while (!todo.empty()) {
+      Loc loc = *todo.begin();
+      todo.erase(loc);
+      fleets.erase(loc);
+      component.fleets.insert(loc);
+
+      const LocSet &adj = ADJ_F_ALL_COASTS[static_cast<size_t>(loc)];
+      todo |= adj & fleets;
+      for (Loc adj_loc : adj - WATER_LOCS) {
+        component.coasts |= WITH_COASTS_MASK[static_cast<size_t>(adj_loc)];
+      }
+    }
+    components.push_back(component);
+  }
+  return components;
+}
+
+} // namespace
+
+const vector<ConvoyComponent> &
+get_convoy_components(const LocSet &water_fleets) {
+  thread_local unordered_map<LocSet, vector<ConvoyComponent>, HashLocSet>
+      cache;
+
+  auto it = cache.find(water_fleets);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  if (cache.size() >= MAX_CACHED_LAYOUTS) {
+    cache.clear();
+  }
+  return cache.emplace(water_fleets, compute_convoy_components(water_fleets))
+      .first->second;
+}
+
+bool can_convoy(const LocSet &water_fleets, Loc src, Loc dest) {
+  src = root_loc(src);
+  for (const ConvoyComponent &component : get_convoy_components(water_fleets)) {
+    if (component.coasts.contains(src) && component.coasts.contains(dest)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace dipcc
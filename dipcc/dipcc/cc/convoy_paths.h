@@ -0,0 +1,36 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "loc.h"
+#include "loc_map.h"
+
+namespace dipcc {
+
+// A connected group of fleets in water locs, i.e. a possible convoy chain
+struct ConvoyComponent {
+  LocSet fleets;
+
+  // Non-water locs adjacent to any of the fleets, with and without coasts. An
+  // army on one of these can be convoyed to any other of them.
+  LocSet coasts;
+};
+
+// Return the convoy chains formed by a set of water fleets. Results are
+// cached per thread, keyed by the fleet mask, since the same few fleet
+// layouts recur across games and rollouts. The returned reference is valid
+// until the next call on the same thread.
+const std::vector<ConvoyComponent> &
+get_convoy_components(const LocSet &water_fleets);
+
+// Return true if an army at src can be convoyed to dest through water_fleets
+bool can_convoy(const LocSet &water_fleets, Loc src, Loc dest);
+
+} // namespace dipcc
@@ -5,32 +5,343 @@ This source code is licensed under the MIT license found in the
 LICENSE file in the root directory of this source tree.
 */
 
+#include <cstring>
+#include <utility>
+
 #include "data_fields.h"
+#include "checks.h"
 
 namespace dipcc {
 
-TensorDict new_data_fields_state_only(long B) {
-  return {
-      {"x_board_state", torch::empty({B, 81, 35}, torch::kFloat32)},
-      {"x_prev_state", torch::empty({B, 81, 35}, torch::kFloat32)},
-      {"x_prev_orders", torch::empty({B, 2, 100}, torch::kLong)},
-      {"x_season", torch::empty({B, 3}, torch::kFloat32)},
-      {"x_in_adj_phase", torch::empty({B}, torch::kFloat32)},
-      {"x_build_numbers", torch::empty({B, 7}, torch::kFloat32)},
+namespace {
+
+const long BOARD_STATE_WIDTH = 35;
+
+torch::Tensor alloc_board_state(long B, BoardStateFormat format,
+                                const torch::TensorOptions &opts) {
+  switch (format) {
+  case BoardStateFormat::FLOAT32:
+    return torch::empty({B, 81, BOARD_STATE_WIDTH},
+                        opts.dtype(torch::kFloat32));
+  case BoardStateFormat::FLOAT16:
+    return torch::empty({B, 81, BOARD_STATE_WIDTH}, opts.dtype(torch::kHalf));
+  case BoardStateFormat::BFLOAT16:
+    return torch::empty({B, 81, BOARD_STATE_WIDTH},
+                        opts.dtype(torch::kBFloat16));
+  case BoardStateFormat::UINT8:
+    return torch::empty({B, 81, BOARD_STATE_WIDTH}, opts.dtype(torch::kUInt8));
+  case BoardStateFormat::PACKED:
+    return torch::empty({B, 81, BOARD_STATE_PACKED_WIDTH},
+                        opts.dtype(torch::kUInt8));
+  }
+  JFAIL("alloc_board_state: bad BoardStateFormat");
+}
+
+template <typename T>
+void write_board_state_as(const float *board_state, void *r, long n_locs) {
+  T *p = static_cast<T *>(r);
+  for (long i = 0; i < n_locs * BOARD_STATE_WIDTH; ++i) {
+    p[i] = static_cast<T>(board_state[i]);
+  }
+}
+
+// Allocate uninitialized fields. max_seq_len == 0 means state fields only.
+TensorDict alloc_data_fields(long B, long max_seq_len, bool include_power,
+                             bool pin_memory,
+                             BoardStateFormat board_state_format,
+                             bool prev_state_delta) {
+  auto opts = [pin_memory](torch::ScalarType dtype) {
+    return torch::TensorOptions().dtype(dtype).pinned_memory(pin_memory);
   };
+  auto board_opts = torch::TensorOptions().pinned_memory(pin_memory);
+  TensorDict fields{
+      {"x_board_state", alloc_board_state(B, board_state_format, board_opts)},
+      {"x_prev_state", alloc_board_state(B, board_state_format, board_opts)},
+      {"x_prev_orders", torch::empty({B, 2, 100}, opts(torch::kLong))},
+      {"x_season", torch::empty({B, 3}, opts(torch::kFloat32))},
+      {"x_in_adj_phase", torch::empty({B}, opts(torch::kFloat32))},
+      {"x_build_numbers", torch::empty({B, 7}, opts(torch::kFloat32))},
+  };
+  if (prev_state_delta) {
+    fields.erase("x_prev_state");
+  }
+  if (max_seq_len > 0) {
+    fields["x_loc_idxs"] = torch::empty({B, 7, 81}, opts(torch::kInt8));
+    fields["x_possible_actions"] =
+        torch::empty({B, 7, max_seq_len, 469}, opts(torch::kInt32));
+    if (include_power) {
+      fields["x_power"] = torch::empty({B, 7, max_seq_len}, opts(torch::kLong));
+    }
+  }
+  return fields;
 }
 
-TensorDict new_data_fields(long B, long max_seq_len, bool include_power) {
-  TensorDict fields(new_data_fields_state_only(B));
-  fields["x_loc_idxs"] = torch::full({B, 7, 81}, -1, torch::kInt8);
-  fields["x_possible_actions"] =
-      torch::full({B, 7, max_seq_len, 469}, -1, torch::kInt32);
+// Fields trimmed by ThreadPool::set_trim_seq_len are [B, 7, S, ...] views of
+// the front of [B, 7, max_seq_len, ...] buffers: return the full view
+torch::Tensor untrim_seq_len(const torch::Tensor &field) {
+  if (field.numel() == 0) {
+    return field;
+  }
+  long row_numel = field.numel() / field.size(2);
+  long max_seq_len =
+      field.storage().nbytes() / field.element_size() / row_numel;
+  if (max_seq_len == field.size(2)) {
+    return field;
+  }
+  std::vector<int64_t> sizes = field.sizes().vec();
+  sizes[2] = max_seq_len;
+  return field.view(-1).as_strided({row_numel * max_seq_len}, {1}).view(sizes);
+}
 
-  if (include_power) {
-    fields["x_power"] = torch::full({B, 7, max_seq_len}, -1, torch::kLong);
+// Select rows of a CSR field whose offsets have n + 1 elements, row r being
+// values[offsets[r]:offsets[r + 1]]. Return the offsets of the selected rows
+// and the idxs of their values.
+std::pair<torch::Tensor, torch::Tensor>
+select_csr_rows(const torch::Tensor &offsets, const torch::Tensor &rows) {
+  long n = offsets.numel() - 1;
+  torch::Tensor starts = offsets.slice(0, 0, n).index_select(0, rows);
+  torch::Tensor counts = offsets.slice(0, 1).index_select(0, rows) - starts;
+  torch::Tensor new_offsets =
+      torch::zeros({rows.numel() + 1}, offsets.options());
+  new_offsets.slice(0, 1).copy_(counts.cumsum(0));
+  long n_values = new_offsets[rows.numel()].item<long>();
+  torch::Tensor shifts = starts - new_offsets.slice(0, 0, rows.numel());
+  torch::Tensor value_idxs = torch::arange(n_values, offsets.options()) +
+                             shifts.repeat_interleave(counts);
+  return {new_offsets, value_idxs};
+}
+
+} // namespace
+
+BoardStateFormat get_board_state_format(const torch::Tensor &field) {
+  switch (field.scalar_type()) {
+  case torch::kFloat32:
+    return BoardStateFormat::FLOAT32;
+  case torch::kHalf:
+    return BoardStateFormat::FLOAT16;
+  case torch::kBFloat16:
+    return BoardStateFormat::BFLOAT16;
+  case torch::kUInt8:
+    return field.size(-1) == BOARD_STATE_PACKED_WIDTH
+               ? BoardStateFormat::PACKED
+               : BoardStateFormat::UINT8;
+  default:
+    JFAIL("get_board_state_format: bad board state dtype");
+  }
+}
+
+void write_board_state(const float *board_state, BoardStateFormat format,
+                       void *r, long n_locs) {
+  switch (format) {
+  case BoardStateFormat::FLOAT32:
+    memcpy(r, board_state, n_locs * BOARD_STATE_WIDTH * sizeof(float));
+    return;
+  case BoardStateFormat::FLOAT16:
+    write_board_state_as<at::Half>(board_state, r, n_locs);
+    return;
+  case BoardStateFormat::BFLOAT16:
+    write_board_state_as<at::BFloat16>(board_state, r, n_locs);
+    return;
+  case BoardStateFormat::UINT8:
+    write_board_state_as<uint8_t>(board_state, r, n_locs);
+    return;
+  case BoardStateFormat::PACKED: {
+    uint8_t *p = static_cast<uint8_t *>(r);
+    memset(p, 0, n_locs * BOARD_STATE_PACKED_WIDTH);
+    for (long loc = 0; loc < n_locs; ++loc) {
+      const float *x = board_state + loc * BOARD_STATE_WIDTH;
+      uint8_t *y = p + loc * BOARD_STATE_PACKED_WIDTH;
+      for (long c = 0; c < BOARD_STATE_WIDTH; ++c) {
+        y[c / 8] |= static_cast<uint8_t>(x[c] != 0) << (c % 8);
+      }
+    }
+    return;
+  }
+  }
+  JFAIL("write_board_state: bad BoardStateFormat");
+}
+
+torch::Tensor unpack_board_state(const torch::Tensor &field,
+                                 torch::ScalarType dtype) {
+  if (get_board_state_format(field) != BoardStateFormat::PACKED) {
+    return field.to(dtype);
+  }
+  torch::Tensor masks =
+      torch::tensor({1, 2, 4, 8, 16, 32, 64, 128}, torch::kUInt8)
+          .to(field.device());
+  return field.unsqueeze(-1)
+      .bitwise_and(masks)
+      .ne(0)
+      .flatten(-2)
+      .narrow(-1, 0, BOARD_STATE_WIDTH)
+      .to(dtype);
+}
+
+void expand_prev_state_delta(TensorDict &fields) {
+  auto offsets_it = fields.find("x_prev_state_delta_offsets");
+  if (offsets_it == fields.end()) {
+    return;
   }
+  torch::Tensor offsets = offsets_it->second;
+  torch::Tensor board_state = fields.at("x_board_state");
+  long B = board_state.size(0);
+  JCHECK(offsets.numel() == B + 1,
+         "expand_prev_state_delta: bad x_prev_state_delta_offsets");
+  torch::Tensor counts = offsets.slice(0, 1) - offsets.slice(0, 0, B);
+  torch::Tensor games =
+      torch::arange(B, offsets.options()).repeat_interleave(counts);
+  torch::Tensor prev_state = board_state.clone();
+  prev_state.index_put_({games, fields.at("x_prev_state_delta_locs")},
+                        fields.at("x_prev_state_delta_rows"));
+  fields.erase("x_prev_state_delta_offsets");
+  fields.erase("x_prev_state_delta_locs");
+  fields.erase("x_prev_state_delta_rows");
+  fields["x_prev_state"] = prev_state;
+}
+
+TensorDict index_select_fields(const TensorDict &fields, torch::Tensor idxs) {
+  long B = fields.at("x_board_state").size(0);
+  TensorDict r;
+  for (auto &it : fields) {
+    if (it.first.rfind("x_prev_state_delta_", 0) != 0 &&
+        it.first.rfind("x_possible_actions_", 0) != 0) {
+      r[it.first] = it.second.index_select(0, idxs.to(it.second.device()));
+    }
+  }
+
+  auto delta_it = fields.find("x_prev_state_delta_offsets");
+  if (delta_it != fields.end()) {
+    const torch::Tensor &offsets = delta_it->second;
+    JCHECK(offsets.numel() == B + 1,
+           "index_select_fields: bad x_prev_state_delta_offsets");
+    auto selected = select_csr_rows(offsets, idxs.to(offsets.device()));
+    r["x_prev_state_delta_offsets"] = selected.first;
+    for (const char *name :
+         {"x_prev_state_delta_locs", "x_prev_state_delta_rows"}) {
+      r[name] = fields.at(name).index_select(0, selected.second);
+    }
+  }
+
+  auto actions_it = fields.find("x_possible_actions_offsets");
+  if (actions_it != fields.end()) {
+    // B * 7 * max_seq_len rows, of which each game has as many
+    const torch::Tensor &offsets = actions_it->second;
+    JCHECK(B > 0 && (offsets.numel() - 1) % B == 0,
+           "index_select_fields: bad x_possible_actions_offsets");
+    long game_rows = (offsets.numel() - 1) / B;
+    torch::Tensor rows =
+        (idxs.to(offsets.device()).unsqueeze(1) * game_rows +
+         torch::arange(game_rows, offsets.options()))
+            .flatten();
+    auto selected = select_csr_rows(offsets, rows);
+    r["x_possible_actions_offsets"] = selected.first;
+    r["x_possible_actions_values"] = fields.at("x_possible_actions_values")
+                                         .index_select(0, selected.second);
+  }
+  return r;
+}
 
+TensorDict new_data_fields_state_only(long B) {
+  return alloc_data_fields(B, 0, false, false, BoardStateFormat::FLOAT32,
+                           false);
+}
+
+TensorDict new_data_fields(long B, long max_seq_len, bool include_power) {
+  TensorDict fields(alloc_data_fields(B, max_seq_len, include_power, false,
+                                      BoardStateFormat::FLOAT32, false));
+  fields["x_loc_idxs"].fill_(-1);
+  fields["x_possible_actions"].fill_(-1);
+  if (include_power) {
+    fields["x_power"].fill_(-1);
+  }
   return fields;
 }
 
+TensorDict DataFieldsPool::get(long B, long max_seq_len, bool include_power) {
+  bool pin_memory;
+  BoardStateFormat board_state_format;
+  bool prev_state_delta;
+  {
+    std::unique_lock<std::mutex> my_lock(mutex_);
+    auto &free = free_[Key(B, max_seq_len, include_power)];
+    if (free.size() > 0) {
+      TensorDict fields(std::move(free.back()));
+      free.pop_back();
+      return fields;
+    }
+    pin_memory = pin_memory_;
+    board_state_format = board_state_format_;
+    prev_state_delta = prev_state_delta_;
+  }
+  return alloc_data_fields(B, max_seq_len, include_power, pin_memory,
+                           board_state_format, prev_state_delta);
+}
+
+void DataFieldsPool::release(TensorDict fields) {
+  auto board_it = fields.find("x_board_state");
+  JCHECK(board_it != fields.end(), "DataFieldsPool::release bad fields");
+  long B = board_it->second.size(0);
+  auto actions_it = fields.find("x_possible_actions");
+  auto power_it = fields.find("x_power");
+  if (actions_it != fields.end()) {
+    actions_it->second = untrim_seq_len(actions_it->second);
+    if (power_it != fields.end()) {
+      power_it->second = untrim_seq_len(power_it->second);
+    }
+  }
+  long max_seq_len =
+      actions_it == fields.end() || actions_it->second.size(1) != 7
+          ? 0
+          : actions_it->second.size(2);
+  bool include_power = power_it != fields.end();
+  bool has_prev_state = fields.count("x_prev_state") > 0;
+  fields.erase("x_prev_state_delta_offsets");
+  fields.erase("x_prev_state_delta_locs");
+  fields.erase("x_prev_state_delta_rows");
+  if (max_seq_len == 0) {
+    // e.g. sparse or power-subset encodings: only the state fields are pooled
+    for (auto it = fields.begin(); it != fields.end();) {
+      if (it->first == "x_loc_idxs" || it->first == "x_power" ||
+          it->first.rfind("x_possible_actions", 0) == 0) {
+        it = fields.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    include_power = false;
+  }
+
+  std::unique_lock<std::mutex> my_lock(mutex_);
+  if (get_board_state_format(board_it->second) != board_state_format_ ||
+      has_prev_state == prev_state_delta_) {
+    // allocated before set_board_state_format or set_prev_state_delta
+    return;
+  }
+  free_[Key(B, max_seq_len, include_power)].push_back(std::move(fields));
+}
+
+void DataFieldsPool::set_pin_memory(bool pin_memory) {
+  std::unique_lock<std::mutex> my_lock(mutex_);
+  if (pin_memory != pin_memory_) {
+    free_.clear();
+    pin_memory_ = pin_memory;
+  }
+}
+
+void DataFieldsPool::set_prev_state_delta(bool prev_state_delta) {
+  std::unique_lock<std::mutex> my_lock(mutex_);
+  if (prev_state_delta != prev_state_delta_) {
+    free_.clear();
+    prev_state_delta_ = prev_state_delta;
+  }
+}
+
+void DataFieldsPool::set_board_state_format(BoardStateFormat format) {
+  std::unique_lock<std::mutex> my_lock(mutex_);
+  if (format != board_state_format_) {
+    free_.clear();
+    board_state_format_ = format;
+  }
+}
+
 } // namespace dipcc
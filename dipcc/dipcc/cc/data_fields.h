@@ -7,15 +7,96 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <map>
+#include <mutex>
 #include <torch/torch.h>
+#include <tuple>
+#include <vector>
 
 namespace dipcc {
 
 using TensorDict = std::unordered_map<std::string, torch::Tensor>;
 
+// Storage of the [B, 81, 35] x_board_state and x_prev_state fields. Every
+// channel is 0 or 1, so they lose nothing in half precision or uint8. PACKED
+// is [B, 81, BOARD_STATE_PACKED_WIDTH] uint8, with channel c of a location in
+// bit c % 8 of its byte c / 8.
+enum class BoardStateFormat { FLOAT32, FLOAT16, BFLOAT16, UINT8, PACKED };
+
+const long BOARD_STATE_PACKED_WIDTH = 5;
+
+// Format of a board state field, from its dtype and width
+BoardStateFormat get_board_state_format(const torch::Tensor &field);
+
+// Write the [n_locs, 35] float board state encoding board_state to r, a row
+// of a field (or n_locs location rows) of the given format
+void write_board_state(const float *board_state, BoardStateFormat format,
+                       void *r, long n_locs = 81);
+
+// Return a board state field of any format as [..., 35] of dtype, on its
+// device: PACKED fields are unpacked, others are cast
+torch::Tensor unpack_board_state(const torch::Tensor &field,
+                                 torch::ScalarType dtype = torch::kFloat32);
+
+// In prev state delta encodings, x_prev_state is replaced by the location
+// rows where it differs from x_board_state, in CSR form: the rows of game b
+// are x_prev_state_delta_rows[offsets[b]:offsets[b + 1]] ([n, 35], or
+// [n, BOARD_STATE_PACKED_WIDTH], in the board state format), at locations
+// x_prev_state_delta_locs[offsets[b]:offsets[b + 1]] (long), where offsets is
+// x_prev_state_delta_offsets, with B + 1 elements. Replace these fields with
+// the full x_prev_state, on the fields' device. No-op for other fields.
+void expand_prev_state_delta(TensorDict &fields);
+
+// Return the rows idxs (long) of fields of B games, like index_select(0, idxs)
+// on every field, on the fields' devices. Fields in CSR form, i.e. prev state
+// deltas and sparse x_possible_actions (see
+// ThreadPool::encode_inputs_multi_sparse), keep it: their offsets are rebuilt
+// from the kept rows.
+TensorDict index_select_fields(const TensorDict &fields, torch::Tensor idxs);
+
 TensorDict new_data_fields_state_only(long B);
 
 TensorDict new_data_fields(long B, long max_seq_len = 17,
                            bool include_power = false);
 
+// Pool of reusable, uninitialized data fields buffers, keyed by shape.
+// Buffers are optionally allocated in pinned memory for faster host-to-device
+// copies. Thread-safe.
+class DataFieldsPool {
+public:
+  DataFieldsPool(bool pin_memory = false) : pin_memory_(pin_memory) {}
+
+  // Pop a released buffer of this shape, or allocate one. Contents are
+  // uninitialized. max_seq_len == 0 means state fields only.
+  TensorDict get(long B, long max_seq_len, bool include_power);
+
+  // Return fields obtained from get() to the pool. The caller must not use
+  // them (or any views of them, or pending non-blocking copies from them)
+  // afterwards.
+  void release(TensorDict fields);
+
+  void set_pin_memory(bool pin_memory);
+  bool get_pin_memory() const { return pin_memory_; }
+
+  // Format of the board state fields of later get() calls
+  void set_board_state_format(BoardStateFormat format);
+  BoardStateFormat get_board_state_format() const {
+    return board_state_format_;
+  }
+
+  // Omit x_prev_state from the fields of later get() calls, for prev state
+  // delta encodings (see expand_prev_state_delta)
+  void set_prev_state_delta(bool prev_state_delta);
+  bool get_prev_state_delta() const { return prev_state_delta_; }
+
+private:
+  using Key = std::tuple<long, long, bool>; // B, max_seq_len, include_power
+
+  std::mutex mutex_;
+  bool pin_memory_;
+  BoardStateFormat board_state_format_ = BoardStateFormat::FLOAT32;
+  bool prev_state_delta_ = false;
+  std::map<Key, std::vector<TensorDict>> free_;
+};
+
 } // namespace dipcc
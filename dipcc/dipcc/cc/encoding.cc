@@ -11,12 +11,14 @@ LICENSE file in the root directory of this source tree.
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <array>
 #include <vector>
 
 #include "checks.h"
 #include "game.h"
 #include "game_state.h"
 #include "loc.h"
+#include "perf_stats.h"
 #include "power.h"
 
 #define S_ARMY 0
@@ -103,47 +105,85 @@ namespace py = pybind11;
 
 namespace dipcc {
 
+namespace {
+
+// Encoding of an empty board with no supply center owners: the area type
+// channels, and the "none" channels that encode_board_state clears where
+// there is a unit, dislodged unit or owned center
+const float *get_empty_board_state() {
+  static const std::vector<float> empty_board_state = [] {
+    std::vector<float> r(81 * BOARD_STATE_ENC_WIDTH, 0);
+    for (int i = 0; i < 81; ++i) {
+      Loc loc = LOCS[i];
+      P_BOARD_STATE(r.data(), i, S_UNIT_NONE) = 1;
+      P_BOARD_STATE(r.data(), i, S_POW_NONE) = 1;
+      P_BOARD_STATE(r.data(), i, S_DIS_UNIT_NONE) = 1;
+      P_BOARD_STATE(r.data(), i, S_DIS_POW_NONE) = 1;
+      if (is_water(loc)) {
+        P_BOARD_STATE(r.data(), i, S_WATER) = 1;
+      } else if (is_coast(loc)) {
+        P_BOARD_STATE(r.data(), i, S_COAST) = 1;
+      } else {
+        P_BOARD_STATE(r.data(), i, S_LAND) = 1;
+      }
+      if (is_center(root_loc(loc))) {
+        P_BOARD_STATE(r.data(), i, S_SC_POW_NONE) = 1;
+      }
+    }
+    return r;
+  }();
+  return empty_board_state.data();
+}
+
+// Set a unit's channels at loc_i, starting at the ARMY channel base
+void encode_unit_at(float *r, size_t loc_i, int base, const OwnedUnit &unit) {
+  // base + [0, 1]: army/fleet, base + 2: none, base + [3, 9]: power,
+  // base + 10: none
+  P_BOARD_STATE(r, loc_i, base + (unit.type == UnitType::ARMY ? 0 : 1)) = 1;
+  P_BOARD_STATE(r, loc_i, base + 2) = 0;
+  P_BOARD_STATE(r, loc_i, base + 3 + static_cast<int>(unit.power) - 1) = 1;
+  P_BOARD_STATE(r, loc_i, base + 10) = 0;
+}
+
+} // namespace
+
 void encode_board_state(GameState &state, float *r) {
-  memset(r, 0, 81 * BOARD_STATE_ENC_WIDTH * sizeof(float));
+  visit_phase_type(state.get_phase().phase_type, [&](auto phase_type) {
+    encode_board_state<decltype(phase_type)::value>(state, r);
+  });
+}
+
+template <char PhaseType> void encode_board_state(GameState &state, float *r) {
+  PerfTimer perf_timer(PerfCounter::ENCODE_BOARD_STATE);
+  static_assert(S_DIS_ARMY - S_ARMY == S_DIS_POW_NONE - S_POW_NONE,
+                "Unit and dislodged unit channels must have the same layout");
+  memcpy(r, get_empty_board_state(),
+         81 * BOARD_STATE_ENC_WIDTH * sizeof(float));
 
   //////////////////////////////////////
   // unit type, unit power, removable //
   //////////////////////////////////////
 
-  std::vector<bool> filled(81, false);
-
-  for (auto p : state.get_units()) {
-    OwnedUnit unit = p.second;
+  // Adjustment phases are the only winter phases
+  constexpr bool winter = PhaseType == 'A';
+  for (const auto &p : state.get_units()) {
+    const OwnedUnit &unit = p.second;
     JCHECK(unit.type != UnitType::NONE, "UnitType::NONE");
     JCHECK(unit.loc != Loc::NONE, "Loc::NONE");
     JCHECK(unit.power != Power::NONE, "Power::NONE");
 
-    bool removable =
-        state.get_phase().season == 'W' && state.get_n_builds(unit.power) < 0;
+    bool removable = winter && state.get_n_builds(unit.power) < 0;
 
     size_t loc_i = static_cast<int>(unit.loc) - 1;
-    P_BOARD_STATE(r, loc_i, unit.type == UnitType::ARMY ? S_ARMY : S_FLEET) = 1;
-    P_BOARD_STATE(r, loc_i, S_AUS + static_cast<int>(unit.power) - 1) = 1;
+    encode_unit_at(r, loc_i, S_ARMY, unit);
     P_BOARD_STATE(r, loc_i, S_REMOVABLE) = static_cast<float>(removable);
-    filled[loc_i] = true;
 
     // Mark parent if it's a coast
     Loc rloc = root_loc(unit.loc);
     if (unit.loc != rloc) {
       size_t rloc_i = static_cast<int>(rloc) - 1;
-      P_BOARD_STATE(r, rloc_i, unit.type == UnitType::ARMY ? S_ARMY : S_FLEET) =
-          1;
-      P_BOARD_STATE(r, rloc_i, S_AUS + static_cast<int>(unit.power) - 1) = 1;
+      encode_unit_at(r, rloc_i, S_ARMY, unit);
       P_BOARD_STATE(r, rloc_i, S_REMOVABLE) = static_cast<float>(removable);
-      filled[rloc_i] = true;
-    }
-  }
-
-  // Set locs with no units
-  for (int i = 0; i < 81; ++i) {
-    if (!filled[i]) {
-      P_BOARD_STATE(r, i, S_UNIT_NONE) = 1;
-      P_BOARD_STATE(r, i, S_POW_NONE) = 1;
     }
   }
 
@@ -151,7 +191,7 @@ void encode_board_state(GameState &state, float *r) {
   // buildable //
   ///////////////
 
-  if (state.get_phase().phase_type == 'A') {
+  if constexpr (PhaseType == 'A') {
     for (auto &p : state.get_all_possible_orders()) {
       auto order = p.second.begin();
       if (order->get_type() == OrderType::B) {
@@ -166,46 +206,15 @@ void encode_board_state(GameState &state, float *r) {
   // dislodged units //
   /////////////////////
 
-  std::fill(filled.begin(), filled.end(), false);
-  for (OwnedUnit unit : state.get_dislodged_units()) {
+  for (const auto &p : state.get_dislodged_units_map()) {
+    const OwnedUnit &unit = p.second.unit;
     size_t loc_i = static_cast<int>(unit.loc) - 1;
-    P_BOARD_STATE(r, loc_i,
-                  unit.type == UnitType::ARMY ? S_DIS_ARMY : S_DIS_FLEET) = 1;
-    P_BOARD_STATE(r, loc_i, S_DIS_AUS + static_cast<int>(unit.power) - 1) = 1;
-    filled[loc_i] = true;
+    encode_unit_at(r, loc_i, S_DIS_ARMY, unit);
 
     // Mark parent if it's a coast
     Loc rloc = root_loc(unit.loc);
     if (unit.loc != rloc) {
-      size_t rloc_i = static_cast<int>(rloc) - 1;
-      P_BOARD_STATE(r, rloc_i,
-                    unit.type == UnitType::ARMY ? S_DIS_ARMY : S_DIS_FLEET) = 1;
-      P_BOARD_STATE(r, rloc_i, S_DIS_AUS + static_cast<int>(unit.power) - 1) =
-          1;
-      filled[rloc_i] = true;
-    }
-  }
-
-  // Set locs with no dislodged units
-  for (int i = 0; i < 81; ++i) {
-    if (!filled[i]) {
-      P_BOARD_STATE(r, i, S_DIS_UNIT_NONE) = 1;
-      P_BOARD_STATE(r, i, S_DIS_POW_NONE) = 1;
-    }
-  }
-
-  ///////////////
-  // Area type //
-  ///////////////
-
-  for (int i = 0; i < 81; ++i) {
-    Loc loc = LOCS[i];
-    if (is_water(loc)) {
-      P_BOARD_STATE(r, i, S_WATER) = 1;
-    } else if (is_coast(loc)) {
-      P_BOARD_STATE(r, i, S_COAST) = 1;
-    } else {
-      P_BOARD_STATE(r, i, S_LAND) = 1;
+      encode_unit_at(r, static_cast<int>(rloc) - 1, S_DIS_ARMY, unit);
     }
   }
 
@@ -213,24 +222,26 @@ void encode_board_state(GameState &state, float *r) {
   // supply center //
   ///////////////////
 
-  auto centers = state.get_centers();
-  for (int i = 0; i < 81; ++i) {
-    Loc loc = LOCS[i];
-    if (!is_center(loc) || loc != root_loc(loc)) {
+  for (const auto &p : state.get_centers()) {
+    Loc loc = p.first;
+    Power power = p.second;
+    if (!is_center(loc) || loc != root_loc(loc) || power == Power::NONE) {
       continue;
     }
-
-    auto it = centers.find(loc);
-    Power power = it == centers.end() ? Power::NONE : it->second;
-    int off = power == Power::NONE ? 7 : static_cast<int>(power) - 1;
-
+    int off = static_cast<int>(power) - 1;
     for (Loc cloc : expand_coasts(loc)) {
       int cloc_i = static_cast<int>(cloc) - 1;
+      P_BOARD_STATE(r, cloc_i, S_SC_POW_NONE) = 0;
       P_BOARD_STATE(r, cloc_i, S_SC_AUS + off) = 1;
     }
   }
 } // encode_board_state
 
+template void encode_board_state<'M'>(GameState &, float *);
+template void encode_board_state<'R'>(GameState &, float *);
+template void encode_board_state<'A'>(GameState &, float *);
+template void encode_board_state<'C'>(GameState &, float *);
+
 void encode_prev_orders(PhaseData &phase_data, float *r) {
   JCHECK(phase_data.get_state().get_phase().phase_type == 'M',
          "encode_prev_orders called on non-movement phase");
@@ -238,14 +249,15 @@ void encode_prev_orders(PhaseData &phase_data, float *r) {
   memset(r, 0, 81 * PREV_ORDERS_ENC_WIDTH * sizeof(float));
 
   // Store owner of each loc: unit owner if there is a unit, otherwise SC
-  // owner, otherwise none (7)
-  std::vector<int> loc_owner(81, 7);
+  // owner, otherwise none (7). Fixed-size, so encoding does not allocate.
+  std::array<int, 81> loc_owner;
+  loc_owner.fill(7);
 
   ////////////////////
   // supply centers //
   ////////////////////
 
-  std::vector<bool> filled(81, false);
+  std::array<bool, 81> filled{};
   for (auto &p : phase_data.get_state().get_centers()) {
     Loc loc = p.first;
     Power power = p.second;
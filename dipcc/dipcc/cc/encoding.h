@@ -20,6 +20,8 @@ namespace py = pybind11;
 namespace dipcc {
 
 void encode_board_state(GameState &state, float *r);
+// Same, for a state of the phase type (see visit_phase_type)
+template <char PhaseType> void encode_board_state(GameState &state, float *r);
 void encode_prev_orders(PhaseData &phase_data, float *r);
 
 } // namespace dipcc
@@ -0,0 +1,217 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "binary.h"
+#include "checks.h"
+#include "encoding_cache.h"
+#include "memory_usage.h"
+
+using namespace std;
+
+namespace dipcc {
+
+// File layout:
+//
+//   header: magic "DIPE" (u32), version (u32), fingerprint (u64),
+//           n_entries (u64)
+//   entries: key (2 x u64), then each EncodedState field, vectors prefixed
+//            by their varint length. Floats and ints are in native byte
+//            order, as the file is only read by the machines that write it.
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x45504944;
+const uint32_t CACHE_VERSION = 1;
+
+template <typename T>
+void write_array(BinaryWriter &writer, const T *p, size_t n) {
+  writer.write_raw(p, n * sizeof(T));
+}
+
+template <typename T>
+void write_vector(BinaryWriter &writer, const vector<T> &v) {
+  writer.write_varint(v.size());
+  write_array(writer, v.data(), v.size());
+}
+
+template <typename T> void read_array(BinaryReader &reader, T *p, size_t n) {
+  memcpy(p, reader.read_raw(n * sizeof(T)), n * sizeof(T));
+}
+
+template <typename T> void read_vector(BinaryReader &reader, vector<T> &v) {
+  v.resize(reader.read_varint());
+  read_array(reader, v.data(), v.size());
+}
+
+void write_entry(BinaryWriter &writer, const EncodingCache::Key &key,
+                 const EncodedState &state) {
+  writer.write_u64(key.first);
+  writer.write_u64(key.second);
+  write_vector(writer, state.x_board_state);
+  write_array(writer, state.x_season.data(), state.x_season.size());
+  write_array(writer, &state.x_in_adj_phase, 1);
+  write_array(writer, state.x_build_numbers.data(),
+              state.x_build_numbers.size());
+  write_vector(writer, state.x_loc_idxs);
+  write_vector(writer, state.x_possible_actions.row_lens);
+  write_vector(writer, state.x_possible_actions.values);
+}
+
+shared_ptr<const EncodedState> read_entry(BinaryReader &reader,
+                                          EncodingCache::Key &key) {
+  key.first = reader.read_u64();
+  key.second = reader.read_u64();
+  auto state = std::make_shared<EncodedState>();
+  read_vector(reader, state->x_board_state);
+  read_array(reader, state->x_season.data(), state->x_season.size());
+  read_array(reader, &state->x_in_adj_phase, 1);
+  read_array(reader, state->x_build_numbers.data(),
+             state->x_build_numbers.size());
+  read_vector(reader, state->x_loc_idxs);
+  read_vector(reader, state->x_possible_actions.row_lens);
+  read_vector(reader, state->x_possible_actions.values);
+  return state;
+}
+
+} // namespace
+
+EncodingCache::EncodingCache(size_t capacity) : capacity_(capacity) {
+  JCHECK(capacity > 0, "EncodingCache empty capacity");
+}
+
+shared_ptr<const EncodedState> EncodingCache::get(const Key &key) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto book_it = book_.find(key);
+    if (book_it != book_.end()) {
+      ++hits_;
+      return book_it->second;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      ++hits_;
+      return it->second->second;
+    }
+  }
+  ++misses_;
+  return nullptr;
+}
+
+void EncodingCache::put(const Key &key, shared_ptr<const EncodedState> value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    it->second->second = std::move(value);
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+
+  if (lru_.size() == capacity_) {
+    index_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  lru_.emplace_front(key, std::move(value));
+  index_[key] = lru_.begin();
+}
+
+void EncodingCache::save(const string &path, uint64_t fingerprint) const {
+  BinaryWriter writer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    writer.write_u32(CACHE_MAGIC);
+    writer.write_u32(CACHE_VERSION);
+    writer.write_u64(fingerprint);
+    writer.write_u64(book_.size() + lru_.size());
+    for (auto &it : book_) {
+      write_entry(writer, it.first, *it.second);
+    }
+    for (auto &entry : lru_) {
+      write_entry(writer, entry.first, *entry.second);
+    }
+  }
+
+  ofstream out(path, ios::binary | ios::trunc);
+  JCHECK(out.good(), "EncodingCache could not open for writing: " + path);
+  out.write(writer.get().data(), writer.get().size());
+  out.close();
+  JCHECK(!out.fail(), "EncodingCache write failed: " + path);
+}
+
+size_t EncodingCache::load_book(const string &path, uint64_t fingerprint) {
+  ifstream in(path, ios::binary);
+  JCHECK(in.good(), "EncodingCache could not open: " + path);
+  string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+  BinaryReader reader(data);
+  JCHECK(reader.read_u32() == CACHE_MAGIC, "EncodingCache bad magic: " + path);
+  JCHECK(reader.read_u32() == CACHE_VERSION,
+         "EncodingCache unsupported version: " + path);
+  JCHECK(reader.read_u64() == fingerprint,
+         "EncodingCache saved with another encoding: " + path);
+  size_t n_entries = reader.read_u64();
+
+  // Read everything before taking the lock
+  vector<pair<Key, shared_ptr<const EncodedState>>> entries(n_entries);
+  for (auto &entry : entries) {
+    entry.second = read_entry(reader, entry.first);
+  }
+  JCHECK(reader.at_end(), "EncodingCache trailing data: " + path);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : entries) {
+    book_[entry.first] = std::move(entry.second);
+  }
+  return n_entries;
+}
+
+size_t EncodingCache::get_book_size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return book_.size();
+}
+
+size_t EncodingCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lru_.size();
+}
+
+namespace {
+
+size_t encoded_state_bytes(const EncodedState &x) {
+  return sizeof(EncodedState) + heap_bytes(x.x_board_state) +
+         heap_bytes(x.x_loc_idxs) +
+         heap_bytes(x.x_possible_actions.row_lens) +
+         heap_bytes(x.x_possible_actions.values);
+}
+
+} // namespace
+
+size_t EncodingCache::memory_usage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t r = heap_bytes(lru_) + heap_bytes(index_) + heap_bytes(book_);
+  for (const auto &entry : lru_) {
+    r += encoded_state_bytes(*entry.second);
+  }
+  for (const auto &p : book_) {
+    r += encoded_state_bytes(*p.second);
+  }
+  return r;
+}
+
+void EncodingCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  lru_.clear();
+  index_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+} // namespace dipcc
@@ -0,0 +1,94 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dipcc {
+
+// Compressed x_possible_actions of one game: the non-EOS candidates of each
+// (power, step) row, concatenated
+struct SparsePossibleActions {
+  std::vector<int32_t> row_lens;
+  std::vector<int32_t> values;
+};
+
+// The encode_inputs_multi rows of one game that depend only on its current
+// state, i.e. all but x_prev_state and x_prev_orders
+struct EncodedState {
+  std::vector<float> x_board_state;
+  std::array<float, 3> x_season;
+  float x_in_adj_phase;
+  std::array<float, 7> x_build_numbers;
+  std::vector<int8_t> x_loc_idxs;
+  SparsePossibleActions x_possible_actions;
+};
+
+// Thread-safe, fixed-capacity LRU table of EncodedStates, keyed by the board
+// hash of the state and a hash of the game's previous movement phase
+// encoding.
+//
+// Entries can also be saved to a file, and loaded back as an opening book:
+// book entries are checked first and never evicted, so that e.g. the early
+// phases that every game goes through are always hits.
+class EncodingCache {
+public:
+  using Key = std::pair<uint64_t, uint64_t>; // (board hash, prev phase hash)
+
+  EncodingCache(size_t capacity);
+
+  // Return nullptr on a miss
+  std::shared_ptr<const EncodedState> get(const Key &key);
+  void put(const Key &key, std::shared_ptr<const EncodedState> value);
+
+  // Write the book and LRU entries to path. fingerprint identifies the
+  // encoding that produced them, and must match in load_book.
+  void save(const std::string &path, uint64_t fingerprint) const;
+  // Add the entries of a save file to the book, replacing any with the same
+  // key, and return their number
+  size_t load_book(const std::string &path, uint64_t fingerprint);
+
+  // LRU entries only
+  size_t size() const;
+  size_t get_book_size() const;
+  size_t get_capacity() const { return capacity_; }
+  uint64_t get_hits() const { return hits_; }
+  uint64_t get_misses() const { return misses_; }
+  // Approximate bytes used by the book and LRU entries
+  size_t memory_usage() const;
+  // Clear the LRU entries and the stats, but not the book
+  void clear();
+
+private:
+  struct HashKey {
+    size_t operator()(const Key &key) const {
+      return key.first ^ (key.second * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  using Entry = std::pair<Key, std::shared_ptr<const EncodedState>>;
+
+  size_t capacity_;
+  mutable std::mutex mutex_;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<Key, std::list<Entry>::iterator, HashKey> index_;
+  std::unordered_map<Key, std::shared_ptr<const EncodedState>, HashKey> book_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace dipcc
@@ -5,6 +5,8 @@ This source code is licensed under the MIT license found in the
 LICENSE file in the root directory of this source tree.
 */
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <exception>
 #include <glog/logging.h>
@@ -25,14 +27,20 @@ namespace dipcc {
 
 void Game::set_orders(const std::string &power_str,
                       const std::vector<std::string> &order_strs) {
-  Power power = power_from_str(power_str);
-  auto &staged_orders = staged_orders_[power];
-
+  vector<Order> orders;
+  orders.reserve(order_strs.size());
   for (const std::string &order_str : order_strs) {
-    if (order_str == "WAIVE") {
-      continue;
+    if (order_str != "WAIVE") {
+      orders.push_back(Order(order_str));
     }
-    Order order(order_str);
+  }
+  set_orders(power_from_str(power_str), orders);
+}
+
+void Game::set_orders(Power power, const std::vector<Order> &orders) {
+  auto &staged_orders = staged_orders_[power];
+
+  for (const Order &order : orders) {
     bool overwritten = false;
     for (int i = 0; i < staged_orders.size(); ++i) {
       if (staged_orders[i].get_unit().loc == order.get_unit().loc) {
@@ -48,31 +56,153 @@ void Game::set_orders(const std::string &power_str,
   }
 }
 
-void Game::process() {
-  state_history_[state_->get_phase()] = state_;
-  order_history_[state_->get_phase()] = staged_orders_;
+void Game::process() { process(nullptr, true); }
+
+void Game::process_like(const Game &leader) { process_like(leader, true); }
+
+ProcessStatus Game::try_process() { return process(nullptr, false); }
+
+ProcessStatus Game::try_process_like(const Game &leader) {
+  return process_like(leader, false);
+}
+
+ProcessStatus Game::process_like(const Game &leader, bool throw_errors) {
+  Phase phase = state_->get_phase();
+  auto prev = leader.state_history_.rbegin();
+  if (&leader == this || leader.is_game_done() ||
+      prev == leader.state_history_.rend() || prev->first != phase ||
+      leader.exception_on_convoy_paradox_ != exception_on_convoy_paradox_ ||
+      !prev->second->same_process_inputs(*state_) ||
+      leader.order_history_.get(phase) != staged_orders_) {
+    // Not processed, or processed from elsewhere, or it ended the game,
+    // which may depend on its history
+    return process(nullptr, throw_errors);
+  }
+  return process(leader.state_, throw_errors);
+}
+
+ProcessStatus Game::process(std::shared_ptr<GameState> next,
+                            bool throw_errors) {
+  // Adjudicate before modifying the game, so that it is left unprocessed if
+  // adjudication fails
+  if (next == nullptr) {
+    try {
+      bool convoy_paradox = false;
+      next = std::make_shared<GameState>(state_->process(
+          staged_orders_, exception_on_convoy_paradox_ && throw_errors,
+          lazy_possible_orders_, &convoy_paradox));
+      if (convoy_paradox && exception_on_convoy_paradox_) {
+        return ProcessStatus::CONVOY_PARADOX;
+      }
+    } catch (const ConvoyParadoxException &e) {
+      throw e;
+    } catch (const std::exception &e) {
+      if (!rollout_mode_) {
+        this->crash_dump();
+      }
+      LOG(ERROR) << "Exception: " << e.what();
+      if (!throw_errors) {
+        return ProcessStatus::ERROR;
+      }
+      throw e;
+    } catch (...) {
+      if (!rollout_mode_) {
+        this->crash_dump();
+      }
+      LOG(ERROR) << "Unknown exception";
+      exit(1);
+    }
+  }
 
-  try {
-    state_ = std::make_shared<GameState>(
-        state_->process(staged_orders_, exception_on_convoy_paradox_));
-    maybe_early_exit();
-  } catch (const ConvoyParadoxException &e) {
-    throw e;
-  } catch (const std::exception &e) {
-    this->crash_dump();
-    LOG(ERROR) << "Exception: " << e.what();
-    throw e;
-  } catch (...) {
-    this->crash_dump();
-    LOG(ERROR) << "Unknown exception";
-    exit(1);
+  set_prev_phase_encoding(nullptr);
+  GameState *prev_movement_state = get_last_movement_phase();
+  std::optional<Phase> prev_movement_phase;
+  if (prev_movement_state != nullptr) {
+    prev_movement_phase = prev_movement_state->get_phase();
   }
+  Phase phase = state_->get_phase();
+  state_history_[phase] = state_;
+  order_history_[phase] = PhaseOrders(staged_orders_);
+  state_ = std::move(next);
+  maybe_early_exit();
   staged_orders_.clear();
+
+  // Keep the possible orders of the last movement phase only: free those of
+  // the phase just processed, or if it is the new last movement phase, those
+  // of the previous one
+  if (evict_old_possible_orders_) {
+    if (phase.phase_type != 'M') {
+      evict_possible_orders(phase);
+    } else if (prev_movement_phase) {
+      evict_possible_orders(*prev_movement_phase);
+    }
+  }
+
+  if (rollout_mode_) {
+    prune_history();
+  }
+  return ProcessStatus::OK;
+}
+
+void Game::evict_possible_orders(const Phase &phase) {
+  // Only if no other Game can see the state, since their threads may be
+  // reading its possible orders
+  std::shared_ptr<GameState> *state = state_history_.find_unshared(phase);
+  if (state != nullptr && state->use_count() == 1) {
+    (*state)->clear_all_possible_orders();
+  }
+}
+
+void Game::set_rollout_mode(bool rollout_mode) {
+  rollout_mode_ = rollout_mode;
+  if (rollout_mode_) {
+    prune_history();
+    message_history_.clear();
+    logs_.clear();
+    phase_json_.clear();
+  }
+}
+
+// The first phase of the history kept in rollout mode, if any is dropped
+std::optional<Phase> Game::rollout_history_start() {
+  GameState *last_movement_phase = get_last_movement_phase();
+  if (last_movement_phase == nullptr) {
+    return std::nullopt;
+  }
+
+  // keep the last movement phase for encoding x_prev_state and x_prev_orders,
+  // and the spring phases compared by maybe_early_exit
+  Phase keep_from = last_movement_phase->get_phase();
+  if (draw_on_stalemate_years_ >= 1) {
+    Phase stalemate_from(
+        'S', state_->get_phase().year - draw_on_stalemate_years_, 'M');
+    if (stalemate_from < keep_from) {
+      keep_from = stalemate_from;
+    }
+  }
+  return keep_from;
+}
+
+void Game::prune_history() {
+  std::optional<Phase> start = rollout_history_start();
+  if (!start) {
+    return;
+  }
+  Phase keep_from = *start;
+  if (keep_from < get_last_movement_phase()->get_phase()) {
+    load_lazy_phases();
+  } else {
+    lazy_phases_ = nullptr; // all before the last movement phase
+    compact_states_ = nullptr;
+  }
+  state_history_.erase_before(keep_from);
+  order_history_.erase_before(keep_from);
+  phase_json_.erase_before(keep_from);
 }
 
 GameState &Game::get_state() { return *state_; }
 
-std::unordered_map<Power, std::vector<Loc>> Game::get_orderable_locations() {
+const PowerMap<std::vector<Loc>> &Game::get_orderable_locations() {
   return state_->get_orderable_locations();
 }
 
@@ -166,43 +296,47 @@ bool Game::is_game_done() const {
 }
 
 string Game::to_json() {
-  json j;
-
-  j["id"] = this->game_id;
-  j["map"] = "standard";
+  load_lazy_phases();
 
-  for (auto &rule : rules_) {
-    j["rules"].push_back(rule);
-  }
+  // Assembled by hand from the memoized phases, with the keys in the sorted
+  // order of json::dump
+  string r = "{\"id\":" + json(this->game_id).dump() +
+             ",\"map\":\"standard\",\"phases\":[";
 
   for (auto &q : state_history_) {
-    GameState &state = *q.second;
-
-    json phase;
-    phase["name"] = state.get_phase().to_string();
-    phase["state"] = state.to_json();
-    for (auto &p : POWERS) {
-      phase["orders"][power_str(p)] = vector<string>();
-    }
-    for (auto &p : order_history_[state.get_phase()]) {
-      string power = power_str(p.first);
-      for (Order &order : p.second) {
-        phase["orders"][power].push_back(order.to_string());
+    const Phase &phase_key = q.first;
+    if (!phase_json_.contains(phase_key)) {
+      GameState &state = *q.second;
+
+      json phase;
+      phase["name"] = state.get_phase().to_string();
+      phase["state"] = state.to_json();
+      for (auto &p : POWERS) {
+        phase["orders"][power_str(p)] = vector<string>();
+      }
+      for (auto &p : order_history_.get(state.get_phase())) {
+        string power = power_str(p.first);
+        for (const Order &order : p.second) {
+          phase["orders"][power].push_back(order.to_string());
+        }
+      }
+      phase["messages"] = json::value_type::array(); // mila compat
+      for (auto & [ time_sent, msg ] :
+           message_history_.get(state.get_phase())) {
+        phase["messages"].push_back(msg);
       }
-    }
-    phase["messages"] = json::value_type::array(); // mila compat
-    for (auto & [ time_sent, msg ] : message_history_[state.get_phase()]) {
-      phase["messages"].push_back(msg);
-    }
 
-    phase["results"] = json::value_type::object(); // mila compat
+      phase["results"] = json::value_type::object(); // mila compat
 
-    phase["logs"] = json::value_type::array();
-    for (auto &data : logs_[state.get_phase()]) {
-      phase["logs"].push_back(data);
-    }
+      phase["logs"] = json::value_type::array();
+      for (auto &data : logs_.get(state.get_phase())) {
+        phase["logs"].push_back(data);
+      }
 
-    j["phases"].push_back(phase);
+      phase_json_[phase_key] = phase.dump();
+    }
+    r += phase_json_.get(phase_key);
+    r += ',';
   }
 
   // current phase
@@ -212,11 +346,11 @@ string Game::to_json() {
   current["orders"] = json::value_type::object();  // mila compat
   current["results"] = json::value_type::object(); // mila compat
   current["messages"] = json::value_type::array(); // mila compat
-  for (auto & [ time_sent, msg ] : message_history_[state_->get_phase()]) {
+  for (auto & [ time_sent, msg ] : message_history_.get(state_->get_phase())) {
     current["messages"].push_back(msg);
   }
   current["logs"] = json::value_type::array();
-  for (auto &data : logs_[state_->get_phase()]) {
+  for (auto &data : logs_.get(state_->get_phase())) {
     current["logs"].push_back(data);
   }
   for (auto & [ power, orders ] : staged_orders_) {
@@ -224,9 +358,14 @@ string Game::to_json() {
       current["orders"][power_str(power)].push_back(order.to_string());
     }
   }
-  j["phases"].push_back(current);
+  r += current.dump();
+  r += ']';
 
-  return j.dump();
+  if (!rules_.empty()) {
+    r += ",\"rules\":" + json(rules_).dump();
+  }
+  r += '}';
+  return r;
 }
 
 Game::Game(const string &json_str) {
@@ -248,31 +387,8 @@ Game::Game(const string &json_str) {
   }
 
   if (j.find("phases") != j.end()) {
-    string phase_str;
     for (auto &j_phase : j["phases"]) {
-      phase_str = j_phase["name"];
-      state_history_[phase_str] = std::make_shared<GameState>(j_phase["state"]);
-
-      for (auto &it : j_phase["orders"].items()) {
-        Power power = power_from_str(it.key());
-        for (auto &j_order : it.value()) {
-          order_history_[phase_str][power].push_back(Order(j_order));
-        }
-      }
-
-      if (j_phase.find("messages") != j_phase.end()) {
-        for (auto &j_msg : j_phase["messages"]) {
-          JCHECK(message_history_[phase_str].find(j_msg["time_sent"]) ==
-                     message_history_[phase_str].end(),
-                 "from_json duplicate message timestamps not allowed");
-          message_history_[phase_str][j_msg["time_sent"]] = j_msg;
-        }
-      }
-      if (j_phase.find("logs") != j_phase.end()) {
-        for (auto &data : j_phase["logs"]) {
-          logs_[phase_str].push_back(data);
-        }
-      }
+      load_json_phase(j_phase);
     }
   } else {
     string phase_str;
@@ -281,12 +397,16 @@ Game::Game(const string &json_str) {
       state_history_[phase_str] = std::make_shared<GameState>(j_state.value());
 
       if (j["order_history"].find(phase_str) != j["order_history"].end()) {
+        PowerMap<vector<Order>> orders;
         for (auto &it : j["order_history"][phase_str].items()) {
           Power power = power_from_str(it.key());
           for (auto &j_order : it.value()) {
-            order_history_[phase_str][power].push_back(Order(j_order));
+            orders[power].push_back(Order(j_order.get<std::string>()));
           }
         }
+        if (!orders.empty()) {
+          order_history_[phase_str] = PhaseOrders(orders);
+        }
       }
 
       if (j.find("message_history") == j.end() ||
@@ -307,12 +427,422 @@ Game::Game(const string &json_str) {
   Phase current_phase = it->first;
   state_ = it->second;
   state_history_.erase(current_phase);
-  if (order_history_.find(current_phase) != order_history_.end()) {
-    staged_orders_ = order_history_[current_phase];
+  if (order_history_.contains(current_phase)) {
+    staged_orders_ = order_history_.at(current_phase).to_power_map();
     order_history_.erase(current_phase);
   }
 }
 
+void Game::load_json_phase(const json &j_phase) {
+  string phase_str = j_phase["name"];
+  state_history_[phase_str] = std::make_shared<GameState>(j_phase["state"]);
+
+  PowerMap<vector<Order>> orders;
+  for (auto &it : j_phase["orders"].items()) {
+    Power power = power_from_str(it.key());
+    for (auto &j_order : it.value()) {
+      orders[power].push_back(Order(j_order.get<std::string>()));
+    }
+  }
+  if (!orders.empty()) {
+    order_history_[phase_str] = PhaseOrders(orders);
+  }
+
+  if (j_phase.find("messages") != j_phase.end()) {
+    for (auto &j_msg : j_phase["messages"]) {
+      JCHECK(message_history_[phase_str].find(j_msg["time_sent"]) ==
+                 message_history_[phase_str].end(),
+             "from_json duplicate message timestamps not allowed");
+      message_history_[phase_str][j_msg["time_sent"]] = j_msg;
+    }
+  }
+  if (j_phase.find("logs") != j_phase.end()) {
+    for (auto &data : j_phase["logs"]) {
+      logs_[phase_str].push_back(data);
+    }
+  }
+}
+
+namespace {
+
+// The position after the json value starting at s[i], which must be valid:
+// only strings and nesting are followed, the value is not checked
+size_t skip_json_value(const string &s, size_t i) {
+  int depth = 0;
+  bool in_string = false;
+  for (; i < s.size(); ++i) {
+    char c = s[i];
+    if (in_string) {
+      if (c == '\\') {
+        ++i;
+      } else if (c == '"') {
+        in_string = false;
+        if (depth == 0) {
+          return i + 1;
+        }
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '{' || c == '[') {
+      ++depth;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        return i; // end of a scalar in a container
+      }
+      if (--depth == 0) {
+        return i + 1;
+      }
+    } else if (depth == 0 && (c == ',' || isspace(c))) {
+      return i;
+    }
+  }
+  return i;
+}
+
+size_t skip_json_space(const string &s, size_t i) {
+  while (i < s.size() && isspace(s[i])) {
+    ++i;
+  }
+  return i;
+}
+
+// The range of the value of key in the json object s[begin, end), or
+// {npos, npos} if missing. Keys are compared unescaped.
+pair<size_t, size_t> find_json_key(const string &s, size_t begin, size_t end,
+                                   const string &key) {
+  size_t i = skip_json_space(s, begin);
+  JCHECK(i < end && s[i] == '{', "from_json_lazy expected an object");
+  i = skip_json_space(s, i + 1);
+  while (i < end && s[i] == '"') {
+    size_t key_end = skip_json_value(s, i);
+    bool match = s.compare(i + 1, key_end - i - 2, key) == 0;
+    i = skip_json_space(s, key_end);
+    JCHECK(i < end && s[i] == ':', "from_json_lazy expected ':'");
+    size_t value_begin = skip_json_space(s, i + 1);
+    size_t value_end = skip_json_value(s, value_begin);
+    if (match) {
+      return {value_begin, value_end};
+    }
+    i = skip_json_space(s, value_end);
+    if (i < end && s[i] == ',') {
+      i = skip_json_space(s, i + 1);
+    }
+  }
+  return {string::npos, string::npos};
+}
+
+} // namespace
+
+Game Game::from_json_lazy(const string &json_str, size_t n_phases) {
+  auto[phases_begin, phases_end] =
+      find_json_key(json_str, 0, json_str.size(), "phases");
+  if (phases_begin == string::npos || json_str[phases_begin] != '[') {
+    return Game(json_str); // e.g. the old state_history format
+  }
+
+  vector<pair<size_t, size_t>> ranges;
+  size_t i = skip_json_space(json_str, phases_begin + 1);
+  while (i < phases_end && json_str[i] != ']') {
+    size_t end = skip_json_value(json_str, i);
+    ranges.push_back({i, end});
+    i = skip_json_space(json_str, end);
+    if (i < phases_end && json_str[i] == ',') {
+      i = skip_json_space(json_str, i + 1);
+    }
+  }
+  if (ranges.empty()) {
+    return Game(json_str);
+  }
+
+  // Decode the last n_phases, and back to a movement phase before the current
+  // one, for x_prev_state and x_prev_orders
+  auto is_movement = [&](size_t k) {
+    auto[name_begin, name_end] =
+        find_json_key(json_str, ranges[k].first, ranges[k].second, "name");
+    JCHECK(name_begin != string::npos, "from_json_lazy phase has no name");
+    return json_str[name_end - 2] == 'M'; // e.g. "S1901M"
+  };
+  size_t last_movement = ranges.size() - 1;
+  while (last_movement > 0 && !is_movement(--last_movement)) {
+  }
+  size_t n_lazy = min(ranges.size() - min(max(n_phases, size_t(1)),
+                                          ranges.size()),
+                      last_movement);
+
+  // The document with only the decoded phases
+  string decoded_json = json_str.substr(0, phases_begin + 1);
+  for (size_t k = n_lazy; k < ranges.size(); ++k) {
+    if (k > n_lazy) {
+      decoded_json += ',';
+    }
+    decoded_json.append(json_str, ranges[k].first,
+                        ranges[k].second - ranges[k].first);
+  }
+  decoded_json.append(json_str, phases_end - 1, string::npos);
+  Game game(decoded_json);
+
+  if (n_lazy > 0) {
+    auto lazy = std::make_shared<LazyJsonPhases>();
+    lazy->json_str = json_str;
+    lazy->ranges.assign(ranges.begin(), ranges.begin() + n_lazy);
+    game.lazy_phases_ = std::move(lazy);
+  }
+  return game;
+}
+
+void Game::compact_history(size_t keyframe_interval) {
+  load_lazy_phases();
+  GameState *last_movement_phase = get_last_movement_phase();
+  if (last_movement_phase == nullptr) {
+    return;
+  }
+  Phase keep_from = last_movement_phase->get_phase();
+  vector<std::shared_ptr<GameState>> states;
+  for (auto &q : state_history_) {
+    if (!(q.first < keep_from)) {
+      break;
+    }
+    states.push_back(q.second);
+  }
+  if (states.empty()) {
+    return;
+  }
+  compact_states_ = std::make_shared<CompactStates>(states, keyframe_interval);
+  state_history_.erase_before(keep_from);
+}
+
+std::shared_ptr<GameState> Game::get_history_state(const Phase &phase) {
+  if (lazy_phases_ != nullptr) {
+    load_lazy_phases();
+  }
+  const std::shared_ptr<GameState> *state = state_history_.find_value(phase);
+  if (state != nullptr) {
+    return *state;
+  }
+  if (compact_states_ != nullptr) {
+    const vector<Phase> &phases = compact_states_->get_phases();
+    auto it = std::lower_bound(phases.begin(), phases.end(), phase);
+    if (it != phases.end() && *it == phase) {
+      return compact_states_->get(it - phases.begin());
+    }
+  }
+  return nullptr;
+}
+
+void Game::decode_lazy_phases() {
+  if (compact_states_ != nullptr) {
+    // Never together with lazy_phases_, which compact_history decodes
+    std::shared_ptr<const CompactStates> compact = std::move(compact_states_);
+    compact_states_ = nullptr;
+    for (auto &state : compact->get_all()) {
+      state_history_[state->get_phase()] = state;
+    }
+    return;
+  }
+
+  // Reset first, as loading goes through accessors that check lazy_phases_
+  std::shared_ptr<const LazyJsonPhases> lazy = std::move(lazy_phases_);
+  lazy_phases_ = nullptr;
+  const char *data = lazy->json_str.data();
+  for (auto & [ begin, end ] : lazy->ranges) {
+    load_json_phase(json::parse(data + begin, data + end));
+  }
+}
+
+namespace {
+
+// "DIPC" followed by a format version
+const uint32_t BINARY_MAGIC = 0x43504944;
+// Version 1 had no states block: each phase's record started with its state
+// in full
+const uint8_t BINARY_VERSION = 2;
+
+// orders is a PowerMap<vector<Order>> or PhaseOrders
+template <typename T>
+void orders_to_bytes(const T &orders, BinaryWriter &writer) {
+  // in power order, so that equal games give equal bytes
+  size_t n_powers = 0;
+  for (auto &it : orders) {
+    n_powers += it.second.size() > 0;
+  }
+  writer.write_varint(n_powers);
+  for (auto &it : orders) {
+    if (it.second.size() == 0) {
+      continue;
+    }
+    writer.write_u8(static_cast<uint8_t>(it.first));
+    writer.write_varint(it.second.size());
+    for (const Order &order : it.second) {
+      writer.write_u32(order.get_id());
+    }
+  }
+}
+
+PowerMap<vector<Order>> orders_from_bytes(BinaryReader &reader) {
+  PowerMap<vector<Order>> orders;
+  size_t n_powers = reader.read_varint();
+  for (size_t i = 0; i < n_powers; ++i) {
+    uint8_t power = reader.read_u8();
+    JCHECK(power >= 1 && power <= 7, "from_bytes bad power");
+    auto &power_orders = orders[static_cast<Power>(power)];
+    power_orders.resize(reader.read_varint());
+    for (Order &order : power_orders) {
+      order = Order::from_id(reader.read_u32());
+    }
+  }
+  return orders;
+}
+
+} // namespace
+
+string Game::to_bytes(const GameBytesOptions &options) {
+  std::optional<Phase> history_start;
+  if (!options.full_history) {
+    history_start = rollout_history_start();
+  }
+  // Compacted states are copied as they are, unless some are dropped
+  if (lazy_phases_ != nullptr ||
+      (compact_states_ != nullptr && history_start)) {
+    load_lazy_phases();
+  }
+  BinaryWriter writer;
+  writer.write_u32(BINARY_MAGIC);
+  writer.write_u8(BINARY_VERSION);
+  writer.write_string(game_id);
+  writer.write_varint(rules_.size());
+  for (auto &rule : rules_) {
+    writer.write_string(rule);
+  }
+
+  // all phases kept, the last one being the current phase
+  vector<Phase> phases;
+  BinaryWriter states_writer;
+  StateHistoryWriter history_writer(CompactStates::DEFAULT_KEYFRAME_INTERVAL);
+  if (compact_states_ != nullptr) {
+    phases = compact_states_->get_phases();
+    history_writer.add_all(*compact_states_, states_writer);
+  }
+  for (auto &q : state_history_) {
+    if (!history_start || q.first >= *history_start) {
+      phases.push_back(q.first);
+      history_writer.add(q.second, states_writer);
+    }
+  }
+  phases.push_back(state_->get_phase());
+  history_writer.add(state_, states_writer);
+  writer.write_varint(phases.size());
+  writer.write_string(states_writer.get());
+
+  for (const Phase &phase : phases) {
+    if (phase == state_->get_phase()) {
+      orders_to_bytes(staged_orders_, writer);
+    } else {
+      orders_to_bytes(order_history_.get(phase), writer);
+    }
+
+    if (options.messages) {
+      const auto &messages = message_history_.get(phase);
+      writer.write_varint(messages.size());
+      for (auto & [ time_sent, msg ] : messages) {
+        writer.write_u8(static_cast<uint8_t>(msg.sender));
+        writer.write_u8(static_cast<uint8_t>(msg.recipient));
+        writer.write_varint(time_sent);
+        writer.write_string(msg.message);
+      }
+    } else {
+      writer.write_varint(0);
+    }
+
+    if (options.logs) {
+      const auto &logs = logs_.get(phase);
+      writer.write_varint(logs.size());
+      for (auto &data : logs) {
+        writer.write_string(data);
+      }
+    } else {
+      writer.write_varint(0);
+    }
+  }
+
+  return std::move(writer.get());
+}
+
+Game Game::from_bytes(std::string_view data) {
+  BinaryReader reader(data);
+  return Game(reader);
+}
+
+Game Game::from_bytes_at_phase_start(std::string_view data, size_t phase_idx) {
+  BinaryReader reader(data);
+  return Game(reader, phase_idx);
+}
+
+Game::Game(BinaryReader &reader, std::optional<size_t> phase_start) {
+  JCHECK(reader.read_u32() == BINARY_MAGIC, "from_bytes bad magic");
+  uint8_t version = reader.read_u8();
+  JCHECK(version == 1 || version == BINARY_VERSION,
+         "from_bytes unsupported version: " + std::to_string(version));
+  game_id = reader.read_string();
+  rules_.resize(reader.read_varint());
+  for (auto &rule : rules_) {
+    rule = reader.read_string();
+  }
+
+  size_t n_phases = reader.read_varint();
+  JCHECK(n_phases > 0, "from_bytes no phases");
+  JCHECK(!phase_start || *phase_start < n_phases,
+         "from_bytes_at_phase_start phase out of range");
+  std::optional<BinaryReader> states_reader;
+  if (version >= 2) {
+    states_reader.emplace(reader.read_string());
+  }
+  StateHistoryReader history_reader;
+  for (size_t i = 0; i < n_phases; ++i) {
+    auto state = states_reader ? history_reader.next(*states_reader)
+                               : std::make_shared<GameState>(reader);
+    Phase phase = state->get_phase();
+    if (phase_start && i == *phase_start) {
+      // drop this phase's orders, messages and logs and everything after
+      state_ = state;
+      return;
+    }
+    auto orders = orders_from_bytes(reader);
+    if (i + 1 < n_phases) {
+      state_history_[phase] = state;
+      if (!orders.empty()) {
+        order_history_[phase] = PhaseOrders(orders);
+      }
+    } else {
+      state_ = state;
+      staged_orders_ = std::move(orders);
+    }
+
+    size_t n_messages = reader.read_varint();
+    if (n_messages > 0) {
+      auto &messages = message_history_[phase];
+      for (size_t j = 0; j < n_messages; ++j) {
+        Message msg;
+        msg.sender = static_cast<Power>(reader.read_u8());
+        msg.recipient = static_cast<Power>(reader.read_u8());
+        msg.phase = phase;
+        msg.time_sent = reader.read_varint();
+        msg.message = reader.read_string();
+        messages[msg.time_sent] = std::move(msg);
+      }
+    }
+
+    size_t n_logs = reader.read_varint();
+    if (n_logs > 0) {
+      auto &logs = logs_[phase];
+      for (size_t j = 0; j < n_logs; ++j) {
+        logs.push_back(string(reader.read_string()));
+      }
+    }
+  }
+  JCHECK(reader.at_end() && (!states_reader || states_reader->at_end()),
+         "from_bytes trailing data");
+}
+
 void Game::crash_dump() {
   json j_orders;
   for (auto &it : staged_orders_) {
@@ -339,28 +869,64 @@ Game Game::rolled_back_to_phase_end(const std::string &phase_s) {
   return new_game;
 }
 
+void Game::rollback_to_phase_start(const std::string &phase_s) {
+  rollback_to_phase(phase_s, false, false, false);
+}
+
+void Game::rollback_to_phase_end(const std::string &phase_s) {
+  rollback_to_phase(phase_s, true, true, true);
+}
+
+GameSnapshot Game::snapshot() const {
+  GameSnapshot snapshot;
+  snapshot.state_ = state_;
+  snapshot.staged_orders_ = staged_orders_;
+  snapshot.state_history_ = state_history_;
+  snapshot.order_history_ = order_history_;
+  snapshot.logs_ = logs_;
+  snapshot.message_history_ = message_history_;
+  snapshot.phase_json_ = phase_json_;
+  snapshot.lazy_phases_ = lazy_phases_;
+  snapshot.compact_states_ = compact_states_;
+  snapshot.prev_phase_encoding_ = get_prev_phase_encoding();
+  snapshot.spring_centers_hashes_ = spring_centers_hashes_;
+  return snapshot;
+}
+
+void Game::restore(const GameSnapshot &snapshot) {
+  state_ = snapshot.state_;
+  staged_orders_ = snapshot.staged_orders_;
+  state_history_ = snapshot.state_history_;
+  order_history_ = snapshot.order_history_;
+  logs_ = snapshot.logs_;
+  message_history_ = snapshot.message_history_;
+  phase_json_ = snapshot.phase_json_;
+  lazy_phases_ = snapshot.lazy_phases_;
+  compact_states_ = snapshot.compact_states_;
+  set_prev_phase_encoding(snapshot.prev_phase_encoding_);
+  spring_centers_hashes_ = snapshot.spring_centers_hashes_;
+}
+
 void Game::rollback_to_phase(const std::string &phase_s,
                              bool preserve_phase_messages,
                              bool preserve_phase_orders,
                              bool preserve_phase_logs) {
   Phase phase(phase_s);
+  load_lazy_phases();
+  phase_json_.erase_from(phase);
 
   // delete message_history_ including (?) and after phase
-  auto m_it = message_history_.find(phase);
-  if (preserve_phase_messages && m_it != message_history_.end()) {
-    ++m_it;
-  }
-  while (m_it != message_history_.end()) {
-    m_it = message_history_.erase(m_it);
+  if (preserve_phase_messages && message_history_.contains(phase)) {
+    message_history_.erase_after(phase);
+  } else if (message_history_.contains(phase)) {
+    message_history_.erase_from(phase);
   }
 
   // delete logs_ including (?) and after phase
-  auto l_it = logs_.find(phase);
-  if (preserve_phase_logs && l_it != logs_.end()) {
-    ++l_it;
-  }
-  while (l_it != logs_.end()) {
-    l_it = logs_.erase(l_it);
+  if (preserve_phase_logs && logs_.contains(phase)) {
+    logs_.erase_after(phase);
+  } else if (logs_.contains(phase)) {
+    logs_.erase_from(phase);
   }
 
   // set current state
@@ -370,46 +936,55 @@ void Game::rollback_to_phase(const std::string &phase_s,
   if (state_->get_phase() == phase) {
     return;
   }
-  auto s_it = state_history_.find(phase);
-  JCHECK(s_it != state_history_.end(), "rollback_to_phase phase not found");
-  state_ = s_it->second;
+  JCHECK(state_history_.contains(phase), "rollback_to_phase phase not found");
+  set_prev_phase_encoding(nullptr);
+  state_ = state_history_.at(phase);
 
   // delete state_history_ including and after phase
-  while (s_it != state_history_.end()) {
-    s_it = state_history_.erase(s_it);
-  }
+  state_history_.erase_from(phase);
 
   // delete order_history_ including and after phase
-  auto o_it = order_history_.find(phase);
   if (preserve_phase_orders) {
-    staged_orders_ = o_it->second;
+    staged_orders_ = order_history_.get(phase).to_power_map();
   }
-  while (o_it != order_history_.end()) {
-    o_it = order_history_.erase(o_it);
+  if (order_history_.contains(phase)) {
+    order_history_.erase_from(phase);
   }
 }
 
 void Game::rollback_messages_to_timestamp(const uint64_t timestamp) {
-  for (auto & [ phase, messages ] : message_history_) {
-    (void)phase;
-    for (auto it = messages.begin(); it != messages.end(); ++it) {
-      if (it->first > timestamp) {
-        messages.erase(it, messages.end());
-        break;
-      }
+  load_lazy_phases();
+
+  // Only phases with later messages are modified, each with a binary search,
+  // so that the history stays shared with clones and no other phase is copied
+  vector<Phase> phases;
+  for (auto &it : message_history_) {
+    if (!it.second.empty() && it.second.rbegin()->first > timestamp) {
+      phases.push_back(it.first);
     }
   }
+  if (phases.empty()) {
+    return;
+  }
+  phase_json_.erase_from(phases[0]);
+  for (const Phase &phase : phases) {
+    auto &messages = message_history_[phase];
+    messages.erase(messages.upper_bound(timestamp), messages.end());
+  }
+}
+
+void Game::check_not_held() const {
+  JCHECK(!batch_holds_.held(),
+         "Game modified while in use by a ThreadPool batch");
 }
 
 GameState *Game::get_last_movement_phase() {
-  for (auto it = state_history_.rbegin(); it != state_history_.rend(); ++it) {
-    if (it->first.phase_type == 'M') {
-      return state_history_[it->first].get();
-    }
-  }
+  // The last movement phase is almost always one of the last three entries
+  auto entry = state_history_.find_last_if(
+      [](const auto &entry) { return entry.first.phase_type == 'M'; });
 
-  // no previous move phases
-  return nullptr;
+  // nullptr if no previous move phases
+  return entry == nullptr ? nullptr : entry->second.get();
 }
 
 void Game::clear_old_all_possible_orders() {
@@ -418,18 +993,134 @@ void Game::clear_old_all_possible_orders() {
   }
 }
 
+namespace {
+
+// Add the entries of a history to usage[key], each a std::map node
+template <typename V>
+void add_history_memory_usage(MemoryUsage &usage, MemorySeen &seen,
+                              const std::string &key,
+                              const PhaseMap<V> &history) {
+  for (const auto &p : history) {
+    if (seen.insert(&p.second).second) {
+      usage[key] += 4 * sizeof(void *) + sizeof(p) + heap_bytes(p.second);
+    }
+  }
+}
+
+} // namespace
+
+MemoryUsage Game::memory_usage() const {
+  MemoryUsage r;
+  MemorySeen seen;
+  add_memory_usage(r, seen);
+  return r;
+}
+
+void Game::add_memory_usage(MemoryUsage &usage, MemorySeen &seen) const {
+  if (!seen.insert(this).second) {
+    return;
+  }
+  usage["game"] += sizeof(Game) + heap_bytes(staged_orders_) +
+                   heap_bytes(rules_) + heap_bytes(spring_centers_hashes_);
+
+  state_->add_memory_usage(usage, seen);
+  add_history_memory_usage(usage, seen, "state", state_history_);
+  for (const auto &p : state_history_) {
+    p.second->add_memory_usage(usage, seen);
+  }
+  add_history_memory_usage(usage, seen, "orders", order_history_);
+  add_history_memory_usage(usage, seen, "messages", message_history_);
+  add_history_memory_usage(usage, seen, "logs", logs_);
+  add_history_memory_usage(usage, seen, "phase_json", phase_json_);
+
+  if (lazy_phases_ != nullptr && seen.insert(lazy_phases_.get()).second) {
+    usage["lazy_phases"] += sizeof(LazyJsonPhases) +
+                            heap_bytes(lazy_phases_->json_str) +
+                            heap_bytes(lazy_phases_->ranges);
+  }
+  if (compact_states_ != nullptr && seen.insert(compact_states_.get()).second) {
+    usage["compact_states"] +=
+        sizeof(CompactStates) + compact_states_->heap_bytes();
+  }
+  auto prev_phase_encoding = get_prev_phase_encoding();
+  if (prev_phase_encoding != nullptr &&
+      seen.insert(prev_phase_encoding.get()).second) {
+    usage["prev_phase_encoding"] +=
+        sizeof(PrevPhaseEncoding) +
+        heap_bytes(prev_phase_encoding->x_prev_state) +
+        heap_bytes(prev_phase_encoding->x_prev_orders);
+  }
+}
+
+void Game::write_sos_targets(float value_decay_alpha, float *targets) {
+  auto &state_history = get_state_history();
+  size_t n = state_history.size();
+  if (n == 0) {
+    return;
+  }
+
+  // Scores are only weighted at the end of a year, since not all years have
+  // an adjustment phase. Going back from the last phase, suffix is the
+  // target of a phase whose later phases have been visited.
+  float suffix[7], sc_counts[7], scores[7];
+  write_square_scores(suffix, sc_counts);
+  size_t k = n;
+  uint32_t next_year = 0;
+  state_history.visit_reverse([&](const auto &entry) {
+    --k;
+    float *row = targets + k * 7;
+    entry.second->write_square_scores(scores, sc_counts);
+    if (k + 1 == n) {
+      copy(scores, scores + 7, row);
+    } else {
+      copy(suffix, suffix + 7, row);
+    }
+    if (k + 1 == n || entry.first.year != next_year) {
+      for (int p = 0; p < 7; ++p) {
+        suffix[p] =
+            (1 - value_decay_alpha) * scores[p] + value_decay_alpha * suffix[p];
+      }
+    }
+    next_year = entry.first.year;
+    return false;
+  });
+}
+
 void Game::maybe_early_exit() {
   Phase phase = state_->get_phase();
 
-  if (draw_on_stalemate_years_ < 1 ||
-      phase.year - 1901 < draw_on_stalemate_years_ || phase.season != 'S' ||
+  if (draw_on_stalemate_years_ < 1 || phase.season != 'S' ||
       phase.phase_type != 'M') {
     return;
   }
 
+  // Record this spring's centers, replacing any springs from before a
+  // rollback, and keeping only those compared below
+  auto &hashes = spring_centers_hashes_;
+  while (!hashes.empty() && hashes.back().first >= phase.year) {
+    hashes.pop_back();
+  }
+  hashes.push_back({phase.year, state_->get_centers_hash()});
+  size_t max_size = draw_on_stalemate_years_ + 1;
+  if (hashes.size() > max_size) {
+    hashes.erase(hashes.begin(), hashes.end() - max_size);
+  }
+
+  if (phase.year - 1901 < draw_on_stalemate_years_) {
+    return;
+  }
   for (int i = 1; i <= draw_on_stalemate_years_; ++i) {
-    if (state_->get_centers() !=
-        state_history_.at(Phase('S', phase.year - i, 'M'))->get_centers()) {
+    uint32_t year = phase.year - i;
+    uint64_t prev_hash;
+    if (i < hashes.size() && hashes[hashes.size() - 1 - i].first == year) {
+      prev_hash = hashes[hashes.size() - 1 - i].second;
+    } else {
+      // not recorded, e.g. in a game loaded from json
+      auto prev_state = get_history_state(Phase('S', year, 'M'));
+      JCHECK(prev_state != nullptr, "maybe_early_exit missing spring phase");
+      prev_hash = prev_state->get_centers_hash();
+    }
+    if (prev_hash != hashes.back().second) {
       // no stalemate
       return;
     }
@@ -439,6 +1130,11 @@ void Game::maybe_early_exit() {
   DLOG(INFO) << "Game over! Stalemate after " << draw_on_stalemate_years_
              << " years";
 
+  // The state may be shared with games processed like this one, which need
+  // not have stalemated
+  if (state_.use_count() > 1) {
+    state_ = std::make_shared<GameState>(*state_);
+  }
   state_->set_phase(phase.completed());
 }
 
@@ -449,6 +1145,9 @@ void Game::add_message(Power sender, Power recipient, const std::string &body,
                     std::chrono::system_clock::now().time_since_epoch())
                     .count();
   }
+  if (rollout_mode_) {
+    return;
+  }
   auto &phase_messages = message_history_[state_->get_phase()];
   if (phase_messages.find(time_sent) != phase_messages.end()) {
     JFAIL("add_message duplicate timestamps not currently allowed");
@@ -458,6 +1157,9 @@ void Game::add_message(Power sender, Power recipient, const std::string &body,
 }
 
 void Game::add_log(const std::string &data) {
+  if (rollout_mode_) {
+    return;
+  }
   logs_[state_->get_phase()].push_back(data);
 }
 
@@ -465,6 +1167,7 @@ std::optional<Phase> Game::get_next_phase(Phase from) {
   if (from == state_->get_phase()) {
     return {};
   }
+  load_lazy_phases();
   auto it = state_history_.find(from);
   if (it == state_history_.end()) {
     JFAIL("get_next_phase phase not found");
@@ -483,6 +1186,7 @@ std::optional<Phase> Game::get_prev_phase(Phase from) {
   if (from == state_->get_phase()) {
     return state_history_.rbegin()->first;
   }
+  load_lazy_phases();
   auto it = state_history_.find(from);
   if (it == state_history_.end()) {
     JFAIL("get_prev_phase phase not found");
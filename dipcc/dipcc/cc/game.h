@@ -7,17 +7,23 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 
 #include "../pybind/phase_data.h"
 #include "../pybind/py_dict.h"
+#include "../pybind/state_view.h"
+#include "binary.h"
+#include "compact_states.h"
 #include "enums.h"
 #include "game_state.h"
 #include "hash.h"
@@ -26,6 +32,8 @@ LICENSE file in the root directory of this source tree.
 #include "message.h"
 #include "order.h"
 #include "phase.h"
+#include "phase_map.h"
+#include "phase_orders.h"
 #include "power.h"
 #include "thirdparty/nlohmann/json.hpp"
 #include "unit.h"
@@ -34,6 +42,65 @@ using nlohmann::json;
 
 namespace dipcc {
 
+// Map of power -> order strings, as passed to Game::set_orders
+using PowerOrderStrs =
+    std::unordered_map<std::string, std::vector<std::string>>;
+
+// Memoized x_prev_state and x_prev_orders of a Game, as encoded by the
+// OrdersEncoder with id encoder_id
+struct PrevPhaseEncoding {
+  uint64_t encoder_id;
+  std::vector<float> x_prev_state;
+  std::vector<long> x_prev_orders;
+  uint64_t hash = 0; // of the previous movement state and x_prev_orders
+};
+
+// Number of ThreadPool batches holding a Game, or -1 if one holds it
+// exclusively. Copies of a Game start unheld.
+class GameBatchHolds {
+public:
+  GameBatchHolds() {}
+  GameBatchHolds(const GameBatchHolds &) {}
+  GameBatchHolds &operator=(const GameBatchHolds &) { return *this; }
+
+  bool try_acquire(bool exclusive) {
+    int n = holds_.load();
+    do {
+      if (n < 0 || (exclusive && n > 0)) {
+        return false;
+      }
+    } while (!holds_.compare_exchange_weak(n, exclusive ? -1 : n + 1));
+    return true;
+  }
+  void release(bool exclusive) {
+    if (exclusive) {
+      holds_ = 0;
+    } else {
+      --holds_;
+    }
+  }
+  bool held() const { return holds_ != 0; }
+
+private:
+  std::atomic<int> holds_{0};
+};
+
+// Options of Game::to_bytes, to make smaller copies of a game, e.g. to move
+// it to another process
+struct GameBytesOptions {
+  bool messages = true;
+  bool logs = true;
+
+  // If false, only the history kept in rollout mode: from the last movement
+  // phase, and the phases checked for a stalemate
+  bool full_history = true;
+};
+
+// Result of Game::try_process
+enum class ProcessStatus { OK = 0, CONVOY_PARADOX = 1, ERROR = 2 };
+
+class GameSnapshot;
+
 class Game {
 public:
   Game(int draw_on_stalemate_years = -1);
@@ -41,12 +108,27 @@ public:
 
   void set_orders(const std::string &power,
                   const std::vector<std::string> &orders);
+  void set_orders(Power power, const std::vector<Order> &orders);
 
   void process();
 
+  // Same as process(), but if leader was just processed from an equal state
+  // with the same staged orders, share its new state instead of adjudicating
+  // again. ThreadPool::process_multi uses this for games cloned from one
+  // game, e.g. rollouts of the same orders.
+  void process_like(const Game &leader);
+
+  // Same as process() and process_like(), but return a status instead of
+  // throwing, leaving the game unprocessed unless OK: CONVOY_PARADOX if the
+  // orders have a convoy paradox and set_exception_on_convoy_paradox was
+  // called, or ERROR if adjudication fails. For batches, where one bad game
+  // should not fail the others.
+  ProcessStatus try_process();
+  ProcessStatus try_process_like(const Game &leader);
+
   GameState &get_state();
 
-  std::unordered_map<Power, std::vector<Loc>> get_orderable_locations();
+  const PowerMap<std::vector<Loc>> &get_orderable_locations();
 
   const std::unordered_map<Loc, std::set<Order>> &get_all_possible_orders();
 
@@ -59,39 +141,161 @@ public:
 
   std::string game_id;
 
+  // Each completed phase is serialized once and memoized, so saving a game
+  // after every phase only formats the new ones
   std::string to_json();
 
+  // Compact, versioned binary alternative to to_json / from_json with the
+  // same contents, less what options drop. States are delta-encoded as in
+  // compact_history, whose states are copied as they are. from_bytes does
+  // not copy data, and reads the previous version too.
+  std::string to_bytes(const GameBytesOptions &options = {});
+  static Game from_bytes(std::string_view data);
+
+  // Same as from_bytes(data).rolled_back_to_phase_start(phase) where phase is
+  // the phase_idx-th phase, but only decodes the phases up to it
+  static Game from_bytes_at_phase_start(std::string_view data,
+                                        size_t phase_idx);
+
   Game rolled_back_to_phase_start(const std::string &phase_s);
   Game rolled_back_to_phase_end(const std::string &phase_s);
+  // In-place versions of the above, for search code branching from an
+  // earlier phase of a game it owns
+  void rollback_to_phase_start(const std::string &phase_s);
+  void rollback_to_phase_end(const std::string &phase_s);
+
+  // Save the current phase, staged orders and history, to return to them
+  // with restore, e.g. after stepping or rolling back. Both are O(1): the
+  // snapshot shares the histories with the game, and neither copies a phase.
+  GameSnapshot snapshot() const;
+  void restore(const GameSnapshot &snapshot);
   void rollback_messages_to_timestamp(const uint64_t timestamp);
 
-  std::map<Phase, std::shared_ptr<GameState>> &get_state_history() {
+  // Keep the states of the phases before the last movement phase, which
+  // encoding and processing don't need, delta-encoded: a keyframe every
+  // keyframe_interval phases and the changed units and centers in between
+  // (see CompactStates). Long games then take a fraction of the memory.
+  // Like the phases left by from_json_lazy, they are decoded again on access
+  // to the whole history; get_history_state reads one without doing so.
+  void compact_history(
+      size_t keyframe_interval = CompactStates::DEFAULT_KEYFRAME_INTERVAL);
+
+  // The state of a past phase, or nullptr if there is none
+  std::shared_ptr<GameState> get_history_state(const Phase &phase);
+
+  PhaseMap<std::shared_ptr<GameState>> &get_state_history() {
+    load_lazy_phases();
     return state_history_;
   }
-  std::map<Phase, std::unordered_map<Power, std::vector<Order>>> &
-  get_order_history() {
+  PhaseMap<PhaseOrders> &get_order_history() {
+    load_lazy_phases();
+    return order_history_;
+  }
+  // The order history without decoding lazy phases (see from_json_lazy):
+  // complete back to the last movement phase
+  const PhaseMap<PhaseOrders> &get_recent_order_history() const {
     return order_history_;
   }
 
   size_t compute_board_hash() const { return state_->compute_board_hash(); }
+  uint64_t stable_board_hash() const { return state_->stable_board_hash(); }
 
   std::vector<float> get_square_scores() const {
     return state_->get_square_scores();
   }
+  void write_square_scores(float *scores, float *sc_counts) const {
+    state_->write_square_scores(scores, sc_counts);
+  }
+
+  // Write the [n, 7] value targets of the n phases of get_state_history():
+  // their later end-of-year phases' square scores, exponentially weighted by
+  // value_decay_alpha, with the remaining weight on the current phase's, as
+  // dataset.py's encode_weighted_sos_scores. The last phase's target is its
+  // own square scores.
+  void write_sos_targets(float value_decay_alpha, float *targets);
 
   void clear_old_all_possible_orders();
 
+  // If set, the default, process() frees the possible orders of past states
+  // other than the last movement phase, as clear_old_all_possible_orders
+  // does, so that long games don't keep one set per phase. They are
+  // regenerated if a past state is asked for them. States shared with copies
+  // of this Game are left alone.
+  void set_evict_old_possible_orders(bool evict) {
+    evict_old_possible_orders_ = evict;
+  }
+  bool get_evict_old_possible_orders() const {
+    return evict_old_possible_orders_;
+  }
+
+  // Approximate bytes used, by component: "state" and "possible_orders" of
+  // the current and past states (see GameState::memory_usage), "orders",
+  // "messages" and "logs" histories, "phase_json", "lazy_phases" and
+  // "compact_states" (see to_json, from_json_lazy and compact_history),
+  // "prev_phase_encoding", and "game" for the rest. Copies share their
+  // history, so add_memory_usage counts what several games share once.
+  MemoryUsage memory_usage() const;
+  void add_memory_usage(MemoryUsage &usage, MemorySeen &seen) const;
+
+  // ThreadPool holds the Game for the duration of a batch, shared by batches
+  // that only encode it and exclusively by batches that step it. It is an
+  // error to mutate a held Game from Python, which may run concurrently since
+  // batches release the GIL.
+  GameBatchHolds &get_batch_holds() { return batch_holds_; }
+  void check_not_held() const;
+
+  // Encoding cache for ThreadPool, reset whenever the history changes. Game
+  // copies share it.
+  std::shared_ptr<const PrevPhaseEncoding> get_prev_phase_encoding() const {
+    return std::atomic_load(&prev_phase_encoding_);
+  }
+  void set_prev_phase_encoding(std::shared_ptr<const PrevPhaseEncoding> e) {
+    std::atomic_store(&prev_phase_encoding_, std::move(e));
+  }
+
   void set_exception_on_convoy_paradox() {
     exception_on_convoy_paradox_ = true;
   }
 
+  bool get_exception_on_convoy_paradox() const {
+    return exception_on_convoy_paradox_;
+  }
+
   void set_draw_on_stalemate_years(int year) {
     draw_on_stalemate_years_ = year;
   }
+  int get_draw_on_stalemate_years() const { return draw_on_stalemate_years_; }
+
+  // Options of to_bytes when pickling the Game in Python, e.g. to drop
+  // messages from games sent between processes
+  void set_pickle_options(const GameBytesOptions &options) {
+    pickle_options_ = options;
+  }
+  const GameBytesOptions &get_pickle_options() const {
+    return pickle_options_;
+  }
+
+  // If set, movement phases only generate possible orders on request, one
+  // unit at a time, reusing the previous phase's where possible
+  void set_lazy_possible_orders(bool lazy) { lazy_possible_orders_ = lazy; }
+  bool get_lazy_possible_orders() const { return lazy_possible_orders_; }
+
+  // If set, keep only the history needed to encode and process the game
+  // (from the last movement phase, and the phases checked for a stalemate),
+  // and drop messages and logs. For search rollouts.
+  void set_rollout_mode(bool rollout_mode);
+  bool get_rollout_mode() const { return rollout_mode_; }
+
+  // Orders set since the last process(), by power. Powers passed to
+  // set_orders are present even if given no orders.
+  const PowerMap<std::vector<Order>> &get_staged_orders() const {
+    return staged_orders_;
+  }
 
   // press
 
-  std::map<Phase, std::map<uint64_t, Message>> &get_message_history() {
+  PhaseMap<std::map<uint64_t, Message>> &get_message_history() {
+    load_lazy_phases();
     return message_history_;
   }
 
@@ -103,7 +307,7 @@ public:
 
   std::unordered_map<std::string, std::vector<std::string>>
   py_get_all_possible_orders();
-  pybind11::dict py_get_state();
+  StateView py_get_state();
   pybind11::dict py_get_orderable_locations();
   std::vector<PhaseData> get_phase_history();
   PhaseData get_phase_data();
@@ -116,6 +320,12 @@ public:
 
   static Game from_json(const std::string &s) { return Game(s); }
 
+  // Like from_json, but only decodes the last n_phases phases of a "phases"
+  // document, and any before them back to the last movement phase, which is
+  // all that encoding and processing the current phase need. Earlier phases
+  // are kept as their raw JSON, and decoded on first access to the history.
+  static Game from_json_lazy(const std::string &s, size_t n_phases = 2);
+
   std::string get_phase_long() { return state_->get_phase().to_string_long(); }
   std::string get_phase_short() { return state_->get_phase().to_string(); }
   void py_add_message(const std::string &sender, const std::string &recipient,
@@ -130,23 +340,86 @@ public:
   char phase_type() { return state_->get_phase().phase_type; }
 
 private:
+  friend class GameSnapshot;
+
+  Game(BinaryReader &reader, std::optional<size_t> phase_start = {});
+
+  // Phases of a from_json_lazy document that are not decoded yet: the byte
+  // ranges of their objects in json_str, in order. Shared by copies.
+  struct LazyJsonPhases {
+    std::string json_str;
+    std::vector<std::pair<size_t, size_t>> ranges;
+  };
+
+  // Add a phase object of a to_json document to the history
+  void load_json_phase(const json &j_phase);
+  // Decode the phases left by from_json_lazy or compact_history, if any
+  void load_lazy_phases() {
+    if (lazy_phases_ != nullptr || compact_states_ != nullptr) {
+      decode_lazy_phases();
+    }
+  }
+  void decode_lazy_phases();
+
+  // Process the staged orders into next if given, else adjudicate them. If
+  // throw_errors is false, return the status instead, see try_process.
+  ProcessStatus process(std::shared_ptr<GameState> next, bool throw_errors);
+  ProcessStatus process_like(const Game &leader, bool throw_errors);
   void crash_dump();
   void maybe_early_exit();
+  void prune_history();
+  std::optional<Phase> rollout_history_start();
+  void evict_possible_orders(const Phase &phase);
 
   void rollback_to_phase(const std::string &phase_s,
                          bool preserve_phase_messages,
                          bool preserve_phase_orders, bool preserve_phase_logs);
 
   // Members
+  // Histories are PhaseMaps, so copying a Game shares them in O(1)
   std::shared_ptr<GameState> state_;
-  std::unordered_map<Power, std::vector<Order>> staged_orders_;
-  std::map<Phase, std::shared_ptr<GameState>> state_history_;
-  std::map<Phase, std::unordered_map<Power, std::vector<Order>>> order_history_;
-  std::map<Phase, std::vector<std::string>> logs_;
-  std::map<Phase, std::map<uint64_t, Message>> message_history_;
+  PowerMap<std::vector<Order>> staged_orders_;
+  PhaseMap<std::shared_ptr<GameState>> state_history_;
+  PhaseMap<PhaseOrders> order_history_;
+  PhaseMap<std::vector<std::string>> logs_;
+  PhaseMap<std::map<uint64_t, Message>> message_history_;
+  // Serialized to_json phase objects of completed phases, filled by to_json
+  // and erased when a phase's history changes
+  PhaseMap<std::string> phase_json_;
+  std::shared_ptr<const LazyJsonPhases> lazy_phases_;
+  // States of the phases before state_history_'s, see compact_history
+  std::shared_ptr<const CompactStates> compact_states_;
+  std::shared_ptr<const PrevPhaseEncoding> prev_phase_encoding_;
+  GameBatchHolds batch_holds_;
   std::vector<std::string> rules_ = {"NO_PRESS", "POWER_CHOICE"};
   int draw_on_stalemate_years_ = -1;
+  // (year, centers hash) of the last springs, for maybe_early_exit
+  std::vector<std::pair<uint32_t, uint64_t>> spring_centers_hashes_;
   bool exception_on_convoy_paradox_ = false;
+  bool lazy_possible_orders_ = false;
+  bool evict_old_possible_orders_ = true;
+  bool rollout_mode_ = false;
+  GameBytesOptions pickle_options_;
+};
+
+// Opaque handle to the state of a Game, see Game::snapshot. It shares the
+// Game's histories (PhaseMaps) and current state, so taking one is O(1) and
+// it stays valid however the Game changes afterwards.
+class GameSnapshot {
+private:
+  friend class Game;
+
+  std::shared_ptr<GameState> state_;
+  PowerMap<std::vector<Order>> staged_orders_;
+  PhaseMap<std::shared_ptr<GameState>> state_history_;
+  PhaseMap<PhaseOrders> order_history_;
+  PhaseMap<std::vector<std::string>> logs_;
+  PhaseMap<std::map<uint64_t, Message>> message_history_;
+  PhaseMap<std::string> phase_json_;
+  std::shared_ptr<const Game::LazyJsonPhases> lazy_phases_;
+  std::shared_ptr<const CompactStates> compact_states_;
+  std::shared_ptr<const PrevPhaseEncoding> prev_phase_encoding_;
+  std::vector<std::pair<uint32_t, uint64_t>> spring_centers_hashes_;
 };
 
 } // namespace dipcc
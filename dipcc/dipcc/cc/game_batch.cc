@@ -0,0 +1,102 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "game_batch.h"
+#include "checks.h"
+
+using namespace std;
+
+namespace dipcc {
+
+GameBatch::GameBatch(vector<Game> games) : games_(std::move(games)) {
+  init_game_ptrs();
+}
+
+GameBatch::GameBatch(ThreadPool &pool, Game &game, size_t n)
+    : games_(pool.clone_multi(game, n)) {
+  init_game_ptrs();
+}
+
+void GameBatch::init_game_ptrs() {
+  game_ptrs_.clear();
+  game_ptrs_.reserve(games_.size());
+  for (Game &game : games_) {
+    game_ptrs_.push_back(&game);
+  }
+}
+
+Game &GameBatch::at(size_t i) {
+  JCHECK(i < games_.size(), "GameBatch index out of range");
+  return games_[i];
+}
+
+GameBatch GameBatch::select(const vector<size_t> &idxs) const {
+  vector<Game> games;
+  games.reserve(idxs.size());
+  for (size_t i : idxs) {
+    JCHECK(i < games_.size(), "GameBatch index out of range");
+    games.push_back(games_[i]);
+  }
+  return GameBatch(std::move(games));
+}
+
+void GameBatch::set_orders_from_idxs(ThreadPool &pool,
+                                     torch::Tensor order_idxs) {
+  pool.set_orders_from_idxs(game_ptrs_, order_idxs);
+}
+
+void GameBatch::process(ThreadPool &pool) {
+  vector<Game *> not_done;
+  not_done.reserve(game_ptrs_.size());
+  for (Game *game : game_ptrs_) {
+    if (!game->is_game_done()) {
+      not_done.push_back(game);
+    }
+  }
+  pool.process_multi(not_done);
+}
+
+TensorDict GameBatch::encode_inputs(ThreadPool &pool) {
+  return pool.encode_inputs_multi(game_ptrs_);
+}
+
+TensorDict GameBatch::encode_inputs_all_powers(ThreadPool &pool) {
+  return pool.encode_inputs_all_powers_multi(game_ptrs_);
+}
+
+TensorDict GameBatch::step_and_encode(ThreadPool &pool,
+                                      torch::Tensor order_idxs) {
+  return pool.step_and_encode_multi(game_ptrs_, order_idxs);
+}
+
+torch::Tensor GameBatch::get_square_scores() const {
+  long B = games_.size();
+  torch::Tensor r = torch::empty({B, 7}, torch::kFloat32);
+  float *p = r.data_ptr<float>();
+  float sc_counts[7];
+  for (const Game &game : games_) {
+    game.write_square_scores(p, sc_counts);
+    p += 7;
+  }
+  return r;
+}
+
+torch::Tensor GameBatch::get_scores(ThreadPool &pool) {
+  return pool.get_scores_multi(game_ptrs_);
+}
+
+torch::Tensor GameBatch::get_is_done() const {
+  long B = games_.size();
+  torch::Tensor r = torch::empty({B}, torch::kBool);
+  bool *p = r.data_ptr<bool>();
+  for (const Game &game : games_) {
+    *p++ = game.is_game_done();
+  }
+  return r;
+}
+
+} // namespace dipcc
@@ -0,0 +1,73 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <torch/torch.h>
+#include <vector>
+
+#include "data_fields.h"
+#include "game.h"
+#include "thread_pool.h"
+
+namespace dipcc {
+
+// A fixed set of games owned by one object, so that rollout loops can keep
+// their working set in C++ and hand it to ThreadPool every ply without
+// converting a Python list of games on each call.
+class GameBatch {
+public:
+  GameBatch() {}
+  GameBatch(std::vector<Game> games);
+  GameBatch(const GameBatch &other) : games_(other.games_) {
+    init_game_ptrs();
+  }
+  GameBatch &operator=(const GameBatch &other) {
+    games_ = other.games_;
+    init_game_ptrs();
+    return *this;
+  }
+  GameBatch(GameBatch &&) = default;
+  GameBatch &operator=(GameBatch &&) = default;
+
+  // n copies of game, made by pool's worker threads
+  GameBatch(ThreadPool &pool, Game &game, size_t n);
+
+  size_t size() const { return games_.size(); }
+  Game &at(size_t i);
+
+  // A batch of copies of the games at idxs. Game copies share their history,
+  // so this is O(idxs.size()).
+  GameBatch select(const std::vector<size_t> &idxs) const;
+
+  // Pointers to the games, in order, for ThreadPool calls
+  std::vector<Game *> &get_game_ptrs() { return game_ptrs_; }
+
+  // See the ThreadPool methods of the same names. process() and
+  // step_and_encode() do not step games that are done.
+  void set_orders_from_idxs(ThreadPool &pool, torch::Tensor order_idxs);
+  void process(ThreadPool &pool);
+  TensorDict encode_inputs(ThreadPool &pool);
+  TensorDict encode_inputs_all_powers(ThreadPool &pool);
+  TensorDict step_and_encode(ThreadPool &pool, torch::Tensor order_idxs);
+
+  // [B, 7] float square scores, and [B] bool game-done mask
+  torch::Tensor get_square_scores() const;
+  torch::Tensor get_is_done() const;
+
+  // [B, 3, 7] square scores, SC counts and alive masks, see
+  // ThreadPool::get_scores_multi
+  torch::Tensor get_scores(ThreadPool &pool);
+
+private:
+  void init_game_ptrs();
+
+  std::vector<Game> games_;
+  std::vector<Game *> game_ptrs_;
+};
+
+} // namespace dipcc
@@ -0,0 +1,175 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binary.h"
+#include "checks.h"
+#include "game_corpus.h"
+#include "zobrist.h"
+
+using namespace std;
+
+namespace dipcc {
+
+// File layout:
+//
+//   header: magic "DIPK" (u32), version (u32)
+//   games:  the Game::to_bytes of each game, back to back
+//   index:  per game, offset (u64), size (u64), n_phases (u64)
+//   footer: index offset (u64), n_games (u64), magic (u32)
+namespace {
+
+const uint32_t CORPUS_MAGIC = 0x4b504944;
+const uint32_t CORPUS_VERSION = 1;
+const size_t HEADER_SIZE = 8;
+const size_t FOOTER_SIZE = 20;
+const size_t INDEX_ENTRY_SIZE = 24;
+
+} // namespace
+
+void GameCorpus::write(const string &path, const vector<Game *> &games) {
+  ofstream out(path, ios::binary | ios::trunc);
+  JCHECK(out.good(), "GameCorpus could not open for writing: " + path);
+
+  BinaryWriter header;
+  header.write_u32(CORPUS_MAGIC);
+  header.write_u32(CORPUS_VERSION);
+  out.write(header.get().data(), header.get().size());
+
+  BinaryWriter index;
+  size_t offset = HEADER_SIZE;
+  for (Game *game : games) {
+    string bytes = game->to_bytes();
+    out.write(bytes.data(), bytes.size());
+    index.write_u64(offset);
+    index.write_u64(bytes.size());
+    index.write_u64(game->get_state_history().size());
+    offset += bytes.size();
+  }
+  index.write_u64(offset);
+  index.write_u64(games.size());
+  index.write_u32(CORPUS_MAGIC);
+  out.write(index.get().data(), index.get().size());
+
+  out.close();
+  JCHECK(!out.fail(), "GameCorpus write failed: " + path);
+}
+
+GameCorpus::GameCorpus(const string &path) {
+  fd_ = open(path.c_str(), O_RDONLY);
+  JCHECK(fd_ >= 0, "GameCorpus could not open: " + path);
+  struct stat st;
+  JCHECK(fstat(fd_, &st) == 0, "GameCorpus could not stat: " + path);
+  size_ = st.st_size;
+  if (size_ < HEADER_SIZE + FOOTER_SIZE) {
+    close(fd_);
+    JFAIL("GameCorpus file too small: " + path);
+  }
+
+  void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    close(fd_);
+    JFAIL("GameCorpus could not mmap: " + path);
+  }
+  data_ = static_cast<const char *>(p);
+
+  // Games are read at random, so don't read ahead
+  madvise(p, size_, MADV_RANDOM);
+
+  BinaryReader header(string_view(data_, HEADER_SIZE));
+  JCHECK(header.read_u32() == CORPUS_MAGIC, "GameCorpus bad magic: " + path);
+  JCHECK(header.read_u32() == CORPUS_VERSION,
+         "GameCorpus unsupported version: " + path);
+
+  BinaryReader footer(string_view(data_ + size_ - FOOTER_SIZE, FOOTER_SIZE));
+  size_t index_offset = footer.read_u64();
+  size_t n_games = footer.read_u64();
+  JCHECK(footer.read_u32() == CORPUS_MAGIC,
+         "GameCorpus bad footer, file truncated? " + path);
+  JCHECK(index_offset + n_games * INDEX_ENTRY_SIZE + FOOTER_SIZE == size_,
+         "GameCorpus bad index: " + path);
+
+  BinaryReader index(
+      string_view(data_ + index_offset, n_games * INDEX_ENTRY_SIZE));
+  game_offsets_.reserve(n_games);
+  phase_offsets_.reserve(n_games + 1);
+  phase_offsets_.push_back(0);
+  for (size_t i = 0; i < n_games; ++i) {
+    size_t offset = index.read_u64();
+    size_t size = index.read_u64();
+    size_t n_phases = index.read_u64();
+    JCHECK(offset + size <= index_offset, "GameCorpus bad index: " + path);
+    game_offsets_.push_back({offset, size});
+    phase_offsets_.push_back(phase_offsets_.back() + n_phases);
+  }
+}
+
+GameCorpus::~GameCorpus() {
+  munmap(const_cast<char *>(data_), size_);
+  close(fd_);
+}
+
+pair<size_t, size_t> GameCorpus::get_phase_range(size_t game_i) const {
+  JCHECK(game_i < get_n_games(), "GameCorpus game out of range");
+  return {phase_offsets_[game_i], phase_offsets_[game_i + 1]};
+}
+
+pair<size_t, size_t> GameCorpus::get_game_and_phase(size_t phase_i) const {
+  JCHECK(phase_i < get_n_phases(), "GameCorpus phase out of range");
+  auto it =
+      upper_bound(phase_offsets_.begin(), phase_offsets_.end(), phase_i) - 1;
+  size_t game_i = it - phase_offsets_.begin();
+  return {game_i, phase_i - *it};
+}
+
+string_view GameCorpus::get_game_bytes(size_t game_i) const {
+  JCHECK(game_i < get_n_games(), "GameCorpus game out of range");
+  auto & [ offset, size ] = game_offsets_[game_i];
+  return string_view(data_ + offset, size);
+}
+
+Game GameCorpus::get_game(size_t game_i) const {
+  return Game::from_bytes(get_game_bytes(game_i));
+}
+
+Game GameCorpus::get_phase(size_t phase_i) const {
+  auto[game_i, game_phase_i] = get_game_and_phase(phase_i);
+  return Game::from_bytes_at_phase_start(get_game_bytes(game_i), game_phase_i);
+}
+
+vector<uint64_t> get_position_hashes(Game &game) {
+  using zobrist::detail::splitmix64;
+  const PhaseMap<PhaseOrders> &order_history = game.get_order_history();
+  vector<uint64_t> r;
+  r.reserve(game.get_state_history().size());
+
+  // Hash of the board of the last movement phase plus the keys of the orders
+  // since, which are encoded sorted, so their order doesn't matter
+  uint64_t prev = 0;
+  for (auto &it : game.get_state_history()) {
+    uint64_t board = it.second->stable_board_hash();
+    r.push_back(splitmix64(board ^ splitmix64(prev)));
+    if (it.first.phase_type == 'M') {
+      prev = splitmix64(board);
+    }
+    const PhaseOrders *orders = order_history.find_value(it.first);
+    if (orders != nullptr) {
+      for (const Order &order : orders->get_all_orders()) {
+        prev += zobrist::order(order);
+      }
+    }
+  }
+  return r;
+}
+
+} // namespace dipcc
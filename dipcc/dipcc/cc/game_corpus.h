@@ -0,0 +1,76 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "game.h"
+
+namespace dipcc {
+
+// Read-only, memory-mapped file of many games in the Game::to_bytes format,
+// indexed by game and by phase. Phases are numbered across all games, in
+// order; the phases of a game are those of its phase history (excluding the
+// current phase), as in Game::get_phase_history.
+//
+// Games are decoded on demand straight from the mapping, so a corpus larger
+// than memory can be read, and processes reading the same file share the
+// page cache. Safe to read from several threads at once.
+class GameCorpus {
+public:
+  // Write games to a new corpus file at path
+  static void write(const std::string &path, const std::vector<Game *> &games);
+
+  GameCorpus(const std::string &path);
+  ~GameCorpus();
+  GameCorpus(const GameCorpus &) = delete;
+  GameCorpus &operator=(const GameCorpus &) = delete;
+
+  size_t get_n_games() const { return game_offsets_.size(); }
+  size_t get_n_phases() const { return phase_offsets_.back(); }
+
+  // Return the [first, end) corpus phases of a game
+  std::pair<size_t, size_t> get_phase_range(size_t game_i) const;
+
+  // Return the (game index, phase index within game) of a corpus phase
+  std::pair<size_t, size_t> get_game_and_phase(size_t phase_i) const;
+
+  // Return the full game
+  Game get_game(size_t game_i) const;
+
+  // Return the game rolled back to the start of a corpus phase
+  Game get_phase(size_t phase_i) const;
+
+private:
+  std::string_view get_game_bytes(size_t game_i) const;
+
+  int fd_ = -1;
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+
+  // Per game: offset and size of its bytes
+  std::vector<std::pair<size_t, size_t>> game_offsets_;
+
+  // phase_offsets_[i] is the index of the first phase of game i. Has
+  // n_games + 1 elements.
+  std::vector<size_t> phase_offsets_;
+};
+
+// Stable hashes of the positions of a game's phases, one per phase of its
+// state history: of the board (see GameState::stable_board_hash) and of the
+// previous orders of the model inputs, i.e. the board of the last movement
+// phase before it and the orders given since (see
+// OrdersEncoder::encode_prev_orders_deepmind). Phases of any games whose
+// boards and previous orders are equal have equal hashes, in every process.
+std::vector<uint64_t> get_position_hashes(Game &game);
+
+} // namespace dipcc
@@ -0,0 +1,151 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "checks.h"
+#include "game_gen.h"
+#include "loc.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+template <typename T>
+const T &uniform_choice(const vector<T> &xs, mt19937 &rng) {
+  return xs[uniform_int_distribution<size_t>(0, xs.size() - 1)(rng)];
+}
+
+// Replace some of the staged movement orders by convoys and attacks, at the
+// options' rates. Each unit keeps a single order.
+void add_convoys_and_attacks(Game &game, const GameGenOptions &options,
+                             mt19937 &rng) {
+  GameState &state = game.get_state();
+  bernoulli_distribution convoy(options.convoy_rate);
+  bernoulli_distribution attack(options.attack_rate);
+
+  PowerMap<vector<Order>> orders = game.get_staged_orders();
+  LocMap<Order> by_loc;
+  for (auto &it : orders) {
+    for (const Order &order : it.second) {
+      by_loc[order.get_unit().loc] = order;
+    }
+  }
+  LocSet fixed; // units already given a convoy or attack order
+
+  vector<pair<Loc, OwnedUnit>> units;
+  for (auto &it : state.get_units()) {
+    units.push_back({it.first, it.second});
+  }
+  shuffle(units.begin(), units.end(), rng);
+
+  // A fleet convoys an army of its power, which moves via convoy
+  for (auto & [ loc, unit ] : units) {
+    if (unit.type != UnitType::FLEET || fixed.contains(loc) ||
+        !convoy(rng)) {
+      continue;
+    }
+    vector<pair<Order, Order>> candidates;
+    for (const Order &order : state.get_possible_orders(loc)) {
+      if (order.get_type() != OrderType::C) {
+        continue;
+      }
+      Loc army_loc = order.get_target().loc;
+      OwnedUnit army = state.get_unit(army_loc);
+      Order via(army.unowned(), OrderType::M, order.get_dest(), true);
+      if (army.power == unit.power && !fixed.contains(army_loc) &&
+          state.is_valid_movement(via)) {
+        candidates.push_back({order, via});
+      }
+    }
+    if (!candidates.empty()) {
+      auto & [ convoy_order, via ] = uniform_choice(candidates, rng);
+      by_loc[loc] = convoy_order;
+      by_loc[via.get_unit().loc] = via;
+      fixed.insert(loc);
+      fixed.insert(via.get_unit().loc);
+    }
+  }
+
+  // A unit moves onto a unit of another power, supported if possible
+  for (auto & [ loc, unit ] : units) {
+    if (fixed.contains(loc) || !attack(rng)) {
+      continue;
+    }
+    // Supported moves first, which are the ones that dislodge
+    vector<pair<Order, Loc>> supported, unsupported;
+    for (const Order &order : state.get_possible_orders(loc)) {
+      if (order.get_type() != OrderType::M || order.get_via()) {
+        continue;
+      }
+      Loc dest = root_loc(order.get_dest());
+      OwnedUnit target = state.get_unit_rooted(dest);
+      if (target.type == UnitType::NONE || target.power == unit.power) {
+        continue;
+      }
+      Loc supporter = Loc::NONE;
+      for (auto & [ other_loc, other ] : units) {
+        if (other.power == unit.power && !fixed.contains(other_loc) &&
+            state.is_valid_movement(Order(other.unowned(), OrderType::SM,
+                                          unit.unowned(), dest))) {
+          supporter = other_loc;
+          break;
+        }
+      }
+      (supporter == Loc::NONE ? unsupported : supported)
+          .push_back({order, supporter});
+    }
+    const auto &moves = supported.empty() ? unsupported : supported;
+    if (moves.empty()) {
+      continue;
+    }
+    auto & [ move, supporter ] = uniform_choice(moves, rng);
+    by_loc[loc] = move;
+    fixed.insert(loc);
+    if (supporter != Loc::NONE) {
+      OwnedUnit other = state.get_unit(supporter);
+      by_loc[supporter] = Order(other.unowned(), OrderType::SM, unit.unowned(),
+                                root_loc(move.get_dest()));
+      fixed.insert(supporter);
+    }
+  }
+
+  for (auto &it : orders) {
+    it.second.clear();
+  }
+  for (auto &it : by_loc) {
+    orders[state.get_unit(it.first).power].push_back(it.second);
+  }
+  for (auto &it : orders) {
+    game.set_orders(it.first, it.second);
+  }
+}
+
+} // namespace
+
+Game generate_game(const GameGenOptions &options, uint64_t seed) {
+  JCHECK(options.n_phases >= 0, "generate_game: negative n_phases");
+  mt19937 rng(seed);
+  Game game;
+  game.game_id = "gen_" + to_string(seed);
+  for (int i = 0; i < options.n_phases && !game.is_game_done(); ++i) {
+    set_playout_orders(game, options.policy, rng);
+    if (game.get_state().get_phase().phase_type == 'M' &&
+        (options.convoy_rate > 0 || options.attack_rate > 0)) {
+      add_convoys_and_attacks(game, options, rng);
+    }
+    game.process();
+  }
+  return game;
+}
+
+} // namespace dipcc
@@ -0,0 +1,40 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "game.h"
+#include "playout.h"
+
+namespace dipcc {
+
+// Options of generate_game
+struct GameGenOptions {
+  // Policy of the orders that are not convoys or attacks
+  PlayoutPolicy policy = PlayoutPolicy::HEURISTIC;
+
+  // Number of phases to process, fewer if the game ends first
+  int n_phases = 100;
+
+  // Chance of each fleet that can convoy an army of its power to do so, with
+  // the army moving via convoy
+  float convoy_rate = 0;
+
+  // Chance of each unit next to a unit of another power to move onto it,
+  // supported by a unit of its power if one can, which dislodges units
+  float attack_rate = 0;
+};
+
+// A game of legal orders played from the start with the given options, the
+// same for the same seed, with game_id "gen_<seed>". Convoy and attack rates
+// of e.g. 0.5 give games much denser in convoys and dislodgements than
+// self-play, to exercise the slower engine paths.
+Game generate_game(const GameGenOptions &options, uint64_t seed);
+
+} // namespace dipcc
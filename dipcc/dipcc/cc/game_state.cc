@@ -5,6 +5,10 @@ This source code is licensed under the MIT license found in the
 LICENSE file in the root directory of this source tree.
 */
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <unordered_set>
@@ -12,18 +16,33 @@ LICENSE file in the root directory of this source tree.
 #include <vector>
 
 #include "adjacencies.h"
+#include "arena.h"
 #include "checks.h"
 #include "civil_disorder_distances.h"
+#include "convoy_paths.h"
 #include "game_state.h"
 #include "loc.h"
+#include "perf_stats.h"
 #include "power.h"
 #include "util.h"
+#include "zobrist.h"
 
 using namespace std;
 using nlohmann::json;
 
 namespace dipcc {
 
+namespace {
+
+// Possible orders are loaded holding the mutex picked by the state's address,
+// so that threads sharing a state load it once
+std::mutex &possible_orders_mutex(const GameState *state) {
+  static std::array<std::mutex, 64> mutexes;
+  return mutexes[(reinterpret_cast<uintptr_t>(state) >> 6) % mutexes.size()];
+}
+
+} // namespace
+
 OwnedUnit GameState::get_unit_rooted(Loc root) const {
   OwnedUnit unit;
   for (Loc loc : expand_coasts(root)) {
@@ -37,33 +56,71 @@ OwnedUnit GameState::get_unit_rooted(Loc root) const {
 
 void GameState::remove_unit_rooted(Loc root) {
   for (Loc loc : expand_coasts(root)) {
-    units_.erase(loc);
+    remove_unit(loc);
   }
 }
 
+size_t GameState::remove_unit(Loc loc) {
+  auto it = units_.find(loc);
+  if (it == units_.end()) {
+    return 0;
+  }
+  board_hash_ ^= zobrist::unit(it->second);
+  return units_.erase(loc);
+}
+
 void GameState::set_unit(Power power, UnitType type, Loc loc) {
+  remove_unit(loc);
   units_[loc] = {power, type, loc};
+  board_hash_ ^= zobrist::unit(units_[loc]);
+}
+
+void GameState::set_units(const LocMap<OwnedUnit> &units) {
+  for (auto &it : units_) {
+    board_hash_ ^= zobrist::unit(it.second);
+  }
+  units_ = units;
+  for (auto &it : units_) {
+    board_hash_ ^= zobrist::unit(it.second);
+  }
 }
 
 void GameState::add_dislodged_unit(OwnedUnit unit, Loc dislodged_by) {
   JCHECK(unit.type != UnitType::NONE, "add_dislodged_unit NONE unit");
-  dislodged_units_[unit] = dislodged_by;
+  auto it = dislodged_units_.find(unit.loc);
+  if (it != dislodged_units_.end()) {
+    retreat_hash_ ^=
+        zobrist::dislodged(it->second.unit, it->second.dislodged_by);
+  }
+  dislodged_units_[unit.loc] = {unit, dislodged_by};
+  retreat_hash_ ^= zobrist::dislodged(unit, dislodged_by);
 }
 
 void GameState::remove_dislodged_unit(OwnedUnit unit) {
-  dislodged_units_.erase(unit);
+  auto it = dislodged_units_.find(unit.loc);
+  if (it != dislodged_units_.end() && it->second.unit == unit) {
+    retreat_hash_ ^= zobrist::dislodged(unit, it->second.dislodged_by);
+    dislodged_units_.erase(unit.loc);
+  }
 }
 
 vector<OwnedUnit> GameState::get_dislodged_units() const {
   vector<OwnedUnit> r;
   r.reserve(dislodged_units_.size());
   for (auto &it : dislodged_units_) {
-    r.push_back(it.first);
+    r.push_back(it.second.unit);
   }
+  // keep (power, type, loc) order
+  std::sort(r.begin(), r.end());
   return r;
 }
 
-void GameState::add_contested_loc(Loc loc) { contested_locs_.insert(loc); }
+void GameState::add_contested_loc(Loc loc) {
+  if (!contested_locs_.contains(loc)) {
+    contested_locs_.insert(loc);
+    retreat_hash_ ^= zobrist::contested(loc);
+  }
+}
 
 OwnedUnit GameState::get_unit(Loc loc) const {
   auto x = units_.find(loc);
@@ -76,14 +133,33 @@ OwnedUnit GameState::get_unit(Loc loc) const {
 
 void GameState::set_center(Loc loc, Power power) {
   JCHECK(is_center(loc), "set_center " + loc_str(loc));
+  auto it = centers_.find(loc);
+  if (it != centers_.end()) {
+    board_hash_ ^= zobrist::center(loc, it->second);
+    centers_hash_ ^= zobrist::center(loc, it->second);
+  }
   centers_[loc] = power;
+  board_hash_ ^= zobrist::center(loc, power);
+  centers_hash_ ^= zobrist::center(loc, power);
+}
+
+void GameState::set_centers(const LocMap<Power> &centers) {
+  for (auto &it : centers_) {
+    board_hash_ ^= zobrist::center(it.first, it.second);
+  }
+  centers_ = centers;
+  centers_hash_ = 0;
+  for (auto &it : centers_) {
+    centers_hash_ ^= zobrist::center(it.first, it.second);
+  }
+  board_hash_ ^= centers_hash_;
 }
 
 void GameState::recalculate_centers() {
   for (auto &p : units_) {
     Loc center = root_loc(p.first);
     if (is_center(center)) {
-      centers_[center] = p.second.power;
+      set_center(center, p.second.power);
     }
   }
 }
@@ -101,42 +177,53 @@ Power GameState::get_winner() const {
   return Power::NONE;
 }
 
-const unordered_map<Power, vector<Loc>> &GameState::get_orderable_locations() {
-  if (!orders_loaded_) {
-    this->get_all_possible_orders();
-    orders_loaded_ = true;
-  }
+const PowerMap<vector<Loc>> &GameState::get_orderable_locations() {
+  this->get_all_possible_orders();
   return orderable_locations_;
 }
 
 const unordered_map<Loc, set<Order>> &GameState::get_all_possible_orders() {
+  // Once orders_loaded_ is set, the orders are not modified until cleared
   if (!orders_loaded_) {
-    if (phase_.phase_type == 'M') {
-      load_all_possible_orders_m();
-    } else if (phase_.phase_type == 'R') {
-      load_all_possible_orders_r();
-    } else if (phase_.phase_type == 'A') {
-      load_all_possible_orders_a();
+    std::lock_guard<std::mutex> lock(possible_orders_mutex(this));
+    if (!orders_loaded_) {
+      if (phase_.phase_type == 'M') {
+        load_all_possible_orders_m();
+      } else if (phase_.phase_type == 'R') {
+        load_all_possible_orders_r();
+      } else if (phase_.phase_type == 'A') {
+        load_all_possible_orders_a();
+      }
+      orders_loaded_ = true;
     }
-    orders_loaded_ = true;
   }
 
   return all_possible_orders_;
 }
 
 void GameState::load_all_possible_orders_m() {
+  PerfTimer perf_timer(PerfCounter::LOAD_ALL_POSSIBLE_ORDERS_M);
   JCHECK(phase_.phase_type == 'M', "load_all_possible_orders_m non-m phase");
-  clear_all_possible_orders();
+  // Lazy orders are kept: other threads may hold references into them
+  all_possible_orders_.clear();
+  orderable_locations_.clear();
+  loc_orders_.clear();
+  if (LocOrdersCache::get_global().enabled()) {
+    load_cached_possible_orders_m();
+    return;
+  }
+
+  // Scratch containers are taken from the thread's arena
+  ArenaScope arena_scope;
 
-  vector<vector<Order>> move_orders_by_dest;
-  std::set<Loc> global_fleets_visited;
+  // Locs of the units that can move to each loc, via or not
+  array<LocSet, N_LOC_SLOTS> movers_by_dest;
 
   all_possible_orders_.reserve(LOCS.size() + 1);
-  move_orders_by_dest.resize(LOCS.size() + 1);
 
-  unordered_map<Power, set<Loc>> orderable_locations;
+  PowerMap<LocSet> orderable_locations;
 
-  // Determine all orders except support-moves
+  // Determine all orders except support-moves and convoys
   for (const auto &it : units_) {
     Unit unit = it.second.unowned();
     JCHECK(unit.type != UnitType::NONE, "load_all_possible_orders_m NONE unit");
@@ -151,127 +238,380 @@ void GameState::load_all_possible_orders_m() {
 
     // Non-via moves
     for (auto adj_loc : adj[static_cast<size_t>(unit.loc)]) {
-      move_orders_by_dest[static_cast<int>(adj_loc)].push_back(
-          Order(unit, OrderType::M, adj_loc));
+      unit_orders.insert(Order(unit, OrderType::M, adj_loc));
+      movers_by_dest[static_cast<int>(adj_loc)].insert(unit.loc);
     }
 
     // Support-holds
-    for (auto adj_loc : adj_coasts[static_cast<size_t>(unit.loc)]) {
-      const Unit &adj_unit = get_unit(adj_loc).unowned();
-      if (adj_unit.type != UnitType::NONE) {
-        unit_orders.insert(Order(unit, OrderType::SH, adj_unit));
-
-        // Accept e.g. "F BLA S F BUL" instead of "F BUL/SC"
-        Loc adj_root = root_loc(adj_unit.loc);
-        if (adj_root != adj_unit.loc) {
-          unit_orders.insert(
-              Order(unit, OrderType::SH, {adj_unit.type, adj_root}));
-        }
+    LocSet adj_units = adj_coasts[static_cast<size_t>(unit.loc)] & units_.keys();
+    for (auto adj_loc : adj_units) {
+      const Unit &adj_unit = units_.at(adj_loc).unowned();
+      unit_orders.insert(Order(unit, OrderType::SH, adj_unit));
+
+      // Accept e.g. "F BLA S F BUL" instead of "F BUL/SC"
+      Loc adj_root = root_loc(adj_unit.loc);
+      if (adj_root != adj_unit.loc) {
+        unit_orders.insert(
+            Order(unit, OrderType::SH, {adj_unit.type, adj_root}));
       }
     }
+  }
 
-    // Convoys + moves via
-    if (unit.type == UnitType::FLEET && is_water(unit.loc)) {
-      std::set<Unit> adj_armies;
-      std::set<Unit> adj_fleets_todo{unit};
-      std::set<Unit> local_fleets_visited;
-      std::set<Loc> adj_coast_locs;
-      while (adj_fleets_todo.size() > 0) {
-
-        // Pop fleet to consider
-        auto fleet_it = adj_fleets_todo.begin();
-        Unit fleet = *fleet_it;
-        adj_fleets_todo.erase(fleet_it);
-        local_fleets_visited.insert(fleet);
-        global_fleets_visited.insert(fleet.loc);
+  // Convoys + moves via
+  pmr::vector<Order> convoy_orders(thread_arena());
+  load_convoy_orders_m(convoy_orders);
+  for (const Order &order : convoy_orders) {
+    all_possible_orders_[order.get_unit().loc].insert(order);
+    if (order.get_type() == OrderType::M) {
+      movers_by_dest[static_cast<int>(order.get_dest())].insert(
+          order.get_unit().loc);
+    }
+  }
 
-        for (Loc adj_loc : ADJ_F_ALL_COASTS[static_cast<size_t>(fleet.loc)]) {
+  // Determine support moves. A unit's support moves are generated into a
+  // vector, then inserted in order with hints, which is amortized O(1) per
+  // order instead of a search of the unit's set per order.
+  pmr::vector<Order> support_moves(thread_arena());
+  for (const auto &it : units_) {
+    Unit unit = it.second.unowned();
+    auto &adj_coasts =
+        unit.type == UnitType::ARMY ? ADJ_A_ALL_COASTS : ADJ_F_ALL_COASTS;
 
-          if (!is_water(adj_loc)) {
-            // Possible destination loc
-            adj_coast_locs.insert(root_loc(adj_loc));
-          }
+    support_moves.clear();
+    for (Loc dest : adj_coasts[static_cast<size_t>(unit.loc)]) {
+      if (dest == unit.loc) {
+        continue; // can't support self-dislodge
+      }
+      LocSet movers = movers_by_dest[static_cast<int>(dest)];
+      movers.erase(unit.loc); // can't support own move
+      Loc dest_root = root_loc(dest);
+      for (Loc mover_loc : movers) {
+        Unit mover = units_.at(mover_loc).unowned();
+        support_moves.push_back(Order(unit, OrderType::SM, mover, dest));
 
-          Unit adj_unit = this->get_unit(adj_loc).unowned();
-          if (adj_unit.type == UnitType::FLEET && is_water(adj_loc) &&
-              global_fleets_visited.find(adj_loc) ==
-                  global_fleets_visited.end()) {
-            // Adjacent fleet that can chain convoy
-            adj_fleets_todo.insert(adj_unit);
-          } else if (adj_unit.type == UnitType::ARMY) {
-            // Possible source army to convoy
-            adj_armies.insert(adj_unit);
-          }
+        // Accept e.g. "F BLA S F CON - BUL" instead of "BUL/SC"
+        if (dest_root != dest) {
+          support_moves.push_back(
+              Order(unit, OrderType::SM, mover, dest_root));
         }
       }
+    }
+    if (support_moves.empty()) {
+      continue;
+    }
 
-      // Each adj_army can be convoyed to each adj_coast_loc via each
-      // local_fleets_visited
-      for (const Unit &army : adj_armies) {
-        for (Loc dest : adj_coast_locs) {
-          if (dest == army.loc) {
-            continue;
-          }
-          move_orders_by_dest[static_cast<int>(dest)].push_back(
-              Order(army, OrderType::M, dest, true));
-          for (const Unit &convoy_fleet : local_fleets_visited) {
-            all_possible_orders_[convoy_fleet.loc].insert(
-                Order(convoy_fleet, OrderType::C, army, dest));
-          }
+    sort(support_moves.begin(), support_moves.end());
+    set<Order> &unit_orders = all_possible_orders_[unit.loc];
+    auto hint = unit_orders.lower_bound(support_moves[0]);
+    for (const Order &order : support_moves) {
+      hint = next(unit_orders.insert(hint, order));
+    }
+  }
+
+  copy_sorted_root_locs(orderable_locations, orderable_locations_);
+}
+
+// Fill convoy_orders with all via moves and convoy orders of the M-phase
+void GameState::load_convoy_orders_m(
+    pmr::vector<Order> &convoy_orders) const {
+  LocSet water_fleets;
+  LocSet armies;
+  for (const auto &it : units_) {
+    if (it.second.type == UnitType::ARMY) {
+      armies.insert(it.first);
+    } else if (is_water(it.first)) {
+      water_fleets.insert(it.first);
+    }
+  }
+
+  // Each army adjacent to a chain of fleets can be convoyed to each other
+  // coast adjacent to the chain, via each fleet in the chain
+  for (const ConvoyComponent &chain : get_convoy_components(water_fleets)) {
+    for (Loc army_loc : chain.coasts & armies) {
+      Unit army = units_.at(army_loc).unowned();
+      for (Loc dest : chain.coasts) {
+        if (dest == army.loc || root_loc(dest) != dest) {
+          continue;
+        }
+        convoy_orders.push_back(Order(army, OrderType::M, dest, true));
+        for (Loc fleet_loc : chain.fleets) {
+          convoy_orders.push_back(Order({UnitType::FLEET, fleet_loc},
+                                        OrderType::C, army, dest));
         }
       }
     }
   }
+}
 
-  // Move move_orders to all_possible_orders_
-  for (const auto &move_orders : move_orders_by_dest) {
-    for (const Order &order : move_orders) {
-      all_possible_orders_[order.get_unit().loc].insert(order);
+// Add the possible orders of one unit to unit_orders. This is the same as
+// the unit's entry in load_all_possible_orders_m, without generating orders
+// for every other unit.
+void GameState::load_possible_orders_m(const OwnedUnit &owned_unit,
+                                       const pmr::vector<Order> &convoy_orders,
+                                       set<Order> &unit_orders) const {
+  Unit unit = owned_unit.unowned();
+  auto &adj = unit.type == UnitType::ARMY ? ADJ_A : ADJ_F;
+  auto &adj_coasts =
+      unit.type == UnitType::ARMY ? ADJ_A_ALL_COASTS : ADJ_F_ALL_COASTS;
+
+  // Hold
+  unit_orders.insert(Order(unit, OrderType::H));
+
+  // Non-via moves
+  for (auto adj_loc : adj[static_cast<size_t>(unit.loc)]) {
+    unit_orders.insert(Order(unit, OrderType::M, adj_loc));
+  }
+
+  // Support-holds
+  LocSet adj_units = adj_coasts[static_cast<size_t>(unit.loc)] & units_.keys();
+  for (auto adj_loc : adj_units) {
+    const Unit &adj_unit = units_.at(adj_loc).unowned();
+    unit_orders.insert(Order(unit, OrderType::SH, adj_unit));
+    Loc adj_root = root_loc(adj_unit.loc);
+    if (adj_root != adj_unit.loc) {
+      unit_orders.insert(Order(unit, OrderType::SH, {adj_unit.type, adj_root}));
     }
   }
 
-  // Determine support moves
-  for (const auto &it : units_) {
-    auto &unit = it.second;
-    auto &adj_coasts =
-        unit.type == UnitType::ARMY ? ADJ_A_ALL_COASTS : ADJ_F_ALL_COASTS;
-    set<Order> &unit_orders = all_possible_orders_[unit.loc];
+  // Convoys + moves via by this unit
+  for (const Order &order : convoy_orders) {
+    if (order.get_unit().loc == unit.loc) {
+      unit_orders.insert(order);
+    }
+  }
 
-    for (Loc dest : adj_coasts[static_cast<size_t>(unit.loc)]) {
-      if (dest == unit.loc) {
-        continue; // can't support self-dislodge
+  // Support moves: any other unit's move (via or not) to a loc adjacent to
+  // this one
+  for (Loc dest : adj_coasts[static_cast<size_t>(unit.loc)]) {
+    if (dest == unit.loc) {
+      continue; // can't support self-dislodge
+    }
+    Loc dest_root = root_loc(dest);
+    auto add_support_move = [&](const Unit &mover) {
+      unit_orders.insert(Order(unit, OrderType::SM, mover, dest));
+      if (dest_root != dest) {
+        unit_orders.insert(Order(unit, OrderType::SM, mover, dest_root));
       }
-      for (const Order &move_order :
-           move_orders_by_dest[static_cast<int>(dest)]) {
-        if (move_order.get_unit().loc == unit.loc) {
-          continue; // can't support own move
-        }
+    };
+    for (const auto &it : units_) {
+      const OwnedUnit &mover = it.second;
+      if (mover.loc == unit.loc) {
+        continue; // can't support own move
+      }
+      auto &mover_adj = mover.type == UnitType::ARMY ? ADJ_A : ADJ_F;
+      if (mover_adj[static_cast<size_t>(mover.loc)].contains(dest)) {
+        add_support_move(mover.unowned());
+      }
+    }
+    for (const Order &order : convoy_orders) {
+      if (order.get_type() == OrderType::M && order.get_dest() == dest &&
+          order.get_unit().loc != unit.loc) {
+        add_support_move(order.get_unit());
+      }
+    }
+  }
+}
 
-        unit_orders.insert(
-            Order(unit, OrderType::SM, move_order.get_unit(), dest));
+namespace {
 
-        // Accept e.g. "F BLA S F CON - BUL" instead of "BUL/SC"
-        Loc dest_root = root_loc(dest);
-        if (dest_root != dest) {
-          unit_orders.insert(
-              Order(unit, OrderType::SM, move_order.get_unit(), dest_root));
+// NEIGHBOURHOODS[x] is every loc (with all coasts) whose unit can affect the
+// possible orders of a unit at x: units it could support-hold, and units that
+// could move to a loc it could support into.
+const vector<vector<Loc>> &get_neighbourhoods() {
+  static const vector<vector<Loc>> neighbourhoods = [] {
+    // roots adjacent to a loc, by any unit type
+    vector<set<Loc>> adj_roots(LOCS.size() + 1);
+    for (Loc loc : LOCS) {
+      auto &r = adj_roots[static_cast<size_t>(loc)];
+      for (auto *adj : {&ADJ_A, &ADJ_F, &ADJ_A_ALL_COASTS, &ADJ_F_ALL_COASTS}) {
+        for (Loc x : (*adj)[static_cast<size_t>(loc)]) {
+          r.insert(root_loc(x));
+        }
+      }
+    }
+
+    vector<vector<Loc>> r(LOCS.size() + 1);
+    for (Loc loc : LOCS) {
+      set<Loc> near{root_loc(loc)};
+      for (Loc c : expand_coasts(root_loc(loc))) {
+        for (Loc x : adj_roots[static_cast<size_t>(c)]) {
+          near.insert(x);
+        }
+      }
+      set<Loc> roots(near);
+      for (Loc other : LOCS) {
+        for (Loc x : adj_roots[static_cast<size_t>(other)]) {
+          if (set_contains(near, x)) {
+            roots.insert(root_loc(other));
+            break;
+          }
+        }
+      }
+      for (Loc root : roots) {
+        for (Loc c : expand_coasts(root)) {
+          r[static_cast<size_t>(loc)].push_back(c);
         }
       }
     }
+    return r;
+  }();
+  return neighbourhoods;
+}
+
+} // namespace
+
+bool GameState::copy_parent_possible_orders(
+    Loc loc, const pmr::vector<Order> &convoy_orders,
+    set<Order> &unit_orders) const {
+  if (parent_lazy_orders_ == nullptr) {
+    return false;
+  }
+  const LazyPossibleOrders &parent = *parent_lazy_orders_;
+  std::lock_guard<std::mutex> lock(parent.mutex);
+  auto parent_orders = parent.orders.find(loc);
+  if (!parent.convoy_orders_loaded || parent.convoy_orders != convoy_orders ||
+      parent_orders == parent.orders.end()) {
+    return false;
+  }
+  for (Loc x : get_neighbourhoods()[static_cast<size_t>(loc)]) {
+    auto it = units_.find(x);
+    auto parent_it = parent.units.find(x);
+    if ((it == units_.end()) != (parent_it == parent.units.end()) ||
+        (it != units_.end() && it->second != parent_it->second)) {
+      return false;
+    }
+  }
+  unit_orders = parent_orders->second;
+  return true;
+}
+
+// The key of a unit's possible orders in the LocOrdersCache: the unit, the
+// units of its neighbourhood, and the via moves and convoys that
+// load_possible_orders_m uses, i.e. the unit's own and those it could support
+void GameState::get_loc_orders_key(const OwnedUnit &unit,
+                                   const pmr::vector<Order> &convoy_orders,
+                                   LocOrdersCache::Key &key) const {
+  key.clear();
+  key.push_back(static_cast<char>(unit.loc));
+  key.push_back(static_cast<char>(unit.type));
+  for (Loc x : get_neighbourhoods()[static_cast<size_t>(unit.loc)]) {
+    auto it = units_.find(x);
+    key.push_back(static_cast<char>(it == units_.end() ? UnitType::NONE
+                                                       : it->second.type));
+  }
+
+  // In a canonical order: convoy_orders is ordered by convoy chain
+  auto &adj_coasts =
+      unit.type == UnitType::ARMY ? ADJ_A_ALL_COASTS : ADJ_F_ALL_COASTS;
+  pmr::vector<OrderId> ids(thread_arena());
+  for (const Order &order : convoy_orders) {
+    if (order.get_unit().loc == unit.loc ||
+        (order.get_type() == OrderType::M &&
+         adj_coasts[static_cast<size_t>(unit.loc)].contains(
+             order.get_dest()))) {
+      ids.push_back(order.get_id());
+    }
+  }
+  sort(ids.begin(), ids.end());
+  key.append(reinterpret_cast<const char *>(ids.data()),
+             ids.size() * sizeof(OrderId));
+}
+
+void GameState::load_cached_possible_orders_m() {
+  ArenaScope arena_scope;
+  pmr::vector<Order> convoy_orders(thread_arena());
+  load_convoy_orders_m(convoy_orders);
+
+  LocOrdersCache &cache = LocOrdersCache::get_global();
+  all_possible_orders_.reserve(units_.size());
+  loc_orders_.reserve(units_.size());
+  PowerMap<LocSet> orderable_locations;
+  LocOrdersCache::Key key;
+  for (const auto &it : units_) {
+    const OwnedUnit &unit = it.second;
+    orderable_locations[unit.power].insert(unit.loc);
+    get_loc_orders_key(unit, convoy_orders, key);
+    auto entry = cache.get(key);
+    if (entry == nullptr) {
+      auto loaded = std::make_shared<LocOrders>();
+      load_possible_orders_m(unit, convoy_orders, loaded->orders);
+      entry = cache.put(key, std::move(loaded));
+    }
+    all_possible_orders_[unit.loc] = entry->orders;
+    loc_orders_[unit.loc] = std::move(entry);
   }
 
   copy_sorted_root_locs(orderable_locations, orderable_locations_);
 }
 
+const LocOrders *GameState::get_loc_orders(Loc loc) {
+  get_all_possible_orders();
+  auto it = loc_orders_.find(loc);
+  return it == loc_orders_.end() ? nullptr : it->second.get();
+}
+
+const set<Order> &GameState::get_possible_orders(Loc loc) {
+  static const set<Order> EMPTY;
+
+  if (!orders_loaded_ && phase_.phase_type == 'M') {
+    std::lock_guard<std::mutex> lock(possible_orders_mutex(this));
+    if (!orders_loaded_) {
+      return get_lazy_possible_orders(loc);
+    }
+  }
+
+  const auto &all_possible_orders = get_all_possible_orders();
+  auto it = all_possible_orders.find(loc);
+  return it == all_possible_orders.end() ? EMPTY : it->second;
+}
+
+// Called holding possible_orders_mutex(this), so this thread is the only
+// one adding to lazy_orders_; others only read it
+const set<Order> &GameState::get_lazy_possible_orders(Loc loc) {
+  static const set<Order> EMPTY;
+
+  if (lazy_orders_ == nullptr) {
+    auto lazy_orders = std::make_shared<LazyPossibleOrders>();
+    lazy_orders->units = units_;
+    std::atomic_store(&lazy_orders_, std::move(lazy_orders));
+  }
+  LazyPossibleOrders &lazy_orders = *lazy_orders_;
+  {
+    std::lock_guard<std::mutex> lock(lazy_orders.mutex);
+    auto it = lazy_orders.orders.find(loc);
+    if (it != lazy_orders.orders.end()) {
+      return it->second;
+    }
+  }
+
+  OwnedUnit unit = get_unit(loc);
+  if (unit.type == UnitType::NONE) {
+    return EMPTY;
+  }
+  if (!lazy_orders.convoy_orders_loaded) {
+    std::lock_guard<std::mutex> lock(lazy_orders.mutex);
+    load_convoy_orders_m(lazy_orders.convoy_orders);
+    lazy_orders.convoy_orders_loaded = true;
+  }
+
+  set<Order> unit_orders;
+  if (!copy_parent_possible_orders(loc, lazy_orders.convoy_orders,
+                                   unit_orders)) {
+    load_possible_orders_m(unit, lazy_orders.convoy_orders, unit_orders);
+  }
+  std::lock_guard<std::mutex> lock(lazy_orders.mutex);
+  return lazy_orders.orders.emplace(loc, std::move(unit_orders)).first->second;
+}
+
 void GameState::load_all_possible_orders_r() {
+  PerfTimer perf_timer(PerfCounter::LOAD_ALL_POSSIBLE_ORDERS_R);
   JCHECK(this->phase_.phase_type == 'R', "load_all_possible_orders_r non-r");
   clear_all_possible_orders();
 
-  unordered_map<Power, set<Loc>> orderable_locations;
+  PowerMap<LocSet> orderable_locations;
 
   for (auto &p : dislodged_units_) {
-    OwnedUnit unit = p.first;
-    Loc dislodger_root = root_loc(p.second);
+    OwnedUnit unit = p.second.unit;
     set<Order> &retreats = all_possible_orders_[unit.loc];
     const auto &adj_locs =
         (unit.type == UnitType::ARMY ? ADJ_A
@@ -279,16 +619,7 @@ void GameState::load_all_possible_orders_r() {
     bool pushed = false;
 
     for (Loc adj : adj_locs) {
-      if (root_loc(adj) == dislodger_root) {
-        // can't retreat to dislodger src
-        continue;
-      }
-      if (set_contains(contested_locs_, root_loc(adj))) {
-        // can't retreat to bounced loc
-        continue;
-      }
-      if (this->get_unit_rooted(adj).type != UnitType::NONE) {
-        // can't retreat to occupied loc
+      if (!can_retreat_to(p.second, adj)) {
         continue;
       }
 
@@ -305,30 +636,18 @@ void GameState::load_all_possible_orders_r() {
 }
 
 void GameState::load_all_possible_orders_a() {
+  PerfTimer perf_timer(PerfCounter::LOAD_ALL_POSSIBLE_ORDERS_A);
   clear_all_possible_orders();
-  unordered_map<Power, set<Loc>> orderable_locations;
+  PowerMap<LocSet> orderable_locations;
 
-  vector<int> n_units(7, 0);
-  vector<int> n_centers(7, 0);
   vector<bool> can_disband(7, false);
-  n_builds_.resize(7);
-
-  // Count units
-  for (auto &p : units_) {
-    n_units[static_cast<int>(p.second.power) - 1] += 1;
-  }
-
-  // Count centers
-  for (auto &p : centers_) {
-    n_centers[static_cast<int>(p.second) - 1] += 1;
-  }
+  n_builds_ = compute_n_builds();
 
   // Determine who builds and who disbands
   for (int p = 0; p < 7; ++p) {
     Power power = POWERS[p];
-    n_builds_[p] = n_centers[p] - n_units[p];
     DLOG(INFO) << "load_all_possible_orders_a " << power_str(power)
-               << " centers=" << n_centers[p] << " units=" << n_units[p];
+               << " n_builds=" << n_builds_[p];
 
     if (n_builds_[p] > 0) {
       // add army builds
@@ -372,19 +691,290 @@ void GameState::load_all_possible_orders_a() {
   copy_sorted_root_locs(orderable_locations, orderable_locations_);
 }
 
+array<int, 7> GameState::compute_n_builds() const {
+  array<int, 7> n_builds{};
+  for (auto &p : centers_) {
+    n_builds[static_cast<int>(p.second) - 1] += 1;
+  }
+  for (auto &p : units_) {
+    n_builds[static_cast<int>(p.second.power) - 1] -= 1;
+  }
+  return n_builds;
+}
+
+bool GameState::has_buildable_home(Power power) const {
+  for (Loc center : home_centers(power)) {
+    auto it = centers_.find(center);
+    if (it != centers_.end() && it->second == power &&
+        get_unit_rooted(center).type == UnitType::NONE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GameState::has_any_adjustment() const {
+  array<int, 7> n_builds = compute_n_builds();
+  for (int p = 0; p < 7; ++p) {
+    if (n_builds[p] < 0 ||
+        (n_builds[p] > 0 && has_buildable_home(POWERS[p]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GameState::is_forced_phase() const {
+  if (phase_.phase_type != 'A') {
+    return false;
+  }
+  array<int, 7> n_builds = compute_n_builds();
+  array<bool, 7> has_center{};
+  for (auto &p : centers_) {
+    has_center[static_cast<int>(p.second) - 1] = true;
+  }
+  for (int p = 0; p < 7; ++p) {
+    if (n_builds[p] > 0 && has_buildable_home(POWERS[p])) {
+      // choice of builds
+      return false;
+    }
+    if (n_builds[p] < 0 && has_center[p]) {
+      // choice of disbands: only powers with no centers disband all units
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GameState::is_valid_adjustment(Power power, const Order &order) const {
+  Unit unit = order.get_unit();
+  if (order.get_type() == OrderType::B) {
+    const auto &centers = unit.type == UnitType::ARMY
+                              ? home_centers_army(power)
+                              : home_centers_fleet(power);
+    if (find(centers.begin(), centers.end(), unit.loc) == centers.end()) {
+      return false;
+    }
+    auto it = centers_.find(root_loc(unit.loc));
+    return it != centers_.end() && it->second == power &&
+           get_unit_rooted(unit.loc).type == UnitType::NONE &&
+           order == Order(unit, OrderType::B);
+  }
+  if (order.get_type() == OrderType::D) {
+    // Any power's disband is valid here, as in all_possible_orders_;
+    // process_a ignores disbands of other powers' units
+    OwnedUnit owned = get_unit(unit.loc);
+    return owned.type == unit.type && order == Order(unit, OrderType::D);
+  }
+  return false;
+}
+
+bool GameState::can_retreat_to(const DislodgedUnit &dislodged,
+                               Loc dest) const {
+  if (root_loc(dest) == root_loc(dislodged.dislodged_by)) {
+    // can't retreat to dislodger src
+    return false;
+  }
+  if (contested_locs_.contains(root_loc(dest))) {
+    // can't retreat to bounced loc
+    return false;
+  }
+  // can't retreat to occupied loc
+  return get_unit_rooted(dest).type == UnitType::NONE;
+}
+
+bool GameState::has_any_retreat(const DislodgedUnit &dislodged) const {
+  const OwnedUnit &unit = dislodged.unit;
+  for (Loc adj : (unit.type == UnitType::ARMY
+                      ? ADJ_A
+                      : ADJ_F)[static_cast<int>(unit.loc)]) {
+    if (can_retreat_to(dislodged, adj)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GameState::is_valid_retreat(const DislodgedUnit &dislodged,
+                                 const Order &order) const {
+  Unit unit = dislodged.unit.unowned();
+  if (order.get_type() == OrderType::D) {
+    return order == Order(unit, OrderType::D) && has_any_retreat(dislodged);
+  }
+  if (order.get_type() != OrderType::R) {
+    return false;
+  }
+  Loc dest = order.get_dest();
+  return (unit.type == UnitType::ARMY ? ADJ_A : ADJ_F)[static_cast<int>(
+             unit.loc)]
+             .contains(dest) &&
+         can_retreat_to(dislodged, dest) &&
+         order == Order(unit, OrderType::R, dest);
+}
+
+LocSet GameState::get_water_fleets() const {
+  LocSet water_fleets;
+  for (const auto &it : units_) {
+    if (it.second.type == UnitType::FLEET && is_water(it.first)) {
+      water_fleets.insert(it.first);
+    }
+  }
+  return water_fleets;
+}
+
+bool GameState::can_move_to(const Unit &mover, Loc dest) const {
+  auto &adj = mover.type == UnitType::ARMY ? ADJ_A : ADJ_F;
+  if (adj[static_cast<size_t>(mover.loc)].contains(dest)) {
+    return true;
+  }
+  // Via moves, see load_convoy_orders_m
+  return mover.type == UnitType::ARMY && root_loc(dest) == dest &&
+         dest != mover.loc && can_convoy(get_water_fleets(), mover.loc, dest);
+}
+
+bool GameState::is_implicit_via(const Order &order) const {
+  return order.get_type() == OrderType::M && !order.get_via() &&
+         !is_valid_movement(order) && is_valid_movement(order.with_via(true));
+}
+
+bool GameState::is_valid_movement(const Order &order) const {
+  Unit unit = order.get_unit();
+  auto it = units_.find(unit.loc);
+  if (it == units_.end() || it->second.type != unit.type) {
+    return false;
+  }
+  auto &adj_coasts =
+      (unit.type == UnitType::ARMY ? ADJ_A_ALL_COASTS
+                                   : ADJ_F_ALL_COASTS)[static_cast<size_t>(
+          unit.loc)];
+  Unit target = order.get_target();
+  Loc dest = order.get_dest();
+
+  switch (order.get_type()) {
+  case OrderType::H:
+    return order == Order(unit, OrderType::H);
+
+  case OrderType::M:
+    if (!order.get_via()) {
+      return (unit.type == UnitType::ARMY ? ADJ_A : ADJ_F)[static_cast<size_t>(
+                 unit.loc)]
+                 .contains(dest) &&
+             order == Order(unit, OrderType::M, dest);
+    }
+    return unit.type == UnitType::ARMY && root_loc(dest) == dest &&
+           dest != unit.loc &&
+           can_convoy(get_water_fleets(), unit.loc, dest) &&
+           order == Order(unit, OrderType::M, dest, true);
+
+  case OrderType::SH: {
+    if (!(order == Order(unit, OrderType::SH, target))) {
+      return false;
+    }
+    // The unit itself, or a unit on a coast of a root target
+    auto target_it = units_.find(target.loc);
+    if (target_it != units_.end() && target_it->second.type == target.type &&
+        adj_coasts.contains(target.loc)) {
+      return true;
+    }
+    if (root_loc(target.loc) != target.loc) {
+      return false;
+    }
+    for (Loc c : WITH_COASTS_MASK[static_cast<size_t>(target.loc)] &
+                     adj_coasts & units_.keys()) {
+      if (c != target.loc && units_.at(c).type == target.type) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  case OrderType::SM: {
+    auto target_it = units_.find(target.loc);
+    if (target.loc == unit.loc || target_it == units_.end() ||
+        target_it->second.type != target.type ||
+        !(order == Order(unit, OrderType::SM, target, dest))) {
+      return false;
+    }
+    // Support into dest, or into a coast of a root dest
+    LocSet supported = adj_coasts;
+    supported.erase(unit.loc);
+    if (supported.contains(dest) && can_move_to(target, dest)) {
+      return true;
+    }
+    if (root_loc(dest) != dest) {
+      return false;
+    }
+    for (Loc c : WITH_COASTS_MASK[static_cast<size_t>(dest)] & supported) {
+      if (c != dest && can_move_to(target, c)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  case OrderType::C: {
+    auto target_it = units_.find(target.loc);
+    if (unit.type != UnitType::FLEET || !is_water(unit.loc) ||
+        target.type != UnitType::ARMY || target_it == units_.end() ||
+        target_it->second.type != UnitType::ARMY || root_loc(dest) != dest ||
+        dest == target.loc ||
+        !(order == Order(unit, OrderType::C, target, dest))) {
+      return false;
+    }
+    for (const ConvoyComponent &chain :
+         get_convoy_components(get_water_fleets())) {
+      if (chain.fleets.contains(unit.loc)) {
+        return chain.coasts.contains(target.loc) && chain.coasts.contains(dest);
+      }
+    }
+    return false;
+  }
+
+  default:
+    return false;
+  }
+}
+
+static size_t heap_bytes(const LazyPossibleOrders &x) {
+  std::lock_guard<std::mutex> lock(x.mutex);
+  return heap_bytes(x.convoy_orders) + heap_bytes(x.orders);
+}
+
+MemoryUsage GameState::memory_usage() const {
+  MemoryUsage r;
+  MemorySeen seen;
+  add_memory_usage(r, seen);
+  return r;
+}
+
+void GameState::add_memory_usage(MemoryUsage &usage, MemorySeen &seen) const {
+  if (!seen.insert(this).second) {
+    return;
+  }
+  usage["state"] += sizeof(GameState);
+  usage["possible_orders"] +=
+      heap_bytes(all_possible_orders_) + heap_bytes(orderable_locations_);
+  // Children share their parent's lazy orders, counted once
+  dipcc::add_memory_usage(usage, seen, "possible_orders", lazy_orders_.get());
+  dipcc::add_memory_usage(usage, seen, "possible_orders",
+                          parent_lazy_orders_.get());
+}
+
 void GameState::clear_all_possible_orders() {
   all_possible_orders_.clear();
+  loc_orders_.clear();
   orderable_locations_.clear();
   orders_loaded_ = false;
+  lazy_orders_.reset();
+  parent_lazy_orders_.reset();
 }
 
 // Set orderable_locations_ in LOCS order. Sort by coastal variant, although
 // orderable_locations_ contains root locs! This is to avoid downstream bugs
 // where we iterate through locs, produce an order for each, and then the
 // orders are not LOCS-ordered (since orders use coastal variants).
-void GameState::copy_sorted_root_locs(
-    const unordered_map<Power, set<Loc>> &from,
-    unordered_map<Power, vector<Loc>> &to) {
+void GameState::copy_sorted_root_locs(const PowerMap<LocSet> &from,
+                                      PowerMap<vector<Loc>> &to) {
   for (auto & [ power, locs_set ] : from) {
     auto &output = to[power];
     output.reserve(locs_set.size());
@@ -396,8 +986,10 @@ void GameState::copy_sorted_root_locs(
   }
 }
 
-GameState GameState::process(const unordered_map<Power, vector<Order>> &orders,
-                             bool exception_on_convoy_paradox) {
+GameState GameState::process(const PowerMap<vector<Order>> &orders,
+                             bool exception_on_convoy_paradox,
+                             bool lazy_possible_orders, bool *convoy_paradox) {
+  PerfTimer perf_timer(PerfCounter::PROCESS);
   DLOG(INFO) << "Processing " << this->get_phase().to_string();
   DLOG(INFO) << "Orders:";
   for (auto &it : orders) {
@@ -407,11 +999,17 @@ GameState GameState::process(const unordered_map<Power, vector<Order>> &orders,
     }
   }
 
-  if (!orders_loaded_) {
+  // Orders are validated directly, see is_valid_movement, is_valid_retreat
+  // and is_valid_adjustment. Non-lazy states still load their possible
+  // orders here, while the processing thread has them in cache.
+  if (!lazy_possible_orders && phase_.phase_type == 'M') {
     this->get_all_possible_orders();
   }
+  if (convoy_paradox != nullptr) {
+    *convoy_paradox = false;
+  }
   if (phase_.phase_type == 'M') {
-    return process_m(orders, exception_on_convoy_paradox);
+    return process_m(orders, exception_on_convoy_paradox, convoy_paradox);
   } else if (phase_.phase_type == 'R') {
     return process_r(orders);
   } else if (phase_.phase_type == 'A') {
@@ -421,38 +1019,151 @@ GameState GameState::process(const unordered_map<Power, vector<Order>> &orders,
   }
 }
 
-GameState
-GameState::process_r(const unordered_map<Power, vector<Order>> &orders) {
+vector<GameState> GameState::process_many(
+    const vector<PowerMap<vector<Order>>> &orders_list,
+    bool exception_on_convoy_paradox) {
+  this->get_all_possible_orders();
+
+  vector<GameState> r;
+  r.reserve(orders_list.size());
+  for (const auto &orders : orders_list) {
+    r.push_back(process(orders, exception_on_convoy_paradox));
+  }
+  return r;
+}
+
+namespace {
+
+// Update the entries of to that differ in from, recording their prior values
+// in delta
+template <typename V>
+void apply_loc_map(LocMap<V> &to, const LocMap<V> &from,
+                   vector<pair<Loc, optional<V>>> &delta) {
+  delta.clear();
+  for (Loc loc : to.keys() | from.keys()) {
+    auto to_it = to.find(loc);
+    auto from_it = from.find(loc);
+    if (from_it == from.end()) {
+      delta.push_back({loc, to_it->second});
+      to.erase(loc);
+    } else if (to_it == to.end()) {
+      delta.push_back({loc, nullopt});
+      to[loc] = from_it->second;
+    } else if (!(to_it->second == from_it->second)) {
+      delta.push_back({loc, to_it->second});
+      to_it->second = from_it->second;
+    }
+  }
+}
+
+template <typename V>
+void undo_loc_map(LocMap<V> &m, const vector<pair<Loc, optional<V>>> &delta) {
+  for (auto &[loc, prior] : delta) {
+    if (prior) {
+      m[loc] = *prior;
+    } else {
+      m.erase(loc);
+    }
+  }
+}
+
+} // namespace
+
+bool GameState::same_process_inputs(const GameState &other) const {
+  return phase_ == other.phase_ && board_hash_ == other.board_hash_ &&
+         retreat_hash_ == other.retreat_hash_ && units_ == other.units_ &&
+         centers_ == other.centers_ &&
+         dislodged_units_ == other.dislodged_units_ &&
+         contested_locs_ == other.contested_locs_ &&
+         n_builds_ == other.n_builds_;
+}
+
+void GameState::apply(const PowerMap<vector<Order>> &orders, UndoRecord &undo,
+                      bool exception_on_convoy_paradox) {
+  // Lazy: orders are validated directly, so don't load possible orders only
+  // to move them to undo
+  GameState next = process(orders, exception_on_convoy_paradox, true);
+
+  undo.phase = phase_;
+  apply_loc_map(units_, next.units_, undo.units);
+  apply_loc_map(centers_, next.centers_, undo.centers);
+  apply_loc_map(dislodged_units_, next.dislodged_units_,
+                undo.dislodged_units);
+  undo.contested_locs = contested_locs_;
+  undo.n_builds = n_builds_;
+  undo.board_hash = board_hash_;
+  undo.centers_hash = centers_hash_;
+  undo.retreat_hash = retreat_hash_;
+  undo.all_possible_orders = std::move(all_possible_orders_);
+  undo.loc_orders = std::move(loc_orders_);
+  undo.orderable_locations = std::move(orderable_locations_);
+  undo.orders_loaded = orders_loaded_;
+  undo.lazy_orders = std::move(lazy_orders_);
+  undo.parent_lazy_orders = std::move(parent_lazy_orders_);
+
+  phase_ = next.phase_;
+  contested_locs_ = next.contested_locs_;
+  n_builds_ = next.n_builds_;
+  board_hash_ = next.board_hash_;
+  centers_hash_ = next.centers_hash_;
+  retreat_hash_ = next.retreat_hash_;
+  all_possible_orders_ = std::move(next.all_possible_orders_);
+  loc_orders_ = std::move(next.loc_orders_);
+  orderable_locations_ = std::move(next.orderable_locations_);
+  orders_loaded_ = next.orders_loaded_;
+  lazy_orders_ = std::move(next.lazy_orders_);
+  parent_lazy_orders_ = std::move(next.parent_lazy_orders_);
+}
+
+void GameState::undo(UndoRecord &undo) {
+  phase_ = undo.phase;
+  undo_loc_map(units_, undo.units);
+  undo_loc_map(centers_, undo.centers);
+  undo_loc_map(dislodged_units_, undo.dislodged_units);
+  contested_locs_ = undo.contested_locs;
+  n_builds_ = undo.n_builds;
+  board_hash_ = undo.board_hash;
+  centers_hash_ = undo.centers_hash;
+  retreat_hash_ = undo.retreat_hash;
+  all_possible_orders_ = std::move(undo.all_possible_orders);
+  loc_orders_ = std::move(undo.loc_orders);
+  orderable_locations_ = std::move(undo.orderable_locations);
+  orders_loaded_ = undo.orders_loaded;
+  lazy_orders_ = std::move(undo.lazy_orders);
+  parent_lazy_orders_ = std::move(undo.parent_lazy_orders);
+}
+
+GameState GameState::process_r(const PowerMap<vector<Order>> &orders) {
   GameState next_state;
   next_state.set_phase(this->get_phase().next(false));
   next_state.set_units(this->get_units());
   next_state.set_centers(this->get_centers());
 
-  map<OwnedUnit, Loc> dislodged_units(this->dislodged_units_);
-  const auto &all_possible_orders(this->get_all_possible_orders());
-  set<Loc> multiple_retreater_locs;
+  LocMap<DislodgedUnit> dislodged_units(this->dislodged_units_);
+  LocSet multiple_retreater_locs;
 
   for (const auto &p : orders) {
     Power power = p.first;
     for (const Order &order : p.second) {
       OwnedUnit unit = order.get_unit().owned_by(power);
-      auto dislodged_it = dislodged_units.find(unit);
-      if (dislodged_it == dislodged_units.end()) {
+      auto dislodged_it = dislodged_units.find(unit.loc);
+      if (dislodged_it == dislodged_units.end() ||
+          dislodged_it->second.unit != unit) {
         LOG(WARNING) << "Unit not dislodged [" << power_str(power)
                      << "]: " << order.to_string();
         continue;
       }
-      if (!safe_contains(all_possible_orders, order.get_unit().loc, order)) {
+      if (!is_valid_retreat(dislodged_it->second, order)) {
         LOG(WARNING) << "Invalid retreat order [" << power_str(power)
                      << "]: " << order.to_string();
         continue;
       }
 
       // retreat order is valid: mark so another valid order is not accepted
-      dislodged_units.erase(dislodged_it);
+      dislodged_units.erase(unit.loc);
 
       if (order.get_type() == OrderType::D ||
-          set_contains(multiple_retreater_locs, root_loc(order.get_dest()))) {
+          multiple_retreater_locs.contains(root_loc(order.get_dest()))) {
         // do nothing: unit not added to next_state
       } else if (next_state.get_unit_rooted(order.get_dest()).type !=
                  UnitType::NONE) {
@@ -473,15 +1184,13 @@ GameState::process_r(const unordered_map<Power, vector<Order>> &orders) {
   return next_state;
 }
 
-GameState
-GameState::process_a(const unordered_map<Power, vector<Order>> &orders) {
+GameState GameState::process_a(const PowerMap<vector<Order>> &orders) {
   GameState next_state;
   next_state.set_phase(this->get_phase().next(false));
   next_state.set_units(this->get_units());
   next_state.set_centers(this->get_centers());
 
-  auto &all_possible_orders(this->get_all_possible_orders());
-  vector<int> n_builds(n_builds_);
+  std::array<int, 7> n_builds = compute_n_builds();
 
   for (auto &it : orders) {
     Power power = it.first;
@@ -495,7 +1204,7 @@ GameState::process_a(const unordered_map<Power, vector<Order>> &orders) {
         continue;
       }
 
-      if (!safe_contains(all_possible_orders, order.get_unit().loc, order)) {
+      if (!is_valid_adjustment(power, order)) {
         LOG(WARNING) << "Illegal order: " << order.to_string();
         continue;
       }
@@ -542,56 +1251,29 @@ void GameState::do_civil_disorder(Power power, int n) {
   DLOG(INFO) << "Civil disorder: " << power_str(power) << " " << n;
   JCHECK(n > 0, "do_civil_disorder must remove > 0 units");
 
-  map<int, set<Unit>> sorted_units; // distance -> units
-
-  // sort units by distance to home centers
+  // Units are removed in order of:
+  // 1. higher distance to home centers first
+  // 2. fleets before armies
+  // 3. alpha order
+  // which are packed into a single sort key per unit
+  std::array<pair<int, Loc>, 81> units;
+  int n_units = 0;
   for (auto &p : units_) {
     if (p.second.power == power) {
-      Unit unit = p.second.unowned();
-      auto &dist_map = unit.type == UnitType::ARMY
-                           ? CIVIL_DISORDER_DISTS_ARMY.at(power)
-                           : CIVIL_DISORDER_DISTS_FLEET.at(power);
-      int dist = dist_map[static_cast<int>(unit.loc) - 1];
-      sorted_units[dist].insert(unit);
+      bool is_army = p.second.type == UnitType::ARMY;
+      int dist = civil_disorder_dist(power, is_army, p.first);
+      int key = ((-dist * 2) + is_army) * 128 +
+                LOC_ALPHA_IDX[static_cast<int>(p.first)];
+      units[n_units++] = {key, p.first};
     }
   }
 
-  // Traverse in reverse order (higher distance first)
-  for (auto it = sorted_units.rbegin(); it != sorted_units.rend(); ++it) {
-    const set<Unit> &units = it->second;
-    if (units.size() <= n) {
-      // remove all units at this dist, no need to sort
-      for (Unit unit : units) {
-        JCHECK(units_.erase(unit.loc) == 1,
-               "do_civil_disorder Not found: " + unit.to_string());
-      }
-      n -= units.size();
-    } else {
-      // remove top n units sorted as follows:
-      // 1. remove fleets before armies
-      // 2. remove in alpha order
-      vector<Unit> fleets;
-      vector<Unit> armies;
-      for (Unit unit : units) {
-        (unit.type == UnitType::ARMY ? armies : fleets).push_back(unit);
-      }
-      while (n > 0) {
-        vector<Unit> &next_vec = fleets.size() > 0 ? fleets : armies;
-        vector<Unit>::iterator best_it;
-        int best_it_prio = 99999;
-        for (auto it = next_vec.begin(); it != next_vec.end(); ++it) {
-          int prio = LOC_ALPHA_IDX[it->loc];
-          if (prio < best_it_prio) {
-            best_it_prio = prio;
-            best_it = it;
-          }
-        }
-        JCHECK(units_.erase(best_it->loc) == 1,
-               "do_civil_disorder Not found: " + best_it->to_string());
-        n -= 1;
-        next_vec.erase(best_it);
-      }
-    }
+  n = std::min(n, n_units);
+  std::partial_sort(units.begin(), units.begin() + n,
+                    units.begin() + n_units);
+  for (int i = 0; i < n; ++i) {
+    JCHECK(remove_unit(units[i].second) == 1,
+           "do_civil_disorder Not found: " + loc_str(units[i].second));
   }
 }
 
@@ -606,11 +1288,9 @@ void GameState::maybe_skip_winter_or_finish() {
     return;
   }
 
-  for (auto &p : get_all_possible_orders()) {
-    if (p.second.size() > 0) {
-      // at least one power has a build/disband, so don't skip winter
-      return;
-    }
+  if (has_any_adjustment()) {
+    // at least one power has a build/disband, so don't skip winter
+    return;
   }
 
   // no power has a build/disband, so skip winter
@@ -631,9 +1311,7 @@ int GameState::get_n_builds(Power power) {
   if (phase_.season != 'W') {
     return 0;
   }
-  if (!orders_loaded_) {
-    get_all_possible_orders();
-  }
+  get_all_possible_orders();
   return n_builds_.at(static_cast<size_t>(power) - 1);
 }
 
@@ -707,9 +1385,9 @@ json GameState::to_json() {
     j["units"][power_str(p.second.power)].push_back(
         p.second.unowned().to_string());
   }
-  for (const auto &p : dislodged_units_) {
-    j["units"][power_str(p.first.power)].push_back(
-        "*" + p.first.unowned().to_string());
+  for (const OwnedUnit &unit : get_dislodged_units()) {
+    j["units"][power_str(unit.power)].push_back("*" +
+                                                unit.unowned().to_string());
   }
 
   return j;
@@ -722,15 +1400,14 @@ GameState::GameState(const json &j) {
 
   // builds
   if (phase_.season == 'W') {
-    n_builds_.clear();
+    n_builds_.fill(0);
   }
 
   // centers
   for (auto &it : j["centers"].items()) {
     Power power = power_from_str(it.key());
     for (const string &s : it.value()) {
-      Loc center = loc_from_str(s);
-      centers_[center] = power;
+      set_center(loc_from_str(s), power);
     }
   }
 
@@ -738,7 +1415,7 @@ GameState::GameState(const json &j) {
 
   // retreats
   if (phase_.phase_type == 'R') {
-    unordered_map<Power, set<Loc>> orderable_locations;
+    PowerMap<LocSet> orderable_locations;
     for (Power power : POWERS) {
       auto power_s = power_str(power);
       if (j["retreats"].find(power_s) == j["retreats"].end()) {
@@ -746,7 +1423,7 @@ GameState::GameState(const json &j) {
       }
       for (auto &it : j["retreats"][power_s].items()) {
         Unit unit = Unit(it.key());
-        dislodged_units_[unit.owned_by(power)] = Loc::NONE;
+        add_dislodged_unit(unit.owned_by(power), Loc::NONE);
         orderable_locations[power].insert(unit.loc);
         all_possible_orders_[unit.loc].insert(Order(unit, OrderType::D));
         for (const string &s : it.value()) {
@@ -768,11 +1445,189 @@ GameState::GameState(const json &j) {
         continue;
       }
       Unit unit(unit_s);
-      units_[unit.loc] = unit.owned_by(power);
+      set_unit(power, unit.type, unit.loc);
+    }
+  }
+}
+
+void GameState::write_board_bytes(uint8_t *units, uint8_t *centers) const {
+  std::fill(units, units + N_LOC_SLOTS, 0);
+  for (const auto &p : units_) {
+    units[static_cast<size_t>(p.first)] =
+        (static_cast<uint8_t>(p.second.power) << 2) |
+        static_cast<uint8_t>(p.second.type);
+  }
+  std::fill(centers, centers + N_LOC_SLOTS, 0);
+  for (const auto &p : centers_) {
+    centers[static_cast<size_t>(p.first)] = static_cast<uint8_t>(p.second);
+  }
+}
+
+void GameState::read_board_bytes(const uint8_t *units,
+                                 const uint8_t *centers) {
+  for (size_t i = 1; i < N_LOC_SLOTS; ++i) {
+    uint8_t unit = units[i];
+    if (unit != 0) {
+      Loc loc = static_cast<Loc>(i);
+      set_unit(static_cast<Power>(unit >> 2), static_cast<UnitType>(unit & 3),
+               loc);
+    }
+    if (centers[i] != 0) {
+      set_center(static_cast<Loc>(i), static_cast<Power>(centers[i]));
     }
   }
 }
 
+void GameState::to_bytes(BinaryWriter &writer) {
+  // phase
+  writer.write_u8(phase_.season);
+  writer.write_u16(phase_.year);
+  writer.write_u8(phase_.phase_type);
+
+  // units and centers, one byte per loc
+  uint8_t units[N_LOC_SLOTS];
+  uint8_t centers[N_LOC_SLOTS];
+  write_board_bytes(units, centers);
+  writer.write_raw(units, N_LOC_SLOTS);
+  writer.write_raw(centers, N_LOC_SLOTS);
+
+  write_retreats_bytes(writer);
+}
+
+void GameState::to_bytes_delta(const GameState &prev, BinaryWriter &writer) {
+  // phase
+  writer.write_u8(phase_.season);
+  writer.write_u16(phase_.year);
+  writer.write_u8(phase_.phase_type);
+
+  // (loc, byte) of the units, then of the centers, that differ from prev's
+  uint8_t units[N_LOC_SLOTS], centers[N_LOC_SLOTS];
+  uint8_t prev_units[N_LOC_SLOTS], prev_centers[N_LOC_SLOTS];
+  write_board_bytes(units, centers);
+  prev.write_board_bytes(prev_units, prev_centers);
+  for (auto[now, before] : {std::make_pair(units, prev_units),
+                            std::make_pair(centers, prev_centers)}) {
+    size_t n_changes = 0;
+    for (size_t i = 1; i < N_LOC_SLOTS; ++i) {
+      n_changes += now[i] != before[i];
+    }
+    writer.write_varint(n_changes);
+    for (size_t i = 1; i < N_LOC_SLOTS; ++i) {
+      if (now[i] != before[i]) {
+        writer.write_u8(i);
+        writer.write_u8(now[i]);
+      }
+    }
+  }
+
+  write_retreats_bytes(writer);
+}
+
+void GameState::write_retreats_bytes(BinaryWriter &writer) {
+  if (phase_.phase_type != 'R') {
+    return;
+  }
+
+  // retreats: store the retreat orders like to_json, since states loaded
+  // from json have no dislodged_by or contested locs to recompute them from
+  auto &all_possible_orders(this->get_all_possible_orders());
+  writer.write_varint(dislodged_units_.size());
+  for (const auto &p : dislodged_units_) {
+    const OwnedUnit &unit = p.second.unit;
+    writer.write_u8(static_cast<uint8_t>(unit.loc));
+    writer.write_u8(static_cast<uint8_t>(unit.power));
+    writer.write_u8(static_cast<uint8_t>(unit.type));
+    writer.write_u8(static_cast<uint8_t>(p.second.dislodged_by));
+
+    auto orders_it = all_possible_orders.find(unit.loc);
+    JCHECK(orders_it != all_possible_orders.end(),
+           "Dislodged unit has no retreat orders in to_bytes: " +
+               loc_str(unit.loc));
+    vector<Loc> dests;
+    for (auto &order : orders_it->second) {
+      if (order.get_type() == OrderType::R) {
+        dests.push_back(order.get_dest());
+      }
+    }
+    writer.write_varint(dests.size());
+    for (Loc dest : dests) {
+      writer.write_u8(static_cast<uint8_t>(dest));
+    }
+  }
+  writer.write_varint(contested_locs_.size());
+  for (Loc loc : contested_locs_) {
+    writer.write_u8(static_cast<uint8_t>(loc));
+  }
+}
+
+GameState::GameState(BinaryReader &reader) {
+  // phase
+  phase_.season = reader.read_u8();
+  phase_.year = reader.read_u16();
+  phase_.phase_type = reader.read_u8();
+
+  // units and centers
+  auto units = reinterpret_cast<const uint8_t *>(reader.read_raw(N_LOC_SLOTS));
+  auto centers =
+      reinterpret_cast<const uint8_t *>(reader.read_raw(N_LOC_SLOTS));
+  read_board_bytes(units, centers);
+
+  read_retreats_bytes(reader);
+}
+
+GameState::GameState(BinaryReader &reader, const GameState &prev) {
+  // phase
+  phase_.season = reader.read_u8();
+  phase_.year = reader.read_u16();
+  phase_.phase_type = reader.read_u8();
+
+  // prev's units and centers, with the changes applied
+  uint8_t units[N_LOC_SLOTS], centers[N_LOC_SLOTS];
+  prev.write_board_bytes(units, centers);
+  for (uint8_t *board : {units, centers}) {
+    size_t n_changes = reader.read_varint();
+    for (size_t i = 0; i < n_changes; ++i) {
+      uint8_t loc = reader.read_u8();
+      JCHECK(loc > 0 && loc < N_LOC_SLOTS, "from_bytes bad loc");
+      board[loc] = reader.read_u8();
+    }
+  }
+  read_board_bytes(units, centers);
+
+  read_retreats_bytes(reader);
+}
+
+void GameState::read_retreats_bytes(BinaryReader &reader) {
+  if (phase_.phase_type != 'R') {
+    return;
+  }
+
+  PowerMap<LocSet> orderable_locations;
+  size_t n_dislodged = reader.read_varint();
+  for (size_t i = 0; i < n_dislodged; ++i) {
+    OwnedUnit unit;
+    unit.loc = static_cast<Loc>(reader.read_u8());
+    unit.power = static_cast<Power>(reader.read_u8());
+    unit.type = static_cast<UnitType>(reader.read_u8());
+    add_dislodged_unit(unit, static_cast<Loc>(reader.read_u8()));
+    orderable_locations[unit.power].insert(unit.loc);
+
+    auto &unit_orders = all_possible_orders_[unit.loc];
+    unit_orders.insert(Order(unit.unowned(), OrderType::D));
+    size_t n_dests = reader.read_varint();
+    for (size_t j = 0; j < n_dests; ++j) {
+      unit_orders.insert(Order(unit.unowned(), OrderType::R,
+                               static_cast<Loc>(reader.read_u8())));
+    }
+  }
+  size_t n_contested = reader.read_varint();
+  for (size_t i = 0; i < n_contested; ++i) {
+    add_contested_loc(static_cast<Loc>(reader.read_u8()));
+  }
+  copy_sorted_root_locs(orderable_locations, orderable_locations_);
+  orders_loaded_ = true;
+}
+
 void GameState::debug_log_all_possible_orders() {
   LOG(INFO) << "ORDERABLE LOCATIONS";
   for (auto &it : this->get_orderable_locations()) {
@@ -791,28 +1646,34 @@ void GameState::debug_log_all_possible_orders() {
 }
 
 std::vector<float> GameState::get_square_scores() const {
-  std::vector<float> scores(7, 0);
+  std::vector<float> scores(7);
+  float sc_counts[7];
+  write_square_scores(scores.data(), sc_counts);
+  return scores;
+}
 
+void GameState::write_square_scores(float *scores, float *sc_counts) const {
   // get SC counts
+  std::fill(sc_counts, sc_counts + 7, 0);
   for (auto &p : centers_) {
-    scores[static_cast<size_t>(p.second) - 1] += 1;
+    sc_counts[static_cast<size_t>(p.second) - 1] += 1;
   }
 
   // check for winner
   for (int i = 0; i < 7; ++i) {
-    if (scores[i] > 17.5) {
+    if (sc_counts[i] > 17.5) {
       // there is a winner, return 1-hot
       for (int j = 0; j < 7; ++j) {
         scores[j] = i == j ? 1 : 0;
       }
-      return scores;
+      return;
     }
   }
 
   // no winner: square scores
   float sumsq = 0;
   for (int i = 0; i < 7; ++i) {
-    scores[i] = scores[i] * scores[i];
+    scores[i] = sc_counts[i] * sc_counts[i];
     sumsq += scores[i];
   }
 
@@ -820,35 +1681,31 @@ std::vector<float> GameState::get_square_scores() const {
   for (int i = 0; i < 7; ++i) {
     scores[i] /= sumsq;
   }
+}
 
-  return scores;
+void GameState::write_unit_arrays(int8_t *unit_types,
+                                  int8_t *unit_owners) const {
+  std::fill(unit_types, unit_types + LOCS.size(), -1);
+  std::fill(unit_owners, unit_owners + LOCS.size(), -1);
+  for (auto &p : units_) {
+    size_t i = static_cast<size_t>(p.first) - 1;
+    unit_types[i] = p.second.type == UnitType::ARMY ? 0 : 1;
+    unit_owners[i] = static_cast<int8_t>(p.second.power) - 1;
+  }
 }
 
-namespace {
-// Using a separate function for std::map to make code die if anyone will change
-// underlying objects to std::unordered_set in the future.
-template <typename K, typename V>
-inline void hash_combine_map(std::size_t &seed, const std::map<K, V> &map) {
-  for (const auto & [ k, v ] : map) {
-    hash_combine(seed, k);
-    hash_combine(seed, v);
+void GameState::write_center_owners(int8_t *center_owners) const {
+  for (size_t i = 0; i < SC_LOCS.size(); ++i) {
+    auto it = centers_.find(SC_LOCS[i]);
+    center_owners[i] =
+        it == centers_.end() ? -1 : static_cast<int8_t>(it->second) - 1;
   }
 }
-} // namespace
 
-size_t GameState::compute_board_hash() const {
-  size_t ret = 0;
-  hash_combine(ret, phase_);
-  hash_combine(ret, units_.size());
-  hash_combine_map(ret, units_);
-  hash_combine(ret, centers_.size());
-  hash_combine_map(ret, centers_);
+uint64_t GameState::stable_board_hash() const {
+  uint64_t ret = board_hash_ ^ zobrist::phase(phase_);
   if (phase_.phase_type == 'R') {
-    hash_combine(ret, dislodged_units_.size());
-    hash_combine_map(ret, dislodged_units_);
-    hash_combine(ret, contested_locs_.size());
-    for (const auto loc : contested_locs_)
-      hash_combine(ret, loc);
+    ret ^= retreat_hash_;
   }
   return ret;
 }
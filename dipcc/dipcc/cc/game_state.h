@@ -7,39 +7,122 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "binary.h"
 #include "enums.h"
 #include "hash.h"
+#include "loc_map.h"
+#include "loc_orders_cache.h"
+#include "memory_usage.h"
 #include "order.h"
 #include "owned_unit.h"
 #include "phase.h"
 #include "power.h"
+#include "power_map.h"
 #include "thirdparty/nlohmann/json.hpp"
 
 namespace dipcc {
 
 struct Resolution; // defined in process.cc
 
+// A unit dislodged during an M-phase, stored by its loc during the R-phase
+struct DislodgedUnit {
+  OwnedUnit unit;
+  Loc dislodged_by;
+
+  bool operator==(const DislodgedUnit &other) const {
+    return unit == other.unit && dislodged_by == other.dislodged_by;
+  }
+};
+
+// Possible orders generated one loc at a time, see
+// GameState::get_possible_orders. The state that owns them adds to them while
+// the states processed from it read them, all holding the mutex; entries are
+// not modified once added.
+struct LazyPossibleOrders {
+  mutable std::mutex mutex;
+
+  // Board the orders were generated for
+  LocMap<OwnedUnit> units;
+
+  // Via moves and convoy orders, which depend on the whole board
+  bool convoy_orders_loaded = false;
+  std::pmr::vector<Order> convoy_orders;
+
+  // Possible orders by (unit) loc
+  std::unordered_map<Loc, std::set<Order>> orders;
+};
+
+// What GameState::apply changed, for GameState::undo: the prior values of
+// the board entries that changed (nullopt if absent), the small fixed-size
+// members, and the prior possible orders, moved rather than copied. Reusing
+// a record across applies reuses the capacity of its vectors.
+struct UndoRecord {
+  Phase phase;
+  std::vector<std::pair<Loc, std::optional<OwnedUnit>>> units;
+  std::vector<std::pair<Loc, std::optional<Power>>> centers;
+  std::vector<std::pair<Loc, std::optional<DislodgedUnit>>> dislodged_units;
+  LocSet contested_locs;
+  std::array<int, 7> n_builds;
+  uint64_t board_hash;
+  uint64_t centers_hash;
+  uint64_t retreat_hash;
+
+  std::unordered_map<Loc, std::set<Order>> all_possible_orders;
+  std::unordered_map<Loc, std::shared_ptr<const LocOrders>> loc_orders;
+  PowerMap<std::vector<Loc>> orderable_locations;
+  bool orders_loaded;
+  std::shared_ptr<LazyPossibleOrders> lazy_orders;
+  std::shared_ptr<const LazyPossibleOrders> parent_lazy_orders;
+};
+
+// A bool that one thread may set while others read it, which publishes the
+// possible orders loaded before it was set, see
+// GameState::get_all_possible_orders. Copies copy the value.
+class LoadedFlag {
+public:
+  LoadedFlag(bool value = false) : value_(value) {}
+  LoadedFlag(const LoadedFlag &other) : value_(bool(other)) {}
+  LoadedFlag &operator=(const LoadedFlag &other) { return *this = bool(other); }
+  LoadedFlag &operator=(bool value) {
+    value_.store(value, std::memory_order_release);
+    return *this;
+  }
+  operator bool() const { return value_.load(std::memory_order_acquire); }
+
+private:
+  std::atomic<bool> value_;
+};
+
 class GameState {
 public:
   GameState(){};
   GameState(const json &j);
+  GameState(BinaryReader &reader);
 
   OwnedUnit get_unit(Loc loc) const;
   OwnedUnit get_unit_rooted(Loc loc) const;
   void set_unit(Power power, UnitType type, Loc loc);
-  void set_units(const std::map<Loc, OwnedUnit> units) { units_ = units; }
+  void set_units(const LocMap<OwnedUnit> &units);
   void remove_unit_rooted(Loc);
-  const std::map<Loc, OwnedUnit> &get_units() const { return units_; }
+  const LocMap<OwnedUnit> &get_units() const { return units_; }
 
   void set_center(Loc loc, Power power);
-  void set_centers(const std::map<Loc, Power> &centers) { centers_ = centers; }
-  const std::map<Loc, Power> &get_centers() const { return centers_; }
+  void set_centers(const LocMap<Power> &centers);
+  const LocMap<Power> &get_centers() const { return centers_; }
+  // Zobrist hash of the centers alone, kept up to date like the board hash
+  uint64_t get_centers_hash() const { return centers_hash_; }
 
   Phase get_phase() const { return phase_; }
   void set_phase(Phase phase) { phase_ = phase; }
@@ -48,42 +131,181 @@ public:
   void remove_dislodged_unit(OwnedUnit unit);
   void add_contested_loc(Loc loc);
   std::vector<OwnedUnit> get_dislodged_units() const;
+  const LocMap<DislodgedUnit> &get_dislodged_units_map() const {
+    return dislodged_units_;
+  }
   int get_n_builds(Power power);
 
-  const std::unordered_map<Power, std::vector<Loc>> &get_orderable_locations();
+  // Possible orders are loaded on first use. Loading is thread-safe: threads
+  // sharing a state load it once, and read it without locking afterwards.
+  const PowerMap<std::vector<Loc>> &get_orderable_locations();
   const std::unordered_map<Loc, std::set<Order>> &get_all_possible_orders();
+  // Not thread-safe
   void clear_all_possible_orders();
 
+  // Approximate bytes used, as "state" (the board) and "possible_orders"
+  // (the loaded or lazily generated possible orders, and orderable locs)
+  MemoryUsage memory_usage() const;
+  void add_memory_usage(MemoryUsage &usage, MemorySeen &seen) const;
+
+  // Return the possible orders for the unit at loc (empty if there is none).
+  // If all possible orders are not loaded, in an M-phase only the orders for
+  // this loc are generated and cached. Orders are reused from the parent
+  // state (the state this one was processed from) if nothing within two
+  // steps of loc changed and the convoy routes are the same. Thread-safe,
+  // like get_all_possible_orders.
+  const std::set<Order> &get_possible_orders(Loc loc);
+
+  // The LocOrdersCache entry of the possible orders of the unit at loc, or
+  // nullptr if they were not loaded through the cache (e.g. it is disabled,
+  // or this is not an M-phase). Loads all possible orders if needed.
+  const LocOrders *get_loc_orders(Loc loc);
+
+  // Whether order is in get_possible_orders(order.get_unit().loc) of this
+  // M-phase, tested against the board without generating the possible
+  // orders. Thread-safe.
+  bool is_valid_movement(const Order &order) const;
+
+  // Whether a dislodged unit has anywhere to retreat to. If not, it is
+  // disbanded without a retreat phase.
+  bool has_any_retreat(const DislodgedUnit &dislodged) const;
+
+  // True if this is an A-phase in which no power has a choice to make: each
+  // has nothing to build or nowhere to build, and disbands nothing or all of
+  // its units (which civil disorder does without orders). Such phases can be
+  // processed without orders.
+  bool is_forced_phase() const;
+
   void do_civil_disorder(Power power, int n);
   void maybe_skip_winter_or_finish();
 
   std::vector<float> get_square_scores() const;
 
-  GameState process(const std::unordered_map<Power, std::vector<Order>> &orders,
-                    bool exception_on_convoy_paradox = false);
+  // Write the 7 square scores, and the 7 SC counts, to the given arrays
+  void write_square_scores(float *scores, float *sc_counts) const;
+
+  // Write the units as two arrays indexed like LOCS: unit_types is 0 for
+  // armies and 1 for fleets, unit_owners the owner's power idx, both -1 where
+  // there is no unit. Dislodged units are not included.
+  void write_unit_arrays(int8_t *unit_types, int8_t *unit_owners) const;
+
+  // Write the owner's power idx of each of SC_LOCS, or -1 if unowned
+  void write_center_owners(int8_t *center_owners) const;
+
+  // If lazy_possible_orders is true, the possible orders of an M-phase are
+  // not loaded: orders are validated against the board, and possible orders
+  // are only generated on request, see get_possible_orders
+  //
+  // If convoy_paradox is given, it is set to whether the orders had a convoy
+  // paradox, which without exception_on_convoy_paradox is resolved by the
+  // Szykman rule
+  GameState process(const PowerMap<std::vector<Order>> &orders,
+                    bool exception_on_convoy_paradox = false,
+                    bool lazy_possible_orders = false,
+                    bool *convoy_paradox = nullptr);
+
+  // Process each of several order sets against this state, returning one
+  // successor state per order set. Possible orders are computed once and
+  // shared, and this state is not modified afterwards, so it is safe to call
+  // process() concurrently on the same state once this (or
+  // get_all_possible_orders) has been called.
+  std::vector<GameState> process_many(
+      const std::vector<PowerMap<std::vector<Order>>> &orders_list,
+      bool exception_on_convoy_paradox = false);
+
+  // Whether this state and other give equal states when processed with the
+  // same orders: their phases and boards, with dislodged units and contested
+  // locs, are equal
+  bool same_process_inputs(const GameState &other) const;
+
+  // Replace this state by its successor under orders, recording in undo only
+  // what changed, so that depth-first search can step a single state per
+  // thread. The possible orders of this state are kept in undo, so siblings
+  // applied after an undo() reuse them.
+  //
+  // This is not in-place adjudication: the successor is still built by
+  // process() (the adjudicator reads the prior board while writing the next
+  // one), then its changed board entries are copied back. It saves keeping
+  // a state per ply and reloading possible orders, not the processing cost.
+  void apply(const PowerMap<std::vector<Order>> &orders, UndoRecord &undo,
+             bool exception_on_convoy_paradox = false);
+
+  // Revert the apply() that filled undo, moving its possible orders back.
+  // Applies must be undone in reverse order.
+  void undo(UndoRecord &undo);
 
   nlohmann::json to_json();
+  void to_bytes(BinaryWriter &writer);
 
-  size_t compute_board_hash() const;
+  // to_bytes of a state of the phase after prev's in a history, storing only
+  // the units and centers that changed since prev. Read back with the prev
+  // it was written against.
+  void to_bytes_delta(const GameState &prev, BinaryWriter &writer);
+  GameState(BinaryReader &reader, const GameState &prev);
+
+  // O(1): the hash is kept up to date by the setters below. Equal boards
+  // have equal hashes however they were built.
+  size_t compute_board_hash() const { return stable_board_hash(); }
+
+  // The same hash as a uint64_t, whose value is part of dipcc's interface:
+  // it is the same in every process, build and platform (see zobrist.h), so
+  // it can key caches and dedup shared between machines. Changing it breaks
+  // files keyed by it, and the golden values of TestStableBoardHash.
+  uint64_t stable_board_hash() const;
 
 private:
+  size_t remove_unit(Loc loc);
+
+  // The board of to_bytes: one byte per loc, of the unit and of the center
+  void write_board_bytes(uint8_t *units, uint8_t *centers) const;
+  void read_board_bytes(const uint8_t *units, const uint8_t *centers);
+  void write_retreats_bytes(BinaryWriter &writer);
+  void read_retreats_bytes(BinaryReader &reader);
+
   void load_all_possible_orders_m();
+  // load_all_possible_orders_m through the global LocOrdersCache
+  void load_cached_possible_orders_m();
+  void get_loc_orders_key(const OwnedUnit &unit,
+                          const std::pmr::vector<Order> &convoy_orders,
+                          LocOrdersCache::Key &key) const;
+  void load_convoy_orders_m(std::pmr::vector<Order> &convoy_orders) const;
+  void load_possible_orders_m(const OwnedUnit &unit,
+                              const std::pmr::vector<Order> &convoy_orders,
+                              std::set<Order> &unit_orders) const;
+  // Copy the parent's possible orders of the unit at loc, if its
+  // neighbourhood is unchanged since; return false otherwise
+  bool copy_parent_possible_orders(Loc loc,
+                                   const std::pmr::vector<Order> &convoy_orders,
+                                   std::set<Order> &unit_orders) const;
+  // get_possible_orders without all possible orders loaded, holding the lock
+  const std::set<Order> &get_lazy_possible_orders(Loc loc);
   void load_all_possible_orders_r();
   void load_all_possible_orders_a();
   void copy_possible_orders_to_root_loc();
-  void
-  copy_sorted_root_locs(const std::unordered_map<Power, std::set<Loc>> &from,
-                        std::unordered_map<Power, std::vector<Loc>> &to);
-
-  GameState
-  process_m(const std::unordered_map<Power, std::vector<Order>> &orders,
-            bool exception_on_convoy_paradox = false);
-  GameState
-  process_r(const std::unordered_map<Power, std::vector<Order>> &orders);
-  GameState
-  process_a(const std::unordered_map<Power, std::vector<Order>> &orders);
+  void copy_sorted_root_locs(const PowerMap<LocSet> &from,
+                             PowerMap<std::vector<Loc>> &to);
+
+  GameState process_m(const PowerMap<std::vector<Order>> &orders,
+                      bool exception_on_convoy_paradox = false,
+                      bool *convoy_paradox = nullptr);
+  GameState process_r(const PowerMap<std::vector<Order>> &orders);
+  GameState process_a(const PowerMap<std::vector<Order>> &orders);
 
   bool has_any_unoccupied_home(Power power) const;
+  std::array<int, 7> compute_n_builds() const;
+  bool has_buildable_home(Power power) const;
+  bool has_any_adjustment() const;
+
+  // Validate orders without loading all possible orders; equivalent to
+  // looking them up in get_all_possible_orders()
+  bool is_valid_adjustment(Power power, const Order &order) const;
+  bool can_retreat_to(const DislodgedUnit &dislodged, Loc dest) const;
+  bool is_valid_retreat(const DislodgedUnit &dislodged,
+                        const Order &order) const;
+  LocSet get_water_fleets() const;
+  bool can_move_to(const Unit &mover, Loc dest) const;
+  // An M-phase move given without via that is only possible as a via move
+  bool is_implicit_via(const Order &order) const;
   void recalculate_centers();
   Power get_winner() const;
   GameState build_next_state(const Resolution &) const;
@@ -93,17 +315,41 @@ private:
 
   // Members
   Phase phase_ = {'S', 1901, 'M'};
-  std::map<Loc, OwnedUnit> units_;
-  std::map<Loc, Power> centers_;
-  std::map<OwnedUnit, Loc> dislodged_units_; // only valid during R phase
-  std::set<Loc> contested_locs_;             // only valid during R phase
-  std::vector<int> n_builds_; // 7-len vector only valid during A phase
+  //
+  // The board is held in fixed-size Loc-indexed containers so that copying
+  // a GameState (done on every process() call and every Game clone) copies
+  // the board with memcpy instead of rebuilding red-black trees.
+  LocMap<OwnedUnit> units_;
+  LocMap<Power> centers_;
+  LocMap<DislodgedUnit> dislodged_units_; // only valid during R phase
+  LocSet contested_locs_;                 // only valid during R phase
+  std::array<int, 7> n_builds_{};         // only valid during A phase
+
+  // Zobrist hashes (see zobrist.h) of units_ + centers_, and of
+  // dislodged_units_ + contested_locs_. Every write to these goes through a
+  // setter that updates the hash.
+  uint64_t board_hash_ = 0;
+  uint64_t centers_hash_ = 0; // the centers_ part of board_hash_
+  uint64_t retreat_hash_ = 0;
 
   std::unordered_map<Loc, std::set<Order>> all_possible_orders_;
-  std::unordered_map<Power, std::vector<Loc>> orderable_locations_;
-  bool orders_loaded_ = false;
+  // If loaded through the LocOrdersCache, the entries of all_possible_orders_
+  std::unordered_map<Loc, std::shared_ptr<const LocOrders>> loc_orders_;
+  PowerMap<std::vector<Loc>> orderable_locations_;
+  LoadedFlag orders_loaded_ = false;
+
+  // Only set if get_possible_orders was called with orders not loaded.
+  // Accessed with std::atomic_load/store where the state may be shared: it
+  // is set while other threads process the state, see build_next_state.
+  std::shared_ptr<LazyPossibleOrders> lazy_orders_;
+  std::shared_ptr<const LazyPossibleOrders> parent_lazy_orders_;
 
   const static int MAX_YEAR = 1935;
 };
 
+static_assert(std::is_trivially_copyable<LocMap<OwnedUnit>>::value &&
+                  std::is_trivially_copyable<LocMap<Power>>::value &&
+                  std::is_trivially_copyable<LocMap<DislodgedUnit>>::value,
+              "board containers must be trivially copyable");
+
 } // namespace dipcc
@@ -122,6 +122,16 @@ const std::vector<Loc> ONLY_COAST_LOCS{
     Loc::SPA_SC, Loc::STP_NC, Loc::STP_SC,
 };
 
+const std::vector<Loc> SC_LOCS = [] {
+  std::vector<Loc> r;
+  for (Loc loc : LOCS) {
+    if (is_center(loc) && root_loc(loc) == loc) {
+      r.push_back(loc);
+    }
+  }
+  return r;
+}();
+
 const std::vector<std::string> LOC_STRS{
     "NONE",   "YOR", "EDI",    "LON", "LVP", "NTH", "WAL", "CLY",    "NWG",
     "ENG",    "IRI", "NAO",    "BEL", "DEN", "HEL", "HOL", "NWY",    "SKA",
@@ -142,52 +152,6 @@ std::ostream &operator<<(std::ostream &os, Loc loc) {
   return os << loc_str(loc);
 }
 
-// >>> [game.map.loc_type.get(loc) == 'WATER' for loc in LOCS]
-std::vector<bool> IS_WATER{
-    false, false, false, false, true,  false, false, true,  true,  true,  true,
-    false, false, true,  false, false, true,  true,  false, true,  false, false,
-    false, true,  false, false, false, false, false, false, false, false, false,
-    false, false, false, true,  false, false, false, true,  false, false, false,
-    false, false, true,  true,  false, false, false, false, false, false, false,
-    true,  false, false, false, false, false, false, false, false, true,  false,
-    true,  true,  false, false, true,  false, false, false, false, false, false,
-    false, false, false, false};
-
-bool is_water(Loc loc) {
-  return IS_WATER.at(static_cast<size_t>(loc) - 1); // -1 for NONE
-}
-
-// >>> [game.map.area_type(loc) == "COAST" for loc in LOCS]
-std::vector<bool> IS_COAST{
-    true,  true,  true,  true,  false, true,  true,  false, false, false, false,
-    true,  true,  false, true,  true,  false, false, true,  false, true,  false,
-    false, false, true,  true,  true,  true,  true,  true,  false, true,  true,
-    true,  true,  true,  false, true,  false, true,  false, true,  true,  true,
-    false, true,  false, false, true,  false, false, false, false, true,  false,
-    false, true,  true,  true,  true,  false, false, true,  true,  false, true,
-    false, false, true,  true,  false, true,  false, false, true,  true,  true,
-    true,  true,  true,  true};
-
-bool is_coast(Loc loc) {
-  return IS_COAST.at(static_cast<size_t>(loc) - 1); // -1 for NONE
-}
-
-// >>> [loc[:3] in game.map.scs for loc in LOCS]
-// N.B. include center coasts, e.g. IS_CENTER[STP/NC] = true
-std::vector<bool> IS_CENTER{
-    false, true,  true,  true,  false, false, false, false, false, false, false,
-    true,  true,  false, true,  true,  false, false, true,  false, false, false,
-    false, false, true,  true,  false, true,  true,  false, true,  false, true,
-    true,  true,  true,  false, true,  true,  true,  false, false, false, true,
-    true,  true,  false, false, false, false, false, false, true,  true,  false,
-    false, false, true,  true,  true,  false, true,  true,  false, false, true,
-    false, false, false, false, false, true,  true,  true,  true,  true,  false,
-    true,  true,  true,  true};
-
-bool is_center(Loc loc) {
-  return IS_CENTER.at(static_cast<size_t>(loc) - 1); // -1 for NONE
-}
-
 const std::unordered_map<std::string, Loc> LOC_FROM_STR{
     {"YOR", Loc::YOR},       {"EDI", Loc::EDI},       {"LON", Loc::LON},
     {"LVP", Loc::LVP},       {"NTH", Loc::NTH},       {"WAL", Loc::WAL},
@@ -218,29 +182,56 @@ const std::unordered_map<std::string, Loc> LOC_FROM_STR{
     {"BUL/EC", Loc::BUL_EC}, {"CON", Loc::CON},       {"BUL/SC", Loc::BUL_SC},
 };
 
-Loc loc_from_str(const std::string &s) {
-  auto it = LOC_FROM_STR.find(s);
-  if (it == LOC_FROM_STR.end()) {
-    return Loc::NONE;
-  } else {
-    return it->second;
+namespace {
+
+const size_t N_LOC_CODES = 26 * 26 * 26;
+
+// Index of a 3-letter upper case loc name, or -1
+inline int loc_code(std::string_view s) {
+  int r = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    if (s[i] < 'A' || s[i] > 'Z') {
+      return -1;
+    }
+    r = r * 26 + (s[i] - 'A');
   }
+  return r;
 }
 
-Loc root_loc(Loc loc) {
-  switch (loc) {
-  case Loc::BUL_EC:
-  case Loc::BUL_SC:
-    return Loc::BUL;
-  case Loc::SPA_NC:
-  case Loc::SPA_SC:
-    return Loc::SPA;
-  case Loc::STP_NC:
-  case Loc::STP_SC:
-    return Loc::STP;
-  default:
-    return loc;
+// Perfect hash of root loc names: indexed by loc_code
+const std::vector<Loc> ROOT_LOC_FROM_CODE = [] {
+  std::vector<Loc> r(N_LOC_CODES, Loc::NONE);
+  for (size_t i = 1; i < LOC_STRS.size(); ++i) {
+    if (LOC_STRS[i].size() == 3) {
+      r[loc_code(LOC_STRS[i])] = static_cast<Loc>(i);
+    }
+  }
+  return r;
+}();
+
+} // namespace
+
+Loc loc_from_str(std::string_view s) {
+  if (s.size() != 3 && s.size() != 6) {
+    return Loc::NONE;
+  }
+  int code = loc_code(s);
+  if (code < 0) {
+    return Loc::NONE;
+  }
+  Loc root = ROOT_LOC_FROM_CODE[code];
+  if (s.size() == 3 || root == Loc::NONE) {
+    return root;
+  }
+
+  // e.g. "SPA/NC"
+  for (Loc loc : ONLY_COAST_LOCS) {
+    std::string_view name = LOC_STRS[static_cast<size_t>(loc)];
+    if (root_loc(loc) == root && s.substr(3) == name.substr(3)) {
+      return loc;
+    }
   }
+  return Loc::NONE;
 }
 
 // >>> '{' + ','.join(['{'+','.join(f'Loc::{c}' for c in game.map.homes[p]) +
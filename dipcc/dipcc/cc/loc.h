@@ -8,6 +8,7 @@ LICENSE file in the root directory of this source tree.
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -109,21 +110,78 @@ extern const std::unordered_map<std::string, Loc> LOC_FROM_STR;
 
 extern const std::vector<Loc> ONLY_COAST_LOCS;
 
+// The N_SCS root supply centers, in LOCS order
+extern const std::vector<Loc> SC_LOCS;
+
+// >>> [game.map.loc_type.get(loc) == 'WATER' for loc in LOCS], with NONE first
+inline constexpr bool IS_WATER[] = {
+    false, false, false, false, false, true,  false, false, true,  true,  true,
+    true,  false, false, true,  false, false, true,  true,  false, true,  false,
+    false, false, true,  false, false, false, false, false, false, false, false,
+    false, false, false, false, true,  false, false, false, true,  false, false,
+    false, false, false, true,  true,  false, false, false, false, false, false,
+    false, true,  false, false, false, false, false, false, false, false, true,
+    false, true,  true,  false, false, true,  false, false, false, false, false,
+    false, false, false, false, false};
+
 // Return true if loc is open water
-bool is_water(Loc);
+inline constexpr bool is_water(Loc loc) {
+  return IS_WATER[static_cast<size_t>(loc)];
+}
+
+// >>> [game.map.area_type(loc) == "COAST" for loc in LOCS], with NONE first
+inline constexpr bool IS_COAST[] = {
+    false, true,  true,  true,  true,  false, true,  true,  false, false, false,
+    false, true,  true,  false, true,  true,  false, false, true,  false, true,
+    false, false, false, true,  true,  true,  true,  true,  true,  false, true,
+    true,  true,  true,  true,  false, true,  false, true,  false, true,  true,
+    true,  false, true,  false, false, true,  false, false, false, false, true,
+    false, false, true,  true,  true,  true,  false, false, true,  true,  false,
+    true,  false, false, true,  true,  false, true,  false, false, true,  true,
+    true,  true,  true,  true,  true};
 
 // Return true if loc is a coastal land loc
-bool is_coast(Loc);
+inline constexpr bool is_coast(Loc loc) {
+  return IS_COAST[static_cast<size_t>(loc)];
+}
+
+// >>> [loc[:3] in game.map.scs for loc in LOCS], with NONE first
+// N.B. include center coasts, e.g. IS_CENTER[STP/NC] = true
+inline constexpr bool IS_CENTER[] = {
+    false, false, true,  true,  true,  false, false, false, false, false, false,
+    false, true,  true,  false, true,  true,  false, false, true,  false, false,
+    false, false, false, true,  true,  false, true,  true,  false, true,  false,
+    true,  true,  true,  true,  false, true,  true,  true,  false, false, false,
+    true,  true,  true,  false, false, false, false, false, false, true,  true,
+    false, false, false, true,  true,  true,  false, true,  true,  false, false,
+    true,  false, false, false, false, false, true,  true,  true,  true,  true,
+    false, true,  true,  true,  true};
 
 // Return true if loc is a supply center
-bool is_center(Loc);
+inline constexpr bool is_center(Loc loc) {
+  return IS_CENTER[static_cast<size_t>(loc)];
+}
 
 // Return the string representation of a loc
 std::string loc_str(Loc);
-Loc loc_from_str(const std::string &);
+Loc loc_from_str(std::string_view); // Loc::NONE if unknown
 
 // Map BUL/EC -> BUL, non-coasts to themselves
-Loc root_loc(Loc);
+inline constexpr Loc root_loc(Loc loc) {
+  switch (loc) {
+  case Loc::BUL_EC:
+  case Loc::BUL_SC:
+    return Loc::BUL;
+  case Loc::SPA_NC:
+  case Loc::SPA_SC:
+    return Loc::SPA;
+  case Loc::STP_NC:
+  case Loc::STP_SC:
+    return Loc::STP;
+  default:
+    return loc;
+  }
+}
 
 // Map any of BUL, BUL/EC, BUL/SC -> {BUL, BUL/EC, BUL/SC}
 const std::vector<Loc> &expand_coasts(Loc);
@@ -0,0 +1,258 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <type_traits>
+
+#include "loc.h"
+
+namespace dipcc {
+
+// Number of Loc enum values, including Loc::NONE
+static constexpr size_t N_LOC_SLOTS = 82;
+
+// Fixed-capacity bitset of Locs, iterated in Loc order. Trivially copyable,
+// and usable in constexpr tables, e.g. the adjacency masks in adjacencies.h.
+class LocSet {
+public:
+  class const_iterator {
+  public:
+    const_iterator(const LocSet *set, size_t i) : set_(set), i_(i) {}
+    Loc operator*() const { return static_cast<Loc>(i_); }
+    const_iterator &operator++() {
+      i_ = set_->next_from(i_ + 1);
+      return *this;
+    }
+    bool operator==(const const_iterator &o) const { return i_ == o.i_; }
+    bool operator!=(const const_iterator &o) const { return i_ != o.i_; }
+
+  private:
+    const LocSet *set_;
+    size_t i_;
+  };
+  using iterator = const_iterator;
+  using value_type = Loc;
+
+  constexpr LocSet() {}
+  constexpr LocSet(std::initializer_list<Loc> locs) {
+    for (Loc loc : locs) {
+      insert(loc);
+    }
+  }
+
+  constexpr void insert(Loc loc) { set_bit(static_cast<size_t>(loc)); }
+  constexpr size_t erase(Loc loc) {
+    size_t i = static_cast<size_t>(loc);
+    if (!test(i)) {
+      return 0;
+    }
+    words_[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    return 1;
+  }
+  constexpr bool contains(Loc loc) const {
+    return test(static_cast<size_t>(loc));
+  }
+  size_t count(Loc loc) const { return contains(loc) ? 1 : 0; }
+  const_iterator find(Loc loc) const {
+    return contains(loc) ? const_iterator(this, static_cast<size_t>(loc))
+                         : end();
+  }
+  size_t size() const {
+    return __builtin_popcountll(words_[0]) + __builtin_popcountll(words_[1]);
+  }
+  constexpr bool empty() const { return words_[0] == 0 && words_[1] == 0; }
+  constexpr void clear() { words_[0] = words_[1] = 0; }
+
+  const_iterator begin() const { return const_iterator(this, next_from(0)); }
+  const_iterator end() const { return const_iterator(this, N_LOC_SLOTS); }
+
+  constexpr bool operator==(const LocSet &o) const {
+    return words_[0] == o.words_[0] && words_[1] == o.words_[1];
+  }
+  constexpr bool operator!=(const LocSet &o) const { return !(*this == o); }
+
+  // Intersection, union and difference
+  constexpr LocSet &operator&=(const LocSet &o) {
+    words_[0] &= o.words_[0];
+    words_[1] &= o.words_[1];
+    return *this;
+  }
+  constexpr LocSet &operator|=(const LocSet &o) {
+    words_[0] |= o.words_[0];
+    words_[1] |= o.words_[1];
+    return *this;
+  }
+  constexpr LocSet &operator-=(const LocSet &o) {
+    words_[0] &= ~o.words_[0];
+    words_[1] &= ~o.words_[1];
+    return *this;
+  }
+  constexpr LocSet operator&(const LocSet &o) const {
+    return LocSet(*this) &= o;
+  }
+  constexpr LocSet operator|(const LocSet &o) const {
+    return LocSet(*this) |= o;
+  }
+  constexpr LocSet operator-(const LocSet &o) const {
+    return LocSet(*this) -= o;
+  }
+  constexpr bool intersects(const LocSet &o) const {
+    return !(*this & o).empty();
+  }
+
+  // Raw access, e.g. for hashing or masking
+  const uint64_t *words() const { return words_; }
+
+  // Return the first set index >= i, or N_LOC_SLOTS if there is none
+  size_t next_from(size_t i) const {
+    while (i < N_LOC_SLOTS) {
+      uint64_t w = words_[i >> 6] >> (i & 63);
+      if (w != 0) {
+        return i + __builtin_ctzll(w);
+      }
+      i = (i | 63) + 1;
+    }
+    return N_LOC_SLOTS;
+  }
+
+private:
+  constexpr bool test(size_t i) const {
+    return (words_[i >> 6] >> (i & 63)) & 1;
+  }
+  constexpr void set_bit(size_t i) {
+    words_[i >> 6] |= uint64_t(1) << (i & 63);
+  }
+
+  uint64_t words_[2] = {0, 0};
+};
+
+// Fixed-capacity map keyed by Loc, a drop-in replacement for std::map<Loc, V>
+// on the board hot path. Entries are stored in an array indexed by Loc, with
+// a LocSet tracking occupancy, so iteration happens in Loc order (the same
+// order as std::map<Loc, V>) and copies are a memcpy with no heap allocation
+// as long as V is trivially copyable.
+template <typename V> class LocMap {
+public:
+  struct Entry {
+    Loc first;
+    V second;
+
+    bool operator==(const Entry &o) const {
+      return first == o.first && second == o.second;
+    }
+  };
+
+  template <typename M, typename E> class iterator_base {
+  public:
+    iterator_base(M *map, size_t i) : map_(map), i_(i) {}
+    E &operator*() const { return map_->entries_[i_]; }
+    E *operator->() const { return &map_->entries_[i_]; }
+    iterator_base &operator++() {
+      i_ = map_->present_.next_from(i_ + 1);
+      return *this;
+    }
+    iterator_base operator++(int) {
+      iterator_base r = *this;
+      ++*this;
+      return r;
+    }
+    bool operator==(const iterator_base &o) const { return i_ == o.i_; }
+    bool operator!=(const iterator_base &o) const { return i_ != o.i_; }
+
+  private:
+    M *map_;
+    size_t i_;
+  };
+
+  using key_type = Loc;
+  using mapped_type = V;
+  using value_type = Entry;
+  using iterator = iterator_base<LocMap, Entry>;
+  using const_iterator = iterator_base<const LocMap, const Entry>;
+
+  LocMap() {
+    for (size_t i = 0; i < N_LOC_SLOTS; ++i) {
+      entries_[i].first = static_cast<Loc>(i);
+    }
+  }
+
+  V &operator[](Loc loc) {
+    size_t i = static_cast<size_t>(loc);
+    if (!present_.contains(loc)) {
+      present_.insert(loc);
+      entries_[i].second = V();
+    }
+    return entries_[i].second;
+  }
+
+  V &at(Loc loc) {
+    if (!present_.contains(loc)) {
+      throw std::out_of_range("LocMap::at " + loc_str(loc));
+    }
+    return entries_[static_cast<size_t>(loc)].second;
+  }
+  const V &at(Loc loc) const {
+    if (!present_.contains(loc)) {
+      throw std::out_of_range("LocMap::at " + loc_str(loc));
+    }
+    return entries_[static_cast<size_t>(loc)].second;
+  }
+
+  iterator find(Loc loc) {
+    return present_.contains(loc) ? iterator(this, static_cast<size_t>(loc))
+                                  : end();
+  }
+  const_iterator find(Loc loc) const {
+    return present_.contains(loc)
+               ? const_iterator(this, static_cast<size_t>(loc))
+               : end();
+  }
+
+  size_t erase(Loc loc) { return present_.erase(loc); }
+  size_t count(Loc loc) const { return present_.count(loc); }
+  bool contains(Loc loc) const { return present_.contains(loc); }
+  size_t size() const { return present_.size(); }
+  bool empty() const { return present_.empty(); }
+  void clear() { present_.clear(); }
+
+  iterator begin() { return iterator(this, present_.next_from(0)); }
+  iterator end() { return iterator(this, N_LOC_SLOTS); }
+  const_iterator begin() const {
+    return const_iterator(this, present_.next_from(0));
+  }
+  const_iterator end() const { return const_iterator(this, N_LOC_SLOTS); }
+
+  // The set of occupied keys
+  const LocSet &keys() const { return present_; }
+
+  bool operator==(const LocMap &o) const {
+    if (present_ != o.present_) {
+      return false;
+    }
+    for (auto it = begin(); it != end(); ++it) {
+      if (!(it->second == o.entries_[static_cast<size_t>(it->first)].second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator!=(const LocMap &o) const { return !(*this == o); }
+
+private:
+  Entry entries_[N_LOC_SLOTS];
+  LocSet present_;
+};
+
+static_assert(std::is_trivially_copyable<LocSet>::value,
+              "LocSet must be trivially copyable");
+
+} // namespace dipcc
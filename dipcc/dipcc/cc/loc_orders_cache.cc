@@ -0,0 +1,83 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "loc_orders_cache.h"
+
+namespace dipcc {
+
+void LocOrders::set_vocab_idxs(uint64_t encoder_id,
+                               const std::vector<int> &vocab_idxs) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (vocab_encoder_id_.load(std::memory_order_relaxed) == 0) {
+    vocab_idxs_ = vocab_idxs;
+    vocab_encoder_id_.store(encoder_id + 1, std::memory_order_release);
+  }
+}
+
+LocOrdersCache &LocOrdersCache::get_global() {
+  static LocOrdersCache cache;
+  return cache;
+}
+
+std::shared_ptr<const LocOrders> LocOrdersCache::get(const Key &key) {
+  if (!enabled()) {
+    return nullptr;
+  }
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  return it->second;
+}
+
+std::shared_ptr<const LocOrders>
+LocOrdersCache::put(const Key &key, std::shared_ptr<const LocOrders> value) {
+  size_t shard_capacity = (capacity_ + N_SHARDS - 1) / N_SHARDS;
+  if (shard_capacity == 0) {
+    return value;
+  }
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it != shard.entries.end()) {
+    return it->second;
+  }
+  if (shard.entries.size() >= shard_capacity) {
+    shard.entries.clear();
+  }
+  shard.entries.emplace(key, value);
+  return value;
+}
+
+void LocOrdersCache::set_capacity(size_t capacity) {
+  capacity_ = capacity;
+  clear();
+}
+
+size_t LocOrdersCache::size() const {
+  size_t r = 0;
+  for (const Shard &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    r += shard.entries.size();
+  }
+  return r;
+}
+
+void LocOrdersCache::clear() {
+  for (Shard &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.entries.clear();
+  }
+  hits_ = 0;
+  misses_ = 0;
+}
+
+} // namespace dipcc
@@ -0,0 +1,96 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "order.h"
+
+namespace dipcc {
+
+// The possible orders of a unit in an M-phase. They depend only on the
+// unit's neighbourhood: the units near it, and the via moves and convoys it
+// could order or support (see GameState::get_possible_orders).
+struct LocOrders {
+  std::set<Order> orders;
+
+  // The sorted vocab idxs of orders in the vocabulary of the OrdersEncoder
+  // with this id, or nullptr if not memoized for it. Thread-safe.
+  const std::vector<int> *get_vocab_idxs(uint64_t encoder_id) const {
+    return vocab_encoder_id_.load(std::memory_order_acquire) == encoder_id + 1
+               ? &vocab_idxs_
+               : nullptr;
+  }
+  // Memoize vocab_idxs for the encoder, unless they are memoized for any
+  // encoder already (processes usually have one). Thread-safe.
+  void set_vocab_idxs(uint64_t encoder_id,
+                      const std::vector<int> &vocab_idxs) const;
+
+private:
+  mutable std::mutex mutex_;
+  mutable std::atomic<uint64_t> vocab_encoder_id_{0}; // id + 1, 0 if unset
+  mutable std::vector<int> vocab_idxs_;
+};
+
+// Process-wide, thread-safe table of LocOrders keyed by neighbourhood (see
+// GameState::get_loc_orders_key), so that states anywhere in any game reuse
+// the orders of units whose surroundings they have seen before. In rollouts
+// the same local configurations recur far more often than whole boards.
+//
+// Disabled (capacity 0) by default. Once a shard of the table is full it is
+// cleared; states keep the entries they use alive.
+class LocOrdersCache {
+public:
+  using Key = std::string;
+
+  static LocOrdersCache &get_global();
+
+  // Return nullptr on a miss, or if disabled
+  std::shared_ptr<const LocOrders> get(const Key &key);
+  // Add value unless an entry for key was added meanwhile; return the entry
+  std::shared_ptr<const LocOrders> put(const Key &key,
+                                       std::shared_ptr<const LocOrders> value);
+
+  // Number of entries, approximately. 0 disables the cache. Clears it.
+  void set_capacity(size_t capacity);
+  size_t get_capacity() const { return capacity_; }
+  bool enabled() const { return capacity_ > 0; }
+
+  size_t size() const;
+  uint64_t get_hits() const { return hits_; }
+  uint64_t get_misses() const { return misses_; }
+  // Clear the entries and the stats
+  void clear();
+
+private:
+  static const size_t N_SHARDS = 64;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_map<Key, std::shared_ptr<const LocOrders>> entries;
+  };
+
+  Shard &get_shard(const Key &key) {
+    return shards_[std::hash<Key>()(key) % N_SHARDS];
+  }
+
+  std::atomic<size_t> capacity_{0};
+  std::array<Shard, N_SHARDS> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace dipcc
@@ -0,0 +1,116 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "message.h"
+#include "power_map.h"
+
+namespace dipcc {
+
+// Approximate bytes used, by component, see Game::memory_usage
+using MemoryUsage = std::map<std::string, size_t>;
+
+// Addresses of the objects already counted in a MemoryUsage, so that the
+// states and history entries shared by Game copies are counted once
+using MemorySeen = std::unordered_set<const void *>;
+
+// Heap bytes owned by a value, not counting sizeof the value itself. These
+// estimate libstdc++ node layouts and ignore allocator overhead.
+template <typename T> size_t heap_bytes(const T &) { return 0; }
+inline size_t heap_bytes(const std::string &x);
+inline size_t heap_bytes(const Message &x);
+template <typename A, typename B> size_t heap_bytes(const std::pair<A, B> &x);
+template <typename T, typename A>
+size_t heap_bytes(const std::vector<T, A> &x);
+template <typename T> size_t heap_bytes(const std::list<T> &x);
+template <typename T> size_t heap_bytes(const std::set<T> &x);
+template <typename K, typename V> size_t heap_bytes(const std::map<K, V> &x);
+template <typename K, typename V, typename H>
+size_t heap_bytes(const std::unordered_map<K, V, H> &x);
+template <typename V> size_t heap_bytes(const PowerMap<V> &x);
+
+inline size_t heap_bytes(const std::string &x) {
+  // Short strings are stored inline
+  return x.capacity() > 15 ? x.capacity() + 1 : 0;
+}
+
+inline size_t heap_bytes(const Message &x) { return heap_bytes(x.message); }
+
+template <typename A, typename B> size_t heap_bytes(const std::pair<A, B> &x) {
+  return heap_bytes(x.first) + heap_bytes(x.second);
+}
+
+template <typename Container>
+size_t heap_bytes_of_elements(const Container &x) {
+  size_t r = 0;
+  for (const auto &v : x) {
+    r += heap_bytes(v);
+  }
+  return r;
+}
+
+template <typename T, typename A>
+size_t heap_bytes(const std::vector<T, A> &x) {
+  return x.capacity() * sizeof(T) + heap_bytes_of_elements(x);
+}
+
+template <typename T> size_t heap_bytes(const std::list<T> &x) {
+  // prev and next pointers
+  return x.size() * (2 * sizeof(void *) + sizeof(T)) +
+         heap_bytes_of_elements(x);
+}
+
+template <typename T> size_t heap_bytes(const std::set<T> &x) {
+  // Red-black tree nodes: color and three pointers
+  return x.size() * (4 * sizeof(void *) + sizeof(T)) +
+         heap_bytes_of_elements(x);
+}
+
+template <typename K, typename V> size_t heap_bytes(const std::map<K, V> &x) {
+  return x.size() * (4 * sizeof(void *) + sizeof(std::pair<const K, V>)) +
+         heap_bytes_of_elements(x);
+}
+
+template <typename K, typename V, typename H>
+size_t heap_bytes(const std::unordered_map<K, V, H> &x) {
+  // Bucket array, and singly-linked nodes
+  return x.bucket_count() * sizeof(void *) +
+         x.size() * (sizeof(void *) + sizeof(std::pair<const K, V>)) +
+         heap_bytes_of_elements(x);
+}
+
+template <typename V> size_t heap_bytes(const PowerMap<V> &x) {
+  // Entries are inline. Not counting what absent entries still hold.
+  size_t r = 0;
+  for (const auto &entry : x) {
+    r += heap_bytes(entry.second);
+  }
+  return r;
+}
+
+// Add the sizeof and heap bytes of *x to usage[key], unless x was already
+// counted or is nullptr
+template <typename T>
+void add_memory_usage(MemoryUsage &usage, MemorySeen &seen,
+                      const std::string &key, const T *x) {
+  if (x != nullptr && seen.insert(x).second) {
+    usage[key] += sizeof(T) + heap_bytes(*x);
+  }
+}
+
+} // namespace dipcc
@@ -0,0 +1,161 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <stdexcept>
+
+#include "model_batcher.h"
+#include "checks.h"
+
+using namespace std;
+
+namespace dipcc {
+
+ModelBatcher::ModelBatcher(InferenceFn infer, long max_batch_size,
+                           long max_latency_us)
+    : infer_(std::move(infer)), max_batch_size_(max_batch_size),
+      max_latency_(max_latency_us) {
+  JCHECK(max_batch_size > 0, "ModelBatcher: max_batch_size must be positive");
+  thread_ = thread(&ModelBatcher::thread_fn, this);
+}
+
+ModelBatcher::ModelBatcher(shared_ptr<TorchScriptModel> model,
+                           long max_batch_size, long max_latency_us,
+                           float temperature, float top_p)
+    : ModelBatcher(
+          [model, temperature, top_p](const TensorDict &x, bool values_only) {
+            return model->forward(x, temperature, top_p, values_only);
+          },
+          max_batch_size, max_latency_us) {}
+
+ModelBatcher::~ModelBatcher() {
+  { // Locked critical section
+    unique_lock<mutex> lock(mutex_);
+    time_to_die_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+ModelFuture ModelBatcher::submit(TensorDict x, bool values_only) {
+  JCHECK(x.count("x_board_state"), "ModelBatcher: missing x_board_state");
+  auto request = make_unique<Request>();
+  request->n_rows = x.at("x_board_state").size(0);
+  request->x = std::move(x);
+  request->values_only = values_only;
+  request->arrival = chrono::steady_clock::now();
+  ModelFuture r = request->output.get_future().share();
+
+  { // Locked critical section
+    unique_lock<mutex> lock(mutex_);
+    JCHECK(!time_to_die_, "ModelBatcher: submit during destruction");
+    pending_rows_ += request->n_rows;
+    pending_.push_back(std::move(request));
+  }
+  cv_.notify_all();
+  return r;
+}
+
+void ModelBatcher::thread_fn() {
+  while (true) {
+    vector<unique_ptr<Request>> batch;
+    { // Locked critical section
+      unique_lock<mutex> lock(mutex_);
+      while (!time_to_die_ && pending_.empty()) {
+        cv_.wait(lock);
+      }
+      if (time_to_die_) {
+        break;
+      }
+      // Wait for the batch to fill up, unless dying
+      cv_.wait_until(lock, pending_.front()->arrival + max_latency_, [&] {
+        return time_to_die_ || pending_rows_ >= max_batch_size_;
+      });
+      if (time_to_die_) {
+        break;
+      }
+      batch = take_batch();
+    }
+    run_batch(batch);
+  }
+
+  // Requests pending at destruction are failed rather than run: the model
+  // may need a lock that the destroying thread holds, e.g. Python's GIL
+  auto error = make_exception_ptr(
+      runtime_error("ModelBatcher: destroyed with the request pending"));
+  unique_lock<mutex> lock(mutex_);
+  for (auto &r : pending_) {
+    r->output.set_exception(error);
+  }
+  pending_.clear();
+  pending_rows_ = 0;
+}
+
+vector<unique_ptr<ModelBatcher::Request>> ModelBatcher::take_batch() {
+  vector<unique_ptr<Request>> batch;
+  long n_rows = 0;
+  bool values_only = pending_.front()->values_only;
+  for (auto it = pending_.begin(); it != pending_.end();) {
+    Request &r = **it;
+    if (r.values_only != values_only ||
+        (!batch.empty() && n_rows + r.n_rows > max_batch_size_)) {
+      ++it;
+      continue;
+    }
+    n_rows += r.n_rows;
+    pending_rows_ -= r.n_rows;
+    batch.push_back(std::move(*it));
+    it = pending_.erase(it);
+  }
+  return batch;
+}
+
+void ModelBatcher::run_batch(vector<unique_ptr<Request>> &batch) {
+  vector<ModelOutput> outputs(batch.size());
+  try {
+    TensorDict x;
+    if (batch.size() == 1) {
+      x = batch[0]->x;
+    } else {
+      // CSR prev state deltas don't concatenate: expand them
+      for (auto &r : batch) {
+        expand_prev_state_delta(r->x);
+      }
+      for (auto &it : batch[0]->x) {
+        vector<torch::Tensor> parts;
+        for (auto &r : batch) {
+          parts.push_back(r->x.at(it.first));
+        }
+        x[it.first] = torch::cat(parts);
+      }
+    }
+
+    ModelOutput y = infer_(x, batch[0]->values_only);
+
+    long offset = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      long n_rows = batch[i]->n_rows;
+      if (y.order_idxs.defined()) {
+        outputs[i].order_idxs = y.order_idxs.narrow(0, offset, n_rows);
+      }
+      if (y.values.defined()) {
+        outputs[i].values = y.values.narrow(0, offset, n_rows);
+      }
+      offset += n_rows;
+    }
+  } catch (...) {
+    for (auto &r : batch) {
+      r->output.set_exception(current_exception());
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch[i]->output.set_value(std::move(outputs[i]));
+  }
+}
+
+} // namespace dipcc
@@ -0,0 +1,97 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "data_fields.h"
+#include "rollouts.h"
+#include "torchscript_model.h"
+
+namespace dipcc {
+
+// Runs a model on a batch of encode_inputs_multi inputs
+using InferenceFn =
+    std::function<ModelOutput(const TensorDict &x, bool values_only)>;
+
+using ModelFuture = std::shared_future<ModelOutput>;
+
+// Queue of model requests from any number of threads, e.g. concurrent
+// searches or run_rollouts, coalesced into single model calls by a worker
+// thread. A batch is run once the pending requests add up to max_batch_size
+// rows, or once the oldest one has waited max_latency_us. Requests are not
+// split, so a batch may exceed max_batch_size if a single request does.
+// Policy and values_only requests are batched separately.
+//
+// Destruction waits for the batch being run, if any, and fails the requests
+// still pending with an exception.
+class ModelBatcher {
+public:
+  ModelBatcher(InferenceFn infer, long max_batch_size, long max_latency_us);
+  ModelBatcher(std::shared_ptr<TorchScriptModel> model, long max_batch_size,
+               long max_latency_us, float temperature, float top_p);
+  ~ModelBatcher();
+
+  // Queue x, typically a single game's inputs. The future's outputs are x's
+  // rows of the batch outputs.
+  ModelFuture submit(TensorDict x, bool values_only = false);
+
+  // Blocks until x has been run
+  ModelOutput forward(const TensorDict &x, bool values_only = false) {
+    return submit(x, values_only).get();
+  }
+
+  // A rollout policy returning the model's sampled order idxs
+  RolloutPolicy as_policy() {
+    return [this](const TensorDict &x) { return forward(x).order_idxs; };
+  }
+
+  // A rollout policy also returning the values of the same model call
+  RolloutPolicyValues as_policy_values() {
+    return [this](const TensorDict &x) {
+      ModelOutput y = forward(x);
+      return std::make_pair(y.order_idxs, y.values);
+    };
+  }
+
+private:
+  struct Request {
+    TensorDict x;
+    long n_rows;
+    bool values_only;
+    std::chrono::steady_clock::time_point arrival;
+    std::promise<ModelOutput> output;
+  };
+
+  void thread_fn();
+
+  // Take the oldest pending requests that share the oldest one's
+  // values_only, up to max_batch_size_ rows. Must hold mutex_.
+  std::vector<std::unique_ptr<Request>> take_batch();
+  void run_batch(std::vector<std::unique_ptr<Request>> &batch);
+
+  InferenceFn infer_;
+  const long max_batch_size_;
+  const std::chrono::microseconds max_latency_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Request>> pending_;
+  long pending_rows_ = 0;
+  bool time_to_die_ = false;
+  std::thread thread_;
+};
+
+} // namespace dipcc
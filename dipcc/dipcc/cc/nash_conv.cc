@@ -0,0 +1,104 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <random>
+
+#include "cfr_kernels.h"
+#include "checks.h"
+#include "nash_conv.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+int sample_action(const vector<float> &ps, mt19937 &rng) {
+  if (ps.empty()) {
+    return -1;
+  }
+  float u = uniform_real_distribution<float>(0, 1)(rng);
+  int r = -1;
+  for (int i = 0; i < ps.size(); ++i) {
+    if (ps[i] > 0) {
+      r = i;
+      u -= ps[i];
+      if (u < 0) {
+        break;
+      }
+    }
+  }
+  JCHECK(r >= 0, "compute_nash_conv: strategy with no positive prob");
+  return r;
+}
+
+} // namespace
+
+NashConvResult compute_nash_conv(const vector<vector<float>> &strategies,
+                                 int n_samples, const JointValuesFn &values_fn,
+                                 int max_rows, uint64_t seed) {
+  JCHECK(strategies.size() == 7, "compute_nash_conv: expected 7 strategies");
+  JCHECK(n_samples > 0, "compute_nash_conv: n_samples must be positive");
+  mt19937 rng(seed);
+
+  NashConvResult r;
+  r.action_values.resize(7);
+  for (int p = 0; p < 7; ++p) {
+    r.action_values[p].assign(strategies[p].size(), 0);
+  }
+
+  // Rows of all samples, with the (power, action) each one evaluates
+  vector<array<int, 7>> rows;
+  vector<pair<int, int>> row_actions;
+  for (int s = 0; s < n_samples; ++s) {
+    array<int, 7> sampled;
+    for (int p = 0; p < 7; ++p) {
+      sampled[p] = sample_action(strategies[p], rng);
+    }
+    for (int p = 0; p < 7; ++p) {
+      for (int i = 0; i < strategies[p].size(); ++i) {
+        rows.push_back(sampled);
+        rows.back()[p] = i;
+        row_actions.push_back({p, i});
+      }
+    }
+  }
+
+  size_t chunk = max_rows > 0 ? max_rows : max<size_t>(rows.size(), 1);
+  for (size_t start = 0; start < rows.size(); start += chunk) {
+    size_t end = min(rows.size(), start + chunk);
+    vector<array<int, 7>> chunk_rows(rows.begin() + start, rows.begin() + end);
+    vector<array<float, 7>> values = values_fn(chunk_rows);
+    JCHECK(values.size() == chunk_rows.size(),
+           "compute_nash_conv: values_fn must return one row per joint action");
+    for (size_t j = 0; j < values.size(); ++j) {
+      auto [p, i] = row_actions[start + j];
+      r.action_values[p][i] += values[j][p];
+    }
+  }
+
+  r.nash_conv = 0;
+  for (int p = 0; p < 7; ++p) {
+    vector<float> &action_values = r.action_values[p];
+    int n = action_values.size();
+    if (n == 0) {
+      r.values[p] = r.br_values[p] = 0;
+      continue;
+    }
+    for (float &v : action_values) {
+      v /= n_samples;
+    }
+    r.values[p] =
+        cfr_kernels::dot(strategies[p].data(), action_values.data(), n);
+    r.br_values[p] = *max_element(action_values.begin(), action_values.end());
+    r.nash_conv += r.br_values[p] - r.values[p];
+  }
+  return r;
+}
+
+} // namespace dipcc
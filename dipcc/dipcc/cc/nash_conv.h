@@ -0,0 +1,44 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace dipcc {
+
+// Values for each power of a batch of joint actions, given as action
+// positions per power (-1 for powers with no actions), e.g. the averaged
+// rollout values of CFRSolver::get_joint_action_idxs rows
+using JointValuesFn = std::function<std::vector<std::array<float, 7>>(
+    const std::vector<std::array<int, 7>> &)>;
+
+struct NashConvResult {
+  float nash_conv;                   // sum of the powers' br_values - values
+  std::array<float, 7> values;       // expected value of the profile
+  std::array<float, 7> br_values;    // value of the best response
+  std::vector<std::vector<float>> action_values; // [power][action]
+};
+
+// Estimate the exploitability of the strategy profile strategies[power]
+// [action], like SearchBotAgent.compute_nash_conv: the value of every action
+// of every power is averaged over n_samples profiles sampled from the other
+// powers' strategies.
+//
+// All samples' joint actions are evaluated by values_fn in as few calls as
+// possible, of at most max_rows joint actions each (or a single call if
+// max_rows is 0), so that the rollouts of different samples and powers run
+// in the same ThreadPool batches. Profiles are sampled with an RNG seeded
+// by seed.
+NashConvResult compute_nash_conv(
+    const std::vector<std::vector<float>> &strategies, int n_samples,
+    const JointValuesFn &values_fn, int max_rows, uint64_t seed);
+
+} // namespace dipcc
@@ -0,0 +1,106 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "numa.h"
+
+using namespace std;
+
+namespace dipcc {
+
+vector<int> parse_cpu_list(const string &s) {
+  vector<int> r;
+  stringstream ss(s);
+  string range;
+  while (getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    size_t dash = range.find('-');
+    int first = stoi(range.substr(0, dash));
+    int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      r.push_back(cpu);
+    }
+  }
+  return r;
+}
+
+#ifdef __linux__
+
+vector<vector<int>> get_numa_node_cpus() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool have_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  auto is_allowed = [&](int cpu) {
+    return !have_allowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed));
+  };
+
+  vector<vector<int>> r;
+  for (int node = 0;; ++node) {
+    ifstream f("/sys/devices/system/node/node" + to_string(node) +
+               "/cpulist");
+    if (!f) {
+      break;
+    }
+    string cpulist;
+    getline(f, cpulist);
+    vector<int> cpus;
+    for (int cpu : parse_cpu_list(cpulist)) {
+      if (is_allowed(cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      r.push_back(cpus);
+    }
+  }
+
+  if (r.empty()) {
+    // No sysfs topology: one node of all allowed CPUs
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (have_allowed ? CPU_ISSET(cpu, &allowed)
+                       : cpu < thread::hardware_concurrency()) {
+        cpus.push_back(cpu);
+      }
+    }
+    r.push_back(cpus);
+  }
+  return r;
+}
+
+bool pin_current_thread(int cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+#else
+
+vector<vector<int>> get_numa_node_cpus() {
+  vector<int> cpus;
+  for (int cpu = 0; cpu < thread::hardware_concurrency(); ++cpu) {
+    cpus.push_back(cpu);
+  }
+  return {cpus};
+}
+
+bool pin_current_thread(int) { return false; }
+
+#endif
+
+} // namespace dipcc
@@ -0,0 +1,26 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace dipcc {
+
+// Parse a Linux cpulist, e.g. "0-3,8,10-11"
+std::vector<int> parse_cpu_list(const std::string &s);
+
+// Return the CPUs of each NUMA node that this process is allowed to run on,
+// read from /sys/devices/system/node. Nodes without such CPUs are omitted. If
+// the topology is not available, return a single node.
+std::vector<std::vector<int>> get_numa_node_cpus();
+
+// Pin the calling thread to the given CPU. Return false on failure.
+bool pin_current_thread(int cpu);
+
+} // namespace dipcc
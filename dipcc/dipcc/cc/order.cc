@@ -5,8 +5,10 @@ This source code is licensed under the MIT license found in the
 LICENSE file in the root directory of this source tree.
 */
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 
 #include "checks.h"
 #include "loc.h"
@@ -31,40 +33,76 @@ Order::Order(Unit unit, OrderType type, Loc dest)
 Order::Order(Unit unit, OrderType type, Loc dest, bool via)
     : unit_(unit), type_(type), dest_(dest), via_(via) {}
 
-Loc loc_from_str_throws(const std::string &s) {
-  Loc loc = loc_from_str(s);
+namespace {
+
+[[noreturn]] void throw_parse_error(std::string_view s) {
+  throw std::invalid_argument("Can't parse order: " + std::string(s));
+}
+
+inline void check_parse(bool b, std::string_view s) {
+  if (!b) {
+    throw_parse_error(s);
+  }
+}
+
+// Parse a unit type char, advancing i
+UnitType parse_unit_type(std::string_view s, size_t &i) {
+  check_parse(i < s.size() && (s[i] == 'A' || s[i] == 'F'), s);
+  return s[i++] == 'A' ? UnitType::ARMY : UnitType::FLEET;
+}
+
+// Parse a loc with or without coast, advancing i
+Loc parse_loc(std::string_view s, size_t &i) {
+  size_t len = i + 3 < s.size() && s[i + 3] == '/' ? 6 : 3;
+  check_parse(i + len <= s.size(), s);
+  Loc loc = loc_from_str(s.substr(i, len));
   if (loc == Loc::NONE) {
-    throw std::invalid_argument("Bad loc_from_str: " + s);
+    throw std::invalid_argument("Bad loc_from_str: " +
+                                std::string(s.substr(i, len)));
   }
+  i += len;
   return loc;
 }
 
-void check_throws(bool b, const std::string &msg) {
-  if (!b) {
-    throw std::invalid_argument(msg);
-  }
+inline void expect(std::string_view s, size_t &i, std::string_view token) {
+  check_parse(s.substr(i, token.size()) == token, s);
+  i += token.size();
 }
 
-Order::Order(const std::string &s) {
-  check_throws(s.size() >= 7, "Can't parse order: " + s);
-  size_t i = 0;
+inline char *append(char *p, std::string_view s) {
+  memcpy(p, s.data(), s.size());
+  return p + s.size();
+}
 
-  // Unit type
-  check_throws(s[i] == 'A' || s[i] == 'F', "Can't parse order: " + s);
-  unit_.type = s[i++] == 'A' ? UnitType::ARMY : UnitType::FLEET;
-  check_throws(s[i++] == ' ', "Can't parse order: " + s);
+inline char *append_loc(char *p, Loc loc) {
+  return append(p, LOC_STRS[static_cast<size_t>(loc)]);
+}
 
-  // Unit loc
-  if (s[i + 3] == '/') {
-    unit_.loc = loc_from_str_throws(s.substr(i, 6));
-    i += 6;
-  } else {
-    unit_.loc = loc_from_str_throws(s.substr(i, 3));
-    i += 3;
+char *append_unit(char *p, Unit unit) {
+  if (unit.type == UnitType::NONE) {
+    JFAIL("Called NONE Unit to_string, Loc=" + loc_str(unit.loc));
+  }
+  if (unit.loc == Loc::NONE) {
+    JFAIL("Called NONE Unit to_string");
   }
-  check_throws(s[i++] == ' ', "Can't parse order: " + s);
+  *p++ = unit.type == UnitType::ARMY ? 'A' : 'F';
+  *p++ = ' ';
+  return append_loc(p, unit.loc);
+}
+
+} // namespace
+
+Order::Order(std::string_view s) {
+  size_t i = 0;
+
+  // Unit
+  unit_.type = parse_unit_type(s, i);
+  expect(s, i, " ");
+  unit_.loc = parse_loc(s, i);
+  expect(s, i, " ");
 
   // Order type
+  check_parse(i < s.size(), s);
   char order_type = s[i++];
 
   if (order_type == 'H' || order_type == 'B' || order_type == 'D') {
@@ -75,85 +113,45 @@ Order::Order(const std::string &s) {
     } else {
       type_ = OrderType::D;
     }
-    check_throws(i == s.size(), "Can't parse order: " + s);
+    check_parse(i == s.size(), s);
     return;
   }
 
-  if (order_type == 'D') {
-    // Disband
-    type_ = OrderType::D;
-    check_throws(i == s.size(), "Can't parse order: " + s);
-    return;
-  }
-
-  check_throws(s[i++] == ' ', "Can't parse order: " + s);
+  expect(s, i, " ");
 
   if (order_type == '-' || order_type == 'R') {
     // Move
     type_ = order_type == '-' ? OrderType::M : OrderType::R;
-
-    // Move dest
-    if (s[i + 3] == '/') {
-      dest_ = loc_from_str_throws(s.substr(i, 6));
-      i += 6;
-    } else {
-      dest_ = loc_from_str_throws(s.substr(i, 3));
-      i += 3;
-    }
+    dest_ = parse_loc(s, i);
 
     // maybe via?
     if (order_type == '-' && i != s.size()) {
-      check_throws(i + 4 == s.size(), "Can't parse order: " + s);
-      check_throws(s.substr(i) == " VIA", "Can't parse order: " + s);
+      check_parse(s.substr(i) == " VIA", s);
       via_ = true;
     }
     return;
   }
 
   // Could be SM, SH, or C
+  check_parse(order_type == 'S' || order_type == 'C', s);
 
   // Target unit
-  check_throws(s[i] == 'A' || s[i] == 'F', "Can't parse order: " + s);
-  target_.type = s[i++] == 'A' ? UnitType::ARMY : UnitType::FLEET;
-  check_throws(s[i++] == ' ', "Can't parse order: " + s);
-
-  // Target loc
-  if (s[i + 3] == '/') {
-    target_.loc = loc_from_str_throws(s.substr(i, 6));
-    i += 6;
-  } else {
-    target_.loc = loc_from_str_throws(s.substr(i, 3));
-    i += 3;
-  }
+  target_.type = parse_unit_type(s, i);
+  expect(s, i, " ");
+  target_.loc = parse_loc(s, i);
 
   // Support hold - done parsing
   if (i == s.size()) {
-    check_throws(order_type == 'S', "Can't parse order: " + s);
+    check_parse(order_type == 'S', s);
     type_ = OrderType::SH;
     return;
   }
-  check_throws(s[i++] == ' ', "Can't parse order: " + s);
-  check_throws(s[i++] == '-', "Can't parse order: " + s);
-  check_throws(s[i++] == ' ', "Can't parse order: " + s);
+  expect(s, i, " - ");
 
-  // Could be SM or C - parse dest
-  if (s[i + 3] == '/') {
-    dest_ = loc_from_str_throws(s.substr(i, 6));
-    i += 6;
-  } else {
-    dest_ = loc_from_str_throws(s.substr(i, 3));
-    i += 3;
-  }
-
-  // We should be done now
-  check_throws(i == s.size(), "Can't parse order: " + s);
-  if (order_type == 'C') {
-    type_ = OrderType::C;
-  } else if (order_type == 'S') {
-    type_ = OrderType::SM;
-  } else {
-    check_throws(false, "Can't parse order: " + s);
-  }
+  // SM or C dest. We should be done now.
+  dest_ = parse_loc(s, i);
+  check_parse(i == s.size(), s);
+  type_ = order_type == 'C' ? OrderType::C : OrderType::SM;
 }
 
 std::tuple<UnitType, Loc, OrderType, UnitType, Loc, Loc, bool>
@@ -162,67 +160,89 @@ Order::to_tuple() const {
                   dest_, via_);
 }
 
-std::string Order::to_string() const {
-  std::string s;
-  s += unit_.to_string();
+size_t Order::format(char *buf) const {
+  char *p = append_unit(buf, unit_);
 
   switch (type_) {
   case OrderType::H: {
-    s += " H";
-    return s;
+    p = append(p, " H");
+    break;
   }
   case OrderType::B: {
-    s += " B";
-    return s;
+    p = append(p, " B");
+    break;
   }
   case OrderType::D: {
-    s += " D";
-    return s;
+    p = append(p, " D");
+    break;
   }
   case OrderType::M: {
-    s += " - ";
-    s += loc_str(dest_);
+    p = append(p, " - ");
+    p = append_loc(p, dest_);
     if (via_) {
-      s += " VIA";
+      p = append(p, " VIA");
     }
-    return s;
+    break;
   }
   case OrderType::R: {
-    s += " R ";
-    s += loc_str(dest_);
-    return s;
+    p = append(p, " R ");
+    p = append_loc(p, dest_);
+    break;
   }
   case OrderType::SH: {
-    s += " S ";
-    s += target_.to_string();
-    return s;
+    p = append(p, " S ");
+    p = append_unit(p, target_);
+    break;
   }
   case OrderType::SM: {
-    s += " S ";
-    s += target_.to_string();
-    s += " - ";
-    s += loc_str(dest_);
-    return s;
+    p = append(p, " S ");
+    p = append_unit(p, target_);
+    p = append(p, " - ");
+    p = append_loc(p, dest_);
+    break;
   }
   case OrderType::C: {
-    s += " C ";
-    s += target_.to_string();
-    s += " - ";
-    s += loc_str(dest_);
-    return s;
+    p = append(p, " C ");
+    p = append_unit(p, target_);
+    p = append(p, " - ");
+    p = append_loc(p, dest_);
+    break;
   }
   default: {
     JFAIL("Bad order type: " + std::to_string(static_cast<int>(type_)));
   }
   }
+  return p - buf;
+}
+
+const std::string &Order::to_string() const {
+  // The set of distinct orders is small, so each thread keeps the string of
+  // every order it has formatted
+  thread_local std::unordered_map<OrderId, std::string> cache;
+
+  OrderId id = get_id();
+  auto it = cache.find(id);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  char buf[MAX_STR_LEN];
+  size_t len = format(buf);
+  return cache.emplace(id, std::string(buf, len)).first->second;
+}
+
+Order Order::from_id(OrderId id) {
+  return Order(Unit(static_cast<UnitType>((id >> 28) & 0x3),
+                    static_cast<Loc>((id >> 21) & 0x7f)),
+               static_cast<OrderType>((id >> 17) & 0xf),
+               Unit(static_cast<UnitType>((id >> 15) & 0x3),
+                    static_cast<Loc>((id >> 8) & 0x7f)),
+               static_cast<Loc>((id >> 1) & 0x7f), id & 1);
 }
 
-bool Order::operator==(const Order &other) const {
-  return this->get_unit() == other.get_unit() &&
-         this->get_type() == other.get_type() &&
-         this->get_target() == other.get_target() &&
-         this->get_dest() == other.get_dest() &&
-         this->get_via() == other.get_via();
+Order Order::without_coasts() const {
+  return Order(Unit(unit_.type, root_loc(unit_.loc)), type_,
+               Unit(target_.type, root_loc(target_.loc)), root_loc(dest_),
+               via_);
 }
 
 std::ostream &operator<<(std::ostream &os, const Order &x) {
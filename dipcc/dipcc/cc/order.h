@@ -7,7 +7,10 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <cstdint>
 #include <glog/logging.h>
+#include <string>
+#include <string_view>
 #include <tuple>
 
 #include "enums.h"
@@ -17,6 +20,10 @@ LICENSE file in the root directory of this source tree.
 
 namespace dipcc {
 
+// Integer encoding of an Order: all fields packed into 30 bits, ordered the
+// same as Order::to_tuple(). Round-trips through Order::from_id().
+using OrderId = uint32_t;
+
 class Order {
 public:
   // Constructors
@@ -29,7 +36,7 @@ public:
         bool via = false);
   Order(Unit unit, OrderType type, Loc dest);
   Order(Unit unit, OrderType type, Loc dest, bool via);
-  Order(const std::string &s);
+  Order(std::string_view s); // throws std::invalid_argument
 
   // Getters
   Unit get_unit() const { return unit_; }
@@ -38,21 +45,43 @@ public:
   Loc get_dest() const { return dest_; }
   bool get_via() const { return via_; }
 
-  // Convert to order string
-  std::string to_string() const;
+  // Convert to order string. Strings are cached per thread, so repeated
+  // calls cost a hash lookup; the reference is valid for the thread's life.
+  const std::string &to_string() const;
+
+  // Write the order string into buf, which must hold MAX_STR_LEN chars, and
+  // return its length. Does not allocate.
+  static constexpr size_t MAX_STR_LEN = 32;
+  size_t format(char *buf) const;
 
   // Return a copy of this order with via set explicitly
   Order with_via(bool via) const;
 
+  // Packed integer id, and its inverse
+  OrderId get_id() const {
+    return (static_cast<OrderId>(unit_.type) << 28) |
+           (static_cast<OrderId>(unit_.loc) << 21) |
+           (static_cast<OrderId>(type_) << 17) |
+           (static_cast<OrderId>(target_.type) << 15) |
+           (static_cast<OrderId>(target_.loc) << 8) |
+           (static_cast<OrderId>(dest_) << 1) | static_cast<OrderId>(via_);
+  }
+  static Order from_id(OrderId id);
+
+  // Return a copy of this order with all locs replaced by their root locs
+  Order without_coasts() const;
+
   // Comparator (to enable use as set/map key)
   std::tuple<UnitType, Loc, OrderType, UnitType, Loc, Loc, bool>
   to_tuple() const;
   bool operator<(const Order &other) const {
-    return this->to_tuple() < other.to_tuple();
+    return this->get_id() < other.get_id();
   }
 
   // Equality comparator
-  bool operator==(const Order &other) const;
+  bool operator==(const Order &other) const {
+    return this->get_id() == other.get_id();
+  }
 
   // Print operator
   friend std::ostream &operator<<(std::ostream &os, const Order &);
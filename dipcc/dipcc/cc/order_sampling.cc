@@ -0,0 +1,270 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "checks.h"
+#include "hash.h"
+#include "order_sampling.h"
+#include "orders_encoder.h"
+
+using namespace std;
+using torch::indexing::Slice;
+
+namespace dipcc {
+
+namespace {
+
+const long EOS_IDX = OrdersEncoder::EOS_IDX;
+
+// log(sum(exp(logits))) over the valid candidates of a step
+float log_sum_exp(const float *logits, const long *cands, int C) {
+  float max_logit = -INFINITY;
+  for (int c = 0; c < C; ++c) {
+    if (cands[c] != EOS_IDX) {
+      max_logit = max(max_logit, logits[c]);
+    }
+  }
+  float sum = 0;
+  for (int c = 0; c < C; ++c) {
+    if (cands[c] != EOS_IDX) {
+      sum += exp(logits[c] - max_logit);
+    }
+  }
+  return max_logit + log(sum);
+}
+
+// Sample a position among weights, which sum to total
+int sample_weighted(const vector<pair<int, float>> &weights, float total,
+                    mt19937 &rng) {
+  float x = uniform_real_distribution<float>(0, total)(rng);
+  for (auto &[c, w] : weights) {
+    if (x < w) {
+      return c;
+    }
+    x -= w;
+  }
+  return weights.back().first; // float rounding
+}
+
+// Sample the candidate position of one step
+int sample_step(const float *logits, const long *cands, int C,
+                float temperature, float top_p, mt19937 &rng) {
+  vector<pair<int, float>> valid; // (position, logit)
+  for (int c = 0; c < C; ++c) {
+    if (cands[c] != EOS_IDX) {
+      valid.push_back({c, logits[c]});
+    }
+  }
+  if (valid.empty()) {
+    return -1;
+  }
+  sort(valid.begin(), valid.end(),
+       [](auto &a, auto &b) { return a.second > b.second; });
+  if (temperature <= 0) {
+    return valid[0].first;
+  }
+
+  // Keep the most likely candidates until their mass exceeds top_p
+  float max_logit = valid[0].second;
+  if (top_p < 1) {
+    float sum = 0;
+    for (auto &v : valid) {
+      sum += exp(v.second - max_logit);
+    }
+    float cum = 0;
+    size_t n_keep = 0;
+    while (n_keep < valid.size() && cum <= top_p) {
+      cum += exp(valid[n_keep++].second - max_logit) / sum;
+    }
+    valid.resize(n_keep);
+  }
+
+  float total = 0;
+  for (auto &v : valid) {
+    v.second = exp((v.second - max_logit) / temperature);
+    total += v.second;
+  }
+  return sample_weighted(valid, total, rng);
+}
+
+// Sample n distinct candidate positions of one step without replacement, or
+// as many as there are valid candidates. Returns them in sampling order.
+vector<int> sample_distinct(const float *logits, const long *cands, int C,
+                            int n, mt19937 &rng) {
+  float lse = log_sum_exp(logits, cands, C);
+  vector<pair<int, float>> valid; // (position, prob)
+  for (int c = 0; c < C; ++c) {
+    if (cands[c] != EOS_IDX) {
+      valid.push_back({c, exp(logits[c] - lse)});
+    }
+  }
+
+  vector<int> r;
+  while (r.size() < n && !valid.empty()) {
+    float total = 0;
+    for (auto &v : valid) {
+      total += v.second;
+    }
+    int c;
+    if (total > 0) {
+      c = sample_weighted(valid, total, rng);
+    } else {
+      // Spiky logits leave only zero probs: sample uniformly
+      c = valid[uniform_int_distribution<size_t>(0, valid.size() - 1)(rng)]
+              .first;
+    }
+    r.push_back(c);
+    valid.erase(find_if(valid.begin(), valid.end(),
+                        [c](auto &v) { return v.first == c; }));
+  }
+  return r;
+}
+
+} // namespace
+
+uint64_t hash_power_orders(const long *order_idxs, int max_seq_len) {
+  vector<long> idxs;
+  for (int i = 0; i < max_seq_len; ++i) {
+    if (order_idxs[i] != EOS_IDX) {
+      idxs.push_back(order_idxs[i]);
+    }
+  }
+  sort(idxs.begin(), idxs.end());
+  size_t r = 0;
+  for (long idx : idxs) {
+    hash_combine(r, idx);
+  }
+  return r;
+}
+
+SampledOrders sample_orders(const torch::Tensor &logits,
+                            const torch::Tensor &x_possible_actions,
+                            const torch::Tensor &x_in_adj_phase,
+                            float temperature, float top_p, mt19937 &rng) {
+  JCHECK(logits.dim() == 4 && logits.sizes() == x_possible_actions.sizes(),
+         "sample_orders: logits and x_possible_actions must be [B, 7, S, C]");
+  torch::Tensor l = logits.to(torch::kFloat32).contiguous();
+  torch::Tensor cands = x_possible_actions.to(torch::kLong).contiguous();
+  torch::Tensor adj = x_in_adj_phase.to(torch::kBool).contiguous();
+  long B = l.size(0), S = l.size(2), C = l.size(3);
+  JCHECK(l.size(1) == 7 && adj.numel() == B,
+         "sample_orders: x_in_adj_phase must be [B]");
+
+  SampledOrders r;
+  r.order_idxs = torch::full({B, 7, S}, EOS_IDX, torch::kLong);
+  r.logprobs = torch::zeros({B, 7}, torch::kFloat32);
+  r.action_hashes = torch::zeros({B, 7}, torch::kLong);
+  const float *l_p = l.data_ptr<float>();
+  const long *cands_p = cands.data_ptr<long>();
+  const bool *adj_p = adj.data_ptr<bool>();
+  long *out_p = r.order_idxs.data_ptr<long>();
+  float *logprobs_p = r.logprobs.data_ptr<float>();
+  int64_t *hashes_p = r.action_hashes.data_ptr<int64_t>();
+
+  for (long i = 0; i < B * 7; ++i) {
+    const float *pl = l_p + i * S * C;
+    const long *pc = cands_p + i * S * C;
+    long *out = out_p + i * S;
+    int n_steps = 0;
+    while (n_steps < S && pc[n_steps * C] != EOS_IDX) {
+      ++n_steps;
+    }
+
+    if (adj_p[i / 7] && n_steps > 1) {
+      // Disbands: distinct candidates of step 0
+      float lse = log_sum_exp(pl, pc, C);
+      vector<int> picks = sample_distinct(pl, pc, C, n_steps, rng);
+      for (int s = 0; s < picks.size(); ++s) {
+        out[s] = pc[picks[s]];
+        logprobs_p[i] += pl[picks[s]] - lse;
+      }
+    } else {
+      for (int s = 0; s < n_steps; ++s) {
+        const float *step_l = pl + s * C;
+        const long *step_c = pc + s * C;
+        int pick = sample_step(step_l, step_c, C, temperature, top_p, rng);
+        out[s] = step_c[pick];
+        logprobs_p[i] += step_l[pick] - log_sum_exp(step_l, step_c, C);
+      }
+    }
+    hashes_p[i] = hash_power_orders(out, S);
+  }
+  return r;
+}
+
+torch::Tensor order_idxs_to_cpu(const torch::Tensor &order_idxs) {
+  if (order_idxs.device().is_cpu()) {
+    return order_idxs.to(torch::kLong).contiguous();
+  }
+  return order_idxs.to(torch::kShort)
+      .to(torch::kCPU)
+      .to(torch::kLong)
+      .contiguous();
+}
+
+void resample_duplicate_disbands(torch::Tensor order_idxs,
+                                 const torch::Tensor &logits,
+                                 const torch::Tensor &x_possible_actions,
+                                 const torch::Tensor &x_in_adj_phase,
+                                 mt19937 &rng) {
+  JCHECK(order_idxs.dim() == 3 && order_idxs.is_contiguous() &&
+             order_idxs.scalar_type() == torch::kLong &&
+             order_idxs.device().is_cpu(),
+         "resample_duplicate_disbands: order_idxs must be [B, 7, S] long on "
+         "the CPU");
+  long S = order_idxs.size(2);
+  if (S < 2) {
+    return;
+  }
+
+  // Powers with a second order in adjustment phases are disbanding
+  torch::Tensor adj = x_in_adj_phase.to(torch::kCPU, torch::kBool);
+  torch::Tensor mask = (order_idxs.index({Slice(), Slice(), 1}) != EOS_IDX) &
+                       adj.view({-1, 1});
+  torch::Tensor idxs = mask.nonzero();
+  long K = idxs.size(0);
+  if (K == 0) {
+    return;
+  }
+  torch::Tensor b = idxs.select(1, 0).contiguous();
+  torch::Tensor p = idxs.select(1, 1).contiguous();
+  torch::Tensor step0_logits =
+      logits.index({b.to(logits.device()), p.to(logits.device()), 0})
+          .to(torch::kCPU, torch::kFloat32)
+          .contiguous();
+  torch::Tensor step0_cands =
+      x_possible_actions
+          .index({b.to(x_possible_actions.device()),
+                  p.to(x_possible_actions.device()), 0})
+          .to(torch::kCPU, torch::kLong)
+          .contiguous();
+  long C = step0_cands.size(1);
+  JCHECK(step0_logits.size(1) == C,
+         "resample_duplicate_disbands: logits and x_possible_actions differ "
+         "in candidates");
+
+  long *out_p = order_idxs.data_ptr<long>();
+  const int64_t *b_p = b.data_ptr<int64_t>(), *p_p = p.data_ptr<int64_t>();
+  for (long k = 0; k < K; ++k) {
+    long *out = out_p + (b_p[k] * 7 + p_p[k]) * S;
+    int n_steps = 0;
+    while (n_steps < S && out[n_steps] != EOS_IDX) {
+      ++n_steps;
+    }
+    const long *cands = step0_cands.data_ptr<long>() + k * C;
+    vector<int> picks = sample_distinct(
+        step0_logits.data_ptr<float>() + k * C, cands, C, n_steps, rng);
+    for (int s = 0; s < n_steps; ++s) {
+      out[s] = s < picks.size() ? cands[picks[s]] : EOS_IDX;
+    }
+  }
+}
+
+} // namespace dipcc
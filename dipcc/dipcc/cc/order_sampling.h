@@ -0,0 +1,64 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <torch/torch.h>
+
+namespace dipcc {
+
+// Orders sampled for a [B, 7] batch of powers
+struct SampledOrders {
+  torch::Tensor order_idxs;    // [B, 7, S] long, EOS_IDX-padded
+  torch::Tensor logprobs;      // [B, 7] float, summed over steps
+  torch::Tensor action_hashes; // [B, 7] long, see hash_power_orders
+};
+
+// Hash of a power's EOS_IDX-padded order idxs that ignores their order, so
+// that equal actions hash equally whatever their step order. 0 if there are
+// no orders.
+uint64_t hash_power_orders(const long *order_idxs, int max_seq_len);
+
+// Sample an order per step from the model logits [B, 7, S, C] over the
+// candidates x_possible_actions [B, 7, S, C] (EOS_IDX-padded; a step with no
+// candidates ends the power's sequence), each step independently. As in
+// DiplomacyModel's decoder, each step's logits are top-p filtered, then
+// divided by temperature; temperature 0 takes the argmax.
+//
+// In adjustment phases (x_in_adj_phase [B]), sequences of several steps are
+// disbands, and are sampled without replacement from the step 0 logits, so
+// that no unit is disbanded twice. Builds are a single compound order, so
+// are consistent by construction.
+//
+// logprobs are of the unfiltered logits, as in compute_sampled_logprobs.
+// Tensors must be on the CPU.
+SampledOrders sample_orders(const torch::Tensor &logits,
+                            const torch::Tensor &x_possible_actions,
+                            const torch::Tensor &x_in_adj_phase,
+                            float temperature, float top_p, std::mt19937 &rng);
+
+// Order idxs of any shape and integer dtype, on any device, as a contiguous
+// CPU long tensor. Idxs on a device are narrowed to int16 there before the
+// copy, which is then a quarter of the size: vocabulary idxs fit (see
+// OrdersEncoder).
+torch::Tensor order_idxs_to_cpu(const torch::Tensor &order_idxs);
+
+// Like resample_duplicate_disbands_inplace in model_sampled_agent.py, for
+// callers that need no logprobs: in adjustment phases, replace the order_idxs
+// [B, 7, S] of powers that disband several units with as many distinct
+// disbands, sampled without replacement from the step 0 logits. order_idxs
+// must be on the CPU; only the step 0 logits of those powers are copied from
+// the logits' device.
+void resample_duplicate_disbands(torch::Tensor order_idxs,
+                                 const torch::Tensor &logits,
+                                 const torch::Tensor &x_possible_actions,
+                                 const torch::Tensor &x_in_adj_phase,
+                                 std::mt19937 &rng);
+
+} // namespace dipcc
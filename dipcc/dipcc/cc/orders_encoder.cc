@@ -7,11 +7,16 @@ LICENSE file in the root directory of this source tree.
 
 #include "orders_encoder.h"
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <glog/logging.h>
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "perf_stats.h"
+
 #define P_IDX(r, w, i, j) (*((r) + ((i) * (w)) + (j)))
 
 #define PREV_ORDERS_WIDTH 100
@@ -25,10 +30,19 @@ vector<string> get_compound_build_orders(
     const unordered_map<dipcc::Loc, set<dipcc::Order>> &all_possible_orders,
     vector<Loc> orderable_locs, int n_builds);
 
+namespace {
+std::atomic<uint64_t> next_orders_encoder_id{0};
+
+// "DIPO" followed by a format version
+const uint32_t BINARY_MAGIC = 0x4f504944;
+const uint8_t BINARY_VERSION = 1;
+} // namespace
+
 // Constructor
 OrdersEncoder::OrdersEncoder(
     std::unordered_map<std::string, int> order_vocabulary_to_idx, int max_cands)
-    : order_vocabulary_to_idx_(order_vocabulary_to_idx), max_cands_(max_cands) {
+    : order_vocabulary_to_idx_(order_vocabulary_to_idx), max_cands_(max_cands),
+      id_(next_orders_encoder_id++) {
 
   // init order_vocabulary_
   int max_idx = 0;
@@ -37,37 +51,270 @@ OrdersEncoder::OrdersEncoder(
       max_idx = p.second;
     }
   }
+  // Sampled idxs are copied from the device as int16, see order_idxs_to_cpu
+  JCHECK(max_idx <= INT16_MAX, "OrdersEncoder: vocabulary too large");
   order_vocabulary_.resize(max_idx + 1);
   for (auto &p : order_vocabulary_to_idx_) {
     order_vocabulary_[p.second] = p.first;
   }
+
+  // init order_vocabulary_orders_, splitting compound build orders
+  order_vocabulary_orders_.resize(max_idx + 1);
+  for (auto &p : order_vocabulary_to_idx_) {
+    try {
+      for (size_t start = 0, end = 0; end != string::npos; start = end + 1) {
+        end = p.first.find(';', start);
+        order_vocabulary_orders_[p.second].push_back(
+            Order(p.first.substr(start, end - start)));
+      }
+    } catch (const std::invalid_argument &) {
+      order_vocabulary_orders_[p.second].clear();
+    }
+  }
+
+  init_order_idx_table();
+  init_build_order_idxs();
+}
+
+void OrdersEncoder::init_order_idx_table() {
+  vector<pair<Order, int>> orders;
+  for (auto &p : order_vocabulary_to_idx_) {
+    if (p.first.find(';') != string::npos) {
+      continue; // compound build order
+    }
+    try {
+      Order order(p.first);
+      if (order.to_string() == p.first) {
+        orders.push_back({order, p.second});
+      }
+    } catch (const std::invalid_argument &) {
+      LOG(WARNING) << "Can't parse vocabulary order: " << p.first;
+    }
+  }
+
+  // Add every coast-specific order that strips to a vocab order, after the
+  // vocab orders themselves so that exact matches take precedence
+  vector<OrderIdxSlot> slots;
+  for (auto & [ order, idx ] : orders) {
+    slots.push_back({order.get_id(), idx, true});
+  }
+  const vector<Loc> no_loc{Loc::NONE};
+  auto coasts = [&](Loc loc) -> const vector<Loc> & {
+    return loc == Loc::NONE ? no_loc : expand_coasts(loc);
+  };
+  for (auto & [ order, idx ] : orders) {
+    if (!(order.without_coasts() == order)) {
+      continue;
+    }
+    Unit unit = order.get_unit();
+    Unit target = order.get_target();
+    for (Loc unit_loc : coasts(unit.loc)) {
+      for (Loc target_loc : coasts(target.loc)) {
+        for (Loc dest : coasts(order.get_dest())) {
+          Order variant({unit.type, unit_loc}, order.get_type(),
+                        {target.type, target_loc}, dest, order.get_via());
+          slots.push_back({variant.get_id(), idx, false});
+        }
+      }
+    }
+  }
+
+  // Load factor of at most 1/2
+  size_t capacity = 16;
+  while (capacity < 2 * slots.size()) {
+    capacity *= 2;
+  }
+  order_idx_table_.assign(capacity, {EMPTY_ORDER_ID, -1, false});
+  order_idx_table_mask_ = capacity - 1;
+  for (const OrderIdxSlot &slot : slots) {
+    OrderIdxSlot &dst = order_idx_table_[find_order_idx_slot(slot.id)];
+    if (dst.id == EMPTY_ORDER_ID) {
+      dst = slot;
+    }
+  }
+}
+
+size_t OrdersEncoder::find_order_idx_slot(OrderId id) const {
+  size_t i = (static_cast<uint64_t>(id) * 0x9e3779b97f4a7c15ULL) >> 40;
+  while (true) {
+    i &= order_idx_table_mask_;
+    const OrderIdxSlot &slot = order_idx_table_[i];
+    if (slot.id == id || slot.id == EMPTY_ORDER_ID) {
+      return i;
+    }
+    ++i;
+  }
+}
+
+// Build orders depend only on which home centers are free, so precompute the
+// compound build order idxs for every subset of each power's home centers
+void OrdersEncoder::init_build_order_idxs() {
+  for (Power power : POWERS) {
+    const vector<Loc> &homes = home_centers(power);
+    for (uint32_t mask = 1; mask < (1u << homes.size()); ++mask) {
+      unordered_map<Loc, set<Order>> all_possible_orders;
+      vector<Loc> orderable_locs;
+      for (int i = 0; i < homes.size(); ++i) {
+        if (mask & (1u << i)) {
+          orderable_locs.push_back(homes[i]);
+        }
+      }
+      for (Loc center : home_centers_army(power)) {
+        all_possible_orders[center].insert(
+            Order({UnitType::ARMY, center}, OrderType::B));
+      }
+      for (Loc center : home_centers_fleet(power)) {
+        all_possible_orders[center].insert(
+            Order({UnitType::FLEET, center}, OrderType::B));
+      }
+      for (Loc loc : orderable_locs) {
+        for (Loc cloc : expand_coasts(loc)) {
+          all_possible_orders[cloc]; // build orders may be empty, e.g. STP/NC
+        }
+      }
+
+      for (int n_builds = 1; n_builds <= orderable_locs.size(); ++n_builds) {
+        vector<int> order_idxs;
+        bool in_vocab = true;
+        for (const string &order : get_compound_build_orders(
+                 all_possible_orders, orderable_locs, n_builds)) {
+          auto it = order_vocabulary_to_idx_.find(order);
+          if (it == order_vocabulary_to_idx_.end()) {
+            in_vocab = false;
+            break;
+          }
+          order_idxs.push_back(it->second);
+        }
+        if (in_vocab) {
+          sort(order_idxs.begin(), order_idxs.end());
+          build_order_idxs_[build_order_key(power, mask, n_builds)] =
+              move(order_idxs);
+        }
+      }
+    }
+  }
+}
+
+string OrdersEncoder::to_bytes() const {
+  BinaryWriter writer;
+  writer.write_u32(BINARY_MAGIC);
+  writer.write_u8(BINARY_VERSION);
+  writer.write_varint(max_cands_);
+
+  // Vocab orders by idx, empty for unused idxs, with their parsed orders
+  writer.write_varint(order_vocabulary_.size());
+  for (size_t i = 0; i < order_vocabulary_.size(); ++i) {
+    writer.write_string(order_vocabulary_[i]);
+    writer.write_varint(order_vocabulary_orders_[i].size());
+    for (const Order &order : order_vocabulary_orders_[i]) {
+      writer.write_u32(order.get_id());
+    }
+  }
+
+  writer.write_varint(order_idx_table_.size());
+  for (const OrderIdxSlot &slot : order_idx_table_) {
+    writer.write_u32(slot.id);
+    writer.write_u32(static_cast<uint32_t>(slot.idx));
+    writer.write_u8(slot.exact);
+  }
+
+  // in key order, so that equal encoders give equal bytes
+  map<uint32_t, const vector<int> *> build_order_idxs;
+  for (auto & [ key, order_idxs ] : build_order_idxs_) {
+    build_order_idxs[key] = &order_idxs;
+  }
+  writer.write_varint(build_order_idxs.size());
+  for (auto & [ key, order_idxs ] : build_order_idxs) {
+    writer.write_u32(key);
+    writer.write_varint(order_idxs->size());
+    for (int idx : *order_idxs) {
+      writer.write_varint(idx);
+    }
+  }
+
+  return std::move(writer.get());
+}
+
+OrdersEncoder OrdersEncoder::from_bytes(std::string_view data) {
+  BinaryReader reader(data);
+  return OrdersEncoder(reader);
+}
+
+OrdersEncoder::OrdersEncoder(BinaryReader &reader)
+    : id_(next_orders_encoder_id++) {
+  JCHECK(reader.read_u32() == BINARY_MAGIC,
+         "OrdersEncoder::from_bytes bad magic");
+  uint8_t version = reader.read_u8();
+  JCHECK(version == BINARY_VERSION,
+         "OrdersEncoder::from_bytes unsupported version: " +
+             std::to_string(version));
+  max_cands_ = reader.read_varint();
+
+  size_t vocab_size = reader.read_varint();
+  JCHECK(vocab_size <= static_cast<size_t>(INT16_MAX) + 1,
+         "OrdersEncoder::from_bytes vocabulary too large");
+  order_vocabulary_.resize(vocab_size);
+  order_vocabulary_orders_.resize(vocab_size);
+  order_vocabulary_to_idx_.reserve(vocab_size);
+  for (size_t i = 0; i < vocab_size; ++i) {
+    order_vocabulary_[i] = reader.read_string();
+    if (!order_vocabulary_[i].empty()) {
+      order_vocabulary_to_idx_[order_vocabulary_[i]] = i;
+    }
+    order_vocabulary_orders_[i].resize(reader.read_varint());
+    for (Order &order : order_vocabulary_orders_[i]) {
+      order = Order::from_id(reader.read_u32());
+    }
+  }
+
+  size_t capacity = reader.read_varint();
+  JCHECK(capacity > 0 && (capacity & (capacity - 1)) == 0,
+         "OrdersEncoder::from_bytes bad table size");
+  order_idx_table_.resize(capacity);
+  order_idx_table_mask_ = capacity - 1;
+  for (OrderIdxSlot &slot : order_idx_table_) {
+    slot.id = reader.read_u32();
+    slot.idx = static_cast<int32_t>(reader.read_u32());
+    slot.exact = reader.read_u8();
+  }
+
+  size_t n_build_keys = reader.read_varint();
+  for (size_t i = 0; i < n_build_keys; ++i) {
+    vector<int> &order_idxs = build_order_idxs_[reader.read_u32()];
+    order_idxs.resize(reader.read_varint());
+    for (int &idx : order_idxs) {
+      idx = reader.read_varint();
+    }
+  }
+  JCHECK(reader.at_end(), "OrdersEncoder::from_bytes trailing data");
 }
 
 void OrdersEncoder::encode_prev_orders_deepmind(Game *game, long *r) const {
+  PerfTimer perf_timer(PerfCounter::ENCODE_PREV_ORDERS);
   memset(r, 0, 2 * PREV_ORDERS_WIDTH * sizeof(long));
 
   vector<pair<int32_t, int8_t>> prev_orders;
   prev_orders.reserve(100);
 
-  for (auto it = game->get_order_history().rbegin();
-       it != game->get_order_history().rend(); ++it) {
-
-    for (auto jt : it->second) {
-      for (const Order &order : jt.second) {
-        auto x = order_vocabulary_to_idx_.find(order.to_string());
-        if (x != order_vocabulary_to_idx_.end()) {
-          int32_t order_idx = x->second;
-          int8_t loc_idx = static_cast<int>(order.get_unit().loc) - 1;
-          prev_orders.push_back(make_pair(order_idx, loc_idx));
-        }
+  // The vocab idxs of each phase's orders are memoized in the history
+  vector<int32_t> scratch;
+  auto vocab_idx = [this](const Order &order) {
+    return exact_order_index(order);
+  };
+  game->get_recent_order_history().visit_reverse([&](const auto &entry) {
+    const vector<Order> &orders = entry.second.get_all_orders();
+    const vector<int32_t> &order_idxs =
+        entry.second.get_vocab_idxs(id_, vocab_idx, scratch);
+    for (size_t i = 0; i < orders.size(); ++i) {
+      if (order_idxs[i] != -1) {
+        int8_t loc_idx = static_cast<int>(orders[i].get_unit().loc) - 1;
+        prev_orders.push_back(make_pair(order_idxs[i], loc_idx));
       }
     }
 
     // Encode up to and including the most recent movement phase
-    if (it->first.phase_type == 'M') {
-      break;
-    }
-  }
+    return entry.first.phase_type == 'M';
+  });
 
   JCHECK(prev_orders.size() < PREV_ORDERS_WIDTH,
          "prev_orders exceeds max size");
@@ -88,13 +335,25 @@ void OrdersEncoder::encode_valid_orders_all_powers(GameState &state,
                                                    int32_t *r_order_idxs,
                                                    int8_t *r_loc_idxs,
                                                    int64_t *r_powers) const {
+  visit_phase_type(state.get_phase().phase_type, [&](auto phase_type) {
+    encode_valid_orders_all_powers<decltype(phase_type)::value>(
+        state, r_order_idxs, r_loc_idxs, r_powers);
+  });
+}
+
+template <char PhaseType>
+void OrdersEncoder::encode_valid_orders_all_powers(GameState &state,
+                                                   int32_t *r_order_idxs,
+                                                   int8_t *r_loc_idxs,
+                                                   int64_t *r_powers) const {
+  PerfTimer perf_timer(PerfCounter::ENCODE_VALID_ORDERS);
   // Init return values
   memset(r_order_idxs, EOS_IDX,
          7 * N_SCS * max_cands_ * sizeof(int32_t));       // [1, 7, 34, 469]
-  memset(r_loc_idxs, EOS_IDX, 81 * sizeof(int8_t));       // [1, 81]
+  memset(r_loc_idxs, EOS_IDX, 7 * 81 * sizeof(int8_t));   // [1, 7, 81]
   memset(r_powers, EOS_IDX, 7 * N_SCS * sizeof(int64_t)); // [1, 7, 34]
 
-  if (state.get_phase().phase_type == 'A') {
+  if constexpr (PhaseType == 'A') {
     // Encode adj phase separately for each power; note we index the return
     // values for each power
     for (int i = 0; i < 7; ++i) {
@@ -127,9 +386,7 @@ void OrdersEncoder::encode_valid_orders_all_powers(GameState &state,
     // Encode outputs at each step
     for (int step = 0; step < orderable_locs.size(); ++step) {
       Loc loc = orderable_locs[step];
-      vector<int> order_idxs(
-          filter_orders_in_vocab(all_possible_orders.at(loc)));
-      sort(order_idxs.begin(), order_idxs.end());
+      const vector<int> &order_idxs = get_sorted_order_idxs(state, loc);
 
       // Encode order idxs
       for (int j = 0; j < order_idxs.size(); ++j) {
@@ -148,6 +405,33 @@ void OrdersEncoder::encode_valid_orders_all_powers(GameState &state,
   }
 } // encode_valid_orders_all_powers
 
+template void OrdersEncoder::encode_valid_orders_all_powers<'M'>(
+    GameState &, int32_t *, int8_t *, int64_t *) const;
+template void OrdersEncoder::encode_valid_orders_all_powers<'R'>(
+    GameState &, int32_t *, int8_t *, int64_t *) const;
+template void OrdersEncoder::encode_valid_orders_all_powers<'A'>(
+    GameState &, int32_t *, int8_t *, int64_t *) const;
+template void OrdersEncoder::encode_valid_orders_all_powers<'C'>(
+    GameState &, int32_t *, int8_t *, int64_t *) const;
+
+int OrdersEncoder::get_seq_len(GameState &state, bool all_powers) const {
+  bool adj_phase = state.get_phase().phase_type == 'A';
+  int r = 0;
+  for (auto & [ power, locs ] : state.get_orderable_locations()) {
+    if (locs.size() == 0) {
+      continue;
+    }
+    int n = locs.size();
+    if (adj_phase) {
+      // One compound build order, or one step per disband
+      int n_builds = state.get_n_builds(power);
+      n = n_builds > 0 ? 1 : n_builds < 0 ? -n_builds : 0;
+    }
+    r = all_powers && !adj_phase ? r + n : max(r, n);
+  }
+  return r;
+}
+
 void OrdersEncoder::encode_adj_phase(Power power, GameState &state,
                                      int32_t *r_order_idxs,
                                      int8_t *r_loc_idxs) const {
@@ -164,15 +448,31 @@ void OrdersEncoder::encode_adj_phase(Power power, GameState &state,
   if (n_builds > 0) {
     // builds phase
     n_builds = min(n_builds, static_cast<int>(orderable_locs.size()));
-    vector<string> orders(get_compound_build_orders(all_possible_orders,
-                                                    orderable_locs, n_builds));
-    vector<int> order_idxs(orders.size());
-    for (int j = 0; j < orders.size(); ++j) {
-      order_idxs[j] = order_vocabulary_to_idx_.at(orders[j]);
+    const vector<Loc> &homes = home_centers(power);
+    uint32_t homes_mask = 0;
+    for (Loc loc : orderable_locs_it->second) {
+      auto it = find(homes.begin(), homes.end(), loc);
+      JCHECK(it != homes.end(), "Build at non-home center");
+      homes_mask |= 1u << (it - homes.begin());
     }
-    sort(order_idxs.begin(), order_idxs.end());
-    for (int j = 0; j < orders.size(); ++j) {
-      P_IDX(r_order_idxs, max_cands_, 0, j) = order_idxs[j];
+
+    auto it = build_order_idxs_.find(
+        build_order_key(power, homes_mask, n_builds));
+    vector<int> order_idxs;
+    if (it == build_order_idxs_.end()) {
+      // not all combinations are in the vocabulary: fall back to lookups
+      vector<string> orders(get_compound_build_orders(
+          all_possible_orders, orderable_locs, n_builds));
+      order_idxs.resize(orders.size());
+      for (int j = 0; j < orders.size(); ++j) {
+        order_idxs[j] = order_vocabulary_to_idx_.at(orders[j]);
+      }
+      sort(order_idxs.begin(), order_idxs.end());
+    }
+    const vector<int> &sorted_idxs =
+        it == build_order_idxs_.end() ? order_idxs : it->second;
+    for (int j = 0; j < sorted_idxs.size(); ++j) {
+      P_IDX(r_order_idxs, max_cands_, 0, j) = sorted_idxs[j];
     }
     for (Loc loc : orderable_locs) {
       r_loc_idxs[static_cast<int>(root_loc(loc)) - 1] = -2;
@@ -205,6 +505,17 @@ void OrdersEncoder::encode_adj_phase(Power power, GameState &state,
 void OrdersEncoder::encode_valid_orders(Power power, GameState &state,
                                         int32_t *r_order_idxs,
                                         int8_t *r_loc_idxs) const {
+  visit_phase_type(state.get_phase().phase_type, [&](auto phase_type) {
+    encode_valid_orders<decltype(phase_type)::value>(power, state,
+                                                     r_order_idxs, r_loc_idxs);
+  });
+}
+
+template <char PhaseType>
+void OrdersEncoder::encode_valid_orders(Power power, GameState &state,
+                                        int32_t *r_order_idxs,
+                                        int8_t *r_loc_idxs) const {
+  PerfTimer perf_timer(PerfCounter::ENCODE_VALID_ORDERS);
   // Init return value: all_order_idxs
   // py::array_t<int32_t> all_order_idxs({1, MAX_SEQ_LEN, max_cands_});
   memset(r_order_idxs, EOS_IDX, MAX_SEQ_LEN * max_cands_ * sizeof(int32_t));
@@ -220,63 +531,107 @@ void OrdersEncoder::encode_valid_orders(Power power, GameState &state,
     return;
   }
 
-  // Get orderable_locs sorted by coast-specific loc idx (orderable_locs
-  // returns root_locs)
-  auto &all_possible_orders(state.get_all_possible_orders());
-  vector<Loc> orderable_locs(get_sorted_actual_orderable_locs(
-      orderable_locs_it->second, all_possible_orders));
-  if (state.get_phase().phase_type == 'A') {
+  if constexpr (PhaseType == 'A') {
     // adj phase
     encode_adj_phase(power, state, r_order_idxs, r_loc_idxs);
-    return;
   } else {
-    // move or retreat phase
+    // move or retreat phase. Get orderable_locs sorted by coast-specific loc
+    // idx (orderable_locs returns root_locs)
+    auto &all_possible_orders(state.get_all_possible_orders());
+    vector<Loc> orderable_locs(get_sorted_actual_orderable_locs(
+        orderable_locs_it->second, all_possible_orders));
     for (int i = 0; i < orderable_locs.size(); ++i) {
       Loc loc = orderable_locs[i];
-      vector<int> order_idxs(
-          filter_orders_in_vocab(all_possible_orders.at(loc)));
-      sort(order_idxs.begin(), order_idxs.end());
+      const vector<int> &order_idxs = get_sorted_order_idxs(state, loc);
       for (int j = 0; j < order_idxs.size(); ++j) {
         P_IDX(r_order_idxs, max_cands_, i, j) = order_idxs[j];
         r_loc_idxs[static_cast<int>(root_loc(loc)) - 1] = i;
       }
     }
   }
-} // namespace dipcc
+} // encode_valid_orders
+
+template void OrdersEncoder::encode_valid_orders<'M'>(Power, GameState &,
+                                                      int32_t *,
+                                                      int8_t *) const;
+template void OrdersEncoder::encode_valid_orders<'R'>(Power, GameState &,
+                                                      int32_t *,
+                                                      int8_t *) const;
+template void OrdersEncoder::encode_valid_orders<'A'>(Power, GameState &,
+                                                      int32_t *,
+                                                      int8_t *) const;
+template void OrdersEncoder::encode_valid_orders<'C'>(Power, GameState &,
+                                                      int32_t *,
+                                                      int8_t *) const;
 
 // Decode a [B, 7, S]-shape tensor of EOS_IDX-padded order idxs.
 // Returns a 3d vector of string (batch, power, orders)
 vector<vector<vector<string>>>
 OrdersEncoder::decode_order_idxs(torch::Tensor *order_idxs) const {
-  auto accessor = order_idxs->accessor<long, 3>();
-  long batch_size = accessor.size(0);
-  long max_seq_len = accessor.size(2);
+  torch::Tensor idxs = order_idxs->to(torch::kLong).contiguous();
+  long batch_size = idxs.size(0);
+  long max_seq_len = idxs.size(2);
+  const long *data = idxs.data_ptr<long>();
 
   vector<vector<vector<string>>> r(batch_size);
   for (int b = 0; b < batch_size; ++b) {
-    auto &rb = r[b];
-    rb.resize(7);
+    decode_order_idxs(data + b * 7 * max_seq_len, max_seq_len, r[b]);
+  }
 
-    for (int p = 0; p < 7; ++p) {
-      auto &rbp = rb[p];
-      rbp.reserve(max_seq_len);
+  return r;
+} // decode_order_idxs
 
-      for (int i = 0; i < max_seq_len; ++i) {
-        long order_idx = accessor[b][p][i];
-        if (order_idx == EOS_IDX) {
-          continue;
-        }
-        string order = order_vocabulary_[order_idx];
-        for (size_t start = 0, end = 0; end != string::npos; start = end + 1) {
-          end = order.find(';', start);
-          rbp.push_back(order.substr(start, end - start));
-        }
-      }
+void OrdersEncoder::decode_order_idxs(const long *order_idxs, long max_seq_len,
+                                      vector<vector<Order>> &r) const {
+  PerfTimer perf_timer(PerfCounter::DECODE_ORDER_IDXS);
+  r.resize(7);
+  for (int p = 0; p < 7; ++p) {
+    decode_power_order_idxs(order_idxs + p * max_seq_len, max_seq_len, r[p]);
+  }
+}
+
+void OrdersEncoder::decode_order_idxs(const long *order_idxs, long max_seq_len,
+                                      vector<vector<string>> &r) const {
+  PerfTimer perf_timer(PerfCounter::DECODE_ORDER_IDXS);
+  r.resize(7);
+  for (int p = 0; p < 7; ++p) {
+    decode_power_order_idxs(order_idxs + p * max_seq_len, max_seq_len, r[p]);
+  }
+}
+
+void OrdersEncoder::decode_power_order_idxs(const long *order_idxs,
+                                            long max_seq_len,
+                                            vector<Order> &r) const {
+  r.clear();
+  for (int i = 0; i < max_seq_len; ++i) {
+    long order_idx = order_idxs[i];
+    if (order_idx == EOS_IDX) {
+      continue;
     }
+    JCHECK(order_idx >= 0 && order_idx < order_vocabulary_orders_.size(),
+           "decode_order_idxs bad order idx");
+    const auto &orders = order_vocabulary_orders_[order_idx];
+    r.insert(r.end(), orders.begin(), orders.end());
   }
+}
 
-  return r;
-} // decode_order_idxs
+void OrdersEncoder::decode_power_order_idxs(const long *order_idxs,
+                                            long max_seq_len,
+                                            vector<string> &r) const {
+  r.clear();
+  r.reserve(max_seq_len);
+  for (int i = 0; i < max_seq_len; ++i) {
+    long order_idx = order_idxs[i];
+    if (order_idx == EOS_IDX) {
+      continue;
+    }
+    const string &order = order_vocabulary_[order_idx];
+    for (size_t start = 0, end = 0; end != string::npos; start = end + 1) {
+      end = order.find(';', start);
+      r.push_back(order.substr(start, end - start));
+    }
+  }
+}
 
 vector<int>
 OrdersEncoder::filter_orders_in_vocab(const set<Order> &orders) const {
@@ -293,33 +648,96 @@ OrdersEncoder::filter_orders_in_vocab(const set<Order> &orders) const {
   return idxs;
 }
 
-int OrdersEncoder::smarter_order_index(const Order &order) const {
-  string order_s(order.to_string());
-  auto it = order_vocabulary_to_idx_.find(order_s);
-  if (it != order_vocabulary_to_idx_.end()) {
-    return it->second;
-  }
-
-  // Try order with no coasts
-  string order_s_no_coasts;
-  order_s_no_coasts.reserve(order_s.size());
-  for (int i = 0; i < order_s.size();) {
-    char c = order_s[i];
-    if (c == '/') {
-      i += 3; // skip coast
-    } else {
-      order_s_no_coasts += c;
-      i += 1;
+const vector<int> &OrdersEncoder::get_sorted_order_idxs(GameState &state,
+                                                       Loc loc) const {
+  const LocOrders *loc_orders = state.get_loc_orders(loc);
+  if (loc_orders != nullptr) {
+    const vector<int> *cached = loc_orders->get_vocab_idxs(id_);
+    if (cached != nullptr) {
+      return *cached;
     }
   }
+  thread_local vector<int> order_idxs;
+  order_idxs = filter_orders_in_vocab(state.get_all_possible_orders().at(loc));
+  sort(order_idxs.begin(), order_idxs.end());
+  if (loc_orders != nullptr) {
+    loc_orders->set_vocab_idxs(id_, order_idxs);
+  }
+  return order_idxs;
+}
 
-  it = order_vocabulary_to_idx_.find(order_s_no_coasts);
-  if (it != order_vocabulary_to_idx_.end()) {
-    return it->second;
+bool OrdersEncoder::encode_power_actions(const vector<Order> &orders,
+                                         const int64_t *offsets,
+                                         const int32_t *values,
+                                         int32_t *r) const {
+  fill(r, r + MAX_SEQ_LEN, EOS_IDX);
+
+  vector<int> order_idxs;
+  bool builds = any_of(orders.begin(), orders.end(), [](const Order &order) {
+    return order.get_type() == OrderType::B;
+  });
+  if (builds) {
+    // Builds are a single ;-separated vocab order
+    vector<string> strs;
+    for (const Order &order : orders) {
+      if (order.get_type() != OrderType::B) {
+        return false;
+      }
+      strs.push_back(order.to_string());
+    }
+    sort(strs.begin(), strs.end());
+    string joined;
+    for (const string &s : strs) {
+      joined += (joined.empty() ? "" : ";") + s;
+    }
+    auto it = order_vocabulary_to_idx_.find(joined);
+    if (it == order_vocabulary_to_idx_.end()) {
+      return false;
+    }
+    order_idxs.push_back(it->second);
+  } else {
+    for (const Order &order : orders) {
+      int idx = smarter_order_index(order);
+      if (idx != -1) {
+        order_idxs.push_back(idx);
+      }
+    }
   }
 
-  // Give up
-  return -1;
+  // Sort by the location of the vocab order, i.e. in topo order
+  auto order_loc = [this](int idx) {
+    const auto &vocab_orders = order_vocabulary_orders_[idx];
+    return vocab_orders.empty() ? Loc::NONE : vocab_orders[0].get_unit().loc;
+  };
+  stable_sort(order_idxs.begin(), order_idxs.end(), [&](int a, int b) {
+    return order_loc(a) < order_loc(b);
+  });
+
+  for (int i = 0; i < order_idxs.size(); ++i) {
+    if (i >= MAX_SEQ_LEN) {
+      return false;
+    }
+    const int32_t *begin = values + offsets[i], *end = values + offsets[i + 1];
+    const int32_t *cand = find(begin, end, order_idxs[i]);
+    if (cand == end) {
+      return false;
+    }
+    r[i] = cand - begin;
+  }
+  return true;
+}
+
+int OrdersEncoder::smarter_order_index(const Order &order) const {
+  // Falls back to the order with no coasts: see init_order_idx_table
+  const OrderIdxSlot &slot =
+      order_idx_table_[find_order_idx_slot(order.get_id())];
+  return slot.id == EMPTY_ORDER_ID ? -1 : slot.idx;
+}
+
+int OrdersEncoder::exact_order_index(const Order &order) const {
+  const OrderIdxSlot &slot =
+      order_idx_table_[find_order_idx_slot(order.get_id())];
+  return slot.id != EMPTY_ORDER_ID && slot.exact ? slot.idx : -1;
 }
 
 template <typename T>
@@ -11,10 +11,12 @@ LICENSE file in the root directory of this source tree.
 #include <glog/logging.h>
 #include <map>
 #include <string>
+#include <string_view>
 #include <torch/torch.h>
 #include <unordered_map>
 #include <vector>
 
+#include "binary.h"
 #include "checks.h"
 #include "game.h"
 #include "game_state.h"
@@ -32,17 +34,38 @@ public:
   OrdersEncoder(std::unordered_map<std::string, int> order_vocabulary_to_idx,
                 int max_cands);
 
+  // Versioned binary form of the vocabulary and the lookup tables built from
+  // it. from_bytes neither parses orders nor rebuilds the tables, so it is
+  // much faster than the constructor. Encoders are immutable once built, and
+  // may be shared by several ThreadPools.
+  std::string to_bytes() const;
+  static OrdersEncoder from_bytes(std::string_view data);
+
   // Encode x_valid_orders and x_loc_idxs into pre-allocated memory pointed to
   // by r_order_idxs and r_loc_idxs. Return the sequence length.
+  void encode_valid_orders(Power power, GameState &state, int32_t *r_order_idxs,
+                           int8_t *r_loc_idxs) const;
+  // Same, for a state of the phase type (see visit_phase_type)
+  template <char PhaseType>
   void encode_valid_orders(Power power, GameState &state, int32_t *r_order_idxs,
                            int8_t *r_loc_idxs) const;
 
   // Perform "all-powers" single-sequence encoding into the tensors pointed to
   // by r_*
+  void encode_valid_orders_all_powers(GameState &state, int32_t *r_order_idxs,
+                                      int8_t *r_loc_idxs,
+                                      int64_t *r_powers) const;
+  template <char PhaseType>
   void encode_valid_orders_all_powers(GameState &state, int32_t *r_order_idxs,
                                       int8_t *r_loc_idxs,
                                       int64_t *r_powers) const;
 
+  // Return the number of steps that encode_valid_orders writes for the state,
+  // the max over powers, or that encode_valid_orders_all_powers writes if
+  // all_powers: steps beyond it are all EOS_IDX. It may overestimate but never
+  // underestimates. Computes the state's orderable locations if needed.
+  int get_seq_len(GameState &state, bool all_powers) const;
+
   // Encode x_prev_orders into pre-allocated memory pointed to by r.
   void encode_prev_orders_deepmind(Game *game, long *r) const;
 
@@ -51,12 +74,55 @@ public:
   std::vector<std::vector<std::vector<std::string>>>
   decode_order_idxs(torch::Tensor *order_idxs) const;
 
+  // Decode the [7, S]-shape EOS_IDX-padded order idxs of one game, into a
+  // vector of orders per power
+  void decode_order_idxs(const long *order_idxs, long max_seq_len,
+                         std::vector<std::vector<std::string>> &r) const;
+
+  // Same, but return Orders built straight from the vocabulary, with
+  // compound build orders split
+  void decode_order_idxs(const long *order_idxs, long max_seq_len,
+                         std::vector<std::vector<Order>> &r) const;
+
+  // Decode the EOS_IDX-padded order idxs of a single power
+  void decode_power_order_idxs(const long *order_idxs, long max_seq_len,
+                               std::vector<std::string> &r) const;
+  void decode_power_order_idxs(const long *order_idxs, long max_seq_len,
+                               std::vector<Order> &r) const;
+
+  // Encode a power's orders as dataset.py's encode_power_actions does: write
+  // to r the MAX_SEQ_LEN EOS_IDX-padded positions of the orders, sorted by
+  // location, among the candidates of their step. The candidates of step i
+  // are values[offsets[i]:offsets[i + 1]], as in the CSR
+  // x_possible_actions of ThreadPool::encode_inputs_multi_sparse. Orders not
+  // in the vocabulary are skipped; returns false if an order is not a
+  // candidate of its step.
+  bool encode_power_actions(const std::vector<Order> &orders,
+                            const int64_t *offsets, const int32_t *values,
+                            int32_t *r) const;
+
   int get_max_cands() const { return max_cands_; }
 
+  // Order strings by vocab idx; compound build orders are ';'-joined
+  const std::vector<std::string> &get_order_vocabulary() const {
+    return order_vocabulary_;
+  }
+
+  // Unique per constructed encoder (copies keep it), for keying encodings
+  uint64_t get_id() const { return id_; }
+
 private:
+  OrdersEncoder(BinaryReader &reader);
+
   // Methods
   int smarter_order_index(const Order &) const;
+  int exact_order_index(const Order &) const;
   std::vector<int> filter_orders_in_vocab(const std::set<Order> &) const;
+  // The sorted filter_orders_in_vocab of the possible orders of the unit at
+  // loc, memoized in their LocOrdersCache entry if any. Valid until the next
+  // call.
+  const std::vector<int> &get_sorted_order_idxs(GameState &state,
+                                                Loc loc) const;
   template <typename T>
   std::vector<Loc> get_sorted_actual_orderable_locs(
       const T &root_locs,
@@ -64,11 +130,36 @@ private:
           &all_possible_orders) const;
   void encode_adj_phase(Power power, GameState &state, int32_t *r_order_idxs,
                         int8_t *r_loc_idxs) const;
+  void init_order_idx_table();
+  size_t find_order_idx_slot(OrderId id) const;
+  void init_build_order_idxs();
+  static uint32_t build_order_key(Power power, uint32_t homes_mask,
+                                  int n_builds) {
+    return (static_cast<uint32_t>(power) << 16) | (homes_mask << 8) | n_builds;
+  }
 
   // Data
   std::unordered_map<std::string, int> order_vocabulary_to_idx_;
+
+  // Open-addressed OrderId -> vocab idx table of single orders. Also holds
+  // the coast-specific variants of vocab orders without coasts, marked
+  // exact = false, so smarter_order_index is a single probe.
+  struct OrderIdxSlot {
+    OrderId id;
+    int32_t idx;
+    bool exact;
+  };
+  static constexpr OrderId EMPTY_ORDER_ID = ~OrderId(0);
+  std::vector<OrderIdxSlot> order_idx_table_;
+  size_t order_idx_table_mask_;
   std::vector<std::string> order_vocabulary_;
+  std::vector<std::vector<Order>> order_vocabulary_orders_;
+
+  // (power, free home centers as a bitmask over home_centers(power),
+  // n_builds) -> sorted vocab idxs of every compound build order
+  std::unordered_map<uint32_t, std::vector<int>> build_order_idxs_;
   int max_cands_;
+  uint64_t id_;
 };
 
 } // namespace dipcc
@@ -0,0 +1,167 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+
+#include "perf_stats.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace detail {
+std::atomic<bool> perf_stats_enabled{false};
+} // namespace detail
+
+namespace {
+
+const char *PERF_COUNTER_NAMES[] = {
+    "process",
+    "load_all_possible_orders_m",
+    "load_all_possible_orders_r",
+    "load_all_possible_orders_a",
+    "encode_board_state",
+    "encode_valid_orders",
+    "encode_prev_orders",
+    "decode_order_idxs",
+    "thread_pool_queue",
+    "thread_pool_work",
+    "thread_pool_idle",
+    "thread_pool_wait",
+};
+static_assert(sizeof(PERF_COUNTER_NAMES) / sizeof(PERF_COUNTER_NAMES[0]) ==
+                  static_cast<size_t>(PerfCounter::N_COUNTERS),
+              "Missing PerfCounter name");
+
+const size_t N_COUNTERS = static_cast<size_t>(PerfCounter::N_COUNTERS);
+
+// Written only by its thread, read by get_perf_stats
+struct AtomicCounterStats {
+  atomic<uint64_t> count{0};
+  atomic<uint64_t> total_ns{0};
+  atomic<uint64_t> max_ns{0};
+  array<atomic<uint64_t>, PERF_HISTOGRAM_BUCKETS> histogram{};
+
+  void add_to(PerfCounterStats &r) const {
+    r.count += count.load(memory_order_relaxed);
+    r.total_ns += total_ns.load(memory_order_relaxed);
+    r.max_ns = max(r.max_ns, max_ns.load(memory_order_relaxed));
+    for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i) {
+      r.histogram[i] += histogram[i].load(memory_order_relaxed);
+    }
+  }
+
+  void reset() {
+    count.store(0, memory_order_relaxed);
+    total_ns.store(0, memory_order_relaxed);
+    max_ns.store(0, memory_order_relaxed);
+    for (auto &x : histogram) {
+      x.store(0, memory_order_relaxed);
+    }
+  }
+};
+
+using ThreadStats = array<AtomicCounterStats, N_COUNTERS>;
+
+// Stats of the live threads, and the sum of those of exited threads.
+// Leaked, so that it outlives threads exiting during static destruction.
+struct Registry {
+  mutex mu;
+  unordered_set<ThreadStats *> threads;
+  vector<PerfCounterStats> exited = vector<PerfCounterStats>(N_COUNTERS);
+};
+
+Registry &registry() {
+  static Registry *r = new Registry();
+  return *r;
+}
+
+// Registers the thread's stats on first use, and folds them into
+// Registry::exited when the thread exits
+struct ThreadStatsHandle {
+  ThreadStats stats;
+
+  ThreadStatsHandle() {
+    Registry &r = registry();
+    lock_guard<mutex> lock(r.mu);
+    r.threads.insert(&stats);
+  }
+
+  ~ThreadStatsHandle() {
+    Registry &r = registry();
+    lock_guard<mutex> lock(r.mu);
+    for (size_t i = 0; i < N_COUNTERS; ++i) {
+      stats[i].add_to(r.exited[i]);
+    }
+    r.threads.erase(&stats);
+  }
+};
+
+ThreadStats &thread_stats() {
+  thread_local ThreadStatsHandle handle;
+  return handle.stats;
+}
+
+size_t histogram_bucket(uint64_t ns) {
+  size_t bucket = 0;
+  while (ns > 1 && bucket < PERF_HISTOGRAM_BUCKETS - 1) {
+    ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+} // namespace
+
+const char *perf_counter_name(PerfCounter counter) {
+  return PERF_COUNTER_NAMES[static_cast<size_t>(counter)];
+}
+
+void set_perf_stats_enabled(bool enabled) {
+  detail::perf_stats_enabled.store(enabled, memory_order_relaxed);
+}
+
+bool get_perf_stats_enabled() {
+  return detail::perf_stats_enabled.load(memory_order_relaxed);
+}
+
+void add_perf_sample(PerfCounter counter, uint64_t ns) {
+  AtomicCounterStats &stats = thread_stats()[static_cast<size_t>(counter)];
+  stats.count.fetch_add(1, memory_order_relaxed);
+  stats.total_ns.fetch_add(ns, memory_order_relaxed);
+  if (ns > stats.max_ns.load(memory_order_relaxed)) {
+    stats.max_ns.store(ns, memory_order_relaxed);
+  }
+  stats.histogram[histogram_bucket(ns)].fetch_add(1, memory_order_relaxed);
+}
+
+vector<PerfCounterStats> get_perf_stats() {
+  Registry &r = registry();
+  lock_guard<mutex> lock(r.mu);
+  vector<PerfCounterStats> stats = r.exited;
+  for (ThreadStats *thread : r.threads) {
+    for (size_t i = 0; i < N_COUNTERS; ++i) {
+      (*thread)[i].add_to(stats[i]);
+    }
+  }
+  return stats;
+}
+
+void reset_perf_stats() {
+  Registry &r = registry();
+  lock_guard<mutex> lock(r.mu);
+  r.exited.assign(N_COUNTERS, PerfCounterStats());
+  for (ThreadStats *thread : r.threads) {
+    for (auto &counter : *thread) {
+      counter.reset();
+    }
+  }
+}
+
+} // namespace dipcc
@@ -0,0 +1,97 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hot-path timing counters. Disabled at runtime by default (a timer then
+// costs one relaxed atomic load); compile with -DDIPCC_NO_PERF_STATS to
+// remove them entirely.
+
+namespace dipcc {
+
+enum class PerfCounter {
+  PROCESS,
+  LOAD_ALL_POSSIBLE_ORDERS_M,
+  LOAD_ALL_POSSIBLE_ORDERS_R,
+  LOAD_ALL_POSSIBLE_ORDERS_A,
+  ENCODE_BOARD_STATE,
+  ENCODE_VALID_ORDERS,
+  ENCODE_PREV_ORDERS,
+  DECODE_ORDER_IDXS,
+  THREAD_POOL_QUEUE, // from batch submission until a job is claimed
+  THREAD_POOL_WORK,  // running a job
+  THREAD_POOL_IDLE,  // worker threads waiting for a batch
+  THREAD_POOL_WAIT,  // calling threads blocked on unfinished jobs
+  N_COUNTERS
+};
+
+const char *perf_counter_name(PerfCounter counter);
+
+// Histogram bucket i counts durations in [2^i, 2^(i+1)) ns
+static const size_t PERF_HISTOGRAM_BUCKETS = 40;
+
+struct PerfCounterStats {
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+  std::array<uint64_t, PERF_HISTOGRAM_BUCKETS> histogram{};
+};
+
+void set_perf_stats_enabled(bool enabled);
+bool get_perf_stats_enabled();
+
+// Sum the stats of all threads, including exited ones, indexed by
+// PerfCounter
+std::vector<PerfCounterStats> get_perf_stats();
+void reset_perf_stats();
+
+// Add one duration to the calling thread's stats. Lock-free.
+void add_perf_sample(PerfCounter counter, uint64_t ns);
+
+namespace detail {
+extern std::atomic<bool> perf_stats_enabled;
+} // namespace detail
+
+// Time the enclosing scope, if perf stats are enabled
+class PerfTimer {
+public:
+#ifdef DIPCC_NO_PERF_STATS
+  explicit PerfTimer(PerfCounter) {}
+#else
+  explicit PerfTimer(PerfCounter counter)
+      : counter_(counter),
+        enabled_(
+            detail::perf_stats_enabled.load(std::memory_order_relaxed)) {
+    if (enabled_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~PerfTimer() {
+    if (enabled_) {
+      add_perf_sample(counter_, std::chrono::duration_cast<
+                                    std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - start_)
+                                    .count());
+    }
+  }
+
+private:
+  PerfCounter counter_;
+  bool enabled_;
+  std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+} // namespace dipcc
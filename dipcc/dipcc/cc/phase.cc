@@ -88,58 +88,13 @@ std::string Phase::to_string_long() const {
   return s;
 }
 
-bool Phase::operator<(const Phase &other) const {
-  if (this->season == 'C') {
-    return false;
+Phase n_move_phases_later(const Phase &from, int n) {
+  if (n == 0) {
+    return from;
   }
-  if (other.season == 'C') {
-    return true;
-  }
-  if (this->year != other.year) {
-    return this->year < other.year;
-  }
-  if (this->season != other.season) {
-    for (char s : {'S', 'F', 'W'}) {
-      if (this->season == s) {
-        return true;
-      } else if (other.season == s) {
-        return false;
-      }
-    }
-  }
-  if (this->phase_type != other.phase_type) {
-    for (char s : {'M', 'R', 'A'}) {
-      if (this->phase_type == s) {
-        return true;
-      } else if (other.phase_type == s) {
-        return false;
-      }
-    }
-  }
-
-  // they are equal
-  return false;
-}
-
-bool Phase::operator==(const Phase &other) const {
-  if (this->season == 'C' || other.season == 'C') {
-    return this->season == other.season;
-  }
-  return (this->season == other.season) && (this->year == other.year) &&
-         (this->phase_type == other.phase_type);
-}
-
-bool Phase::operator!=(const Phase &other) const {
-  return !(*this == other);
-}
-bool Phase::operator>(const Phase &other) const {
-  return other < *this;
-}
-bool Phase::operator<=(const Phase &other) const {
-  return !(*this > other);
-}
-bool Phase::operator>=(const Phase &other) const {
-  return !(*this < other);
+  int from_idx = 2 * (from.year - 1901) + (from.season == 'S' ? 0 : 1);
+  int to_idx = from_idx + n;
+  return Phase(to_idx % 2 == 0 ? 'S' : 'F', to_idx / 2 + 1901, 'M');
 }
 
 } // namespace dipcc
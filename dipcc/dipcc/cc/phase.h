@@ -7,7 +7,9 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <type_traits>
 
 #include "enums.h"
 
@@ -29,14 +31,53 @@ struct Phase {
   std::string to_string() const;
   std::string to_string_long() const;
 
-  bool operator<(const Phase &other) const;
-  bool operator>(const Phase &other) const;
-  bool operator<=(const Phase &other) const;
-  bool operator>=(const Phase &other) const;
-  bool operator==(const Phase &other) const;
-  bool operator!=(const Phase &other) const;
+  // Packed ordinal, increasing in the order phases are played, with all
+  // COMPLETED phases equal and last. Phases are compared by ordinal, e.g. as
+  // history keys. Valid for years 1900 to 5994.
+  uint16_t ordinal() const {
+    if (season == 'C') {
+      return COMPLETED_ORDINAL;
+    }
+    uint16_t s = season == 'S' ? 0 : season == 'F' ? 1 : season == 'W' ? 2 : 3;
+    uint16_t t = phase_type == 'M'   ? 0
+                 : phase_type == 'R' ? 1
+                 : phase_type == 'A' ? 2
+                                     : 3;
+    return ((year - 1900) << 4) | (s << 2) | t;
+  }
+
+  bool operator<(const Phase &other) const {
+    return ordinal() < other.ordinal();
+  }
+  bool operator>(const Phase &other) const { return other < *this; }
+  bool operator<=(const Phase &other) const { return !(other < *this); }
+  bool operator>=(const Phase &other) const { return !(*this < other); }
+  bool operator==(const Phase &other) const {
+    return ordinal() == other.ordinal();
+  }
+  bool operator!=(const Phase &other) const { return !(*this == other); }
+
+  static const uint16_t COMPLETED_ORDINAL = 0xffff;
 };
 
 void to_json(json &j, const Phase &x);
 
+// The movement phase n movement phases after from (from itself if n == 0)
+Phase n_move_phases_later(const Phase &from, int n);
+
+// Return f(std::integral_constant<char, phase_type>()), so that f can call
+// code specialized at compile time for the phase type ('M', 'R', 'A' or 'C')
+template <typename F> decltype(auto) visit_phase_type(char phase_type, F &&f) {
+  switch (phase_type) {
+  case 'M':
+    return f(std::integral_constant<char, 'M'>());
+  case 'R':
+    return f(std::integral_constant<char, 'R'>());
+  case 'A':
+    return f(std::integral_constant<char, 'A'>());
+  default:
+    return f(std::integral_constant<char, 'C'>());
+  }
+}
+
 } // namespace dipcc
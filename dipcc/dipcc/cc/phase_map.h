@@ -0,0 +1,447 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "phase.h"
+
+namespace dipcc {
+
+// Ordered map keyed by Phase with O(1) copies, for Game histories.
+//
+// Entries are split into an immutable, reference-counted prefix shared with
+// other copies, and a tail owned by this copy. Copying a PhaseMap moves the
+// source's tail into a new shared segment, so clones share their history and
+// only store the phases they add. Writing to a phase that lives in the shared
+// prefix (almost always the most recent one) first copies that phase and any
+// later ones into the tail.
+//
+// Iteration walks the visible ranges of the segments, which are built on the
+// first begin(), rbegin(), find() or size() after a change and kept until the
+// next one.
+template <typename V> class PhaseMap {
+  using Map = std::map<Phase, V>;
+
+  struct Segment {
+    std::shared_ptr<const Segment> parent;
+    std::optional<Phase> parent_limit; // parent entries >= this are hidden
+    Map entries;
+    size_t depth;
+  };
+
+  // A contiguous run of n visible entries of one map, from first to back.
+  // Holds no end iterator, since moving a map (see freeze) invalidates it, so
+  // iterating a PhaseMap stays valid while it is copied.
+  struct Range {
+    typename Map::const_iterator first, back;
+    size_t n;
+  };
+  using Ranges = std::vector<Range>;
+
+public:
+  using key_type = Phase;
+  using mapped_type = V;
+  using value_type = typename Map::value_type;
+
+  class const_iterator {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename Map::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+    const_iterator() {}
+    const_iterator(std::shared_ptr<const Ranges> ranges, size_t i,
+                   typename Map::const_iterator it, size_t j)
+        : ranges_(ranges), i_(i), j_(j), it_(it) {
+      skip_empty();
+    }
+
+    reference operator*() const { return *it_; }
+    pointer operator->() const { return &*it_; }
+    const_iterator &operator++() {
+      ++it_;
+      ++j_;
+      skip_empty();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator r = *this;
+      ++*this;
+      return r;
+    }
+    const_iterator &operator--() {
+      if (i_ < ranges_->size() && j_ > 0) {
+        --it_;
+        --j_;
+        return *this;
+      }
+      do {
+        --i_;
+      } while ((*ranges_)[i_].n == 0);
+      it_ = (*ranges_)[i_].back;
+      j_ = (*ranges_)[i_].n - 1;
+      return *this;
+    }
+    const_iterator operator--(int) {
+      const_iterator r = *this;
+      --*this;
+      return r;
+    }
+    bool operator==(const const_iterator &o) const {
+      if (at_end() || o.at_end()) {
+        return at_end() && o.at_end();
+      }
+      return i_ == o.i_ && j_ == o.j_;
+    }
+    bool operator!=(const const_iterator &o) const { return !(*this == o); }
+
+  private:
+    bool at_end() const { return ranges_ == nullptr || i_ == ranges_->size(); }
+    void skip_empty() {
+      while (!at_end() && j_ == (*ranges_)[i_].n) {
+        ++i_;
+        j_ = 0;
+        if (!at_end()) {
+          it_ = (*ranges_)[i_].first;
+        }
+      }
+    }
+
+    std::shared_ptr<const Ranges> ranges_;
+    size_t i_ = 0; // index of the range
+    size_t j_ = 0; // index within the range
+    typename Map::const_iterator it_;
+  };
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  PhaseMap() {}
+  PhaseMap(const PhaseMap &other) { share(other); }
+  PhaseMap(PhaseMap &&) = default;
+  PhaseMap &operator=(const PhaseMap &other) {
+    if (this != &other) {
+      tail_.clear();
+      share(other);
+      invalidate_ranges();
+    }
+    return *this;
+  }
+  PhaseMap &operator=(PhaseMap &&) = default;
+
+  ////////////
+  // Lookup //
+  ////////////
+
+  const_iterator begin() const {
+    auto ranges = get_ranges();
+    auto first = ranges->size() > 0 ? (*ranges)[0].first
+                                    : typename Map::const_iterator();
+    return const_iterator(ranges, 0, first, 0);
+  }
+  const_iterator end() const {
+    return const_iterator(nullptr, 0, typename Map::const_iterator(), 0);
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end_with_ranges());
+  }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+  const_iterator find(const Phase &key) const {
+    auto ranges = get_ranges();
+    for (size_t i = 0; i < ranges->size(); ++i) {
+      const Range &range = (*ranges)[i];
+      if (range.n == 0) {
+        continue;
+      }
+      if (!(key < range.first->first) && !(range.back->first < key)) {
+        auto it = range.first;
+        for (size_t j = 0; j < range.n; ++j, ++it) {
+          if (it->first == key) {
+            return const_iterator(ranges, i, it, j);
+          }
+          if (key < it->first) {
+            break;
+          }
+        }
+        return end();
+      }
+    }
+    return end();
+  }
+
+  const V *find_value(const Phase &key) const {
+    auto it = tail_.find(key);
+    if (it != tail_.end()) {
+      return &it->second;
+    }
+    if (limit_ && !(key < *limit_)) {
+      return nullptr;
+    }
+    for (const Segment *seg = prefix_.get(); seg != nullptr;
+         seg = seg->parent.get()) {
+      auto jt = seg->entries.find(key);
+      if (jt != seg->entries.end()) {
+        return &jt->second;
+      }
+      if (seg->parent_limit && !(key < *seg->parent_limit)) {
+        return nullptr;
+      }
+    }
+    return nullptr;
+  }
+
+  bool contains(const Phase &key) const { return find_value(key) != nullptr; }
+  size_t count(const Phase &key) const { return contains(key) ? 1 : 0; }
+
+  const V &at(const Phase &key) const {
+    const V *v = find_value(key);
+    if (v == nullptr) {
+      throw std::out_of_range("PhaseMap::at " + key.to_string());
+    }
+    return *v;
+  }
+
+  // Return the value at key, or an empty value if there is none. Unlike
+  // operator[], does not insert.
+  const V &get(const Phase &key) const {
+    static const V empty{};
+    const V *v = find_value(key);
+    return v == nullptr ? empty : *v;
+  }
+
+  // Call fn on each entry from the last one back, until it returns true.
+  // Unlike rbegin(), allocates nothing, so finding a recent entry is cheap.
+  template <typename Fn> void visit_reverse(Fn fn) const {
+    for (auto it = tail_.rbegin(); it != tail_.rend(); ++it) {
+      if (fn(*it)) {
+        return;
+      }
+    }
+    std::optional<Phase> limit = limit_;
+    for (const Segment *seg = prefix_.get(); seg != nullptr;
+         seg = seg->parent.get()) {
+      auto last = limit ? seg->entries.lower_bound(*limit) : seg->entries.end();
+      for (auto it = std::make_reverse_iterator(last);
+           it != seg->entries.rend(); ++it) {
+        if (fn(*it)) {
+          return;
+        }
+      }
+      if (seg->parent_limit && (!limit || *seg->parent_limit < *limit)) {
+        limit = seg->parent_limit;
+      }
+    }
+  }
+
+  // Return the last entry for which pred is true, or nullptr
+  template <typename Pred>
+  const value_type *find_last_if(Pred pred) const {
+    const value_type *r = nullptr;
+    visit_reverse([&](const value_type &entry) {
+      if (pred(entry)) {
+        r = &entry;
+        return true;
+      }
+      return false;
+    });
+    return r;
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const Range &range : *get_ranges()) {
+      n += range.n;
+    }
+    return n;
+  }
+  bool empty() const { return tail_.empty() && size() == 0; }
+
+  //////////////
+  // Mutation //
+  //////////////
+
+  V &operator[](const Phase &key) {
+    cut(key);
+    auto it = tail_.find(key);
+    if (it != tail_.end()) {
+      return it->second;
+    }
+    invalidate_ranges();
+    return tail_[key];
+  }
+
+  // The value at key if it is in this copy's own storage, i.e. not shared
+  // with other copies, else nullptr
+  V *find_unshared(const Phase &key) {
+    auto it = tail_.find(key);
+    return it == tail_.end() ? nullptr : &it->second;
+  }
+
+  void erase(const Phase &key) {
+    cut(key);
+    tail_.erase(key);
+    invalidate_ranges();
+  }
+
+  // Erase all entries < key. Drops the shared prefix, so later entries are
+  // copied into this copy's own storage.
+  void erase_before(const Phase &key) {
+    if (prefix_ != nullptr) {
+      cut(key);
+      prefix_.reset();
+      limit_.reset();
+    }
+    tail_.erase(tail_.begin(), tail_.lower_bound(key));
+    invalidate_ranges();
+  }
+
+  // Erase all entries >= key
+  void erase_from(const Phase &key) {
+    if (prefix_ != nullptr && (!limit_ || key < *limit_)) {
+      limit_ = key;
+    }
+    tail_.erase(tail_.lower_bound(key), tail_.end());
+    invalidate_ranges();
+  }
+
+  // Erase all entries > key
+  void erase_after(const Phase &key) {
+    cut(key);
+    tail_.erase(tail_.upper_bound(key), tail_.end());
+    invalidate_ranges();
+  }
+
+  void clear() {
+    prefix_.reset();
+    limit_.reset();
+    tail_.clear();
+    invalidate_ranges();
+  }
+
+private:
+  // Share other's history, moving its tail into a new shared segment. Does
+  // not modify other if its tail is empty, so a PhaseMap with an empty tail
+  // may be copied concurrently.
+  void share(const PhaseMap &other) {
+    other.freeze();
+    prefix_ = other.prefix_;
+    limit_ = other.limit_;
+  }
+
+  void freeze() const {
+    if (tail_.empty()) {
+      return;
+    }
+    auto seg = std::make_shared<Segment>();
+    if (prefix_ != nullptr && prefix_->depth >= MAX_DEPTH) {
+      // Compact long chains so lookups stay cheap
+      seg->entries = Map(begin(), end());
+      seg->depth = 1;
+    } else {
+      seg->parent = prefix_;
+      seg->parent_limit = limit_;
+      seg->entries = std::move(tail_);
+      seg->depth = prefix_ == nullptr ? 1 : prefix_->depth + 1;
+    }
+    prefix_ = seg;
+    limit_.reset();
+    tail_.clear();
+    // A compacted prefix drops the segments the ranges point into
+    invalidate_ranges();
+  }
+
+  // Ensure no shared entry >= key is visible, copying them into tail_
+  void cut(const Phase &key) {
+    if (prefix_ == nullptr || (limit_ && !(key < *limit_))) {
+      return;
+    }
+    Ranges ranges;
+    append_ranges(prefix_.get(), limit_, ranges);
+    for (auto r = ranges.rbegin(); r != ranges.rend(); ++r) {
+      auto it = r->back;
+      for (size_t j = 0; j < r->n; ++j) {
+        if (j > 0) {
+          --it;
+        }
+        if (it->first < key) {
+          limit_ = key;
+          invalidate_ranges();
+          return;
+        }
+        tail_.insert(*it);
+      }
+    }
+    limit_ = key;
+    invalidate_ranges();
+  }
+
+  // Append the visible ranges of seg (limited to keys < limit) in key order
+  static void append_ranges(const Segment *seg,
+                            const std::optional<Phase> &limit,
+                            Ranges &ranges) {
+    if (seg == nullptr) {
+      return;
+    }
+    std::optional<Phase> parent_limit = seg->parent_limit;
+    if (limit && (!parent_limit || *limit < *parent_limit)) {
+      parent_limit = limit;
+    }
+    append_ranges(seg->parent.get(), parent_limit, ranges);
+    ranges.push_back(make_range(
+        seg->entries, limit ? seg->entries.lower_bound(*limit)
+                            : seg->entries.end()));
+  }
+
+  static Range make_range(const Map &m, typename Map::const_iterator last) {
+    size_t n = std::distance(m.begin(), last);
+    return Range{m.begin(), n > 0 ? std::prev(last) : last, n};
+  }
+
+  // The visible ranges, built if a change dropped them. Loaded and stored
+  // atomically, as a PhaseMap that isn't being changed may be read by
+  // several threads at once.
+  std::shared_ptr<const Ranges> get_ranges() const {
+    auto ranges = std::atomic_load(&ranges_);
+    if (ranges == nullptr) {
+      auto built = std::make_shared<Ranges>();
+      append_ranges(prefix_.get(), limit_, *built);
+      built->push_back(make_range(tail_, tail_.end()));
+      ranges = built;
+      std::atomic_store(&ranges_, ranges);
+    }
+    return ranges;
+  }
+
+  void invalidate_ranges() const {
+    std::atomic_store(&ranges_, std::shared_ptr<const Ranges>());
+  }
+
+  // end() that can be decremented
+  const_iterator end_with_ranges() const {
+    auto ranges = get_ranges();
+    return const_iterator(ranges, ranges->size(),
+                          typename Map::const_iterator(), 0);
+  }
+
+  static const size_t MAX_DEPTH = 16;
+
+  mutable std::shared_ptr<const Segment> prefix_;
+  mutable std::optional<Phase> limit_; // prefix entries >= this are hidden
+  mutable Map tail_;
+  mutable std::shared_ptr<const Ranges> ranges_; // see get_ranges
+};
+
+} // namespace dipcc
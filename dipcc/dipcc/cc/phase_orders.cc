@@ -0,0 +1,87 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+
+#include "phase_orders.h"
+#include "checks.h"
+
+namespace dipcc {
+
+PhaseOrders::PhaseOrders(const PowerMap<std::vector<Order>> &orders) {
+  size_t n = 0;
+  for (auto &it : orders) {
+    n += it.second.size();
+  }
+  orders_.reserve(n);
+  for (size_t i = 0; i < N_POWER_SLOTS; ++i) {
+    offsets_[i] = orders_.size();
+    auto it = orders.find(static_cast<Power>(i));
+    if (it != orders.end()) {
+      present_ |= 1 << i;
+      orders_.insert(orders_.end(), it->second.begin(), it->second.end());
+    }
+  }
+  JCHECK(orders_.size() <= UINT16_MAX, "PhaseOrders too many orders");
+  offsets_[N_POWER_SLOTS] = orders_.size();
+}
+
+PhaseOrders &PhaseOrders::operator=(const PhaseOrders &o) {
+  if (this != &o) {
+    orders_ = o.orders_;
+    offsets_ = o.offsets_;
+    present_ = o.present_;
+    std::atomic_store(&vocab_idxs_, std::atomic_load(&o.vocab_idxs_));
+  }
+  return *this;
+}
+
+PhaseOrders &PhaseOrders::operator=(PhaseOrders &&o) {
+  if (this != &o) {
+    orders_ = std::move(o.orders_);
+    offsets_ = o.offsets_;
+    present_ = o.present_;
+    std::atomic_store(&vocab_idxs_, std::atomic_load(&o.vocab_idxs_));
+  }
+  return *this;
+}
+
+PowerMap<std::vector<Order>> PhaseOrders::to_power_map() const {
+  PowerMap<std::vector<Order>> r;
+  for (auto &it : *this) {
+    r[it.first].assign(it.second.begin(), it.second.end());
+  }
+  return r;
+}
+
+bool PhaseOrders::operator==(const PowerMap<std::vector<Order>> &o) const {
+  if (size() != o.size()) {
+    return false;
+  }
+  for (auto &it : o) {
+    if (!contains(it.first)) {
+      return false;
+    }
+    Range orders = get(it.first);
+    if (orders.size() != it.second.size() ||
+        !std::equal(orders.begin(), orders.end(), it.second.begin())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t PhaseOrders::heap_bytes() const {
+  size_t r = orders_.capacity() * sizeof(Order);
+  auto memo = std::atomic_load(&vocab_idxs_);
+  if (memo != nullptr) {
+    r += sizeof(VocabIdxs) + memo->idxs.capacity() * sizeof(int32_t);
+  }
+  return r;
+}
+
+} // namespace dipcc
@@ -0,0 +1,183 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "order.h"
+#include "power.h"
+#include "power_map.h"
+
+namespace dipcc {
+
+// The orders of a phase of a Game's history, packed in one array in power
+// order with an offset table, instead of a vector per power: one heap block
+// per phase. Read like a const PowerMap<std::vector<Order>>, whose entries
+// are ranges of the array.
+class PhaseOrders {
+public:
+  // The orders of a power
+  class Range {
+  public:
+    Range(const Order *begin, const Order *end) : begin_(begin), end_(end) {}
+    const Order *begin() const { return begin_; }
+    const Order *end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+    const Order &operator[](size_t i) const { return begin_[i]; }
+    std::vector<Order> to_vector() const { return {begin_, end_}; }
+
+  private:
+    const Order *begin_;
+    const Order *end_;
+  };
+
+  struct Entry {
+    Power first;
+    Range second;
+  };
+
+  // Iterates over the present powers, like PowerMap. The entry is held by
+  // the iterator.
+  class const_iterator {
+  public:
+    const_iterator(const PhaseOrders *orders, size_t i)
+        : orders_(orders), i_(i), entry_{Power::NONE, {nullptr, nullptr}} {
+      load();
+    }
+    const Entry &operator*() const { return entry_; }
+    const Entry *operator->() const { return &entry_; }
+    const_iterator &operator++() {
+      i_ = orders_->next_from(i_ + 1);
+      load();
+      return *this;
+    }
+    bool operator==(const const_iterator &o) const { return i_ == o.i_; }
+    bool operator!=(const const_iterator &o) const { return i_ != o.i_; }
+
+  private:
+    void load() {
+      if (i_ < N_POWER_SLOTS) {
+        entry_ = Entry{static_cast<Power>(i_), orders_->range(i_)};
+      }
+    }
+
+    const PhaseOrders *orders_;
+    size_t i_;
+    Entry entry_;
+  };
+  using iterator = const_iterator;
+
+  PhaseOrders() {}
+  PhaseOrders(const PowerMap<std::vector<Order>> &orders);
+  PhaseOrders(const PhaseOrders &o) { *this = o; }
+  PhaseOrders(PhaseOrders &&o) { *this = std::move(o); }
+  PhaseOrders &operator=(const PhaseOrders &o);
+  PhaseOrders &operator=(PhaseOrders &&o);
+
+  PowerMap<std::vector<Order>> to_power_map() const;
+
+  bool contains(Power power) const {
+    return (present_ >> static_cast<size_t>(power)) & 1;
+  }
+  // The orders of power, empty if it is absent
+  Range get(Power power) const { return range(static_cast<size_t>(power)); }
+  const_iterator find(Power power) const {
+    return contains(power) ? const_iterator(this, static_cast<size_t>(power))
+                           : end();
+  }
+  size_t size() const { return __builtin_popcount(present_); }
+  bool empty() const { return present_ == 0; }
+  // Number of orders of all powers
+  size_t n_orders() const { return orders_.size(); }
+  const std::vector<Order> &get_all_orders() const { return orders_; }
+
+  const_iterator begin() const { return const_iterator(this, next_from(0)); }
+  const_iterator end() const { return const_iterator(this, N_POWER_SLOTS); }
+
+  bool operator==(const PhaseOrders &o) const {
+    return present_ == o.present_ && offsets_ == o.offsets_ &&
+           orders_ == o.orders_;
+  }
+  bool operator!=(const PhaseOrders &o) const { return !(*this == o); }
+  // Equal to the PowerMap it was built from, without building it
+  bool operator==(const PowerMap<std::vector<Order>> &o) const;
+  bool operator!=(const PowerMap<std::vector<Order>> &o) const {
+    return !(*this == o);
+  }
+
+  // The vocab idxs of get_all_orders(), as given by vocab_idx(order) for the
+  // OrdersEncoder with id encoder_id. Memoized for the first encoder asked,
+  // since processes usually have one, else computed into scratch.
+  // Thread-safe.
+  template <typename F>
+  const std::vector<int32_t> &get_vocab_idxs(uint64_t encoder_id, F vocab_idx,
+                                             std::vector<int32_t> &scratch)
+      const;
+
+  size_t heap_bytes() const;
+
+private:
+  struct VocabIdxs {
+    uint64_t encoder_id;
+    std::vector<int32_t> idxs;
+  };
+
+  Range range(size_t i) const {
+    return {orders_.data() + offsets_[i], orders_.data() + offsets_[i + 1]};
+  }
+  size_t next_from(size_t i) const {
+    uint32_t rest = present_ >> i;
+    return rest == 0 ? N_POWER_SLOTS : i + __builtin_ctz(rest);
+  }
+
+  std::vector<Order> orders_;
+  // The orders of power i are orders_[offsets_[i]:offsets_[i + 1]]
+  std::array<uint16_t, N_POWER_SLOTS + 1> offsets_{};
+  uint8_t present_ = 0;
+  // Set once, then never replaced, so references to it stay valid
+  mutable std::shared_ptr<const VocabIdxs> vocab_idxs_;
+};
+
+inline size_t heap_bytes(const PhaseOrders &x) { return x.heap_bytes(); }
+
+template <typename F>
+const std::vector<int32_t> &
+PhaseOrders::get_vocab_idxs(uint64_t encoder_id, F vocab_idx,
+                            std::vector<int32_t> &scratch) const {
+  std::shared_ptr<const VocabIdxs> memo = std::atomic_load(&vocab_idxs_);
+  if (memo != nullptr && memo->encoder_id == encoder_id) {
+    return memo->idxs;
+  }
+
+  auto computed = std::make_shared<VocabIdxs>();
+  computed->encoder_id = encoder_id;
+  computed->idxs.reserve(orders_.size());
+  for (const Order &order : orders_) {
+    computed->idxs.push_back(vocab_idx(order));
+  }
+  if (memo == nullptr) {
+    std::shared_ptr<const VocabIdxs> expected;
+    std::shared_ptr<const VocabIdxs> desired = computed;
+    if (std::atomic_compare_exchange_strong(&vocab_idxs_, &expected,
+                                            desired)) {
+      return computed->idxs;
+    }
+    if (expected->encoder_id == encoder_id) {
+      return expected->idxs; // memoized meanwhile
+    }
+  }
+  scratch = std::move(computed->idxs);
+  return scratch;
+}
+
+} // namespace dipcc
@@ -0,0 +1,168 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "checks.h"
+#include "hash.h"
+#include "plausible_orders.h"
+
+using namespace std;
+
+namespace dipcc {
+
+bool are_supports_coordinated(const vector<Order> &orders) {
+  // The order required of the unit at each supported or convoyed loc: the
+  // unit, and its destination unless supported to hold
+  unordered_map<Loc, pair<Unit, Loc>> required;
+  unordered_map<Loc, const Order *> ordered;
+
+  for (const Order &order : orders) {
+    ordered[order.get_unit().loc] = &order;
+    OrderType type = order.get_type();
+    if (type != OrderType::SH && type != OrderType::SM &&
+        type != OrderType::C) {
+      continue;
+    }
+    Unit target = order.get_target();
+    pair<Unit, Loc> req{target, order.get_dest()};
+    auto it = required.find(target.loc);
+    if (it == required.end()) {
+      required[target.loc] = req;
+    } else if (it->second.first.type != target.type ||
+               it->second.second != req.second) {
+      // an order is already required of this unit, but it contradicts this
+      // one
+      return false;
+    }
+  }
+
+  for (auto &[req_loc, req] : required) {
+    auto it = ordered.find(req_loc);
+    if (it == ordered.end()) {
+      continue;
+    }
+    const Order &actual = *it->second;
+    bool actual_move = actual.get_type() == OrderType::M;
+    Loc req_dest = req.second;
+    if (req_dest == Loc::NONE && actual_move) {
+      // we supported a hold, but it tried to move
+      return false;
+    }
+    if (req_dest != Loc::NONE &&
+        (!actual_move || root_loc(actual.get_dest()) != root_loc(req_dest))) {
+      // we supported a move, but the order given was not a move, or a move
+      // to the wrong destination
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t PlausibleOrdersCounter::OrderIdxsHash::operator()(
+    const vector<long> &idxs) const {
+  size_t r = 0;
+  for (long idx : idxs) {
+    hash_combine(r, idx);
+  }
+  return r;
+}
+
+void PlausibleOrdersCounter::add(const torch::Tensor &order_idxs,
+                                 const torch::Tensor &logprobs) {
+  JCHECK(order_idxs.dim() == 3 && order_idxs.size(1) == 7,
+         "PlausibleOrdersCounter::add: order_idxs must be [B, 7, S]");
+  torch::Tensor idxs = order_idxs.to(torch::kCPU, torch::kLong).contiguous();
+  torch::Tensor lps = logprobs.to(torch::kCPU, torch::kFloat32).contiguous();
+  long B = idxs.size(0), S = idxs.size(2);
+  JCHECK(lps.numel() == B * 7,
+         "PlausibleOrdersCounter::add: logprobs must be [B, 7]");
+  const long *idxs_p = idxs.data_ptr<long>();
+  const float *lps_p = lps.data_ptr<float>();
+
+  vector<long> sampled, key;
+  for (long i = 0; i < B * 7; ++i) {
+    int power = i % 7;
+    sampled.clear();
+    for (long s = 0; s < S; ++s) {
+      long idx = idxs_p[i * S + s];
+      if (idx != OrdersEncoder::EOS_IDX) {
+        sampled.push_back(idx);
+      }
+    }
+    key = sampled;
+    sort(key.begin(), key.end());
+
+    auto &entries = entries_[power];
+    auto [it, inserted] = entry_idxs_[power].emplace(key, entries.size());
+    if (inserted) {
+      entries.push_back({sampled, 1, lps_p[i]});
+    } else {
+      Entry &entry = entries[it->second];
+      JCHECK(abs(entry.logprob - lps_p[i]) < 1e-2,
+             "PlausibleOrdersCounter::add: logprobs differ for an action");
+      ++entry.count;
+    }
+  }
+  n_samples_ += B;
+}
+
+bool PlausibleOrdersCounter::is_plausible(
+    const Entry &entry, optional<int> exclude_n_holds) const {
+  vector<Order> orders;
+  orders_encoder_.decode_power_order_idxs(entry.order_idxs.data(),
+                                          entry.order_idxs.size(), orders);
+  if (exclude_n_holds && static_cast<int>(orders.size()) >= *exclude_n_holds &&
+      all_of(orders.begin(), orders.end(),
+             [](auto &o) { return o.get_type() == OrderType::H; })) {
+    return false;
+  }
+  return are_supports_coordinated(orders);
+}
+
+vector<PlausibleOrdersCounter::Action>
+PlausibleOrdersCounter::get_plausible_actions(
+    int power, int limit, optional<int> exclude_n_holds) const {
+  JCHECK(limit >= 0, "get_plausible_actions: limit must be >= 0");
+  const auto &entries = entries_.at(power);
+  vector<size_t> idxs(entries.size());
+  iota(idxs.begin(), idxs.end(), 0);
+
+  // filter out badly-coordinated actions
+  if (entries.size() > static_cast<size_t>(limit)) {
+    idxs.erase(remove_if(idxs.begin(), idxs.end(),
+                         [&](size_t i) {
+                           return !is_plausible(entries[i], exclude_n_holds);
+                         }),
+               idxs.end());
+  }
+
+  stable_sort(idxs.begin(), idxs.end(), [&](size_t a, size_t b) {
+    return entries[a].count > entries[b].count;
+  });
+  stable_sort(idxs.begin(), idxs.end(), [&](size_t a, size_t b) {
+    return entries[a].logprob > entries[b].logprob;
+  });
+  if (idxs.size() > static_cast<size_t>(limit)) {
+    idxs.resize(limit);
+  }
+
+  vector<Action> r;
+  r.reserve(idxs.size());
+  for (size_t i : idxs) {
+    const Entry &entry = entries[i];
+    Action action{{}, entry.count, entry.logprob};
+    orders_encoder_.decode_power_order_idxs(
+        entry.order_idxs.data(), entry.order_idxs.size(), action.orders);
+    r.push_back(move(action));
+  }
+  return r;
+}
+
+} // namespace dipcc
@@ -0,0 +1,81 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <torch/torch.h>
+#include <unordered_map>
+#include <vector>
+
+#include "order.h"
+#include "orders_encoder.h"
+
+namespace dipcc {
+
+// Return false if any of a power's supports or convoys are not coordinated
+// with its other orders, as are_supports_coordinated in base_search_agent.py:
+// e.g. "F BLA S A SEV - RUM" requires "A SEV - RUM" if A SEV is ordered.
+// Supporting a foreign unit is always allowed.
+bool are_supports_coordinated(const std::vector<Order> &orders);
+
+// Counts the distinct actions sampled for each power, keyed by their sorted
+// order idxs so that step order does not matter, for
+// BaseSearchAgent.get_plausible_orders
+class PlausibleOrdersCounter {
+public:
+  struct Action {
+    std::vector<std::string> orders; // as first sampled
+    int count;
+    float logprob; // of the first sample
+  };
+
+  PlausibleOrdersCounter(const OrdersEncoder &orders_encoder)
+      : orders_encoder_(orders_encoder) {}
+
+  // Count the EOS_IDX-padded order_idxs [B, 7, S], sampled with logprobs
+  // [B, 7]
+  void add(const torch::Tensor &order_idxs, const torch::Tensor &logprobs);
+
+  int get_n_samples() const { return n_samples_; }
+  size_t get_n_unique(int power) const { return entries_.at(power).size(); }
+
+  // Return the power's limit most likely actions. If it has more than limit,
+  // all-holds actions of at least exclude_n_holds orders and actions with
+  // uncoordinated supports are dropped first. Equally likely actions are
+  // ordered by count, then by first sample.
+  std::vector<Action>
+  get_plausible_actions(int power, int limit,
+                        std::optional<int> exclude_n_holds) const;
+
+private:
+  struct Entry {
+    std::vector<long> order_idxs; // as first sampled, without EOS_IDX
+    int count;
+    float logprob;
+  };
+
+  struct OrderIdxsHash {
+    size_t operator()(const std::vector<long> &idxs) const;
+  };
+
+  bool is_plausible(const Entry &entry,
+                    std::optional<int> exclude_n_holds) const;
+
+  const OrdersEncoder &orders_encoder_;
+  int n_samples_ = 0;
+
+  // Per power, the actions in first-sampled order, and their positions by
+  // sorted order idxs
+  std::array<std::vector<Entry>, 7> entries_;
+  std::array<std::unordered_map<std::vector<long>, size_t, OrderIdxsHash>, 7>
+      entry_idxs_;
+};
+
+} // namespace dipcc
@@ -0,0 +1,324 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <array>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "adjacencies.h"
+#include "checks.h"
+#include "civil_disorder_distances.h"
+#include "loc.h"
+#include "playout.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+const uint8_t FAR = 255;
+
+// Moves from each loc to a center, FAR if there is no way
+using LocDists = array<uint8_t, N_LOC_SLOTS>;
+
+// [is_fleet][i]: the distances to SC_LOCS[i], by breadth-first search over
+// the army or fleet adjacencies, which are symmetric
+const array<vector<LocDists>, 2> &get_center_dists() {
+  static const array<vector<LocDists>, 2> dists = [] {
+    array<vector<LocDists>, 2> r;
+    for (int is_fleet = 0; is_fleet < 2; ++is_fleet) {
+      const LocSet *adj = is_fleet ? ADJ_F : ADJ_A;
+      for (Loc center : SC_LOCS) {
+        LocDists &d = r[is_fleet].emplace_back();
+        d.fill(FAR);
+        vector<Loc> frontier;
+        for (Loc loc : expand_coasts(center)) {
+          if (is_fleet ? !adj[static_cast<size_t>(loc)].empty()
+                       : loc == center) {
+            d[static_cast<size_t>(loc)] = 0;
+            frontier.push_back(loc);
+          }
+        }
+        for (uint8_t dist = 1; !frontier.empty(); ++dist) {
+          vector<Loc> next;
+          for (Loc loc : frontier) {
+            for (Loc x : adj[static_cast<size_t>(loc)]) {
+              if (d[static_cast<size_t>(x)] == FAR) {
+                d[static_cast<size_t>(x)] = dist;
+                next.push_back(x);
+              }
+            }
+          }
+          frontier = move(next);
+        }
+      }
+    }
+    return r;
+  }();
+  return dists;
+}
+
+// [is_fleet]: the distances to the nearest center not owned by power
+array<LocDists, 2> get_target_dists(const GameState &state, Power power) {
+  const auto &center_dists = get_center_dists();
+  const LocMap<Power> &centers = state.get_centers();
+  array<LocDists, 2> r;
+  for (int is_fleet = 0; is_fleet < 2; ++is_fleet) {
+    r[is_fleet].fill(FAR);
+    for (size_t i = 0; i < SC_LOCS.size(); ++i) {
+      auto it = centers.find(SC_LOCS[i]);
+      if (it != centers.end() && it->second == power) {
+        continue;
+      }
+      const LocDists &d = center_dists[is_fleet][i];
+      for (size_t loc = 0; loc < N_LOC_SLOTS; ++loc) {
+        r[is_fleet][loc] = min(r[is_fleet][loc], d[loc]);
+      }
+    }
+  }
+  return r;
+}
+
+template <typename T> const T &uniform_choice(const set<T> &xs, mt19937 &rng) {
+  JCHECK(!xs.empty(), "uniform_choice of an empty set");
+  auto it = xs.begin();
+  advance(it, uniform_int_distribution<size_t>(0, xs.size() - 1)(rng));
+  return *it;
+}
+
+// Possible orders of the units at a root loc and its coasts, for R- and
+// A-phases where orderable locs are rooted
+vector<const set<Order> *> get_root_possible_orders(GameState &state,
+                                                    Loc root) {
+  const auto &all_possible_orders = state.get_all_possible_orders();
+  vector<const set<Order> *> r;
+  for (Loc loc : expand_coasts(root)) {
+    auto it = all_possible_orders.find(loc);
+    if (it != all_possible_orders.end() && !it->second.empty()) {
+      r.push_back(&it->second);
+    }
+  }
+  return r;
+}
+
+void set_movement_orders(GameState &state, PlayoutPolicy policy,
+                         mt19937 &rng, PowerMap<vector<Order>> &orders) {
+  // Units in random order, so that no unit always claims dests first
+  vector<pair<Loc, OwnedUnit>> units;
+  for (auto &it : state.get_units()) {
+    units.push_back({it.first, it.second});
+  }
+  shuffle(units.begin(), units.end(), rng);
+
+  if (policy == PlayoutPolicy::RANDOM) {
+    for (auto & [ loc, unit ] : units) {
+      if (orders.contains(unit.power)) {
+        orders[unit.power].push_back(
+            uniform_choice(state.get_possible_orders(loc), rng));
+      }
+    }
+    return;
+  }
+
+  vector<array<LocDists, 2>> target_dists(N_POWER_SLOTS);
+  for (auto &it : orders) {
+    target_dists[static_cast<size_t>(it.first)] =
+        get_target_dists(state, it.first);
+  }
+
+  // Each unit takes the order with the lowest 2 * distance + is_move, ties
+  // broken uniformly. Via moves are skipped: they need a convoy too.
+  PowerMap<LocSet> claimed_by_power; // root dests of moves
+  vector<pair<const OwnedUnit *, Order>> holds;
+  for (auto & [ loc, unit ] : units) {
+    if (!orders.contains(unit.power)) {
+      continue;
+    }
+    const LocDists &dists = target_dists[static_cast<size_t>(
+        unit.power)][unit.type == UnitType::FLEET];
+    LocSet &claimed = claimed_by_power[unit.power];
+    Order best(unit.unowned(), OrderType::H);
+    int best_key = 2 * dists[static_cast<size_t>(loc)];
+    int n_best = 1;
+    for (const Order &order : state.get_possible_orders(loc)) {
+      if (order.get_type() != OrderType::M || order.get_via() ||
+          claimed.contains(root_loc(order.get_dest()))) {
+        continue;
+      }
+      int key = 2 * dists[static_cast<size_t>(order.get_dest())] + 1;
+      if (key < best_key) {
+        best = order;
+        best_key = key;
+        n_best = 1;
+      } else if (key == best_key &&
+                 uniform_int_distribution<int>(0, n_best++)(rng) == 0) {
+        best = order;
+      }
+    }
+    if (best.get_type() == OrderType::M) {
+      claimed.insert(root_loc(best.get_dest()));
+      orders[unit.power].push_back(best);
+    } else {
+      holds.push_back({&unit, best});
+    }
+  }
+
+  // Holding units support a move of their power into a center
+  for (auto & [ unit, order ] : holds) {
+    const set<Order> &possible_orders = state.get_possible_orders(unit->loc);
+    for (const Order &move : orders[unit->power]) {
+      if (move.get_type() == OrderType::M &&
+          is_center(root_loc(move.get_dest()))) {
+        Order support(unit->unowned(), OrderType::SM, move.get_unit(),
+                      root_loc(move.get_dest()));
+        if (possible_orders.find(support) != possible_orders.end()) {
+          order = support;
+          break;
+        }
+      }
+    }
+    orders[unit->power].push_back(order);
+  }
+}
+
+void set_retreat_orders(GameState &state, PlayoutPolicy policy,
+                        mt19937 &rng, PowerMap<vector<Order>> &orders) {
+  const auto &all_possible_orders = state.get_all_possible_orders();
+  PowerMap<LocSet> claimed;
+  for (auto & [ loc, dislodged ] : state.get_dislodged_units_map()) {
+    const OwnedUnit &unit = dislodged.unit;
+    auto it = all_possible_orders.find(unit.loc);
+    if (!orders.contains(unit.power) || it == all_possible_orders.end() ||
+        it->second.empty()) {
+      continue;
+    }
+    if (policy == PlayoutPolicy::RANDOM) {
+      orders[unit.power].push_back(uniform_choice(it->second, rng));
+      continue;
+    }
+
+    // The retreat nearest to a target not taken by another retreat of the
+    // same power, which would bounce it, else disband
+    const LocDists dists = get_target_dists(
+        state, unit.power)[unit.type == UnitType::FLEET];
+    Order best(unit.unowned(), OrderType::D);
+    int best_dist = FAR + 1;
+    for (const Order &order : it->second) {
+      if (order.get_type() == OrderType::R &&
+          !claimed[unit.power].contains(root_loc(order.get_dest())) &&
+          dists[static_cast<size_t>(order.get_dest())] < best_dist) {
+        best = order;
+        best_dist = dists[static_cast<size_t>(order.get_dest())];
+      }
+    }
+    if (best.get_type() == OrderType::R) {
+      claimed[unit.power].insert(root_loc(best.get_dest()));
+    }
+    orders[unit.power].push_back(best);
+  }
+}
+
+void set_adjustment_orders(GameState &state, PlayoutPolicy policy,
+                           mt19937 &rng, PowerMap<vector<Order>> &orders) {
+  const auto &orderable_locations = state.get_orderable_locations();
+  for (auto &it : orders) {
+    Power power = it.first;
+    auto locs_it = orderable_locations.find(power);
+    if (locs_it == orderable_locations.end()) {
+      continue;
+    }
+    vector<Loc> locs = locs_it->second;
+    int n_builds = state.get_n_builds(power);
+    int n = min(abs(n_builds), static_cast<int>(locs.size()));
+    if (n_builds > 0 || policy == PlayoutPolicy::RANDOM) {
+      shuffle(locs.begin(), locs.end(), rng);
+    } else {
+      // Furthest from home first, see GameState::do_civil_disorder
+      vector<pair<int, Loc>> keyed;
+      for (Loc root : locs) {
+        OwnedUnit unit = state.get_unit_rooted(root);
+        keyed.push_back({-civil_disorder_dist(power,
+                                              unit.type == UnitType::ARMY,
+                                              unit.loc),
+                         root});
+      }
+      sort(keyed.begin(), keyed.end());
+      for (size_t i = 0; i < locs.size(); ++i) {
+        locs[i] = keyed[i].second;
+      }
+    }
+    for (int i = 0; i < n; ++i) {
+      // A build at each free coast or as an army
+      vector<const set<Order> *> root_orders =
+          get_root_possible_orders(state, locs[i]);
+      if (root_orders.empty()) {
+        continue;
+      }
+      const set<Order> &loc_orders = *root_orders[uniform_int_distribution<
+          size_t>(0, root_orders.size() - 1)(rng)];
+      it.second.push_back(uniform_choice(loc_orders, rng));
+    }
+  }
+}
+
+} // namespace
+
+void set_playout_orders(Game &game, PlayoutPolicy policy, mt19937 &rng) {
+  GameState &state = game.get_state();
+  char phase_type = state.get_phase().phase_type;
+
+  // The powers to order: those with units or dislodged units, or with
+  // adjustments to make
+  PowerMap<vector<Order>> orders;
+  if (phase_type == 'M') {
+    for (auto &it : state.get_units()) {
+      orders[it.second.power];
+    }
+  } else if (phase_type == 'R') {
+    for (auto &it : state.get_dislodged_units_map()) {
+      orders[it.second.unit.power];
+    }
+  } else if (phase_type == 'A') {
+    for (auto &it : state.get_orderable_locations()) {
+      orders[it.first];
+    }
+  }
+  for (auto &it : game.get_staged_orders()) {
+    orders.erase(it.first);
+  }
+
+  if (phase_type == 'M') {
+    set_movement_orders(state, policy, rng, orders);
+  } else if (phase_type == 'R') {
+    set_retreat_orders(state, policy, rng, orders);
+  } else if (phase_type == 'A') {
+    set_adjustment_orders(state, policy, rng, orders);
+  }
+  for (auto &it : orders) {
+    game.set_orders(it.first, it.second);
+  }
+}
+
+int playout(Game &game, PlayoutPolicy policy, int max_move_phases,
+            mt19937 &rng) {
+  JCHECK(max_move_phases >= 0, "playout: negative max_move_phases");
+  Phase end_phase =
+      n_move_phases_later(game.get_state().get_phase(), max_move_phases);
+  int n_phases = 0;
+  while (!game.is_game_done() &&
+         (n_phases == 0 || game.get_state().get_phase() < end_phase)) {
+    set_playout_orders(game, policy, rng);
+    game.process();
+    ++n_phases;
+  }
+  return n_phases;
+}
+
+} // namespace dipcc
@@ -0,0 +1,41 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <random>
+
+#include "game.h"
+
+namespace dipcc {
+
+// Native policies to play games out without a model, e.g. for cheap value
+// estimates at search leaves
+enum class PlayoutPolicy {
+  // Each unit's order uniformly among its possible orders, like RandomAgent.
+  // Builds and disbands are spread uniformly.
+  RANDOM,
+  // Units move to the reachable loc nearest to a center their power does
+  // not own, or hold if none is nearer than their own loc, without two units
+  // of a power moving to the same loc. Holding units support a move of their
+  // power into a center if they can. Builds are spread uniformly, and
+  // disbands remove the units furthest from home, as civil disorder does.
+  HEURISTIC,
+};
+
+// Stage policy orders for the powers with orderable locs in game's current
+// phase. Powers with staged orders (see Game::get_staged_orders) keep them.
+void set_playout_orders(Game &game, PlayoutPolicy policy, std::mt19937 &rng);
+
+// Set playout orders and process game in place, until it is done or reaches
+// the movement phase max_move_phases after its current phase (see
+// n_move_phases_later). If max_move_phases is 0, only the current phase is
+// processed. Returns the number of phases processed.
+int playout(Game &game, PlayoutPolicy policy, int max_move_phases,
+            std::mt19937 &rng);
+
+} // namespace dipcc
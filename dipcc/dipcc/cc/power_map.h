@@ -0,0 +1,176 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+
+#include "power.h"
+
+namespace dipcc {
+
+// Number of Power enum values, including Power::NONE
+static constexpr size_t N_POWER_SLOTS = 8;
+
+// Fixed-capacity map keyed by Power, a drop-in replacement for
+// std::unordered_map<Power, V> for orders and orderable locations. Like
+// LocMap, entries are stored in an array indexed by Power with a bitmask
+// tracking occupancy, so lookups don't hash and iteration happens in Power
+// order. Absent entries keep their value, so that e.g. the vectors of a
+// cleared map reuse their capacity when set again; V must have clear().
+template <typename V> class PowerMap {
+public:
+  struct Entry {
+    Power first;
+    V second;
+
+    bool operator==(const Entry &o) const {
+      return first == o.first && second == o.second;
+    }
+  };
+
+  template <typename M, typename E> class iterator_base {
+  public:
+    iterator_base(M *map, size_t i) : map_(map), i_(i) {}
+    E &operator*() const { return map_->entries_[i_]; }
+    E *operator->() const { return &map_->entries_[i_]; }
+    iterator_base &operator++() {
+      i_ = map_->next_from(i_ + 1);
+      return *this;
+    }
+    iterator_base operator++(int) {
+      iterator_base r = *this;
+      ++*this;
+      return r;
+    }
+    bool operator==(const iterator_base &o) const { return i_ == o.i_; }
+    bool operator!=(const iterator_base &o) const { return i_ != o.i_; }
+
+  private:
+    M *map_;
+    size_t i_;
+  };
+
+  using key_type = Power;
+  using mapped_type = V;
+  using value_type = Entry;
+  using iterator = iterator_base<PowerMap, Entry>;
+  using const_iterator = iterator_base<const PowerMap, const Entry>;
+
+  PowerMap() {
+    for (size_t i = 0; i < N_POWER_SLOTS; ++i) {
+      entries_[i].first = static_cast<Power>(i);
+    }
+  }
+  PowerMap(std::initializer_list<std::pair<Power, V>> init) : PowerMap() {
+    for (auto &p : init) {
+      (*this)[p.first] = p.second;
+    }
+  }
+  // Copies and moves skip absent entries
+  PowerMap(const PowerMap &o) : PowerMap() { *this = o; }
+  PowerMap(PowerMap &&o) : PowerMap() { *this = std::move(o); }
+  PowerMap &operator=(const PowerMap &o) {
+    if (this != &o) {
+      for (auto &entry : o) {
+        entries_[static_cast<size_t>(entry.first)].second = entry.second;
+      }
+      present_ = o.present_;
+    }
+    return *this;
+  }
+  PowerMap &operator=(PowerMap &&o) {
+    if (this != &o) {
+      for (auto &entry : o) {
+        entries_[static_cast<size_t>(entry.first)].second =
+            std::move(entry.second);
+      }
+      present_ = o.present_;
+      o.present_ = 0;
+    }
+    return *this;
+  }
+
+  V &operator[](Power power) {
+    size_t i = static_cast<size_t>(power);
+    if (!contains(power)) {
+      present_ |= 1 << i;
+      entries_[i].second.clear();
+    }
+    return entries_[i].second;
+  }
+
+  V &at(Power power) {
+    if (!contains(power)) {
+      throw std::out_of_range("PowerMap::at " + power_str(power));
+    }
+    return entries_[static_cast<size_t>(power)].second;
+  }
+  const V &at(Power power) const {
+    if (!contains(power)) {
+      throw std::out_of_range("PowerMap::at " + power_str(power));
+    }
+    return entries_[static_cast<size_t>(power)].second;
+  }
+
+  iterator find(Power power) {
+    return contains(power) ? iterator(this, static_cast<size_t>(power))
+                           : end();
+  }
+  const_iterator find(Power power) const {
+    return contains(power) ? const_iterator(this, static_cast<size_t>(power))
+                           : end();
+  }
+
+  size_t erase(Power power) {
+    if (!contains(power)) {
+      return 0;
+    }
+    present_ &= ~(1 << static_cast<size_t>(power));
+    return 1;
+  }
+  size_t count(Power power) const { return contains(power) ? 1 : 0; }
+  bool contains(Power power) const {
+    return (present_ >> static_cast<size_t>(power)) & 1;
+  }
+  size_t size() const { return __builtin_popcount(present_); }
+  bool empty() const { return present_ == 0; }
+  void clear() { present_ = 0; }
+
+  iterator begin() { return iterator(this, next_from(0)); }
+  iterator end() { return iterator(this, N_POWER_SLOTS); }
+  const_iterator begin() const { return const_iterator(this, next_from(0)); }
+  const_iterator end() const { return const_iterator(this, N_POWER_SLOTS); }
+
+  bool operator==(const PowerMap &o) const {
+    if (present_ != o.present_) {
+      return false;
+    }
+    for (auto it = begin(); it != end(); ++it) {
+      if (!(it->second == o.entries_[static_cast<size_t>(it->first)].second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator!=(const PowerMap &o) const { return !(*this == o); }
+
+private:
+  // Return the first present index >= i, or N_POWER_SLOTS if there is none
+  size_t next_from(size_t i) const {
+    uint32_t rest = present_ >> i;
+    return rest == 0 ? N_POWER_SLOTS : i + __builtin_ctz(rest);
+  }
+
+  Entry entries_[N_POWER_SLOTS];
+  uint8_t present_ = 0;
+};
+
+} // namespace dipcc
@@ -0,0 +1,167 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <exception>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+#include "replay.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+string units_str(const LocMap<OwnedUnit> &units) {
+  ostringstream ss;
+  for (auto &it : units) {
+    ss << " " << it.second.to_string();
+  }
+  return ss.str();
+}
+
+string centers_str(const LocMap<Power> &centers) {
+  ostringstream ss;
+  for (auto &it : centers) {
+    ss << " " << loc_str(it.first) << ":" << power_str(it.second);
+  }
+  return ss.str();
+}
+
+// The dislodged units of a recorded R-phase state that were disbanded: that
+// its recorded orders do not retreat, or, if the recorded state after it is
+// given, that are not at their retreat's dest there
+LocSet disbanded_locs(const GameState &state,
+                      const PhaseOrders &orders, const GameState *after) {
+  LocSet r;
+  for (auto &it : state.get_dislodged_units_map()) {
+    const OwnedUnit &unit = it.second.unit;
+    bool retreats = false;
+    auto orders_it = orders.find(unit.power);
+    if (orders_it != orders.end()) {
+      for (const Order &order : orders_it->second) {
+        if (order.get_unit().loc == unit.loc &&
+            order.get_type() == OrderType::R) {
+          OwnedUnit retreated = after == nullptr
+                                    ? unit
+                                    : after->get_unit(order.get_dest());
+          retreats = retreated.power == unit.power &&
+                     retreated.type == unit.type;
+        }
+      }
+    }
+    if (!retreats) {
+      r.insert(it.first);
+    }
+  }
+  return r;
+}
+
+// Append to mismatches how got differs from the recorded state expected.
+// Other engines record dislodged units that cannot retreat, which this one
+// disbands at once: recorded units in disbanded that got does not have are
+// not mismatches. Dislodgers are not compared, since states loaded from json
+// do not record them.
+void compare_states(const GameState &expected, const GameState &got,
+                    const LocSet &disbanded, const string &prefix,
+                    vector<string> &mismatches) {
+  const Phase &expected_phase = expected.get_phase();
+  if (expected_phase.phase_type != 'C' &&
+      !(expected_phase == got.get_phase())) {
+    mismatches.push_back(prefix + "phase: expected " +
+                         expected_phase.to_string() + " got " +
+                         got.get_phase().to_string());
+  }
+  if (expected.get_units() != got.get_units()) {
+    mismatches.push_back(prefix + "units: expected" +
+                         units_str(expected.get_units()) + " got" +
+                         units_str(got.get_units()));
+  }
+  if (expected.get_centers() != got.get_centers()) {
+    mismatches.push_back(prefix + "centers: expected" +
+                         centers_str(expected.get_centers()) + " got" +
+                         centers_str(got.get_centers()));
+  }
+  const auto &got_dislodged_map = got.get_dislodged_units_map();
+  LocMap<OwnedUnit> expected_dislodged, got_dislodged;
+  for (auto &it : expected.get_dislodged_units_map()) {
+    if (!disbanded.contains(it.first) || got_dislodged_map.contains(it.first)) {
+      expected_dislodged[it.first] = it.second.unit;
+    }
+  }
+  for (auto &it : got_dislodged_map) {
+    got_dislodged[it.first] = it.second.unit;
+  }
+  if (expected_dislodged != got_dislodged) {
+    mismatches.push_back(prefix + "dislodged: expected" +
+                         units_str(expected_dislodged) + " got" +
+                         units_str(got_dislodged));
+  }
+}
+
+} // namespace
+
+ReplayResult replay_game(Game &game) {
+  ReplayResult r;
+  auto &order_history = game.get_order_history();
+  vector<GameState *> states;
+  for (auto &it : game.get_state_history()) {
+    states.push_back(it.second.get());
+  }
+  states.push_back(&game.get_state());
+
+  for (size_t i = 0; i + 1 < states.size();) {
+    Phase phase = states[i]->get_phase();
+    try {
+      // Lazy: possible orders are not needed to adjudicate, see
+      // GameState::process
+      GameState got =
+          states[i]->process(order_history.get(phase).to_power_map(), false,
+                             true);
+
+      // A recorded R-phase that only disbands is skipped by this engine:
+      // compare with the state after it
+      size_t next_i = i + 1;
+      LocSet disbanded;
+      if (states[next_i]->get_phase().phase_type == 'R') {
+        const GameState &next = *states[next_i];
+        disbanded = disbanded_locs(
+            next, order_history.get(next.get_phase()),
+            next_i + 1 < states.size() ? states[next_i + 1] : nullptr);
+        if (got.get_phase().phase_type != 'R' && next_i + 1 < states.size() &&
+            disbanded.size() == next.get_dislodged_units_map().size()) {
+          ++next_i;
+          disbanded.clear();
+        }
+      }
+      compare_states(*states[next_i], got, disbanded,
+                     phase.to_string() + ": ", r.mismatches);
+      r.n_phases += next_i - i;
+      i = next_i;
+    } catch (const exception &e) {
+      r.error = phase.to_string() + ": " + e.what();
+      return r;
+    }
+  }
+  return r;
+}
+
+ReplayResult replay_game_json(const string &json_str) {
+  optional<Game> game;
+  try {
+    game.emplace(json_str);
+  } catch (const exception &e) {
+    ReplayResult r;
+    r.error = string("load: ") + e.what();
+    return r;
+  }
+  return replay_game(*game);
+}
+
+} // namespace dipcc
@@ -0,0 +1,43 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "game.h"
+
+namespace dipcc {
+
+// Result of re-adjudicating a recorded game, see replay_game
+struct ReplayResult {
+  // Number of phases processed
+  size_t n_phases = 0;
+
+  // One line per phase whose processed state differs from the recorded next
+  // state, e.g. "S1901M: units: expected ... got ..."
+  std::vector<std::string> mismatches;
+
+  // Set if the game could not be loaded or processing threw
+  std::string error;
+
+  bool ok() const { return mismatches.empty() && error.empty(); }
+};
+
+// Process each phase of game's history with its recorded orders and compare
+// the result against the recorded next state: its phase, units, centers and
+// dislodged units. A recorded completed phase matches any phase with the same
+// board, since games also end by draws that adjudication does not decide.
+// Recorded dislodged units that were then disbanded may be missing from the
+// processed state, as this engine disbands units with no retreat at once.
+ReplayResult replay_game(Game &game);
+
+// Same as replay_game(Game(json_str)), recording load errors in the result
+ReplayResult replay_game_json(const std::string &json_str);
+
+} // namespace dipcc
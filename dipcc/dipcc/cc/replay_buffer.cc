@@ -0,0 +1,384 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "checks.h"
+#include "replay_buffer.h"
+
+using namespace std;
+
+namespace dipcc {
+
+// File layout:
+//
+//   header:     see ReplayBuffer::Header, padded to 64 bytes
+//   seqs:       per slot, a u64 sequence number: 0 if never written,
+//               2 * row + 1 while append index row is written to it, and
+//               2 * row + 2 once written. Appends claim a slot with a
+//               compare-exchange, so sequence numbers only grow.
+//   priorities: per slot, a float
+//   rows:       per slot, the fields back to back, each 8-byte aligned
+namespace {
+
+const uint32_t BUFFER_MAGIC = 0x42524944;
+const uint32_t BUFFER_VERSION = 1;
+const size_t MAX_FIELDS = 64;
+const size_t MAX_NAME_LEN = 63;
+const size_t MAX_DIMS = 6;
+
+// A sample gives up after this many draws of rows that are being written
+const int MAX_SAMPLE_ATTEMPTS = 1000000;
+
+struct FieldSpec {
+  char name[MAX_NAME_LEN + 1];
+  int32_t dtype;
+  int32_t ndim;
+  int64_t shape[MAX_DIMS];
+};
+
+size_t align(size_t x, size_t alignment) {
+  return (x + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+static_assert(atomic<uint64_t>::is_always_lock_free &&
+                  atomic<float>::is_always_lock_free,
+              "ReplayBuffer needs lock-free atomics to share them between "
+              "processes");
+
+struct ReplayBuffer::Header {
+  // Written last by the creator
+  atomic<uint32_t> magic;
+  uint32_t version;
+  uint64_t capacity;
+  uint64_t n_fields;
+  FieldSpec fields[MAX_FIELDS];
+  atomic<uint64_t> n_appended;
+  atomic<float> max_priority;
+};
+
+ReplayBuffer::ReplayBuffer(const string &path, size_t capacity,
+                           const TensorDict &example)
+    : rng_(random_device{}()) {
+  JCHECK(capacity > 0, "ReplayBuffer capacity must be positive");
+  JCHECK(!example.empty() && example.size() <= MAX_FIELDS,
+         "ReplayBuffer needs 1 to 64 fields");
+
+  // Fields in name order, so that every process lays rows out alike
+  for (auto &it : example) {
+    JCHECK(it.first.size() <= MAX_NAME_LEN,
+           "ReplayBuffer field name too long: " + it.first);
+    JCHECK(it.first != "sample_idxs" && it.first != "sample_probs",
+           "ReplayBuffer field name is reserved: " + it.first);
+    JCHECK(it.second.dim() >= 1 &&
+               static_cast<size_t>(it.second.dim()) <= MAX_DIMS + 1,
+           "ReplayBuffer field needs 1 to 7 dims: " + it.first);
+    Field field;
+    field.name = it.first;
+    field.dtype = it.second.scalar_type();
+    auto sizes = it.second.sizes();
+    field.shape.assign(sizes.begin() + 1, sizes.end());
+    fields_.push_back(field);
+  }
+  sort(fields_.begin(), fields_.end(),
+       [](const Field &a, const Field &b) { return a.name < b.name; });
+  capacity_ = capacity;
+  init_pointers();
+
+  map(path, size_, true);
+  header_ = new (mapping_.data) Header();
+  header_->version = BUFFER_VERSION;
+  header_->capacity = capacity;
+  header_->n_fields = fields_.size();
+  for (size_t i = 0; i < fields_.size(); ++i) {
+    FieldSpec &spec = header_->fields[i];
+    strncpy(spec.name, fields_[i].name.c_str(), MAX_NAME_LEN);
+    spec.dtype = static_cast<int32_t>(fields_[i].dtype);
+    spec.ndim = fields_[i].shape.size();
+    copy(fields_[i].shape.begin(), fields_[i].shape.end(), spec.shape);
+  }
+  header_->n_appended.store(0);
+  header_->max_priority.store(1.0);
+  init_pointers();
+  for (size_t i = 0; i < capacity_; ++i) {
+    new (&seqs_[i]) atomic<uint64_t>(0);
+    new (&priorities_[i]) atomic<float>(0);
+  }
+  header_->magic.store(BUFFER_MAGIC, memory_order_release);
+}
+
+ReplayBuffer::ReplayBuffer(const string &path) : rng_(random_device{}()) {
+  map(path, 0, false);
+  JCHECK(mapping_.size >= sizeof(Header),
+         "ReplayBuffer file too small: " + path);
+  header_ = reinterpret_cast<Header *>(mapping_.data);
+  JCHECK(header_->magic.load(memory_order_acquire) == BUFFER_MAGIC,
+         "ReplayBuffer bad magic, or not yet created: " + path);
+  JCHECK(header_->version == BUFFER_VERSION,
+         "ReplayBuffer unsupported version: " + path);
+  JCHECK(header_->n_fields <= MAX_FIELDS, "ReplayBuffer bad header: " + path);
+
+  capacity_ = header_->capacity;
+  for (size_t i = 0; i < header_->n_fields; ++i) {
+    const FieldSpec &spec = header_->fields[i];
+    Field field;
+    field.name = string(spec.name, strnlen(spec.name, MAX_NAME_LEN));
+    field.dtype = static_cast<torch::ScalarType>(spec.dtype);
+    field.shape.assign(spec.shape, spec.shape + spec.ndim);
+    fields_.push_back(field);
+  }
+  init_pointers();
+  JCHECK(size_ == mapping_.size, "ReplayBuffer bad file size: " + path);
+}
+
+ReplayBuffer::Mapping::~Mapping() {
+  if (data != nullptr) {
+    munmap(data, size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void ReplayBuffer::map(const string &path, size_t size, bool create) {
+  path_ = path;
+  mapping_.fd = open(path.c_str(),
+                     create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+  JCHECK(mapping_.fd >= 0, "ReplayBuffer could not open: " + path);
+  if (create) {
+    JCHECK(ftruncate(mapping_.fd, size) == 0,
+           "ReplayBuffer could not resize: " + path);
+  } else {
+    struct stat st;
+    JCHECK(fstat(mapping_.fd, &st) == 0,
+           "ReplayBuffer could not stat: " + path);
+    size = st.st_size;
+  }
+
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 mapping_.fd, 0);
+  JCHECK(p != MAP_FAILED, "ReplayBuffer could not mmap: " + path);
+  mapping_.data = static_cast<char *>(p);
+  mapping_.size = size;
+}
+
+// Set the fields' offsets, row_bytes_ and size_ from fields_ and capacity_,
+// and the pointers into the mapping if there is one
+void ReplayBuffer::init_pointers() {
+  row_bytes_ = 0;
+  for (Field &field : fields_) {
+    size_t n_elements = 1;
+    for (int64_t dim : field.shape) {
+      n_elements *= dim;
+    }
+    field.offset = row_bytes_;
+    field.n_bytes = n_elements * c10::elementSize(field.dtype);
+    row_bytes_ += align(field.n_bytes, 8);
+  }
+
+  size_t seqs_offset = align(sizeof(Header), 64);
+  size_t priorities_offset = seqs_offset + capacity_ * sizeof(uint64_t);
+  size_t rows_offset = align(priorities_offset + capacity_ * sizeof(float), 64);
+  size_ = rows_offset + capacity_ * row_bytes_;
+  if (mapping_.data != nullptr) {
+    char *data = mapping_.data;
+    seqs_ = reinterpret_cast<atomic<uint64_t> *>(data + seqs_offset);
+    priorities_ = reinterpret_cast<atomic<float> *>(data + priorities_offset);
+    rows_ = data + rows_offset;
+  }
+}
+
+uint64_t ReplayBuffer::append(const TensorDict &rows) {
+  JCHECK(rows.size() == fields_.size(),
+         "ReplayBuffer append: wrong number of fields");
+  long n = -1;
+  vector<torch::Tensor> values;
+  for (const Field &field : fields_) {
+    auto it = rows.find(field.name);
+    JCHECK(it != rows.end(), "ReplayBuffer append: missing " + field.name);
+    torch::Tensor value =
+        it->second.to(torch::kCPU, field.dtype).contiguous();
+    auto sizes = value.sizes();
+    if (sizes.size() != field.shape.size() + 1 ||
+        !equal(field.shape.begin(), field.shape.end(), sizes.begin() + 1) ||
+        (n >= 0 && sizes[0] != n)) {
+      JFAIL("ReplayBuffer append: wrong shape of " + field.name);
+    }
+    n = sizes[0];
+    values.push_back(value);
+  }
+  JCHECK(static_cast<size_t>(n) <= capacity_,
+         "ReplayBuffer append: more rows than capacity");
+
+  uint64_t first = header_->n_appended.fetch_add(n);
+  float priority = header_->max_priority.load(memory_order_relaxed);
+  for (long i = 0; i < n; ++i) {
+    uint64_t row = first + i;
+    size_t slot = row % capacity_;
+
+    // Claim the slot, so that no two appends write it at once: wait for the
+    // write of an older row, from an append that this one lapped, to finish,
+    // and drop the row if a newer row has claimed the slot already
+    uint64_t seq = seqs_[slot].load(memory_order_acquire);
+    bool claimed = false;
+    while (seq < 2 * row + 1) {
+      if (seq % 2 == 1) {
+        this_thread::yield();
+        seq = seqs_[slot].load(memory_order_acquire);
+      } else if (seqs_[slot].compare_exchange_weak(seq, 2 * row + 1,
+                                                   memory_order_acquire)) {
+        claimed = true;
+        break;
+      }
+    }
+    if (!claimed) {
+      continue;
+    }
+    atomic_thread_fence(memory_order_release);
+    char *dst = rows_ + slot * row_bytes_;
+    for (size_t k = 0; k < fields_.size(); ++k) {
+      const Field &field = fields_[k];
+      memcpy(dst + field.offset,
+             static_cast<const char *>(values[k].data_ptr()) +
+                 i * field.n_bytes,
+             field.n_bytes);
+    }
+    priorities_[slot].store(priority, memory_order_relaxed);
+    seqs_[slot].store(2 * row + 2, memory_order_release);
+  }
+  return first;
+}
+
+TensorDict ReplayBuffer::sample(long batch_size, bool prioritized,
+                                bool pin_memory) {
+  size_t n = size();
+  JCHECK(n > 0, "ReplayBuffer sample: buffer is empty");
+  auto opts = torch::TensorOptions().pinned_memory(pin_memory);
+  TensorDict r;
+  vector<char *> dsts;
+  for (const Field &field : fields_) {
+    vector<int64_t> shape = {batch_size};
+    shape.insert(shape.end(), field.shape.begin(), field.shape.end());
+    torch::Tensor value = torch::empty(shape, opts.dtype(field.dtype));
+    dsts.push_back(static_cast<char *>(value.data_ptr()));
+    r[field.name] = value;
+  }
+  torch::Tensor idxs = torch::empty({batch_size}, opts.dtype(torch::kLong));
+  torch::Tensor probs =
+      torch::empty({batch_size}, opts.dtype(torch::kFloat32));
+  int64_t *idxs_p = idxs.data_ptr<int64_t>();
+  float *probs_p = probs.data_ptr<float>();
+
+  // Cumulative priorities, read once: rows appended meanwhile keep the
+  // priority their slot had
+  vector<double> cum;
+  double total = 0;
+  if (prioritized) {
+    cum.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      total += max(priorities_[i].load(memory_order_relaxed), 0.0f);
+      cum[i] = total;
+    }
+    JCHECK(total > 0, "ReplayBuffer sample: all priorities are 0");
+  }
+
+  lock_guard<mutex> lock(rng_mutex_);
+  uniform_int_distribution<size_t> uniform_slot(0, n - 1);
+  uniform_real_distribution<double> uniform_priority(0, total);
+  int attempts = 0;
+  for (long b = 0; b < batch_size; ++b) {
+    while (true) {
+      JCHECK(++attempts < MAX_SAMPLE_ATTEMPTS,
+             "ReplayBuffer sample: no complete rows");
+      size_t slot =
+          prioritized
+              ? min<size_t>(upper_bound(cum.begin(), cum.end(),
+                                        uniform_priority(rng_)) -
+                                cum.begin(),
+                            n - 1)
+              : uniform_slot(rng_);
+
+      // Copy the row, and retry if it was being written meanwhile
+      uint64_t seq = seqs_[slot].load(memory_order_acquire);
+      if (seq == 0 || seq % 2 == 1) {
+        continue;
+      }
+      const char *src = rows_ + slot * row_bytes_;
+      for (size_t k = 0; k < fields_.size(); ++k) {
+        const Field &field = fields_[k];
+        memcpy(dsts[k] + b * field.n_bytes, src + field.offset,
+               field.n_bytes);
+      }
+      atomic_thread_fence(memory_order_acquire);
+      if (seqs_[slot].load(memory_order_relaxed) != seq) {
+        continue;
+      }
+
+      idxs_p[b] = slot;
+      probs_p[b] = prioritized
+                       ? (cum[slot] - (slot > 0 ? cum[slot - 1] : 0)) / total
+                       : 1.0 / n;
+      break;
+    }
+  }
+  r["sample_idxs"] = idxs;
+  r["sample_probs"] = probs;
+  return r;
+}
+
+void ReplayBuffer::set_priorities(torch::Tensor idxs,
+                                  torch::Tensor priorities) {
+  idxs = idxs.to(torch::kCPU, torch::kLong).contiguous();
+  priorities = priorities.to(torch::kCPU, torch::kFloat32).contiguous();
+  JCHECK(idxs.dim() == 1 && priorities.sizes() == idxs.sizes(),
+         "ReplayBuffer set_priorities: idxs and priorities differ in shape");
+  const int64_t *idxs_p = idxs.data_ptr<int64_t>();
+  const float *priorities_p = priorities.data_ptr<float>();
+  float max_priority = header_->max_priority.load();
+  for (long i = 0; i < idxs.size(0); ++i) {
+    JCHECK(idxs_p[i] >= 0 && static_cast<size_t>(idxs_p[i]) < capacity_,
+           "ReplayBuffer set_priorities: idx out of range");
+    priorities_[idxs_p[i]].store(priorities_p[i], memory_order_relaxed);
+    max_priority = max(max_priority, priorities_p[i]);
+  }
+  float old = header_->max_priority.load();
+  while (old < max_priority &&
+         !header_->max_priority.compare_exchange_weak(old, max_priority)) {
+  }
+}
+
+void ReplayBuffer::seed(uint64_t seed) {
+  lock_guard<mutex> lock(rng_mutex_);
+  rng_.seed(seed);
+}
+
+uint64_t ReplayBuffer::get_n_appended() const {
+  return header_->n_appended.load();
+}
+
+size_t ReplayBuffer::size() const {
+  return min<uint64_t>(get_n_appended(), capacity_);
+}
+
+vector<string> ReplayBuffer::get_field_names() const {
+  vector<string> r;
+  for (const Field &field : fields_) {
+    r.push_back(field.name);
+  }
+  return r;
+}
+
+} // namespace dipcc
@@ -0,0 +1,119 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <torch/torch.h>
+#include <vector>
+
+#include "data_fields.h"
+
+namespace dipcc {
+
+// Fixed-capacity ring buffer of training rows (e.g. encoded phases with
+// their actions and rewards) in a memory-mapped file, shared by processes:
+// put it under /dev/shm for shared memory. One process creates it, rollout
+// processes attach and append, and the trainer samples batches from it.
+//
+// Rows have fixed fields, each a tensor of a fixed dtype and shape, given
+// by an example row at creation. Storing compact dtypes (e.g. PACKED board
+// states, int16 order idxs) keeps rows small. Appends from any number of
+// processes and threads are lock-free; a batch of rows appended at once is
+// contiguous in append order. Once full, the oldest rows are overwritten;
+// an append that laps a slot still being written waits for that write.
+// Sampling skips rows being written, so it never returns a torn row.
+class ReplayBuffer {
+public:
+  // Create a buffer of capacity rows at path, replacing any file there. The
+  // fields are those of example, [n, ...] rows as for append: e.g.
+  // "x_board_state" a [n, 81, 5] uint8 tensor for rows of [81, 5].
+  ReplayBuffer(const std::string &path, size_t capacity,
+               const TensorDict &example);
+
+  // Attach to the buffer created at path, e.g. by another process
+  ReplayBuffer(const std::string &path);
+
+  ReplayBuffer(const ReplayBuffer &) = delete;
+  ReplayBuffer &operator=(const ReplayBuffer &) = delete;
+
+  // Append rows: each field of the buffer as a [n, ...] tensor, cast to the
+  // field's dtype. New rows get the highest priority set so far. Returns the
+  // append index of the first row; rows are numbered from 0 in append order.
+  uint64_t append(const TensorDict &rows);
+
+  // Return batch_size rows sampled with replacement, uniformly or, if
+  // prioritized, in proportion to their priorities, as [batch_size, ...]
+  // tensors, optionally in pinned memory. Also returns "sample_idxs", the
+  // [batch_size] int64 slots of the rows for set_priorities, and
+  // "sample_probs", their [batch_size] float sampling probabilities for
+  // importance weights.
+  TensorDict sample(long batch_size, bool prioritized = false,
+                    bool pin_memory = false);
+
+  // Set the priorities of the rows at slots idxs, as returned by sample
+  void set_priorities(torch::Tensor idxs, torch::Tensor priorities);
+
+  // Seed the RNG of sample, randomly seeded otherwise
+  void seed(uint64_t seed);
+
+  size_t get_capacity() const { return capacity_; }
+
+  // Number of rows appended (or being appended) so far
+  uint64_t get_n_appended() const;
+
+  // Number of rows that can be sampled, at most the capacity
+  size_t size() const;
+
+  std::vector<std::string> get_field_names() const;
+
+private:
+  struct Field {
+    std::string name;
+    torch::ScalarType dtype;
+    std::vector<int64_t> shape;
+    size_t offset; // in the row
+    size_t n_bytes;
+  };
+  struct Header;
+
+  // The open file and its mapping, released on destruction, including when
+  // a constructor throws
+  struct Mapping {
+    int fd = -1;
+    char *data = nullptr;
+    size_t size = 0;
+
+    Mapping() {}
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+    ~Mapping();
+  };
+
+  void map(const std::string &path, size_t size, bool create);
+  void init_pointers();
+
+  std::string path_;
+  Mapping mapping_;
+  size_t size_ = 0; // of the layout, see init_pointers
+
+  Header *header_ = nullptr;
+  std::atomic<uint64_t> *seqs_ = nullptr;  // [capacity], see append
+  std::atomic<float> *priorities_ = nullptr; // [capacity]
+  char *rows_ = nullptr;
+  size_t capacity_ = 0;
+  size_t row_bytes_ = 0;
+  std::vector<Field> fields_;
+
+  std::mutex rng_mutex_;
+  std::mt19937_64 rng_;
+};
+
+} // namespace dipcc
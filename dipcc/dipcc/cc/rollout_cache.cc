@@ -0,0 +1,148 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+
+#include "checks.h"
+#include "rollout_cache.h"
+#include "zobrist.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+uint64_t hash_order(Power power, const Order &order) {
+  return zobrist::detail::splitmix64(
+      (static_cast<uint64_t>(power) << 32) | order.get_id());
+}
+
+} // namespace
+
+RolloutCache::RolloutCache(size_t capacity, size_t n_shards) {
+  JCHECK(capacity > 0 && n_shards > 0, "RolloutCache empty capacity");
+  n_shards = std::min(n_shards, capacity);
+  shard_capacity_ = (capacity + n_shards - 1) / n_shards;
+  for (size_t i = 0; i < n_shards; ++i) {
+    shards_.push_back(make_unique<Shard>());
+  }
+}
+
+uint64_t RolloutCache::hash_orders(const PowerMap<vector<Order>> &orders) {
+  uint64_t r = 0;
+  for (auto & [ power, power_orders ] : orders) {
+    for (const Order &order : power_orders) {
+      r += hash_order(power, order);
+    }
+  }
+  return r;
+}
+
+uint64_t RolloutCache::hash_orders(const PowerOrderStrs &orders) {
+  uint64_t r = 0;
+  for (auto & [ power_s, order_strs ] : orders) {
+    Power power = power_from_str(power_s);
+    for (const string &order_str : order_strs) {
+      if (order_str == "WAIVE") {
+        continue;
+      }
+      r += hash_order(power, Order(order_str));
+    }
+  }
+  return r;
+}
+
+bool RolloutCache::get(const Key &key, Values &values) {
+  Shard &shard = get_shard(key);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      Entry &entry = shard.slots[it->second];
+      entry.referenced = true;
+      values = entry.values;
+      ++hits_;
+      return true;
+    }
+  }
+  ++misses_;
+  return false;
+}
+
+void RolloutCache::put(const Key &key, const Values &values) {
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    shard.slots[it->second].values = values;
+    shard.slots[it->second].referenced = true;
+    return;
+  }
+
+  if (shard.slots.size() < shard_capacity_) {
+    shard.index[key] = shard.slots.size();
+    shard.slots.push_back({key, values, false});
+    return;
+  }
+
+  // Clock: evict the first entry not referenced since the hand last passed
+  while (shard.slots[shard.hand].referenced) {
+    shard.slots[shard.hand].referenced = false;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+  }
+  Entry &victim = shard.slots[shard.hand];
+  shard.index.erase(victim.key);
+  victim = {key, values, false};
+  shard.index[key] = shard.hand;
+  shard.hand = (shard.hand + 1) % shard.slots.size();
+}
+
+vector<optional<RolloutCache::Values>>
+RolloutCache::get_multi(const Game &game,
+                        const vector<PowerOrderStrs> &orders) {
+  uint64_t board_hash = game.compute_board_hash();
+  vector<optional<Values>> r(orders.size());
+  for (size_t i = 0; i < orders.size(); ++i) {
+    Values values;
+    if (get({board_hash, hash_orders(orders[i])}, values)) {
+      r[i] = values;
+    }
+  }
+  return r;
+}
+
+void RolloutCache::put_multi(const vector<Key> &keys,
+                             const vector<Values> &values) {
+  JCHECK(keys.size() == values.size(), "RolloutCache::put_multi size mismatch");
+  for (size_t i = 0; i < keys.size(); ++i) {
+    put(keys[i], values[i]);
+  }
+}
+
+size_t RolloutCache::size() const {
+  size_t r = 0;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    r += shard->slots.size();
+  }
+  return r;
+}
+
+void RolloutCache::clear() {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->index.clear();
+    shard->slots.clear();
+    shard->hand = 0;
+  }
+  hits_ = 0;
+  misses_ = 0;
+}
+
+} // namespace dipcc
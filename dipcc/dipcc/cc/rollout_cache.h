@@ -0,0 +1,101 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "game.h"
+#include "order.h"
+#include "power.h"
+
+namespace dipcc {
+
+// Thread-safe, fixed-capacity table of rollout results (one value per power,
+// e.g. square scores), keyed by the board hash of the state the rollout
+// started from and a hash of the joint orders set on it.
+//
+// The table is split into shards, each with its own lock, and each shard
+// evicts with the clock (second chance) algorithm once full.
+class RolloutCache {
+public:
+  using Key = std::pair<uint64_t, uint64_t>; // (board hash, orders hash)
+  using Values = std::array<float, 7>;
+
+  RolloutCache(size_t capacity, size_t n_shards = 16);
+
+  // Order-independent hash of joint orders, over powers and within powers
+  static uint64_t hash_orders(const PowerMap<std::vector<Order>> &orders);
+  static uint64_t hash_orders(const PowerOrderStrs &orders);
+
+  static Key make_key(const Game &game, const PowerOrderStrs &orders) {
+    return {game.compute_board_hash(), hash_orders(orders)};
+  }
+  // Key of the orders staged on game, e.g. by set_orders before a rollout
+  static Key make_key(const Game &game) {
+    return {game.compute_board_hash(), hash_orders(game.get_staged_orders())};
+  }
+
+  // Return true and fill values if key is present
+  bool get(const Key &key, Values &values);
+  void put(const Key &key, const Values &values);
+
+  // Look up one result per joint orders set on game
+  std::vector<std::optional<Values>>
+  get_multi(const Game &game, const std::vector<PowerOrderStrs> &orders);
+  void put(const Game &game, const PowerOrderStrs &orders,
+           const Values &values) {
+    put(make_key(game, orders), values);
+  }
+  void put_multi(const std::vector<Key> &keys,
+                 const std::vector<Values> &values);
+
+  size_t size() const;
+  size_t get_capacity() const { return shard_capacity_ * shards_.size(); }
+  uint64_t get_hits() const { return hits_; }
+  uint64_t get_misses() const { return misses_; }
+  void clear();
+
+private:
+  struct HashKey {
+    size_t operator()(const Key &key) const {
+      return key.first ^ (key.second * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    Values values;
+    bool referenced;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, size_t, HashKey> index; // key -> slot
+    std::vector<Entry> slots;
+    size_t hand = 0;
+  };
+
+  Shard &get_shard(const Key &key) {
+    return *shards_[(HashKey()(key) >> 32) % shards_.size()];
+  }
+
+  size_t shard_capacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace dipcc
@@ -0,0 +1,311 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "checks.h"
+#include "order_sampling.h"
+#include "orders_encoder.h"
+#include "power.h"
+#include "rollouts.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+// Earliest phase of the games that are not done
+optional<Phase> get_min_phase(const vector<Game *> &games) {
+  optional<Phase> r;
+  for (Game *game : games) {
+    if (game->is_game_done()) {
+      continue;
+    }
+    Phase phase = game->get_state().get_phase();
+    if (!r || phase < *r) {
+      r = phase;
+    }
+  }
+  return r;
+}
+
+bool all_powers_staged(const vector<Game *> &games) {
+  for (Game *game : games) {
+    if (game->get_staged_orders().size() < 7) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Copy of order_idxs with the rows of the powers that have staged orders set
+// to EOS_IDX, so that set_orders_from_idxs leaves them unchanged
+torch::Tensor mask_staged_powers(torch::Tensor order_idxs,
+                                 const vector<Game *> &games) {
+  order_idxs = order_idxs_to_cpu(order_idxs).clone();
+  for (int i = 0; i < games.size(); ++i) {
+    for (auto &it : games[i]->get_staged_orders()) {
+      order_idxs[i][static_cast<int>(it.first) - 1].fill_(
+          OrdersEncoder::EOS_IDX);
+    }
+  }
+  return order_idxs;
+}
+
+// The rows of x, which encodes x_games, for games, if games is a
+// subsequence of x_games
+optional<TensorDict> select_rows(const TensorDict &x,
+                                 const vector<Game *> &x_games,
+                                 const vector<Game *> &games) {
+  if (x_games.empty()) {
+    return {};
+  }
+  if (games == x_games) {
+    return x;
+  }
+
+  vector<long> idxs;
+  size_t j = 0;
+  for (Game *game : games) {
+    while (j < x_games.size() && x_games[j] != game) {
+      ++j;
+    }
+    if (j == x_games.size()) {
+      return {};
+    }
+    idxs.push_back(j++);
+  }
+  return index_select_fields(x, torch::tensor(idxs, torch::kLong));
+}
+
+// Whether a power owns at least n centers
+bool has_solo_centers(const GameState &state, int n) {
+  array<int, 8> counts{};
+  for (auto &it : state.get_centers()) {
+    if (it.second != Power::NONE &&
+        ++counts[static_cast<int>(it.second)] >= n) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Record the centers of a spring movement phase, keeping the last years + 1
+// springs, and return whether they are unchanged over years years, like
+// Game::maybe_early_exit
+bool is_stalemate(const GameState &state, int years,
+                  vector<pair<uint32_t, uint64_t>> &springs) {
+  Phase phase = state.get_phase();
+  if (phase.season != 'S' || phase.phase_type != 'M') {
+    return false;
+  }
+  if (springs.empty() || springs.back().first < phase.year) {
+    springs.push_back({phase.year, state.get_centers_hash()});
+  }
+  size_t n_springs = years + 1;
+  if (springs.size() > n_springs) {
+    springs.erase(springs.begin(), springs.end() - n_springs);
+  }
+  if (springs.size() < n_springs ||
+      static_cast<int>(springs.back().first - springs.front().first) !=
+          years) {
+    return false;
+  }
+  for (auto &it : springs) {
+    if (it.second != springs.back().second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Drop the games that meet a predicate of stop, other than the value cutoff,
+// from active
+void stop_games(vector<Game *> &active, const RolloutStopOptions &stop,
+                unordered_map<Game *, vector<pair<uint32_t, uint64_t>>>
+                    &springs) {
+  if (stop.solo_centers <= 0 && stop.stalemate_years <= 0 &&
+      stop.max_year <= 0) {
+    return;
+  }
+  auto should_stop = [&](Game *game) {
+    const GameState &state = game->get_state();
+    return (stop.max_year > 0 && state.get_phase().year >= stop.max_year) ||
+           (stop.solo_centers > 0 &&
+            has_solo_centers(state, stop.solo_centers)) ||
+           (stop.stalemate_years > 0 &&
+            is_stalemate(state, stop.stalemate_years, springs[game]));
+  };
+  active.erase(remove_if(active.begin(), active.end(), should_stop),
+               active.end());
+}
+
+// Drop the games of to_step that are decided, i.e. whose values give a
+// power at least stop.value_cutoff, from to_step and active. Return the idxs
+// in to_step of the games kept.
+vector<long> drop_decided(torch::Tensor values, vector<Game *> &to_step,
+                          vector<Game *> &active,
+                          const RolloutStopOptions &stop) {
+  JCHECK(values.defined(), "run_rollouts: value_cutoff without values");
+  values = values.to(torch::kCPU, torch::kFloat);
+  JCHECK(values.dim() == 2 && values.size(0) == to_step.size() &&
+             values.size(1) == 7,
+         "run_rollouts: values must be [B, 7]");
+  torch::Tensor max_values = std::get<0>(values.max(1)).contiguous();
+  const float *max_values_ptr = max_values.data_ptr<float>();
+
+  vector<long> kept;
+  vector<Game *> undecided;
+  unordered_set<Game *> stopped;
+  for (size_t i = 0; i < to_step.size(); ++i) {
+    if (max_values_ptr[i] >= stop.value_cutoff) {
+      stopped.insert(to_step[i]);
+    } else {
+      kept.push_back(i);
+      undecided.push_back(to_step[i]);
+    }
+  }
+  if (!stopped.empty()) {
+    active.erase(remove_if(active.begin(), active.end(),
+                           [&](Game *game) { return stopped.count(game) > 0; }),
+                 active.end());
+    to_step = std::move(undecided);
+  }
+  return kept;
+}
+
+} // namespace
+
+int run_rollouts(ThreadPool &pool, vector<Game *> &games, int max_move_phases,
+                 const RolloutPolicy &policy, const RolloutStopOptions &stop) {
+  JCHECK(stop.value_cutoff <= 0 || stop.values,
+         "run_rollouts: value_cutoff without values");
+  return run_rollouts(
+      pool, games, max_move_phases,
+      [&policy](const TensorDict &x) {
+        return make_pair(policy(x), torch::Tensor());
+      },
+      stop);
+}
+
+int run_rollouts(ThreadPool &pool, vector<Game *> &games, int max_move_phases,
+                 const RolloutPolicyValues &policy,
+                 const RolloutStopOptions &stop) {
+  JCHECK(max_move_phases >= 0, "run_rollouts: negative max_move_phases");
+  optional<Phase> start_phase = get_min_phase(games);
+  if (!start_phase) {
+    return 0;
+  }
+  // If max_move_phases is 0, really far ahead, but for one step
+  Phase end_phase = n_move_phases_later(
+      *start_phase, max_move_phases > 0 ? max_move_phases : 10);
+  int max_steps =
+      max_move_phases > 0 ? numeric_limits<int>::max() : 1;
+
+  // Inputs of the games stepped last, encoded by step_and_encode_multi
+  vector<Game *> x_games;
+  TensorDict x;
+
+  // Games not stopped early (see RolloutStopOptions), and the springs
+  // compared for stalemates
+  vector<Game *> active = games;
+  unordered_map<Game *, vector<pair<uint32_t, uint64_t>>> springs;
+
+  int step = 0;
+  for (; step < max_steps; ++step) {
+    stop_games(active, stop, springs);
+
+    // Step games together at the pace of the slowest game, e.g. process games
+    // with retreat phases alone before moving on to the next movement phase
+    optional<Phase> min_phase = get_min_phase(active);
+    if (!min_phase || *min_phase >= end_phase) {
+      break;
+    }
+    vector<Game *> to_step;
+    for (Game *game : active) {
+      if (!game->is_game_done() &&
+          game->get_state().get_phase() == *min_phase) {
+        to_step.push_back(game);
+      }
+    }
+
+    if (step == 0 && all_powers_staged(to_step)) {
+      pool.process_multi(to_step);
+      x_games.clear();
+      continue;
+    }
+
+    // Adjustment phases with no choices to make are processed without orders
+    vector<Game *> forced, to_query;
+    for (Game *game : to_step) {
+      (game->get_state().is_forced_phase() ? forced : to_query)
+          .push_back(game);
+    }
+    if (!forced.empty()) {
+      pool.process_multi(forced);
+      if (to_query.empty()) {
+        x_games.clear();
+        continue;
+      }
+      to_step = to_query;
+    }
+
+    optional<TensorDict> to_step_x = select_rows(x, x_games, to_step);
+    if (!to_step_x) {
+      to_step_x = pool.encode_inputs_multi(to_step);
+    }
+
+    // Drop the games decided according to their values: those of
+    // stop.values before querying the policy, or else the policy's
+    bool value_cutoff = stop.value_cutoff > 0 && min_phase->phase_type == 'M';
+    if (value_cutoff && stop.values) {
+      size_t n_to_step = to_step.size();
+      vector<long> kept =
+          drop_decided(stop.values(*to_step_x), to_step, active, stop);
+      if (kept.empty()) {
+        --step; // nothing was stepped
+        continue;
+      }
+      if (kept.size() < n_to_step) {
+        to_step_x = index_select_fields(*to_step_x,
+                                        torch::tensor(kept, torch::kLong));
+      }
+    }
+
+    auto policy_output = policy(*to_step_x);
+    torch::Tensor order_idxs = policy_output.first;
+    JCHECK(order_idxs.dim() == 3 && order_idxs.size(0) == to_step.size(),
+           "run_rollouts: policy must return [B, 7, S] order idxs");
+    if (value_cutoff && !stop.values) {
+      size_t n_to_step = to_step.size();
+      vector<long> kept =
+          drop_decided(policy_output.second, to_step, active, stop);
+      if (kept.empty()) {
+        --step; // nothing was stepped
+        continue;
+      }
+      if (kept.size() < n_to_step) {
+        order_idxs = order_idxs.index_select(
+            0, torch::tensor(kept, torch::kLong).to(order_idxs.device()));
+      }
+    }
+    if (step == 0) {
+      order_idxs = mask_staged_powers(order_idxs, to_step);
+    }
+    x = pool.step_and_encode_multi(to_step, order_idxs);
+    x_games = to_step;
+  }
+  return step;
+}
+
+} // namespace dipcc
@@ -0,0 +1,87 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <functional>
+#include <torch/torch.h>
+#include <utility>
+#include <vector>
+
+#include "data_fields.h"
+#include "game.h"
+#include "phase.h"
+#include "thread_pool.h"
+
+namespace dipcc {
+
+// Batched policy for rollouts: given the encode_inputs_multi inputs of B
+// games, return their [B, 7, S] order vocabulary idxs, as sampled by the
+// model (see ThreadPool::set_orders_from_idxs), on any device. Called from
+// the thread that runs the rollouts, once per ply. It must not keep the
+// inputs.
+using RolloutPolicy = std::function<torch::Tensor(const TensorDict &)>;
+
+// Batched value estimate for rollouts: given the encode_inputs_multi inputs
+// of B games, return their [B, 7] estimated final scores, on any device
+using RolloutValues = std::function<torch::Tensor(const TensorDict &)>;
+
+// A RolloutPolicy that also returns the RolloutValues of its inputs, e.g.
+// from the same model call: (order idxs, values). Values may be undefined
+// unless they are used for RolloutStopOptions::value_cutoff.
+using RolloutPolicyValues =
+    std::function<std::pair<torch::Tensor, torch::Tensor>(const TensorDict &)>;
+
+// Early termination of run_rollouts: games for which any enabled predicate
+// holds before a ply stop there, in their current phase, and are dropped
+// from the batch, so that the policy is queried and the pool steps only for
+// the games still undecided. All are disabled by default.
+struct RolloutStopOptions {
+  // A power owns at least this many centers, e.g. fewer than the 18 of a
+  // solo, which ends the game anyway
+  int solo_centers = 0;
+
+  // The centers are unchanged over this many years of the rollout, compared
+  // in spring movement phases like Game::set_draw_on_stalemate_years, but
+  // without ending the game
+  int stalemate_years = 0;
+
+  // The game reached this year
+  int max_year = 0;
+
+  // In movement phases, values of the inputs the policy is queried with give
+  // a power at least value_cutoff, if positive. The values are those
+  // returned by a RolloutPolicyValues, unless values is set, which costs a
+  // call per movement ply but spares querying the policy for decided games.
+  float value_cutoff = 0;
+  RolloutValues values;
+};
+
+// Step the games in place with policy orders, like
+// ThreadedSearchAgent.do_rollouts: games are stepped together at the pace of
+// the slowest one, until all are done or have reached the movement phase
+// max_move_phases after the earliest starting phase. If max_move_phases is 0,
+// only the first phase is processed.
+//
+// On the first ply, powers that have staged orders (see
+// Game::get_staged_orders) keep them, and the policy is not queried if all
+// powers of all games have them. Nor is it queried for games in adjustment
+// phases with no choices to make (see GameState::is_forced_phase). Each ply
+// sets orders, processes and re-encodes the games in a single pass of the
+// pool's threads.
+//
+// Games may also stop early, see RolloutStopOptions.
+//
+// Returns the number of plies.
+int run_rollouts(ThreadPool &pool, std::vector<Game *> &games,
+                 int max_move_phases, const RolloutPolicyValues &policy,
+                 const RolloutStopOptions &stop = {});
+int run_rollouts(ThreadPool &pool, std::vector<Game *> &games,
+                 int max_move_phases, const RolloutPolicy &policy,
+                 const RolloutStopOptions &stop = {});
+
+} // namespace dipcc
@@ -0,0 +1,107 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "checks.h"
+#include "search_store.h"
+
+using namespace std;
+
+namespace dipcc {
+
+namespace {
+
+// A RolloutCache slot and its index node, approximately
+const size_t ROLLOUT_ENTRY_BYTES = 96;
+
+// A store entry's list and index nodes, approximately
+const size_t ENTRY_OVERHEAD_BYTES = 96;
+
+} // namespace
+
+SearchStore::SearchStore(size_t max_bytes)
+    : max_bytes_(max_bytes), max_orders_bytes_(max_bytes / 2) {
+  JCHECK(max_bytes >= 2 * ROLLOUT_ENTRY_BYTES, "SearchStore budget too small");
+  rollouts_ = make_shared<RolloutCache>(
+      (max_bytes - max_orders_bytes_) / ROLLOUT_ENTRY_BYTES);
+}
+
+size_t SearchStore::estimate_bytes(const PlausibleOrders &orders) {
+  size_t r = ENTRY_OVERHEAD_BYTES + sizeof(PlausibleOrders);
+  for (const auto &actions : orders) {
+    r += actions.capacity() * sizeof(actions[0]);
+    for (const auto &action : actions) {
+      r += action.first.capacity() * sizeof(string);
+      for (const string &order : action.first) {
+        // Orders are short enough for the small string buffer
+        r += order.size() >= sizeof(string) ? order.capacity() + 1 : 0;
+      }
+    }
+  }
+  return r;
+}
+
+shared_ptr<const SearchStore::PlausibleOrders>
+SearchStore::get_plausible_orders(uint64_t board_hash) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(board_hash);
+  if (it == index_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->orders;
+}
+
+void SearchStore::put_plausible_orders(uint64_t board_hash,
+                                       PlausibleOrders orders) {
+  size_t bytes = estimate_bytes(orders);
+  if (bytes > max_orders_bytes_) {
+    return;
+  }
+  auto value = make_shared<const PlausibleOrders>(std::move(orders));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(board_hash);
+  if (it != index_.end()) {
+    orders_bytes_ -= it->second->bytes;
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+  while (orders_bytes_ + bytes > max_orders_bytes_) {
+    orders_bytes_ -= lru_.back().bytes;
+    index_.erase(lru_.back().board_hash);
+    lru_.pop_back();
+  }
+  lru_.push_front({board_hash, std::move(value), bytes});
+  index_[board_hash] = lru_.begin();
+  orders_bytes_ += bytes;
+}
+
+size_t SearchStore::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return index_.size();
+}
+
+size_t SearchStore::get_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return orders_bytes_ + rollouts_->size() * ROLLOUT_ENTRY_BYTES;
+}
+
+void SearchStore::clear() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    orders_bytes_ = 0;
+  }
+  rollouts_->clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+} // namespace dipcc
@@ -0,0 +1,78 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rollout_cache.h"
+
+namespace dipcc {
+
+// What a search learned about positions, kept across the searches of
+// consecutive moves of a game under a memory budget: per board (see
+// GameState::stable_board_hash), the plausible actions of each power with
+// their blueprint logprobs, and the rollout results of joint actions on it.
+//
+// Half of the budget goes to a RolloutCache, the other half to plausible
+// orders, evicting the least recently used boards. Thread-safe.
+class SearchStore {
+public:
+  using Action = std::vector<std::string>;
+  // Per power (in POWERS order), actions and their blueprint logprobs
+  using PlausibleOrders =
+      std::array<std::vector<std::pair<Action, float>>, 7>;
+
+  explicit SearchStore(size_t max_bytes);
+
+  // Return nullptr on a miss
+  std::shared_ptr<const PlausibleOrders>
+  get_plausible_orders(uint64_t board_hash);
+  void put_plausible_orders(uint64_t board_hash, PlausibleOrders orders);
+
+  // Rollout results from boards searched before, to seed new searches with
+  std::shared_ptr<RolloutCache> get_rollout_cache() { return rollouts_; }
+
+  size_t size() const;
+  size_t get_bytes() const;
+  size_t get_max_bytes() const { return max_bytes_; }
+  uint64_t get_hits() const { return hits_; }
+  uint64_t get_misses() const { return misses_; }
+  // Clear the plausible orders, the rollout results and the stats
+  void clear();
+
+private:
+  struct Entry {
+    uint64_t board_hash;
+    std::shared_ptr<const PlausibleOrders> orders;
+    size_t bytes;
+  };
+
+  static size_t estimate_bytes(const PlausibleOrders &orders);
+
+  size_t max_bytes_;
+  size_t max_orders_bytes_;
+  std::shared_ptr<RolloutCache> rollouts_;
+
+  mutable std::mutex mutex_;
+  std::list<Entry> lru_; // most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  size_t orders_bytes_ = 0;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace dipcc
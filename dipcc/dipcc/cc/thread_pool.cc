@@ -5,94 +5,1209 @@ This source code is licensed under the MIT license found in the
 LICENSE file in the root directory of this source tree.
 */
 
+#include <algorithm>
+#include <ctime>
+
 #include "thread_pool.h"
+#include "arena.h"
 #include "checks.h"
 #include "data_fields.h"
 #include "encoding.h"
+#include "numa.h"
+#include "order_sampling.h"
+#include "perf_stats.h"
+#include "trace.h"
+#include "zobrist.h"
 
 using namespace std;
 
 namespace dipcc {
 
+namespace {
+
+const char *job_type_name(ThreadPoolJobType job_type) {
+  switch (job_type) {
+  case ThreadPoolJobType::STEP:
+    return "step";
+  case ThreadPoolJobType::ENCODE:
+    return "encode";
+  case ThreadPoolJobType::ENCODE_STATE_ONLY:
+    return "encode_state_only";
+  case ThreadPoolJobType::ENCODE_ALL_POWERS:
+    return "encode_all_powers";
+  case ThreadPoolJobType::PROCESS_MANY:
+    return "process_many";
+  case ThreadPoolJobType::LOAD_CORPUS:
+    return "load_corpus";
+  case ThreadPoolJobType::STEP_AND_ENCODE:
+    return "step_and_encode";
+  case ThreadPoolJobType::CLONE:
+    return "clone";
+  case ThreadPoolJobType::DATASET_TARGETS:
+    return "dataset_targets";
+  case ThreadPoolJobType::PLAYOUT:
+    return "playout";
+  case ThreadPoolJobType::REPLAY:
+    return "replay";
+  case ThreadPoolJobType::SOS_TARGETS:
+    return "sos_targets";
+  case ThreadPoolJobType::CAT_PAD:
+    return "cat_pad";
+  case ThreadPoolJobType::CORPUS_HASHES:
+    return "corpus_hashes";
+  case ThreadPoolJobType::ROLLOUT_CACHE:
+    return "rollout_cache";
+  }
+  return "unknown";
+}
+
+// CPU time of the calling thread
+uint64_t get_thread_cpu_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Games (or other items) done by job
+size_t job_n_items(const ThreadPoolJob &job) {
+  return job.orders_idxs.empty() ? job.games.size() : job.orders_idxs.size();
+}
+
+// Poll done for up to spin_us microseconds, returning whether it is true
+template <typename F> bool spin_until(F done, int spin_us) {
+  if (spin_us <= 0 || done()) {
+    return done();
+  }
+  auto deadline = chrono::steady_clock::now() + chrono::microseconds(spin_us);
+  while (!done()) {
+    if (chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+  return true;
+}
+
+thread_local ThreadPoolPriority thread_pool_priority =
+    ThreadPoolPriority::INTERACTIVE;
+
+// Point row i's board state pointers at the batch's fields, whatever their
+// BoardStateFormat, or at its prev state delta
+void set_board_state_rows(ThreadPoolBatch &batch, long i,
+                          EncodingArrayPointers &pointers) {
+  TensorDict &fields = batch.fields;
+  torch::Tensor board_state = fields["x_board_state"].index({i});
+  pointers.board_state_format = get_board_state_format(board_state);
+  bool float32 = pointers.board_state_format == BoardStateFormat::FLOAT32;
+  if (float32) {
+    pointers.x_board_state = board_state.data_ptr<float>();
+  } else {
+    pointers.x_board_state_out = board_state.data_ptr();
+  }
+
+  auto prev_it = fields.find("x_prev_state");
+  if (prev_it == fields.end()) {
+    if (batch.prev_state_deltas.empty()) {
+      batch.prev_state_deltas.resize(fields["x_board_state"].size(0));
+    }
+    pointers.x_prev_state_delta = &batch.prev_state_deltas[i];
+  } else if (float32) {
+    pointers.x_prev_state = prev_it->second.index({i}).data_ptr<float>();
+  } else {
+    pointers.x_prev_state_out = prev_it->second.index({i}).data_ptr();
+  }
+}
+
+// Float board states of the row being encoded, for other formats
+thread_local vector<float> board_state_scratch;
+
+// Phase types of the games of the job being encoded
+thread_local vector<char> phase_types_scratch;
+
+// Call f(phase_type, i) for each of games[i], grouped by the phase type of
+// their state: phase_type is a std::integral_constant (see visit_phase_type),
+// so encode jobs run the kernels specialized for each phase type on the games
+// of that type. Batches usually have a single phase type.
+template <typename F>
+void for_each_game_by_phase_type(const vector<Game *> &games, F f) {
+  vector<char> &phase_types = phase_types_scratch;
+  phase_types.resize(games.size());
+  for (int i = 0; i < games.size(); ++i) {
+    phase_types[i] = games[i]->get_state().get_phase().phase_type;
+  }
+  for (char type : {'M', 'R', 'A', 'C'}) {
+    if (find(phase_types.begin(), phase_types.end(), type) ==
+        phase_types.end()) {
+      continue;
+    }
+    visit_phase_type(type, [&](auto phase_type) {
+      for (int i = 0; i < games.size(); ++i) {
+        if (phase_types[i] == type) {
+          f(phase_type, i);
+        }
+      }
+    });
+  }
+}
+
+// Call encode(pointers) on a row. Board states in another BoardStateFormat
+// than FLOAT32, or whose prev state delta is wanted, are encoded to
+// board_state_scratch, then converted.
+template <typename F>
+void encode_row(EncodingArrayPointers &pointers, F encode) {
+  bool convert = pointers.board_state_format != BoardStateFormat::FLOAT32;
+  PrevStateDelta *delta = pointers.x_prev_state_delta;
+  if (!convert && delta == nullptr) {
+    encode(pointers);
+    return;
+  }
+  board_state_scratch.resize(2 * 81 * BOARD_STATE_ENC_WIDTH);
+  EncodingArrayPointers scratch = pointers;
+  if (convert) {
+    scratch.x_board_state = board_state_scratch.data();
+  }
+  scratch.x_prev_state =
+      board_state_scratch.data() + 81 * BOARD_STATE_ENC_WIDTH;
+  encode(scratch);
+  if (convert) {
+    write_board_state(scratch.x_board_state, pointers.board_state_format,
+                      pointers.x_board_state_out);
+  }
+  if (delta == nullptr) {
+    write_board_state(scratch.x_prev_state, pointers.board_state_format,
+                      pointers.x_prev_state_out);
+    return;
+  }
+
+  delta->locs.clear();
+  delta->rows.clear();
+  for (int loc = 0; loc < 81; ++loc) {
+    size_t off = loc * BOARD_STATE_ENC_WIDTH;
+    const float *board_row = scratch.x_board_state + off;
+    const float *prev_row = scratch.x_prev_state + off;
+    if (memcmp(board_row, prev_row, BOARD_STATE_ENC_WIDTH * sizeof(float))) {
+      delta->locs.push_back(loc);
+      delta->rows.insert(delta->rows.end(), prev_row,
+                         prev_row + BOARD_STATE_ENC_WIDTH);
+    }
+  }
+}
+
+// Copy the contiguous src to the contiguous dst, which has as many rows and
+// is at least as large in the other dims, filling the rest of dst with pad,
+// one element
+void copy_padded(const char *src, torch::IntArrayRef src_shape, char *dst,
+                 torch::IntArrayRef dst_shape, const vector<char> &pad) {
+  size_t es = pad.size();
+  size_t n_dims = src_shape.size();
+  if (src_shape == dst_shape) {
+    size_t n = 1;
+    for (int64_t size : src_shape) {
+      n *= size;
+    }
+    memcpy(dst, src, n * es);
+    return;
+  }
+
+  // Fill with pad, doubling the filled prefix
+  size_t dst_bytes = es;
+  for (int64_t size : dst_shape) {
+    dst_bytes *= size;
+  }
+  if (dst_bytes == 0) {
+    return;
+  }
+  memcpy(dst, pad.data(), es);
+  for (size_t filled = es; filled < dst_bytes; filled *= 2) {
+    memcpy(dst + filled, dst, min(filled, dst_bytes - filled));
+  }
+
+  // Copy src's innermost rows, iterating over the other dims' idxs
+  vector<size_t> dst_strides(n_dims, es);
+  for (int d = n_dims - 2; d >= 0; --d) {
+    dst_strides[d] = dst_strides[d + 1] * dst_shape[d + 1];
+  }
+  size_t run_bytes = src_shape[n_dims - 1] * es;
+  size_t n_runs = 1;
+  for (size_t d = 0; d + 1 < n_dims; ++d) {
+    n_runs *= src_shape[d];
+  }
+  vector<int64_t> idx(n_dims, 0);
+  for (size_t run = 0; run < n_runs; ++run) {
+    size_t offset = 0;
+    for (size_t d = 0; d + 1 < n_dims; ++d) {
+      offset += idx[d] * dst_strides[d];
+    }
+    memcpy(dst + offset, src + run * run_bytes, run_bytes);
+    for (int d = n_dims - 2; d >= 0 && ++idx[d] == src_shape[d]; --d) {
+      idx[d] = 0;
+    }
+  }
+}
+
+} // namespace
+
+ThreadPoolPriority set_thread_pool_priority(ThreadPoolPriority priority) {
+  ThreadPoolPriority prev = thread_pool_priority;
+  thread_pool_priority = priority;
+  return prev;
+}
+
+ThreadPoolPriority get_thread_pool_priority() { return thread_pool_priority; }
+
 ThreadPool::ThreadPool(
     size_t n_threads,
     std::unordered_map<std::string, int> order_vocabulary_to_idx,
-    int max_order_cands)
-    : orders_encoder_(order_vocabulary_to_idx, max_order_cands) {
+    int max_order_cands, bool pin_threads)
+    : ThreadPool(n_threads,
+                 std::make_shared<const OrdersEncoder>(order_vocabulary_to_idx,
+                                                       max_order_cands),
+                 pin_threads) {}
+
+ThreadPool::ThreadPool(size_t n_threads,
+                       std::shared_ptr<const OrdersEncoder> orders_encoder,
+                       bool pin_threads)
+    : orders_encoder_(std::move(orders_encoder)) {
+  JCHECK(orders_encoder_ != nullptr, "ThreadPool: null orders_encoder");
 
-  jobs_.reserve(n_threads);
-  threads_.reserve(n_threads);
-  for (int i = 0; i < n_threads; ++i) {
-    threads_.push_back(thread(&ThreadPool::thread_fn, this));
+  if (pin_threads && n_threads > 0) {
+    node_cpus_ = get_numa_node_cpus();
+    pinned_ = !node_cpus_[0].empty();
   }
+  if (pinned_) {
+    // Deal threads round-robin to the nodes, one CPU each. Workers started
+    // by resize keep dealing to the same groups.
+    n_groups_ = min(node_cpus_.size(), n_threads);
+    LOG(INFO) << "ThreadPool: pinning " << n_threads << " threads to "
+              << n_groups_ << " NUMA nodes";
+  }
+
+  resize(n_threads);
 }
 
 ThreadPool::~ThreadPool() {
+  stop_controller();
   { // Locked critical section
     unique_lock<mutex> my_lock(mutex_);
     time_to_die_ = true;
   }
   cv_in_.notify_all();
+  cv_parked_.notify_all();
   for (auto &th : threads_) {
     th.join();
   }
 }
 
-void ThreadPool::boilerplate_job_prep(ThreadPoolJobType job_type,
-                                      vector<Game *> &games) {
-  JCHECK(jobs_.size() == 0, "ThreadPool called with non-empty jobs_");
+void ThreadPool::start_thread() {
+  size_t worker = threads_.size();
+  size_t group = worker % n_groups_;
+  int cpu = -1;
+  if (pinned_) {
+    const vector<int> &cpus = node_cpus_[group];
+    cpu = cpus[(worker / n_groups_) % cpus.size()];
+  }
+  threads_.push_back(
+      thread(&ThreadPool::thread_fn, this, worker, group, cpu));
+}
 
-  // Pack games into n_threads jobs
-  size_t n_threads = threads_.size() > 0 ? threads_.size() : 1;
-  for (int i = 0; i < n_threads; ++i) {
-    jobs_.push_back(ThreadPoolJob(job_type));
+void ThreadPool::resize(size_t n_threads) {
+  JCHECK(n_threads > 0 || !pinned_, "Pinned ThreadPool needs a worker");
+  unique_lock<mutex> resize_lock(resize_mutex_);
+  while (threads_.size() < n_threads) {
+    start_thread();
   }
-  for (int i = 0; i < games.size(); ++i) {
-    jobs_[i % n_threads].games.push_back(games[i]);
+  { // Under mutex_, so that a parked worker cannot miss the notification
+    unique_lock<mutex> my_lock = lock_mutex();
+    n_active_ = n_threads;
   }
-  for (int i = 0; i < games.size(); ++i) {
-    // Poor man's race condition elimination. Should not take so much time as
-    // stepping job calls get_all_possible_orders on all produced states.
-    games[i]->get_all_possible_orders();
+  cv_parked_.notify_all();
+}
+
+void ThreadPool::set_adaptive_sizing(size_t min_threads, size_t max_threads,
+                                     int interval_ms) {
+  JCHECK(min_threads <= max_threads, "min_threads > max_threads");
+  JCHECK(interval_ms > 0, "interval_ms must be positive");
+  stop_controller();
+  if (max_threads == 0) {
+    return;
   }
+  resize(std::clamp(n_active_.load(), max(min_threads, size_t(1)),
+                    max_threads));
+  stop_controller_ = false;
+  controller_ = thread(&ThreadPool::controller_fn, this, min_threads,
+                       max_threads, interval_ms);
 }
 
-void ThreadPool::boilerplate_job_handle(unique_lock<mutex> &my_lock) {
-  // maybe handle in-thread
-  if (threads_.size() == 0) {
-    thread_fn_do_job_unsafe(jobs_[0]);
-    jobs_.clear();
+void ThreadPool::stop_controller() {
+  if (!controller_.joinable()) {
     return;
   }
+  {
+    unique_lock<mutex> my_lock(controller_mutex_);
+    stop_controller_ = true;
+  }
+  controller_cv_.notify_all();
+  controller_.join();
+}
+
+void ThreadPool::controller_fn(size_t min_threads, size_t max_threads,
+                               int interval_ms) {
+  set_trace_thread_name("ThreadPool controller");
+  // Grow while jobs are queued and workers are busy more than GROW_BUSY of
+  // the time; shrink while they are busy less than SHRINK_BUSY of it, or get
+  // less than CONTENDED_CPU of a core while busy. Long jobs are counted when
+  // they finish, so the signals are smoothed over intervals.
+  const double GROW_BUSY = 0.9;
+  const double SHRINK_BUSY = 0.5;
+  const double CONTENDED_CPU = 0.75;
+  const double SMOOTHING = 0.5; // weight of the last interval
+  const double NEUTRAL_BUSY = (SHRINK_BUSY + GROW_BUSY) / 2;
+  min_threads = max(min_threads, size_t(1));
+
+  double busy = NEUTRAL_BUSY, cpu = 1, queued = 0;
+  uint64_t prev_busy_ns = busy_ns_, prev_cpu_ns = busy_cpu_ns_;
+  auto prev_time = chrono::steady_clock::now();
+  unique_lock<mutex> my_lock(controller_mutex_);
+  while (!controller_cv_.wait_for(my_lock, chrono::milliseconds(interval_ms),
+                                  [this] { return stop_controller_; })) {
+    auto now = chrono::steady_clock::now();
+    uint64_t busy_ns = busy_ns_, cpu_ns = busy_cpu_ns_;
+    size_t n = n_active_;
+    double interval_ns =
+        chrono::duration<double, nano>(now - prev_time).count();
+    double capacity_ns = max(n, size_t(1)) * interval_ns;
+    double d_busy = busy_ns - prev_busy_ns;
+    busy += SMOOTHING * (min(d_busy / capacity_ns, 1.0) - busy);
+    if (d_busy > 0) {
+      cpu += SMOOTHING * (min((cpu_ns - prev_cpu_ns) / d_busy, 1.0) - cpu);
+    }
+    queued += SMOOTHING * (n_unclaimed_jobs_.load() - queued);
+    prev_busy_ns = busy_ns;
+    prev_cpu_ns = cpu_ns;
+    prev_time = now;
+
+    size_t target = n;
+    if (n > min_threads && (cpu < CONTENDED_CPU || busy < SHRINK_BUSY)) {
+      target = n - 1;
+    } else if (n < max_threads && cpu >= CONTENDED_CPU && busy > GROW_BUSY &&
+               queued >= 1) {
+      target = min(n + max(n / 4, size_t(1)), max_threads);
+    }
+    if (target != n) {
+      resize(target);
+      // Measure the new size afresh
+      busy = NEUTRAL_BUSY;
+      queued = 0;
+    }
+  }
+}
+
+TensorDict ThreadPoolFuture::wait() {
+  pool_->wait(*batch_);
+  pool_->trim_seq_lens(*batch_);
+  pool_->write_prev_state_deltas(*batch_);
+  return batch_->fields;
+}
+
+bool ThreadPoolFuture::done() const { return pool_->is_done(*batch_); }
+
+shared_ptr<ThreadPoolBatch>
+ThreadPool::boilerplate_job_prep(ThreadPoolJobType job_type,
+                                 vector<Game *> &games) {
+  auto batch = make_shared<ThreadPoolBatch>();
+  batch->hold_games(games, job_type == ThreadPoolJobType::STEP ||
+                               job_type == ThreadPoolJobType::STEP_AND_ENCODE);
+
+  // Pack games into small jobs, claimed by threads as they become free
+  size_t n_jobs = get_n_jobs(games.size());
+  for (int i = 0; i < n_jobs; ++i) {
+    batch->jobs.push_back(ThreadPoolJob(job_type));
+  }
+  for (int i = 0; i < games.size(); ++i) {
+    batch->jobs[i % n_jobs].games.push_back(games[i]);
+    if (job_type == ThreadPoolJobType::STEP) {
+      batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+    }
+  }
+  // Possible orders are loaded by the workers as needed: loading is
+  // thread-safe, see GameState::get_all_possible_orders
+  return batch;
+}
 
-  // Notify and wait for worker threads
-  unfinished_jobs_ = jobs_.size();
+void ThreadPoolBatch::hold_games(vector<Game *> &games, bool exclusive) {
+  holds_exclusive = exclusive;
+  held_games.reserve(games.size());
+  for (Game *game : games) {
+    if (!game->get_batch_holds().try_acquire(exclusive)) {
+      release_games();
+      JFAIL(exclusive ? "Game to step is in use by another ThreadPool batch, "
+                        "or passed twice"
+                      : "Game to encode is being stepped by a ThreadPool "
+                        "batch");
+    }
+    held_games.push_back(game);
+  }
+}
+
+void ThreadPoolBatch::release_games() {
+  for (Game *game : held_games) {
+    game->get_batch_holds().release(holds_exclusive);
+  }
+  held_games.clear();
+}
+
+size_t ThreadPool::get_n_jobs(size_t n_items) const {
+  size_t max_jobs = max(n_active_.load(), size_t(1)) * JOBS_PER_THREAD;
+  return max(min(n_items, max_jobs), size_t(1));
+}
+
+ThreadPoolFuture ThreadPool::submit(shared_ptr<ThreadPoolBatch> batch) {
+  batch->unfinished_jobs = batch->jobs.size();
+  batch->finished = batch->jobs.empty();
+
+  // Small batches are done right away, without the handoff to workers
+  size_t inline_max_games = inline_max_games_;
+  size_t n_items = 0;
+  for (const ThreadPoolJob &job : batch->jobs) {
+    n_items += job_n_items(job);
+  }
+  if (!pinned_ && inline_max_games > 0 && n_items <= inline_max_games) {
+    for (ThreadPoolJob &job : batch->jobs) {
+      thread_fn_do_job_unsafe(job);
+      finish_job(*batch);
+    }
+    return ThreadPoolFuture(this, batch);
+  }
+
+  { // Locked critical section
+    unique_lock<mutex> my_lock = lock_mutex();
+    if (get_perf_stats_enabled()) {
+      batch->submit_time = chrono::steady_clock::now();
+    }
+    batch->unclaimed_jobs = batch->jobs.size();
+    batch->priority = get_thread_pool_priority();
+    batch->next_job.resize(n_groups_);
+    for (size_t group = 0; group < n_groups_; ++group) {
+      batch->next_job[group] = group;
+    }
+    batches_[static_cast<int>(batch->priority)].push_back(batch);
+    n_unclaimed_jobs_ += batch->jobs.size();
+  }
   cv_in_.notify_all();
-  while (unfinished_jobs_ != 0) {
-    cv_out_.wait(my_lock);
+  return ThreadPoolFuture(this, batch);
+}
+
+ThreadPoolJob *ThreadPool::claim_job(ThreadPoolBatch &batch, size_t group) {
+  if (batch.unclaimed_jobs == 0) {
+    return nullptr;
+  }
+
+  // Take the group's next job, else steal from the following groups
+  ThreadPoolJob *job = nullptr;
+  size_t n_groups = batch.next_job.size();
+  for (size_t i = 0; job == nullptr; ++i) {
+    size_t &next = batch.next_job[(group + i) % n_groups];
+    if (next < batch.jobs.size()) {
+      job = &batch.jobs[next];
+      next += n_groups;
+    }
+  }
+  if (get_perf_stats_enabled() &&
+      batch.submit_time != chrono::steady_clock::time_point()) {
+    add_perf_sample(PerfCounter::THREAD_POOL_QUEUE,
+                    chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::steady_clock::now() - batch.submit_time)
+                        .count());
+  }
+  --n_unclaimed_jobs_;
+  if (--batch.unclaimed_jobs == 0) {
+    // All jobs claimed: stop offering this batch to worker threads
+    auto &batches = batches_[static_cast<int>(batch.priority)];
+    for (auto it = batches.begin(); it != batches.end(); ++it) {
+      if (it->get() == &batch) {
+        batches.erase(it);
+        break;
+      }
+    }
+  }
+  return job;
+}
+
+shared_ptr<ThreadPoolBatch> ThreadPool::next_batch() {
+  auto &interactive =
+      batches_[static_cast<int>(ThreadPoolPriority::INTERACTIVE)];
+  auto &bulk = batches_[static_cast<int>(ThreadPoolPriority::BULK)];
+  if (!interactive.empty() && !bulk.empty()) {
+    if (++interactive_streak_ < BULK_CLAIM_INTERVAL) {
+      return interactive.front();
+    }
+    interactive_streak_ = 0;
+    return bulk.front();
+  }
+  interactive_streak_ = 0;
+  if (!interactive.empty()) {
+    return interactive.front();
   }
+  return bulk.empty() ? nullptr : bulk.front();
 }
 
-void ThreadPool::process_multi(vector<Game *> &games) {
-  unique_lock<mutex> my_lock(mutex_);
+bool ThreadPool::has_queued_batches() const {
+  return !batches_[0].empty() || !batches_[1].empty();
+}
 
-  boilerplate_job_prep(ThreadPoolJobType::STEP, games);
-  boilerplate_job_handle(my_lock);
+void ThreadPool::finish_job(ThreadPoolBatch &batch) {
+  if (--batch.unfinished_jobs != 0) {
+    return;
+  }
+  batch.release_games();
+  { // Under mutex_, so that a waiter cannot miss the notification
+    unique_lock<mutex> my_lock = lock_mutex();
+    batch.finished = true;
+  }
+  cv_out_.notify_all();
 }
 
-TensorDict ThreadPool::encode_inputs_state_only_multi(vector<Game *> &games) {
-  unique_lock<mutex> my_lock(mutex_);
+void ThreadPool::wait(ThreadPoolBatch &batch) {
+  // Help worker threads until none of the batch's jobs are left to claim.
+  // Pinned pools leave all jobs to the workers on their nodes.
+  while (!pinned_ && !batch.finished) {
+    ThreadPoolJob *job;
+    {
+      unique_lock<mutex> my_lock = lock_mutex();
+      job = claim_job(batch, 0);
+    }
+    if (job == nullptr) {
+      break;
+    }
+    thread_fn_do_job_unsafe(*job);
+    finish_job(batch);
+  }
 
-  boilerplate_job_prep(ThreadPoolJobType::ENCODE_STATE_ONLY, games);
+  // Wait for worker threads
+  if (!batch.finished) {
+    PerfTimer perf_timer(PerfCounter::THREAD_POOL_WAIT);
+    TraceScope trace_scope("wait", "thread_pool");
+    if (!spin_until([&batch] { return batch.finished.load(); }, spin_us_)) {
+      unique_lock<mutex> my_lock = lock_mutex();
+      while (!batch.finished) {
+        cv_out_.wait(my_lock);
+      }
+    }
+  }
+}
+
+unique_lock<mutex> ThreadPool::lock_mutex() {
+  if (!get_tracing_enabled()) {
+    return unique_lock<mutex>(mutex_);
+  }
+  unique_lock<mutex> my_lock(mutex_, try_to_lock);
+  if (!my_lock.owns_lock()) {
+    double start_us = trace_now_us();
+    my_lock.lock();
+    add_trace_event("mutex_wait", "thread_pool", start_us, trace_now_us());
+  }
+  return my_lock;
+}
+
+bool ThreadPool::is_done(ThreadPoolBatch &batch) { return batch.finished; }
+
+TensorDict ThreadPool::encode_inputs_multi_sparse(vector<Game *> &games) {
+  return encode_inputs_sparse(games, false);
+}
+
+TensorDict
+ThreadPool::encode_inputs_all_powers_multi_sparse(vector<Game *> &games) {
+  return encode_inputs_sparse(games, true);
+}
+
+TensorDict ThreadPool::encode_inputs_sparse(vector<Game *> &games,
+                                            bool all_powers) {
+  auto batch = boilerplate_job_prep(all_powers
+                                        ? ThreadPoolJobType::ENCODE_ALL_POWERS
+                                        : ThreadPoolJobType::ENCODE,
+                                    games);
+  long B = games.size();
+  size_t max_seq_len = all_powers ? N_SCS : OrdersEncoder::MAX_SEQ_LEN;
 
   // Job-specific prep
-  TensorDict fields(new_data_fields_state_only(games.size()));
-  size_t n_threads = threads_.size() > 0 ? threads_.size() : 1;
+  TensorDict &fields = batch->fields;
+  fields = data_fields_pool_.get(B, 0, false);
+  fields["x_loc_idxs"] = torch::empty({B, 7, 81}, torch::kInt8);
+  if (all_powers) {
+    fields["x_power"] =
+        torch::empty({B, 7, static_cast<long>(max_seq_len)}, torch::kLong);
+  }
+  vector<SparsePossibleActions> sparse(B);
+  for (int i = 0; i < B; ++i) {
+    batch->jobs[i % batch->jobs.size()].encoding_array_pointers.push_back(
+        EncodingArrayPointers{
+            nullptr, // x_board_state, see set_board_state_rows
+            nullptr, // x_prev_state
+            fields["x_prev_orders"].index({i}).data_ptr<long>(),
+            fields["x_season"].index({i}).data_ptr<float>(),
+            fields["x_in_adj_phase"].index({i}).data_ptr<float>(),
+            fields["x_build_numbers"].index({i}).data_ptr<float>(),
+            fields["x_loc_idxs"].index({i}).data_ptr<int8_t>(),
+            nullptr, // x_possible_actions
+            all_powers ? fields["x_power"].index({i}).data_ptr<int64_t>()
+                       : nullptr,
+            &sparse[i],
+        });
+    set_board_state_rows(*batch, i,
+                         batch->jobs[i % batch->jobs.size()]
+                             .encoding_array_pointers.back());
+  }
+
+  submit(batch).wait();
+
+  // Concatenate per-game candidates
+  size_t n_values = 0;
+  for (auto &x : sparse) {
+    n_values += x.values.size();
+  }
+  torch::Tensor offsets =
+      torch::empty({static_cast<long>(B * 7 * max_seq_len + 1)}, torch::kLong);
+  torch::Tensor values =
+      torch::empty({static_cast<long>(n_values)}, torch::kInt32);
+  int64_t *offsets_p = offsets.data_ptr<int64_t>();
+  int32_t *values_p = values.data_ptr<int32_t>();
+  int64_t offset = 0;
+  *offsets_p++ = 0;
+  for (auto &x : sparse) {
+    for (int32_t row_len : x.row_lens) {
+      offset += row_len;
+      *offsets_p++ = offset;
+    }
+    memcpy(values_p, x.values.data(), x.values.size() * sizeof(int32_t));
+    values_p += x.values.size();
+  }
+  fields["x_possible_actions_offsets"] = offsets;
+  fields["x_possible_actions_values"] = values;
+
+  return fields;
+}
+
+void ThreadPool::maybe_reset_possible_actions(TensorDict &fields) const {
+  // The encoders overwrite every field, except for x_possible_actions columns
+  // beyond max_cands
+  if (orders_encoder_->get_max_cands() !=
+      fields["x_possible_actions"].size(-1)) {
+    fields["x_possible_actions"].fill_(-1);
+  }
+}
+
+void ThreadPool::set_encoding_cache_capacity(size_t capacity) {
+  if (capacity == 0) {
+    encoding_cache_.reset();
+  } else {
+    encoding_cache_ = std::make_unique<EncodingCache>(capacity);
+  }
+}
+
+void ThreadPool::save_encoding_cache(const string &path) const {
+  JCHECK(encoding_cache_ != nullptr, "save_encoding_cache: cache disabled");
+  encoding_cache_->save(path, get_encoding_fingerprint());
+}
+
+size_t ThreadPool::load_encoding_book(const string &path) {
+  JCHECK(encoding_cache_ != nullptr, "load_encoding_book: cache disabled");
+  return encoding_cache_->load_book(path, get_encoding_fingerprint());
+}
+
+MemoryUsage ThreadPool::get_memory_usage(const vector<Game *> &games) const {
+  MemoryUsage r;
+  MemorySeen seen;
+  for (Game *game : games) {
+    game->check_not_held();
+    game->add_memory_usage(r, seen);
+  }
+  r["encoding_cache"] = encoding_cache_ ? encoding_cache_->memory_usage() : 0;
+  return r;
+}
+
+uint64_t ThreadPool::get_encoding_fingerprint() const {
+  // FNV-1a, which unlike std::hash is the same in every build
+  uint64_t r = 0xcbf29ce484222325ULL;
+  auto add = [&r](const void *p, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      r = (r ^ static_cast<const uint8_t *>(p)[i]) * 0x100000001b3ULL;
+    }
+  };
+  int64_t widths[] = {BOARD_STATE_ENC_WIDTH, OrdersEncoder::MAX_SEQ_LEN,
+                      orders_encoder_->get_max_cands()};
+  add(widths, sizeof(widths));
+  for (const string &order : orders_encoder_->get_order_vocabulary()) {
+    add(order.data(), order.size() + 1); // with the terminating null
+  }
+  return r;
+}
+
+namespace {
+
+// Equal for games with equal states and staged orders
+size_t hash_process_inputs(Game &game) {
+  size_t r = game.stable_board_hash();
+  for (const auto & [ power, orders ] : game.get_staged_orders()) {
+    hash_combine(r, power);
+    for (const Order &order : orders) {
+      hash_combine(r, order.get_id());
+    }
+  }
+  return r;
+}
+
+} // namespace
+
+void ThreadPool::pack_step_jobs(ThreadPoolBatch &batch,
+                                const vector<Game *> &games) {
+  // Games that may process like an earlier game go in its job, after it.
+  // Game::process_like checks they really do.
+  for (ThreadPoolJob &job : batch.jobs) {
+    job.games.clear();
+    job.orders_idxs.clear();
+  }
+  unordered_map<size_t, pair<Game *, size_t>> leaders;
+  leaders.reserve(games.size());
+  size_t n_groups = 0;
+  for (size_t i = 0; i < games.size(); ++i) {
+    Game *game = games[i];
+    auto [it, is_leader] = leaders.emplace(
+        hash_process_inputs(*game),
+        make_pair(game, n_groups % batch.jobs.size()));
+    ThreadPoolJob &job = batch.jobs[it->second.second];
+    job.games.push_back(game);
+    job.orders_idxs.push_back(i);
+    job.leaders.push_back(is_leader ? nullptr : it->second.first);
+    n_groups += is_leader;
+  }
+}
+
+ThreadPoolFuture ThreadPool::process_multi_async(vector<Game *> &games,
+                                                bool share_identical) {
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::STEP, games);
+  if (share_identical) {
+    pack_step_jobs(*batch, games);
+  }
+  return submit(batch);
+}
+
+void ThreadPool::process_multi(vector<Game *> &games, bool share_identical) {
+  process_multi_async(games, share_identical).wait();
+}
+
+vector<ProcessStatus> ThreadPool::try_process_multi(vector<Game *> &games,
+                                                    bool share_identical) {
+  vector<ProcessStatus> statuses(games.size(), ProcessStatus::OK);
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::STEP, games);
+  if (share_identical) {
+    pack_step_jobs(*batch, games);
+  }
+  for (ThreadPoolJob &job : batch->jobs) {
+    job.statuses = &statuses;
+  }
+  submit(batch).wait();
+  return statuses;
+}
+
+vector<Game> ThreadPool::process_many(Game &game,
+                                      const vector<PowerOrderStrs> &orders) {
+  // Shared by all successors, which only read it
+  game.get_all_possible_orders();
+
+  // A fresh copy owns none of its history, so that worker threads can copy it
+  // concurrently
+  Game root(game);
+
+  auto batch = make_shared<ThreadPoolBatch>();
+  vector<optional<Game>> successors(orders.size());
+  size_t n_jobs = get_n_jobs(orders.size());
+  for (int i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::PROCESS_MANY);
+    job.games.push_back(&root);
+    job.orders = &orders;
+    job.successors = &successors;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < orders.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+
+  submit(batch).wait();
+
+  vector<Game> r;
+  r.reserve(orders.size());
+  for (auto &successor : successors) {
+    r.push_back(std::move(*successor));
+  }
+  return r;
+}
+
+int64_t ThreadPool::playout_multi(vector<Game *> &games, PlayoutPolicy policy,
+                                  int max_move_phases, uint64_t seed) {
+  JCHECK(max_move_phases >= 0, "playout_multi: negative max_move_phases");
+  auto batch = make_shared<ThreadPoolBatch>();
+  batch->hold_games(games, true);
+
+  size_t n_jobs = get_n_jobs(games.size());
+  for (size_t i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::PLAYOUT);
+    job.playout_policy = policy;
+    job.max_move_phases = max_move_phases;
+    job.playout_seed = seed;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < games.size(); ++i) {
+    batch->jobs[i % n_jobs].games.push_back(games[i]);
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+
+  submit(batch).wait();
+
+  int64_t n_phases = 0;
+  for (const ThreadPoolJob &job : batch->jobs) {
+    n_phases += job.n_phases;
+  }
+  return n_phases;
+}
+
+vector<ReplayResult>
+ThreadPool::replay_games(const vector<string> &game_jsons) {
+  auto batch = make_shared<ThreadPoolBatch>();
+  vector<ReplayResult> results(game_jsons.size());
+  size_t n_jobs = get_n_jobs(game_jsons.size());
+  for (size_t i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::REPLAY);
+    job.game_jsons = &game_jsons;
+    job.replay_results = &results;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < game_jsons.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+
+  submit(batch).wait();
+  return results;
+}
+
+vector<Game> ThreadPool::clone_multi(Game &game, size_t n) {
+  game.get_all_possible_orders();
+  Game root(game);
+
+  auto batch = make_shared<ThreadPoolBatch>();
+  vector<optional<Game>> clones(n);
+  size_t n_jobs = get_n_jobs(n);
+  for (int i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::CLONE);
+    job.games.push_back(&root);
+    job.successors = &clones;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+
+  submit(batch).wait();
+
+  vector<Game> r;
+  r.reserve(n);
+  for (auto &clone : clones) {
+    r.push_back(std::move(*clone));
+  }
+  return r;
+}
+
+torch::Tensor ThreadPool::get_scores_multi(vector<Game *> &games) {
+  long B = games.size();
+  torch::Tensor r = torch::empty({B, 3, 7}, torch::kFloat32);
+  float *p = r.data_ptr<float>();
+  for (Game *game : games) {
+    game->write_square_scores(p, p + 7);
+    for (int i = 0; i < 7; ++i) {
+      p[14 + i] = p[i] >= 1e-3 ? 1 : 0;
+    }
+    p += 21;
+  }
+  return r;
+}
+
+torch::Tensor ThreadPool::get_sos_targets_multi(vector<Game *> &games,
+                                                float value_decay_alpha) {
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::SOS_TARGETS, games);
+  size_t n_jobs = batch->jobs.size();
+  size_t n_rows = 0;
+  for (size_t i = 0; i < games.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(n_rows);
+    n_rows += games[i]->get_state_history().size();
+  }
+  torch::Tensor r = torch::empty({static_cast<long>(n_rows), 7},
+                                 torch::kFloat32);
+  for (ThreadPoolJob &job : batch->jobs) {
+    job.sos_targets = r.data_ptr<float>();
+    job.value_decay_alpha = value_decay_alpha;
+  }
+
+  submit(batch).wait();
+  return r;
+}
+
+TensorDict ThreadPool::lookup_rollout_cache(RolloutCache &cache,
+                                            vector<Game *> &games) {
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::ROLLOUT_CACHE, games);
+  size_t n_jobs = batch->jobs.size();
+  for (size_t i = 0; i < games.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+  long B = games.size();
+  TensorDict r;
+  r["keys"] = torch::empty({B, 2}, torch::kInt64);
+  r["hits"] = torch::empty({B}, torch::kBool);
+  r["values"] = torch::zeros({B, 7}, torch::kFloat32);
+  for (ThreadPoolJob &job : batch->jobs) {
+    job.rollout_cache = &cache;
+    job.rollout_keys = r["keys"].data_ptr<int64_t>();
+    job.rollout_hits = r["hits"].data_ptr<bool>();
+    job.rollout_values = r["values"].data_ptr<float>();
+  }
+
+  submit(batch).wait();
+  return r;
+}
+
+TensorDict
+ThreadPool::cat_pad_inputs(const vector<TensorDict> &xs,
+                           const unordered_map<string, double> &pad_values) {
+  JCHECK(!xs.empty(), "cat_pad_inputs: no inputs");
+  for (const string &key :
+       {"x_prev_state_delta_offsets", "x_possible_actions_offsets"}) {
+    JCHECK(xs[0].find(key) == xs[0].end(),
+           "cat_pad_inputs does not support " + key);
+  }
+  auto opts = torch::TensorOptions().pinned_memory(
+      data_fields_pool_.get_pin_memory());
+
+  // Output shapes, computed once
+  vector<CatPadField> fields;
+  vector<string> names;
+  for (auto &it : xs[0]) {
+    const string &name = it.first;
+    auto pad_it = pad_values.find(name);
+    bool padded = pad_it != pad_values.end();
+    torch::ScalarType dtype = it.second.scalar_type();
+    vector<int64_t> shape = it.second.sizes().vec();
+    JCHECK(!shape.empty(), "cat_pad_inputs: scalar field " + name);
+    shape[0] = 0;
+
+    CatPadField field;
+    for (const TensorDict &x : xs) {
+      JCHECK(x.size() == xs[0].size(),
+             "cat_pad_inputs: inputs have different fields");
+      auto x_it = x.find(name);
+      JCHECK(x_it != x.end(), "cat_pad_inputs: missing field " + name);
+      const torch::Tensor &input = x_it->second;
+      JCHECK(input.dim() == static_cast<long>(shape.size()) &&
+                 input.scalar_type() == dtype,
+             "cat_pad_inputs: " + name + " differs in dims or dtype");
+      for (size_t d = 1; d < shape.size(); ++d) {
+        JCHECK(padded || input.size(d) == shape[d],
+               "cat_pad_inputs: " + name + " differs in shape");
+        shape[d] = max(shape[d], input.size(d));
+      }
+      field.first_rows.push_back(shape[0]);
+      shape[0] += input.size(0);
+      // e.g. the expanded rows of encode_inputs_repeated
+      field.inputs.push_back(input.contiguous());
+    }
+    field.out = torch::empty(shape, opts.dtype(dtype));
+    field.pad.resize(field.out.element_size());
+    if (padded) {
+      torch::Tensor pad = torch::full({1}, pad_it->second, dtype);
+      memcpy(field.pad.data(), pad.data_ptr(), field.pad.size());
+    }
+    fields.push_back(std::move(field));
+    names.push_back(name);
+  }
+
+  auto batch = make_shared<ThreadPoolBatch>();
+  size_t n_jobs = get_n_jobs(xs.size());
+  for (size_t i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::CAT_PAD);
+    job.cat_pad_fields = &fields;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < xs.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+  submit(batch).wait();
+
+  TensorDict r;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    r[names[i]] = fields[i].out;
+  }
+  return r;
+}
+
+vector<optional<Game>>
+ThreadPool::load_corpus_phases(const GameCorpus &corpus,
+                               const vector<size_t> &phase_idxs) {
+  // Decode the games in parallel
+  auto batch = make_shared<ThreadPoolBatch>();
+  vector<optional<Game>> games(phase_idxs.size());
+  size_t n_jobs = get_n_jobs(phase_idxs.size());
+  for (int i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::LOAD_CORPUS);
+    job.corpus = &corpus;
+    job.corpus_phase_idxs = &phase_idxs;
+    job.successors = &games;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < phase_idxs.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+
+  submit(batch).wait();
+  return games;
+}
+
+TensorDict ThreadPool::encode_corpus_phases(const GameCorpus &corpus,
+                                            const vector<size_t> &phase_idxs,
+                                            bool all_powers) {
+  vector<optional<Game>> games = load_corpus_phases(corpus, phase_idxs);
+  vector<Game *> game_ptrs;
+  game_ptrs.reserve(games.size());
+  for (auto &game : games) {
+    game_ptrs.push_back(&*game);
+  }
+  return all_powers ? encode_inputs_all_powers_multi(game_ptrs)
+                    : encode_inputs_multi(game_ptrs);
+}
+
+TensorDict ThreadPool::encode_dataset_games(const GameCorpus &corpus,
+                                            const vector<size_t> &game_idxs,
+                                            float value_decay_alpha,
+                                            int only_with_min_final_score,
+                                            int exclude_n_holds) {
+  DatasetTargetsArgs args;
+  args.game_idxs = &game_idxs;
+  vector<size_t> phase_idxs;
+  for (size_t game_i : game_idxs) {
+    auto [first, end] = corpus.get_phase_range(game_i);
+    args.first_rows.push_back(phase_idxs.size());
+    for (size_t phase_i = first; phase_i < end; ++phase_i) {
+      phase_idxs.push_back(phase_i);
+    }
+  }
+  long R = phase_idxs.size();
+
+  // Inputs, from the games rolled back to each phase
+  TensorDict fields;
+  {
+    vector<optional<Game>> games = load_corpus_phases(corpus, phase_idxs);
+    vector<Game *> game_ptrs;
+    game_ptrs.reserve(games.size());
+    for (auto &game : games) {
+      game_ptrs.push_back(&*game);
+    }
+    fields = encode_inputs_multi_sparse(game_ptrs);
+  }
+
+  // Targets, from the full games
+  torch::Tensor y_actions = torch::empty(
+      {R, 7, 1, OrdersEncoder::MAX_SEQ_LEN}, torch::kInt32);
+  torch::Tensor y_final_scores = torch::empty({R, 7}, torch::kFloat32);
+  torch::Tensor valid_power_idxs = torch::empty({R, 7}, torch::kBool);
+  args.cand_offsets = fields["x_possible_actions_offsets"].data_ptr<int64_t>();
+  args.cand_values = fields["x_possible_actions_values"].data_ptr<int32_t>();
+  args.y_actions = y_actions.data_ptr<int32_t>();
+  args.y_final_scores = y_final_scores.data_ptr<float>();
+  args.valid_power_idxs = valid_power_idxs.data_ptr<bool>();
+  args.value_decay_alpha = value_decay_alpha;
+  args.only_with_min_final_score = only_with_min_final_score;
+  args.exclude_n_holds = exclude_n_holds;
+
+  auto batch = make_shared<ThreadPoolBatch>();
+  size_t n_jobs = get_n_jobs(game_idxs.size());
+  for (int i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::DATASET_TARGETS);
+    job.corpus = &corpus;
+    job.dataset_targets = &args;
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < game_idxs.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+
+  submit(batch).wait();
+
+  fields["y_actions"] = y_actions;
+  fields["y_final_scores"] = y_final_scores;
+  fields["valid_power_idxs"] = valid_power_idxs;
+  return fields;
+}
+
+TensorDict ThreadPool::dedup_corpus(const GameCorpus &corpus,
+                                    const vector<size_t> &game_idxs) {
+  vector<size_t> first_rows;
+  long R = 0;
+  for (size_t game_i : game_idxs) {
+    auto [first, end] = corpus.get_phase_range(game_i);
+    first_rows.push_back(R);
+    R += end - first;
+  }
+  torch::Tensor hashes = torch::empty({R}, torch::kInt64);
+  auto batch = make_shared<ThreadPoolBatch>();
+  size_t n_jobs = get_n_jobs(game_idxs.size());
+  for (int i = 0; i < n_jobs; ++i) {
+    ThreadPoolJob job(ThreadPoolJobType::CORPUS_HASHES);
+    job.corpus = &corpus;
+    job.corpus_game_idxs = &game_idxs;
+    job.first_rows = &first_rows;
+    job.position_hashes = reinterpret_cast<uint64_t *>(hashes.data_ptr());
+    batch->jobs.push_back(job);
+  }
+  for (size_t i = 0; i < game_idxs.size(); ++i) {
+    batch->jobs[i % n_jobs].orders_idxs.push_back(i);
+  }
+  submit(batch).wait();
+
+  // Index by first occurrence
+  torch::Tensor first = torch::empty({R}, torch::kInt64);
+  torch::Tensor counts = torch::empty({R}, torch::kInt64);
+  const int64_t *h = hashes.data_ptr<int64_t>();
+  int64_t *f = first.data_ptr<int64_t>();
+  int64_t *c = counts.data_ptr<int64_t>();
+  unordered_map<int64_t, int64_t> first_row_of;
+  first_row_of.reserve(R);
+  for (long row = 0; row < R; ++row) {
+    f[row] = first_row_of.emplace(h[row], row).first->second;
+    c[row] = 0;
+    ++c[f[row]];
+  }
+  for (long row = 0; row < R; ++row) {
+    c[row] = c[f[row]];
+  }
+
+  TensorDict r;
+  r["hashes"] = hashes;
+  r["first_rows"] = first;
+  r["counts"] = counts;
+  return r;
+}
+
+ThreadPoolFuture
+ThreadPool::encode_inputs_state_only_multi_async(vector<Game *> &games) {
+  auto batch =
+      boilerplate_job_prep(ThreadPoolJobType::ENCODE_STATE_ONLY, games);
+
+  // Job-specific prep
+  TensorDict &fields = batch->fields;
+  fields = data_fields_pool_.get(games.size(), 0, false);
   for (int i = 0; i < games.size(); ++i) {
-    jobs_[i % n_threads].encoding_array_pointers.push_back(
+    batch->jobs[i % batch->jobs.size()].encoding_array_pointers.push_back(
         EncodingArrayPointers{
-            fields["x_board_state"].index({i}).data_ptr<float>(),
-            fields["x_prev_state"].index({i}).data_ptr<float>(),
+            nullptr, // x_board_state, see set_board_state_rows
+            nullptr, // x_prev_state
             fields["x_prev_orders"].index({i}).data_ptr<long>(),
             fields["x_season"].index({i}).data_ptr<float>(),
             fields["x_in_adj_phase"].index({i}).data_ptr<float>(),
@@ -101,26 +1216,35 @@ TensorDict ThreadPool::encode_inputs_state_only_multi(vector<Game *> &games) {
             nullptr, // x_possible_actions
             nullptr, // x_max_seq_len
         });
+    set_board_state_rows(*batch, i,
+                         batch->jobs[i % batch->jobs.size()]
+                             .encoding_array_pointers.back());
   }
 
-  boilerplate_job_handle(my_lock);
-
-  return fields;
+  return submit(batch);
 }
 
-TensorDict ThreadPool::encode_inputs_all_powers_multi(vector<Game *> &games) {
-  unique_lock<mutex> my_lock(mutex_);
+TensorDict ThreadPool::encode_inputs_state_only_multi(vector<Game *> &games) {
+  return encode_inputs_state_only_multi_async(games).wait();
+}
 
-  boilerplate_job_prep(ThreadPoolJobType::ENCODE_ALL_POWERS, games);
+ThreadPoolFuture
+ThreadPool::encode_inputs_all_powers_multi_async(vector<Game *> &games) {
+  auto batch =
+      boilerplate_job_prep(ThreadPoolJobType::ENCODE_ALL_POWERS, games);
 
   // Job-specific prep
-  TensorDict fields(new_data_fields(games.size(), N_SCS, true));
-  size_t n_threads = threads_.size() > 0 ? threads_.size() : 1;
+  TensorDict &fields = batch->fields;
+  fields = data_fields_pool_.get(games.size(), N_SCS, true);
+  maybe_reset_possible_actions(fields);
+  if (trim_seq_len_) {
+    batch->seq_lens.resize(games.size());
+  }
   for (int i = 0; i < games.size(); ++i) {
-    jobs_[i % n_threads].encoding_array_pointers.push_back(
+    batch->jobs[i % batch->jobs.size()].encoding_array_pointers.push_back(
         EncodingArrayPointers{
-            fields["x_board_state"].index({i}).data_ptr<float>(),
-            fields["x_prev_state"].index({i}).data_ptr<float>(),
+            nullptr, // x_board_state, see set_board_state_rows
+            nullptr, // x_prev_state
             fields["x_prev_orders"].index({i}).data_ptr<long>(),
             fields["x_season"].index({i}).data_ptr<float>(),
             fields["x_in_adj_phase"].index({i}).data_ptr<float>(),
@@ -129,26 +1253,130 @@ TensorDict ThreadPool::encode_inputs_all_powers_multi(vector<Game *> &games) {
             fields["x_possible_actions"].index({i}).data_ptr<int32_t>(),
             fields["x_power"].index({i}).data_ptr<int64_t>(),
         });
+    EncodingArrayPointers &pointers =
+        batch->jobs[i % batch->jobs.size()].encoding_array_pointers.back();
+    set_board_state_rows(*batch, i, pointers);
+    if (trim_seq_len_) {
+      pointers.seq_len = &batch->seq_lens[i];
+    }
   }
 
-  boilerplate_job_handle(my_lock);
+  return submit(batch);
+}
 
-  return fields;
+TensorDict ThreadPool::encode_inputs_all_powers_multi(vector<Game *> &games) {
+  return encode_inputs_all_powers_multi_async(games).wait();
+}
+
+ThreadPoolFuture ThreadPool::encode_inputs_multi_async(vector<Game *> &games) {
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::ENCODE, games);
+  set_encoding_array_pointers(*batch, games.size());
+  return submit(batch);
+}
+
+// Allocate encode_inputs_multi fields for the batch, and point each job's
+// games at their rows
+void ThreadPool::set_encoding_array_pointers(ThreadPoolBatch &batch,
+                                             size_t n_games) {
+  TensorDict &fields = batch.fields;
+  fields = data_fields_pool_.get(n_games, OrdersEncoder::MAX_SEQ_LEN, false);
+  maybe_reset_possible_actions(fields);
+  if (trim_seq_len_) {
+    batch.seq_lens.resize(n_games);
+  }
+  for (int i = 0; i < n_games; ++i) {
+    batch.jobs[i % batch.jobs.size()].encoding_array_pointers.push_back(
+        EncodingArrayPointers{
+            nullptr, // x_board_state, see set_board_state_rows
+            nullptr, // x_prev_state
+            fields["x_prev_orders"].index({i}).data_ptr<long>(),
+            fields["x_season"].index({i}).data_ptr<float>(),
+            fields["x_in_adj_phase"].index({i}).data_ptr<float>(),
+            fields["x_build_numbers"].index({i}).data_ptr<float>(),
+            fields["x_loc_idxs"].index({i}).data_ptr<int8_t>(),
+            fields["x_possible_actions"].index({i}).data_ptr<int32_t>(),
+            nullptr, // x_max_seq_len
+        });
+    EncodingArrayPointers &pointers =
+        batch.jobs[i % batch.jobs.size()].encoding_array_pointers.back();
+    set_board_state_rows(batch, i, pointers);
+    if (trim_seq_len_) {
+      pointers.seq_len = &batch.seq_lens[i];
+    }
+  }
+}
+
+void ThreadPool::set_orders_from_idxs(vector<Game *> &games,
+                                      torch::Tensor order_idxs) {
+  order_idxs = order_idxs_to_cpu(order_idxs);
+  JCHECK(order_idxs.dim() == 3 && order_idxs.size(0) == games.size() &&
+             order_idxs.size(1) == 7,
+         "set_orders_from_idxs expects [B, 7, S] order_idxs");
+  const long *data = order_idxs.data_ptr<long>();
+  long max_seq_len = order_idxs.size(2);
+
+  vector<vector<Order>> orders;
+  for (int i = 0; i < games.size(); ++i) {
+    orders_encoder_->decode_order_idxs(data + i * 7 * max_seq_len, max_seq_len,
+                                      orders);
+    for (int power_i = 0; power_i < 7; ++power_i) {
+      if (!orders[power_i].empty()) {
+        games[i]->set_orders(POWERS[power_i], orders[power_i]);
+      }
+    }
+  }
+}
+
+TensorDict ThreadPool::step_and_encode_multi(vector<Game *> &games,
+                                             torch::Tensor order_idxs) {
+  order_idxs = order_idxs_to_cpu(order_idxs);
+  JCHECK(order_idxs.dim() == 3 && order_idxs.size(0) == games.size() &&
+             order_idxs.size(1) == 7,
+         "step_and_encode_multi expects [B, 7, S] order_idxs");
+
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::STEP_AND_ENCODE, games);
+  for (int i = 0; i < games.size(); ++i) {
+    ThreadPoolJob &job = batch->jobs[i % batch->jobs.size()];
+    job.orders_idxs.push_back(i);
+    job.step_order_idxs = order_idxs.data_ptr<long>();
+    job.step_max_seq_len = order_idxs.size(2);
+  }
+  set_encoding_array_pointers(*batch, games.size());
+
+  // order_idxs is kept alive until the batch is done
+  return submit(batch).wait();
 }
 
 TensorDict ThreadPool::encode_inputs_multi(vector<Game *> &games) {
-  unique_lock<mutex> my_lock(mutex_);
+  return encode_inputs_multi_async(games).wait();
+}
 
-  boilerplate_job_prep(ThreadPoolJobType::ENCODE, games);
+TensorDict ThreadPool::encode_inputs_powers_multi(vector<Game *> &games,
+                                                  const vector<Power> &powers) {
+  JCHECK(!powers.empty() && powers.size() <= 7,
+         "encode_inputs_powers_multi expects 1 to 7 powers");
+  auto batch = boilerplate_job_prep(ThreadPoolJobType::ENCODE, games);
+  long B = games.size();
+  long k = powers.size();
 
   // Job-specific prep
-  TensorDict fields(new_data_fields(games.size()));
-  size_t n_threads = threads_.size() > 0 ? threads_.size() : 1;
-  for (int i = 0; i < games.size(); ++i) {
-    jobs_[i % n_threads].encoding_array_pointers.push_back(
+  TensorDict &fields = batch->fields;
+  fields = data_fields_pool_.get(B, 0, false);
+  auto opts = torch::TensorOptions().pinned_memory(
+      data_fields_pool_.get_pin_memory());
+  fields["x_loc_idxs"] = torch::empty({B, k, 81}, opts.dtype(torch::kInt8));
+  fields["x_possible_actions"] =
+      torch::empty({B, k, OrdersEncoder::MAX_SEQ_LEN, 469},
+                   opts.dtype(torch::kInt32));
+  maybe_reset_possible_actions(fields);
+  for (auto &job : batch->jobs) {
+    job.powers = powers;
+  }
+  for (int i = 0; i < B; ++i) {
+    batch->jobs[i % batch->jobs.size()].encoding_array_pointers.push_back(
         EncodingArrayPointers{
-            fields["x_board_state"].index({i}).data_ptr<float>(),
-            fields["x_prev_state"].index({i}).data_ptr<float>(),
+            nullptr, // x_board_state, see set_board_state_rows
+            nullptr, // x_prev_state
             fields["x_prev_orders"].index({i}).data_ptr<long>(),
             fields["x_season"].index({i}).data_ptr<float>(),
             fields["x_in_adj_phase"].index({i}).data_ptr<float>(),
@@ -157,43 +1385,88 @@ TensorDict ThreadPool::encode_inputs_multi(vector<Game *> &games) {
             fields["x_possible_actions"].index({i}).data_ptr<int32_t>(),
             nullptr, // x_max_seq_len
         });
+    set_board_state_rows(*batch, i,
+                         batch->jobs[i % batch->jobs.size()]
+                             .encoding_array_pointers.back());
   }
 
-  boilerplate_job_handle(my_lock);
+  return submit(batch).wait();
+}
 
+TensorDict ThreadPool::encode_inputs_repeated(Game &game, size_t n) {
+  vector<Game *> games{&game};
+  TensorDict fields = encode_inputs_multi(games);
+  expand_prev_state_delta(fields); // CSR fields can't be repeated by views
+  for (auto &it : fields) {
+    vector<int64_t> sizes = it.second.sizes().vec();
+    sizes[0] = n;
+    it.second = it.second.expand(sizes);
+  }
   return fields;
 }
 
-void ThreadPool::thread_fn() {
+void ThreadPool::thread_fn(size_t worker, size_t group, int cpu) {
+  if (cpu >= 0 && !pin_current_thread(cpu)) {
+    LOG(WARNING) << "ThreadPool: could not pin thread to CPU " << cpu;
+  }
+  set_trace_thread_name("ThreadPool worker (group " + to_string(group) + ")");
+
+  auto active = [this, worker] { return worker < n_active_; };
   while (true) {
-    ThreadPoolJob job;
+    // In low-latency mode, poll for jobs before sleeping on cv_in_
+    if (active()) {
+      spin_until([this] { return n_unclaimed_jobs_.load() > 0; }, spin_us_);
+    }
+
+    ThreadPoolJob *job;
+    shared_ptr<ThreadPoolBatch> batch;
     { // Locked critical section
-      unique_lock<mutex> my_lock(mutex_);
-      while (!time_to_die_ && jobs_.size() == 0) {
-        cv_in_.wait(my_lock);
+      unique_lock<mutex> my_lock = lock_mutex();
+      auto has_job = [&] { return active() && has_queued_batches(); };
+      if (!time_to_die_ && !has_job()) {
+        optional<PerfTimer> perf_timer;
+        if (active()) {
+          perf_timer.emplace(PerfCounter::THREAD_POOL_IDLE);
+        }
+        TraceScope trace_scope(active() ? "idle" : "parked", "thread_pool");
+        while (!time_to_die_ && !has_job()) {
+          (active() ? cv_in_ : cv_parked_).wait(my_lock);
+        }
       }
       if (time_to_die_) {
         return;
       }
-      job = jobs_.back();
-      jobs_.pop_back();
+      // Keep the batch alive until its job is finished; its jobs vector is
+      // not modified after submission
+      batch = next_batch();
+      job = claim_job(*batch, group);
     }
 
     // Do the job
-    thread_fn_do_job_unsafe(job);
-
-    // Notify done (locked critical section)
-    {
-      unique_lock<mutex> my_lock(mutex_);
-      unfinished_jobs_--;
-      if (unfinished_jobs_ == 0) {
-        cv_out_.notify_all();
-      }
-    }
+    auto start = chrono::steady_clock::now();
+    uint64_t start_cpu_ns = get_thread_cpu_ns();
+    thread_fn_do_job_unsafe(*job);
+    busy_cpu_ns_ += get_thread_cpu_ns() - start_cpu_ns;
+    busy_ns_ += chrono::duration_cast<chrono::nanoseconds>(
+                    chrono::steady_clock::now() - start)
+                    .count();
+    finish_job(*batch);
   }
 }
 
 void ThreadPool::thread_fn_do_job_unsafe(ThreadPoolJob &job) {
+  PerfTimer perf_timer(PerfCounter::THREAD_POOL_WORK);
+  // Scratch memory of the job is reset when it is done
+  ArenaScope arena_scope;
+  TraceScope trace_scope(job_type_name(job.job_type), "thread_pool");
+  if (trace_scope.enabled()) {
+    trace_scope.add_arg("n_games", to_string(job_n_items(job)));
+    if (!job.games.empty()) {
+      trace_scope.add_arg(
+          "phase_type",
+          string(1, job.games[0]->get_state().get_phase().phase_type));
+    }
+  }
   try {
     // Do the job
     if (job.job_type == ThreadPoolJobType::STEP) {
@@ -204,6 +1477,28 @@ void ThreadPool::thread_fn_do_job_unsafe(ThreadPoolJob &job) {
       do_job_encode_state_only(job);
     } else if (job.job_type == ThreadPoolJobType::ENCODE_ALL_POWERS) {
       do_job_encode_all_powers(job);
+    } else if (job.job_type == ThreadPoolJobType::PROCESS_MANY) {
+      do_job_process_many(job);
+    } else if (job.job_type == ThreadPoolJobType::LOAD_CORPUS) {
+      do_job_load_corpus(job);
+    } else if (job.job_type == ThreadPoolJobType::STEP_AND_ENCODE) {
+      do_job_step_and_encode(job);
+    } else if (job.job_type == ThreadPoolJobType::CLONE) {
+      do_job_clone(job);
+    } else if (job.job_type == ThreadPoolJobType::DATASET_TARGETS) {
+      do_job_dataset_targets(job);
+    } else if (job.job_type == ThreadPoolJobType::CORPUS_HASHES) {
+      do_job_corpus_hashes(job);
+    } else if (job.job_type == ThreadPoolJobType::PLAYOUT) {
+      do_job_playout(job);
+    } else if (job.job_type == ThreadPoolJobType::REPLAY) {
+      do_job_replay(job);
+    } else if (job.job_type == ThreadPoolJobType::SOS_TARGETS) {
+      do_job_sos_targets(job);
+    } else if (job.job_type == ThreadPoolJobType::CAT_PAD) {
+      do_job_cat_pad(job);
+    } else if (job.job_type == ThreadPoolJobType::ROLLOUT_CACHE) {
+      do_job_rollout_cache(job);
     } else {
       JCHECK(false, "ThreadPoolJobType Not Implemented");
     }
@@ -214,24 +1509,228 @@ void ThreadPool::thread_fn_do_job_unsafe(ThreadPoolJob &job) {
 }
 
 void ThreadPool::do_job_step(ThreadPoolJob &job) {
-  for (Game *game : job.games) {
-    game->process();
+  for (size_t i = 0; i < job.games.size(); ++i) {
+    Game *game = job.games[i];
+    Game *leader = job.leaders.empty() ? nullptr : job.leaders[i];
+    if (job.statuses != nullptr) {
+      ProcessStatus status = leader != nullptr
+                                 ? game->try_process_like(*leader)
+                                 : game->try_process();
+      (*job.statuses)[job.orders_idxs[i]] = status;
+      if (status != ProcessStatus::OK) {
+        continue;
+      }
+    } else if (leader != nullptr) {
+      game->process_like(*leader);
+    } else {
+      game->process();
+    }
+    if (!game->get_lazy_possible_orders()) {
+      game->get_all_possible_orders();
+    }
+  }
+}
+
+void ThreadPool::do_job_process_many(ThreadPoolJob &job) {
+  JCHECK(job.games.size() == 1, "do_job_process_many expects one root game");
+  const Game &root = *job.games[0];
+
+  for (size_t i : job.orders_idxs) {
+    // Game copies share the root GameState, which is read-only here
+    optional<Game> &successor = (*job.successors)[i];
+    successor.emplace(root);
+    for (const auto & [ power, power_orders ] : (*job.orders)[i]) {
+      successor->set_orders(power, power_orders);
+    }
+    successor->process();
+    successor->get_all_possible_orders();
+  }
+}
+
+void ThreadPool::do_job_clone(ThreadPoolJob &job) {
+  JCHECK(job.games.size() == 1, "do_job_clone expects one root game");
+  const Game &root = *job.games[0];
+  for (size_t i : job.orders_idxs) {
+    (*job.successors)[i].emplace(root);
+  }
+}
+
+void ThreadPool::do_job_playout(ThreadPoolJob &job) {
+  for (size_t i = 0; i < job.games.size(); ++i) {
+    uint64_t idx = job.orders_idxs[i];
+    seed_seq seq{static_cast<uint32_t>(job.playout_seed),
+                 static_cast<uint32_t>(job.playout_seed >> 32),
+                 static_cast<uint32_t>(idx), static_cast<uint32_t>(idx >> 32)};
+    mt19937 rng(seq);
+    job.n_phases +=
+        playout(*job.games[i], job.playout_policy, job.max_move_phases, rng);
+  }
+}
+
+void ThreadPool::do_job_sos_targets(ThreadPoolJob &job) {
+  for (size_t i = 0; i < job.games.size(); ++i) {
+    job.games[i]->write_sos_targets(job.value_decay_alpha,
+                                    job.sos_targets + job.orders_idxs[i] * 7);
+  }
+}
+
+void ThreadPool::do_job_rollout_cache(ThreadPoolJob &job) {
+  for (size_t i = 0; i < job.games.size(); ++i) {
+    size_t row = job.orders_idxs[i];
+    RolloutCache::Key key = RolloutCache::make_key(*job.games[i]);
+    job.rollout_keys[row * 2] = static_cast<int64_t>(key.first);
+    job.rollout_keys[row * 2 + 1] = static_cast<int64_t>(key.second);
+    RolloutCache::Values values;
+    job.rollout_hits[row] = job.rollout_cache->get(key, values);
+    if (job.rollout_hits[row]) {
+      std::copy(values.begin(), values.end(), job.rollout_values + row * 7);
+    }
+  }
+}
+
+void ThreadPool::do_job_cat_pad(ThreadPoolJob &job) {
+  for (const CatPadField &field : *job.cat_pad_fields) {
+    size_t row_bytes = field.out.stride(0) * field.out.element_size();
+    for (size_t i : job.orders_idxs) {
+      const torch::Tensor &input = field.inputs[i];
+      vector<int64_t> out_shape = field.out.sizes().vec();
+      out_shape[0] = input.size(0);
+      copy_padded(static_cast<const char *>(input.data_ptr()), input.sizes(),
+                  static_cast<char *>(field.out.data_ptr()) +
+                      field.first_rows[i] * row_bytes,
+                  out_shape, field.pad);
+    }
+  }
+}
+
+void ThreadPool::do_job_replay(ThreadPoolJob &job) {
+  for (size_t i : job.orders_idxs) {
+    (*job.replay_results)[i] = replay_game_json((*job.game_jsons)[i]);
+  }
+}
+
+void ThreadPool::do_job_load_corpus(ThreadPoolJob &job) {
+  for (size_t i : job.orders_idxs) {
+    optional<Game> &game = (*job.successors)[i];
+    game.emplace(job.corpus->get_phase((*job.corpus_phase_idxs)[i]));
     game->get_all_possible_orders();
   }
 }
 
+void ThreadPool::do_job_dataset_targets(ThreadPoolJob &job) {
+  const DatasetTargetsArgs &args = *job.dataset_targets;
+  for (size_t i : job.orders_idxs) {
+    Game game = job.corpus->get_game((*args.game_idxs)[i]);
+    write_dataset_targets(game, args, args.first_rows[i]);
+  }
+}
+
+void ThreadPool::do_job_corpus_hashes(ThreadPoolJob &job) {
+  for (size_t i : job.orders_idxs) {
+    Game game = job.corpus->get_game((*job.corpus_game_idxs)[i]);
+    vector<uint64_t> hashes = get_position_hashes(game);
+    std::copy(hashes.begin(), hashes.end(),
+              job.position_hashes + (*job.first_rows)[i]);
+  }
+}
+
+void ThreadPool::write_dataset_targets(Game &game,
+                                       const DatasetTargetsArgs &args,
+                                       size_t row) const {
+  const long S = OrdersEncoder::MAX_SEQ_LEN;
+  auto &state_history = game.get_state_history();
+  auto &order_history = game.get_order_history();
+  vector<Phase> phases;
+  for (auto &it : state_history) {
+    phases.push_back(it.first);
+  }
+  float final_scores[7], final_sc_counts[7];
+  game.write_square_scores(final_scores, final_sc_counts);
+  bool min_score_filter =
+      args.only_with_min_final_score >= 0 &&
+      *max_element(final_sc_counts, final_sc_counts + 7) >=
+          args.only_with_min_final_score;
+
+  game.write_sos_targets(args.value_decay_alpha,
+                         args.y_final_scores + row * 7);
+
+  vector<Order> power_orders;
+  for (size_t k = 0; k < phases.size(); ++k, ++row) {
+    // y_actions and valid_power_idxs
+    const PhaseOrders &phase_orders = order_history.get(phases[k]);
+    for (int p = 0; p < 7; ++p) {
+      auto orders = phase_orders.get(POWERS[p]);
+      power_orders.assign(orders.begin(), orders.end());
+      int32_t *y_actions = args.y_actions + (row * 7 + p) * S;
+      bool valid = orders_encoder_->encode_power_actions(
+          power_orders, args.cand_offsets + (row * 7 + p) * S,
+          args.cand_values, y_actions);
+      if (args.exclude_n_holds >= 0 &&
+          args.exclude_n_holds <= orders.size() &&
+          all_of(orders.begin(), orders.end(), [](const Order &order) {
+            return order.get_type() == OrderType::H;
+          })) {
+        valid = false;
+      }
+      if (y_actions[0] == OrdersEncoder::EOS_IDX) {
+        valid = false; // no orders
+      }
+      if (min_score_filter &&
+          final_sc_counts[p] < args.only_with_min_final_score) {
+        valid = false;
+      }
+      args.valid_power_idxs[row * 7 + p] = valid;
+    }
+  }
+}
+
+void ThreadPool::do_job_step_and_encode(ThreadPoolJob &job) {
+  JCHECK(job.games.size() == job.encoding_array_pointers.size() &&
+             job.games.size() == job.orders_idxs.size(),
+         "do_job_step_and_encode called with wrong input sizes");
+
+  vector<vector<Order>> orders;
+  for (int i = 0; i < job.games.size(); ++i) {
+    Game *game = job.games[i];
+    // The phase type is only known once the game is stepped
+    auto encode = [&](EncodingArrayPointers &p) {
+      visit_phase_type(game->get_state().get_phase().phase_type,
+                       [&](auto phase_type) {
+                         encode_game<decltype(phase_type)::value>(game, p);
+                       });
+    };
+    if (game->is_game_done()) {
+      encode_row(job.encoding_array_pointers[i], encode);
+      set_seq_len(game, job.encoding_array_pointers[i], false);
+      continue;
+    }
+    orders_encoder_->decode_order_idxs(
+        job.step_order_idxs + job.orders_idxs[i] * 7 * job.step_max_seq_len,
+        job.step_max_seq_len, orders);
+    for (int power_i = 0; power_i < 7; ++power_i) {
+      if (!orders[power_i].empty()) {
+        game->set_orders(POWERS[power_i], orders[power_i]);
+      }
+    }
+    game->process();
+    encode_row(job.encoding_array_pointers[i], encode);
+    set_seq_len(game, job.encoding_array_pointers[i], false);
+  }
+}
+
 void ThreadPool::do_job_encode_state_only(ThreadPoolJob &job) {
   JCHECK(job.job_type == ThreadPoolJobType::ENCODE_STATE_ONLY,
          "do_job_encode called with wrong ThreadPoolJobType");
   JCHECK(job.games.size() == job.encoding_array_pointers.size(),
          "do_job_encode called with wrong input sizes");
 
-  for (int i = 0; i < job.games.size(); ++i) {
+  for_each_game_by_phase_type(job.games, [&](auto phase_type, int i) {
+    constexpr char P = decltype(phase_type)::value;
     Game *game = job.games[i];
-    EncodingArrayPointers &pointers = job.encoding_array_pointers[i];
-
-    encode_state_for_game(game, pointers);
-  }
+    encode_row(job.encoding_array_pointers[i], [&](EncodingArrayPointers &p) {
+      encode_state_for_game<P>(game, p);
+    });
+  });
 }
 
 void ThreadPool::do_job_encode_all_powers(ThreadPoolJob &job) {
@@ -240,15 +1739,18 @@ void ThreadPool::do_job_encode_all_powers(ThreadPoolJob &job) {
   JCHECK(job.games.size() == job.encoding_array_pointers.size(),
          "do_job_encode called with wrong input sizes");
 
-  for (int i = 0; i < job.games.size(); ++i) {
+  for_each_game_by_phase_type(job.games, [&](auto phase_type, int i) {
+    constexpr char P = decltype(phase_type)::value;
     Game *game = job.games[i];
-    EncodingArrayPointers &pointers = job.encoding_array_pointers[i];
-
-    encode_state_for_game(game, pointers);
-    orders_encoder_.encode_valid_orders_all_powers(
-        game->get_state(), pointers.x_possible_actions, pointers.x_loc_idxs,
-        pointers.x_power);
-  }
+    encode_row(job.encoding_array_pointers[i], [&](EncodingArrayPointers &p) {
+      encode_state_for_game<P>(game, p);
+      int32_t *x_possible_actions = get_possible_actions_ptr(p, N_SCS);
+      orders_encoder_->encode_valid_orders_all_powers<P>(
+          game->get_state(), x_possible_actions, p.x_loc_idxs, p.x_power);
+      maybe_compress_possible_actions(p, N_SCS);
+    });
+    set_seq_len(game, job.encoding_array_pointers[i], true);
+  });
 }
 
 void ThreadPool::do_job_encode(ThreadPoolJob &job) {
@@ -257,53 +1759,313 @@ void ThreadPool::do_job_encode(ThreadPoolJob &job) {
   JCHECK(job.games.size() == job.encoding_array_pointers.size(),
          "do_job_encode called with wrong input sizes");
 
-  for (int i = 0; i < job.games.size(); ++i) {
+  for_each_game_by_phase_type(job.games, [&](auto phase_type, int i) {
+    constexpr char P = decltype(phase_type)::value;
     Game *game = job.games[i];
-    EncodingArrayPointers &pointers = job.encoding_array_pointers[i];
+    if (!job.powers.empty()) {
+      encode_row(job.encoding_array_pointers[i], [&](EncodingArrayPointers &p) {
+        encode_game_powers<P>(game, job.powers, p);
+      });
+      return;
+    }
+    encode_row(job.encoding_array_pointers[i],
+               [&](EncodingArrayPointers &p) { encode_game<P>(game, p); });
+    set_seq_len(game, job.encoding_array_pointers[i], false);
+  });
+}
 
-    // encode all inputs except actions
-    encode_state_for_game(game, pointers);
+void ThreadPool::set_seq_len(Game *game, EncodingArrayPointers &pointers,
+                             bool all_powers) const {
+  if (pointers.seq_len != nullptr) {
+    *pointers.seq_len =
+        orders_encoder_->get_seq_len(game->get_state(), all_powers);
+  }
+}
 
-    // encode x_possible_actions, x_loc_idxs
-    for (int power_i = 0; power_i < 7; ++power_i) {
-      orders_encoder_.encode_valid_orders(
-          POWERS[power_i], game->get_state(),
-          pointers.x_possible_actions + (power_i * orders_encoder_.MAX_SEQ_LEN *
-                                         orders_encoder_.get_max_cands()),
-          pointers.x_loc_idxs + (power_i * 81));
+// Encode the inputs of encode_inputs_multi
+template <char PhaseType>
+void ThreadPool::encode_game(Game *game, EncodingArrayPointers &pointers) {
+  if (encoding_cache_ == nullptr) {
+    encode_game_uncached<PhaseType>(game, pointers);
+    return;
+  }
+
+  auto prev = get_prev_phase_encoding(game);
+  EncodingCache::Key key{game->compute_board_hash(),
+                         prev == nullptr ? 0 : prev->hash};
+  auto cached = encoding_cache_->get(key);
+  if (cached == nullptr) {
+    encode_game_uncached<PhaseType>(game, pointers);
+    encoding_cache_->put(key, make_encoded_state(pointers));
+    return;
+  }
+  write_prev_phase_encoding(prev.get(), pointers);
+  write_encoded_state(*cached, pointers);
+}
+
+shared_ptr<const EncodedState>
+ThreadPool::make_encoded_state(EncodingArrayPointers &pointers) const {
+  auto r = std::make_shared<EncodedState>();
+  r->x_board_state.assign(pointers.x_board_state,
+                          pointers.x_board_state + 81 * BOARD_STATE_ENC_WIDTH);
+  memcpy(r->x_season.data(), pointers.x_season, 3 * sizeof(float));
+  r->x_in_adj_phase = *pointers.x_in_adj_phase;
+  memcpy(r->x_build_numbers.data(), pointers.x_build_numbers,
+         7 * sizeof(float));
+  r->x_loc_idxs.assign(pointers.x_loc_idxs, pointers.x_loc_idxs + 7 * 81);
+  if (pointers.x_possible_actions_sparse != nullptr) {
+    r->x_possible_actions = *pointers.x_possible_actions_sparse;
+  } else {
+    compress_possible_actions(pointers.x_possible_actions,
+                              OrdersEncoder::MAX_SEQ_LEN,
+                              &r->x_possible_actions);
+  }
+  return r;
+}
+
+void ThreadPool::write_encoded_state(const EncodedState &encoded,
+                                     EncodingArrayPointers &pointers) const {
+  memcpy(pointers.x_board_state, encoded.x_board_state.data(),
+         81 * BOARD_STATE_ENC_WIDTH * sizeof(float));
+  memcpy(pointers.x_season, encoded.x_season.data(), 3 * sizeof(float));
+  *pointers.x_in_adj_phase = encoded.x_in_adj_phase;
+  memcpy(pointers.x_build_numbers, encoded.x_build_numbers.data(),
+         7 * sizeof(float));
+  memcpy(pointers.x_loc_idxs, encoded.x_loc_idxs.data(), 7 * 81);
+  if (pointers.x_possible_actions_sparse != nullptr) {
+    *pointers.x_possible_actions_sparse = encoded.x_possible_actions;
+    return;
+  }
+
+  // Expand to the dense EOS-padded rows
+  size_t max_cands = orders_encoder_->get_max_cands();
+  const int32_t *values = encoded.x_possible_actions.values.data();
+  int32_t *p = pointers.x_possible_actions;
+  for (int32_t row_len : encoded.x_possible_actions.row_lens) {
+    memcpy(p, values, row_len * sizeof(int32_t));
+    std::fill(p + row_len, p + max_cands, OrdersEncoder::EOS_IDX);
+    values += row_len;
+    p += max_cands;
+  }
+}
+
+template <char PhaseType>
+void ThreadPool::encode_game_uncached(Game *game,
+                                      EncodingArrayPointers &pointers) {
+  // encode all inputs except actions
+  encode_state_for_game<PhaseType>(game, pointers);
+
+  // encode x_possible_actions, x_loc_idxs
+  int32_t *x_possible_actions =
+      get_possible_actions_ptr(pointers, orders_encoder_->MAX_SEQ_LEN);
+  for (int power_i = 0; power_i < 7; ++power_i) {
+    orders_encoder_->encode_valid_orders<PhaseType>(
+        POWERS[power_i], game->get_state(),
+        x_possible_actions + (power_i * orders_encoder_->MAX_SEQ_LEN *
+                              orders_encoder_->get_max_cands()),
+        pointers.x_loc_idxs + (power_i * 81));
+  }
+  maybe_compress_possible_actions(pointers, orders_encoder_->MAX_SEQ_LEN);
+}
+
+// Encode the inputs of encode_inputs_powers_multi
+template <char PhaseType>
+void ThreadPool::encode_game_powers(Game *game, const vector<Power> &powers,
+                                    EncodingArrayPointers &pointers) {
+  encode_state_for_game<PhaseType>(game, pointers);
+  for (int i = 0; i < powers.size(); ++i) {
+    orders_encoder_->encode_valid_orders<PhaseType>(
+        powers[i], game->get_state(),
+        pointers.x_possible_actions + (i * orders_encoder_->MAX_SEQ_LEN *
+                                       orders_encoder_->get_max_cands()),
+        pointers.x_loc_idxs + (i * 81));
+  }
+}
+
+namespace {
+
+// Dense x_possible_actions of one game, for sparse encoding jobs
+thread_local vector<int32_t> possible_actions_scratch;
+
+} // namespace
+
+int32_t *ThreadPool::get_possible_actions_ptr(EncodingArrayPointers &pointers,
+                                              size_t max_seq_len) const {
+  if (pointers.x_possible_actions_sparse == nullptr) {
+    return pointers.x_possible_actions;
+  }
+  possible_actions_scratch.resize(7 * max_seq_len *
+                                  orders_encoder_->get_max_cands());
+  return possible_actions_scratch.data();
+}
+
+void ThreadPool::maybe_compress_possible_actions(
+    EncodingArrayPointers &pointers, size_t max_seq_len) const {
+  SparsePossibleActions *sparse = pointers.x_possible_actions_sparse;
+  if (sparse == nullptr) {
+    return;
+  }
+  compress_possible_actions(possible_actions_scratch.data(), max_seq_len,
+                            sparse);
+}
+
+void ThreadPool::trim_seq_lens(ThreadPoolBatch &batch) const {
+  if (batch.seq_lens.empty()) {
+    return;
+  }
+  torch::Tensor &x_possible_actions = batch.fields["x_possible_actions"];
+  long B = x_possible_actions.size(0);
+  long max_seq_len = x_possible_actions.size(2);
+  long max_cands = x_possible_actions.size(3);
+  long S = *max_element(batch.seq_lens.begin(), batch.seq_lens.end());
+  S = std::min(std::max(S, 1L), max_seq_len);
+  batch.seq_lens.clear();
+  if (S == max_seq_len) {
+    return;
+  }
+
+  // Move each [S, max_cands] block of the rows to the front of the buffer,
+  // which is then viewed as [B, 7, S, ...]. The full buffer is pooled by
+  // DataFieldsPool::release.
+  auto trim = [&](torch::Tensor &field, long row_size) {
+    char *data = static_cast<char *>(field.data_ptr());
+    size_t n_bytes = S * row_size * field.element_size();
+    size_t stride = max_seq_len * row_size * field.element_size();
+    for (long k = 1; k < B * 7; ++k) {
+      memmove(data + k * n_bytes, data + k * stride, n_bytes);
     }
+    vector<int64_t> sizes = field.sizes().vec();
+    sizes[2] = S;
+    field = field.view(-1).narrow(0, 0, B * 7 * S * row_size).view(sizes);
+  };
+  trim(x_possible_actions, max_cands);
+  auto power_it = batch.fields.find("x_power");
+  if (power_it != batch.fields.end()) {
+    trim(power_it->second, 1);
   }
 }
 
-void ThreadPool::encode_state_for_game(Game *game,
-                                       EncodingArrayPointers &pointers) {
-  // encode x_board_state
-  encode_board_state(game->get_state(), pointers.x_board_state);
+void ThreadPool::write_prev_state_deltas(ThreadPoolBatch &batch) const {
+  if (batch.prev_state_deltas.empty()) {
+    return;
+  }
+  size_t n_rows = 0;
+  for (auto &delta : batch.prev_state_deltas) {
+    n_rows += delta.locs.size();
+  }
+  vector<float> rows;
+  rows.reserve(n_rows * BOARD_STATE_ENC_WIDTH);
+  long B = batch.prev_state_deltas.size();
+  auto opts = torch::TensorOptions().pinned_memory(
+      data_fields_pool_.get_pin_memory());
+  torch::Tensor offsets = torch::empty({B + 1}, opts.dtype(torch::kLong));
+  torch::Tensor locs =
+      torch::empty({static_cast<long>(n_rows)}, opts.dtype(torch::kLong));
+  int64_t *offsets_p = offsets.data_ptr<int64_t>();
+  int64_t *locs_p = locs.data_ptr<int64_t>();
+  *offsets_p++ = 0;
+  for (auto &delta : batch.prev_state_deltas) {
+    memcpy(locs_p, delta.locs.data(), delta.locs.size() * sizeof(int64_t));
+    locs_p += delta.locs.size();
+    *offsets_p = offsets_p[-1] + delta.locs.size();
+    ++offsets_p;
+    rows.insert(rows.end(), delta.rows.begin(), delta.rows.end());
+  }
 
-  // encode x_prev_state, x_prev_orders
+  // Rows are in the board state format
+  torch::Tensor board_state = batch.fields["x_board_state"];
+  vector<long> rows_shape = board_state.sizes().vec();
+  rows_shape.erase(rows_shape.begin());
+  rows_shape[0] = n_rows;
+  torch::Tensor delta_rows =
+      torch::empty(rows_shape, opts.dtype(board_state.scalar_type()));
+  write_board_state(rows.data(), get_board_state_format(board_state),
+                    delta_rows.data_ptr(), n_rows);
+
+  batch.fields["x_prev_state_delta_offsets"] = offsets;
+  batch.fields["x_prev_state_delta_locs"] = locs;
+  batch.fields["x_prev_state_delta_rows"] = delta_rows;
+  batch.prev_state_deltas.clear();
+}
+
+void ThreadPool::compress_possible_actions(
+    const int32_t *x_possible_actions, size_t max_seq_len,
+    SparsePossibleActions *sparse) const {
+  size_t max_cands = orders_encoder_->get_max_cands();
+  sparse->row_lens.assign(7 * max_seq_len, 0);
+  sparse->values.clear();
+  for (size_t row = 0; row < 7 * max_seq_len; ++row) {
+    const int32_t *p = x_possible_actions + row * max_cands;
+    size_t n = 0;
+    while (n < max_cands && p[n] != OrdersEncoder::EOS_IDX) {
+      sparse->values.push_back(p[n++]);
+    }
+    sparse->row_lens[row] = n;
+  }
+}
+
+// Return the game's x_prev_state and x_prev_orders, encoding them if they are
+// not memoized yet, or nullptr if there is no previous movement phase
+shared_ptr<const PrevPhaseEncoding>
+ThreadPool::get_prev_phase_encoding(Game *game) {
   GameState *prev_move_state = game->get_last_movement_phase();
-  if (prev_move_state != nullptr) {
-    encode_board_state(*prev_move_state, pointers.x_prev_state);
-    orders_encoder_.encode_prev_orders_deepmind(game, pointers.x_prev_orders);
+  if (prev_move_state == nullptr) {
+    return nullptr;
+  }
+  auto prev = game->get_prev_phase_encoding();
+  if (prev != nullptr && prev->encoder_id == orders_encoder_->get_id()) {
+    return prev;
+  }
+
+  auto encoded = std::make_shared<PrevPhaseEncoding>();
+  encoded->encoder_id = orders_encoder_->get_id();
+  encoded->x_prev_state.resize(81 * BOARD_STATE_ENC_WIDTH);
+  encoded->x_prev_orders.resize(2 * PREV_ORDERS_CAPACITY);
+  encode_board_state<'M'>(*prev_move_state, encoded->x_prev_state.data());
+  orders_encoder_->encode_prev_orders_deepmind(game,
+                                              encoded->x_prev_orders.data());
+  encoded->hash = prev_move_state->compute_board_hash();
+  for (long x : encoded->x_prev_orders) {
+    encoded->hash = zobrist::detail::splitmix64(encoded->hash ^ x);
+  }
+  game->set_prev_phase_encoding(encoded);
+  return encoded;
+}
+
+void ThreadPool::write_prev_phase_encoding(
+    const PrevPhaseEncoding *prev, EncodingArrayPointers &pointers) const {
+  if (prev != nullptr) {
+    memcpy(pointers.x_prev_state, prev->x_prev_state.data(),
+           81 * BOARD_STATE_ENC_WIDTH * sizeof(float));
+    memcpy(pointers.x_prev_orders, prev->x_prev_orders.data(),
+           2 * PREV_ORDERS_CAPACITY * sizeof(long));
   } else {
     memset(pointers.x_prev_state, 0,
            81 * BOARD_STATE_ENC_WIDTH * sizeof(float));
     memset(pointers.x_prev_orders, 0, 2 * PREV_ORDERS_CAPACITY * sizeof(long));
   }
+}
+
+template <char PhaseType>
+void ThreadPool::encode_state_for_game(Game *game,
+                                       EncodingArrayPointers &pointers) {
+  // encode x_board_state
+  encode_board_state<PhaseType>(game->get_state(), pointers.x_board_state);
+
+  // encode x_prev_state, x_prev_orders
+  write_prev_phase_encoding(get_prev_phase_encoding(game).get(), pointers);
 
-  // encode x_season
-  Phase current_phase = game->get_state().get_phase();
+  // encode x_season: M- and R-phases are in spring or fall, A-phases in
+  // winter, and COMPLETED games are encoded as winter too
   memset(pointers.x_season, 0, 3 * sizeof(float));
-  if (current_phase.season == 'S') {
-    pointers.x_season[0] = 1;
-  } else if (current_phase.season == 'F') {
-    pointers.x_season[1] = 1;
+  if constexpr (PhaseType == 'M' || PhaseType == 'R') {
+    pointers.x_season[game->get_state().get_phase().season == 'S' ? 0 : 1] = 1;
   } else {
     pointers.x_season[2] = 1;
   }
 
   // encode x_in_adj_phase, x_build_numbers
-  if (current_phase.phase_type == 'A') {
+  if constexpr (PhaseType == 'A') {
     *pointers.x_in_adj_phase = 1;
     float *p = pointers.x_build_numbers;
     for (Power power : POWERS) {
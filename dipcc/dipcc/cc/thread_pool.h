@@ -7,25 +7,68 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 
 #include "data_fields.h"
+#include "encoding_cache.h"
 #include "game.h"
+#include "game_corpus.h"
 #include "orders_encoder.h"
+#include "playout.h"
+#include "replay.h"
+#include "rollout_cache.h"
 
 namespace py = pybind11;
 
 namespace dipcc {
 
 // Job Types
-enum ThreadPoolJobType { STEP, ENCODE, ENCODE_STATE_ONLY, ENCODE_ALL_POWERS };
+enum ThreadPoolJobType {
+  STEP,
+  ENCODE,
+  ENCODE_STATE_ONLY,
+  ENCODE_ALL_POWERS,
+  PROCESS_MANY,
+  LOAD_CORPUS,
+  STEP_AND_ENCODE,
+  CLONE,
+  DATASET_TARGETS,
+  PLAYOUT,
+  REPLAY,
+  SOS_TARGETS,
+  CAT_PAD,
+  CORPUS_HASHES,
+  ROLLOUT_CACHE
+};
+
+// Scheduling class of ThreadPool batches. Workers claim the jobs of
+// INTERACTIVE batches (e.g. encoding a live game's current phase) before
+// those of queued BULK batches (e.g. background rollouts), at job
+// granularity: running jobs are never interrupted.
+enum class ThreadPoolPriority { INTERACTIVE = 0, BULK = 1 };
+
+// Set the priority of the batches submitted by the calling thread, to any
+// ThreadPool. INTERACTIVE by default. Returns the previous priority.
+ThreadPoolPriority set_thread_pool_priority(ThreadPoolPriority priority);
+ThreadPoolPriority get_thread_pool_priority();
 
 // Used for ENCODE* jobs
 //
+// The x_prev_state rows of one game that differ from its x_board_state, for
+// prev state delta encodings (see expand_prev_state_delta)
+struct PrevStateDelta {
+  std::vector<int64_t> locs;
+  std::vector<float> rows; // [locs.size(), BOARD_STATE_ENC_WIDTH]
+};
+
 // Initialized in "new_data_fields" function
 struct EncodingArrayPointers {
   float *x_board_state;
@@ -37,6 +80,42 @@ struct EncodingArrayPointers {
   int8_t *x_loc_idxs;
   int32_t *x_possible_actions;
   int64_t *x_power;
+  // If set, x_possible_actions is ignored and the candidates are written here
+  SparsePossibleActions *x_possible_actions_sparse = nullptr;
+  // If the board state fields are not FLOAT32, x_board_state and x_prev_state
+  // are encoded to scratch memory, then written to these rows in this format
+  BoardStateFormat board_state_format = BoardStateFormat::FLOAT32;
+  void *x_board_state_out = nullptr;
+  void *x_prev_state_out = nullptr;
+  // If set, x_prev_state is ignored and its delta is written here
+  PrevStateDelta *x_prev_state_delta = nullptr;
+  // If set, the number of steps of x_possible_actions is written here (see
+  // OrdersEncoder::get_seq_len)
+  int *seq_len = nullptr;
+};
+
+// Used for DATASET_TARGETS jobs: the training targets of encode_dataset_games,
+// written for the phases of each game from row first_rows[i] on
+struct DatasetTargetsArgs {
+  const std::vector<size_t> *game_idxs;
+  std::vector<size_t> first_rows;
+  const int64_t *cand_offsets; // CSR x_possible_actions of all rows
+  const int32_t *cand_values;
+  int32_t *y_actions;      // [rows, 7, 17]
+  float *y_final_scores;   // [rows, 7]
+  bool *valid_power_idxs;  // [rows, 7]
+  float value_decay_alpha;
+  int only_with_min_final_score;
+  int exclude_n_holds;
+};
+
+// Used for CAT_PAD jobs: a field of cat_pad_inputs, to which the inputs'
+// contiguous tensors are copied from their first row on, padded with pad
+struct CatPadField {
+  torch::Tensor out;
+  std::vector<torch::Tensor> inputs;
+  std::vector<int64_t> first_rows;
+  std::vector<char> pad; // one element of out's dtype
 };
 
 // Struct for all job types
@@ -45,27 +124,206 @@ struct ThreadPoolJob {
   std::vector<Game *> games;
   std::vector<EncodingArrayPointers> encoding_array_pointers;
 
+  // Used for PROCESS_MANY jobs: games[0] is the shared root game, and
+  // orders_idxs are the indices into *orders for which this job produces
+  // successors. CLONE jobs set successors[i] to a copy of games[0] for each i
+  // in orders_idxs.
+  const std::vector<PowerOrderStrs> *orders = nullptr;
+  std::vector<size_t> orders_idxs;
+  std::vector<std::optional<Game>> *successors = nullptr;
+
+  // Used for ENCODE jobs: if not empty, only the x_possible_actions and
+  // x_loc_idxs rows of these powers are encoded, in this order (see
+  // encode_inputs_powers_multi)
+  std::vector<Power> powers;
+
+  // Used for LOAD_CORPUS jobs: successors[i] is set to corpus phase
+  // (*corpus_phase_idxs)[i] for each i in orders_idxs
+  const GameCorpus *corpus = nullptr;
+  const std::vector<size_t> *corpus_phase_idxs = nullptr;
+
+  // Used for DATASET_TARGETS jobs: the targets of corpus game
+  // (*dataset_targets->game_idxs)[i] are computed for each i in orders_idxs
+  const DatasetTargetsArgs *dataset_targets = nullptr;
+
+  // Used for STEP_AND_ENCODE jobs: the [B, 7, S] order idxs of the batch.
+  // games[i] is row orders_idxs[i].
+  const long *step_order_idxs = nullptr;
+  long step_max_seq_len = 0;
+
+  // Used for STEP jobs: leaders[i] is an earlier game of the job with the
+  // same state and staged orders as games[i], whose new state games[i]
+  // shares (see Game::process_like), or nullptr. Empty if not packed so.
+  // games[i] is game orders_idxs[i] of the batch; if statuses is set, games
+  // are processed with Game::try_process and (*statuses)[orders_idxs[i]] is
+  // set to the status of games[i].
+  std::vector<Game *> leaders;
+  std::vector<ProcessStatus> *statuses = nullptr;
+
+  // Used for PLAYOUT jobs: games[i] is played out (see playout) with an RNG
+  // seeded by playout_seed and orders_idxs[i], its index in the batch. The
+  // phases processed are added to n_phases.
+  PlayoutPolicy playout_policy = PlayoutPolicy::RANDOM;
+  int max_move_phases = 0;
+  uint64_t playout_seed = 0;
+  int64_t n_phases = 0;
+
+  // Used for REPLAY jobs: (*replay_results)[i] is set to the replay of game
+  // json (*game_jsons)[i] for each i in orders_idxs
+  const std::vector<std::string> *game_jsons = nullptr;
+  std::vector<ReplayResult> *replay_results = nullptr;
+
+  // Used for SOS_TARGETS jobs: the write_sos_targets of games[i] are written
+  // to sos_targets from row orders_idxs[i] on
+  float *sos_targets = nullptr;
+  float value_decay_alpha = 1.0;
+
+  // Used for CAT_PAD jobs: input i of each field is copied for each i in
+  // orders_idxs
+  const std::vector<CatPadField> *cat_pad_fields = nullptr;
+
+  // Used for CORPUS_HASHES jobs: the get_position_hashes of corpus game
+  // (*corpus_game_idxs)[i] are written to position_hashes from row
+  // (*first_rows)[i] on, for each i in orders_idxs
+  const std::vector<size_t> *corpus_game_idxs = nullptr;
+  const std::vector<size_t> *first_rows = nullptr;
+  uint64_t *position_hashes = nullptr;
+
+  // Used for ROLLOUT_CACHE jobs: games[i] is looked up in rollout_cache by
+  // its staged orders, and its key, hit and, on a hit, values are written to
+  // row orders_idxs[i] of rollout_keys, rollout_hits and rollout_values
+  RolloutCache *rollout_cache = nullptr;
+  int64_t *rollout_keys = nullptr;
+  bool *rollout_hits = nullptr;
+  float *rollout_values = nullptr;
+
   ThreadPoolJob() {}
   ThreadPoolJob(ThreadPoolJobType type) : job_type(type) {}
 };
 
+// Jobs submitted by a single ThreadPool call. Several batches may be in
+// flight at once; their jobs are claimed in submission order.
+struct ThreadPoolBatch {
+  std::vector<ThreadPoolJob> jobs;
+  // Index in jobs of the next unclaimed job of each worker group: jobs[k]
+  // belongs to group k % next_job.size() (see ThreadPool's pin_threads)
+  std::vector<size_t> next_job;
+  size_t unclaimed_jobs = 0;
+  // Counted down without the pool's mutex as jobs finish. finished is set
+  // once all are, after the games are released.
+  std::atomic<size_t> unfinished_jobs{0};
+  std::atomic<bool> finished{false};
+  ThreadPoolPriority priority = ThreadPoolPriority::INTERACTIVE;
+  TensorDict fields; // output of ENCODE* batches
+  // Per game, if fields are a prev state delta encoding. Written to fields
+  // once the jobs are done.
+  std::vector<PrevStateDelta> prev_state_deltas;
+  // Per game, if fields are to be trimmed to the batch's longest sequence
+  // (see ThreadPool::set_trim_seq_len). Applied once the jobs are done.
+  std::vector<int> seq_lens;
+
+  // Set on submission if perf stats are enabled, for THREAD_POOL_QUEUE
+  std::chrono::steady_clock::time_point submit_time;
+
+  // Hold the games until all jobs are finished (see Game::get_batch_holds),
+  // exclusively for batches that step them. Fails if another batch holds one
+  // of them incompatibly.
+  void hold_games(std::vector<Game *> &games, bool exclusive);
+  void release_games();
+  ~ThreadPoolBatch() { release_games(); }
+
+  std::vector<Game *> held_games;
+  bool holds_exclusive = false;
+};
+
+class ThreadPool;
+
+// Handle to a submitted batch. The games passed to the submitting call must
+// stay alive, and must not be used by other batches, until wait() returns.
+class ThreadPoolFuture {
+public:
+  ThreadPoolFuture(ThreadPool *pool, std::shared_ptr<ThreadPoolBatch> batch)
+      : pool_(pool), batch_(batch) {}
+
+  // Block until all of the batch's jobs are done, helping with unclaimed
+  // ones meanwhile. Returns the encoded inputs for encoding batches, else an
+  // empty dict.
+  TensorDict wait();
+
+  // True if wait() would not block
+  bool done() const;
+
+private:
+  ThreadPool *pool_;
+  std::shared_ptr<ThreadPoolBatch> batch_;
+};
+
 class ThreadPool {
 public:
+  // If pin_threads is true, worker threads are pinned to CPUs and split into
+  // one group per NUMA node. The jobs of a batch are dealt round-robin to the
+  // groups, so that a game at the same index of same-sized batches (e.g. of a
+  // GameBatch) is always stepped on the same node, and games made in the
+  // workers (clone_multi, process_many) are first touched there. Workers
+  // only claim other groups' jobs when their own are exhausted, and the
+  // calling thread, which is not pinned, does not help with jobs.
   ThreadPool(size_t n_threads,
              std::unordered_map<std::string, int> order_vocabulary_to_idx,
-             int max_order_cands);
+             int max_order_cands, bool pin_threads = false);
+  // Use an encoder shared with other pools, e.g. one loaded with
+  // OrdersEncoder::from_bytes, instead of building one
+  ThreadPool(size_t n_threads,
+             std::shared_ptr<const OrdersEncoder> orders_encoder,
+             bool pin_threads = false);
   ~ThreadPool();
 
-  const OrdersEncoder &get_orders_encoder() const { return orders_encoder_; }
+  const OrdersEncoder &get_orders_encoder() const { return *orders_encoder_; }
+
+  // Call game.process() on each of the games. If share_identical, games with
+  // equal states and staged orders, e.g. rollouts of the same orders from one
+  // game, are adjudicated once and share the new state (see
+  // Game::process_like). Blocks until all process() functions have exited.
+  void process_multi(std::vector<Game *> &games, bool share_identical = true);
 
-  // Call game.process() on each of the games. Blocks until all process()
-  // functions have exited.
-  void process_multi(std::vector<Game *> &games);
+  // Same as process_multi, but processes each game with Game::try_process,
+  // so that the other games are processed if one fails, and returns their
+  // statuses
+  std::vector<ProcessStatus>
+  try_process_multi(std::vector<Game *> &games, bool share_identical = true);
+
+  // Apply each of the order sets to a copy of game and process it, returning
+  // the N successor games. The root state's possible orders are computed once
+  // and shared by all copies. Blocks until all successors are ready.
+  std::vector<Game> process_many(Game &game,
+                                 const std::vector<PowerOrderStrs> &orders);
+
+  // Return n copies of game, made in the worker threads. The copies share
+  // game's history and current state, with its possible orders loaded.
+  std::vector<Game> clone_multi(Game &game, size_t n);
+
+  // Play each game out in place with a native policy, without a model (see
+  // playout). Each game is played out by one worker, with an RNG seeded by
+  // seed and its index in games, so that results do not depend on the number
+  // of threads. Returns the number of phases processed, summed over games.
+  int64_t playout_multi(std::vector<Game *> &games, PlayoutPolicy policy,
+                        int max_move_phases, uint64_t seed);
+
+  // Load each game json and re-adjudicate its history (see replay_game_json)
+  // in the worker threads
+  std::vector<ReplayResult>
+  replay_games(const std::vector<std::string> &game_jsons);
 
   // Fill a list of pre-allocated DataFields objects with the games' input
   // encodings
   TensorDict encode_inputs_multi(std::vector<Game *> &games);
 
+  // Like encode_inputs_multi, but encode the candidates of the given powers
+  // only, e.g. for the one power of a best response: x_possible_actions is
+  // [B, k, 17, 469] and x_loc_idxs [B, k, 81] for k powers, whose rows are
+  // those of encode_inputs_multi. Bypasses the encoding cache.
+  TensorDict encode_inputs_powers_multi(std::vector<Game *> &games,
+                                        const std::vector<Power> &powers);
+
   // Fill a list of pre-allocated DataFields objects with the games' input
   // encodings
   TensorDict encode_inputs_state_only_multi(std::vector<Game *> &games);
@@ -74,13 +332,222 @@ public:
   // encodings
   TensorDict encode_inputs_all_powers_multi(std::vector<Game *> &games);
 
+  // Like encode_inputs_multi and encode_inputs_all_powers_multi, but return
+  // x_possible_actions in CSR form instead of as a dense EOS-padded tensor:
+  // the candidates of row r (a flattened (game, power, step) index into the
+  // dense tensor) are x_possible_actions_values[offsets[r]:offsets[r + 1]],
+  // where offsets is x_possible_actions_offsets, with B * 7 * max_seq_len + 1
+  // elements.
+  TensorDict encode_inputs_multi_sparse(std::vector<Game *> &games);
+  TensorDict encode_inputs_all_powers_multi_sparse(std::vector<Game *> &games);
+
+  // Return game's encode_inputs_multi encoding repeated n times, for callers
+  // that sample the same state many times. The game is encoded once and each
+  // tensor is a stride-0 expanded view of its single row, so the result is
+  // read-only and must not be passed to release_encoded_inputs.
+  TensorDict encode_inputs_repeated(Game &game, size_t n);
+
+  // Set each game's orders from its row of order_idxs, a [B, 7, S] tensor of
+  // EOS_IDX-padded order vocabulary idxs as sampled by the model. Same as
+  // set_orders with the decode_order_idxs strings, without making strings.
+  // Powers whose row is all EOS_IDX are left unchanged.
+  void set_orders_from_idxs(std::vector<Game *> &games,
+                            torch::Tensor order_idxs);
+
+  // For each game: set the orders in its row of order_idxs, a [B, 7, S]
+  // tensor of EOS_IDX-padded order vocabulary idxs as sampled by the model
+  // (see decode_order_idxs), process it, and encode the new state as in
+  // encode_inputs_multi, all in one pass of the worker threads. Games that
+  // are done are only encoded. order_idxs may be on the model's device, see
+  // order_idxs_to_cpu.
+  TensorDict step_and_encode_multi(std::vector<Game *> &games,
+                                   torch::Tensor order_idxs);
+
+  // Return a [B, 3, 7] float tensor of, for each game, its square scores
+  // (as in get_square_scores), its SC counts, and a 0/1 mask of the powers
+  // that are alive (as in get_alive_power_ids). Computed in the calling
+  // thread: this is a few dozen adds per game.
+  torch::Tensor get_scores_multi(std::vector<Game *> &games);
+
+  // Return the [rows, 7] float value targets of all phases of the games, as
+  // encode_dataset_games' y_final_scores (see Game::write_sos_targets). Rows
+  // are the games' get_phase_history phases, in order. Computed in the
+  // worker threads.
+  torch::Tensor get_sos_targets_multi(std::vector<Game *> &games,
+                                      float value_decay_alpha);
+
+  // Look up the rollout results of the games, from the orders staged on them
+  // (see RolloutCache::make_key), before they are rolled out:
+  //   keys: [B, 2] int64, the RolloutCache keys (as int64 bits), to put the
+  //     results of the misses with once they are rolled out
+  //   hits: [B] bool, if the game's results were found
+  //   values: [B, 7] float, the results found, zeros on a miss
+  // Board and orders are hashed in the worker threads.
+  TensorDict lookup_rollout_cache(RolloutCache &cache,
+                                  std::vector<Game *> &games);
+
+  // Concatenate the fields of xs, e.g. the encode_inputs_* results of several
+  // batches, along dim 0 as torch.cat does, into tensors allocated once
+  // (pinned if set_pin_memory). Fields in pad_values may differ in their
+  // other dims, and are padded to the largest with their pad value, e.g. -1
+  // for x_possible_actions of all-powers and per-power encodings; the others
+  // must match. Prev state delta and sparse encodings are not supported.
+  // Inputs are copied in the worker threads.
+  TensorDict
+  cat_pad_inputs(const std::vector<TensorDict> &xs,
+                 const std::unordered_map<std::string, double> &pad_values);
+
+  // Decode the given corpus phases (see GameCorpus::get_phase) and return
+  // their encode_inputs_multi (or encode_inputs_all_powers_multi) encodings.
+  // Games are decoded in the worker threads.
+  TensorDict encode_corpus_phases(const GameCorpus &corpus,
+                                  const std::vector<size_t> &phase_idxs,
+                                  bool all_powers = false);
+
+  // Encode all phases of the given corpus games for training, as dataset.py's
+  // encode_game does with the games' recorded orders: the
+  // encode_inputs_multi_sparse inputs of each phase (rows are the games'
+  // phases, in order), and
+  //   y_actions: [rows, 7, 1, 17] int32 candidate positions of the orders
+  //   y_final_scores: [rows, 7] square scores, exponentially weighted over
+  //     the later end-of-year phases by value_decay_alpha
+  //   valid_power_idxs: [rows, 7] bool, false for powers with no encodable
+  //     orders, with exclude_n_holds or more orders which are all holds (if
+  //     exclude_n_holds >= 0), or, if only_with_min_final_score >= 0 and some
+  //     power ends the game with that many centers, with fewer centers
+  // Games are decoded and their targets computed in the worker threads.
+  TensorDict encode_dataset_games(const GameCorpus &corpus,
+                                  const std::vector<size_t> &game_idxs,
+                                  float value_decay_alpha = 1.0,
+                                  int only_with_min_final_score = -1,
+                                  int exclude_n_holds = -1);
+
+  // Index the phases of the given corpus games (rows as in
+  // encode_dataset_games) by position (see get_position_hashes), e.g. to skip
+  // or reweight the duplicate positions of a training corpus:
+  //   hashes: [rows] int64, the stable position hashes (as int64 bits)
+  //   first_rows: [rows] int64, the first row of the same position
+  //   counts: [rows] int64, the number of rows of the same position
+  // Games are decoded and hashed in the worker threads.
+  TensorDict dedup_corpus(const GameCorpus &corpus,
+                          const std::vector<size_t> &game_idxs);
+
+  // Return the tensors of an encode_inputs_* result to be reused by later
+  // calls. The caller must not use them afterwards.
+  void release_encoded_inputs(TensorDict fields) {
+    data_fields_pool_.release(std::move(fields));
+  }
+
+  // Allocate encode_inputs_* tensors in pinned memory
+  void set_pin_memory(bool pin_memory) {
+    data_fields_pool_.set_pin_memory(pin_memory);
+  }
+
+  // Format of the x_board_state and x_prev_state fields of later
+  // encode_inputs_* calls (see BoardStateFormat). FLOAT32 by default.
+  void set_board_state_format(BoardStateFormat format) {
+    data_fields_pool_.set_board_state_format(format);
+  }
+  BoardStateFormat get_board_state_format() const {
+    return data_fields_pool_.get_board_state_format();
+  }
+
+  // Replace x_prev_state in the fields of later encode_inputs_* calls by the
+  // rows where it differs from x_board_state (see expand_prev_state_delta),
+  // which are usually a handful. False by default.
+  void set_prev_state_delta(bool prev_state_delta) {
+    data_fields_pool_.set_prev_state_delta(prev_state_delta);
+  }
+  bool get_prev_state_delta() const {
+    return data_fields_pool_.get_prev_state_delta();
+  }
+
+  // Trim x_possible_actions and x_power of later dense encode_inputs_multi,
+  // encode_inputs_all_powers_multi and step_and_encode_multi calls from 17
+  // (or N_SCS) steps to the longest sequence of orderable locations in the
+  // batch, at least 1: e.g. [B, 7, 4, 469] in the opening, where Russia has
+  // the most units. The model then decodes fewer steps. False by default,
+  // since callers that concatenate batches expect a fixed length.
+  void set_trim_seq_len(bool trim_seq_len) { trim_seq_len_ = trim_seq_len; }
+  bool get_trim_seq_len() const { return trim_seq_len_; }
+
+  // Low-latency mode, for interactive callers that submit many small
+  // batches, e.g. encode_inputs_multi of a few games, where waking threads
+  // costs as much as the work. Batches of at most inline_max_games games (or
+  // other items) are done on the calling thread when submitted, except by
+  // pinned pools. Idle workers, and callers waiting for a batch, poll for up
+  // to spin_us microseconds before sleeping, at the cost of CPU time. Both 0,
+  // i.e. off, by default.
+  void set_inline_max_games(size_t inline_max_games) {
+    inline_max_games_ = inline_max_games;
+  }
+  size_t get_inline_max_games() const { return inline_max_games_; }
+  void set_spin_us(int spin_us) { spin_us_ = spin_us; }
+  int get_spin_us() const { return spin_us_; }
+
+  // Change the number of active workers. Surplus workers are parked: they
+  // finish their job, then sleep until the pool grows again. Threads are
+  // started as needed and kept until the pool is destroyed, so resizing is
+  // cheap. Pinned pools keep at least one worker. Thread-safe.
+  void resize(size_t n_threads);
+  size_t get_n_threads() const { return n_active_; }
+
+  // Adaptive sizing, for processes that share a host's cores, e.g. rollouts
+  // and inference: every interval_ms, a controller thread resizes the pool
+  // within [min_threads, max_threads] from the last intervals' queue depth
+  // and worker idle time. It grows the pool while jobs are queued and the
+  // workers are never idle, and shrinks it while they are idle half of the
+  // time, or get much less CPU time than they run for, i.e. the host's cores
+  // are oversubscribed. max_threads 0 (the default) stops the controller and
+  // keeps the pool at its current size.
+  void set_adaptive_sizing(size_t min_threads, size_t max_threads,
+                           int interval_ms = 100);
+
+  // Memoize the encode_inputs_multi rows of up to capacity distinct states
+  // (and previous movement phases), for callers like search that encode the
+  // same states many times. 0, the default, disables the cache. Must not be
+  // called while batches are in flight.
+  void set_encoding_cache_capacity(size_t capacity);
+  uint64_t get_encoding_cache_hits() const {
+    return encoding_cache_ ? encoding_cache_->get_hits() : 0;
+  }
+  uint64_t get_encoding_cache_misses() const {
+    return encoding_cache_ ? encoding_cache_->get_misses() : 0;
+  }
+  // Save the encoding cache's entries, e.g. after encoding the opening
+  // phases of many games, and load such a file as an opening book of entries
+  // that are never evicted (see EncodingCache). The cache must be enabled.
+  // The file can only be loaded by a pool with the same orders vocabulary.
+  void save_encoding_cache(const std::string &path) const;
+  size_t load_encoding_book(const std::string &path);
+
+  // Approximate bytes used by games, counting what copies share once (see
+  // Game::memory_usage), plus "encoding_cache" for this pool's cache
+  MemoryUsage get_memory_usage(const std::vector<Game *> &games) const;
+
+  // Non-blocking versions of the above. Return as soon as the jobs are
+  // queued; call wait() on the result to block until they are done.
+  ThreadPoolFuture process_multi_async(std::vector<Game *> &games,
+                                       bool share_identical = true);
+  ThreadPoolFuture encode_inputs_multi_async(std::vector<Game *> &games);
+  ThreadPoolFuture
+  encode_inputs_state_only_multi_async(std::vector<Game *> &games);
+  ThreadPoolFuture
+  encode_inputs_all_powers_multi_async(std::vector<Game *> &games);
+
 private:
   /////////////
   // Methods //
   /////////////
 
-  // Worker thread entrypoint function
-  void thread_fn();
+  // Worker thread entrypoint function. Pins the thread to cpu if cpu >= 0.
+  // Parked while worker >= n_active_.
+  void thread_fn(size_t worker, size_t group, int cpu);
+  // Start worker threads_.size(). Must hold resize_mutex_.
+  void start_thread();
+  // Adaptive sizing controller thread entrypoint, and its policy
+  void controller_fn(size_t min_threads, size_t max_threads, int interval_ms);
+  void stop_controller();
 
   // Top-level job handler
   void thread_fn_do_job_unsafe(ThreadPoolJob &);
@@ -90,27 +557,133 @@ private:
   void do_job_encode(ThreadPoolJob &);
   void do_job_encode_state_only(ThreadPoolJob &);
   void do_job_encode_all_powers(ThreadPoolJob &);
+  void do_job_process_many(ThreadPoolJob &);
+  void do_job_load_corpus(ThreadPoolJob &);
+  void do_job_step_and_encode(ThreadPoolJob &);
+  void do_job_clone(ThreadPoolJob &);
+  void do_job_dataset_targets(ThreadPoolJob &);
+  void do_job_corpus_hashes(ThreadPoolJob &);
+  void do_job_playout(ThreadPoolJob &);
+  void do_job_replay(ThreadPoolJob &);
+  void do_job_sos_targets(ThreadPoolJob &);
+  void do_job_cat_pad(ThreadPoolJob &);
+  void do_job_rollout_cache(ThreadPoolJob &);
 
   // Job handler boilerplate
-  void boilerplate_job_prep(ThreadPoolJobType, std::vector<Game *> &);
-  void boilerplate_job_handle(std::unique_lock<std::mutex> &);
+  size_t get_n_jobs(size_t n_items) const;
+  std::shared_ptr<ThreadPoolBatch>
+  boilerplate_job_prep(ThreadPoolJobType, std::vector<Game *> &);
+  void pack_step_jobs(ThreadPoolBatch &batch, const std::vector<Game *> &games);
+  ThreadPoolFuture submit(std::shared_ptr<ThreadPoolBatch>);
+  void wait(ThreadPoolBatch &);
+  bool is_done(ThreadPoolBatch &);
 
-  // Helpers
+  // Lock mutex_, tracing the wait if it is contended
+  std::unique_lock<std::mutex> lock_mutex();
+
+  // Claim the next job of batch, preferably one of group, or return nullptr
+  // if all are claimed. Must hold mutex_.
+  ThreadPoolJob *claim_job(ThreadPoolBatch &batch, size_t group);
+
+  // The batch whose job a worker claims next, by priority, or nullptr if no
+  // jobs are queued. Must hold mutex_.
+  std::shared_ptr<ThreadPoolBatch> next_batch();
+  bool has_queued_batches() const;
+  // Count one of batch's jobs as finished: the last releases the games and
+  // wakes waiters. Must not hold mutex_.
+  void finish_job(ThreadPoolBatch &batch);
+
+  // Helpers. The encode_* kernels are specialized for the PhaseType of the
+  // game's state (see visit_phase_type); encode jobs group their games by it.
+  template <char PhaseType>
   void encode_state_for_game(Game *, EncodingArrayPointers &);
+  template <char PhaseType> void encode_game(Game *, EncodingArrayPointers &);
+  template <char PhaseType>
+  void encode_game_uncached(Game *, EncodingArrayPointers &);
+  template <char PhaseType>
+  void encode_game_powers(Game *, const std::vector<Power> &powers,
+                          EncodingArrayPointers &);
+  std::shared_ptr<const PrevPhaseEncoding> get_prev_phase_encoding(Game *);
+  void write_prev_phase_encoding(const PrevPhaseEncoding *,
+                                 EncodingArrayPointers &) const;
+  std::shared_ptr<const EncodedState>
+  make_encoded_state(EncodingArrayPointers &) const;
+  void write_encoded_state(const EncodedState &,
+                           EncodingArrayPointers &) const;
+  uint64_t get_encoding_fingerprint() const;
+  void set_encoding_array_pointers(ThreadPoolBatch &batch, size_t n_games);
+  void maybe_reset_possible_actions(TensorDict &fields) const;
+  int32_t *get_possible_actions_ptr(EncodingArrayPointers &,
+                                    size_t max_seq_len) const;
+  void maybe_compress_possible_actions(EncodingArrayPointers &,
+                                       size_t max_seq_len) const;
+  // Concatenate batch.prev_state_deltas into its fields, once its jobs are
+  // done
+  void write_prev_state_deltas(ThreadPoolBatch &batch) const;
+  // Trim batch's fields to batch.seq_lens, once its jobs are done
+  void trim_seq_lens(ThreadPoolBatch &batch) const;
+  void set_seq_len(Game *game, EncodingArrayPointers &pointers,
+                   bool all_powers) const;
+  void compress_possible_actions(const int32_t *x_possible_actions,
+                                 size_t max_seq_len,
+                                 SparsePossibleActions *) const;
+  TensorDict encode_inputs_sparse(std::vector<Game *> &games, bool all_powers);
+  std::vector<std::optional<Game>>
+  load_corpus_phases(const GameCorpus &corpus,
+                     const std::vector<size_t> &phase_idxs);
+  void write_dataset_targets(Game &game, const DatasetTargetsArgs &args,
+                             size_t row) const;
 
   //////////
   // Data //
   //////////
 
-  std::vector<ThreadPoolJob> jobs_;
+  // Jobs are split finer than one per thread so that threads which finish
+  // early claim remaining jobs instead of idling behind a straggler
+  static const size_t JOBS_PER_THREAD = 8;
+
+  // While both INTERACTIVE and BULK jobs are queued, one claim in
+  // BULK_CLAIM_INTERVAL goes to a BULK batch, so that bulk work is slowed
+  // down but never starved by a stream of interactive batches
+  static const size_t BULK_CLAIM_INTERVAL = 8;
+
+  // Batches with unclaimed jobs, oldest first, per ThreadPoolPriority. A
+  // batch is referenced by its future until all its jobs are finished.
+  std::deque<std::shared_ptr<ThreadPoolBatch>> batches_[2];
+  size_t interactive_streak_ = 0; // claims since the last BULK one
+  // Unclaimed jobs of all batches, polled by spinning workers without mutex_
+  std::atomic<size_t> n_unclaimed_jobs_{0};
   std::mutex mutex_;
   std::condition_variable cv_in_;
   std::condition_variable cv_out_;
-  size_t unfinished_jobs_;
+  std::condition_variable cv_parked_; // parked workers wait here
   bool time_to_die_ = false;
 
+  friend class ThreadPoolFuture;
+
+  // All workers ever started. Workers >= n_active_ are parked.
   std::vector<std::thread> threads_;
-  const OrdersEncoder orders_encoder_;
+  std::atomic<size_t> n_active_{0};
+  std::mutex resize_mutex_;
+  size_t n_groups_ = 1; // worker groups, one per NUMA node if pinned_
+  bool pinned_ = false;
+  std::vector<std::vector<int>> node_cpus_; // if pinned_
+
+  // Time the workers spent running jobs, in wall-clock and thread CPU time,
+  // sampled by the adaptive sizing controller
+  std::atomic<uint64_t> busy_ns_{0};
+  std::atomic<uint64_t> busy_cpu_ns_{0};
+  std::thread controller_;
+  std::mutex controller_mutex_;
+  std::condition_variable controller_cv_;
+  bool stop_controller_ = false;
+
+  const std::shared_ptr<const OrdersEncoder> orders_encoder_;
+  DataFieldsPool data_fields_pool_;
+  std::unique_ptr<EncodingCache> encoding_cache_;
+  bool trim_seq_len_ = false;
+  std::atomic<size_t> inline_max_games_{0};
+  std::atomic<int> spin_us_{0};
 };
 
 } // namespace dipcc
@@ -0,0 +1,80 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "torchscript_model.h"
+#include "checks.h"
+#include "order_sampling.h"
+
+using namespace std;
+
+namespace dipcc {
+
+TorchScriptModel::TorchScriptModel(const string &path, const string &device)
+    : TorchScriptModel(torch::jit::load(path, torch::Device(device)), device) {
+}
+
+TorchScriptModel::TorchScriptModel(torch::jit::script::Module module,
+                                   const string &device)
+    : module_(std::move(module)), device_(device) {
+  module_.to(device_);
+  module_.eval();
+}
+
+ModelOutput TorchScriptModel::forward(const TensorDict &x, float temperature,
+                                      float top_p, bool values_only) {
+  JCHECK(x.count("x_board_state"), "TorchScriptModel: missing x_board_state");
+  long B = x.at("x_board_state").size(0);
+
+  torch::NoGradGuard no_grad;
+  TensorDict x_device;
+  for (auto &it : x) {
+    x_device[it.first] = it.second.to(device_, /*non_blocking=*/true);
+  }
+  // Board states may be sent as a prev state delta, and in a compact
+  // BoardStateFormat: expand them on the device
+  expand_prev_state_delta(x_device);
+  torch::jit::Kwargs kwargs;
+  for (auto &it : x_device) {
+    bool board = it.first == "x_board_state" || it.first == "x_prev_state";
+    kwargs[it.first] = board ? unpack_board_state(it.second) : it.second;
+  }
+  kwargs["temperature"] =
+      torch::full({B, 1}, temperature, torch::TensorOptions(device_));
+  kwargs["top_p"] = torch::full({B, 1}, top_p, torch::TensorOptions(device_));
+  kwargs["values_only"] = values_only;
+
+  torch::jit::IValue y;
+  {
+    lock_guard<mutex> lock(mutex_);
+    y = module_.get_method("forward")({}, kwargs);
+  }
+
+  ModelOutput r;
+  if (y.isTensor()) {
+    r.values = y.toTensor().to(torch::kCPU);
+    return r;
+  }
+  auto elements = y.toTuple()->elements();
+  JCHECK(elements.size() >= 4,
+         "TorchScriptModel: forward must return (order_idxs, _, _, values)");
+  if (!values_only) {
+    r.order_idxs = order_idxs_to_cpu(elements[0].toTensor());
+    if (x.count("x_in_adj_phase") && x.count("x_possible_actions") &&
+        elements[2].isTensor()) {
+      lock_guard<mutex> lock(mutex_);
+      resample_duplicate_disbands(r.order_idxs, elements[2].toTensor(),
+                                  x.at("x_possible_actions"),
+                                  x.at("x_in_adj_phase"), rng_);
+    }
+  }
+  if (elements[3].isTensor()) {
+    r.values = elements[3].toTensor().to(torch::kCPU);
+  }
+  return r;
+}
+
+} // namespace dipcc
@@ -0,0 +1,53 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <random>
+#include <string>
+#include <torch/script.h>
+#include <torch/torch.h>
+
+#include "data_fields.h"
+
+namespace dipcc {
+
+// Outputs of one model call, on the CPU. order_idxs is empty for values_only
+// calls.
+struct ModelOutput {
+  torch::Tensor order_idxs; // [B, 7, S] long order vocabulary idxs
+  torch::Tensor values;     // [B, 7] float estimated final scores
+};
+
+// A TorchScript policy/value model with the interface of DiplomacyModel:
+// forward takes the encode_inputs_multi fields, temperature and top_p ([B, 1]
+// each) and values_only as keyword args, and returns a tuple whose elements
+// 0 and 3 are the sampled order idxs and the values, or only the values if
+// values_only.
+//
+// Element 2 must be the logits: as in the Python agents'
+// model_output_transform, duplicate disbands are resampled from them (see
+// resample_duplicate_disbands).
+class TorchScriptModel {
+public:
+  TorchScriptModel(const std::string &path, const std::string &device);
+  TorchScriptModel(torch::jit::script::Module module,
+                   const std::string &device);
+
+  // Thread-safe; calls are serialized
+  ModelOutput forward(const TensorDict &x, float temperature, float top_p,
+                      bool values_only = false);
+
+private:
+  torch::jit::script::Module module_;
+  torch::Device device_;
+  std::mutex mutex_;
+  std::mt19937 rng_{std::random_device()()}; // guarded by mutex_
+};
+
+} // namespace dipcc
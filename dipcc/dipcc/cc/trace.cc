@@ -0,0 +1,167 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+#include "checks.h"
+#include "thirdparty/nlohmann/json.hpp"
+#include "trace.h"
+
+using namespace std;
+using nlohmann::json;
+
+namespace dipcc {
+
+namespace detail {
+std::atomic<bool> tracing_enabled{false};
+} // namespace detail
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  const char *category;
+  double start_us;
+  double end_us;
+  vector<pair<const char *, string>> args;
+};
+
+// Events of one thread. The mutex is only contended while dumping.
+struct ThreadTrace {
+  mutex mu;
+  int tid;
+  string name;
+  vector<TraceEvent> events;
+};
+
+// Traces of the live threads and of exited ones. Leaked, so that it outlives
+// threads exiting during static destruction.
+struct Registry {
+  mutex mu;
+  int next_tid = 1;
+  unordered_set<shared_ptr<ThreadTrace>> threads;
+  vector<shared_ptr<ThreadTrace>> exited;
+};
+
+Registry &registry() {
+  static Registry *r = new Registry();
+  return *r;
+}
+
+struct ThreadTraceHandle {
+  shared_ptr<ThreadTrace> trace = make_shared<ThreadTrace>();
+
+  ThreadTraceHandle() {
+    Registry &r = registry();
+    lock_guard<mutex> lock(r.mu);
+    trace->tid = r.next_tid++;
+    r.threads.insert(trace);
+  }
+
+  ~ThreadTraceHandle() {
+    Registry &r = registry();
+    lock_guard<mutex> lock(r.mu);
+    r.threads.erase(trace);
+    if (!trace->events.empty()) {
+      r.exited.push_back(trace);
+    }
+  }
+};
+
+ThreadTrace &thread_trace() {
+  thread_local ThreadTraceHandle handle;
+  return *handle.trace;
+}
+
+const chrono::steady_clock::time_point EPOCH = chrono::steady_clock::now();
+
+void append_events(const ThreadTrace &trace, json &r) {
+  if (!trace.name.empty()) {
+    r.push_back({{"name", "thread_name"},
+                 {"ph", "M"},
+                 {"pid", 0},
+                 {"tid", trace.tid},
+                 {"args", {{"name", trace.name}}}});
+  }
+  for (const TraceEvent &e : trace.events) {
+    json args = json::object();
+    for (auto & [ key, value ] : e.args) {
+      args[key] = value;
+    }
+    r.push_back({{"name", e.name},
+                 {"cat", e.category},
+                 {"ph", "X"},
+                 {"ts", e.start_us},
+                 {"dur", e.end_us - e.start_us},
+                 {"pid", 0},
+                 {"tid", trace.tid},
+                 {"args", args}});
+  }
+}
+
+} // namespace
+
+void set_tracing_enabled(bool enabled) {
+  detail::tracing_enabled.store(enabled, memory_order_relaxed);
+}
+
+double trace_now_us() {
+  return chrono::duration<double, micro>(chrono::steady_clock::now() - EPOCH)
+      .count();
+}
+
+void add_trace_event(const char *name, const char *category, double start_us,
+                     double end_us,
+                     vector<pair<const char *, string>> args) {
+  ThreadTrace &trace = thread_trace();
+  lock_guard<mutex> lock(trace.mu);
+  if (trace.events.size() < MAX_TRACE_EVENTS_PER_THREAD) {
+    trace.events.push_back({name, category, start_us, end_us, move(args)});
+  }
+}
+
+void set_trace_thread_name(const string &name) {
+  ThreadTrace &trace = thread_trace();
+  lock_guard<mutex> lock(trace.mu);
+  trace.name = name;
+}
+
+string get_trace_json() {
+  json events = json::array();
+  Registry &r = registry();
+  lock_guard<mutex> lock(r.mu);
+  for (auto &trace : r.exited) {
+    append_events(*trace, events);
+  }
+  for (auto &trace : r.threads) {
+    lock_guard<mutex> trace_lock(trace->mu);
+    append_events(*trace, events);
+  }
+  return json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump();
+}
+
+void dump_trace(const string &path) {
+  ofstream f(path);
+  JCHECK(f.good(), "Could not open trace file " + path);
+  f << get_trace_json();
+}
+
+void clear_trace() {
+  Registry &r = registry();
+  lock_guard<mutex> lock(r.mu);
+  r.exited.clear();
+  for (auto &trace : r.threads) {
+    lock_guard<mutex> trace_lock(trace->mu);
+    trace->events.clear();
+  }
+}
+
+} // namespace dipcc
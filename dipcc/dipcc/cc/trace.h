@@ -0,0 +1,84 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Optional event tracing, dumped in the Chrome trace format (viewable in
+// chrome://tracing or Perfetto). Disabled by default, when recording an event
+// costs one relaxed atomic load.
+
+namespace dipcc {
+
+void set_tracing_enabled(bool enabled);
+
+namespace detail {
+extern std::atomic<bool> tracing_enabled;
+} // namespace detail
+
+inline bool get_tracing_enabled() {
+  return detail::tracing_enabled.load(std::memory_order_relaxed);
+}
+
+// Microseconds since an arbitrary process-wide epoch
+double trace_now_us();
+
+// Record a complete event of the calling thread, with optional string args.
+// Each thread keeps at most MAX_TRACE_EVENTS_PER_THREAD events; later ones
+// are dropped.
+void add_trace_event(
+    const char *name, const char *category, double start_us, double end_us,
+    std::vector<std::pair<const char *, std::string>> args = {});
+
+static const size_t MAX_TRACE_EVENTS_PER_THREAD = 1 << 20;
+
+// Name the calling thread in the trace
+void set_trace_thread_name(const std::string &name);
+
+// Return the events of all threads, including exited ones, as a Chrome trace
+// JSON string
+std::string get_trace_json();
+void dump_trace(const std::string &path);
+void clear_trace();
+
+// Record the enclosing scope as an event, if tracing is enabled when it
+// starts
+class TraceScope {
+public:
+  TraceScope(const char *name, const char *category)
+      : name_(name), category_(category), enabled_(get_tracing_enabled()) {
+    if (enabled_) {
+      start_us_ = trace_now_us();
+    }
+  }
+
+  ~TraceScope() {
+    if (enabled_) {
+      add_trace_event(name_, category_, start_us_, trace_now_us(),
+                      std::move(args_));
+    }
+  }
+
+  bool enabled() const { return enabled_; }
+  void add_arg(const char *key, std::string value) {
+    args_.emplace_back(key, std::move(value));
+  }
+
+private:
+  const char *name_;
+  const char *category_;
+  bool enabled_;
+  double start_us_ = 0;
+  std::vector<std::pair<const char *, std::string>> args_;
+};
+
+} // namespace dipcc
@@ -21,13 +21,6 @@ LICENSE file in the root directory of this source tree.
 
 namespace dipcc {
 
-bool is_implicit_via(const Order &order,
-                     const std::set<Order> &loc_possible_orders);
-
-bool is_implicit_via(
-    const Order &order,
-    const std::unordered_map<Loc, std::set<Order>> &all_possible_orders);
-
 template <typename T> bool set_contains(const std::set<T> &c, const T &x) {
   return c.find(x) != c.end();
 }
@@ -0,0 +1,122 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "loc.h"
+#include "loc_map.h"
+#include "order.h"
+#include "owned_unit.h"
+#include "phase.h"
+#include "power.h"
+
+// Zobrist keys for GameState::compute_board_hash. A board hash is the XOR of
+// the keys of every unit, center, dislodged unit and contested loc on the
+// board, so GameState keeps it up to date with one XOR per change.
+//
+// Keys are generated at compile time from a fixed seed, so hashes are stable
+// across processes, builds and platforms: key i is splitmix64(i), with i
+// indexing table-major [table][loc][power][unit type] over the enum values
+// of Loc, Power and UnitType, and the phase key is splitmix64 of the phase
+// (see phase() below). Nothing depends on std::hash or on iteration order.
+
+namespace dipcc {
+namespace zobrist {
+
+static constexpr size_t N_POWER_SLOTS = 8; // including Power::NONE
+static constexpr size_t N_TYPE_SLOTS = 3;  // including UnitType::NONE
+
+enum Table {
+  UNIT,
+  CENTER,
+  DISLODGED,
+  CONTESTED,
+  N_TABLES,
+};
+
+static constexpr size_t TABLE_SIZE =
+    N_LOC_SLOTS * N_POWER_SLOTS * N_TYPE_SLOTS;
+
+namespace detail {
+
+constexpr uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+constexpr std::array<uint64_t, N_TABLES * TABLE_SIZE> make_keys() {
+  std::array<uint64_t, N_TABLES * TABLE_SIZE> r{};
+  for (size_t i = 0; i < r.size(); ++i) {
+    r[i] = splitmix64(i);
+  }
+  return r;
+}
+
+inline constexpr std::array<uint64_t, N_TABLES * TABLE_SIZE> KEYS =
+    make_keys();
+
+constexpr uint64_t key(Table table, size_t i) {
+  return KEYS[table * TABLE_SIZE + i];
+}
+
+constexpr size_t unit_idx(const OwnedUnit &unit) {
+  return (static_cast<size_t>(unit.loc) * N_POWER_SLOTS +
+          static_cast<size_t>(unit.power)) *
+             N_TYPE_SLOTS +
+         static_cast<size_t>(unit.type);
+}
+
+} // namespace detail
+
+inline uint64_t unit(const OwnedUnit &unit) {
+  return detail::key(UNIT, detail::unit_idx(unit));
+}
+
+inline uint64_t center(Loc loc, Power power) {
+  return detail::key(CENTER, static_cast<size_t>(loc) * N_POWER_SLOTS +
+                                 static_cast<size_t>(power));
+}
+
+inline uint64_t dislodged(const OwnedUnit &unit, Loc dislodged_by) {
+  return detail::splitmix64(detail::key(DISLODGED, detail::unit_idx(unit)) ^
+                            static_cast<uint64_t>(dislodged_by));
+}
+
+inline uint64_t contested(Loc loc) {
+  return detail::key(CONTESTED, static_cast<size_t>(loc));
+}
+
+// Orders are not part of board hashes: keys for hashes of order histories
+// (see get_position_hashes). The fields are packed above the table indices.
+inline uint64_t order(const Order &order) {
+  Unit unit = order.get_unit();
+  Unit target = order.get_target();
+  return detail::splitmix64(
+      (1ULL << 56) | (static_cast<uint64_t>(order.get_via()) << 48) |
+      (static_cast<uint64_t>(order.get_dest()) << 40) |
+      (static_cast<uint64_t>(target.type) << 32) |
+      (static_cast<uint64_t>(target.loc) << 24) |
+      (static_cast<uint64_t>(order.get_type()) << 16) |
+      (static_cast<uint64_t>(unit.type) << 8) |
+      static_cast<uint64_t>(unit.loc));
+}
+
+// Phases are not part of the incremental hash: mixed in when it is read
+inline uint64_t phase(const Phase &phase) {
+  return detail::splitmix64(
+      (static_cast<uint64_t>(static_cast<uint8_t>(phase.season)) << 24) |
+      (static_cast<uint64_t>(static_cast<uint8_t>(phase.phase_type)) << 16) |
+      static_cast<uint64_t>(static_cast<uint16_t>(phase.year)));
+}
+
+} // namespace zobrist
+} // namespace dipcc
@@ -0,0 +1,391 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// Microbenchmarks of the dipcc hot paths. Build in Release mode and run e.g.
+//
+//   ./out/bench_dipcc --benchmark_filter=Process
+//
+// Fixtures are the checked-in self-play games of integration_tests/data, and
+// games from generate_game.
+
+#include <algorithm>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <random>
+#include <set>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../cc/cfr_kernels.h"
+#include "../cc/cfr_solver.h"
+#include "../cc/encoding.h"
+#include "../cc/game.h"
+#include "../cc/game_gen.h"
+#include "../cc/game_state.h"
+#include "../cc/order.h"
+#include "../cc/orders_encoder.h"
+#include "../cc/playout.h"
+#include "../cc/power.h"
+#include "../cc/thread_pool.h"
+
+using namespace dipcc;
+
+namespace {
+
+const std::string kGamePath =
+    std::string(DIPCC_BENCH_DATA_DIR) + "/game_TUR.1299.json";
+
+// A late-game movement, retreat and adjustment phase of the fixture game,
+// indexed by the benchmarks' phase argument
+const std::vector<std::string> kPhases = {"S1911M", "S1911R", "W1911A"};
+
+const int kMaxOrderCands = 469;
+
+// Batch size of the ThreadPool benchmarks
+const int kBatchSize = 64;
+
+const std::string &fixture_json() {
+  static const std::string json_str = [] {
+    std::ifstream f(kGamePath);
+    JCHECK(f.good(), "Could not open fixture " + kGamePath);
+    return std::string((std::istreambuf_iterator<char>(f)),
+                       std::istreambuf_iterator<char>());
+  }();
+  return json_str;
+}
+
+Game &fixture_game() {
+  static Game game(fixture_json());
+  return game;
+}
+
+// Vocabulary of every possible order in the fixture's phases, standing in
+// for the model's order vocabulary
+const std::unordered_map<std::string, int> &fixture_vocab() {
+  static const std::unordered_map<std::string, int> vocab = [] {
+    std::set<std::string> orders;
+    for (auto & [ phase, state ] : fixture_game().get_state_history()) {
+      GameState s(*state);
+      for (auto & [ loc, loc_orders ] : s.get_all_possible_orders()) {
+        for (const Order &order : loc_orders) {
+          orders.insert(order.to_string());
+        }
+      }
+    }
+    std::unordered_map<std::string, int> r;
+    for (const std::string &order : orders) {
+      r[order] = r.size();
+    }
+    return r;
+  }();
+  return vocab;
+}
+
+const OrdersEncoder &fixture_orders_encoder() {
+  static const OrdersEncoder encoder(fixture_vocab(), kMaxOrderCands);
+  return encoder;
+}
+
+// The fixture game at the start of phase, with its possible orders loaded
+Game game_at_phase_start(const std::string &phase) {
+  Game game = fixture_game().rolled_back_to_phase_start(phase);
+  game.get_all_possible_orders();
+  return game;
+}
+
+// Same, with the phase's orders staged
+Game game_at_phase_end(const std::string &phase) {
+  Game game = fixture_game().rolled_back_to_phase_end(phase);
+  game.get_all_possible_orders();
+  return game;
+}
+
+// Options of the generated games: dense in convoys and dislodgements if
+// dense, else plain heuristic play
+GameGenOptions gen_options(bool dense, int n_phases) {
+  GameGenOptions options;
+  options.n_phases = n_phases;
+  if (dense) {
+    options.convoy_rate = 0.5;
+    options.attack_rate = 0.5;
+  }
+  return options;
+}
+
+// kBatchSize distinct dense generated games, each mid-game with the orders
+// of its current phase staged
+const std::vector<Game> &generated_batch() {
+  static const std::vector<Game> games = [] {
+    std::vector<Game> r;
+    for (int seed = 0; seed < kBatchSize; ++seed) {
+      Game &game = r.emplace_back(generate_game(gen_options(true, 40), seed));
+      std::mt19937 rng(seed);
+      set_playout_orders(game, PlayoutPolicy::HEURISTIC, rng);
+      game.get_all_possible_orders();
+    }
+    return r;
+  }();
+  return games;
+}
+
+///////////////////
+// Adjudication //
+///////////////////
+
+void BM_Process(benchmark::State &st) {
+  const std::string &phase = kPhases[st.range(0)];
+  GameState state(*fixture_game().get_state_history().at(Phase(phase)));
+  state.get_all_possible_orders();
+  const auto &orders = fixture_game().get_order_history().at(Phase(phase));
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(state.process(orders));
+  }
+  st.SetLabel(phase);
+}
+BENCHMARK(BM_Process)->DenseRange(0, 2);
+
+void BM_GetAllPossibleOrders(benchmark::State &st) {
+  const std::string &phase = kPhases[st.range(0)];
+  json j = fixture_game().get_state_history().at(Phase(phase))->to_json();
+
+  for (auto _ : st) {
+    st.PauseTiming();
+    GameState state(j);
+    st.ResumeTiming();
+    benchmark::DoNotOptimize(state.get_all_possible_orders());
+  }
+  st.SetLabel(phase);
+}
+BENCHMARK(BM_GetAllPossibleOrders)->DenseRange(0, 2);
+
+// Items are phases of a generated 100-phase game, plain (0) or dense (1):
+// order generation, the policy and adjudication together
+void BM_GenerateGame(benchmark::State &st) {
+  GameGenOptions options = gen_options(st.range(0), 100);
+  int64_t n_phases = 0;
+  uint64_t seed = 0;
+
+  for (auto _ : st) {
+    Game game = generate_game(options, seed++);
+    n_phases += game.get_state_history().size();
+  }
+  st.SetItemsProcessed(n_phases);
+}
+BENCHMARK(BM_GenerateGame)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+//////////////
+// Encoding //
+//////////////
+
+void BM_EncodeBoardState(benchmark::State &st) {
+  Game game = game_at_phase_start(kPhases[0]);
+  std::vector<float> r(81 * BOARD_STATE_ENC_WIDTH);
+
+  for (auto _ : st) {
+    encode_board_state(game.get_state(), r.data());
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_EncodeBoardState);
+
+void BM_EncodeValidOrders(benchmark::State &st) {
+  const std::string &phase = kPhases[st.range(0)];
+  Game game = game_at_phase_start(phase);
+  const OrdersEncoder &encoder = fixture_orders_encoder();
+  std::vector<int32_t> order_idxs(OrdersEncoder::MAX_SEQ_LEN *
+                                  encoder.get_max_cands());
+  std::vector<int8_t> loc_idxs(81);
+
+  for (auto _ : st) {
+    for (Power power : POWERS) {
+      encoder.encode_valid_orders(power, game.get_state(), order_idxs.data(),
+                                  loc_idxs.data());
+    }
+    benchmark::ClobberMemory();
+  }
+  st.SetLabel(phase);
+}
+BENCHMARK(BM_EncodeValidOrders)->DenseRange(0, 2);
+
+void BM_DecodeOrderIdxs(benchmark::State &st) {
+  // The movement phase's actual orders, as model order idxs
+  const std::string &phase = kPhases[0];
+  const auto &vocab = fixture_vocab();
+  const long S = OrdersEncoder::MAX_SEQ_LEN;
+  std::vector<long> order_idxs(7 * S, OrdersEncoder::EOS_IDX);
+  for (auto & [ power, orders ] :
+       fixture_game().get_order_history().at(Phase(phase))) {
+    long *p = order_idxs.data() + (static_cast<int>(power) - 1) * S;
+    for (const Order &order : orders) {
+      auto it = vocab.find(order.to_string());
+      if (it != vocab.end()) {
+        *p++ = it->second;
+      }
+    }
+  }
+  const OrdersEncoder &encoder = fixture_orders_encoder();
+  std::vector<std::vector<Order>> r;
+
+  for (auto _ : st) {
+    encoder.decode_order_idxs(order_idxs.data(), S, r);
+    benchmark::DoNotOptimize(r);
+  }
+}
+BENCHMARK(BM_DecodeOrderIdxs);
+
+///////////////////
+// Serialization //
+///////////////////
+
+void BM_GameClone(benchmark::State &st) {
+  Game game = game_at_phase_start(kPhases[0]);
+
+  for (auto _ : st) {
+    Game copy(game);
+    benchmark::DoNotOptimize(copy);
+  }
+}
+BENCHMARK(BM_GameClone);
+
+void BM_ToJson(benchmark::State &st) {
+  Game game(fixture_json());
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(game.to_json());
+  }
+}
+BENCHMARK(BM_ToJson)->Unit(benchmark::kMillisecond);
+
+void BM_FromJson(benchmark::State &st) {
+  const std::string &json_str = fixture_json();
+
+  for (auto _ : st) {
+    Game game(json_str);
+    benchmark::DoNotOptimize(game);
+  }
+  st.SetBytesProcessed(st.iterations() * json_str.size());
+}
+BENCHMARK(BM_FromJson)->Unit(benchmark::kMillisecond);
+
+////////////////
+// ThreadPool //
+////////////////
+
+// Thread counts 1, 2, 4, ..., up to the number of CPUs
+void ThreadCounts(benchmark::internal::Benchmark *b) {
+  int max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  for (int n = 1; n < max_threads; n *= 2) {
+    b->Arg(n);
+  }
+  b->Arg(max_threads);
+}
+
+// Distinct generated games, since process_multi shares the processing of
+// identical ones
+void BM_ThreadPoolProcess(benchmark::State &st) {
+  ThreadPool pool(st.range(0), fixture_vocab(), kMaxOrderCands);
+  std::vector<Game> games;
+  std::vector<Game *> game_ptrs;
+
+  for (auto _ : st) {
+    // Fresh copies, with the processed ones destroyed outside of the timing
+    st.PauseTiming();
+    games = generated_batch();
+    game_ptrs.clear();
+    for (Game &game : games) {
+      game_ptrs.push_back(&game);
+    }
+    st.ResumeTiming();
+
+    pool.process_multi(game_ptrs);
+  }
+  st.SetItemsProcessed(st.iterations() * kBatchSize);
+}
+BENCHMARK(BM_ThreadPoolProcess)->Apply(ThreadCounts)->UseRealTime();
+
+void BM_ThreadPoolEncode(benchmark::State &st) {
+  ThreadPool pool(st.range(0), fixture_vocab(), kMaxOrderCands);
+  std::vector<Game> games(kBatchSize, game_at_phase_start(kPhases[0]));
+  std::vector<Game *> game_ptrs;
+  for (Game &game : games) {
+    game_ptrs.push_back(&game);
+  }
+
+  for (auto _ : st) {
+    pool.release_encoded_inputs(pool.encode_inputs_multi(game_ptrs));
+  }
+  st.SetItemsProcessed(st.iterations() * kBatchSize);
+}
+BENCHMARK(BM_ThreadPoolEncode)->Apply(ThreadCounts)->UseRealTime();
+
+// Items are phases played out, by the RANDOM (0) or HEURISTIC (1) policy
+void BM_ThreadPoolPlayout(benchmark::State &st) {
+  ThreadPool pool(st.range(0), fixture_vocab(), kMaxOrderCands);
+  PlayoutPolicy policy = static_cast<PlayoutPolicy>(st.range(1));
+  std::vector<Game> games;
+  std::vector<Game *> game_ptrs;
+  int64_t n_phases = 0;
+  uint64_t seed = 0;
+
+  for (auto _ : st) {
+    st.PauseTiming();
+    games.assign(kBatchSize, Game());
+    game_ptrs.clear();
+    for (Game &game : games) {
+      game.set_lazy_possible_orders(true);
+      game_ptrs.push_back(&game);
+    }
+    st.ResumeTiming();
+
+    n_phases += pool.playout_multi(game_ptrs, policy, 4, seed++);
+  }
+  st.SetItemsProcessed(n_phases);
+}
+BENCHMARK(BM_ThreadPoolPlayout)
+    ->ArgsProduct({{1, static_cast<long>(std::thread::hardware_concurrency())},
+                   {0, 1}})
+    ->UseRealTime();
+
+/////////
+// CFR //
+/////////
+
+// One CFR iteration with st.range(1) actions per power, with the kernels of
+// SimdLevel st.range(0)
+void BM_CFRIter(benchmark::State &st) {
+  SimdLevel default_level = get_simd_level();
+  SimdLevel level = static_cast<SimdLevel>(st.range(0));
+  if (set_simd_level(level) != level) {
+    set_simd_level(default_level);
+    st.SkipWithError("SIMD level not supported");
+    return;
+  }
+  int n_actions = st.range(1);
+  CFRSolver solver(std::vector<std::vector<float>>(
+                       7, std::vector<float>(n_actions, 1.0)),
+                   true, 0);
+  std::vector<std::array<float, 7>> utilities(7 * n_actions);
+  for (int i = 0; i < utilities.size(); ++i) {
+    utilities[i].fill((i * 7919 % 101) / 100.0);
+  }
+
+  for (auto _ : st) {
+    solver.start_iter();
+    solver.sample({});
+    benchmark::DoNotOptimize(solver.update(utilities));
+  }
+  set_simd_level(default_level);
+}
+BENCHMARK(BM_CFRIter)->ArgsProduct({{0, 1, 2}, {10, 50, 200}});
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,230 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// Performance regression check, run by ctest as perf_dipcc in Release builds:
+//
+//   ./out/perf_dipcc --data_dir DIR --baselines FILE [--out FILE]
+//                    [--tolerance X] [--update]
+//
+// Times adjudication and possible-order generation on fixed phases of the
+// checked-in self-play games, and fails if any is more than tolerance times
+// slower than its stored baseline. Times are stored relative to a fixed
+// calibration workload timed in the same run, so that baselines carry over
+// between machines of similar architecture. Results are printed as json (and
+// written to --out); --update rewrites the baselines with this run's.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "../cc/checks.h"
+#include "../cc/game.h"
+#include "../cc/game_state.h"
+#include "../cc/json.h"
+#include "../cc/phase.h"
+
+using namespace dipcc;
+
+namespace {
+
+// Used unless the baselines file gives one: a real regression, like process()
+// getting twice as slow, fails, while machine noise does not
+const double kDefaultTolerance = 1.75;
+
+// Each timing is the fastest of kReps batches of at least kBatchSecs
+const int kReps = 7;
+const double kBatchSecs = 0.02;
+
+struct PerfCase {
+  std::string name;
+  std::string game_file;
+  std::string phase;
+};
+
+const std::vector<PerfCase> kCases = {
+    {"opening", "game_TUR.1299.json", "S1901M"},
+    {"late_game", "game_TUR.1299.json", "S1911M"},
+    {"convoys", "game_TUR.1033.json", "S1919M"},
+    {"builds", "game_AUS.1009.json", "W1901A"},
+};
+
+void usage() {
+  std::cerr << "Usage: perf_dipcc --data_dir DIR --baselines FILE [--out FILE] "
+               "[--tolerance X] [--update]\n";
+  exit(2);
+}
+
+std::string read_file(const std::string &path) {
+  std::ifstream f(path);
+  JCHECK(f.good(), "Could not open " + path);
+  return std::string((std::istreambuf_iterator<char>(f)),
+                     std::istreambuf_iterator<char>());
+}
+
+// Nanoseconds per call of fn
+double time_ns(const std::function<void()> &fn) {
+  using clock = std::chrono::steady_clock;
+  fn();
+
+  // Calls per batch, doubled until a batch takes kBatchSecs
+  size_t n = 1;
+  while (true) {
+    auto start = clock::now();
+    for (size_t i = 0; i < n; ++i) {
+      fn();
+    }
+    double secs = std::chrono::duration<double>(clock::now() - start).count();
+    if (secs >= kBatchSecs) {
+      break;
+    }
+    n *= 2;
+  }
+
+  double best = 0;
+  for (int rep = 0; rep < kReps; ++rep) {
+    auto start = clock::now();
+    for (size_t i = 0; i < n; ++i) {
+      fn();
+    }
+    double ns =
+        std::chrono::duration<double, std::nano>(clock::now() - start).count() /
+        n;
+    best = rep == 0 ? ns : std::min(best, ns);
+  }
+  return best;
+}
+
+// Sort of 64k pseudo-random ints: a fixed CPU- and cache-bound workload to
+// which the other timings are relative
+double time_calibration() {
+  std::mt19937 rng(0);
+  std::vector<int> xs(1 << 16);
+  for (int &x : xs) {
+    x = rng();
+  }
+  std::vector<int> ys;
+  return time_ns([&] {
+    ys = xs;
+    std::sort(ys.begin(), ys.end());
+  });
+}
+
+volatile size_t sink;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string data_dir, baselines_path, out_path;
+  double tolerance = 0;
+  bool update = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--update") {
+      update = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      usage();
+    }
+    std::string value = argv[++i];
+    if (arg == "--data_dir") {
+      data_dir = value;
+    } else if (arg == "--baselines") {
+      baselines_path = value;
+    } else if (arg == "--out") {
+      out_path = value;
+    } else if (arg == "--tolerance") {
+      tolerance = std::stod(value);
+    } else {
+      usage();
+    }
+  }
+  if (data_dir.empty() || baselines_path.empty()) {
+    usage();
+  }
+
+  json baselines;
+  if (!update) {
+    baselines = json::parse(read_file(baselines_path));
+    if (tolerance == 0) {
+      tolerance = baselines.value("tolerance", kDefaultTolerance);
+    }
+  }
+  if (tolerance == 0) {
+    tolerance = kDefaultTolerance;
+  }
+
+  double calibration_ns = time_calibration();
+  json results = json::array();
+  bool ok = true;
+  auto record = [&](const std::string &name, double ns) {
+    json r;
+    r["name"] = name;
+    r["ns"] = ns;
+    r["relative"] = ns / calibration_ns;
+    if (!update) {
+      if (baselines["baselines"].contains(name)) {
+        double baseline = baselines["baselines"][name];
+        r["baseline"] = baseline;
+        r["ratio"] = ns / calibration_ns / baseline;
+        r["ok"] = ns / calibration_ns <= baseline * tolerance;
+        ok = ok && r["ok"].get<bool>();
+      } else {
+        // A new case passes until its baseline is recorded
+        r["ok"] = true;
+      }
+    }
+    results.push_back(r);
+  };
+
+  for (const PerfCase &c : kCases) {
+    Game game(read_file(data_dir + "/" + c.game_file));
+    const GameState &recorded =
+        *game.get_state_history().at(Phase(c.phase));
+    const auto &orders = game.get_order_history().at(Phase(c.phase));
+
+    GameState loaded(recorded);
+    loaded.get_all_possible_orders();
+    record(c.name + "/process",
+           time_ns([&] { sink = loaded.process(orders).get_units().size(); }));
+
+    GameState unloaded(recorded);
+    unloaded.clear_all_possible_orders();
+    record(c.name + "/possible_orders", time_ns([&] {
+             GameState state(unloaded);
+             sink = state.get_all_possible_orders().size();
+           }));
+  }
+
+  json out;
+  out["calibration_ns"] = calibration_ns;
+  out["tolerance"] = tolerance;
+  out["results"] = results;
+  out["ok"] = ok;
+  std::cout << out.dump(2) << std::endl;
+  if (!out_path.empty()) {
+    std::ofstream(out_path) << out.dump(2) << std::endl;
+  }
+
+  if (update) {
+    json new_baselines;
+    new_baselines["tolerance"] = tolerance;
+    for (const json &r : results) {
+      new_baselines["baselines"][r["name"].get<std::string>()] = r["relative"];
+    }
+    std::ofstream(baselines_path) << new_baselines.dump(2) << std::endl;
+    return 0;
+  }
+  return ok ? 0 : 1;
+}
@@ -43,4 +43,19 @@ py::array_t<float> py_encode_board_state_from_phase(PhaseData &phase) {
   return py_encode_board_state(phase.get_state());
 }
 
+// (unit_types, unit_owners) int8 arrays [81], see write_unit_arrays
+py::tuple py_unit_arrays(GameState &state) {
+  py::array_t<int8_t> unit_types(81), unit_owners(81);
+  state.write_unit_arrays(unit_types.mutable_data(0),
+                          unit_owners.mutable_data(0));
+  return py::make_tuple(unit_types, unit_owners);
+}
+
+// int8 array [34] of SC_LOCS owners, see write_center_owners
+py::array_t<int8_t> py_center_owners(GameState &state) {
+  py::array_t<int8_t> r(N_SCS);
+  state.write_center_owners(r.mutable_data(0));
+  return r;
+}
+
 } // namespace dipcc
@@ -20,7 +20,7 @@ PhaseData Game::get_phase_data() {
   // Does NOT return the current staged orders, nor the current phase's messages.
   // This is intentional, to match the old diplomacy research python implementation,
   // even though this is a little weird and inconsistent.
-  return PhaseData(*state_, std::unordered_map<Power, std::vector<Order>>());
+  return PhaseData(state_);
 }
 
 } // namespace dipcc
@@ -16,12 +16,22 @@ using namespace std;
 namespace dipcc {
 
 vector<PhaseData> Game::get_phase_history() {
+  load_lazy_phases();
+
+  // O(1) copies of the histories, which the PhaseData reference into
+  struct Histories {
+    PhaseMap<PhaseData::Orders> orders;
+    PhaseMap<PhaseData::Messages> messages;
+  };
+  auto histories = std::make_shared<const Histories>(
+      Histories{order_history_, message_history_});
+
   vector<PhaseData> r;
   r.reserve(state_history_.size());
-
   for (auto &it : state_history_) {
-    string name = it.first.to_string();
-    r.push_back(PhaseData(*it.second, order_history_[name], message_history_[name]));
+    r.push_back(PhaseData(it.second, histories,
+                          histories->orders.get(it.first),
+                          histories->messages.get(it.first)));
   }
 
   return r;
@@ -20,6 +20,7 @@ namespace dipcc {
 // PUBLIC
 
 py::dict Game::py_get_logs() {
+  load_lazy_phases();
   py::dict d;
   for (auto & [ phase, datas ] : logs_) {
     py::list l;
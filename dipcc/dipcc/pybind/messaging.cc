@@ -19,11 +19,12 @@ namespace dipcc {
 // PUBLIC
 
 py::dict Game::py_get_message_history() {
+  load_lazy_phases();
   return py_message_history_to_dict(message_history_, state_->get_phase());
 }
 
 py::dict Game::py_get_messages() {
-  return py_messages_to_phase_dict(message_history_[state_->get_phase()]);
+  return py_messages_to_phase_dict(message_history_.get(state_->get_phase()));
 }
 
 // PRIVATE
@@ -48,7 +49,7 @@ py_messages_to_phase_dict(const std::map<uint64_t, Message> &messages) {
 }
 
 py::dict py_message_history_to_dict(
-    const std::map<Phase, std::map<uint64_t, Message>> &message_history,
+    const PhaseMap<std::map<uint64_t, Message>> &message_history,
     Phase exclude_phase) {
 
   py::dict d;
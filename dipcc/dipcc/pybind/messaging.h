@@ -8,6 +8,7 @@ LICENSE file in the root directory of this source tree.
 #pragma once
 
 #include "../cc/message.h"
+#include "../cc/phase_map.h"
 
 namespace py = pybind11;
 
@@ -18,7 +19,7 @@ py::dict py_message_to_dict(const Message &message);
 py::dict py_messages_to_phase_dict(const std::map<uint64_t, Message> &messages);
 
 py::dict py_message_history_to_dict(
-    const std::map<Phase, std::map<uint64_t, Message>> &message_history,
+    const PhaseMap<std::map<uint64_t, Message>> &message_history,
     Phase exclude_phase);
 
 }; // namespace dipcc
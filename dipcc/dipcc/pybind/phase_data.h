@@ -7,70 +7,82 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <map>
+#include <memory>
 #include <unordered_map>
 
 #include "../cc/game.h"
 #include "../cc/game_state.h"
 #include "../cc/message.h"
+#include "../cc/phase_orders.h"
 #include "../cc/power.h"
 #include "py_dict.h"
+#include "state_view.h"
 
 namespace py = pybind11;
 
 namespace dipcc {
 
 // forward declares
-py::dict
-py_orders_to_dict(std::unordered_map<Power, std::vector<Order>> &orders);
+py::dict py_orders_to_dict(const PowerMap<std::vector<Order>> &orders);
+py::dict py_orders_to_dict(const PhaseOrders &orders);
 py::dict py_state_to_dict(GameState &state);
 py::dict py_messages_to_phase_dict(const std::map<uint64_t, Message> &messages);
 // !forward declares
 
+// A phase of a game's history. Holds no copies: the state is shared, and the
+// orders and messages are references into the history, kept alive by owner,
+// since completed phases are immutable.
 class PhaseData {
 public:
-  PhaseData(const GameState &state,
-            const std::unordered_map<Power, std::vector<Order>> &orders) {
-    name_ = state.get_phase().to_string();
-    state_ = state;
-    orders_ = orders;
-  }
+  using Orders = PhaseOrders;
+  using Messages = std::map<uint64_t, Message>;
 
-  PhaseData(const GameState &state,
-            const std::unordered_map<Power, std::vector<Order>> &orders,
-            std::map<uint64_t, Message> &messages) {
-    name_ = state.get_phase().to_string();
-    state_ = state;
-    orders_ = orders;
-    messages_ = messages;
-  }
+  // A phase with no orders nor messages
+  PhaseData(std::shared_ptr<GameState> state)
+      : PhaseData(state, nullptr, empty_orders(), empty_messages()) {}
+
+  PhaseData(std::shared_ptr<GameState> state,
+            std::shared_ptr<const void> owner, const Orders &orders,
+            const Messages &messages)
+      : state_(state), owner_(owner), orders_(&orders), messages_(&messages) {}
 
-  py::dict py_get_state() { return py_state_to_dict(state_); }
+  StateView py_get_state() { return StateView(state_); }
 
-  py::dict py_get_orders() { return py_orders_to_dict(orders_); }
+  py::dict py_get_orders() { return py_orders_to_dict(*orders_); }
 
-  py::dict py_get_messages() { return py_messages_to_phase_dict(messages_); }
+  py::dict py_get_messages() { return py_messages_to_phase_dict(*messages_); }
 
   py::dict to_dict() {
     py::dict d;
-    d["name"] = name_;
-    d["state"] = py_get_state();
+    d["name"] = get_name();
+    d["state"] = py_state_to_dict(*state_);
     d["orders"] = py_get_orders();
     d["messages"] = py_get_messages();
     return d;
   }
 
-  const std::string get_name() const { return name_; }
-  GameState &get_state() { return state_; }
-  const std::unordered_map<Power, std::vector<Order>> &get_orders() const {
-    return orders_;
+  const std::string get_name() const {
+    return state_->get_phase().to_string();
   }
+  GameState &get_state() { return *state_; }
+  const Orders &get_orders() const { return *orders_; }
 
 private:
+  static const Orders &empty_orders() {
+    static const Orders empty;
+    return empty;
+  }
+  static const Messages &empty_messages() {
+    static const Messages empty;
+    return empty;
+  }
+
   // Members
-  std::string name_;
-  GameState state_;
-  std::unordered_map<Power, std::vector<Order>> orders_;
-  std::map<uint64_t, Message> messages_;
+  std::shared_ptr<GameState> state_; // shared with the game's history
+  std::shared_ptr<const void> owner_; // keeps orders_ and messages_ alive
+  const Orders *orders_;
+  const Messages *messages_;
 };
 
 } // namespace dipcc
@@ -17,14 +17,16 @@ namespace py = pybind11;
 
 namespace dipcc {
 
-py::dict py_orders_to_dict(unordered_map<Power, vector<Order>> &orders) {
+namespace {
+
+template <typename T> py::dict orders_to_dict(const T &orders) {
   py::dict d;
 
   for (auto &it : orders) {
     auto py_power = py::cast<string>(power_str(it.first));
     auto list = py::list();
-    for (Order &order : it.second) {
-      list.append(py::cast<string>(order.to_string()));
+    for (const Order &order : it.second) {
+      list.append(py::cast(order.to_string()));
     }
     d[py_power] = list;
   }
@@ -32,45 +34,54 @@ py::dict py_orders_to_dict(unordered_map<Power, vector<Order>> &orders) {
   return d;
 }
 
-py::dict py_state_to_dict(GameState &state) {
-  py::dict d;
+} // namespace
 
-  auto &all_possible_orders(state.get_all_possible_orders());
+py::dict py_orders_to_dict(const PowerMap<vector<Order>> &orders) {
+  return orders_to_dict(orders);
+}
 
-  // builds
-  d["builds"] = py::dict();
+py::dict py_orders_to_dict(const PhaseOrders &orders) {
+  return orders_to_dict(orders);
+}
+
+py::dict py_state_builds(GameState &state) {
+  py::dict d;
   for (Power power : POWERS) {
-    auto power_py_str = py::cast<std::string>(power_str(power));
-    d["builds"][power_py_str] = py::dict();
+    py::dict power_d;
     py::list homes_list;
     if (state.get_phase().phase_type == 'A') {
+      auto &all_possible_orders(state.get_all_possible_orders());
       for (Loc center : home_centers(power)) {
         auto it = all_possible_orders.find(center);
         if (it != all_possible_orders.end() && it->second.size() > 0) {
           homes_list.append(loc_str(center));
         }
       }
-      d["builds"][power_py_str]["count"] = std::min(
-          state.get_n_builds(power), static_cast<int>(homes_list.size()));
+      power_d["count"] = std::min(state.get_n_builds(power),
+                                  static_cast<int>(homes_list.size()));
     } else {
-      d["builds"][power_py_str]["count"] = 0;
+      power_d["count"] = 0;
     }
-    d["builds"][power_py_str]["homes"] = homes_list;
+    power_d["homes"] = homes_list;
+    d[py::cast<std::string>(power_str(power))] = power_d;
   }
+  return d;
+}
 
-  // centers
-  d["centers"] = py::dict();
+py::dict py_state_centers(GameState &state) {
+  py::dict d;
   for (Power power : POWERS) {
-    d["centers"][py::cast<std::string>(power_str(power))] = py::list();
+    d[py::cast<std::string>(power_str(power))] = py::list();
   }
   for (const auto &p : state.get_centers()) {
-    static_cast<py::list>(
-        d["centers"][py::cast<std::string>(power_str(p.second))])
+    static_cast<py::list>(d[py::cast<std::string>(power_str(p.second))])
         .append(loc_str(p.first));
   }
+  return d;
+}
 
-  // homes
-  d["homes"] = py::dict();
+py::dict py_state_homes(GameState &state) {
+  py::dict d;
   for (Power power : POWERS) {
     py::list homes;
     for (Loc center : home_centers(power)) {
@@ -79,18 +90,18 @@ py::dict py_state_to_dict(GameState &state) {
         homes.append(loc_str(center));
       }
     }
-    d["homes"][py::cast<std::string>(power_str(power))] = homes;
+    d[py::cast<std::string>(power_str(power))] = homes;
   }
+  return d;
+}
 
-  // name
-  d["name"] = py::cast<std::string>(state.get_phase().to_string());
-
-  // retreats
-  d["retreats"] = py::dict();
+py::dict py_state_retreats(GameState &state) {
+  py::dict d;
   for (Power power : POWERS) {
-    d["retreats"][py::cast<std::string>(power_str(power))] = py::dict();
+    d[py::cast<std::string>(power_str(power))] = py::dict();
   }
   if (state.get_phase().phase_type == 'R') {
+    auto &all_possible_orders(state.get_all_possible_orders());
     for (OwnedUnit &unit : state.get_dislodged_units()) {
       auto key = py::cast<std::string>(unit.unowned().to_string());
       py::list retreats;
@@ -102,15 +113,16 @@ py::dict py_state_to_dict(GameState &state) {
           retreats.append(loc_str(order.get_dest()));
         }
       }
-      d["retreats"][py::cast<std::string>(power_str(unit.power))][key] =
-          retreats;
+      d[py::cast<std::string>(power_str(unit.power))][key] = retreats;
     }
   }
+  return d;
+}
 
-  // units
-  d["units"] = py::dict();
+py::dict py_state_units(GameState &state) {
+  py::dict d;
   for (Power power : POWERS) {
-    d["units"][py::cast<std::string>(power_str(power))] = py::list();
+    d[py::cast<std::string>(power_str(power))] = py::list();
   }
   for (auto &p : state.get_units()) {
     OwnedUnit unit = p.second;
@@ -118,8 +130,7 @@ py::dict py_state_to_dict(GameState &state) {
       LOG(WARNING) << "UnitType::NONE in py_state_to_dict units, loc="
                    << (unit.loc == Loc::NONE ? "NONE" : loc_str(unit.loc));
     }
-    static_cast<py::list>(
-        d["units"][py::cast<std::string>(power_str(unit.power))])
+    static_cast<py::list>(d[py::cast<std::string>(power_str(unit.power))])
         .append(unit.unowned().to_string());
   }
   for (OwnedUnit unit : state.get_dislodged_units()) {
@@ -127,28 +138,34 @@ py::dict py_state_to_dict(GameState &state) {
       LOG(WARNING) << "UnitType::NONE in py_state_to_dict dislodged_units, loc="
                    << (unit.loc == Loc::NONE ? "NONE" : loc_str(unit.loc));
     }
-    static_cast<py::list>(
-        d["units"][py::cast<std::string>(power_str(unit.power))])
+    static_cast<py::list>(d[py::cast<std::string>(power_str(unit.power))])
         .append("*" + unit.unowned().to_string());
   }
-
   return d;
 }
 
-py::dict Game::py_get_state() {
-  auto d(py_state_to_dict(this->get_state()));
-
-  // DEBUGGING
-  if (this->get_state().get_phase().phase_type == 'R') {
-    for (auto &p : this->get_state().get_all_possible_orders()) {
-      if (this->get_state().get_unit_rooted(p.first).type == UnitType::NONE) {
-        LOG(WARNING) << "Found weird case, logging crash dump: " << p.first;
-        this->crash_dump();
-      }
-    }
+py::object py_state_field(GameState &state, const std::string &key) {
+  if (key == "builds") {
+    return py_state_builds(state);
+  } else if (key == "centers") {
+    return py_state_centers(state);
+  } else if (key == "homes") {
+    return py_state_homes(state);
+  } else if (key == "name") {
+    return py::str(state.get_phase().to_string());
+  } else if (key == "retreats") {
+    return py_state_retreats(state);
+  } else if (key == "units") {
+    return py_state_units(state);
   }
-  // !DEBUGGING
+  throw py::key_error(key);
+}
 
+py::dict py_state_to_dict(GameState &state) {
+  py::dict d;
+  for (const char *key : STATE_DICT_KEYS) {
+    d[key] = py_state_field(state, key);
+  }
   return d;
 }
 
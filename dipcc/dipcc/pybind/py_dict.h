@@ -10,14 +10,26 @@ LICENSE file in the root directory of this source tree.
 #include "../cc/game.h"
 #include "../cc/game_state.h"
 #include "../cc/order.h"
+#include "../cc/phase_orders.h"
 #include "../cc/power.h"
+#include "state_view.h"
 
 namespace py = pybind11;
 
 namespace dipcc {
 
-py::dict
-py_orders_to_dict(std::unordered_map<Power, std::vector<Order>> &orders);
+py::dict py_orders_to_dict(const PowerMap<std::vector<Order>> &orders);
+py::dict py_orders_to_dict(const PhaseOrders &orders);
+
+// Fields of the state dict, see STATE_DICT_KEYS
+py::dict py_state_builds(GameState &state);
+py::dict py_state_centers(GameState &state);
+py::dict py_state_homes(GameState &state);
+py::dict py_state_retreats(GameState &state);
+py::dict py_state_units(GameState &state);
+
+// State dict field by key; raises KeyError if unknown
+py::object py_state_field(GameState &state, const std::string &key);
 
 py::dict py_state_to_dict(GameState &state);
 
@@ -8,6 +8,7 @@ LICENSE file in the root directory of this source tree.
 #pragma once
 
 #include "../cc/game.h"
+#include "py_dict.h"
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
@@ -15,5 +16,7 @@ namespace py = pybind11;
 
 namespace dipcc {
 
-py::dict py_game_get_units(Game *game) { return game->py_get_state()["units"]; }
+py::dict py_game_get_units(Game *game) {
+  return py_state_units(game->get_state());
+}
 };
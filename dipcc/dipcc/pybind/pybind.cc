@@ -6,27 +6,132 @@ LICENSE file in the root directory of this source tree.
 */
 
 #include <memory>
+#include <optional>
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <torch/extension.h>
 
+#include "../cc/cfr_kernels.h"
+#include "../cc/checks.h"
+#include "../cc/cfr_solver.h"
 #include "../cc/exceptions.h"
 #include "../cc/game.h"
+#include "../cc/game_batch.h"
+#include "../cc/game_corpus.h"
+#include "../cc/game_gen.h"
+#include "../cc/loc_orders_cache.h"
+#include "../cc/model_batcher.h"
+#include "../cc/nash_conv.h"
+#include "../cc/order_sampling.h"
+#include "../cc/perf_stats.h"
+#include "../cc/plausible_orders.h"
+#include "../cc/replay_buffer.h"
+#include "../cc/rollout_cache.h"
+#include "../cc/rollouts.h"
+#include "../cc/search_store.h"
 #include "../cc/thread_pool.h"
+#include "../cc/torchscript_model.h"
+#include "../cc/trace.h"
 #include "encoding.h"
 #include "py_game_get_units.h"
+#include "state_view.h"
 #include "thread_pool.h"
 
 namespace py = pybind11;
 using namespace dipcc;
 
+namespace {
+
+// Bind a Game method that modifies the game. ThreadPool batches run without
+// the GIL, so fail rather than race with a batch that holds the game.
+template <typename R, typename... Args>
+auto unheld(R (Game::*f)(Args...)) {
+  return [f](Game &game, Args... args) {
+    game.check_not_held();
+    return (game.*f)(std::forward<Args>(args)...);
+  };
+}
+
+// Like py::gil_scoped_release, but traces the time spent without the GIL and
+// reacquiring it
+class TracedGilRelease {
+public:
+  TracedGilRelease() : enabled_(get_tracing_enabled()) {
+    if (enabled_) {
+      start_us_ = trace_now_us();
+    }
+    release_.emplace();
+  }
+
+  ~TracedGilRelease() {
+    if (!enabled_) {
+      return;
+    }
+    double released_us = trace_now_us();
+    release_.reset();
+    add_trace_event("gil_released", "gil", start_us_, released_us);
+    add_trace_event("gil_acquire", "gil", released_us, trace_now_us());
+  }
+
+private:
+  bool enabled_;
+  double start_us_ = 0;
+  std::optional<py::gil_scoped_release> release_;
+};
+
+// Wrap a Python model, run by ModelBatcher's worker thread with the GIL
+InferenceFn py_inference_fn(py::function infer) {
+  // Deleted with the GIL held
+  auto infer_ptr = std::shared_ptr<py::function>(
+      new py::function(std::move(infer)), [](py::function *f) {
+        py::gil_scoped_acquire gil;
+        delete f;
+      });
+  return [infer_ptr](const TensorDict &x, bool values_only) {
+    py::gil_scoped_acquire gil;
+    py::tuple y = (*infer_ptr)(x, values_only);
+    ModelOutput r;
+    if (!y[0].is_none()) {
+      r.order_idxs = y[0].cast<torch::Tensor>();
+    }
+    if (!y[1].is_none()) {
+      r.values = y[1].cast<torch::Tensor>();
+    }
+    return r;
+  };
+}
+
+py::dict py_get_perf_stats() {
+  std::vector<PerfCounterStats> stats = get_perf_stats();
+  py::dict r;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    py::dict d;
+    d["count"] = stats[i].count;
+    d["total_ns"] = stats[i].total_ns;
+    d["max_ns"] = stats[i].max_ns;
+    d["histogram"] = std::vector<uint64_t>(stats[i].histogram.begin(),
+                                           stats[i].histogram.end());
+    r[perf_counter_name(static_cast<PerfCounter>(i))] = d;
+  }
+  return r;
+}
+
+} // namespace
+
 PYBIND11_MODULE(pydipcc, m) {
   // class Game
   py::class_<Game>(m, "Game")
       .def(py::init<int>(), py::arg("draw_on_stalemate_years") = -1)
       .def(py::init<const Game &>())
-      .def("process", &Game::process)
-      .def("set_orders", &Game::set_orders)
+      .def("process", unheld(py::overload_cast<>(&Game::process)))
+      .def("try_process", unheld(&Game::try_process),
+           "Same as process(), but return a ProcessStatus instead of raising, "
+           "leaving the game unprocessed unless OK")
+      .def("set_orders",
+           unheld(py::overload_cast<const std::string &,
+                                    const std::vector<std::string> &>(
+               &Game::set_orders)))
       .def("get_state", &Game::py_get_state, py::return_value_policy::move)
       .def("get_all_possible_orders", &Game::py_get_all_possible_orders)
       // Returns a dict power -> list of orderable locations. The list will be
@@ -34,6 +139,68 @@ PYBIND11_MODULE(pydipcc, m) {
       .def("get_orderable_locations", &Game::py_get_orderable_locations)
       .def("to_json", &Game::to_json)
       .def("from_json", &Game::from_json)
+      .def_static("from_json_lazy", &Game::from_json_lazy, py::arg("s"),
+                  py::arg("n_phases") = 2)
+      .def(
+          "to_bytes",
+          [](Game &game, bool messages, bool logs, bool full_history) {
+            return py::bytes(
+                game.to_bytes(GameBytesOptions{messages, logs, full_history}));
+          },
+          py::arg("messages") = true, py::arg("logs") = true,
+          py::arg("full_history") = true,
+          "If not full_history, only the history kept in rollout mode")
+      .def_static("from_bytes", &Game::from_bytes, py::arg("data"))
+      .def(
+          "set_pickle_options",
+          [](Game &game, bool messages, bool logs, bool full_history) {
+            game.set_pickle_options(
+                GameBytesOptions{messages, logs, full_history});
+          },
+          py::arg("messages") = true, py::arg("logs") = true,
+          py::arg("full_history") = true,
+          "Set the to_bytes options used when pickling the game, e.g. to "
+          "send it to another process without its messages")
+      .def(py::pickle(
+          [](Game &game) {
+            const GameBytesOptions &options = game.get_pickle_options();
+            std::string bytes = game.to_bytes(options);
+            return py::make_tuple(
+                py::bytes(bytes), game.get_draw_on_stalemate_years(),
+                game.get_exception_on_convoy_paradox(),
+                game.get_lazy_possible_orders(),
+                game.get_evict_old_possible_orders(), game.get_rollout_mode(),
+                py::make_tuple(options.messages, options.logs,
+                               options.full_history));
+          },
+          [](py::tuple t) {
+            JCHECK(t.size() == 7, "Game: bad pickle state");
+            Game game = Game::from_bytes(t[0].cast<std::string>());
+            game.set_draw_on_stalemate_years(t[1].cast<int>());
+            if (t[2].cast<bool>()) {
+              game.set_exception_on_convoy_paradox();
+            }
+            game.set_lazy_possible_orders(t[3].cast<bool>());
+            game.set_evict_old_possible_orders(t[4].cast<bool>());
+            game.set_rollout_mode(t[5].cast<bool>());
+            auto options = t[6].cast<std::tuple<bool, bool, bool>>();
+            game.set_pickle_options(GameBytesOptions{std::get<0>(options),
+                                                     std::get<1>(options),
+                                                     std::get<2>(options)});
+            return game;
+          }))
+      .def_static(
+          "from_buffer",
+          [](py::buffer data) {
+            py::buffer_info info = data.request();
+            JCHECK(info.ndim == 1 && info.strides[0] == info.itemsize,
+                   "Game.from_buffer requires a contiguous buffer");
+            return Game::from_bytes(std::string_view(
+                static_cast<const char *>(info.ptr), info.size * info.itemsize));
+          },
+          py::arg("data"),
+          "Like from_bytes, but reads any contiguous buffer, e.g. a shared "
+          "memory segment, without copying it")
       .def("get_phase_history", &Game::get_phase_history,
            py::return_value_policy::move)
       .def("get_phase_data", &Game::get_phase_data,
@@ -43,16 +210,20 @@ PYBIND11_MODULE(pydipcc, m) {
       .def_property_readonly("messages", &Game::py_get_messages,
                              py::return_value_policy::move)
       .def("get_logs", &Game::py_get_logs, py::return_value_policy::move)
-      .def("add_log", &Game::add_log)
-      .def("add_message", &Game::py_add_message, py::arg("sender"),
+      .def("add_log", unheld(&Game::add_log))
+      .def("add_message", unheld(&Game::py_add_message), py::arg("sender"),
            py::arg("recipient"), py::arg("body"),
            py::arg_v("time_sent", 0,
                      "Time sent, in micros since epoch. Default 0 means use "
                      "current system time"))
       .def("rolled_back_to_phase_start", &Game::rolled_back_to_phase_start)
       .def("rolled_back_to_phase_end", &Game::rolled_back_to_phase_end)
+      .def("rollback_to_phase_start", unheld(&Game::rollback_to_phase_start))
+      .def("rollback_to_phase_end", unheld(&Game::rollback_to_phase_end))
+      .def("snapshot", &Game::snapshot)
+      .def("restore", unheld(&Game::restore))
       .def("rollback_messages_to_timestamp",
-           &Game::rollback_messages_to_timestamp)
+           unheld(&Game::rollback_messages_to_timestamp))
       .def_property_readonly("is_game_done", &Game::is_game_done)
       .def_property_readonly("phase", &Game::get_phase_long)
       .def_property_readonly("current_short_phase", &Game::get_phase_short)
@@ -64,12 +235,56 @@ PYBIND11_MODULE(pydipcc, m) {
       .def("get_units", &py_game_get_units,
            py::return_value_policy::move) // mila compat
       .def("get_square_scores", &Game::get_square_scores)
+      .def(
+          "get_sos_targets",
+          [](Game &game, float value_decay_alpha) {
+            long n = game.get_state_history().size();
+            torch::Tensor r = torch::empty({n, 7}, torch::kFloat32);
+            game.write_sos_targets(value_decay_alpha, r.data_ptr<float>());
+            return r;
+          },
+          py::arg("value_decay_alpha"),
+          "Return the [phases, 7] value targets of the get_phase_history "
+          "phases, as encode_weighted_sos_scores in dataset.py")
+      .def(
+          "get_unit_arrays",
+          [](Game &game) { return py_unit_arrays(game.get_state()); },
+          "Return int8 arrays [81] indexed like LOCS (unit_types, "
+          "unit_owners): 0 for armies and 1 for fleets, and the owner's power "
+          "idx, -1 where there is no unit. Dislodged units are not included.")
+      .def(
+          "get_center_owners",
+          [](Game &game) { return py_center_owners(game.get_state()); },
+          "Return an int8 array [34] of the owner's power idx of each of "
+          "SC_LOCS, -1 if unowned")
+      .def("memory_usage", &Game::memory_usage,
+           "Approximate bytes used, as a dict component -> bytes")
       .def("clear_old_all_possible_orders",
-           &Game::clear_old_all_possible_orders)
+           unheld(&Game::clear_old_all_possible_orders))
       .def("set_exception_on_convoy_paradox",
-           &Game::set_exception_on_convoy_paradox)
+           unheld(&Game::set_exception_on_convoy_paradox))
       .def("compute_board_hash", &Game::compute_board_hash)
-      .def("set_draw_on_stalemate_years", &Game::set_draw_on_stalemate_years)
+      .def("stable_board_hash", &Game::stable_board_hash,
+           "Board hash that is the same on every machine, see "
+           "GameState::stable_board_hash")
+      .def("set_draw_on_stalemate_years",
+           unheld(&Game::set_draw_on_stalemate_years))
+      .def("set_lazy_possible_orders", unheld(&Game::set_lazy_possible_orders),
+           py::arg("lazy"))
+      .def("set_evict_old_possible_orders",
+           unheld(&Game::set_evict_old_possible_orders), py::arg("evict"),
+           "If set, the default, process() frees the possible orders of past "
+           "states other than the last movement phase")
+      .def("get_evict_old_possible_orders",
+           &Game::get_evict_old_possible_orders)
+      .def("compact_history", unheld(&Game::compact_history),
+           py::arg("keyframe_interval") =
+               CompactStates::DEFAULT_KEYFRAME_INTERVAL,
+           "Keep the states before the last movement phase delta-encoded, "
+           "decoding them again on access to the whole history")
+      .def("set_rollout_mode", unheld(&Game::set_rollout_mode),
+           py::arg("rollout_mode"))
+      .def("get_rollout_mode", &Game::get_rollout_mode)
       .def("get_alive_powers",
            [](Game &game) {
              const auto scores = game.get_square_scores();
@@ -105,23 +320,669 @@ PYBIND11_MODULE(pydipcc, m) {
       });
 
   // class PhaseData
+  py::class_<GameSnapshot>(m, "GameSnapshot");
+
+  py::enum_<ProcessStatus>(m, "ProcessStatus")
+      .value("OK", ProcessStatus::OK)
+      .value("CONVOY_PARADOX", ProcessStatus::CONVOY_PARADOX)
+      .value("ERROR", ProcessStatus::ERROR);
+
   py::class_<PhaseData>(m, "PhaseData")
       .def_property_readonly("name", &PhaseData::get_name)
       .def_property_readonly("state", &PhaseData::py_get_state)
       .def_property_readonly("orders", &PhaseData::py_get_orders)
       .def_property_readonly("messages", &PhaseData::py_get_messages)
+      .def("get_unit_arrays",
+           [](PhaseData &phase) { return py_unit_arrays(phase.get_state()); })
+      .def("get_center_owners",
+           [](PhaseData &phase) { return py_center_owners(phase.get_state()); })
       .def("to_dict", &PhaseData::to_dict);
 
+  // class StateView
+  py::class_<StateView>(m, "StateView",
+                        "Read-only dict-like game state, whose fields are "
+                        "built on first access")
+      .def("__getitem__", &StateView::get)
+      .def("__contains__", &StateView::contains)
+      .def("__len__", [](StateView &) { return std::size(STATE_DICT_KEYS); })
+      .def("__iter__",
+           [](StateView &) {
+             return py::iter(py::cast(std::vector<std::string>(
+                 std::begin(STATE_DICT_KEYS), std::end(STATE_DICT_KEYS))));
+           })
+      .def("keys",
+           [](StateView &) {
+             return std::vector<std::string>(std::begin(STATE_DICT_KEYS),
+                                             std::end(STATE_DICT_KEYS));
+           })
+      .def("values",
+           [](StateView &view) {
+             py::list r;
+             for (const char *key : STATE_DICT_KEYS) {
+               r.append(view.get(key));
+             }
+             return r;
+           })
+      .def("items",
+           [](StateView &view) {
+             py::list r;
+             for (const char *key : STATE_DICT_KEYS) {
+               r.append(py::make_tuple(key, view.get(key)));
+             }
+             return r;
+           })
+      .def(
+          "get",
+          [](StateView &view, const std::string &key, py::object default_) {
+            try {
+              return view.get(key);
+            } catch (py::key_error &) {
+              return default_;
+            }
+          },
+          py::arg("key"), py::arg("default") = py::none())
+      .def("to_dict", &StateView::to_dict)
+      .def(
+          "memory_usage",
+          [](StateView &view) { return view.get_state().memory_usage(); },
+          "Approximate bytes used by the state, as a dict component -> bytes")
+      .def("__repr__", [](StateView &view) {
+        return "StateView(" + view.get_state().get_phase().to_string() + ")";
+      });
+
+  // ThreadPool priorities
+  py::enum_<BoardStateFormat>(m, "BoardStateFormat")
+      .value("FLOAT32", BoardStateFormat::FLOAT32)
+      .value("FLOAT16", BoardStateFormat::FLOAT16)
+      .value("BFLOAT16", BoardStateFormat::BFLOAT16)
+      .value("UINT8", BoardStateFormat::UINT8)
+      .value("PACKED", BoardStateFormat::PACKED);
+  m.def(
+      "unpack_board_state",
+      [](const torch::Tensor &field) { return unpack_board_state(field); },
+      py::arg("field"),
+      "Return an x_board_state or x_prev_state field of any BoardStateFormat "
+      "as [..., 35] float32, on its device");
+  m.def(
+      "expand_prev_state_delta",
+      [](TensorDict fields) {
+        expand_prev_state_delta(fields);
+        return fields;
+      },
+      py::arg("fields"),
+      "Return the fields of a prev state delta encoding with the full "
+      "x_prev_state, computed on their device");
+
+  py::enum_<PlayoutPolicy>(m, "PlayoutPolicy")
+      .value("RANDOM", PlayoutPolicy::RANDOM)
+      .value("HEURISTIC", PlayoutPolicy::HEURISTIC);
+  m.def(
+      "generate_game",
+      [](uint64_t seed, int n_phases, PlayoutPolicy policy, float convoy_rate,
+         float attack_rate) {
+        return generate_game({policy, n_phases, convoy_rate, attack_rate},
+                             seed);
+      },
+      py::arg("seed"), py::arg("n_phases") = 100,
+      py::arg("policy") = PlayoutPolicy::HEURISTIC,
+      py::arg("convoy_rate") = 0, py::arg("attack_rate") = 0,
+      py::call_guard<TracedGilRelease>(),
+      "Return a reproducible game of legal orders played for n_phases with a "
+      "native policy, where each fleet convoys with chance convoy_rate and "
+      "each unit next to another power's attacks with chance attack_rate");
+  py::enum_<ThreadPoolPriority>(m, "ThreadPoolPriority")
+      .value("INTERACTIVE", ThreadPoolPriority::INTERACTIVE)
+      .value("BULK", ThreadPoolPriority::BULK);
+  m.def("set_thread_pool_priority", &set_thread_pool_priority,
+        py::arg("priority"),
+        "Set the priority of the ThreadPool batches submitted by the calling "
+        "thread. Returns the previous priority.");
+  m.def("get_thread_pool_priority", &get_thread_pool_priority);
+  m.def(
+      "set_loc_orders_cache_capacity",
+      [](size_t capacity) {
+        LocOrdersCache::get_global().set_capacity(capacity);
+      },
+      py::arg("capacity"),
+      "Memoize the M-phase possible orders (and their order vocab idxs) of "
+      "units by neighbourhood, for up to about capacity neighbourhoods, "
+      "process-wide. 0, the default, disables the cache.");
+  m.def("get_loc_orders_cache_stats", []() {
+    LocOrdersCache &cache = LocOrdersCache::get_global();
+    return std::map<std::string, uint64_t>{{"size", cache.size()},
+                                           {"hits", cache.get_hits()},
+                                           {"misses", cache.get_misses()}};
+  });
+
+  // class OrdersEncoder
+  py::class_<OrdersEncoder, std::shared_ptr<OrdersEncoder>>(m, "OrdersEncoder")
+      .def(py::init<std::unordered_map<std::string, int>, int>(),
+           py::arg("order_vocabulary_to_idx"), py::arg("max_order_cands"))
+      .def("to_bytes",
+           [](const OrdersEncoder &encoder) {
+             return py::bytes(encoder.to_bytes());
+           })
+      .def_static("from_bytes", &OrdersEncoder::from_bytes, py::arg("data"),
+                  "Load an encoder saved with to_bytes, much faster than "
+                  "building it from the vocabulary")
+      .def("get_max_cands", &OrdersEncoder::get_max_cands);
+
   // class ThreadPool
   py::class_<ThreadPool, std::shared_ptr<ThreadPool>>(m, "ThreadPool")
-      .def(py::init<size_t, std::unordered_map<std::string, int>, int>())
-      .def("process_multi", &ThreadPool::process_multi)
-      .def("encode_inputs_multi", &py_thread_pool_encode_inputs_multi)
+      .def(py::init<size_t, std::unordered_map<std::string, int>, int, bool>(),
+           py::arg("n_threads"), py::arg("order_vocabulary_to_idx"),
+           py::arg("max_order_cands"), py::arg("pin_threads") = false,
+           "If pin_threads, pin workers to CPUs in per-NUMA-node groups")
+      .def(py::init([](size_t n_threads,
+                       std::shared_ptr<OrdersEncoder> orders_encoder,
+                       bool pin_threads) {
+             return std::make_shared<ThreadPool>(n_threads, orders_encoder,
+                                                 pin_threads);
+           }),
+           py::arg("n_threads"), py::arg("orders_encoder"),
+           py::arg("pin_threads") = false,
+           "Share orders_encoder with other pools instead of building one")
+      .def("process_multi", &ThreadPool::process_multi, py::arg("games"),
+           py::arg("share_identical") = true,
+           py::call_guard<TracedGilRelease>(),
+           "Process games in place. Games with equal states and staged orders "
+           "are adjudicated once if share_identical.")
+      .def("try_process_multi", &ThreadPool::try_process_multi,
+           py::arg("games"), py::arg("share_identical") = true,
+           py::call_guard<TracedGilRelease>(),
+           "Same as process_multi, but return one ProcessStatus per game "
+           "instead of raising, so that one failed game does not fail the "
+           "others")
+      .def("process_many", &ThreadPool::process_many, py::arg("game"),
+           py::arg("orders"), py::call_guard<TracedGilRelease>(),
+           "Return one processed copy of game per dict of power -> orders")
+      .def("clone_multi", &ThreadPool::clone_multi, py::arg("game"),
+           py::arg("n"), py::call_guard<TracedGilRelease>(),
+           py::return_value_policy::move, "Return n copies of game")
+      .def("encode_inputs_multi", &py_thread_pool_encode_inputs_multi,
+           py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_powers_multi",
+           &py_thread_pool_encode_inputs_powers_multi, py::arg("games"),
+           py::arg("powers"), py::call_guard<TracedGilRelease>(),
+           "Like encode_inputs_multi, with the candidates of these powers "
+           "only: x_possible_actions [B, k, 17, 469], x_loc_idxs [B, k, 81]")
+      .def("encode_inputs_repeated", &ThreadPool::encode_inputs_repeated,
+           py::arg("game"), py::arg("n"), py::call_guard<TracedGilRelease>(),
+           "Encode game once, as n read-only expanded rows")
       .def("encode_inputs_all_powers_multi",
-           &py_thread_pool_encode_inputs_all_powers_multi)
+           &py_thread_pool_encode_inputs_all_powers_multi,
+           py::call_guard<TracedGilRelease>())
       .def("encode_inputs_state_only_multi",
-           &py_thread_pool_encode_inputs_state_only_multi)
-      .def("decode_order_idxs", &py_decode_order_idxs);
+           &py_thread_pool_encode_inputs_state_only_multi,
+           py::call_guard<TracedGilRelease>())
+      .def("process_multi_async", &ThreadPool::process_multi_async,
+           py::arg("games"), py::arg("share_identical") = true,
+           py::keep_alive<0, 1>(), py::keep_alive<0, 2>(),
+           py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_multi_async",
+           &ThreadPool::encode_inputs_multi_async, py::keep_alive<0, 1>(),
+           py::keep_alive<0, 2>(), py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_all_powers_multi_async",
+           &ThreadPool::encode_inputs_all_powers_multi_async,
+           py::keep_alive<0, 1>(), py::keep_alive<0, 2>(),
+           py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_state_only_multi_async",
+           &ThreadPool::encode_inputs_state_only_multi_async,
+           py::keep_alive<0, 1>(), py::keep_alive<0, 2>(),
+           py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_multi_sparse",
+           &ThreadPool::encode_inputs_multi_sparse,
+           py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_all_powers_multi_sparse",
+           &ThreadPool::encode_inputs_all_powers_multi_sparse,
+           py::call_guard<TracedGilRelease>())
+      .def("playout_multi", &ThreadPool::playout_multi, py::arg("games"),
+           py::arg("policy"), py::arg("max_move_phases"), py::arg("seed") = 0,
+           py::call_guard<TracedGilRelease>(),
+           "Play games out in place with a native policy until done or "
+           "max_move_phases movement phases later. Returns the number of "
+           "phases processed.")
+      .def("set_orders_from_idxs", &ThreadPool::set_orders_from_idxs,
+           py::arg("games"), py::arg("order_idxs"),
+           py::call_guard<TracedGilRelease>(),
+           "Set orders from a [B, 7, S] tensor of model order idxs")
+      .def("step_and_encode_multi", &ThreadPool::step_and_encode_multi,
+           py::arg("games"), py::arg("order_idxs"),
+           py::call_guard<TracedGilRelease>(),
+           "Set orders from model order idxs, process, and encode each game")
+      .def("get_scores_multi", &ThreadPool::get_scores_multi,
+           py::arg("games"), py::call_guard<TracedGilRelease>(),
+           "[B, 3, 7] square scores, SC counts and alive masks")
+      .def("cat_pad_inputs", &ThreadPool::cat_pad_inputs, py::arg("xs"),
+           py::arg("pad_values"), py::call_guard<TracedGilRelease>(),
+           "torch.cat the fields of xs, padding those in pad_values to the "
+           "largest shape with their pad value")
+      .def("get_sos_targets_multi", &ThreadPool::get_sos_targets_multi,
+           py::arg("games"), py::arg("value_decay_alpha"),
+           py::call_guard<TracedGilRelease>(),
+           "[rows, 7] value targets of all phases of the games, one row per "
+           "get_phase_history phase, as Game.get_sos_targets")
+      .def("lookup_rollout_cache", &ThreadPool::lookup_rollout_cache,
+           py::arg("cache"), py::arg("games"),
+           py::call_guard<TracedGilRelease>(),
+           "Look up the results of rolling out the games' staged orders: "
+           "dict of [B, 2] int64 keys, [B] bool hits and [B, 7] values")
+      .def("encode_corpus_phases", &ThreadPool::encode_corpus_phases,
+           py::arg("corpus"), py::arg("phase_idxs"),
+           py::arg("all_powers") = false,
+           py::call_guard<TracedGilRelease>())
+      .def("encode_dataset_games", &ThreadPool::encode_dataset_games,
+           py::arg("corpus"), py::arg("game_idxs"),
+           py::arg("value_decay_alpha") = 1.0,
+           py::arg("only_with_min_final_score") = -1,
+           py::arg("exclude_n_holds") = -1,
+           py::call_guard<TracedGilRelease>(),
+           "Encode inputs and targets of all phases of the games, as "
+           "dataset.py's encode_game")
+      .def("dedup_corpus", &ThreadPool::dedup_corpus, py::arg("corpus"),
+           py::arg("game_idxs"), py::call_guard<TracedGilRelease>(),
+           "Index the phases of the games by position: dict of [rows] int64 "
+           "hashes, first_rows and counts (rows as in encode_dataset_games)")
+      .def("release_encoded_inputs", &ThreadPool::release_encoded_inputs,
+           py::arg("fields"),
+           "Reuse the tensors of an encode_inputs_* result in later calls")
+      .def("set_pin_memory", &ThreadPool::set_pin_memory,
+           py::arg("pin_memory"))
+      .def("set_board_state_format", &ThreadPool::set_board_state_format,
+           py::arg("format"),
+           "Format of the x_board_state and x_prev_state fields of later "
+           "encode_inputs_* calls")
+      .def("get_board_state_format", &ThreadPool::get_board_state_format)
+      .def("set_prev_state_delta", &ThreadPool::set_prev_state_delta,
+           py::arg("prev_state_delta"),
+           "Replace x_prev_state in later encode_inputs_* calls by its rows "
+           "that differ from x_board_state (see expand_prev_state_delta)")
+      .def("get_prev_state_delta", &ThreadPool::get_prev_state_delta)
+      .def("set_trim_seq_len", &ThreadPool::set_trim_seq_len,
+           py::arg("trim_seq_len"),
+           "Trim x_possible_actions and x_power of later dense encode_inputs_* "
+           "calls to the batch's longest sequence of orderable locations")
+      .def("get_trim_seq_len", &ThreadPool::get_trim_seq_len)
+      .def("set_inline_max_games", &ThreadPool::set_inline_max_games,
+           py::arg("inline_max_games"),
+           "Do batches of at most inline_max_games games on the calling "
+           "thread, without waking workers. 0 (the default) disables this.")
+      .def("get_inline_max_games", &ThreadPool::get_inline_max_games)
+      .def("set_spin_us", &ThreadPool::set_spin_us, py::arg("spin_us"),
+           "Poll for up to spin_us microseconds before sleeping, in idle "
+           "workers and callers waiting for a batch. 0 (the default) "
+           "disables this.")
+      .def("get_spin_us", &ThreadPool::get_spin_us)
+      .def("resize", &ThreadPool::resize, py::arg("n_threads"),
+           py::call_guard<TracedGilRelease>(),
+           "Change the number of active workers; surplus ones are parked")
+      .def("get_n_threads", &ThreadPool::get_n_threads)
+      .def("set_adaptive_sizing", &ThreadPool::set_adaptive_sizing,
+           py::arg("min_threads"), py::arg("max_threads"),
+           py::arg("interval_ms") = 100,
+           py::call_guard<TracedGilRelease>(),
+           "Resize the pool within [min_threads, max_threads] from its queue "
+           "depth and idle time. max_threads 0 stops this.")
+      .def("set_encoding_cache_capacity",
+           &ThreadPool::set_encoding_cache_capacity, py::arg("capacity"),
+           "Memoize encode_inputs_multi rows of up to capacity states")
+      .def("get_encoding_cache_hits", &ThreadPool::get_encoding_cache_hits)
+      .def("get_encoding_cache_misses",
+           &ThreadPool::get_encoding_cache_misses)
+      .def("get_memory_usage", &ThreadPool::get_memory_usage,
+           py::arg("games"),
+           "Approximate bytes used by games and the encoding cache, as a dict "
+           "component -> bytes. What games share is counted once.")
+      .def("save_encoding_cache", &ThreadPool::save_encoding_cache,
+           py::arg("path"),
+           "Save the encoding cache entries, e.g. of opening phases")
+      .def("load_encoding_book", &ThreadPool::load_encoding_book,
+           py::arg("path"),
+           "Load a save_encoding_cache file as entries that are never "
+           "evicted; returns their number")
+      .def("decode_order_idxs", &py_decode_order_idxs, py::arg("order_idxs"),
+           "Decode [B, 7, S] order idxs into lists of per-power order tuples "
+           "of shared, interned strs");
+
+  // class RolloutStopOptions, see run_rollouts
+  py::class_<RolloutStopOptions>(m, "RolloutStopOptions")
+      .def(py::init<>())
+      .def_readwrite("solo_centers", &RolloutStopOptions::solo_centers)
+      .def_readwrite("stalemate_years", &RolloutStopOptions::stalemate_years)
+      .def_readwrite("max_year", &RolloutStopOptions::max_year)
+      .def_readwrite("value_cutoff", &RolloutStopOptions::value_cutoff)
+      .def_readwrite("values", &RolloutStopOptions::values,
+                     "values(x: Dict[str, Tensor]) -> [B, 7] values");
+
+  // class GameBatch
+  py::class_<GameBatch>(m, "GameBatch")
+      .def(py::init<std::vector<Game>>(), py::arg("games"))
+      .def(py::init<ThreadPool &, Game &, size_t>(), py::arg("pool"),
+           py::arg("game"), py::arg("n"),
+           py::call_guard<TracedGilRelease>(),
+           "Make n copies of game in the pool's worker threads")
+      .def("__len__", &GameBatch::size)
+      .def("__getitem__", &GameBatch::at, py::arg("i"),
+           py::return_value_policy::reference_internal)
+      .def("__getitem__",
+           [](const GameBatch &batch, py::slice slice) {
+             size_t start, stop, step, slicelength;
+             if (!slice.compute(batch.size(), &start, &stop, &step,
+                                &slicelength)) {
+               throw py::error_already_set();
+             }
+             // Unsigned arithmetic wraps correctly for negative steps
+             std::vector<size_t> idxs(slicelength);
+             for (size_t i = 0; i < slicelength; ++i) {
+               idxs[i] = start + i * step;
+             }
+             return batch.select(idxs);
+           },
+           "Return a GameBatch of copies of the sliced games")
+      .def("select", &GameBatch::select, py::arg("idxs"),
+           "Return a GameBatch of copies of the games at idxs")
+      .def("set_orders_from_idxs", &GameBatch::set_orders_from_idxs,
+           py::arg("pool"), py::arg("order_idxs"),
+           py::call_guard<TracedGilRelease>())
+      .def("process", &GameBatch::process, py::arg("pool"),
+           py::call_guard<TracedGilRelease>(),
+           "Process the games that are not done")
+      .def("encode_inputs", &GameBatch::encode_inputs, py::arg("pool"),
+           py::call_guard<TracedGilRelease>())
+      .def("encode_inputs_all_powers", &GameBatch::encode_inputs_all_powers,
+           py::arg("pool"), py::call_guard<TracedGilRelease>())
+      .def("step_and_encode", &GameBatch::step_and_encode, py::arg("pool"),
+           py::arg("order_idxs"), py::call_guard<TracedGilRelease>())
+      .def("get_square_scores", &GameBatch::get_square_scores)
+      .def("get_is_done", &GameBatch::get_is_done)
+      .def(
+          "run_rollouts",
+          [](GameBatch &batch, ThreadPool &pool, int max_move_phases,
+             const RolloutPolicy &policy, const RolloutStopOptions &stop) {
+            return run_rollouts(pool, batch.get_game_ptrs(), max_move_phases,
+                                policy, stop);
+          },
+          py::arg("pool"), py::arg("max_move_phases"), py::arg("policy"),
+          py::arg("stop") = RolloutStopOptions(),
+          py::call_guard<TracedGilRelease>(), "See pydipcc.run_rollouts")
+      .def("get_scores", &GameBatch::get_scores, py::arg("pool"),
+           py::call_guard<TracedGilRelease>(),
+           "[B, 3, 7] square scores, SC counts and alive masks");
+
+  // class GameCorpus
+  py::class_<GameCorpus>(m, "GameCorpus")
+      .def(py::init<const std::string &>(), py::arg("path"))
+      .def_static("write", &GameCorpus::write, py::arg("path"),
+                  py::arg("games"))
+      .def("get_n_games", &GameCorpus::get_n_games)
+      .def("get_n_phases", &GameCorpus::get_n_phases)
+      .def("get_phase_range", &GameCorpus::get_phase_range,
+           py::arg("game_i"), "Return the [first, end) corpus phases of a game")
+      .def("get_game_and_phase", &GameCorpus::get_game_and_phase,
+           py::arg("phase_i"))
+      .def("get_game", &GameCorpus::get_game, py::arg("game_i"))
+      .def("get_phase", &GameCorpus::get_phase, py::arg("phase_i"),
+           "Return the game rolled back to the start of a corpus phase");
+
+  // class ReplayBuffer
+  py::class_<ReplayBuffer>(m, "ReplayBuffer")
+      .def(py::init<const std::string &, size_t, const TensorDict &>(),
+           py::arg("path"), py::arg("capacity"), py::arg("example"),
+           "Create a buffer at path with the fields of example [n, ...] rows")
+      .def(py::init<const std::string &>(), py::arg("path"),
+           "Attach to the buffer created at path")
+      .def("append", &ReplayBuffer::append, py::arg("rows"),
+           py::call_guard<TracedGilRelease>(),
+           "Append [n, ...] rows, returning the append index of the first")
+      .def("sample", &ReplayBuffer::sample, py::arg("batch_size"),
+           py::arg("prioritized") = false, py::arg("pin_memory") = false,
+           py::call_guard<TracedGilRelease>())
+      .def("set_priorities", &ReplayBuffer::set_priorities, py::arg("idxs"),
+           py::arg("priorities"), py::call_guard<TracedGilRelease>())
+      .def("seed", &ReplayBuffer::seed, py::arg("seed"))
+      .def("get_capacity", &ReplayBuffer::get_capacity)
+      .def("get_n_appended", &ReplayBuffer::get_n_appended)
+      .def("get_field_names", &ReplayBuffer::get_field_names)
+      .def("__len__", &ReplayBuffer::size);
+
+  // CFR kernels
+  py::enum_<SimdLevel>(m, "SimdLevel")
+      .value("SCALAR", SimdLevel::SCALAR)
+      .value("AVX2", SimdLevel::AVX2)
+      .value("AVX512", SimdLevel::AVX512);
+  m.def("get_max_simd_level", &get_max_simd_level);
+  m.def("get_simd_level", &get_simd_level);
+  m.def("set_simd_level", &set_simd_level, py::arg("level"),
+        "Use at most level for the CFRSolver kernels. Returns the level in "
+        "use.");
+
+  // class CFRSolver
+  py::class_<CFRSolver>(m, "CFRSolver")
+      .def(py::init<const std::vector<std::vector<float>> &, bool,
+                    uint64_t>(),
+           py::arg("bp_probs"), py::arg("optimistic"), py::arg("seed"),
+           "bp_probs: per power in POWERS order, the unnormalized blueprint "
+           "probs of its plausible actions. seed seeds the sampling of joint "
+           "actions, e.g. from the caller's RNG.")
+      .def("get_n_actions", &CFRSolver::get_n_actions, py::arg("power"))
+      .def("get_action_idxs", &CFRSolver::get_action_idxs, py::arg("power"),
+           "Original positions of the power's remaining (unpruned) actions")
+      .def("get_iter", &CFRSolver::get_iter)
+      .def("get_iter_weight", &CFRSolver::get_iter_weight)
+      .def("start_iter", &CFRSolver::start_iter,
+           "Apply the linear CFR discount and return the iteration weight")
+      .def("strategy", &CFRSolver::strategy, py::arg("power"))
+      .def("avg_strategy", &CFRSolver::avg_strategy, py::arg("power"))
+      .def("bp_strategy", &CFRSolver::bp_strategy, py::arg("power"),
+           py::arg("temperature") = 1.0)
+      .def("avg_action_utilities", &CFRSolver::avg_action_utilities,
+           py::arg("power"))
+      .def("avg_utility", &CFRSolver::avg_utility, py::arg("power"))
+      .def("sample", &CFRSolver::sample, py::arg("use_bp"),
+           "Sample an action position per power (-1 if it has no actions), "
+           "from the blueprint where use_bp[power] else the current strategy")
+      .def("get_sampled", &CFRSolver::get_sampled)
+      .def("get_joint_action_idxs", &CFRSolver::get_joint_action_idxs,
+           "Per power and action, the sampled action positions with the "
+           "power's own replaced")
+      .def("update", &CFRSolver::update, py::arg("utilities"),
+           "Update from utilities[i][power], the values of the joint actions "
+           "of get_joint_action_idxs(). Returns the state utility per power.")
+      .def("prune", &CFRSolver::prune, py::arg("ave_regret_thresh"),
+           py::arg("ave_strat_thresh"),
+           "Remove dominated actions, returning their (power, original "
+           "position)");
+
+  // exploitability
+  py::class_<NashConvResult>(m, "NashConvResult")
+      .def_readonly("nash_conv", &NashConvResult::nash_conv)
+      .def_readonly("values", &NashConvResult::values)
+      .def_readonly("br_values", &NashConvResult::br_values)
+      .def_readonly("action_values", &NashConvResult::action_values);
+  m.def("compute_nash_conv", &compute_nash_conv, py::arg("strategies"),
+        py::arg("n_samples"), py::arg("values_fn"), py::arg("max_rows"),
+        py::arg("seed"),
+        "Estimate the exploitability of strategies[power][action] over "
+        "n_samples sampled profiles, with an RNG seeded by seed. "
+        "values_fn(joint_idxs) is called with batches of joint actions, as "
+        "action positions per power, and must return the [len(joint_idxs), "
+        "7] values of each, in batches of at most max_rows (0: one batch).");
+
+  // Order sampling
+  m.def(
+      "sample_orders",
+      [](torch::Tensor logits, torch::Tensor x_possible_actions,
+         torch::Tensor x_in_adj_phase, float temperature, float top_p,
+         std::optional<uint64_t> seed) {
+        std::mt19937 rng(seed ? *seed : std::random_device()());
+        SampledOrders r = sample_orders(logits, x_possible_actions,
+                                        x_in_adj_phase, temperature, top_p, rng);
+        return std::make_tuple(r.order_idxs, r.logprobs, r.action_hashes);
+      },
+      py::arg("logits"), py::arg("x_possible_actions"),
+      py::arg("x_in_adj_phase"), py::arg("temperature") = 1.0,
+      py::arg("top_p") = 1.0, py::arg("seed") = py::none(),
+      py::call_guard<TracedGilRelease>(),
+      "Sample an order per step from [B, 7, S, C] logits, without duplicate "
+      "disbands. Returns the [B, 7, S] order idxs, [B, 7] logprobs and [B, 7] "
+      "action hashes.");
+  m.def(
+      "resample_duplicate_disbands",
+      [](torch::Tensor order_idxs, torch::Tensor logits,
+         torch::Tensor x_possible_actions, torch::Tensor x_in_adj_phase,
+         std::optional<uint64_t> seed) {
+        std::mt19937 rng(seed ? *seed : std::random_device()());
+        resample_duplicate_disbands(order_idxs, logits, x_possible_actions,
+                                    x_in_adj_phase, rng);
+      },
+      py::arg("order_idxs"), py::arg("logits"), py::arg("x_possible_actions"),
+      py::arg("x_in_adj_phase"), py::arg("seed") = py::none(),
+      py::call_guard<TracedGilRelease>(),
+      "Resample the [B, 7, S] order_idxs of powers disbanding several units "
+      "in place, without duplicates");
+
+  // Plausible orders
+  m.def(
+      "are_supports_coordinated",
+      [](const std::vector<std::string> &orders) {
+        std::vector<Order> parsed(orders.begin(), orders.end());
+        return are_supports_coordinated(parsed);
+      },
+      py::arg("orders"),
+      "Return False if any supports or convoys of a power's orders are not "
+      "coordinated with its other orders");
+  py::class_<PlausibleOrdersCounter>(m, "PlausibleOrdersCounter")
+      .def(py::init([](const ThreadPool &pool) {
+             return std::make_unique<PlausibleOrdersCounter>(
+                 pool.get_orders_encoder());
+           }),
+           py::arg("pool"), py::keep_alive<1, 2>())
+      .def("add", &PlausibleOrdersCounter::add, py::arg("order_idxs"),
+           py::arg("logprobs"), py::call_guard<TracedGilRelease>(),
+           "Count the [B, 7, S] order_idxs sampled with [B, 7] logprobs")
+      .def("get_n_samples", &PlausibleOrdersCounter::get_n_samples)
+      .def("get_n_unique", &PlausibleOrdersCounter::get_n_unique,
+           py::arg("power"))
+      .def(
+          "get_plausible_orders",
+          [](const PlausibleOrdersCounter &counter, int power, int limit,
+             std::optional<int> exclude_n_holds) {
+            auto actions =
+                counter.get_plausible_actions(power, limit, exclude_n_holds);
+            py::list r;
+            for (auto &action : actions) {
+              r.append(py::make_tuple(py::tuple(py::cast(action.orders)),
+                                      action.count, action.logprob));
+            }
+            return r;
+          },
+          py::arg("power"), py::arg("limit"),
+          py::arg("exclude_n_holds") = py::none(),
+          "Return the power's limit most likely (orders, count, logprob), "
+          "filtered as BaseSearchAgent.is_plausible_orders if it has more");
+
+  // class RolloutCache
+  py::class_<RolloutCache, std::shared_ptr<RolloutCache>>(m, "RolloutCache")
+      .def(py::init<size_t, size_t>(), py::arg("capacity"),
+           py::arg("n_shards") = 16)
+      .def("get_multi", &RolloutCache::get_multi, py::arg("game"),
+           py::arg("orders"),
+           "Return per dict of power -> orders the cached values, or None")
+      .def("put",
+           [](RolloutCache &cache, const Game &game,
+              const PowerOrderStrs &orders,
+              const RolloutCache::Values &values) {
+             cache.put(game, orders, values);
+           },
+           py::arg("game"), py::arg("orders"), py::arg("values"))
+      .def("put_multi",
+           [](RolloutCache &cache, torch::Tensor keys, torch::Tensor values) {
+             JCHECK(keys.dim() == 2 && keys.size(1) == 2 &&
+                        values.dim() == 2 && values.size(1) == 7 &&
+                        keys.size(0) == values.size(0),
+                    "put_multi expects [N, 2] keys and [N, 7] values");
+             auto k = keys.to(torch::kInt64).contiguous();
+             auto v = values.to(torch::kFloat32).contiguous();
+             std::vector<RolloutCache::Key> ks(k.size(0));
+             std::vector<RolloutCache::Values> vs(k.size(0));
+             for (long i = 0; i < k.size(0); ++i) {
+               const int64_t *kp = k.data_ptr<int64_t>() + i * 2;
+               ks[i] = {static_cast<uint64_t>(kp[0]),
+                        static_cast<uint64_t>(kp[1])};
+               std::copy_n(v.data_ptr<float>() + i * 7, 7, vs[i].begin());
+             }
+             cache.put_multi(ks, vs);
+           },
+           py::arg("keys"), py::arg("values"),
+           "Put values by ThreadPool.lookup_rollout_cache keys")
+      .def("__len__", &RolloutCache::size)
+      .def("get_capacity", &RolloutCache::get_capacity)
+      .def("get_hits", &RolloutCache::get_hits)
+      .def("get_misses", &RolloutCache::get_misses)
+      .def("clear", &RolloutCache::clear);
+
+  // class SearchStore
+  py::class_<SearchStore, std::shared_ptr<SearchStore>>(m, "SearchStore")
+      .def(py::init<size_t>(), py::arg("max_bytes"))
+      .def(
+          "get_plausible_orders",
+          [](SearchStore &store, const Game &game) -> py::object {
+            auto orders = store.get_plausible_orders(game.stable_board_hash());
+            if (orders == nullptr) {
+              return py::none();
+            }
+            py::dict r;
+            for (int i = 0; i < 7; ++i) {
+              py::dict actions;
+              for (auto &action : (*orders)[i]) {
+                actions[py::tuple(py::cast(action.first))] = action.second;
+              }
+              r[py::str(power_str(POWERS[i]))] = actions;
+            }
+            return r;
+          },
+          py::arg("game"),
+          "Return the dict of power -> {action: logprob} stored for the "
+          "game's board, or None")
+      .def(
+          "put_plausible_orders",
+          [](SearchStore &store, const Game &game,
+             const std::map<std::string,
+                            std::map<SearchStore::Action, float>> &orders) {
+            SearchStore::PlausibleOrders value;
+            for (auto & [ power_s, actions ] : orders) {
+              auto &power_actions =
+                  value[static_cast<int>(power_from_str(power_s)) - 1];
+              power_actions.assign(actions.begin(), actions.end());
+            }
+            store.put_plausible_orders(game.stable_board_hash(),
+                                       std::move(value));
+          },
+          py::arg("game"), py::arg("orders"))
+      .def("get_rollout_cache", &SearchStore::get_rollout_cache,
+           "The RolloutCache shared by the searches using the store")
+      .def("__len__", &SearchStore::size)
+      .def("get_bytes", &SearchStore::get_bytes)
+      .def("get_max_bytes", &SearchStore::get_max_bytes)
+      .def("get_hits", &SearchStore::get_hits)
+      .def("get_misses", &SearchStore::get_misses)
+      .def("clear", &SearchStore::clear);
+
+  // class ThreadPoolFuture
+  py::class_<ThreadPoolFuture>(m, "ThreadPoolFuture")
+      .def("wait", &ThreadPoolFuture::wait,
+           py::call_guard<TracedGilRelease>(),
+           "Block until done. Returns the encoded inputs for encode_* calls")
+      .def("done", &ThreadPoolFuture::done);
+
+  // Order of get_center_owners
+  m.attr("SC_LOCS") = py::cast([] {
+    std::vector<std::string> r;
+    for (Loc loc : SC_LOCS) {
+      r.push_back(loc_str(loc));
+    }
+    return r;
+  }());
 
   // encoding functions
   m.def("encode_board_state", &py_encode_board_state,
@@ -133,6 +994,122 @@ PYBIND11_MODULE(pydipcc, m) {
   m.def("encode_prev_orders", &py_encode_prev_orders,
         py::return_value_policy::move);
 
+  // class TorchScriptModel
+  py::class_<TorchScriptModel, std::shared_ptr<TorchScriptModel>>(
+      m, "TorchScriptModel")
+      .def(py::init<const std::string &, const std::string &>(),
+           py::arg("path"), py::arg("device") = "cpu")
+      .def(
+          "forward",
+          [](TorchScriptModel &model, const TensorDict &x, float temperature,
+             float top_p, bool values_only) {
+            ModelOutput y = model.forward(x, temperature, top_p, values_only);
+            return std::make_tuple(y.order_idxs, y.values);
+          },
+          py::arg("x"), py::arg("temperature"), py::arg("top_p"),
+          py::arg("values_only") = false, py::call_guard<TracedGilRelease>(),
+          "Return (order_idxs, values); order_idxs is None if values_only");
+
+  // class ModelBatcher
+  py::class_<ModelBatcher, std::shared_ptr<ModelBatcher>>(m, "ModelBatcher")
+      .def(py::init<std::shared_ptr<TorchScriptModel>, long, long, float,
+                    float>(),
+           py::arg("model"), py::arg("max_batch_size"),
+           py::arg("max_latency_us"), py::arg("temperature"),
+           py::arg("top_p"))
+      .def(py::init([](py::function infer, long max_batch_size,
+                       long max_latency_us) {
+             // Destroyed without the GIL: the batch being run needs it
+             return std::shared_ptr<ModelBatcher>(
+                 new ModelBatcher(py_inference_fn(infer), max_batch_size,
+                                  max_latency_us),
+                 [](ModelBatcher *batcher) {
+                   if (PyGILState_Check()) {
+                     py::gil_scoped_release release;
+                     delete batcher;
+                   } else {
+                     delete batcher;
+                   }
+                 });
+           }),
+           py::arg("infer"), py::arg("max_batch_size"),
+           py::arg("max_latency_us"),
+           "Batch requests for a Python model: infer(x, values_only) must "
+           "return (order_idxs, values), either of which may be None")
+      .def("submit", &ModelBatcher::submit, py::arg("x"),
+           py::arg("values_only") = false, py::call_guard<TracedGilRelease>(),
+           "Queue x and return a ModelFuture of its outputs")
+      .def(
+          "forward",
+          [](ModelBatcher &batcher, const TensorDict &x, bool values_only) {
+            ModelOutput y = batcher.forward(x, values_only);
+            return std::make_tuple(y.order_idxs, y.values);
+          },
+          py::arg("x"), py::arg("values_only") = false,
+          py::call_guard<TracedGilRelease>(),
+          "Return (order_idxs, values), batched with concurrent calls");
+
+  // class ModelFuture
+  py::class_<ModelFuture>(m, "ModelFuture")
+      .def(
+          "get",
+          [](ModelFuture &future) {
+            const ModelOutput &y = future.get();
+            return std::make_tuple(y.order_idxs, y.values);
+          },
+          py::call_guard<TracedGilRelease>(),
+          "Block until done and return (order_idxs, values)")
+      .def("done", [](ModelFuture &future) {
+        return future.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready;
+      });
+
+  // rollouts
+  m.def(
+      "run_rollouts",
+      [](ThreadPool &pool, std::vector<Game *> &games, int max_move_phases,
+         ModelBatcher &policy, const RolloutStopOptions &stop) {
+        return run_rollouts(pool, games, max_move_phases,
+                            policy.as_policy_values(), stop);
+      },
+      py::arg("pool"), py::arg("games"), py::arg("max_move_phases"),
+      py::arg("policy"), py::arg("stop") = RolloutStopOptions(),
+      py::call_guard<TracedGilRelease>(),
+      "Step games in place, like the overload below, with orders sampled "
+      "from the batcher's model in C++, without taking the GIL. The values "
+      "of the same model calls are used for stop.value_cutoff unless "
+      "stop.values is set.");
+  m.def("run_rollouts",
+        py::overload_cast<ThreadPool &, std::vector<Game *> &, int,
+                          const RolloutPolicy &, const RolloutStopOptions &>(
+            &run_rollouts),
+        py::arg("pool"), py::arg("games"), py::arg("max_move_phases"),
+        py::arg("policy"), py::arg("stop") = RolloutStopOptions(),
+        py::call_guard<TracedGilRelease>(),
+        "Step games in place until done, stopped early by stop (see "
+        "RolloutStopOptions), or max_move_phases movement phases later, "
+        "calling policy(x: Dict[str, Tensor]) -> [B, 7, S] order idxs once "
+        "per ply. Returns the number of plies.");
+
+  // perf stats
+  m.def("set_perf_stats_enabled", &set_perf_stats_enabled, py::arg("enabled"),
+        "Enable the hot-path timing counters, off by default");
+  m.def("get_perf_stats_enabled", &get_perf_stats_enabled);
+  m.def("get_perf_stats", &py_get_perf_stats,
+        "Dict of counter name -> {count, total_ns, max_ns, histogram}, summed "
+        "over threads. histogram[i] counts durations in [2^i, 2^(i+1)) ns.");
+  m.def("reset_perf_stats", &reset_perf_stats);
+
+  // tracing
+  m.def("set_tracing_enabled", &set_tracing_enabled, py::arg("enabled"),
+        "Record ThreadPool job, lock and GIL events, off by default");
+  m.def("get_tracing_enabled", &get_tracing_enabled);
+  m.def("get_trace_json", &get_trace_json,
+        "Recorded events, as a Chrome trace JSON string");
+  m.def("dump_trace", &dump_trace, py::arg("path"),
+        "Write the recorded events to path in the Chrome trace format");
+  m.def("clear_trace", &clear_trace);
+
   // Exceptions
   py::register_exception<ConvoyParadoxException>(m, "ConvoyParadoxException");
 }
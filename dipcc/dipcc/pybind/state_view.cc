@@ -0,0 +1,61 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <glog/logging.h>
+
+#include "../cc/game.h"
+#include "py_dict.h"
+#include "state_view.h"
+
+using namespace std;
+
+namespace dipcc {
+
+int StateView::key_idx(const std::string &key) {
+  for (int i = 0; i < std::size(STATE_DICT_KEYS); ++i) {
+    if (key == STATE_DICT_KEYS[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+py::object StateView::get(const std::string &key) {
+  int i = key_idx(key);
+  if (i < 0) {
+    throw py::key_error(key);
+  }
+  if (!cache_[i]) {
+    cache_[i] = py_state_field(*state_, key);
+  }
+  return cache_[i];
+}
+
+py::dict StateView::to_dict() {
+  py::dict d;
+  for (const char *key : STATE_DICT_KEYS) {
+    d[key] = get(key);
+  }
+  return d;
+}
+
+StateView Game::py_get_state() {
+  // DEBUGGING
+  if (state_->get_phase().phase_type == 'R') {
+    for (auto &p : state_->get_all_possible_orders()) {
+      if (state_->get_unit_rooted(p.first).type == UnitType::NONE) {
+        LOG(WARNING) << "Found weird case, logging crash dump: " << p.first;
+        this->crash_dump();
+      }
+    }
+  }
+  // !DEBUGGING
+
+  return StateView(state_);
+}
+
+} // namespace dipcc
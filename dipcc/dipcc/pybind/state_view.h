@@ -0,0 +1,50 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <iterator>
+#include <memory>
+#include <pybind11/pybind11.h>
+#include <string>
+
+#include "../cc/game_state.h"
+
+namespace py = pybind11;
+
+namespace dipcc {
+
+// Keys of the state dict, in py_state_to_dict order
+inline constexpr const char *STATE_DICT_KEYS[] = {
+    "builds", "centers", "homes", "name", "retreats", "units"};
+
+// Read-only, dict-like view of a GameState. Each field of py_state_to_dict is
+// only built when first accessed, then cached, so that e.g. view["name"]
+// neither builds the units dicts nor computes the possible orders.
+//
+// The GameState is shared, not copied: game states are not modified once
+// processed, apart from their possible orders caches.
+class StateView {
+public:
+  StateView(std::shared_ptr<GameState> state) : state_(state) {}
+
+  // Raises KeyError if key is not one of STATE_DICT_KEYS
+  py::object get(const std::string &key);
+  bool contains(const std::string &key) const { return key_idx(key) >= 0; }
+  py::dict to_dict();
+
+  const GameState &get_state() const { return *state_; }
+
+private:
+  static int key_idx(const std::string &key);
+
+  std::shared_ptr<GameState> state_;
+  std::array<py::object, std::size(STATE_DICT_KEYS)> cache_;
+};
+
+} // namespace dipcc
@@ -11,11 +11,13 @@ LICENSE file in the root directory of this source tree.
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <torch/torch.h>
+#include <unordered_map>
 #include <vector>
 
 #include "../cc/checks.h"
 #include "../cc/data_fields.h"
 #include "../cc/encoding.h"
+#include "../cc/perf_stats.h"
 
 namespace py = pybind11;
 
@@ -32,15 +34,106 @@ TensorDict py_thread_pool_encode_inputs_multi(ThreadPool *thread_pool,
   return thread_pool->encode_inputs_multi(games);
 }
 
+TensorDict py_thread_pool_encode_inputs_powers_multi(
+    ThreadPool *thread_pool, std::vector<Game *> &games,
+    const std::vector<std::string> &powers) {
+  std::vector<Power> powers_enum;
+  for (const std::string &power : powers) {
+    powers_enum.push_back(power_from_str(power));
+  }
+  return thread_pool->encode_inputs_powers_multi(games, powers_enum);
+}
+
 TensorDict
 py_thread_pool_encode_inputs_all_powers_multi(ThreadPool *thread_pool,
                                               std::vector<Game *> &games) {
   return thread_pool->encode_inputs_all_powers_multi(games);
 }
 
-std::vector<std::vector<std::vector<std::string>>>
-py_decode_order_idxs(ThreadPool *thread_pool, torch::Tensor *order_idxs) {
-  return thread_pool->get_orders_encoder().decode_order_idxs(order_idxs);
+// Interned order strings of each vocab idx of an OrdersEncoder, as a tuple
+// (compound build orders are split). Built once per encoder, on first
+// decode. Requires the GIL.
+const std::vector<py::tuple> &
+get_order_vocabulary_tuples(const OrdersEncoder &encoder) {
+  // Leaked so that the strings are not released after the interpreter
+  static auto *cache = new std::unordered_map<uint64_t, std::vector<py::tuple>>;
+  auto it = cache->find(encoder.get_id());
+  if (it != cache->end()) {
+    return it->second;
+  }
+  if (cache->size() >= 8) {
+    cache->clear(); // pools are rarely constructed: don't bother with LRU
+  }
+
+  const std::vector<std::string> &vocab = encoder.get_order_vocabulary();
+  std::vector<py::tuple> tuples;
+  tuples.reserve(vocab.size());
+  std::vector<py::str> parts;
+  for (const std::string &order : vocab) {
+    parts.clear();
+    for (size_t start = 0, end = 0; end != std::string::npos;
+         start = end + 1) {
+      end = order.find(';', start);
+      std::string part = order.substr(start, end - start);
+      parts.push_back(py::reinterpret_steal<py::str>(
+          PyUnicode_InternFromString(part.c_str())));
+    }
+    py::tuple t(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i) {
+      t[i] = parts[i];
+    }
+    tuples.push_back(std::move(t));
+  }
+  return cache->emplace(encoder.get_id(), std::move(tuples)).first->second;
+}
+
+// Decode a [B, 7, S]-shape tensor of EOS_IDX-padded order idxs into a list
+// (batch) of lists (power) of order tuples, as OrdersEncoder::
+// decode_order_idxs does, but sharing one interned str per vocab order
+// instead of building new strings.
+py::list py_decode_order_idxs(ThreadPool *thread_pool,
+                              torch::Tensor *order_idxs) {
+  const OrdersEncoder &encoder = thread_pool->get_orders_encoder();
+  const std::vector<py::tuple> &tuples = get_order_vocabulary_tuples(encoder);
+  torch::Tensor idxs = order_idxs->to(torch::kLong).contiguous();
+  JCHECK(idxs.dim() == 3 && idxs.size(1) == 7,
+         "decode_order_idxs: order_idxs must be [B, 7, S]");
+  long batch_size = idxs.size(0);
+  long max_seq_len = idxs.size(2);
+  const long *data = idxs.data_ptr<long>();
+
+  PerfTimer perf_timer(PerfCounter::DECODE_ORDER_IDXS);
+  py::list r(batch_size);
+  for (long b = 0; b < batch_size; ++b) {
+    py::list powers(7);
+    for (int p = 0; p < 7; ++p) {
+      const long *power_idxs = data + (b * 7 + p) * max_seq_len;
+      size_t n_orders = 0;
+      for (long i = 0; i < max_seq_len; ++i) {
+        long idx = power_idxs[i];
+        if (idx == OrdersEncoder::EOS_IDX) {
+          continue;
+        }
+        JCHECK(idx >= 0 && idx < static_cast<long>(tuples.size()),
+               "decode_order_idxs bad order idx");
+        n_orders += tuples[idx].size();
+      }
+      py::tuple orders(n_orders);
+      size_t j = 0;
+      for (long i = 0; i < max_seq_len; ++i) {
+        long idx = power_idxs[i];
+        if (idx == OrdersEncoder::EOS_IDX) {
+          continue;
+        }
+        for (auto order : tuples[idx]) {
+          orders[j++] = order;
+        }
+      }
+      powers[p] = std::move(orders);
+    }
+    r[b] = std::move(powers);
+  }
+  return r;
 }
 
 } // namespace dipcc
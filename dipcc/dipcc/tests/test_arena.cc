@@ -0,0 +1,62 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+#include "../cc/arena.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class ArenaTest : public ::testing::Test {};
+
+TEST_F(ArenaTest, TestResetByOutermostScope) {
+  EXPECT_THROW(thread_arena(), std::runtime_error);
+
+  const int *first;
+  {
+    ArenaScope scope;
+    pmr::vector<int> xs({1, 2, 3}, thread_arena());
+    first = xs.data();
+    {
+      ArenaScope nested;
+      pmr::vector<int> ys({4, 5, 6}, thread_arena());
+      EXPECT_NE(ys.data(), first);
+    }
+    // The nested scope did not reset the arena
+    pmr::vector<int> zs({7, 8, 9}, thread_arena());
+    EXPECT_NE(zs.data(), first);
+    EXPECT_EQ(xs, pmr::vector<int>({1, 2, 3}));
+  }
+  {
+    ArenaScope scope;
+    pmr::vector<int> xs({1, 2, 3}, thread_arena());
+    EXPECT_EQ(xs.data(), first);
+
+    // More than the initial buffer comes from upstream
+    pmr::vector<char> big(1 << 20, 'x', thread_arena());
+    EXPECT_EQ(big.back(), 'x');
+  }
+}
+
+TEST_F(ArenaTest, TestArenaPerThread) {
+  ArenaScope scope;
+  pmr::memory_resource *main_arena = thread_arena();
+  pmr::memory_resource *other_arena = nullptr;
+  thread th([&] {
+    ArenaScope other_scope;
+    other_arena = thread_arena();
+  });
+  th.join();
+  EXPECT_NE(main_arena, other_arena);
+}
+
+} // namespace dipcc
@@ -0,0 +1,104 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <random>
+#include <vector>
+
+#include "../cc/cfr_kernels.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class CFRKernelsTest : public ::testing::Test {
+protected:
+  void SetUp() override { level_ = get_simd_level(); }
+  void TearDown() override { set_simd_level(level_); }
+
+  vector<float> random_floats(int n, float lo, float hi) {
+    uniform_real_distribution<float> dist(lo, hi);
+    vector<float> r(n);
+    for (float &x : r) {
+      x = dist(rng_);
+    }
+    return r;
+  }
+
+  SimdLevel level_;
+  mt19937 rng_{0};
+};
+
+TEST_F(CFRKernelsTest, TestSetSimdLevel) {
+  EXPECT_EQ(set_simd_level(SimdLevel::SCALAR), SimdLevel::SCALAR);
+  EXPECT_EQ(get_simd_level(), SimdLevel::SCALAR);
+  EXPECT_EQ(set_simd_level(SimdLevel::AVX512), get_max_simd_level());
+}
+
+TEST_F(CFRKernelsTest, TestMatchScalar) {
+  // Sizes around the vector widths, on every level the CPU supports
+  for (int level = 1; level <= static_cast<int>(get_max_simd_level());
+       ++level) {
+    for (int n : {0, 1, 7, 8, 9, 15, 16, 17, 33, 50}) {
+      vector<float> a = random_floats(n, -1, 1), b = random_floats(n, 0, 1);
+      vector<float> cum_regrets = random_floats(n, -1, 1);
+      vector<float> cum_sigma = random_floats(n, 0, 1);
+      vector<float> sigma = random_floats(n, 0, 1);
+
+      // Scalar results
+      set_simd_level(SimdLevel::SCALAR);
+      float dot = cfr_kernels::dot(a.data(), b.data(), n);
+      vector<float> scaled = a;
+      cfr_kernels::scale(scaled.data(), 0.5, n);
+      vector<float> cr = cum_regrets, lr(n), cs = cum_sigma, s = sigma;
+      float sum = cfr_kernels::update_regrets(a.data(), 0.1, cr.data(),
+                                              lr.data(), cs.data(), s.data(),
+                                              true, n);
+      cfr_kernels::normalize(s.data(), sum, n);
+
+      // Vector results
+      set_simd_level(static_cast<SimdLevel>(level));
+      SCOPED_TRACE(simd_level_name(get_simd_level()));
+      SCOPED_TRACE(n);
+      EXPECT_NEAR(cfr_kernels::dot(a.data(), b.data(), n), dot, 1e-5);
+      vector<float> v_scaled = a;
+      cfr_kernels::scale(v_scaled.data(), 0.5, n);
+      EXPECT_EQ(v_scaled, scaled);
+      vector<float> v_cr = cum_regrets, v_lr(n), v_cs = cum_sigma,
+                    v_s = sigma;
+      float v_sum = cfr_kernels::update_regrets(
+          a.data(), 0.1, v_cr.data(), v_lr.data(), v_cs.data(), v_s.data(),
+          true, n);
+      EXPECT_NEAR(v_sum, sum, 1e-5);
+      EXPECT_EQ(v_cr, cr);
+      EXPECT_EQ(v_lr, lr);
+      EXPECT_EQ(v_cs, cs);
+      cfr_kernels::normalize(v_s.data(), v_sum, n);
+      for (int i = 0; i < n; ++i) {
+        EXPECT_NEAR(v_s[i], s[i], 1e-5);
+      }
+    }
+  }
+}
+
+TEST_F(CFRKernelsTest, TestNormalizeZeroSum) {
+  for (int level = 0; level <= static_cast<int>(get_max_simd_level());
+       ++level) {
+    set_simd_level(static_cast<SimdLevel>(level));
+    vector<float> sigma(20, 0);
+    vector<float> cum_regrets(20, -1), last_regrets(20), cum_sigma(20, 0);
+    vector<float> utilities(20, 0);
+    float sum = cfr_kernels::update_regrets(
+        utilities.data(), 0, cum_regrets.data(), last_regrets.data(),
+        cum_sigma.data(), sigma.data(), false, 20);
+    EXPECT_EQ(sum, 0);
+    cfr_kernels::normalize(sigma.data(), sum, 20);
+    EXPECT_EQ(sigma, vector<float>(20, 0.05));
+  }
+}
+
+} // namespace dipcc
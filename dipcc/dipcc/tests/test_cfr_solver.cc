@@ -0,0 +1,108 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/cfr_solver.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class CFRSolverTest : public ::testing::Test {
+protected:
+  // Rollout values for a matching pennies game between powers 0 and 1, with
+  // the other powers having no actions: power 0 wins if the actions match
+  vector<array<float, 7>> matching_pennies(const CFRSolver &solver) {
+    vector<array<float, 7>> r;
+    for (auto &idxs : solver.get_joint_action_idxs()) {
+      float u = idxs[0] == idxs[1] ? 1 : 0;
+      r.push_back({u, 1 - u, 0, 0, 0, 0, 0});
+    }
+    return r;
+  }
+};
+
+TEST_F(CFRSolverTest, TestStrategies) {
+  CFRSolver solver({{1, 3}, {2}, {}, {}, {}, {}, {}}, true, 0);
+  EXPECT_EQ(solver.get_n_actions(0), 2);
+  EXPECT_EQ(solver.get_n_actions(2), 0);
+  EXPECT_EQ(solver.strategy(0), vector<float>({0.5, 0.5}));
+  EXPECT_EQ(solver.avg_strategy(0), vector<float>({0.5, 0.5}));
+  EXPECT_EQ(solver.bp_strategy(0), vector<float>({0.25, 0.75}));
+  EXPECT_FLOAT_EQ(solver.bp_strategy(0, 0.5)[0], 0.1);
+  EXPECT_EQ(solver.bp_strategy(1), vector<float>({1.0}));
+}
+
+TEST_F(CFRSolverTest, TestJointActionIdxs) {
+  CFRSolver solver({{1, 1}, {1, 1, 1}, {}, {}, {}, {}, {1}}, true, 0);
+  solver.start_iter();
+  array<int, 7> sampled = solver.sample({});
+  EXPECT_EQ(sampled[2], -1);
+  EXPECT_EQ(sampled[6], 0);
+
+  auto idxs = solver.get_joint_action_idxs();
+  ASSERT_EQ(idxs.size(), 6);
+  EXPECT_EQ(idxs[0][0], 0);
+  EXPECT_EQ(idxs[1][0], 1);
+  EXPECT_EQ(idxs[4][1], 2);
+  EXPECT_EQ(idxs[4][0], sampled[0]);
+  EXPECT_EQ(idxs[5][1], sampled[1]);
+}
+
+TEST_F(CFRSolverTest, TestUpdate) {
+  CFRSolver solver({{1, 1}, {1}, {}, {}, {}, {}, {}}, false, 0);
+  solver.start_iter();
+  solver.sample({});
+  auto state_utilities = solver.update({{1, 0, 0, 0, 0, 0, 0},
+                                        {0, 0, 0, 0, 0, 0, 0},
+                                        {0, 2, 0, 0, 0, 0, 0}});
+  EXPECT_FLOAT_EQ(state_utilities[0], 0.5);
+  EXPECT_FLOAT_EQ(state_utilities[1], 2);
+  // Only action 0 has a positive regret
+  EXPECT_EQ(solver.strategy(0), vector<float>({1, 0}));
+  EXPECT_EQ(solver.avg_strategy(0), vector<float>({0.5, 0.5}));
+  EXPECT_FLOAT_EQ(solver.avg_action_utilities(0)[0], 1);
+  EXPECT_FLOAT_EQ(solver.avg_action_utilities(0)[1], 0);
+}
+
+TEST_F(CFRSolverTest, TestConvergence) {
+  // The average strategies of matching pennies converge to uniform
+  CFRSolver solver({{1, 1}, {1, 1}, {}, {}, {}, {}, {}}, true, 0);
+  for (int i = 0; i < 2000; ++i) {
+    solver.start_iter();
+    solver.sample({});
+    solver.update(matching_pennies(solver));
+  }
+  for (int p = 0; p < 2; ++p) {
+    EXPECT_NEAR(solver.avg_strategy(p)[0], 0.5, 0.05);
+    EXPECT_NEAR(solver.avg_utility(p), 0.5, 0.05);
+  }
+}
+
+TEST_F(CFRSolverTest, TestPrune) {
+  // Action 1 is dominated, and pruned
+  CFRSolver solver({{1, 1, 1}, {}, {}, {}, {}, {}, {}}, true, 0);
+  for (int i = 0; i < 10; ++i) {
+    solver.start_iter();
+    solver.sample({});
+    solver.update({{1, 0, 0, 0, 0, 0, 0},
+                   {0, 0, 0, 0, 0, 0, 0},
+                   {1, 0, 0, 0, 0, 0, 0}});
+  }
+  auto pruned = solver.prune(-0.06, 0.1);
+  ASSERT_EQ(pruned.size(), 1);
+  EXPECT_EQ(pruned[0], make_pair(0, 1));
+  EXPECT_EQ(solver.get_action_idxs(0), vector<int>({0, 2}));
+
+  solver.start_iter();
+  solver.sample({});
+  EXPECT_EQ(solver.get_joint_action_idxs().size(), 2);
+  solver.update({{1, 0, 0, 0, 0, 0, 0}, {1, 0, 0, 0, 0, 0, 0}});
+  EXPECT_EQ(solver.strategy(0).size(), 2);
+}
+
+} // namespace dipcc
@@ -0,0 +1,38 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/convoy_paths.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class ConvoyPathsTest : public ::testing::Test {};
+
+TEST_F(ConvoyPathsTest, TestChains) {
+  // Two chains: NTH-ENG-MAO, and BLA on its own
+  LocSet fleets{Loc::NTH, Loc::ENG, Loc::MAO, Loc::BLA};
+
+  const auto &chains = get_convoy_components(fleets);
+  ASSERT_EQ(chains.size(), 2);
+  EXPECT_EQ(chains[0].fleets.size() + chains[1].fleets.size(), 4);
+
+  EXPECT_TRUE(can_convoy(fleets, Loc::YOR, Loc::SPA));
+  EXPECT_TRUE(can_convoy(fleets, Loc::NWY, Loc::SPA_NC));
+  EXPECT_TRUE(can_convoy(fleets, Loc::LON, Loc::POR));
+  EXPECT_TRUE(can_convoy(fleets, Loc::RUM, Loc::ANK));
+  EXPECT_FALSE(can_convoy(fleets, Loc::YOR, Loc::ANK));
+  EXPECT_FALSE(can_convoy(fleets, Loc::YOR, Loc::TUN));
+  EXPECT_FALSE(can_convoy(fleets, Loc::MUN, Loc::LON));
+
+  // Cached result is the same
+  EXPECT_EQ(get_convoy_components(fleets).size(), 2);
+  EXPECT_FALSE(can_convoy(LocSet(), Loc::LON, Loc::BEL));
+}
+
+} // namespace dipcc
@@ -0,0 +1,113 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/data_fields.h"
+#include "../cc/encoding.h"
+#include "../cc/game.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class DataFieldsTest : public ::testing::Test {};
+
+TEST_F(DataFieldsTest, TestBoardStateFormatsRoundTrip) {
+  Game game;
+  game.set_orders("FRANCE", {"F BRE - MAO", "A PAR - BUR"});
+  game.process();
+  torch::Tensor expected = torch::empty({1, 81, BOARD_STATE_ENC_WIDTH});
+  encode_board_state(game.get_state(), expected.data_ptr<float>());
+
+  for (auto format : {BoardStateFormat::FLOAT32, BoardStateFormat::FLOAT16,
+                      BoardStateFormat::BFLOAT16, BoardStateFormat::UINT8,
+                      BoardStateFormat::PACKED}) {
+    DataFieldsPool pool;
+    pool.set_board_state_format(format);
+    TensorDict fields = pool.get(1, 0, false);
+    torch::Tensor board_state = fields["x_board_state"];
+    EXPECT_EQ(get_board_state_format(board_state), format);
+    write_board_state(expected.data_ptr<float>(), format,
+                      board_state.data_ptr());
+    EXPECT_TRUE(torch::equal(unpack_board_state(board_state), expected));
+  }
+}
+
+TEST_F(DataFieldsTest, TestPackedBoardStateIsSmaller) {
+  DataFieldsPool pool;
+  pool.set_board_state_format(BoardStateFormat::PACKED);
+  TensorDict fields = pool.get(4, 0, false);
+  EXPECT_EQ(fields["x_prev_state"].sizes(),
+            torch::IntArrayRef({4, 81, BOARD_STATE_PACKED_WIDTH}));
+
+  // Fields of another format are not reused
+  pool.set_board_state_format(BoardStateFormat::FLOAT32);
+  pool.release(std::move(fields));
+  EXPECT_EQ(pool.get(4, 0, false)["x_prev_state"].scalar_type(),
+            torch::kFloat32);
+}
+
+TEST_F(DataFieldsTest, TestExpandPrevStateDelta) {
+  torch::Tensor board_state = torch::zeros({2, 81, 35});
+  board_state[1][3][0] = 1;
+  TensorDict fields{
+      {"x_board_state", board_state},
+      {"x_prev_state_delta_offsets", torch::tensor({0, 0, 2}, torch::kLong)},
+      {"x_prev_state_delta_locs", torch::tensor({3, 80}, torch::kLong)},
+      {"x_prev_state_delta_rows", torch::ones({2, 35})},
+  };
+  expand_prev_state_delta(fields);
+  EXPECT_EQ(fields.count("x_prev_state_delta_rows"), 0);
+
+  torch::Tensor expected = board_state.clone();
+  expected[1][3] = 1;
+  expected[1][80] = 1;
+  EXPECT_TRUE(torch::equal(fields["x_prev_state"], expected));
+  EXPECT_EQ(fields["x_board_state"][1][3].sum().item<float>(), 1);
+}
+
+TEST_F(DataFieldsTest, TestIndexSelectFieldsPrevStateDelta) {
+  torch::Tensor board_state = torch::zeros({3, 81, 35});
+  TensorDict fields{
+      {"x_board_state", board_state},
+      {"x_prev_state_delta_offsets", torch::tensor({0, 1, 1, 3}, torch::kLong)},
+      {"x_prev_state_delta_locs", torch::tensor({5, 3, 80}, torch::kLong)},
+      {"x_prev_state_delta_rows", torch::ones({3, 35})},
+  };
+  torch::Tensor idxs = torch::tensor({2, 0}, torch::kLong);
+  TensorDict selected = index_select_fields(fields, idxs);
+  EXPECT_TRUE(torch::equal(selected["x_prev_state_delta_offsets"],
+                           torch::tensor({0, 2, 3}, torch::kLong)));
+  EXPECT_TRUE(torch::equal(selected["x_prev_state_delta_locs"],
+                           torch::tensor({3, 80, 5}, torch::kLong)));
+
+  // Same as selecting the expanded rows
+  expand_prev_state_delta(fields);
+  expand_prev_state_delta(selected);
+  EXPECT_TRUE(torch::equal(selected["x_prev_state"],
+                           fields["x_prev_state"].index_select(0, idxs)));
+}
+
+TEST_F(DataFieldsTest, TestIndexSelectFieldsSparsePossibleActions) {
+  // 2 games of 2 rows each (e.g. 1 power, max_seq_len 2)
+  TensorDict fields{
+      {"x_board_state", torch::zeros({2, 81, 35})},
+      {"x_possible_actions_offsets",
+       torch::tensor({0, 2, 2, 3, 6}, torch::kLong)},
+      {"x_possible_actions_values",
+       torch::tensor({10, 11, 20, 30, 31, 32}, torch::kInt32)},
+  };
+  TensorDict selected =
+      index_select_fields(fields, torch::tensor({1}, torch::kLong));
+  EXPECT_EQ(selected["x_board_state"].size(0), 1);
+  EXPECT_TRUE(torch::equal(selected["x_possible_actions_offsets"],
+                           torch::tensor({0, 1, 4}, torch::kLong)));
+  EXPECT_TRUE(torch::equal(selected["x_possible_actions_values"],
+                           torch::tensor({20, 30, 31, 32}, torch::kInt32)));
+}
+
+} // namespace dipcc
@@ -33,7 +33,7 @@ TEST_F(DATCTest, Test6A1) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH - PIC"));
 
   GameState next(state.process(orders));
@@ -61,7 +61,7 @@ TEST_F(DATCTest, Test6A2) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A LVP - IRI"));
 
   GameState next(state.process(orders));
@@ -89,7 +89,7 @@ TEST_F(DATCTest, Test6A3) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F KIE - MUN"));
 
   GameState next(state.process(orders));
@@ -117,7 +117,7 @@ TEST_F(DATCTest, Test6A4) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F KIE - KIE"));
 
   GameState next(state.process(orders));
@@ -149,7 +149,7 @@ TEST_F(DATCTest, Test6A5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A YOR - YOR"));
   orders[Power::ENGLAND].push_back(Order("A YOR - YOR"));
   orders[Power::ENGLAND].push_back(Order("A LVP S A YOR - YOR"));
@@ -182,7 +182,7 @@ TEST_F(DATCTest, Test6A6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F LON - NTH"));
 
   GameState next(state.process(orders));
@@ -211,7 +211,7 @@ TEST_F(DATCTest, Test6A7) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
 
@@ -242,7 +242,7 @@ TEST_F(DATCTest, Test6A8) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ITALY].push_back(Order("A VEN - TRI"));
   orders[Power::ITALY].push_back(Order("A TYR S A VEN - TRI"));
   orders[Power::AUSTRIA].push_back(Order("F TRI S F TRI"));
@@ -273,7 +273,7 @@ TEST_F(DATCTest, Test6A9) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ITALY].push_back(Order("F ROM - VEN"));
 
   GameState next(state.process(orders));
@@ -303,7 +303,7 @@ TEST_F(DATCTest, Test6A10) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A VEN H"));
   orders[Power::ITALY].push_back(Order("F ROM S A APU - VEN"));
   orders[Power::ITALY].push_back(Order("A APU - VEN"));
@@ -334,7 +334,7 @@ TEST_F(DATCTest, Test6A11) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A VIE - TYR"));
   orders[Power::ITALY].push_back(Order("A VEN - TYR"));
 
@@ -365,7 +365,7 @@ TEST_F(DATCTest, Test6A12) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A VIE - TYR"));
   orders[Power::GERMANY].push_back(Order("A MUN - TYR"));
   orders[Power::ITALY].push_back(Order("A VEN - TYR"));
@@ -395,7 +395,7 @@ TEST_F(DATCTest, Test6B1) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F POR - SPA"));
 
   GameState next(state.process(orders));
@@ -423,7 +423,7 @@ TEST_F(DATCTest, Test6B2) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F GAS - SPA"));
 
   GameState next(state.process(orders));
@@ -451,7 +451,7 @@ TEST_F(DATCTest, Test6B3) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F GAS - SPA/SC"));
 
   GameState next(state.process(orders));
@@ -481,7 +481,7 @@ TEST_F(DATCTest, Test6B4) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F GAS - SPA/NC"));
   orders[Power::FRANCE].push_back(Order("F MAR S F GAS - SPA/NC"));
   orders[Power::ITALY].push_back(Order("F WES - SPA/SC"));
@@ -515,7 +515,7 @@ TEST_F(DATCTest, Test6B5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F MAR - LYO"));
   orders[Power::FRANCE].push_back(Order("F SPA/NC S F MAR - LYO"));
   orders[Power::ITALY].push_back(Order("F LYO H"));
@@ -549,7 +549,7 @@ TEST_F(DATCTest, Test6B6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F IRI S F NAO - MAO"));
   orders[Power::ENGLAND].push_back(Order("F NAO - MAO"));
   orders[Power::FRANCE].push_back(Order("F SPA/NC S F MAO"));
@@ -585,7 +585,7 @@ TEST_F(DATCTest, Test6B7) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F POR S F MAO - SPA"));
   orders[Power::FRANCE].push_back(Order("F MAO - SPA/NC"));
   orders[Power::ITALY].push_back(Order("F LYO S F WES - SPA/SC"));
@@ -622,7 +622,7 @@ TEST_F(DATCTest, Test6B8) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F POR S F GAS - SPA"));
   orders[Power::FRANCE].push_back(Order("F GAS - SPA/NC"));
   orders[Power::ITALY].push_back(Order("F LYO S F WES - SPA/SC"));
@@ -658,7 +658,7 @@ TEST_F(DATCTest, Test6B9) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F POR S F MAO - SPA/NC"));
   orders[Power::FRANCE].push_back(Order("F MAO - SPA/SC"));
   orders[Power::ITALY].push_back(Order("F LYO S F WES - SPA/SC"));
@@ -691,7 +691,7 @@ TEST_F(DATCTest, Test6B10) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F SPA/NC - LYO"));
 
   GameState next(state.process(orders));
@@ -719,7 +719,7 @@ TEST_F(DATCTest, Test6B12) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("A GAS - SPA/NC"));
 
   GameState next(state.process(orders));
@@ -749,7 +749,7 @@ TEST_F(DATCTest, Test6B13) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::TURKEY].push_back(Order("F BUL/SC - CON"));
   orders[Power::TURKEY].push_back(Order("F CON - BUL/EC"));
   orders[Power::RUSSIA].push_back(Order("F BUL/SC - CON"));
@@ -781,7 +781,7 @@ TEST_F(DATCTest, Test6C1) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::TURKEY].push_back(Order("F ANK - CON"));
   orders[Power::TURKEY].push_back(Order("A CON - SMY"));
   orders[Power::TURKEY].push_back(Order("A SMY - ANK"));
@@ -821,7 +821,7 @@ TEST_F(DATCTest, Test6C2) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::TURKEY].push_back(Order("F ANK - CON"));
   orders[Power::TURKEY].push_back(Order("A CON - SMY"));
   orders[Power::TURKEY].push_back(Order("A SMY - ANK"));
@@ -862,7 +862,7 @@ TEST_F(DATCTest, Test6C3) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::TURKEY].push_back(Order("F ANK - CON"));
   orders[Power::TURKEY].push_back(Order("A CON - SMY"));
   orders[Power::TURKEY].push_back(Order("A SMY - ANK"));
@@ -899,7 +899,7 @@ TEST_F(DATCTest, Test6C4) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A TRI - SER"));
   orders[Power::AUSTRIA].push_back(Order("A SER - BUL"));
   orders[Power::TURKEY].push_back(Order("A BUL - TRI"));
@@ -947,7 +947,7 @@ TEST_F(DATCTest, Test6C5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A TRI - SER"));
   orders[Power::AUSTRIA].push_back(Order("A SER - BUL"));
   orders[Power::TURKEY].push_back(Order("A BUL - TRI"));
@@ -986,7 +986,7 @@ TEST_F(DATCTest, Test6C6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::FRANCE].push_back(Order("F ENG C A BEL - LON"));
@@ -1025,7 +1025,7 @@ TEST_F(DATCTest, Test6C7) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::FRANCE].push_back(Order("F ENG C A BEL - LON"));
@@ -1060,7 +1060,7 @@ TEST_F(DATCTest, Test6D1) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F ADR S A TRI - VEN"));
   orders[Power::AUSTRIA].push_back(Order("A TRI - VEN"));
   orders[Power::ITALY].push_back(Order("A VEN H"));
@@ -1095,7 +1095,7 @@ TEST_F(DATCTest, Test6D2) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F ADR S A TRI - VEN"));
   orders[Power::AUSTRIA].push_back(Order("A TRI - VEN"));
   orders[Power::AUSTRIA].push_back(Order("A VIE - TYR"));
@@ -1131,7 +1131,7 @@ TEST_F(DATCTest, Test6D3) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F ADR S A TRI - VEN"));
   orders[Power::AUSTRIA].push_back(Order("A TRI - VEN"));
   orders[Power::ITALY].push_back(Order("A VEN H"));
@@ -1165,7 +1165,7 @@ TEST_F(DATCTest, Test6D4) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER S F KIE"));
   orders[Power::GERMANY].push_back(Order("F KIE S A BER"));
   orders[Power::RUSSIA].push_back(Order("F BAL S A PRU - BER"));
@@ -1200,7 +1200,7 @@ TEST_F(DATCTest, Test6D5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER S A MUN - SIL"));
   orders[Power::GERMANY].push_back(Order("F KIE S A BER"));
   orders[Power::GERMANY].push_back(Order("A MUN - SIL"));
@@ -1238,7 +1238,7 @@ TEST_F(DATCTest, Test6D6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER - SWE"));
   orders[Power::GERMANY].push_back(Order("F BAL C A BER - SWE"));
   orders[Power::GERMANY].push_back(Order("F PRU S F BAL"));
@@ -1275,7 +1275,7 @@ TEST_F(DATCTest, Test6D8) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F ION H"));
   orders[Power::AUSTRIA].push_back(Order("A SER S A ALB - GRE"));
   orders[Power::AUSTRIA].push_back(Order("A ALB - GRE"));
@@ -1311,7 +1311,7 @@ TEST_F(DATCTest, Test6D9) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ITALY].push_back(Order("A VEN - TRI"));
   orders[Power::ITALY].push_back(Order("A TYR S A VEN - TRI"));
   orders[Power::AUSTRIA].push_back(Order("A ALB S A TRI - SER"));
@@ -1345,7 +1345,7 @@ TEST_F(DATCTest, Test6D10) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER H"));
   orders[Power::GERMANY].push_back(Order("F KIE - BER"));
   orders[Power::GERMANY].push_back(Order("A MUN S F KIE - BER"));
@@ -1378,7 +1378,7 @@ TEST_F(DATCTest, Test6D11) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER - PRU"));
   orders[Power::GERMANY].push_back(Order("F KIE - BER"));
   orders[Power::GERMANY].push_back(Order("A MUN S F KIE - BER"));
@@ -1411,7 +1411,7 @@ TEST_F(DATCTest, Test6D12) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F TRI H"));
   orders[Power::AUSTRIA].push_back(Order("A VIE S A VEN - TRI"));
   orders[Power::ITALY].push_back(Order("A VEN - TRI"));
@@ -1445,7 +1445,7 @@ TEST_F(DATCTest, Test6D13) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F TRI - ADR"));
   orders[Power::AUSTRIA].push_back(Order("A VIE S A VEN - TRI"));
   orders[Power::ITALY].push_back(Order("A VEN - TRI"));
@@ -1481,7 +1481,7 @@ TEST_F(DATCTest, Test6D14) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F TRI H"));
   orders[Power::AUSTRIA].push_back(Order("A VIE S A VEN - TRI"));
   orders[Power::ITALY].push_back(Order("A VEN - TRI"));
@@ -1516,7 +1516,7 @@ TEST_F(DATCTest, Test6D15) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::RUSSIA].push_back(Order("F CON S F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("F BLA - ANK"));
   orders[Power::TURKEY].push_back(Order("F ANK - CON"));
@@ -1551,7 +1551,7 @@ TEST_F(DATCTest, Test6D16) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A LON H"));
   orders[Power::ENGLAND].push_back(Order("F NTH C A BEL - LON"));
   orders[Power::FRANCE].push_back(Order("F ENG S A BEL - LON"));
@@ -1587,7 +1587,7 @@ TEST_F(DATCTest, Test6D17) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::RUSSIA].push_back(Order("F CON S F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("F BLA - ANK"));
   orders[Power::TURKEY].push_back(Order("F ANK - CON"));
@@ -1633,7 +1633,7 @@ TEST_F(DATCTest, Test6D18) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::RUSSIA].push_back(Order("F CON S F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("A BUL S F CON"));
@@ -1670,7 +1670,7 @@ TEST_F(DATCTest, Test6D19) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::RUSSIA].push_back(Order("F CON S F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("A SMY S F ANK - CON"));
@@ -1705,7 +1705,7 @@ TEST_F(DATCTest, Test6D20) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F LON S F NTH - ENG"));
   orders[Power::ENGLAND].push_back(Order("F NTH - ENG"));
   orders[Power::ENGLAND].push_back(Order("A YOR - LON"));
@@ -1742,7 +1742,7 @@ TEST_F(DATCTest, Test6D21) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("F TRI H"));
   orders[Power::ITALY].push_back(Order("A VEN - TRI"));
   orders[Power::ITALY].push_back(Order("A TYR S A VEN - TRI"));
@@ -1787,7 +1787,7 @@ TEST_F(DATCTest, Test6D22) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F KIE - MUN"));
   orders[Power::GERMANY].push_back(Order("A BUR S F KIE - MUN"));
   orders[Power::RUSSIA].push_back(Order("A MUN - KIE"));
@@ -1830,7 +1830,7 @@ TEST_F(DATCTest, Test6D23) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ITALY].push_back(Order("F LYO - SPA/SC"));
   orders[Power::ITALY].push_back(Order("F WES S F LYO - SPA/SC"));
   orders[Power::FRANCE].push_back(Order("F SPA/NC - LYO"));
@@ -1875,7 +1875,7 @@ TEST_F(DATCTest, Test6D24) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("A MAR - LYO"));
   orders[Power::FRANCE].push_back(Order("F SPA/SC S A MAR - LYO"));
   orders[Power::ITALY].push_back(Order("F LYO H"));
@@ -1919,7 +1919,7 @@ TEST_F(DATCTest, Test6D25) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER S A PRU"));
   orders[Power::GERMANY].push_back(Order("F KIE S A BER"));
   orders[Power::RUSSIA].push_back(Order("F BAL S A PRU - BER"));
@@ -1953,7 +1953,7 @@ TEST_F(DATCTest, Test6D26) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER S A PRU - SIL"));
   orders[Power::GERMANY].push_back(Order("F KIE S A BER"));
   orders[Power::RUSSIA].push_back(Order("F BAL S A PRU - BER"));
@@ -1988,7 +1988,7 @@ TEST_F(DATCTest, Test6D27) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F SWE - BAL"));
   orders[Power::ENGLAND].push_back(Order("F DEN S F SWE - BAL"));
   orders[Power::GERMANY].push_back(Order("A BER H"));
@@ -2023,7 +2023,7 @@ TEST_F(DATCTest, Test6D28) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A BUD S F RUM"));
   orders[Power::RUSSIA].push_back(Order("F RUM - HOL"));
   orders[Power::TURKEY].push_back(Order("F BLA - RUM"));
@@ -2057,7 +2057,7 @@ TEST_F(DATCTest, Test6D29) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A BUD S F RUM"));
   orders[Power::RUSSIA].push_back(Order("F RUM - BUL/SC"));
   orders[Power::TURKEY].push_back(Order("F BLA - RUM"));
@@ -2091,7 +2091,7 @@ TEST_F(DATCTest, Test6D30) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ITALY].push_back(Order("F AEG S F CON"));
   orders[Power::RUSSIA].push_back(Order("F CON - BUL"));
   orders[Power::TURKEY].push_back(Order("F BLA - CON"));
@@ -2125,7 +2125,7 @@ TEST_F(DATCTest, Test6D32) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F EDI S A LVP - YOR"));
   orders[Power::ENGLAND].push_back(Order("A LVP - YOR"));
   orders[Power::FRANCE].push_back(Order("F LON S A YOR"));
@@ -2159,7 +2159,7 @@ TEST_F(DATCTest, Test6D33) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A SER - BUD"));
   orders[Power::AUSTRIA].push_back(Order("A VIE - BUD"));
   orders[Power::RUSSIA].push_back(Order("A GAL S A SER - BUD"));
@@ -2199,7 +2199,7 @@ TEST_F(DATCTest, Test6D34) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER - PRU"));
   orders[Power::GERMANY].push_back(Order("A SIL S A BER - PRU"));
   orders[Power::GERMANY].push_back(Order("F BAL S A BER - PRU"));
@@ -2236,7 +2236,7 @@ TEST_F(DATCTest, Test6E1) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER - PRU"));
   orders[Power::GERMANY].push_back(Order("F KIE - BER"));
   orders[Power::GERMANY].push_back(Order("A SIL S A BER - PRU"));
@@ -2270,7 +2270,7 @@ TEST_F(DATCTest, Test6E2) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER - KIE"));
   orders[Power::GERMANY].push_back(Order("F KIE - BER"));
   orders[Power::GERMANY].push_back(Order("A MUN S A BER - KIE"));
@@ -2302,7 +2302,7 @@ TEST_F(DATCTest, Test6E3) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("A BER - KIE"));
   orders[Power::GERMANY].push_back(Order("A MUN S F KIE - BER"));
   orders[Power::ENGLAND].push_back(Order("F KIE - BER"));
@@ -2341,7 +2341,7 @@ TEST_F(DATCTest, Test6E4) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F HOL - NTH"));
   orders[Power::GERMANY].push_back(Order("F HEL S F HOL - NTH"));
   orders[Power::GERMANY].push_back(Order("F SKA S F HOL - NTH"));
@@ -2390,7 +2390,7 @@ TEST_F(DATCTest, Test6E5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F HOL - NTH"));
   orders[Power::GERMANY].push_back(Order("F HEL S F HOL - NTH"));
   orders[Power::GERMANY].push_back(Order("F SKA S F HOL - NTH"));
@@ -2442,7 +2442,7 @@ TEST_F(DATCTest, Test6E6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::GERMANY].push_back(Order("F HOL - NTH"));
   orders[Power::GERMANY].push_back(Order("F HEL S F HOL - NTH"));
   orders[Power::FRANCE].push_back(Order("F NTH - HOL"));
@@ -2483,7 +2483,7 @@ TEST_F(DATCTest, Test6E7) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH H"));
   orders[Power::ENGLAND].push_back(Order("F YOR S F NWY - NTH"));
   orders[Power::GERMANY].push_back(Order("F HOL S F HEL - NTH"));
@@ -2526,7 +2526,7 @@ TEST_F(DATCTest, Test6E8) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH - NWY"));
   orders[Power::ENGLAND].push_back(Order("F YOR S F NWY - NTH"));
   orders[Power::GERMANY].push_back(Order("F HOL S F HEL - NTH"));
@@ -2564,7 +2564,7 @@ TEST_F(DATCTest, Test6E9) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH - NWG"));
   orders[Power::ENGLAND].push_back(Order("F YOR S F NWY - NTH"));
   orders[Power::GERMANY].push_back(Order("F HOL S F HEL - NTH"));
@@ -2608,7 +2608,7 @@ TEST_F(DATCTest, Test6E10) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH - DEN"));
   orders[Power::ENGLAND].push_back(Order("F YOR S F NWY - NTH"));
   orders[Power::GERMANY].push_back(Order("F HOL S F HEL - NTH"));
@@ -2649,7 +2649,7 @@ TEST_F(DATCTest, Test6E11) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("A SPA - POR VIA"));
   orders[Power::FRANCE].push_back(Order("F MAO C A SPA - POR"));
   orders[Power::FRANCE].push_back(Order("F LYO S F POR - SPA/NC"));
@@ -2692,7 +2692,7 @@ TEST_F(DATCTest, Test6E12) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A BUD - RUM"));
   orders[Power::AUSTRIA].push_back(Order("A SER S A VIE - BUD"));
   orders[Power::ITALY].push_back(Order("A VIE - BUD"));
@@ -2730,7 +2730,7 @@ TEST_F(DATCTest, Test6E13) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F EDI S F YOR - NTH"));
   orders[Power::ENGLAND].push_back(Order("F YOR - NTH"));
   orders[Power::FRANCE].push_back(Order("F BEL - NTH"));
@@ -2765,7 +2765,7 @@ TEST_F(DATCTest, Test6E14) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A LVP - EDI"));
   orders[Power::RUSSIA].push_back(Order("F EDI - LVP"));
 
@@ -2803,7 +2803,7 @@ TEST_F(DATCTest, Test6E15) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F HOL S A RUH - KIE"));
   orders[Power::ENGLAND].push_back(Order("A RUH - KIE"));
   orders[Power::FRANCE].push_back(Order("A KIE - BER"));
@@ -2843,7 +2843,7 @@ TEST_F(DATCTest, Test6F1) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::TURKEY].push_back(Order("A GRE - SEV"));
   orders[Power::TURKEY].push_back(Order("F AEG C A GRE - SEV"));
   orders[Power::TURKEY].push_back(Order("F CON C A GRE - SEV"));
@@ -2878,7 +2878,7 @@ TEST_F(DATCTest, Test6F2) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F ENG C A LON - BRE"));
   orders[Power::ENGLAND].push_back(Order("A LON - BRE"));
   orders[Power::FRANCE].push_back(Order("A PAR - BRE"));
@@ -2911,7 +2911,7 @@ TEST_F(DATCTest, Test6F3) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F ENG C A LON - BRE"));
   orders[Power::ENGLAND].push_back(Order("A LON - BRE"));
   orders[Power::ENGLAND].push_back(Order("F MAO S A LON - BRE"));
@@ -2949,7 +2949,7 @@ TEST_F(DATCTest, Test6F4) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - HOL"));
   orders[Power::ENGLAND].push_back(Order("A LON - HOL"));
   orders[Power::GERMANY].push_back(Order("F SKA - NTH"));
@@ -2985,7 +2985,7 @@ TEST_F(DATCTest, Test6F5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - HOL"));
   orders[Power::ENGLAND].push_back(Order("A LON - HOL"));
   orders[Power::FRANCE].push_back(Order("F ENG - NTH"));
@@ -3026,7 +3026,7 @@ TEST_F(DATCTest, Test6F6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - HOL"));
   orders[Power::ENGLAND].push_back(Order("A LON - HOL"));
   orders[Power::GERMANY].push_back(Order("A HOL S A BEL"));
@@ -3069,7 +3069,7 @@ TEST_F(DATCTest, Test6F8) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - HOL"));
   orders[Power::ENGLAND].push_back(Order("A LON - HOL"));
   orders[Power::GERMANY].push_back(Order("F HEL S F SKA - NTH"));
@@ -3106,7 +3106,7 @@ TEST_F(DATCTest, Test6F9) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F ENG C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
@@ -3143,7 +3143,7 @@ TEST_F(DATCTest, Test6F10) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::GERMANY].push_back(Order("F ENG C A LON - BEL"));
@@ -3180,7 +3180,7 @@ TEST_F(DATCTest, Test6F11) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::GERMANY].push_back(Order("F ENG C A LON - BEL"));
   orders[Power::RUSSIA].push_back(Order("F NTH C A LON - BEL"));
@@ -3217,7 +3217,7 @@ TEST_F(DATCTest, Test6F12) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F ENG C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("F IRI C A LON - BEL"));
@@ -3254,7 +3254,7 @@ TEST_F(DATCTest, Test6F13) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
   orders[Power::FRANCE].push_back(Order("F ENG C A LON - BEL"));
@@ -3294,7 +3294,7 @@ TEST_F(DATCTest, Test6F14) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F LON S F WAL - ENG"));
   orders[Power::ENGLAND].push_back(Order("F WAL - ENG"));
   orders[Power::FRANCE].push_back(Order("A BRE - LON"));
@@ -3333,7 +3333,7 @@ TEST_F(DATCTest, Test6F15) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F LON S F WAL - ENG"));
   orders[Power::ENGLAND].push_back(Order("F WAL - ENG"));
   orders[Power::FRANCE].push_back(Order("A BRE - LON"));
@@ -3376,7 +3376,7 @@ TEST_F(DATCTest, Test6F16) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F LON S F WAL - ENG"));
   orders[Power::ENGLAND].push_back(Order("F WAL - ENG"));
   orders[Power::FRANCE].push_back(Order("A BRE - LON"));
@@ -3415,7 +3415,7 @@ TEST_F(DATCTest, Test6F17) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F LON S F WAL - ENG"));
   orders[Power::ENGLAND].push_back(Order("F WAL - ENG"));
   orders[Power::FRANCE].push_back(Order("A BRE - LON"));
@@ -3464,7 +3464,7 @@ TEST_F(DATCTest, Test6F18) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F NTH C A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("A LON - BEL"));
   orders[Power::ENGLAND].push_back(Order("F ENG S A LON - BEL"));
@@ -3509,7 +3509,7 @@ TEST_F(DATCTest, Test6F19) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("A TUN - NAP"));
   orders[Power::FRANCE].push_back(Order("F TYS C A TUN - NAP"));
   orders[Power::FRANCE].push_back(Order("F ION C A TUN - NAP"));
@@ -3550,7 +3550,7 @@ TEST_F(DATCTest, Test6F20) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("A TUN - NAP"));
   orders[Power::FRANCE].push_back(Order("F TYS C A TUN - NAP"));
   orders[Power::ITALY].push_back(Order("F NAP S F ION"));
@@ -3592,7 +3592,7 @@ TEST_F(DATCTest, Test6F21) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::RUSSIA].push_back(Order("A EDI S A NWY - CLY"));
   orders[Power::RUSSIA].push_back(Order("F NWG C A NWY - CLY"));
   orders[Power::RUSSIA].push_back(Order("A NWY - CLY"));
@@ -3636,7 +3636,7 @@ TEST_F(DATCTest, Test6F22) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F EDI - NTH"));
   orders[Power::ENGLAND].push_back(Order("F LON S F EDI - NTH"));
   orders[Power::FRANCE].push_back(Order("A BRE - LON"));
@@ -3688,7 +3688,7 @@ TEST_F(DATCTest, Test6F23) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F EDI - NTH"));
   orders[Power::ENGLAND].push_back(Order("F YOR S F EDI - NTH"));
   orders[Power::FRANCE].push_back(Order("A BRE - LON"));
@@ -3739,7 +3739,7 @@ TEST_F(DATCTest, Test6F24) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F EDI - NTH"));
   orders[Power::ENGLAND].push_back(Order("F LON S F EDI - NTH"));
   orders[Power::ENGLAND].push_back(Order("F IRI - ENG"));
@@ -3784,7 +3784,7 @@ TEST_F(DATCTest, Test6H5) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::RUSSIA].push_back(Order("F CON S F BLA - ANK"));
   orders[Power::RUSSIA].push_back(Order("F BLA - ANK"));
   orders[Power::TURKEY].push_back(Order("F ANK H"));
@@ -3825,7 +3825,7 @@ TEST_F(DATCTest, Test6H6) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::AUSTRIA].push_back(Order("A BUD S A TRI - VIE"));
   orders[Power::AUSTRIA].push_back(Order("A TRI - VIE"));
   orders[Power::GERMANY].push_back(Order("A MUN - BOH"));
@@ -3869,7 +3869,7 @@ TEST_F(DATCTest, Test6H9) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F HEL - KIE"));
   orders[Power::ENGLAND].push_back(Order("F DEN S F HEL - KIE"));
   orders[Power::GERMANY].push_back(Order("A BER - PRU"));
@@ -3909,7 +3909,7 @@ TEST_F(DATCTest, DISABLED_Test6H11) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("A GAS - MAR VIA"));
   orders[Power::FRANCE].push_back(Order("A BUR S A GAS - MAR"));
   orders[Power::FRANCE].push_back(Order("F MAO C A GAS - MAR"));
@@ -3954,7 +3954,7 @@ TEST_F(DATCTest, DISABLED_Test6H12) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A LVP - EDI VIA"));
   orders[Power::ENGLAND].push_back(Order("F IRI C A LVP - EDI"));
   orders[Power::ENGLAND].push_back(Order("F ENG C A LVP - EDI"));
@@ -3996,7 +3996,7 @@ TEST_F(DATCTest, Test6H13) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("A PIC H"));
   orders[Power::ENGLAND].push_back(Order("F ENG C A PIC - LON"));
   orders[Power::FRANCE].push_back(Order("A PAR - PIC"));
@@ -4036,7 +4036,7 @@ TEST_F(DATCTest, Test6H15) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::ENGLAND].push_back(Order("F POR H"));
   orders[Power::FRANCE].push_back(Order("F SPA/SC - POR"));
   orders[Power::FRANCE].push_back(Order("F MAO S F SPA/SC - POR"));
@@ -4076,7 +4076,7 @@ TEST_F(DATCTest, Test6H16) {
       LOG(INFO) << "  " << order.to_string();
     }
   }
-  std::unordered_map<Power, std::vector<Order>> orders;
+  PowerMap<std::vector<Order>> orders;
   orders[Power::FRANCE].push_back(Order("F MAO - SPA/NC"));
   orders[Power::FRANCE].push_back(Order("F GAS - SPA/NC"));
   orders[Power::FRANCE].push_back(Order("F WES H"));
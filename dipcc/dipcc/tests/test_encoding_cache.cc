@@ -0,0 +1,74 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/encoding_cache.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class EncodingCacheTest : public ::testing::Test {};
+
+TEST_F(EncodingCacheTest, TestLruEviction) {
+  EncodingCache cache(2);
+  auto a = make_shared<EncodedState>();
+  auto b = make_shared<EncodedState>();
+  auto c = make_shared<EncodedState>();
+
+  EXPECT_EQ(cache.get({1, 0}), nullptr);
+  cache.put({1, 0}, a);
+  cache.put({2, 0}, b);
+  EXPECT_EQ(cache.get({1, 0}), a);
+
+  // {2, 0} is now the least recently used
+  cache.put({3, 0}, c);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.get({2, 0}), nullptr);
+  EXPECT_EQ(cache.get({1, 0}), a);
+  EXPECT_EQ(cache.get({3, 0}), c);
+  EXPECT_EQ(cache.get({1, 1}), nullptr);
+  EXPECT_EQ(cache.get_hits(), 3);
+  EXPECT_EQ(cache.get_misses(), 3);
+
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.get({1, 0}), nullptr);
+}
+
+TEST_F(EncodingCacheTest, TestSaveLoadBook) {
+  EncodingCache cache(2);
+  auto a = make_shared<EncodedState>();
+  a->x_board_state = {1, 2, 3};
+  a->x_season = {0, 1, 0};
+  a->x_in_adj_phase = 1;
+  a->x_loc_idxs = {-1, 4};
+  a->x_possible_actions.row_lens = {2};
+  a->x_possible_actions.values = {7, 9};
+  cache.put({1, 2}, a);
+  string path = ::testing::TempDir() + "encoding_cache_book";
+  cache.save(path, 42);
+
+  EncodingCache book(1);
+  EXPECT_THROW(book.load_book(path, 43), std::exception);
+  EXPECT_EQ(book.load_book(path, 42), 1);
+  EXPECT_EQ(book.get_book_size(), 1);
+
+  // Book entries are not evicted by newer ones
+  book.put({3, 0}, make_shared<EncodedState>());
+  book.put({4, 0}, make_shared<EncodedState>());
+  book.clear();
+  auto r = book.get({1, 2});
+  ASSERT_NE(r, nullptr);
+  EXPECT_EQ(r->x_board_state, a->x_board_state);
+  EXPECT_EQ(r->x_season, a->x_season);
+  EXPECT_EQ(r->x_in_adj_phase, 1);
+  EXPECT_EQ(r->x_loc_idxs, a->x_loc_idxs);
+  EXPECT_EQ(r->x_possible_actions.values, a->x_possible_actions.values);
+}
+
+} // namespace dipcc
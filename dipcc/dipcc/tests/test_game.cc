@@ -5,9 +5,12 @@ This source code is licensed under the MIT license found in the
 LICENSE file in the root directory of this source tree.
 */
 
+#include <thread>
 #include <unordered_set>
 
+#include "../cc/exceptions.h"
 #include "../cc/game.h"
+#include "../cc/game_gen.h"
 #include "../cc/thirdparty/nlohmann/json.hpp"
 #include "consts.h"
 #include "gmock/gmock.h"
@@ -130,6 +133,26 @@ TEST_F(GameTest, TestOrderParsing7) {
   EXPECT_EQ(order.get_dest(), Loc::RUM);
 }
 
+TEST_F(GameTest, TestOrderFormatRoundTrip) {
+  for (const string s :
+       {"F STP/SC - BOT", "A PAR - BRE VIA", "F SPA/NC S A GAS - MAR",
+        "F BLA C A BUL - RUM", "A MUN S A BER", "F BRE B", "A VIE D"}) {
+    Order order(s);
+    EXPECT_EQ(order.to_string(), s);
+    char buf[Order::MAX_STR_LEN];
+    EXPECT_EQ(string(buf, order.format(buf)), s);
+  }
+  EXPECT_EQ(loc_from_str("STP/SC"), Loc::STP_SC);
+  EXPECT_EQ(loc_from_str("XYZ"), Loc::NONE);
+  EXPECT_EQ(loc_from_str("STP/EC"), Loc::NONE);
+
+  for (const string s :
+       {"", "F", "F XYZ H", "F SEV", "F SEV X", "A PAR - BRE VIAX",
+        "A PAR S", "F BLA C A BUL", "A PAR H extra"}) {
+    EXPECT_THROW(Order{s}, std::invalid_argument) << s;
+  }
+}
+
 TEST_F(GameTest, TestDrawOnStalemateOff) {
   Game game;
   game.set_orders("RUSSIA", {"F SEV - RUM"});
@@ -162,6 +185,33 @@ TEST_F(GameTest, TestDrawOnStalemateOne) {
   EXPECT_EQ(game.is_game_done(), true);
 }
 
+TEST_F(GameTest, TestDrawOnStalemateAfterRollback) {
+  // Springs recorded before a rollback are not compared after it
+  Game game(2);
+  game.set_orders("RUSSIA", {"F SEV - RUM"});
+  game.process(); // S1901M
+  game.process(); // F1901M
+  game.set_orders("RUSSIA", {"F SEV B"});
+  while (game.get_state().get_phase().year < 1903) {
+    game.process();
+  }
+  ASSERT_EQ(game.get_state().get_phase().to_string(), "S1903M");
+
+  Game rolled_back = game.rolled_back_to_phase_start("S1902M");
+  rolled_back.set_orders("AUSTRIA", {"A BUD - SER"});
+  while (rolled_back.get_state().get_phase().year < 1905) {
+    EXPECT_EQ(rolled_back.is_game_done(), false);
+    rolled_back.process();
+  }
+  EXPECT_EQ(rolled_back.is_game_done(), true);
+
+  while (game.get_state().get_phase().year < 1904) {
+    EXPECT_EQ(game.is_game_done(), false);
+    game.process();
+  }
+  EXPECT_EQ(game.is_game_done(), true);
+}
+
 TEST_F(GameTest, TestHashSameBounce) {
   Game game;
   game.set_orders("FRANCE", {"A PAR - BUR"});
@@ -182,6 +232,716 @@ TEST_F(GameTest, TestHashDifferent) {
   ASSERT_NE(game.compute_board_hash(), game2.compute_board_hash());
 }
 
+TEST_F(GameTest, TestStableBoardHash) {
+  // Golden values: these must never change (see stable_board_hash)
+  Game game;
+  EXPECT_EQ(game.stable_board_hash(), 17382248704093976667ULL);
+  game.set_orders("FRANCE", {"A PAR - BUR"});
+  game.set_orders("GERMANY", {"A MUN - RUH", "A BER - MUN"});
+  game.process();
+  game.set_orders("GERMANY", {"A RUH - BUR", "A MUN S A RUH - BUR"});
+  game.process();
+  ASSERT_EQ(game.get_state().get_phase().to_string(), "F1901R");
+  EXPECT_EQ(game.stable_board_hash(), 8417768288938673544ULL);
+}
+
+TEST_F(GameTest, TestHashMatchesLoadedState) {
+  // The incrementally maintained hash equals that of the same board loaded
+  // from scratch, including dislodged units in an R phase
+  Game game;
+  game.set_orders("FRANCE", {"A PAR - BUR"});
+  game.set_orders("GERMANY", {"A MUN - RUH", "A BER - MUN"});
+  game.process();
+  game.set_orders("GERMANY", {"A RUH - BUR", "A MUN S A RUH - BUR"});
+  game.process();
+  ASSERT_EQ(game.get_state().get_phase().to_string(), "F1901R");
+
+  Game loaded = Game::from_bytes(game.to_bytes());
+  EXPECT_EQ(loaded.compute_board_hash(), game.compute_board_hash());
+
+  Game game2(game);
+  game2.set_orders("FRANCE", {"A BUR R PIC"});
+  game2.process();
+  game.set_orders("FRANCE", {"A BUR R GAS"});
+  game.process();
+  EXPECT_NE(game.compute_board_hash(), game2.compute_board_hash());
+  EXPECT_EQ(Game(game.to_json()).compute_board_hash(),
+            game.compute_board_hash());
+}
+
+TEST_F(GameTest, TestBoardLocMap) {
+  Game game;
+  auto units = game.get_state().get_units();
+  EXPECT_EQ(units.size(), 22);
+  EXPECT_EQ(game.get_state().get_centers().size(), 22);
+
+  // iteration is in Loc order, like the std::map it replaced
+  Loc prev = Loc::NONE;
+  for (const auto &p : units) {
+    EXPECT_LT(prev, p.first);
+    EXPECT_EQ(p.first, p.second.loc);
+    prev = p.first;
+  }
+
+  units.erase(Loc::PAR);
+  EXPECT_EQ(units.size(), 21);
+  EXPECT_EQ(units.find(Loc::PAR), units.end());
+  EXPECT_NE(units, game.get_state().get_units());
+  EXPECT_THROW(units.at(Loc::PAR), std::out_of_range);
+}
+
+TEST_F(GameTest, TestStagedOrdersPowerMap) {
+  Game game;
+  game.set_orders("GERMANY", {"A MUN - RUH"});
+  game.set_orders("AUSTRIA", {"A VIE - GAL"});
+  auto staged = game.get_staged_orders();
+  EXPECT_EQ(staged.size(), 2);
+
+  // iteration is in Power order
+  auto it = staged.begin();
+  EXPECT_EQ(it->first, Power::AUSTRIA);
+  EXPECT_EQ((++it)->first, Power::GERMANY);
+
+  // entries cleared or erased are absent, even if they kept their storage
+  staged.erase(Power::AUSTRIA);
+  EXPECT_EQ(staged.find(Power::AUSTRIA), staged.end());
+  EXPECT_NE(staged, game.get_staged_orders());
+  EXPECT_TRUE(staged[Power::AUSTRIA].empty());
+  staged.clear();
+  EXPECT_TRUE(staged.empty());
+  EXPECT_THROW(staged.at(Power::GERMANY), std::out_of_range);
+}
+
+TEST_F(GameTest, TestProcessMany) {
+  Game game;
+  GameState &state = game.get_state();
+  vector<PowerMap<vector<Order>>> orders_list(3);
+  orders_list[1][Power::FRANCE] = {Order("A PAR - BUR")};
+  orders_list[2][Power::FRANCE] = {Order("A PAR - BUR")};
+  orders_list[2][Power::GERMANY] = {Order("A MUN - BUR")};
+
+  auto nexts = state.process_many(orders_list);
+  ASSERT_EQ(nexts.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(nexts[i].compute_board_hash(),
+              state.process(orders_list[i]).compute_board_hash());
+  }
+  EXPECT_EQ(nexts[0].get_units(), state.get_units());
+  EXPECT_NE(nexts[1].get_units().find(Loc::BUR), nexts[1].get_units().end());
+  EXPECT_EQ(nexts[2].get_units().find(Loc::BUR), nexts[2].get_units().end());
+}
+
+TEST_F(GameTest, TestProcessLike) {
+  Game root;
+  root.set_lazy_possible_orders(true);
+  root.set_orders("GERMANY", {"A MUN - RUH", "A BER - MUN"});
+  root.process();
+  Game leader(root), follower(root), other(root), expected(root);
+  for (Game *game : {&leader, &follower, &expected}) {
+    game->set_orders("GERMANY", {"A RUH - BUR", "A MUN S A RUH - BUR"});
+  }
+  other.set_orders("FRANCE", {"A PAR - BUR"});
+  leader.process();
+  expected.process();
+
+  follower.process_like(leader);
+  other.process_like(leader); // different orders: adjudicated
+  EXPECT_EQ(follower.get_state().get_units(), expected.get_state().get_units());
+  EXPECT_EQ(follower.get_state().get_phase(), expected.get_state().get_phase());
+  EXPECT_EQ(follower.stable_board_hash(), expected.stable_board_hash());
+  EXPECT_EQ(follower.to_json(), expected.to_json());
+  EXPECT_EQ(other.get_state().get_unit(Loc::BUR).power, Power::FRANCE);
+
+  // The new state is shared, not copied
+  EXPECT_EQ(&follower.get_state(), &leader.get_state());
+  EXPECT_NE(&other.get_state(), &leader.get_state());
+  EXPECT_EQ(follower.get_state().get_possible_orders(Loc::BUR),
+            expected.get_state().get_possible_orders(Loc::BUR));
+
+  // leader was not processed from follower's state
+  follower.process_like(leader);
+  EXPECT_EQ(follower.get_state().get_phase().to_string(), "F1902M");
+
+  // A follower that stalemates does not end the leader's game
+  Game no_draw(-1), draw(1);
+  for (Game *game : {&no_draw, &draw}) {
+    game->process();
+  }
+  no_draw.process();
+  draw.process_like(no_draw);
+  EXPECT_TRUE(draw.is_game_done());
+  EXPECT_FALSE(no_draw.is_game_done());
+}
+
+TEST_F(GameTest, TestApplyUndo) {
+  // Step into an R phase and out of it in place, then back to the start
+  Game game;
+  game.set_orders("FRANCE", {"A PAR - BUR"});
+  game.set_orders("GERMANY", {"A MUN - RUH", "A BER - MUN"});
+  game.process();
+  GameState state(game.get_state());
+  json start = state.to_json();
+  size_t start_hash = state.compute_board_hash();
+
+  PowerMap<vector<Order>> moves, retreats;
+  moves[Power::GERMANY] = {Order("A RUH - BUR"), Order("A MUN S A RUH - BUR")};
+  retreats[Power::FRANCE] = {Order("A BUR R PIC")};
+  GameState expected_r = state.process(moves);
+  GameState expected_m = expected_r.process(retreats);
+
+  UndoRecord undo_m, undo_r;
+  state.apply(moves, undo_m);
+  ASSERT_EQ(state.get_phase().to_string(), "F1901R");
+  EXPECT_EQ(state.to_json(), expected_r.to_json());
+  EXPECT_EQ(state.compute_board_hash(), expected_r.compute_board_hash());
+  state.apply(retreats, undo_r);
+  EXPECT_EQ(state.to_json(), expected_m.to_json());
+  EXPECT_EQ(state.compute_board_hash(), expected_m.compute_board_hash());
+  EXPECT_LE(undo_r.units.size(), 2);
+
+  state.undo(undo_r);
+  EXPECT_EQ(state.to_json(), expected_r.to_json());
+  state.undo(undo_m);
+  EXPECT_EQ(state.to_json(), start);
+  EXPECT_EQ(state.compute_board_hash(), start_hash);
+}
+
+TEST_F(GameTest, TestAdjustmentsValidatedDirectly) {
+  GameState state;
+  state.set_phase(Phase("W1901A"));
+  for (Loc loc : {Loc::BUD, Loc::VIE, Loc::TRI, Loc::SER}) {
+    state.set_center(loc, Power::AUSTRIA);
+  }
+  state.set_unit(Power::AUSTRIA, UnitType::ARMY, Loc::SER);
+  state.set_unit(Power::AUSTRIA, UnitType::FLEET, Loc::TRI);
+  state.set_unit(Power::AUSTRIA, UnitType::ARMY, Loc::VIE);
+  state.set_unit(Power::GERMANY, UnitType::ARMY, Loc::MUN); // no centers
+  EXPECT_FALSE(state.is_forced_phase());
+
+  // Another power's build in an Austrian home is ignored
+  PowerMap<vector<Order>> orders;
+  orders[Power::AUSTRIA] = {Order("F BUD B")}; // inland
+  orders[Power::ENGLAND] = {Order("A BUD B")};
+  GameState next = state.process(orders);
+  EXPECT_EQ(next.get_unit(Loc::BUD).type, UnitType::NONE);
+  EXPECT_EQ(next.get_unit(Loc::MUN).type, UnitType::NONE); // civil disorder
+
+  orders[Power::AUSTRIA] = {Order("A BUD B")};
+  next = state.process(orders);
+  EXPECT_EQ(next.get_unit(Loc::BUD).power, Power::AUSTRIA);
+
+  // With BUD occupied, Austria has nothing to build and Germany must
+  // disband its only unit
+  state.set_unit(Power::AUSTRIA, UnitType::ARMY, Loc::BUD);
+  EXPECT_TRUE(state.is_forced_phase());
+}
+
+TEST_F(GameTest, TestMovementValidatedDirectly) {
+  // Convoy chains, split coasts and units of every power
+  GameState convoys;
+  convoys.set_phase(Phase("S1901M"));
+  convoys.set_unit(Power::ENGLAND, UnitType::ARMY, Loc::LON);
+  convoys.set_unit(Power::ENGLAND, UnitType::FLEET, Loc::NTH);
+  convoys.set_unit(Power::ENGLAND, UnitType::FLEET, Loc::ENG);
+  convoys.set_unit(Power::FRANCE, UnitType::ARMY, Loc::BRE);
+  convoys.set_unit(Power::FRANCE, UnitType::FLEET, Loc::MAO);
+  convoys.set_unit(Power::FRANCE, UnitType::FLEET, Loc::SPA_NC);
+  convoys.set_unit(Power::ITALY, UnitType::ARMY, Loc::TUN);
+  convoys.set_unit(Power::ITALY, UnitType::FLEET, Loc::TYS);
+  convoys.set_unit(Power::TURKEY, UnitType::FLEET, Loc::BUL_SC);
+  convoys.set_unit(Power::TURKEY, UnitType::FLEET, Loc::BLA);
+  convoys.set_unit(Power::TURKEY, UnitType::ARMY, Loc::CON);
+  convoys.set_unit(Power::RUSSIA, UnitType::FLEET, Loc::STP_SC);
+
+  // and the movement phases of a game with arbitrary orders
+  vector<GameState> states{convoys};
+  Game game;
+  for (int phase = 0; phase < 12 && !game.is_game_done(); ++phase) {
+    GameState &state = game.get_state();
+    if (state.get_phase().phase_type == 'M') {
+      states.push_back(state);
+      PowerMap<vector<string>> orders;
+      int i = 0;
+      for (const auto &it : state.get_units()) {
+        const set<Order> &loc_orders = state.get_possible_orders(it.first);
+        auto order_it = loc_orders.begin();
+        std::advance(order_it, (i++ * 31 + phase * 7) % loc_orders.size());
+        orders[it.second.power].push_back(order_it->to_string());
+      }
+      for (const auto & [ power, power_orders ] : orders) {
+        game.set_orders(power_str(power), power_orders);
+      }
+    }
+    game.process();
+  }
+
+  for (GameState &state : states) {
+    const auto &all_possible_orders = state.get_all_possible_orders();
+    for (const auto &it : state.get_units()) {
+      const set<Order> &possible = all_possible_orders.at(it.first);
+      // Each possible order, and its variants with any other dest, target
+      // or via, which are mostly not possible
+      for (const Order &order : possible) {
+        Unit unit = order.get_unit();
+        Unit target = order.get_target();
+        vector<Order> orders{order, order.with_via(!order.get_via())};
+        for (Loc loc : LOCS) {
+          orders.push_back(Order(unit, order.get_type(), target, loc,
+                                 order.get_via()));
+          orders.push_back(Order(unit, order.get_type(), {target.type, loc},
+                                 order.get_dest(), order.get_via()));
+          orders.push_back(Order(unit, OrderType::C, {UnitType::ARMY, loc},
+                                 order.get_dest()));
+        }
+        for (const Order &x : orders) {
+          EXPECT_EQ(state.is_valid_movement(x), possible.count(x) == 1)
+              << state.get_phase().to_string() << " " << x.to_string();
+        }
+      }
+    }
+  }
+}
+
+TEST_F(GameTest, TestLazyPossibleOrders) {
+  Game eager;
+  Game lazy;
+  lazy.set_lazy_possible_orders(true);
+
+  for (int phase = 0; phase < 12 && !eager.is_game_done(); ++phase) {
+    ASSERT_EQ(eager.compute_board_hash(), lazy.compute_board_hash());
+    const auto &all_possible_orders = eager.get_all_possible_orders();
+    if (lazy.get_state().get_phase().phase_type == 'M') {
+      for (const auto &it : lazy.get_state().get_units()) {
+        EXPECT_EQ(lazy.get_state().get_possible_orders(it.first),
+                  all_possible_orders.at(it.first))
+            << loc_str(it.first);
+      }
+    }
+
+    int i = 0;
+    for (const auto & [ power, locs ] : eager.get_orderable_locations()) {
+      vector<string> orders;
+      for (Loc root : locs) {
+        // orderable locations are rooted, possible orders are not
+        Loc loc = root;
+        for (Loc coast : expand_coasts(root)) {
+          if (all_possible_orders.find(coast) != all_possible_orders.end()) {
+            loc = coast;
+          }
+        }
+        const set<Order> &loc_orders = all_possible_orders.at(loc);
+        auto order_it = loc_orders.begin();
+        std::advance(order_it, (i++ * 31 + phase * 7) % loc_orders.size());
+        orders.push_back(order_it->to_string());
+      }
+      eager.set_orders(power_str(power), orders);
+      lazy.set_orders(power_str(power), orders);
+    }
+    eager.process();
+    lazy.process();
+  }
+  EXPECT_EQ(eager.compute_board_hash(), lazy.compute_board_hash());
+  EXPECT_EQ(eager.get_state().get_phase(), lazy.get_state().get_phase());
+}
+
+TEST_F(GameTest, TestConcurrentPossibleOrders) {
+  Game game;
+  for (int phase = 0; phase < 6 && !game.is_game_done(); ++phase) {
+    const auto expected = game.get_all_possible_orders();
+    GameState state(game.get_state());
+    state.clear_all_possible_orders();
+
+    // Threads alternately load the orders of one loc (lazily, in M-phases)
+    // and all orders, racing to load them first
+    vector<thread> threads;
+    vector<int> n_mismatches(4, 0);
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&state, &expected, &n_mismatches, t]() {
+        for (const auto &it : expected) {
+          if (t % 2 == 0 &&
+              !(state.get_possible_orders(it.first) == it.second)) {
+            ++n_mismatches[t];
+          }
+          if (!(state.get_all_possible_orders().at(it.first) == it.second)) {
+            ++n_mismatches[t];
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    EXPECT_THAT(n_mismatches, testing::Each(0))
+        << game.get_state().get_phase().to_string();
+    game.process();
+  }
+}
+
+TEST_F(GameTest, TestConcurrentSiblingPossibleOrders) {
+  GameGenOptions options;
+  options.n_phases = 12;
+  Game game = generate_game(options, 0);
+  for (auto &it : game.get_state_history()) {
+    if (it.second->get_phase().phase_type != 'M') {
+      continue;
+    }
+    GameState eager(*it.second);
+    const auto &all_possible_orders = eager.get_all_possible_orders();
+    GameState parent(*it.second);
+    parent.clear_all_possible_orders();
+
+    // Each thread processes the parent lazily with its own orders, then
+    // loads its child's possible orders from the parent's, while the other
+    // threads add to the parent's
+    const int n_threads = 4;
+    vector<GameState> children(n_threads);
+    vector<map<Loc, set<Order>>> lazy(n_threads);
+    vector<thread> threads;
+    for (int t = 0; t < n_threads; ++t) {
+      threads.emplace_back([&, t]() {
+        PowerMap<vector<Order>> orders;
+        int i = t;
+        for (const auto &unit : eager.get_units()) {
+          const set<Order> &loc_orders = all_possible_orders.at(unit.first);
+          auto order_it = loc_orders.begin();
+          std::advance(order_it, (i++ * 7) % loc_orders.size());
+          orders[unit.second.power].push_back(*order_it);
+        }
+        children[t] = parent.process(orders, false, true);
+        if (children[t].get_phase().phase_type != 'M') {
+          return;
+        }
+        for (const auto &unit : children[t].get_units()) {
+          parent.get_possible_orders(unit.first);
+          lazy[t][unit.first] = children[t].get_possible_orders(unit.first);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    for (int t = 0; t < n_threads; ++t) {
+      GameState child(children[t]);
+      child.clear_all_possible_orders();
+      for (const auto & [ loc, orders ] : lazy[t]) {
+        EXPECT_EQ(orders, child.get_all_possible_orders().at(loc))
+            << it.first.to_string() << " " << loc_str(loc);
+      }
+    }
+  }
+}
+
+TEST_F(GameTest, TestOrderId) {
+  Game game;
+  vector<Order> orders;
+  for (const auto &it : game.get_all_possible_orders()) {
+    orders.insert(orders.end(), it.second.begin(), it.second.end());
+  }
+  orders.push_back(Order("F STP/SC - BOT"));
+  orders.push_back(Order("A PAR - BRE VIA"));
+  orders.push_back(Order("A PAR B"));
+
+  for (const Order &a : orders) {
+    EXPECT_EQ(Order::from_id(a.get_id()).to_string(), a.to_string());
+    for (const Order &b : orders) {
+      EXPECT_EQ(a < b, a.to_tuple() < b.to_tuple());
+    }
+  }
+  EXPECT_EQ(Order("F STP/SC - BOT").without_coasts(), Order("F STP - BOT"));
+}
+
+TEST_F(GameTest, TestCopySharesHistory) {
+  Game game;
+  for (int i = 0; i < 4; ++i) {
+    game.add_message(Power::FRANCE, Power::ENGLAND, "hi", i + 1);
+    game.process();
+  }
+  string game_json = game.to_json();
+
+  Game copy(game);
+  copy.add_message(Power::FRANCE, Power::ENGLAND, "bye", 100);
+  copy.set_orders("FRANCE", {"A PAR - BUR"});
+  copy.process();
+  copy.process();
+
+  // The original is unchanged
+  EXPECT_EQ(game.to_json(), game_json);
+  EXPECT_EQ(game.get_state_history().size(), 4);
+  EXPECT_EQ(copy.get_state_history().size(), 6);
+  EXPECT_EQ(copy.get_message_history()[game.get_state().get_phase()].size(),
+            1);
+  EXPECT_EQ(game.get_message_history()[game.get_state().get_phase()].size(),
+            0);
+
+  // Rolling back the copy restores the original
+  Game rolled_back =
+      copy.rolled_back_to_phase_start(game.get_state().get_phase().to_string());
+  EXPECT_EQ(rolled_back.to_json(), game_json);
+}
+
+TEST_F(GameTest, TestToJsonMemoizedPhasesInvalidated) {
+  Game game;
+  game.add_message(Power::FRANCE, Power::ENGLAND, "hi", 1);
+  game.add_message(Power::FRANCE, Power::ENGLAND, "later", 5);
+  game.process();
+  game.process();
+  game.to_json(); // memoizes the completed phases
+
+  // Replaying a phase with other orders
+  Game replayed = game.rolled_back_to_phase_start("S1901M");
+  replayed.set_orders("FRANCE", {"A PAR - BUR"});
+  replayed.process();
+  string replayed_json = replayed.to_json();
+  EXPECT_NE(replayed_json.find("A PAR - BUR"), string::npos);
+  EXPECT_EQ(Game(replayed_json).to_json(), replayed_json);
+
+  // Dropping messages of a completed phase
+  game.rollback_messages_to_timestamp(2);
+  string game_json = game.to_json();
+  EXPECT_EQ(game_json.find("later"), string::npos);
+  EXPECT_EQ(Game(game_json).to_json(), game_json);
+}
+
+TEST_F(GameTest, TestRollbackMessagesToTimestamp) {
+  Game game;
+  game.add_message(Power::FRANCE, Power::ENGLAND, "a", 1);
+  game.add_message(Power::FRANCE, Power::ENGLAND, "b", 3);
+  game.process();
+  game.add_message(Power::ENGLAND, Power::FRANCE, "c", 5);
+  game.add_message(Power::ENGLAND, Power::FRANCE, "d", 7);
+
+  Game clone(game);
+  game.rollback_messages_to_timestamp(5);
+  auto &history = game.get_message_history();
+  EXPECT_EQ(history.get(Phase("S1901M")).size(), 2);
+  EXPECT_EQ(history.get(Phase("F1901M")).size(), 1);
+  EXPECT_EQ(clone.get_message_history().get(Phase("F1901M")).size(), 2);
+
+  game.rollback_messages_to_timestamp(2);
+  EXPECT_EQ(history.get(Phase("S1901M")).size(), 1);
+  EXPECT_EQ(history.get(Phase("F1901M")).size(), 0);
+  EXPECT_EQ(clone.get_message_history().get(Phase("S1901M")).size(), 2);
+}
+
+TEST_F(GameTest, TestFromJsonLazy) {
+  Game game;
+  game.add_message(Power::FRANCE, Power::ENGLAND, "hi \"there\"", 1);
+  for (int i = 0; i < 6; ++i) {
+    game.process();
+  }
+  string game_json = game.to_json();
+
+  Game lazy = Game::from_json_lazy(game_json, 1);
+  EXPECT_EQ(lazy.get_state().get_phase(), game.get_state().get_phase());
+  EXPECT_LT(lazy.get_recent_order_history().size(),
+            game.get_order_history().size());
+  EXPECT_EQ(lazy.get_last_movement_phase()->get_phase(),
+            game.get_last_movement_phase()->get_phase());
+
+  Game copy(lazy);
+  EXPECT_EQ(copy.get_state_history().size(), game.get_state_history().size());
+  EXPECT_EQ(copy.to_json(), game_json);
+  EXPECT_EQ(lazy.to_json(), game_json);
+}
+
+TEST_F(GameTest, TestPrevPhaseEncodingReset) {
+  Game game;
+  game.process();
+  game.set_prev_phase_encoding(
+      std::make_shared<PrevPhaseEncoding>(PrevPhaseEncoding{1, {}, {}}));
+
+  Game copy(game);
+  EXPECT_EQ(copy.get_prev_phase_encoding(), game.get_prev_phase_encoding());
+  copy.process();
+  EXPECT_EQ(copy.get_prev_phase_encoding(), nullptr);
+  EXPECT_NE(game.get_prev_phase_encoding(), nullptr);
+
+  Game rolled_back = game.rolled_back_to_phase_start("S1901M");
+  EXPECT_EQ(rolled_back.get_prev_phase_encoding(), nullptr);
+}
+
+TEST_F(GameTest, TestBatchHolds) {
+  Game game;
+  GameBatchHolds &holds = game.get_batch_holds();
+  EXPECT_TRUE(holds.try_acquire(false));
+  EXPECT_TRUE(holds.try_acquire(false));
+  EXPECT_FALSE(holds.try_acquire(true));
+  EXPECT_THROW(game.check_not_held(), std::exception);
+
+  Game copy(game);
+  EXPECT_NO_THROW(copy.check_not_held());
+
+  holds.release(false);
+  holds.release(false);
+  EXPECT_TRUE(holds.try_acquire(true));
+  EXPECT_FALSE(holds.try_acquire(false));
+  holds.release(true);
+  EXPECT_NO_THROW(game.check_not_held());
+}
+
+TEST_F(GameTest, TestRolloutMode) {
+  for (int draw_on_stalemate_years : {-1, 2}) {
+    Game game(draw_on_stalemate_years);
+    Game rollout(game);
+    rollout.set_rollout_mode(true);
+    rollout.add_message(Power::FRANCE, Power::ENGLAND, "hi", 1);
+    EXPECT_EQ(rollout.get_message_history().size(), 0);
+
+    for (int i = 0; i < 20 && !game.is_game_done(); ++i) {
+      game.set_orders("FRANCE", {"A PAR - BUR", "A BUR - PAR"});
+      rollout.set_orders("FRANCE", {"A PAR - BUR", "A BUR - PAR"});
+      game.process();
+      rollout.process();
+      EXPECT_EQ(rollout.get_state().get_phase(), game.get_state().get_phase());
+      EXPECT_EQ(rollout.compute_board_hash(), game.compute_board_hash());
+      EXPECT_LE(rollout.get_state_history().size(), 5);
+      EXPECT_EQ(rollout.get_last_movement_phase()->get_phase(),
+                game.get_last_movement_phase()->get_phase());
+    }
+    EXPECT_EQ(rollout.is_game_done(), draw_on_stalemate_years > 0);
+  }
+}
+
+TEST_F(GameTest, TestBinaryRoundTrip) {
+  Game game;
+  game.add_message(Power::FRANCE, Power::GERMANY, "hi", 1);
+  game.add_log("log");
+  game.set_orders("FRANCE", {"A PAR - BUR"});
+  game.set_orders("GERMANY", {"A MUN - RUH", "A BER - MUN"});
+  game.process();
+  game.set_orders("GERMANY", {"A RUH - BUR", "A MUN S A RUH - BUR"});
+  game.process();
+  ASSERT_EQ(game.get_state().get_phase().to_string(), "F1901R");
+  game.add_message(Power::GERMANY, Power::FRANCE, "sorry", 2);
+  game.set_orders("FRANCE", {"A BUR R PIC"});
+
+  string bytes = game.to_bytes();
+  Game loaded = Game::from_bytes(bytes);
+  EXPECT_EQ(loaded.to_json(), game.to_json());
+  EXPECT_EQ(loaded.to_bytes(), bytes);
+  EXPECT_LT(bytes.size(), game.to_json().size());
+
+  // States loaded from json keep their retreat orders
+  Game from_json(game.to_json());
+  EXPECT_EQ(Game::from_bytes(from_json.to_bytes()).to_json(), game.to_json());
+
+  EXPECT_THROW(Game::from_bytes(bytes.substr(0, bytes.size() - 1)),
+               std::exception);
+}
+
+TEST_F(GameTest, TestCompactHistory) {
+  GameGenOptions options;
+  options.n_phases = 60;
+  options.attack_rate = 0.5;
+  Game game = generate_game(options, 1);
+  string json = game.to_json();
+  string bytes = game.to_bytes();
+  auto history = game.get_state_history();
+  size_t state_bytes = game.memory_usage()["state"];
+
+  Game compact(game);
+  compact.compact_history(4);
+  MemoryUsage usage = compact.memory_usage();
+  EXPECT_LT(usage["state"] + usage["compact_states"], state_bytes / 4);
+
+  // Each state is decoded on its own, or all on access to the history
+  for (auto &it : history) {
+    auto state = compact.get_history_state(it.first);
+    ASSERT_NE(state, nullptr) << it.first.to_string();
+    EXPECT_EQ(state->get_phase(), it.first);
+    EXPECT_EQ(state->compute_board_hash(), it.second->compute_board_hash());
+  }
+  EXPECT_EQ(compact.get_history_state(Phase("S1950M")), nullptr);
+  EXPECT_EQ(Game::from_bytes(compact.to_bytes()).to_json(), json);
+  EXPECT_EQ(compact.to_json(), json);
+
+  // Keeps processing the same
+  Game compact2(game);
+  compact2.compact_history();
+  Game stepped(game);
+  for (Game *g : {&compact2, &stepped}) {
+    g->set_draw_on_stalemate_years(2);
+    g->process();
+    g->process();
+  }
+  EXPECT_EQ(compact2.compute_board_hash(), stepped.compute_board_hash());
+  EXPECT_EQ(compact2.to_bytes(), stepped.to_bytes());
+
+  // Delta-encoded on disk: smaller than the boards alone, in full
+  EXPECT_LT(bytes.size(), history.size() * 2 * N_LOC_SLOTS);
+  EXPECT_EQ(Game::from_bytes(bytes).to_json(), json);
+}
+
+TEST_F(GameTest, TestPhaseOrders) {
+  PowerMap<vector<Order>> orders;
+  orders[Power::FRANCE] = {Order("A PAR - BUR"), Order("F BRE - MAO")};
+  orders[Power::GERMANY] = {};
+  orders[Power::AUSTRIA] = {Order("A VIE H")};
+  PhaseOrders packed(orders);
+  EXPECT_TRUE(packed == orders);
+  EXPECT_EQ(packed.to_power_map(), orders);
+  EXPECT_EQ(packed.size(), 3);
+  EXPECT_EQ(packed.n_orders(), 3);
+  EXPECT_TRUE(packed.contains(Power::GERMANY));
+  EXPECT_FALSE(packed.contains(Power::ITALY));
+  EXPECT_EQ(packed.get(Power::FRANCE).to_vector(), orders[Power::FRANCE]);
+  EXPECT_TRUE(packed.get(Power::ITALY).empty());
+  orders[Power::GERMANY].push_back(Order("A MUN H"));
+  EXPECT_TRUE(packed != orders);
+
+  // Memoized for the first encoder only
+  int n_calls = 0;
+  auto vocab_idx = [&](const Order &order) {
+    ++n_calls;
+    return order.get_type() == OrderType::H ? -1 : 7;
+  };
+  vector<int32_t> scratch;
+  vector<int32_t> expected = {-1, 7, 7};
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(packed.get_vocab_idxs(1, vocab_idx, scratch), expected);
+  }
+  EXPECT_EQ(PhaseOrders(packed).get_vocab_idxs(1, vocab_idx, scratch),
+            expected);
+  EXPECT_EQ(n_calls, 3);
+  EXPECT_EQ(&packed.get_vocab_idxs(2, vocab_idx, scratch), &scratch);
+  EXPECT_EQ(n_calls, 6);
+}
+
+TEST_F(GameTest, TestBinaryOptions) {
+  Game game;
+  for (int i = 0; i < 8; ++i) {
+    game.add_message(Power::FRANCE, Power::GERMANY, "hi", i + 1);
+    game.add_log("log");
+    game.set_orders("FRANCE", {i % 2 == 0 ? "A PAR - BUR" : "A BUR - PAR"});
+    game.process();
+  }
+  ASSERT_EQ(game.get_state().get_phase().to_string(), "S1905M");
+
+  GameBytesOptions options;
+  options.messages = false;
+  options.logs = false;
+  options.full_history = false;
+  string bytes = game.to_bytes(options);
+  EXPECT_LT(bytes.size(), game.to_bytes().size() / 2);
+  Game loaded = Game::from_bytes(bytes);
+  EXPECT_EQ(loaded.get_message_history().size(), 0);
+  EXPECT_EQ(loaded.get_state_history().size(), 1);
+  EXPECT_EQ(loaded.get_state_history().begin()->first.to_string(), "F1904M");
+
+  // Same as the history kept in rollout mode, which still processes the same
+  Game rollout(game);
+  rollout.set_rollout_mode(true);
+  EXPECT_EQ(loaded.to_json(), rollout.to_json());
+  game.set_orders("FRANCE", {"A PAR - BUR"});
+  loaded.set_orders("FRANCE", {"A PAR - BUR"});
+  game.process();
+  loaded.process();
+  EXPECT_EQ(loaded.compute_board_hash(), game.compute_board_hash());
+  EXPECT_EQ(loaded.get_last_movement_phase()->get_phase(),
+            game.get_last_movement_phase()->get_phase());
+}
+
 TEST_F(GameTest, TestGameRollback) {
   Game game;
   game.set_orders("FRANCE", {"A PAR - BUR"});
@@ -288,4 +1048,204 @@ TEST_F(GameTest, TestGameRollbackMessages) {
             "W1903A"); // move preserved so W phase
 }
 
+TEST_F(GameTest, TestRollbackInPlaceAndRestore) {
+  Game game;
+  game.set_orders("RUSSIA", {"F SEV - RUM"});
+  game.process();
+  game.add_message(Power::RUSSIA, Power::TURKEY, "hi Turkey, it's F1901M");
+  game.set_orders("RUSSIA", {"A WAR - GAL"});
+  string game_json = game.to_json();
+  GameSnapshot snapshot = game.snapshot();
+
+  // In place, same as the copying versions
+  Game expected_end = game.rolled_back_to_phase_end("S1901M");
+  Game expected_start = game.rolled_back_to_phase_start("S1901M");
+  game.rollback_to_phase_end("S1901M");
+  EXPECT_EQ(game.to_json(), expected_end.to_json());
+  game.rollback_to_phase_start("S1901M");
+  EXPECT_EQ(game.to_json(), expected_start.to_json());
+  EXPECT_EQ(game.get_staged_orders().size(), 0);
+
+  // Branch from S1901M, then back to F1901M with its staged orders
+  game.set_orders("TURKEY", {"F ANK - BLA"});
+  game.process();
+  game.process();
+  EXPECT_EQ(game.get_state().get_phase().to_string(), "S1902M");
+  game.restore(snapshot);
+  EXPECT_EQ(game.to_json(), game_json);
+  EXPECT_EQ(game.get_staged_orders().at(Power::RUSSIA).size(), 1);
+  game.process();
+  EXPECT_EQ(game.get_state().get_unit(Loc::GAL).power, Power::RUSSIA);
+
+  // The snapshot is unchanged, and can be restored again
+  game.restore(snapshot);
+  EXPECT_EQ(game.to_json(), game_json);
+}
+
+TEST_F(GameTest, TestTryProcessConvoyParadox) {
+  // DATC 6.F.14, simple convoy paradox
+  Game game;
+  LocMap<OwnedUnit> units;
+  units[Loc::LON] = {Power::ENGLAND, UnitType::FLEET, Loc::LON};
+  units[Loc::WAL] = {Power::ENGLAND, UnitType::FLEET, Loc::WAL};
+  units[Loc::BRE] = {Power::FRANCE, UnitType::ARMY, Loc::BRE};
+  units[Loc::ENG] = {Power::FRANCE, UnitType::FLEET, Loc::ENG};
+  game.get_state().set_units(units);
+  game.get_state().clear_all_possible_orders();
+  game.set_orders("ENGLAND", {"F LON S F WAL - ENG", "F WAL - ENG"});
+  game.set_orders("FRANCE", {"A BRE - LON", "F ENG C A BRE - LON"});
+
+  // Resolved by the Szykman rule
+  Game resolved(game);
+  EXPECT_EQ(resolved.try_process(), ProcessStatus::OK);
+  EXPECT_EQ(resolved.get_state().get_phase().to_string(), "S1901R");
+
+  game.set_exception_on_convoy_paradox();
+  string game_json = game.to_json();
+  EXPECT_EQ(game.try_process(), ProcessStatus::CONVOY_PARADOX);
+  EXPECT_EQ(game.to_json(), game_json);
+  EXPECT_THROW(game.process(), ConvoyParadoxException);
+  EXPECT_EQ(game.to_json(), game_json);
+}
+
+TEST_F(GameTest, TestWriteSquareScores) {
+  Game game;
+  float scores[7], sc_counts[7];
+  game.write_square_scores(scores, sc_counts);
+
+  vector<float> expected = game.get_square_scores();
+  float total = 0;
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_FLOAT_EQ(scores[i], expected[i]);
+    total += sc_counts[i];
+  }
+  EXPECT_EQ(sc_counts[static_cast<int>(Power::RUSSIA) - 1], 4);
+  EXPECT_EQ(sc_counts[static_cast<int>(Power::ITALY) - 1], 3);
+  EXPECT_EQ(total, 22);
+}
+
+TEST_F(GameTest, TestWriteSosTargets) {
+  GameGenOptions options;
+  options.n_phases = 30;
+  options.attack_rate = 0.5;
+  Game game = generate_game(options, 0);
+  vector<Phase> phases;
+  vector<vector<float>> scores;
+  for (auto &it : game.get_state_history()) {
+    phases.push_back(it.first);
+    scores.push_back(it.second->get_square_scores());
+  }
+  vector<float> final_scores = game.get_square_scores();
+  size_t n = phases.size();
+
+  for (float alpha : {0.0f, 0.5f, 1.0f}) {
+    vector<float> targets(n * 7);
+    game.write_sos_targets(alpha, targets.data());
+
+    // As dataset.py's encode_weighted_sos_scores, phase by phase
+    for (size_t k = 0; k < n; ++k) {
+      vector<float> expected = scores[k];
+      if (k + 1 < n) {
+        expected.assign(7, 0);
+        float remaining = 1, weight = 1 - alpha;
+        for (size_t j = k + 1; j < n; ++j) {
+          if (j + 1 < n && phases[j + 1].year == phases[j].year) {
+            continue;
+          }
+          for (int p = 0; p < 7; ++p) {
+            expected[p] += weight * scores[j][p];
+          }
+          remaining -= weight;
+          weight *= alpha;
+        }
+        for (int p = 0; p < 7; ++p) {
+          expected[p] += remaining * final_scores[p];
+        }
+      }
+      for (int p = 0; p < 7; ++p) {
+        EXPECT_NEAR(targets[k * 7 + p], expected[p], 1e-5)
+            << alpha << " " << phases[k].to_string();
+      }
+    }
+  }
+}
+
+TEST_F(GameTest, TestWriteBoardArrays) {
+  Game game;
+  int8_t unit_types[81], unit_owners[81], center_owners[34];
+  game.get_state().write_unit_arrays(unit_types, unit_owners);
+  game.get_state().write_center_owners(center_owners);
+
+  size_t stp_sc = static_cast<size_t>(Loc::STP_SC) - 1;
+  EXPECT_EQ(unit_types[stp_sc], 1);
+  EXPECT_EQ(unit_owners[stp_sc], static_cast<int>(Power::RUSSIA) - 1);
+  EXPECT_EQ(unit_types[static_cast<size_t>(Loc::STP) - 1], -1);
+  EXPECT_EQ(unit_types[static_cast<size_t>(Loc::PAR) - 1], 0);
+  EXPECT_EQ(unit_owners[static_cast<size_t>(Loc::BUR) - 1], -1);
+  EXPECT_EQ(std::count(unit_types, unit_types + 81, -1), 81 - 22);
+
+  ASSERT_EQ(SC_LOCS.size(), 34);
+  for (size_t i = 0; i < SC_LOCS.size(); ++i) {
+    if (SC_LOCS[i] == Loc::STP) {
+      EXPECT_EQ(center_owners[i], static_cast<int>(Power::RUSSIA) - 1);
+    } else if (SC_LOCS[i] == Loc::BEL) {
+      EXPECT_EQ(center_owners[i], -1);
+    }
+  }
+  EXPECT_EQ(std::count(center_owners, center_owners + 34, -1), 34 - 22);
+}
+
+TEST_F(GameTest, TestMemoryUsage) {
+  Game game;
+  game.set_orders("FRANCE", {"F BRE - MAO", "A PAR - BUR"});
+  game.process();
+  game.get_all_possible_orders();
+  MemoryUsage usage = game.memory_usage();
+  EXPECT_GT(usage["state"], 0);
+  EXPECT_GT(usage["orders"], 0);
+  EXPECT_EQ(usage["messages"], 0);
+
+  // Copies share their history and past states
+  Game copy(game);
+  MemoryUsage both;
+  MemorySeen seen;
+  game.add_memory_usage(both, seen);
+  copy.add_memory_usage(both, seen);
+  EXPECT_EQ(both["orders"], usage["orders"]);
+  EXPECT_EQ(both["possible_orders"], usage["possible_orders"]);
+  EXPECT_GT(both["game"], usage["game"]);
+
+  game.clear_old_all_possible_orders();
+  EXPECT_LT(game.memory_usage()["possible_orders"], usage["possible_orders"]);
+}
+
+TEST_F(GameTest, TestEvictOldPossibleOrders) {
+  auto possible_orders_bytes = [](Game &game, const char *phase) {
+    return game.get_state_history().at(Phase(phase))->memory_usage().at(
+        "possible_orders");
+  };
+
+  Game game;
+  game.process();
+  game.process();
+  EXPECT_EQ(game.get_state().get_phase(), Phase("S1902M"));
+  size_t loaded = possible_orders_bytes(game, "F1901M");
+  EXPECT_LT(possible_orders_bytes(game, "S1901M"), loaded / 2);
+
+  // States shared with a copy are kept
+  Game copy(game);
+  copy.process();
+  EXPECT_EQ(possible_orders_bytes(copy, "F1901M"), loaded);
+
+  // Evicted orders are regenerated on demand
+  auto state = game.get_state_history().at(Phase("S1901M"));
+  EXPECT_FALSE(state->get_all_possible_orders().empty());
+
+  Game no_evict;
+  no_evict.set_evict_old_possible_orders(false);
+  no_evict.process();
+  no_evict.process();
+  EXPECT_GT(possible_orders_bytes(no_evict, "S1901M"), loaded / 2);
+}
+
 } // namespace dipcc
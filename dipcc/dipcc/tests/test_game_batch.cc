@@ -0,0 +1,120 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/game.h"
+#include "../cc/game_batch.h"
+#include "../cc/orders_encoder.h"
+#include "../cc/thread_pool.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class GameBatchTest : public ::testing::Test {
+protected:
+  GameBatchTest()
+      : pool_(2, {{"A PAR - BUR", 0}, {"A MUN - RUH", 1}, {"F BRE - MAO", 2}},
+              469) {}
+
+  // [2, 7, S] order idxs: FRANCE moves A PAR - BUR in game 0, GERMANY
+  // A MUN - RUH in game 1, other powers order nothing
+  static torch::Tensor make_order_idxs() {
+    torch::Tensor r = torch::full({2, 7, OrdersEncoder::MAX_SEQ_LEN},
+                                  OrdersEncoder::EOS_IDX, torch::kLong);
+    r[0][static_cast<int>(Power::FRANCE) - 1][0] = 0;
+    r[1][static_cast<int>(Power::GERMANY) - 1][0] = 1;
+    return r;
+  }
+
+  // The games of make_order_idxs, stepped one by one
+  static vector<Game> step_each(const Game &a, const Game &b) {
+    vector<Game> r = {a, b};
+    r[0].set_orders("FRANCE", {"A PAR - BUR"});
+    r[1].set_orders("GERMANY", {"A MUN - RUH"});
+    for (Game &game : r) {
+      game.process();
+    }
+    return r;
+  }
+
+  void expect_equal(TensorDict r, TensorDict expected) {
+    ASSERT_EQ(r.size(), expected.size());
+    for (auto &it : expected) {
+      ASSERT_TRUE(r.count(it.first)) << it.first;
+      EXPECT_TRUE(torch::equal(r[it.first], it.second)) << it.first;
+    }
+  }
+
+  ThreadPool pool_;
+};
+
+TEST_F(GameBatchTest, TestStepAndEncode) {
+  Game a, b;
+  b.process();
+  GameBatch batch({a, b});
+  TensorDict r = batch.step_and_encode(pool_, make_order_idxs());
+
+  vector<Game> expected = step_each(a, b);
+  GameBatch expected_batch(expected);
+  expect_equal(r, expected_batch.encode_inputs(pool_));
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_EQ(batch.at(i).get_state().get_phase(),
+              expected[i].get_state().get_phase());
+    EXPECT_EQ(batch.at(i).get_state().get_units(),
+              expected[i].get_state().get_units());
+  }
+  EXPECT_EQ(batch.at(0).get_state().get_unit(loc_from_str("BUR")).power,
+            Power::FRANCE);
+  EXPECT_EQ(batch.at(1).get_state().get_unit(loc_from_str("RUH")).power,
+            Power::GERMANY);
+}
+
+TEST_F(GameBatchTest, TestSetOrdersAndProcess) {
+  Game a, b;
+  b.process();
+  GameBatch batch({a, b});
+  batch.set_orders_from_idxs(pool_, make_order_idxs());
+  batch.process(pool_);
+
+  vector<Game> expected = step_each(a, b);
+  GameBatch expected_batch(expected);
+  expect_equal(batch.encode_inputs(pool_), expected_batch.encode_inputs(pool_));
+  expect_equal(batch.encode_inputs_all_powers(pool_),
+               expected_batch.encode_inputs_all_powers(pool_));
+  EXPECT_TRUE(torch::equal(batch.get_square_scores(),
+                           expected_batch.get_square_scores()));
+  EXPECT_TRUE(torch::equal(batch.get_scores(pool_),
+                           pool_.get_scores_multi(
+                               expected_batch.get_game_ptrs())));
+  EXPECT_FALSE(batch.get_is_done().any().item<bool>());
+}
+
+TEST_F(GameBatchTest, TestClonesAndSelect) {
+  Game game;
+  game.process();
+  GameBatch batch(pool_, game, 3);
+  ASSERT_EQ(batch.size(), 3);
+  TensorDict r = batch.encode_inputs(pool_);
+  TensorDict one = GameBatch({game}).encode_inputs(pool_);
+  for (auto &it : one) {
+    for (long i = 0; i < 3; ++i) {
+      EXPECT_TRUE(torch::equal(r[it.first][i], it.second[0])) << it.first;
+    }
+  }
+
+  // Selected games are copies: stepping them leaves the batch unchanged
+  GameBatch selected = batch.select({2, 0});
+  ASSERT_EQ(selected.size(), 2);
+  selected.process(pool_);
+  EXPECT_EQ(selected.at(0).get_state().get_phase().to_string(), "S1902M");
+  EXPECT_EQ(batch.at(2).get_state().get_phase().to_string(), "F1901M");
+  EXPECT_THROW(batch.select({3}), std::exception);
+  EXPECT_THROW(batch.at(3), std::exception);
+}
+
+} // namespace dipcc
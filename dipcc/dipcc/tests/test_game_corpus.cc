@@ -0,0 +1,194 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <cstdio>
+#include <set>
+#include <unistd.h>
+
+#include "../cc/game.h"
+#include "../cc/game_corpus.h"
+#include "../cc/thread_pool.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class GameCorpusTest : public ::testing::Test {};
+
+Game make_game(int n_phases) {
+  Game game;
+  for (int i = 0; i < n_phases; ++i) {
+    game.add_message(Power::FRANCE, Power::ENGLAND, "hi", i + 1);
+    game.set_orders("FRANCE", {i % 2 == 0 ? "A PAR - BUR" : "A BUR - PAR"});
+    game.process();
+  }
+  return game;
+}
+
+TEST_F(GameCorpusTest, TestFromBytesAtPhaseStart) {
+  Game game = make_game(5);
+  string bytes = game.to_bytes();
+  size_t phase_idx = 0;
+  for (auto &it : game.get_state_history()) {
+    EXPECT_EQ(Game::from_bytes_at_phase_start(bytes, phase_idx).to_json(),
+              game.rolled_back_to_phase_start(it.first.to_string()).to_json());
+    ++phase_idx;
+  }
+}
+
+TEST_F(GameCorpusTest, TestReadWrite) {
+  vector<Game> games = {make_game(3), make_game(0), make_game(5)};
+  vector<Game *> game_ptrs = {&games[0], &games[1], &games[2]};
+
+  char path[] = "/tmp/test_game_corpus_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  GameCorpus::write(path, game_ptrs);
+
+  {
+    GameCorpus corpus(path);
+    ASSERT_EQ(corpus.get_n_games(), 3);
+    ASSERT_EQ(corpus.get_n_phases(), 8);
+    for (size_t i = 0; i < games.size(); ++i) {
+      EXPECT_EQ(corpus.get_game(i).to_json(), games[i].to_json());
+    }
+    EXPECT_EQ(corpus.get_phase_range(2), make_pair(size_t(3), size_t(8)));
+    EXPECT_EQ(corpus.get_game_and_phase(2), make_pair(size_t(0), size_t(2)));
+    EXPECT_EQ(corpus.get_game_and_phase(3), make_pair(size_t(2), size_t(0)));
+    EXPECT_EQ(corpus.get_phase(4).to_json(),
+              games[2].rolled_back_to_phase_start("F1901M").to_json());
+    EXPECT_THROW(corpus.get_phase(8), std::exception);
+  }
+  remove(path);
+}
+
+TEST_F(GameCorpusTest, TestPositionHashes) {
+  Game a = make_game(3);
+  Game a_again = make_game(3);
+  EXPECT_EQ(get_position_hashes(a), get_position_hashes(a_again));
+
+  // Same opening, then other moves back to the same S1902M board
+  Game b;
+  b.set_orders("FRANCE", {"A PAR - PIC"});
+  b.process();
+  b.set_orders("FRANCE", {"A PIC - PAR"});
+  b.process();
+  b.set_orders("FRANCE", {"A PAR - BUR"});
+  b.process();
+  vector<uint64_t> ha = get_position_hashes(a);
+  vector<uint64_t> hb = get_position_hashes(b);
+  ASSERT_EQ(ha.size(), 3);
+  ASSERT_EQ(hb.size(), 3);
+  EXPECT_EQ(ha[0], hb[0]);
+  EXPECT_NE(ha[1], hb[1]);
+  EXPECT_EQ(a.get_state_history().rbegin()->second->stable_board_hash(),
+            b.get_state_history().rbegin()->second->stable_board_hash());
+  EXPECT_NE(ha[2], hb[2]);
+}
+
+TEST_F(GameCorpusTest, TestDedupCorpus) {
+  vector<Game> games = {make_game(3), make_game(0), make_game(2),
+                        make_game(3)};
+  vector<Game *> game_ptrs;
+  for (Game &game : games) {
+    game_ptrs.push_back(&game);
+  }
+
+  char path[] = "/tmp/test_game_corpus_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  GameCorpus::write(path, game_ptrs);
+
+  {
+    GameCorpus corpus(path);
+    ThreadPool pool(2, {{"A PAR - BUR", 0}}, 469);
+    TensorDict index = pool.dedup_corpus(corpus, {0, 2, 3});
+    ASSERT_EQ(index["hashes"].size(0), 8);
+    auto hashes = index["hashes"].accessor<int64_t, 1>();
+    auto first_rows = index["first_rows"].accessor<int64_t, 1>();
+    auto counts = index["counts"].accessor<int64_t, 1>();
+    vector<int64_t> expected_first_rows = {0, 1, 2, 0, 1, 0, 1, 2};
+    vector<int64_t> expected_counts = {3, 3, 2, 3, 3, 3, 3, 2};
+    vector<uint64_t> expected_hashes = get_position_hashes(games[3]);
+    for (int row = 0; row < 8; ++row) {
+      EXPECT_EQ(first_rows[row], expected_first_rows[row]) << row;
+      EXPECT_EQ(counts[row], expected_counts[row]) << row;
+    }
+    for (int row = 5; row < 8; ++row) {
+      EXPECT_EQ(static_cast<uint64_t>(hashes[row]), expected_hashes[row - 5]);
+    }
+  }
+  remove(path);
+}
+
+TEST_F(GameCorpusTest, TestEncodeDatasetGames) {
+  unordered_map<string, int> vocab = {
+      {"F BRE H", 0}, {"A MAR H", 1},     {"A PAR H", 2},
+      {"A PAR - BUR", 3}, {"A BUR H", 4}};
+  Game game;
+  game.set_orders("FRANCE", {"F BRE H", "A MAR H", "A PAR - BUR"});
+  game.set_orders("ENGLAND", {"F LON H"}); // not in the vocab
+  game.process();
+  game.set_orders("FRANCE", {"F BRE H", "A MAR H", "A BUR H"});
+  game.process();
+  vector<Game *> game_ptrs = {&game};
+
+  char path[] = "/tmp/test_game_corpus_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  GameCorpus::write(path, game_ptrs);
+
+  {
+    GameCorpus corpus(path);
+    ThreadPool pool(2, vocab, 469);
+    TensorDict fields = pool.encode_dataset_games(corpus, {0}, 0.5);
+    ASSERT_EQ(fields["y_actions"].size(0), 2);
+    auto y_actions = fields["y_actions"].accessor<int32_t, 4>();
+    auto valid = fields["valid_power_idxs"].accessor<bool, 2>();
+    auto offsets = fields["x_possible_actions_offsets"].accessor<int64_t, 1>();
+    auto values = fields["x_possible_actions_values"].accessor<int32_t, 1>();
+    const int S = OrdersEncoder::MAX_SEQ_LEN;
+    const int france = static_cast<int>(Power::FRANCE) - 1;
+
+    // S1901M: France's orders are candidates of their steps, in loc order
+    EXPECT_TRUE(valid[0][france]);
+    set<int> order_idxs;
+    for (int i = 0; i < 3; ++i) {
+      int row = france * S + i;
+      int32_t y = y_actions[0][france][0][i];
+      ASSERT_GE(y, 0);
+      ASSERT_LT(y, offsets[row + 1] - offsets[row]);
+      order_idxs.insert(values[offsets[row] + y]);
+    }
+    EXPECT_EQ(order_idxs, set<int>({0, 1, 3}));
+    EXPECT_EQ(y_actions[0][france][0][3], OrdersEncoder::EOS_IDX);
+    EXPECT_FALSE(valid[0][static_cast<int>(Power::ENGLAND) - 1]);
+
+    // F1901M: all holds
+    EXPECT_TRUE(valid[1][france]);
+
+    // No center changed hands, so every phase has the initial square scores
+    auto scores = fields["y_final_scores"].accessor<float, 2>();
+    EXPECT_FLOAT_EQ(scores[0][france], 9.0 / 70);
+    EXPECT_FLOAT_EQ(scores[1][france], 9.0 / 70);
+
+    fields = pool.encode_dataset_games(corpus, {0}, 1.0, -1, 3);
+    EXPECT_TRUE(fields["valid_power_idxs"][0][france].item<bool>());
+    EXPECT_FALSE(fields["valid_power_idxs"][1][france].item<bool>());
+
+    // Only Russia has 4 centers
+    fields = pool.encode_dataset_games(corpus, {0}, 1.0, 4);
+    EXPECT_FALSE(fields["valid_power_idxs"][0][france].item<bool>());
+  }
+  remove(path);
+}
+
+} // namespace dipcc
@@ -0,0 +1,115 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <random>
+#include <vector>
+
+#include "../cc/game.h"
+#include "../cc/game_gen.h"
+#include "../cc/thread_pool.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class GameGenTest : public ::testing::Test {};
+
+// Number of orders of the given type in the game's history, and of dislodged
+// units in its states
+pair<int, int> count_orders(Game &game, OrderType type) {
+  int n_orders = 0, n_dislodged = 0;
+  for (auto &it : game.get_order_history()) {
+    for (auto &power_orders : it.second) {
+      for (const Order &order : power_orders.second) {
+        n_orders += order.get_type() == type;
+      }
+    }
+  }
+  for (auto &it : game.get_state_history()) {
+    n_dislodged += it.second->get_dislodged_units_map().size();
+  }
+  return {n_orders, n_dislodged};
+}
+
+TEST_F(GameGenTest, TestReproducibleBySeed) {
+  GameGenOptions options;
+  options.n_phases = 30;
+  options.convoy_rate = 0.5;
+  options.attack_rate = 0.5;
+  EXPECT_EQ(generate_game(options, 1).to_json(),
+            generate_game(options, 1).to_json());
+  EXPECT_NE(generate_game(options, 1).to_json(),
+            generate_game(options, 2).to_json());
+}
+
+TEST_F(GameGenTest, TestLengthAndLegality) {
+  for (PlayoutPolicy policy :
+       {PlayoutPolicy::RANDOM, PlayoutPolicy::HEURISTIC}) {
+    GameGenOptions options;
+    options.policy = policy;
+    options.n_phases = 40;
+    options.convoy_rate = 0.5;
+    options.attack_rate = 0.5;
+    Game game = generate_game(options, 0);
+    EXPECT_EQ(game.get_state_history().size(), 40);
+
+    // Every recorded order is possible in its phase
+    for (auto &it : game.get_state_history()) {
+      GameState state(*it.second);
+      for (auto &power_orders : game.get_order_history().get(it.first)) {
+        for (const Order &order : power_orders.second) {
+          const auto &possible =
+              state.get_all_possible_orders().at(order.get_unit().loc);
+          EXPECT_NE(possible.find(order), possible.end())
+              << it.first.to_string() << " " << order.to_string();
+        }
+      }
+    }
+  }
+}
+
+TEST_F(GameGenTest, TestDensity) {
+  GameGenOptions sparse;
+  sparse.n_phases = 60;
+  GameGenOptions dense = sparse;
+  dense.convoy_rate = 0.5;
+  dense.attack_rate = 0.5;
+  Game sparse_game = generate_game(sparse, 0);
+  Game dense_game = generate_game(dense, 0);
+
+  auto[sparse_convoys, sparse_dislodged] =
+      count_orders(sparse_game, OrderType::C);
+  auto[dense_convoys, dense_dislodged] = count_orders(dense_game, OrderType::C);
+  EXPECT_GT(dense_convoys, sparse_convoys);
+  EXPECT_GT(dense_dislodged, sparse_dislodged);
+}
+
+TEST_F(GameGenTest, TestThreadPoolProcessMatchesSerial) {
+  // Distinct games, dense in convoys and dislodgements, with orders staged
+  vector<Game> games;
+  for (int seed = 0; seed < 16; ++seed) {
+    Game &game = games.emplace_back(
+        generate_game({PlayoutPolicy::HEURISTIC, 20, 0.5, 0.5}, seed));
+    mt19937 rng(seed);
+    set_playout_orders(game, PlayoutPolicy::HEURISTIC, rng);
+  }
+  vector<Game> serial = games;
+  vector<Game *> game_ptrs;
+  for (Game &game : games) {
+    game_ptrs.push_back(&game);
+  }
+
+  ThreadPool pool(4, {}, 0);
+  pool.process_multi(game_ptrs);
+  for (size_t i = 0; i < games.size(); ++i) {
+    serial[i].process();
+    EXPECT_EQ(games[i].to_json(), serial[i].to_json());
+  }
+}
+
+} // namespace dipcc
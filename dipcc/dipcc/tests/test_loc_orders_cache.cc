@@ -0,0 +1,87 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/game_gen.h"
+#include "../cc/loc_orders_cache.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class LocOrdersCacheTest : public ::testing::Test {
+protected:
+  void TearDown() override { LocOrdersCache::get_global().set_capacity(0); }
+};
+
+TEST_F(LocOrdersCacheTest, TestSameOrders) {
+  LocOrdersCache &cache = LocOrdersCache::get_global();
+  GameGenOptions options;
+  options.n_phases = 30;
+  options.convoy_rate = 0.5;
+  options.attack_rate = 0.5;
+
+  for (uint64_t seed = 0; seed < 4; ++seed) {
+    Game game = generate_game(options, seed);
+    for (auto &it : game.get_state_history()) {
+      if (it.second->get_phase().phase_type != 'M') {
+        continue;
+      }
+      GameState uncached(*it.second);
+      uncached.clear_all_possible_orders();
+      cache.set_capacity(0);
+      const auto &expected = uncached.get_all_possible_orders();
+      EXPECT_EQ(uncached.get_loc_orders(expected.begin()->first), nullptr);
+
+      // Loaded once to fill the cache, then from it
+      cache.set_capacity(1 << 16);
+      for (int i = 0; i < 2; ++i) {
+        GameState cached(*it.second);
+        cached.clear_all_possible_orders();
+        EXPECT_EQ(cached.get_all_possible_orders(), expected)
+            << it.first.to_string();
+        EXPECT_EQ(cached.get_orderable_locations(),
+                  uncached.get_orderable_locations());
+        for (const auto &loc_orders : expected) {
+          const LocOrders *entry = cached.get_loc_orders(loc_orders.first);
+          ASSERT_NE(entry, nullptr);
+          EXPECT_EQ(entry->orders, loc_orders.second);
+        }
+      }
+      EXPECT_EQ(cache.get_hits(), expected.size());
+    }
+  }
+}
+
+TEST_F(LocOrdersCacheTest, TestVocabIdxs) {
+  LocOrders entry;
+  EXPECT_EQ(entry.get_vocab_idxs(0), nullptr);
+  entry.set_vocab_idxs(0, {1, 5});
+  entry.set_vocab_idxs(3, {2});
+  ASSERT_NE(entry.get_vocab_idxs(0), nullptr);
+  EXPECT_EQ(*entry.get_vocab_idxs(0), vector<int>({1, 5}));
+  EXPECT_EQ(entry.get_vocab_idxs(3), nullptr);
+}
+
+TEST_F(LocOrdersCacheTest, TestCapacity) {
+  LocOrdersCache &cache = LocOrdersCache::get_global();
+  auto entry = make_shared<LocOrders>();
+  EXPECT_EQ(cache.put("a", entry), entry);
+  EXPECT_EQ(cache.get("a"), nullptr); // disabled
+
+  cache.set_capacity(64); // one entry per shard
+  EXPECT_EQ(cache.put("a", entry), entry);
+  EXPECT_EQ(cache.put("a", make_shared<LocOrders>()), entry);
+  EXPECT_EQ(cache.get("a"), entry);
+  for (int i = 0; i < 1000; ++i) {
+    cache.put(to_string(i), make_shared<LocOrders>());
+  }
+  EXPECT_LE(cache.size(), 64);
+  EXPECT_EQ(cache.get_hits(), 1);
+}
+
+} // namespace dipcc
@@ -0,0 +1,152 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "../cc/model_batcher.h"
+#include "../cc/torchscript_model.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class ModelBatcherTest : public ::testing::Test {
+protected:
+  // Orders nothing, and values each row with its first 7 board features
+  shared_ptr<TorchScriptModel> make_model() {
+    torch::jit::script::Module module("TestModel");
+    module.define(R"(
+def forward(self, x_board_state, temperature, top_p, values_only: bool = False):
+    B = x_board_state.size(0)
+    order_idxs = torch.full([B, 7, 17], -1, dtype=torch.long)
+    values = x_board_state[:, 0, :7]
+    return order_idxs, order_idxs, order_idxs, values
+)");
+    return make_shared<TorchScriptModel>(module, "cpu");
+  }
+
+  TensorDict make_inputs(long B, float value) {
+    return {{"x_board_state", torch::full({B, 81, 35}, value)}};
+  }
+};
+
+TEST_F(ModelBatcherTest, TestForward) {
+  auto model = make_model();
+  ModelOutput y = model->forward(make_inputs(3, 0.5), 1.0, 1.0);
+  EXPECT_EQ(y.order_idxs.sizes(), torch::IntArrayRef({3, 7, 17}));
+  EXPECT_EQ(y.values.sizes(), torch::IntArrayRef({3, 7}));
+  EXPECT_FLOAT_EQ(y.values[2][6].item<float>(), 0.5);
+
+  y = model->forward(make_inputs(3, 0.5), 1.0, 1.0, true);
+  EXPECT_FALSE(y.order_idxs.defined());
+  EXPECT_TRUE(y.values.defined());
+}
+
+TEST_F(ModelBatcherTest, TestConcurrentRequests) {
+  // A long max latency: the two requests fill the batch
+  ModelBatcher batcher(make_model(), 5, 10000000, 1.0, 1.0);
+  TensorDict x_a = make_inputs(2, 1.0), x_b = make_inputs(3, 2.0);
+  ModelOutput y_a, y_b;
+  thread th([&] { y_a = batcher.forward(x_a); });
+  y_b = batcher.forward(x_b);
+  th.join();
+
+  EXPECT_EQ(y_a.values.size(0), 2);
+  EXPECT_EQ(y_b.values.size(0), 3);
+  EXPECT_TRUE(y_a.values.eq(1.0).all().item<bool>());
+  EXPECT_TRUE(y_b.values.eq(2.0).all().item<bool>());
+  EXPECT_EQ(y_b.order_idxs.size(0), 3);
+}
+
+TEST_F(ModelBatcherTest, TestMaxLatency) {
+  // A lone request is run once the max latency has passed
+  ModelBatcher batcher(make_model(), 100, 1000, 1.0, 1.0);
+  ModelOutput y = batcher.forward(make_inputs(1, 3.0), true);
+  EXPECT_FLOAT_EQ(y.values[0][0].item<float>(), 3.0);
+}
+
+TEST_F(ModelBatcherTest, TestSubmitMany) {
+  // Count model calls: 8 single-row requests fill exactly two batches
+  atomic<int> n_calls{0};
+  ModelBatcher batcher(
+      [&](const TensorDict &x, bool values_only) {
+        ++n_calls;
+        ModelOutput y;
+        y.values = x.at("x_board_state").select(1, 0).narrow(1, 0, 7);
+        return y;
+      },
+      4, 10000000);
+
+  vector<ModelFuture> futures;
+  for (int i = 0; i < 8; ++i) {
+    futures.push_back(batcher.submit(make_inputs(1, i), true));
+  }
+  for (int i = 0; i < 8; ++i) {
+    const ModelOutput &y = futures[i].get();
+    EXPECT_FALSE(y.order_idxs.defined());
+    EXPECT_FLOAT_EQ(y.values[0][0].item<float>(), i);
+  }
+  EXPECT_EQ(n_calls, 2);
+}
+
+TEST_F(ModelBatcherTest, TestSeparateValuesOnly) {
+  // Policy and values_only requests are not mixed in a batch
+  vector<bool> calls;
+  ModelBatcher batcher(
+      [&](const TensorDict &x, bool values_only) {
+        calls.push_back(values_only);
+        ModelOutput y;
+        y.values = torch::zeros({x.at("x_board_state").size(0), 7});
+        return y;
+      },
+      2, 1000);
+  ModelFuture a = batcher.submit(make_inputs(1, 0), false);
+  ModelFuture b = batcher.submit(make_inputs(1, 0), true);
+  a.get();
+  b.get();
+  EXPECT_EQ(calls, vector<bool>({false, true}));
+}
+
+TEST_F(ModelBatcherTest, TestException) {
+  ModelBatcher batcher(
+      [](const TensorDict &x, bool values_only) -> ModelOutput {
+        throw runtime_error("model error");
+      },
+      2, 1000);
+  ModelFuture a = batcher.submit(make_inputs(1, 0));
+  ModelFuture b = batcher.submit(make_inputs(1, 0));
+  EXPECT_THROW(a.get(), runtime_error);
+  EXPECT_THROW(b.get(), runtime_error);
+}
+
+TEST_F(ModelBatcherTest, TestDestroyPending) {
+  // Like a Python model, the model takes a lock that the destroying thread
+  // holds (the GIL): pending requests must fail rather than run
+  mutex gil;
+  atomic<int> n_calls{0};
+  auto batcher = make_unique<ModelBatcher>(
+      [&](const TensorDict &x, bool values_only) {
+        lock_guard<mutex> lock(gil);
+        ++n_calls;
+        return ModelOutput();
+      },
+      100, 10000000);
+  ModelFuture a = batcher->submit(make_inputs(1, 0));
+  ModelFuture b = batcher->submit(make_inputs(1, 0), true);
+  {
+    lock_guard<mutex> lock(gil);
+    batcher.reset();
+  }
+  EXPECT_THROW(a.get(), runtime_error);
+  EXPECT_THROW(b.get(), runtime_error);
+  EXPECT_EQ(n_calls, 0);
+}
+
+} // namespace dipcc
@@ -0,0 +1,64 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/nash_conv.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class NashConvTest : public ::testing::Test {
+protected:
+  // Matching pennies between powers 0 and 1: power 0 wins if actions match
+  JointValuesFn matching_pennies(int *n_calls) {
+    return [n_calls](const vector<array<int, 7>> &rows) {
+      ++*n_calls;
+      vector<array<float, 7>> r;
+      for (auto &idxs : rows) {
+        float u = idxs[0] == idxs[1] ? 1 : 0;
+        r.push_back({u, 1 - u, 0, 0, 0, 0, 0});
+      }
+      return r;
+    };
+  }
+};
+
+TEST_F(NashConvTest, TestPureProfile) {
+  // Both play action 0: power 1 gains 1 by switching
+  int n_calls = 0;
+  NashConvResult r = compute_nash_conv({{1, 0}, {1, 0}, {}, {}, {}, {}, {}},
+                                       10, matching_pennies(&n_calls), 0, 0);
+  EXPECT_EQ(n_calls, 1);
+  EXPECT_FLOAT_EQ(r.values[0], 1);
+  EXPECT_FLOAT_EQ(r.br_values[0], 1);
+  EXPECT_FLOAT_EQ(r.values[1], 0);
+  EXPECT_FLOAT_EQ(r.br_values[1], 1);
+  EXPECT_FLOAT_EQ(r.nash_conv, 1);
+  EXPECT_EQ(r.action_values[1], vector<float>({0, 1}));
+  EXPECT_TRUE(r.action_values[2].empty());
+}
+
+TEST_F(NashConvTest, TestEquilibrium) {
+  int n_calls = 0;
+  NashConvResult r =
+      compute_nash_conv({{0.5, 0.5}, {0.5, 0.5}, {}, {}, {}, {}, {}}, 2000,
+                        matching_pennies(&n_calls), 0, 0);
+  EXPECT_NEAR(r.nash_conv, 0, 0.1);
+  EXPECT_NEAR(r.values[0], 0.5, 0.05);
+}
+
+TEST_F(NashConvTest, TestMaxRows) {
+  // 4 rows per sample, 3 samples, at most 5 rows per call
+  int n_calls = 0;
+  NashConvResult r = compute_nash_conv({{1, 0}, {1, 0}, {}, {}, {}, {}, {}},
+                                       3, matching_pennies(&n_calls), 5, 0);
+  EXPECT_EQ(n_calls, 3);
+  EXPECT_FLOAT_EQ(r.nash_conv, 1);
+}
+
+} // namespace dipcc
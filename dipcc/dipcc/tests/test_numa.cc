@@ -0,0 +1,32 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/numa.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class NumaTest : public ::testing::Test {};
+
+TEST_F(NumaTest, TestParseCpuList) {
+  EXPECT_EQ(parse_cpu_list("0-3,8,10-11\n"),
+            vector<int>({0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(parse_cpu_list("5"), vector<int>({5}));
+  EXPECT_EQ(parse_cpu_list(""), vector<int>());
+}
+
+TEST_F(NumaTest, TestNodeCpus) {
+  auto nodes = get_numa_node_cpus();
+  ASSERT_FALSE(nodes.empty());
+  for (auto &cpus : nodes) {
+    EXPECT_FALSE(cpus.empty());
+  }
+}
+
+} // namespace dipcc
@@ -0,0 +1,132 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <cmath>
+#include <random>
+
+#include "../cc/order_sampling.h"
+#include "../cc/orders_encoder.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class OrderSamplingTest : public ::testing::Test {
+protected:
+  // [1, 7, S, C] candidates, all EOS_IDX except for power 0's steps
+  torch::Tensor make_cands(const vector<vector<long>> &steps, long S, long C) {
+    torch::Tensor r =
+        torch::full({1, 7, S, C}, OrdersEncoder::EOS_IDX, torch::kLong);
+    for (int s = 0; s < steps.size(); ++s) {
+      for (int c = 0; c < steps[s].size(); ++c) {
+        r[0][0][s][c] = steps[s][c];
+      }
+    }
+    return r;
+  }
+
+  mt19937 rng_{0};
+};
+
+TEST_F(OrderSamplingTest, TestHashPowerOrders) {
+  const long EOS = OrdersEncoder::EOS_IDX;
+  long a[] = {3, 5, EOS}, b[] = {5, 3, EOS}, c[] = {3, 6, EOS};
+  long none[] = {EOS, EOS, EOS};
+  EXPECT_EQ(hash_power_orders(a, 3), hash_power_orders(b, 3));
+  EXPECT_NE(hash_power_orders(a, 3), hash_power_orders(c, 3));
+  EXPECT_EQ(hash_power_orders(none, 3), 0);
+}
+
+TEST_F(OrderSamplingTest, TestSampleArgmax) {
+  torch::Tensor cands = make_cands({{10, 11, 12}, {20, 21}}, 3, 3);
+  torch::Tensor logits = torch::zeros({1, 7, 3, 3});
+  logits[0][0][0][1] = 5;
+  logits[0][0][1][0] = 5;
+  logits[0][0][1][2] = 100; // not a candidate
+  SampledOrders r =
+      sample_orders(logits, cands, torch::zeros({1}), 0, 1.0, rng_);
+
+  EXPECT_EQ(r.order_idxs[0][0][0].item<long>(), 11);
+  EXPECT_EQ(r.order_idxs[0][0][1].item<long>(), 20);
+  EXPECT_EQ(r.order_idxs[0][0][2].item<long>(), OrdersEncoder::EOS_IDX);
+  EXPECT_EQ(r.order_idxs[0][1][0].item<long>(), OrdersEncoder::EOS_IDX);
+  float step0 = 5 - log(exp(5.0f) + 2), step1 = 5 - log(exp(5.0f) + 1);
+  EXPECT_NEAR(r.logprobs[0][0].item<float>(), step0 + step1, 1e-5);
+  EXPECT_EQ(r.logprobs[0][1].item<float>(), 0);
+  EXPECT_EQ(r.action_hashes[0][1].item<long>(), 0);
+}
+
+TEST_F(OrderSamplingTest, TestTopP) {
+  // With top_p 0.5, only the most likely candidate is kept
+  torch::Tensor cands = make_cands({{10, 11, 12}}, 1, 3);
+  torch::Tensor logits = torch::zeros({1, 7, 1, 3});
+  logits[0][0][0][2] = 1;
+  for (int i = 0; i < 20; ++i) {
+    SampledOrders r =
+        sample_orders(logits, cands, torch::zeros({1}), 1.0, 0.5, rng_);
+    EXPECT_EQ(r.order_idxs[0][0][0].item<long>(), 12);
+  }
+}
+
+TEST_F(OrderSamplingTest, TestDistinctDisbands) {
+  // A spiky step 0 would disband the same unit twice if steps were sampled
+  // independently
+  torch::Tensor cands = make_cands({{10, 11, 12}, {10, 11, 12}}, 2, 3);
+  torch::Tensor logits = torch::zeros({1, 7, 2, 3});
+  logits[0][0][0][0] = 1000;
+  logits[0][0][1][0] = 1000;
+  for (int i = 0; i < 20; ++i) {
+    SampledOrders r =
+        sample_orders(logits, cands, torch::ones({1}), 1.0, 1.0, rng_);
+    long a = r.order_idxs[0][0][0].item<long>();
+    long b = r.order_idxs[0][0][1].item<long>();
+    EXPECT_EQ(a, 10);
+    EXPECT_NE(b, 10);
+    EXPECT_NE(b, OrdersEncoder::EOS_IDX);
+  }
+}
+
+TEST_F(OrderSamplingTest, TestResampleDuplicateDisbands) {
+  torch::Tensor cands = make_cands({{10, 11, 12}, {10, 11, 12}}, 2, 3);
+  torch::Tensor logits = torch::zeros({1, 7, 2, 3});
+  torch::Tensor order_idxs =
+      torch::full({1, 7, 2}, OrdersEncoder::EOS_IDX, torch::kLong);
+  order_idxs[0][0][0] = 11;
+  order_idxs[0][0][1] = 11;
+
+  // Not an adjustment phase: left as is
+  torch::Tensor movement = order_idxs.clone();
+  resample_duplicate_disbands(movement, logits, cands, torch::zeros({1}),
+                              rng_);
+  EXPECT_TRUE(torch::equal(movement, order_idxs));
+
+  resample_duplicate_disbands(order_idxs, logits, cands, torch::ones({1}),
+                              rng_);
+  long a = order_idxs[0][0][0].item<long>();
+  long b = order_idxs[0][0][1].item<long>();
+  EXPECT_NE(a, b);
+  EXPECT_GE(a, 10);
+  EXPECT_GE(b, 10);
+  EXPECT_EQ(order_idxs[0][1][0].item<long>(), OrdersEncoder::EOS_IDX);
+}
+
+TEST_F(OrderSamplingTest, TestOrderIdxsToCpu) {
+  // int32, not contiguous
+  torch::Tensor order_idxs =
+      torch::tensor({{13000, OrdersEncoder::EOS_IDX}}, torch::kInt).t();
+  torch::Tensor r = order_idxs_to_cpu(order_idxs);
+  EXPECT_EQ(r.scalar_type(), torch::kLong);
+  EXPECT_TRUE(r.is_contiguous());
+  EXPECT_TRUE(torch::equal(r, order_idxs.to(torch::kLong)));
+  if (torch::cuda::is_available()) {
+    torch::Tensor on_device = order_idxs.to(torch::kCUDA, torch::kLong);
+    EXPECT_TRUE(torch::equal(order_idxs_to_cpu(on_device), r));
+  }
+}
+
+} // namespace dipcc
@@ -0,0 +1,61 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <thread>
+
+#include "../cc/game.h"
+#include "../cc/perf_stats.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class PerfStatsTest : public ::testing::Test {
+protected:
+  void TearDown() override {
+    set_perf_stats_enabled(false);
+    reset_perf_stats();
+  }
+};
+
+const size_t PROCESS = static_cast<size_t>(PerfCounter::PROCESS);
+
+TEST_F(PerfStatsTest, TestDisabledByDefault) {
+  reset_perf_stats();
+  Game game;
+  game.process();
+  EXPECT_EQ(get_perf_stats()[PROCESS].count, 0);
+}
+
+TEST_F(PerfStatsTest, TestCountsAcrossThreads) {
+  reset_perf_stats();
+  set_perf_stats_enabled(true);
+
+  Game game;
+  game.process();
+  thread th([] {
+    Game other;
+    other.process();
+  });
+  th.join();
+
+  PerfCounterStats stats = get_perf_stats()[PROCESS];
+  EXPECT_EQ(stats.count, 2);
+  EXPECT_GT(stats.total_ns, 0);
+  EXPECT_LE(stats.max_ns, stats.total_ns);
+  uint64_t histogram_count = 0;
+  for (uint64_t n : stats.histogram) {
+    histogram_count += n;
+  }
+  EXPECT_EQ(histogram_count, 2);
+
+  reset_perf_stats();
+  EXPECT_EQ(get_perf_stats()[PROCESS].count, 0);
+}
+
+} // namespace dipcc
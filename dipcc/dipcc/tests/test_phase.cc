@@ -8,6 +8,7 @@ LICENSE file in the root directory of this source tree.
 #include <unordered_set>
 
 #include "../cc/game.h"
+#include "../cc/phase_map.h"
 #include "../cc/thirdparty/nlohmann/json.hpp"
 #include "consts.h"
 #include "gmock/gmock.h"
@@ -25,4 +26,114 @@ TEST_F(PhaseTest, TestPhaseNE) {
               Phase("S1902M") < Phase("S1902R"));
 }
 
+TEST_F(PhaseTest, TestPhaseOrdinal) {
+  vector<string> ordered = {"S1901M", "S1901R", "F1901M", "F1901R",
+                            "W1901A", "S1902M", "W1935A", "COMPLETED"};
+  for (int i = 0; i + 1 < ordered.size(); ++i) {
+    EXPECT_LT(Phase(ordered[i]).ordinal(), Phase(ordered[i + 1]).ordinal());
+    EXPECT_LT(Phase(ordered[i]), Phase(ordered[i + 1]));
+  }
+  EXPECT_EQ(Phase("S1901M").completed(), Phase("COMPLETED"));
+}
+
+TEST_F(PhaseTest, TestPhaseMapCopies) {
+  // Compare a chain of PhaseMap copies against std::map copies
+  vector<Phase> phases;
+  Phase phase("S1901M");
+  for (int i = 0; i < 60; ++i) {
+    phases.push_back(phase);
+    phase = phase.next(phase.phase_type == 'M' && i % 3 != 0);
+  }
+
+  PhaseMap<int> m;
+  map<Phase, int> ref;
+  vector<pair<PhaseMap<int>, map<Phase, int>>> copies;
+  for (int i = 0; i < 60; ++i) {
+    m[phases[i]] = i;
+    ref[phases[i]] = i;
+    if (i % 2 == 0) {
+      m[phases[i / 2]] += 100; // write into the shared prefix
+      ref[phases[i / 2]] += 100;
+    }
+    if (i % 5 == 4) {
+      m.erase_from(phases[i - 1]);
+      ref.erase(ref.find(phases[i - 1]), ref.end());
+    }
+    copies.push_back({m, ref});
+    m = copies.back().first;
+  }
+
+  for (auto & [ pm, expected ] : copies) {
+    ASSERT_EQ(pm.size(), expected.size());
+    ASSERT_EQ((map<Phase, int>(pm.begin(), pm.end())), expected);
+    auto it = pm.rbegin();
+    for (auto jt = expected.rbegin(); jt != expected.rend(); ++jt, ++it) {
+      ASSERT_EQ(it->first, jt->first);
+    }
+    ASSERT_TRUE(it == pm.rend());
+    auto kt = expected.rbegin();
+    pm.visit_reverse([&](const auto &entry) {
+      EXPECT_EQ(entry.first, kt->first);
+      EXPECT_EQ(entry.second, kt->second);
+      return ++kt == expected.rend();
+    });
+    ASSERT_TRUE(kt == expected.rend());
+    for (const Phase &p : phases) {
+      ASSERT_EQ(pm.contains(p), expected.find(p) != expected.end());
+      if (pm.contains(p)) {
+        ASSERT_EQ(pm.at(p), expected.at(p));
+        ASSERT_EQ(pm.find(p)->second, expected.at(p));
+      } else {
+        ASSERT_TRUE(pm.find(p) == pm.end());
+      }
+    }
+  }
+}
+
+TEST_F(PhaseTest, TestPhaseMapReadsBetweenChanges) {
+  // Reads between changes must see each change, in the tail and the prefix
+  vector<Phase> phases;
+  Phase phase("S1901M");
+  for (int i = 0; i < 40; ++i) {
+    phases.push_back(phase);
+    phase = phase.next(phase.phase_type == 'M');
+  }
+  auto expect_eq = [](const PhaseMap<int> &pm, const map<Phase, int> &ref) {
+    ASSERT_EQ(pm.size(), ref.size());
+    ASSERT_EQ(pm.empty(), ref.empty());
+    ASSERT_EQ((map<Phase, int>(pm.begin(), pm.end())), ref);
+    if (!ref.empty()) {
+      ASSERT_EQ(pm.rbegin()->first, ref.rbegin()->first);
+      ASSERT_EQ(pm.find(ref.begin()->first)->second, ref.begin()->second);
+    }
+  };
+
+  PhaseMap<int> m;
+  map<Phase, int> ref;
+  expect_eq(m, ref);
+  for (int i = 0; i < 40; ++i) {
+    m[phases[i]] = i;
+    ref[phases[i]] = i;
+    expect_eq(m, ref);
+    PhaseMap<int> copy(m); // moves m's tail into the shared prefix
+    expect_eq(m, ref);
+    expect_eq(copy, ref);
+    if (i % 4 == 3) {
+      map<Phase, int> copy_ref = ref;
+      m.erase(phases[i - 1]);
+      ref.erase(phases[i - 1]);
+      expect_eq(m, ref);
+      m.erase_after(phases[i - 2]);
+      ref.erase(ref.upper_bound(phases[i - 2]), ref.end());
+      expect_eq(m, ref);
+      expect_eq(copy, copy_ref);
+    }
+  }
+  m.erase_before(phases[20]);
+  ref.erase(ref.begin(), ref.lower_bound(phases[20]));
+  expect_eq(m, ref);
+  m = PhaseMap<int>();
+  expect_eq(m, {});
+}
+
 } // namespace dipcc
@@ -0,0 +1,125 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/plausible_orders.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class PlausibleOrdersTest : public ::testing::Test {
+protected:
+  // [B, 7, 2] order idxs, all EOS_IDX except for power 0's
+  torch::Tensor make_order_idxs(const vector<vector<long>> &samples) {
+    torch::Tensor r = torch::full({(long)samples.size(), 7, 2},
+                                  OrdersEncoder::EOS_IDX, torch::kLong);
+    for (int b = 0; b < samples.size(); ++b) {
+      for (int s = 0; s < samples[b].size(); ++s) {
+        r[b][0][s] = samples[b][s];
+      }
+    }
+    return r;
+  }
+
+  bool coordinated(const vector<string> &orders) {
+    vector<Order> r;
+    for (auto &order : orders) {
+      r.emplace_back(order);
+    }
+    return are_supports_coordinated(r);
+  }
+
+  OrdersEncoder encoder_{{{"A SEV H", 0},
+                          {"A SEV - RUM", 1},
+                          {"F BLA S A SEV - RUM", 2},
+                          {"F BLA H", 3},
+                          {"F BLA S A SEV", 4}},
+                         469};
+};
+
+TEST_F(PlausibleOrdersTest, TestAreSupportsCoordinated) {
+  EXPECT_TRUE(coordinated({"F BLA S A SEV - RUM", "A SEV - RUM"}));
+  EXPECT_FALSE(coordinated({"F BLA S A SEV - RUM", "A SEV H"}));
+  EXPECT_FALSE(coordinated({"F BLA S A SEV - RUM", "A SEV - UKR"}));
+  EXPECT_FALSE(coordinated({"F BLA S A SEV", "A SEV - RUM"}));
+  EXPECT_TRUE(coordinated({"F BLA S A SEV", "A SEV H"}));
+  EXPECT_FALSE(coordinated({"F BLA S A SEV", "A RUM S A SEV - UKR"}));
+  EXPECT_TRUE(coordinated({"F BLA S A SEV - RUM"})); // foreign unit
+  EXPECT_TRUE(coordinated({"F SPA/SC S F MAO - POR", "F MAO - POR"}));
+}
+
+TEST_F(PlausibleOrdersTest, TestCountAndSort) {
+  PlausibleOrdersCounter counter(encoder_);
+  counter.add(make_order_idxs({{0, 3}, {3, 0}, {1, 2}, {0, 4}}),
+              torch::tensor({-1.0f, -1.0f, -0.5f, -2.0f}).view({4, 1}).expand(
+                  {4, 7}));
+  counter.add(make_order_idxs({{1, 2}}), torch::full({1, 7}, -0.5f));
+  EXPECT_EQ(counter.get_n_samples(), 5);
+  EXPECT_EQ(counter.get_n_unique(0), 3);
+  EXPECT_EQ(counter.get_n_unique(1), 1); // all empty
+
+  auto actions = counter.get_plausible_actions(0, 5, nullopt);
+  ASSERT_EQ(actions.size(), 3);
+  EXPECT_EQ(actions[0].orders,
+            vector<string>({"A SEV - RUM", "F BLA S A SEV - RUM"}));
+  EXPECT_EQ(actions[0].count, 2);
+  EXPECT_FLOAT_EQ(actions[0].logprob, -0.5);
+  // Step order is kept as first sampled
+  EXPECT_EQ(actions[1].orders, vector<string>({"A SEV H", "F BLA H"}));
+  EXPECT_EQ(actions[1].count, 2);
+  EXPECT_EQ(actions[2].count, 1);
+
+  EXPECT_EQ(counter.get_plausible_actions(0, 1, nullopt).size(), 1);
+  EXPECT_EQ(counter.get_plausible_actions(1, 1, nullopt)[0].orders.size(), 0);
+}
+
+TEST_F(PlausibleOrdersTest, TestFilter) {
+  PlausibleOrdersCounter counter(encoder_);
+  counter.add(make_order_idxs({{0, 3}, {1, 4}, {1, 2}}),
+              torch::tensor({-0.1f, -0.2f, -0.3f}).view({3, 1}).expand({3, 7}));
+
+  // Only filtered if there are more actions than the limit
+  EXPECT_EQ(counter.get_plausible_actions(0, 3, 2).size(), 3);
+
+  auto actions = counter.get_plausible_actions(0, 2, 2);
+  ASSERT_EQ(actions.size(), 1);
+  EXPECT_EQ(actions[0].orders,
+            vector<string>({"A SEV - RUM", "F BLA S A SEV - RUM"}));
+
+  // All-holds of fewer than exclude_n_holds orders are kept
+  EXPECT_EQ(counter.get_plausible_actions(0, 2, 3).size(), 2);
+}
+
+TEST_F(PlausibleOrdersTest, TestEncoderFromBytes) {
+  OrdersEncoder encoder({{"A PAR B;F BRE B", 0}, {"F STP/SC - BOT", 2}}, 469);
+  string data = encoder.to_bytes();
+  OrdersEncoder loaded = OrdersEncoder::from_bytes(data);
+  EXPECT_EQ(loaded.to_bytes(), data);
+  EXPECT_EQ(loaded.get_order_vocabulary(),
+            vector<string>({"A PAR B;F BRE B", "", "F STP/SC - BOT"}));
+  EXPECT_EQ(loaded.get_max_cands(), 469);
+  EXPECT_NE(loaded.get_id(), encoder.get_id());
+
+  vector<Order> orders;
+  const long order_idxs[] = {2, 0, OrdersEncoder::EOS_IDX};
+  loaded.decode_power_order_idxs(order_idxs, 3, orders);
+  EXPECT_EQ(orders, vector<Order>({Order("F STP/SC - BOT"), Order("A PAR B"),
+                                   Order("F BRE B")}));
+
+  EXPECT_THROW(OrdersEncoder::from_bytes(data.substr(0, data.size() - 1)),
+               std::exception);
+
+  // Loaded encoders work like built ones
+  OrdersEncoder loaded_fixture = OrdersEncoder::from_bytes(encoder_.to_bytes());
+  PlausibleOrdersCounter counter(loaded_fixture);
+  counter.add(make_order_idxs({{1, 2}}), torch::full({1, 7}, -0.5f));
+  EXPECT_EQ(counter.get_plausible_actions(0, 1, nullopt)[0].orders,
+            vector<string>({"A SEV - RUM", "F BLA S A SEV - RUM"}));
+}
+
+} // namespace dipcc
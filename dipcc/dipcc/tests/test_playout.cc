@@ -0,0 +1,105 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <random>
+
+#include "../cc/game.h"
+#include "../cc/playout.h"
+#include "../cc/thread_pool.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class PlayoutTest : public ::testing::Test {};
+
+TEST_F(PlayoutTest, TestOrdersArePossible) {
+  for (PlayoutPolicy policy :
+       {PlayoutPolicy::RANDOM, PlayoutPolicy::HEURISTIC}) {
+    mt19937 rng(0);
+    Game game;
+    for (int i = 0; i < 40 && !game.is_game_done(); ++i) {
+      set_playout_orders(game, policy, rng);
+      const auto &all_possible_orders = game.get_all_possible_orders();
+      const auto &orderable_locations = game.get_orderable_locations();
+      char phase_type = game.get_state().get_phase().phase_type;
+      for (const auto & [ power, orders ] : game.get_staged_orders()) {
+        size_t n_locs = orderable_locations.at(power).size();
+        if (phase_type == 'A') {
+          EXPECT_EQ(orders.size(),
+                    min<size_t>(abs(game.get_state().get_n_builds(power)),
+                                n_locs));
+        } else {
+          EXPECT_EQ(orders.size(), n_locs);
+        }
+        for (const Order &order : orders) {
+          const auto &possible = all_possible_orders.at(order.get_unit().loc);
+          EXPECT_NE(possible.find(order), possible.end())
+              << game.get_state().get_phase().to_string() << " "
+              << order.to_string();
+        }
+      }
+      game.process();
+    }
+  }
+}
+
+TEST_F(PlayoutTest, TestHeuristicMovesToCenters) {
+  mt19937 rng(0);
+  Game game;
+  set_playout_orders(game, PlayoutPolicy::HEURISTIC, rng);
+  const auto &france = game.get_staged_orders().at(Power::FRANCE);
+  EXPECT_NE(find(france.begin(), france.end(), Order("A MAR - SPA")),
+            france.end());
+
+  // A unit on a center it does not own stays to take it
+  game.process();
+  ASSERT_EQ(game.get_state().get_unit(Loc::SPA).power, Power::FRANCE);
+  set_playout_orders(game, PlayoutPolicy::HEURISTIC, rng);
+  for (const Order &order : game.get_staged_orders().at(Power::FRANCE)) {
+    if (order.get_unit().loc == Loc::SPA) {
+      EXPECT_NE(order.get_type(), OrderType::M) << order.to_string();
+    }
+  }
+}
+
+TEST_F(PlayoutTest, TestPlayoutStops) {
+  mt19937 rng(0);
+  Game game;
+  EXPECT_EQ(playout(game, PlayoutPolicy::RANDOM, 0, rng), 1);
+  EXPECT_EQ(game.get_state().get_phase().to_string(), "F1901M");
+
+  Game other;
+  EXPECT_GE(playout(other, PlayoutPolicy::HEURISTIC, 2, rng), 2);
+  EXPECT_EQ(other.get_state().get_phase().to_string(), "S1902M");
+}
+
+TEST_F(PlayoutTest, TestPlayoutMultiIsDeterministic) {
+  auto run = [](size_t n_threads) {
+    ThreadPool pool(n_threads, {}, 469);
+    vector<Game> games(8);
+    vector<Game *> game_ptrs;
+    for (Game &game : games) {
+      game_ptrs.push_back(&game);
+    }
+    int64_t n_phases =
+        pool.playout_multi(game_ptrs, PlayoutPolicy::RANDOM, 3, 42);
+    vector<size_t> hashes;
+    for (Game &game : games) {
+      hashes.push_back(game.compute_board_hash());
+    }
+    EXPECT_GE(n_phases, 8 * 3);
+    return make_pair(n_phases, hashes);
+  };
+  auto one = run(1);
+  EXPECT_EQ(run(3), one);
+  // Games get different RNGs
+  EXPECT_NE(one.second[0], one.second[1]);
+}
+
+} // namespace dipcc
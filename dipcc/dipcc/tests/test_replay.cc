@@ -0,0 +1,62 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <string>
+#include <vector>
+
+#include "../cc/game.h"
+#include "../cc/replay.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class ReplayTest : public ::testing::Test {};
+
+Game make_replay_game() {
+  Game game;
+  game.set_orders("FRANCE", {"A PAR - BUR", "A MAR - SPA"});
+  game.set_orders("GERMANY", {"A MUN - BUR"});
+  game.process();
+  game.set_orders("FRANCE", {"A MAR - BUR"});
+  game.process();
+  game.process();
+  return game;
+}
+
+TEST_F(ReplayTest, TestProcessedGameReplays) {
+  Game game = make_replay_game();
+  ReplayResult r = replay_game(game);
+  EXPECT_TRUE(r.ok()) << r.error;
+  EXPECT_EQ(r.n_phases, 3);
+
+  r = replay_game_json(game.to_json());
+  EXPECT_TRUE(r.ok()) << r.error;
+  EXPECT_EQ(r.n_phases, 3);
+}
+
+TEST_F(ReplayTest, TestChangedOrdersMismatch) {
+  string json = make_replay_game().to_json();
+  size_t pos = json.find("A MAR - SPA");
+  ASSERT_NE(pos, string::npos);
+  json.replace(pos, string("A MAR - SPA").size(), "A MAR H");
+
+  ReplayResult r = replay_game_json(json);
+  EXPECT_TRUE(r.error.empty()) << r.error;
+  ASSERT_FALSE(r.mismatches.empty());
+  EXPECT_EQ(r.mismatches[0].rfind("S1901M: units:", 0), 0) << r.mismatches[0];
+}
+
+TEST_F(ReplayTest, TestBadJsonIsError) {
+  ReplayResult r = replay_game_json("{not json");
+  EXPECT_FALSE(r.ok());
+  EXPECT_EQ(r.error.rfind("load: ", 0), 0) << r.error;
+  EXPECT_EQ(r.n_phases, 0);
+}
+
+} // namespace dipcc
@@ -0,0 +1,197 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <cstdio>
+#include <set>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../cc/replay_buffer.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class ReplayBufferTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    int fd = mkstemp(path_);
+    ASSERT_GE(fd, 0);
+    close(fd);
+  }
+  void TearDown() override { remove(path_); }
+
+  char path_[64] = "/tmp/test_replay_buffer_XXXXXX";
+};
+
+// n rows whose fields all hold the row's value first + i
+TensorDict make_rows(long first, long n) {
+  torch::Tensor ids = torch::arange(first, first + n, torch::kLong);
+  return {{"x_board_state", ids.to(torch::kUInt8).view({n, 1, 1}).expand(
+                                {n, 81, 5})},
+          {"y_actions", ids.to(torch::kShort).view({n, 1}).expand({n, 7})},
+          {"rewards", ids.to(torch::kFloat32).view({n, 1}).expand({n, 7})}};
+}
+
+// Each sampled row's value, checking that its fields agree
+vector<long> sampled_ids(const TensorDict &batch) {
+  vector<long> r;
+  for (long i = 0; i < batch.at("rewards").size(0); ++i) {
+    long id = batch.at("rewards")[i][0].item<float>();
+    EXPECT_TRUE(
+        torch::all(batch.at("x_board_state")[i] == uint8_t(id)).item<bool>());
+    EXPECT_TRUE(torch::all(batch.at("y_actions")[i] == id).item<bool>());
+    EXPECT_TRUE(torch::all(batch.at("rewards")[i] == id).item<bool>());
+    r.push_back(id);
+  }
+  return r;
+}
+
+TEST_F(ReplayBufferTest, TestAppendAndSample) {
+  ReplayBuffer buffer(path_, 10, make_rows(0, 1));
+  EXPECT_EQ(buffer.get_field_names(),
+            vector<string>({"rewards", "x_board_state", "y_actions"}));
+  EXPECT_THROW(buffer.sample(1), std::exception);
+
+  EXPECT_EQ(buffer.append(make_rows(0, 4)), 0);
+  EXPECT_EQ(buffer.append(make_rows(4, 2)), 4);
+  EXPECT_EQ(buffer.size(), 6);
+
+  buffer.seed(0);
+  TensorDict batch = buffer.sample(100);
+  EXPECT_EQ(batch.at("x_board_state").sizes(),
+            torch::IntArrayRef({100, 81, 5}));
+  EXPECT_EQ(batch.at("y_actions").scalar_type(), torch::kShort);
+  vector<long> ids = sampled_ids(batch);
+  EXPECT_EQ(set<long>(ids.begin(), ids.end()), set<long>({0, 1, 2, 3, 4, 5}));
+  for (long i = 0; i < 100; ++i) {
+    EXPECT_EQ(batch.at("sample_idxs")[i].item<long>(), ids[i]);
+    EXPECT_FLOAT_EQ(batch.at("sample_probs")[i].item<float>(), 1.0 / 6);
+  }
+
+  // Rows of the wrong shape or fields
+  EXPECT_THROW(buffer.append({{"rewards", torch::zeros({1, 7})}}),
+               std::exception);
+  TensorDict bad = make_rows(0, 1);
+  bad["y_actions"] = torch::zeros({1, 6});
+  EXPECT_THROW(buffer.append(bad), std::exception);
+}
+
+TEST_F(ReplayBufferTest, TestWrapsAround) {
+  ReplayBuffer buffer(path_, 5, make_rows(0, 1));
+  for (long i = 0; i < 12; i += 3) {
+    buffer.append(make_rows(i, 3));
+  }
+  EXPECT_EQ(buffer.get_n_appended(), 12);
+  EXPECT_EQ(buffer.size(), 5);
+  vector<long> ids = sampled_ids(buffer.sample(100));
+  EXPECT_EQ(set<long>(ids.begin(), ids.end()),
+            set<long>({7, 8, 9, 10, 11}));
+  EXPECT_THROW(buffer.append(make_rows(0, 6)), std::exception);
+}
+
+TEST_F(ReplayBufferTest, TestAttach) {
+  ReplayBuffer buffer(path_, 10, make_rows(0, 1));
+  buffer.append(make_rows(0, 3));
+
+  ReplayBuffer attached(path_);
+  EXPECT_EQ(attached.get_capacity(), 10);
+  EXPECT_EQ(attached.get_field_names(), buffer.get_field_names());
+  attached.append(make_rows(3, 2));
+  EXPECT_EQ(buffer.size(), 5);
+  vector<long> ids = sampled_ids(buffer.sample(100));
+  EXPECT_EQ(set<long>(ids.begin(), ids.end()), set<long>({0, 1, 2, 3, 4}));
+}
+
+TEST_F(ReplayBufferTest, TestPrioritized) {
+  ReplayBuffer buffer(path_, 4, make_rows(0, 1));
+  buffer.append(make_rows(0, 4));
+  buffer.set_priorities(torch::tensor({0, 1, 2, 3}, torch::kLong),
+                        torch::tensor({0.0, 3.0, 1.0, 0.0}));
+  buffer.seed(0);
+  TensorDict batch = buffer.sample(4000, true);
+  vector<long> ids = sampled_ids(batch);
+  long n_1 = count(ids.begin(), ids.end(), 1);
+  long n_2 = count(ids.begin(), ids.end(), 2);
+  EXPECT_EQ(n_1 + n_2, 4000);
+  EXPECT_NEAR(n_1 / 4000.0, 0.75, 0.03);
+  for (long i = 0; i < 4000; ++i) {
+    EXPECT_FLOAT_EQ(batch.at("sample_probs")[i].item<float>(),
+                    ids[i] == 1 ? 0.75 : 0.25);
+  }
+
+  // New rows get the highest priority so far
+  buffer.append(make_rows(4, 1));
+  ids = sampled_ids(buffer.sample(4000, true));
+  EXPECT_NEAR(count(ids.begin(), ids.end(), 4) / 4000.0, 3.0 / 7, 0.03);
+}
+
+TEST_F(ReplayBufferTest, TestConcurrentAppendAndSample) {
+  ReplayBuffer buffer(path_, 64, make_rows(0, 1));
+  buffer.append(make_rows(0, 1));
+  vector<thread> producers;
+  for (int t = 0; t < 4; ++t) {
+    producers.emplace_back([&, t] {
+      for (int i = 0; i < 200; ++i) {
+        buffer.append(make_rows((t * 200 + i) % 250, 3));
+      }
+    });
+  }
+  for (int i = 0; i < 50; ++i) {
+    sampled_ids(buffer.sample(32));
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(buffer.get_n_appended(), 1 + 4 * 200 * 3);
+}
+
+TEST_F(ReplayBufferTest, TestLappingAppends) {
+  // Appends lap the ring many times over while earlier ones still write
+  ReplayBuffer buffer(path_, 2, make_rows(0, 1));
+  buffer.append(make_rows(0, 2));
+  vector<thread> producers;
+  for (int t = 0; t < 8; ++t) {
+    producers.emplace_back([&, t] {
+      for (int i = 0; i < 500; ++i) {
+        buffer.append(make_rows((t * 500 + i) % 250, 2));
+      }
+    });
+  }
+  for (int i = 0; i < 200; ++i) {
+    sampled_ids(buffer.sample(8));
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  sampled_ids(buffer.sample(100));
+}
+
+TEST_F(ReplayBufferTest, TestAttachBadFile) {
+  {
+    ReplayBuffer buffer(path_, 10, make_rows(0, 1));
+  }
+  // The lowest free fd, which a leaked fd would take
+  int free_fd = dup(0);
+  close(free_fd);
+
+  struct stat st;
+  ASSERT_EQ(stat(path_, &st), 0);
+  ASSERT_EQ(truncate(path_, st.st_size - 1), 0);
+  EXPECT_THROW(ReplayBuffer attached(path_), std::exception);
+  ASSERT_EQ(truncate(path_, 16), 0);
+  EXPECT_THROW(ReplayBuffer attached(path_), std::exception);
+
+  int fd = dup(0);
+  close(fd);
+  EXPECT_EQ(fd, free_fd);
+}
+
+} // namespace dipcc
@@ -0,0 +1,96 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <thread>
+
+#include "../cc/game.h"
+#include "../cc/rollout_cache.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class RolloutCacheTest : public ::testing::Test {};
+
+TEST_F(RolloutCacheTest, TestGetPut) {
+  Game game;
+  RolloutCache cache(100);
+  PowerOrderStrs a{{"FRANCE", {"A PAR - BUR", "A MAR H"}},
+                   {"GERMANY", {"A MUN - RUH"}}};
+  PowerOrderStrs a_reordered{{"GERMANY", {"A MUN - RUH"}},
+                             {"FRANCE", {"A MAR H", "A PAR - BUR"}}};
+  PowerOrderStrs b{{"FRANCE", {"A PAR - BUR"}}};
+
+  EXPECT_FALSE(cache.get_multi(game, {a})[0]);
+  cache.put(game, a, {1, 2, 3, 4, 5, 6, 7});
+
+  auto r = cache.get_multi(game, {a_reordered, b});
+  ASSERT_TRUE(r[0]);
+  EXPECT_EQ((*r[0])[6], 7);
+  EXPECT_FALSE(r[1]);
+  EXPECT_EQ(cache.get_hits(), 1);
+  EXPECT_EQ(cache.get_misses(), 2);
+
+  // Same orders on another board miss
+  game.process();
+  EXPECT_FALSE(cache.get_multi(game, {a})[0]);
+}
+
+TEST_F(RolloutCacheTest, TestStagedOrdersKey) {
+  Game game;
+  RolloutCache cache(100);
+  PowerOrderStrs a{{"FRANCE", {"A PAR - BUR", "A MAR H"}},
+                   {"GERMANY", {"A MUN - RUH"}}};
+  for (auto & [ power, orders ] : a) {
+    game.set_orders(power, orders);
+  }
+  EXPECT_EQ(RolloutCache::make_key(game), RolloutCache::make_key(game, a));
+
+  cache.put_multi({RolloutCache::make_key(game)}, {{1, 2, 3, 4, 5, 6, 7}});
+  auto r = cache.get_multi(game, {a});
+  ASSERT_TRUE(r[0]);
+  EXPECT_EQ((*r[0])[0], 1);
+}
+
+TEST_F(RolloutCacheTest, TestClockEviction) {
+  RolloutCache cache(4, 1);
+  RolloutCache::Values values{};
+  for (uint64_t i = 0; i < 4; ++i) {
+    cache.put({i, 0}, values);
+  }
+  EXPECT_EQ(cache.size(), 4);
+
+  // Referenced entries get a second chance
+  ASSERT_TRUE(cache.get({0, 0}, values));
+  cache.put({4, 0}, values);
+  EXPECT_EQ(cache.size(), 4);
+  EXPECT_TRUE(cache.get({0, 0}, values));
+  EXPECT_FALSE(cache.get({1, 0}, values));
+  EXPECT_TRUE(cache.get({4, 0}, values));
+}
+
+TEST_F(RolloutCacheTest, TestConcurrent) {
+  RolloutCache cache(1000);
+  vector<thread> threads;
+  for (uint64_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      RolloutCache::Values values{};
+      for (uint64_t i = 0; i < 1000; ++i) {
+        values[0] = i;
+        cache.put({i, t}, values);
+        cache.get({i, t}, values);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.size(), cache.get_capacity());
+}
+
+} // namespace dipcc
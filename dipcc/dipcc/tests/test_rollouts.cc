@@ -0,0 +1,190 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/game.h"
+#include "../cc/orders_encoder.h"
+#include "../cc/rollouts.h"
+#include "../cc/thread_pool.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class RolloutsTest : public ::testing::Test {};
+
+TEST_F(RolloutsTest, TestNMovePhasesLater) {
+  EXPECT_EQ(n_move_phases_later(Phase("S1901M"), 0).to_string(), "S1901M");
+  EXPECT_EQ(n_move_phases_later(Phase("S1901M"), 1).to_string(), "F1901M");
+  EXPECT_EQ(n_move_phases_later(Phase("F1901R"), 1).to_string(), "S1902M");
+  EXPECT_EQ(n_move_phases_later(Phase("W1901A"), 3).to_string(), "F1903M");
+}
+
+TEST_F(RolloutsTest, TestStagedOrdersKeptOnFirstPly) {
+  ThreadPool pool(2, {}, 469);
+  Game a, b;
+  a.set_orders("ITALY", {"A VEN - TYR"});
+  vector<Game *> games{&a, &b};
+
+  // A policy that orders nothing, so that units hold
+  int n_queries = 0;
+  RolloutPolicy policy = [&](const TensorDict &x) {
+    ++n_queries;
+    long B = x.at("x_board_state").size(0);
+    return torch::full({B, 7, OrdersEncoder::MAX_SEQ_LEN},
+                       OrdersEncoder::EOS_IDX, torch::kLong);
+  };
+
+  EXPECT_EQ(run_rollouts(pool, games, 1, policy), 1);
+  EXPECT_EQ(n_queries, 1);
+  for (Game *game : games) {
+    EXPECT_EQ(game->get_state().get_phase().to_string(), "F1901M");
+  }
+  EXPECT_EQ(a.get_state().get_unit(loc_from_str("TYR")).power, Power::ITALY);
+  EXPECT_EQ(b.get_state().get_unit(loc_from_str("VEN")).power, Power::ITALY);
+}
+
+TEST_F(RolloutsTest, TestStopEarly) {
+  ThreadPool pool(2, {}, 469);
+  RolloutPolicy hold = [](const TensorDict &x) {
+    long B = x.at("x_board_state").size(0);
+    return torch::full({B, 7, OrdersEncoder::MAX_SEQ_LEN},
+                       OrdersEncoder::EOS_IDX, torch::kLong);
+  };
+
+  // Units hold, so the centers of S1902M are those of S1901M
+  for (bool by_year : {true, false}) {
+    Game a, b;
+    vector<Game *> games{&a, &b};
+    RolloutStopOptions stop;
+    if (by_year) {
+      stop.max_year = 1902;
+    } else {
+      stop.stalemate_years = 1;
+    }
+    EXPECT_EQ(run_rollouts(pool, games, 10, hold, stop), 2);
+    for (Game *game : games) {
+      EXPECT_EQ(game->get_state().get_phase().to_string(), "S1902M");
+    }
+  }
+
+  // Games with a power valued at least value_cutoff stop, and are dropped
+  // from the batch: here a, once it is in F1901M with b
+  Game a, b;
+  b.process();
+  vector<Game *> games{&a, &b};
+  RolloutStopOptions stop;
+  stop.value_cutoff = 0.9;
+  int n_values = 0;
+  stop.values = [&](const TensorDict &x) {
+    long B = x.at("x_board_state").size(0);
+    torch::Tensor r = torch::full({B, 7}, 0.5, torch::kFloat);
+    if (n_values++ > 0) {
+      r[0][3] = 0.95;
+    }
+    return r;
+  };
+  vector<long> batch_sizes;
+  RolloutPolicy counted_hold = [&](const TensorDict &x) {
+    batch_sizes.push_back(x.at("x_board_state").size(0));
+    return hold(x);
+  };
+  EXPECT_EQ(run_rollouts(pool, games, 2, counted_hold, stop), 2);
+  EXPECT_EQ(batch_sizes, vector<long>({1, 1}));
+  EXPECT_EQ(a.get_state().get_phase().to_string(), "F1901M");
+  EXPECT_EQ(b.get_state().get_phase().to_string(), "S1902M");
+}
+
+TEST_F(RolloutsTest, TestValueCutoff) {
+  // As in TestStopEarly, a is decided once it is in F1901M with b: by the
+  // values returned with the policy's orders, or by stop.values before
+  // querying the policy. Inputs are prev state delta encoded.
+  ThreadPool pool(2, {}, 469);
+  pool.set_prev_state_delta(true);
+  auto values = [](const TensorDict &x, bool decided) {
+    long B = x.at("x_board_state").size(0);
+    torch::Tensor r = torch::full({B, 7}, 0.5, torch::kFloat);
+    if (decided) {
+      r[0][3] = 0.95;
+    }
+    return r;
+  };
+  auto hold = [](const TensorDict &x) {
+    TensorDict expanded = x;
+    expand_prev_state_delta(expanded);
+    long B = expanded.at("x_prev_state").size(0);
+    return torch::full({B, 7, OrdersEncoder::MAX_SEQ_LEN},
+                       OrdersEncoder::EOS_IDX, torch::kLong);
+  };
+
+  for (bool policy_values : {true, false}) {
+    Game a, b;
+    b.process();
+    vector<Game *> games{&a, &b};
+    RolloutStopOptions stop;
+    stop.value_cutoff = 0.9;
+    int n_values = 0;
+    vector<long> batch_sizes;
+    if (policy_values) {
+      RolloutPolicyValues policy = [&](const TensorDict &x) {
+        batch_sizes.push_back(x.at("x_board_state").size(0));
+        return make_pair(hold(x), values(x, n_values++ > 0));
+      };
+      EXPECT_EQ(run_rollouts(pool, games, 2, policy, stop), 2);
+      EXPECT_EQ(batch_sizes, vector<long>({1, 2}));
+    } else {
+      stop.values = [&](const TensorDict &x) {
+        return values(x, n_values++ > 0);
+      };
+      RolloutPolicy policy = [&](const TensorDict &x) {
+        batch_sizes.push_back(x.at("x_board_state").size(0));
+        return hold(x);
+      };
+      EXPECT_EQ(run_rollouts(pool, games, 2, policy, stop), 2);
+      EXPECT_EQ(batch_sizes, vector<long>({1, 1}));
+    }
+    EXPECT_EQ(n_values, 2);
+    EXPECT_EQ(a.get_state().get_phase().to_string(), "F1901M");
+    EXPECT_EQ(b.get_state().get_phase().to_string(), "S1902M");
+  }
+}
+
+TEST_F(RolloutsTest, TestStopEarlyPrevStateDelta) {
+  // Inputs of the games still rolled out, selected from those of the last
+  // ply, keep their CSR prev state deltas consistent
+  ThreadPool pool(2, {}, 469);
+  pool.set_prev_state_delta(true);
+  Game a, b;
+  b.set_orders("GERMANY", {"F KIE - DEN"});
+  vector<Game *> games{&a, &b};
+
+  // a stalemates in S1902M, while b, which took DEN, is in W1901A
+  RolloutStopOptions stop;
+  stop.stalemate_years = 1;
+  vector<long> batch_sizes;
+  RolloutPolicy hold = [&](const TensorDict &x) {
+    long B = x.at("x_board_state").size(0);
+    batch_sizes.push_back(B);
+    vector<Game *> x_games = B == 2 ? games : vector<Game *>{&b};
+    TensorDict expected = pool.encode_inputs_multi(x_games);
+    TensorDict actual = x;
+    expand_prev_state_delta(expected);
+    expand_prev_state_delta(actual);
+    for (const char *name : {"x_board_state", "x_prev_state"}) {
+      EXPECT_TRUE(torch::equal(actual.at(name), expected.at(name)))
+          << name << " of " << B << " games";
+    }
+    return torch::full({B, 7, OrdersEncoder::MAX_SEQ_LEN},
+                       OrdersEncoder::EOS_IDX, torch::kLong);
+  };
+  EXPECT_EQ(run_rollouts(pool, games, 3, hold, stop), 4);
+  EXPECT_EQ(batch_sizes, vector<long>({2, 2, 1, 1}));
+  EXPECT_EQ(a.get_state().get_phase().to_string(), "S1902M");
+  EXPECT_EQ(b.get_state().get_phase().to_string(), "F1902M");
+}
+
+} // namespace dipcc
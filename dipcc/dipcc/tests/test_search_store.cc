@@ -0,0 +1,65 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "../cc/game.h"
+#include "../cc/search_store.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+
+namespace dipcc {
+
+class SearchStoreTest : public ::testing::Test {};
+
+TEST_F(SearchStoreTest, TestAcrossMoves) {
+  Game game;
+  SearchStore store(1 << 20);
+  SearchStore::PlausibleOrders orders;
+  orders[2] = {{{"A PAR - BUR", "A MAR H"}, -0.5}, {{"A PAR H"}, -1.5}};
+
+  uint64_t s1901m = game.stable_board_hash();
+  EXPECT_EQ(store.get_plausible_orders(s1901m), nullptr);
+  store.put_plausible_orders(s1901m, orders);
+  PowerOrderStrs joint{{"FRANCE", {"A PAR - BUR"}}};
+  store.get_rollout_cache()->put(game, joint, {1, 2, 3, 4, 5, 6, 7});
+
+  // The next move's search misses, and doesn't evict the last's
+  game.process();
+  EXPECT_EQ(store.get_plausible_orders(game.stable_board_hash()), nullptr);
+
+  Game again;
+  auto r = store.get_plausible_orders(again.stable_board_hash());
+  ASSERT_NE(r, nullptr);
+  EXPECT_EQ(*r, orders);
+  auto values = store.get_rollout_cache()->get_multi(again, {joint});
+  ASSERT_TRUE(values[0]);
+  EXPECT_EQ((*values[0])[6], 7);
+  EXPECT_EQ(store.get_hits(), 1);
+  EXPECT_EQ(store.get_misses(), 2);
+  EXPECT_GT(store.get_bytes(), 0);
+}
+
+TEST_F(SearchStoreTest, TestBudget) {
+  SearchStore store(1 << 16);
+  SearchStore::PlausibleOrders orders;
+  orders[0] = {{{"A VIE - GAL", "A BUD - SER", "F TRI - ALB"}, -1}};
+  for (uint64_t i = 0; i < 1000; ++i) {
+    store.put_plausible_orders(i, orders);
+    // Keep the first board in use
+    EXPECT_NE(store.get_plausible_orders(0), nullptr);
+  }
+  EXPECT_LT(store.size(), 1000);
+  EXPECT_LE(store.get_bytes(), store.get_max_bytes() / 2);
+  EXPECT_EQ(store.get_plausible_orders(1), nullptr);
+  EXPECT_NE(store.get_plausible_orders(999), nullptr);
+
+  store.clear();
+  EXPECT_EQ(store.size(), 0);
+  EXPECT_EQ(store.get_bytes(), 0);
+}
+
+} // namespace dipcc
@@ -0,0 +1,285 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "../cc/thirdparty/nlohmann/json.hpp"
+#include "../cc/thread_pool.h"
+#include "../cc/trace.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+using nlohmann::json;
+
+namespace dipcc {
+
+class ThreadPoolTest : public ::testing::Test {};
+
+TEST_F(ThreadPoolTest, TestCatPadInputs) {
+  ThreadPool pool(3, {}, 469);
+  vector<TensorDict> xs;
+  for (long i = 0; i < 5; ++i) {
+    long seq_len = i % 2 == 0 ? 17 : 34;
+    xs.push_back(
+        {{"x_possible_actions",
+          torch::full({i + 1, 7, seq_len, 4}, i, torch::kInt32)},
+         {"x_season", torch::full({i + 1, 3}, float(i))}});
+  }
+  TensorDict r = pool.cat_pad_inputs(xs, {{"x_possible_actions", -1}});
+
+  torch::Tensor actions = r["x_possible_actions"];
+  ASSERT_EQ(actions.sizes(), torch::IntArrayRef({15, 7, 34, 4}));
+  long row = 0;
+  for (long i = 0; i < 5; ++i) {
+    long seq_len = xs[i]["x_possible_actions"].size(2);
+    torch::Tensor rows = actions.narrow(0, row, i + 1);
+    EXPECT_TRUE(torch::equal(rows.narrow(2, 0, seq_len),
+                             xs[i]["x_possible_actions"]));
+    EXPECT_TRUE(
+        torch::all(rows.narrow(2, seq_len, 34 - seq_len) == -1).item<bool>());
+    row += i + 1;
+  }
+
+  // Unpadded fields are concatenated as is
+  vector<torch::Tensor> seasons;
+  for (auto &x : xs) {
+    seasons.push_back(x["x_season"]);
+  }
+  EXPECT_TRUE(torch::equal(r["x_season"], torch::cat(seasons)));
+
+  // Which must match
+  xs[0]["x_season"] = torch::zeros({1, 4});
+  EXPECT_THROW(pool.cat_pad_inputs(xs, {{"x_possible_actions", -1}}),
+               std::exception);
+}
+
+TEST_F(ThreadPoolTest, TestTrimSeqLen) {
+  ThreadPool pool(2, {{"F BRE H", 0}, {"A PAR H", 1}}, 469);
+  Game game_a, game_b;
+  vector<Game *> games = {&game_a, &game_b};
+  TensorDict full = pool.encode_inputs_multi(games);
+  pool.set_trim_seq_len(true);
+  TensorDict trimmed = pool.encode_inputs_multi(games);
+
+  // Russia has the most units, 4
+  torch::Tensor actions = trimmed["x_possible_actions"];
+  ASSERT_EQ(actions.sizes(), torch::IntArrayRef({2, 7, 4, 469}));
+  EXPECT_TRUE(actions.is_contiguous());
+  EXPECT_TRUE(
+      torch::equal(actions, full["x_possible_actions"].narrow(2, 0, 4)));
+  EXPECT_TRUE(torch::all(full["x_possible_actions"].narrow(2, 4, 13) == -1)
+                  .item<bool>());
+  EXPECT_TRUE(torch::equal(trimmed["x_loc_idxs"], full["x_loc_idxs"]));
+
+  // All powers: one sequence of the 22 units
+  TensorDict all_powers = pool.encode_inputs_all_powers_multi(games);
+  EXPECT_EQ(all_powers["x_possible_actions"].size(2), 22);
+  EXPECT_EQ(all_powers["x_power"].sizes(), torch::IntArrayRef({2, 7, 22}));
+
+  // Released fields are reused at their full length
+  pool.release_encoded_inputs(trimmed);
+  pool.set_trim_seq_len(false);
+  TensorDict reused = pool.encode_inputs_multi(games);
+  EXPECT_EQ(reused["x_possible_actions"].data_ptr(), actions.data_ptr());
+  EXPECT_TRUE(
+      torch::equal(reused["x_possible_actions"], full["x_possible_actions"]));
+}
+
+TEST_F(ThreadPoolTest, TestTryProcessMulti) {
+  ThreadPool pool(2, {}, 469);
+  // DATC 6.F.14, simple convoy paradox
+  Game paradox;
+  LocMap<OwnedUnit> units;
+  units[Loc::LON] = {Power::ENGLAND, UnitType::FLEET, Loc::LON};
+  units[Loc::WAL] = {Power::ENGLAND, UnitType::FLEET, Loc::WAL};
+  units[Loc::BRE] = {Power::FRANCE, UnitType::ARMY, Loc::BRE};
+  units[Loc::ENG] = {Power::FRANCE, UnitType::FLEET, Loc::ENG};
+  paradox.get_state().set_units(units);
+  paradox.get_state().clear_all_possible_orders();
+  paradox.set_orders("ENGLAND", {"F LON S F WAL - ENG", "F WAL - ENG"});
+  paradox.set_orders("FRANCE", {"A BRE - LON", "F ENG C A BRE - LON"});
+  paradox.set_exception_on_convoy_paradox();
+
+  Game game_a, game_b, paradox_b(paradox);
+  vector<Game *> games = {&game_a, &paradox, &game_b, &paradox_b};
+  vector<ProcessStatus> statuses = pool.try_process_multi(games);
+  EXPECT_EQ(statuses, vector<ProcessStatus>({ProcessStatus::OK,
+                                             ProcessStatus::CONVOY_PARADOX,
+                                             ProcessStatus::OK,
+                                             ProcessStatus::CONVOY_PARADOX}));
+  EXPECT_EQ(game_a.get_state().get_phase().to_string(), "F1901M");
+  EXPECT_EQ(game_b.get_state().get_phase().to_string(), "F1901M");
+  EXPECT_EQ(paradox.get_state().get_phase().to_string(), "S1901M");
+  EXPECT_EQ(paradox_b.get_staged_orders().size(), 2);
+}
+
+TEST_F(ThreadPoolTest, TestLowLatency) {
+  ThreadPool pool(2, {{"F BRE H", 0}, {"A PAR H", 1}, {"A MOS H", 2}}, 469);
+  Game game_a, game_b;
+  game_b.process();
+  vector<Game *> games = {&game_a, &game_b};
+  TensorDict expected = pool.encode_inputs_multi(games);
+
+  for (size_t inline_max_games : {0, 2, 4}) {
+    pool.set_inline_max_games(inline_max_games);
+    pool.set_spin_us(inline_max_games == 0 ? 50 : 0);
+    TensorDict r = pool.encode_inputs_multi(games);
+    for (auto &it : expected) {
+      EXPECT_TRUE(torch::equal(r[it.first], it.second)) << it.first;
+    }
+  }
+
+  // Inline batches are done when submitted
+  pool.set_inline_max_games(2);
+  ThreadPoolFuture future = pool.process_multi_async(games);
+  EXPECT_TRUE(future.done());
+  future.wait();
+  EXPECT_EQ(game_a.get_state().get_phase().to_string(), "F1901M");
+  EXPECT_EQ(game_b.get_state().get_phase().to_string(), "S1902M");
+}
+
+TEST_F(ThreadPoolTest, TestResize) {
+  ThreadPool pool(2, {}, 469);
+  vector<Game> games(16);
+  vector<Game *> game_ptrs;
+  for (Game &game : games) {
+    game_ptrs.push_back(&game);
+  }
+  for (size_t n_threads : {4, 1, 0, 3}) {
+    pool.resize(n_threads);
+    EXPECT_EQ(pool.get_n_threads(), n_threads);
+    pool.process_multi(game_ptrs);
+  }
+  for (Game &game : games) {
+    EXPECT_EQ(game.get_state().get_phase().to_string(), "S1903M");
+  }
+
+  // The controller keeps the pool within bounds
+  pool.set_adaptive_sizing(2, 3, 1);
+  EXPECT_GE(pool.get_n_threads(), 2);
+  for (int i = 0; i < 20; ++i) {
+    pool.process_multi(game_ptrs);
+    EXPECT_GE(pool.get_n_threads(), 2);
+    EXPECT_LE(pool.get_n_threads(), 3);
+  }
+  pool.set_adaptive_sizing(0, 0);
+  size_t n_threads = pool.get_n_threads();
+  this_thread::sleep_for(chrono::milliseconds(5));
+  EXPECT_EQ(pool.get_n_threads(), n_threads);
+}
+
+TEST_F(ThreadPoolTest, TestEncodeInputsPowers) {
+  ThreadPool pool(2, {{"F BRE H", 0}, {"A PAR H", 1}, {"A MOS H", 2}}, 469);
+  Game game_a, game_b;
+  vector<Game *> games = {&game_a, &game_b};
+  TensorDict full = pool.encode_inputs_multi(games);
+  TensorDict r = pool.encode_inputs_powers_multi(
+      games, {Power::RUSSIA, Power::FRANCE});
+
+  ASSERT_EQ(r["x_possible_actions"].sizes(),
+            torch::IntArrayRef({2, 2, 17, 469}));
+  ASSERT_EQ(r["x_loc_idxs"].sizes(), torch::IntArrayRef({2, 2, 81}));
+  torch::Tensor idxs = torch::tensor({static_cast<int>(Power::RUSSIA) - 1,
+                                      static_cast<int>(Power::FRANCE) - 1},
+                                     torch::kLong);
+  for (auto key : {"x_possible_actions", "x_loc_idxs"}) {
+    EXPECT_TRUE(torch::equal(r[key], full[key].index_select(1, idxs))) << key;
+  }
+  EXPECT_TRUE(torch::equal(r["x_board_state"], full["x_board_state"]));
+
+  // Released fields are not reused by encode_inputs_multi
+  pool.release_encoded_inputs(r);
+  EXPECT_EQ(pool.encode_inputs_multi(games)["x_loc_idxs"].size(1), 7);
+  EXPECT_THROW(pool.encode_inputs_powers_multi(games, {}), std::exception);
+}
+
+TEST_F(ThreadPoolTest, TestLookupRolloutCache) {
+  ThreadPool pool(2, {}, 469);
+  RolloutCache cache(100);
+  Game game_a, game_b, game_c;
+  game_a.set_orders("FRANCE", {"A PAR - BUR"});
+  game_b.set_orders("FRANCE", {"A PAR - PIC"});
+  game_c.set_orders("FRANCE", {"A PAR - BUR"});
+  cache.put(game_a, {{"FRANCE", {"A PAR - BUR"}}}, {1, 2, 3, 4, 5, 6, 7});
+
+  vector<Game *> games = {&game_a, &game_b, &game_c};
+  TensorDict r = pool.lookup_rollout_cache(cache, games);
+  EXPECT_EQ(r["hits"][0].item<bool>(), true);
+  EXPECT_EQ(r["hits"][1].item<bool>(), false);
+  EXPECT_EQ(r["hits"][2].item<bool>(), true);
+  EXPECT_EQ(r["values"][2][6].item<float>(), 7);
+  EXPECT_EQ(r["values"][1].sum().item<float>(), 0);
+
+  // Results put by key are found on the next lookup
+  cache.put_multi({{static_cast<uint64_t>(r["keys"][1][0].item<int64_t>()),
+                    static_cast<uint64_t>(r["keys"][1][1].item<int64_t>())}},
+                  {{7, 6, 5, 4, 3, 2, 1}});
+  r = pool.lookup_rollout_cache(cache, games);
+  EXPECT_EQ(r["hits"].all().item<bool>(), true);
+  EXPECT_EQ(r["values"][1][0].item<float>(), 7);
+}
+
+TEST_F(ThreadPoolTest, TestPriority) {
+  // Queue batches on a parked pool, then let a single worker claim them,
+  // and read the claim order from the trace: INTERACTIVE batches step
+  // games, BULK ones encode them
+  ThreadPool pool(1, {}, 469);
+  pool.set_inline_max_games(0);
+  pool.resize(0);
+
+  const size_t n_bulk = 2, n_interactive = 20;
+  vector<Game> games(n_bulk + n_interactive);
+  vector<vector<Game *>> batches;
+  for (Game &game : games) {
+    batches.push_back({&game});
+  }
+  vector<ThreadPoolFuture> futures;
+  ThreadPoolPriority prev = set_thread_pool_priority(ThreadPoolPriority::BULK);
+  for (size_t i = 0; i < n_bulk; ++i) {
+    futures.push_back(pool.encode_inputs_multi_async(batches[i]));
+  }
+  set_thread_pool_priority(prev);
+  for (size_t i = n_bulk; i < batches.size(); ++i) {
+    futures.push_back(pool.process_multi_async(batches[i]));
+  }
+
+  clear_trace();
+  set_tracing_enabled(true);
+  pool.resize(1);
+  // Poll rather than wait: waiting would claim jobs from the calling thread
+  for (ThreadPoolFuture &future : futures) {
+    while (!future.done()) {
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+  }
+  set_tracing_enabled(false);
+  for (ThreadPoolFuture &future : futures) {
+    future.wait();
+  }
+
+  vector<pair<double, char>> claims;
+  for (auto &event : json::parse(get_trace_json())["traceEvents"]) {
+    if (event["name"] == "step" || event["name"] == "encode") {
+      claims.push_back({event["ts"].get<double>(),
+                        event["name"] == "step" ? 'I' : 'B'});
+    }
+  }
+  clear_trace();
+  sort(claims.begin(), claims.end());
+  string order;
+  for (auto &claim : claims) {
+    order += claim.second;
+  }
+
+  // Interactive batches go first, though submitted later, but every
+  // BULK_CLAIM_INTERVAL-th claim (8) goes to a queued BULK batch
+  EXPECT_EQ(order, "IIIIIIIBIIIIIIIBIIIIII");
+}
+
+} // namespace dipcc
@@ -0,0 +1,56 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include <thread>
+
+#include "../cc/thirdparty/nlohmann/json.hpp"
+#include "../cc/trace.h"
+#include "gtest/gtest.h"
+
+using namespace std;
+using nlohmann::json;
+
+namespace dipcc {
+
+class TraceTest : public ::testing::Test {
+protected:
+  void TearDown() override {
+    set_tracing_enabled(false);
+    clear_trace();
+  }
+};
+
+TEST_F(TraceTest, TestDisabledByDefault) {
+  clear_trace();
+  { TraceScope scope("job", "test"); }
+  EXPECT_EQ(json::parse(get_trace_json())["traceEvents"].size(), 0);
+}
+
+TEST_F(TraceTest, TestEventsOfExitedThreads) {
+  clear_trace();
+  set_tracing_enabled(true);
+  thread th([] {
+    set_trace_thread_name("worker");
+    TraceScope scope("job", "test");
+    scope.add_arg("n_games", "3");
+  });
+  th.join();
+
+  json events = json::parse(get_trace_json())["traceEvents"];
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_EQ(events[0]["ph"], "M");
+  EXPECT_EQ(events[0]["args"]["name"], "worker");
+  EXPECT_EQ(events[1]["name"], "job");
+  EXPECT_EQ(events[1]["ph"], "X");
+  EXPECT_EQ(events[1]["args"]["n_games"], "3");
+  EXPECT_GE(events[1]["dur"].get<double>(), 0);
+
+  clear_trace();
+  EXPECT_EQ(json::parse(get_trace_json())["traceEvents"].size(), 0);
+}
+
+} // namespace dipcc
@@ -0,0 +1,214 @@
+/*
+Copyright (c) Facebook, Inc. and its affiliates.
+
+This source code is licensed under the MIT license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// dipcc_replay: re-adjudicate stored games and check that every phase gives
+// the recorded next state, e.g. after an engine change.
+//
+//   dipcc_replay [--threads N] [--chunk N] [--max_report N] PATH...
+//
+// Each PATH is a game json file, a jsonl file of one game json per line, or a
+// directory searched recursively for *.json and *.jsonl files. Games are
+// loaded and replayed in a ThreadPool, a chunk of games at a time, while the
+// next chunk is read. Mismatches and errors are printed per game, then a
+// summary with throughput. Exits with 1 if any game did not replay cleanly.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../cc/replay.h"
+#include "../cc/thread_pool.h"
+
+using namespace std;
+using namespace dipcc;
+
+namespace {
+
+void usage() {
+  cerr << "Usage: dipcc_replay [--threads N] [--chunk N] [--max_report N] "
+          "PATH...\n";
+  exit(2);
+}
+
+// Game json files and jsonl files under the given paths, sorted within each
+// directory so that runs are reproducible
+vector<filesystem::path> find_files(const vector<string> &paths) {
+  vector<filesystem::path> r;
+  for (const string &path : paths) {
+    if (!filesystem::is_directory(path)) {
+      r.push_back(path);
+      continue;
+    }
+    vector<filesystem::path> found;
+    for (const auto &entry :
+         filesystem::recursive_directory_iterator(path)) {
+      string ext = entry.path().extension().string();
+      if (entry.is_regular_file() && (ext == ".json" || ext == ".jsonl")) {
+        found.push_back(entry.path());
+      }
+    }
+    sort(found.begin(), found.end());
+    r.insert(r.end(), found.begin(), found.end());
+  }
+  return r;
+}
+
+// Reads games one at a time from the files: a .jsonl file gives one game per
+// non-empty line, any other file one game
+class GameReader {
+public:
+  GameReader(vector<filesystem::path> files) : files_(move(files)) {}
+
+  // Set name (file, or file:line) and json of the next game. Returns false
+  // when all files are read.
+  bool next(string &name, string &json) {
+    while (true) {
+      if (jsonl_.is_open()) {
+        while (getline(jsonl_, json)) {
+          ++line_;
+          if (!json.empty()) {
+            name = files_[file_i_ - 1].string() + ":" + to_string(line_);
+            return true;
+          }
+        }
+        jsonl_.close();
+      }
+      if (file_i_ == files_.size()) {
+        return false;
+      }
+      const filesystem::path &path = files_[file_i_++];
+      if (path.extension() == ".jsonl") {
+        jsonl_.open(path);
+        line_ = 0;
+        if (!jsonl_.is_open()) {
+          cerr << "Cannot open " << path << "\n";
+        }
+        continue;
+      }
+      ifstream f(path);
+      if (!f.is_open()) {
+        cerr << "Cannot open " << path << "\n";
+        continue;
+      }
+      stringstream ss;
+      ss << f.rdbuf();
+      name = path.string();
+      json = ss.str();
+      return true;
+    }
+  }
+
+private:
+  vector<filesystem::path> files_;
+  size_t file_i_ = 0;
+  ifstream jsonl_;
+  size_t line_ = 0;
+};
+
+struct Chunk {
+  vector<string> names;
+  vector<string> jsons;
+};
+
+Chunk read_chunk(GameReader &reader, size_t chunk_size) {
+  Chunk r;
+  string name, json;
+  while (r.jsons.size() < chunk_size && reader.next(name, json)) {
+    r.names.push_back(move(name));
+    r.jsons.push_back(move(json));
+  }
+  return r;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t n_threads = max(thread::hardware_concurrency(), 1u);
+  size_t chunk_size = 4096;
+  size_t max_report = 100;
+  vector<string> paths;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--threads" || arg == "--chunk" || arg == "--max_report") {
+      if (i + 1 == argc) {
+        usage();
+      }
+      size_t value = stoul(argv[++i]);
+      if (arg == "--threads") {
+        n_threads = value;
+      } else if (arg == "--chunk") {
+        chunk_size = max(value, size_t(1));
+      } else {
+        max_report = value;
+      }
+    } else if (arg.rfind("--", 0) == 0) {
+      usage();
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    usage();
+  }
+
+  // Replays encode nothing, so the pool needs no order vocabulary
+  ThreadPool pool(n_threads, {}, 0);
+  GameReader reader(find_files(paths));
+
+  size_t n_games = 0, n_phases = 0, n_mismatched = 0, n_errors = 0;
+  size_t n_reported = 0;
+  auto start = chrono::steady_clock::now();
+  Chunk chunk = read_chunk(reader, chunk_size);
+  while (!chunk.jsons.empty()) {
+    auto results = async(launch::async, [&pool, &chunk] {
+      return pool.replay_games(chunk.jsons);
+    });
+    Chunk next_chunk = read_chunk(reader, chunk_size);
+
+    vector<ReplayResult> replays = results.get();
+    for (size_t i = 0; i < replays.size(); ++i) {
+      const ReplayResult &replay = replays[i];
+      ++n_games;
+      n_phases += replay.n_phases;
+      if (replay.ok()) {
+        continue;
+      }
+      if (!replay.error.empty()) {
+        ++n_errors;
+      } else {
+        ++n_mismatched;
+      }
+      if (n_reported++ < max_report) {
+        cout << chunk.names[i] << "\n";
+        for (const string &mismatch : replay.mismatches) {
+          cout << "  " << mismatch << "\n";
+        }
+        if (!replay.error.empty()) {
+          cout << "  error: " << replay.error << "\n";
+        }
+      }
+    }
+    chunk = move(next_chunk);
+  }
+
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << n_games << " games, " << n_phases << " phases, " << n_mismatched
+       << " mismatched, " << n_errors << " errors in " << secs << " s ("
+       << n_games / max(secs, 1e-9) << " games/s, "
+       << n_phases / max(secs, 1e-9) << " phases/s, " << n_threads
+       << " threads)\n";
+  return n_mismatched + n_errors > 0 ? 1 : 0;
+}
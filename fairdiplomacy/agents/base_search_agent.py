@@ -10,6 +10,7 @@ from typing import List, Dict, Union, Sequence, Tuple
 
 from fairdiplomacy.agents.base_agent import BaseAgent
 from fairdiplomacy.agents.model_sampled_agent import resample_duplicate_disbands_inplace
+from fairdiplomacy.data.data_fields import DataFields
 from fairdiplomacy.models.consts import POWERS
 from fairdiplomacy.utils.game_scoring import compute_game_scores_from_state
 from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder
@@ -49,13 +50,13 @@ class BaseSearchAgent(BaseAgent):
         # non-trivial return case: query model
         counters = {p: Counter() for p in POWERS}
 
-        x = [FeatureEncoder().encode_inputs([game])] * n
+        # Every batch samples from the same inputs, so encode them once
+        x = FeatureEncoder().encode_inputs_repeated(game, batch_size)
 
         orders_to_logprobs = {}
-        for x_chunk in [x[i : i + batch_size] for i in range(0, n, batch_size)]:
-            batch_inputs = self.cat_pad_inputs(x_chunk)
+        for _ in range(n // batch_size):
             batch_orders, batch_order_logprobs, _ = self.do_model_request(
-                batch_inputs, temperature, top_p
+                DataFields(x), temperature, top_p
             )
             batch_orders = list(zip(*batch_orders))  # power -> list[orders]
             batch_order_logprobs = batch_order_logprobs.t()  # [7 x B]
@@ -95,7 +95,7 @@ class FP1PAgent(MultiprocSearchAgent):
         self.cum_sigma = defaultdict(float)
 
         game_state = game.get_state()
-        phase = game_state["name"]
+        phase = game.current_short_phase
 
         if self.cache_rollout_results:
             rollout_results_cache = RolloutResultsCache(min_count=self.cache_rollout_results)
@@ -18,7 +18,7 @@ from fairdiplomacy.models.diplomacy_model.order_vocabulary import (
     EOS_IDX,
 )
 from fairdiplomacy import pydipcc
-from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder
+from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder, get_shared_thread_pool
 
 ORDER_VOCABULARY = get_order_vocabulary()
 ORDER_VOCABULARY_TO_IDX = {order: idx for idx, order in enumerate(get_order_vocabulary())}
@@ -32,9 +32,7 @@ class ModelSampledAgent(BaseAgent):
         self.temperature = temperature
         self.device = device
         self.top_p = top_p
-        self.thread_pool = pydipcc.ThreadPool(
-            1, ORDER_VOCABULARY_TO_IDX, get_order_vocabulary_idxs_len()
-        )
+        self.thread_pool = get_shared_thread_pool(1)
 
     def get_orders(self, game, power, *, temperature=None, top_p=None):
         if len(game.get_orderable_locations().get(power, [])) == 0:
@@ -31,14 +31,13 @@ from fairdiplomacy.agents.base_search_agent import (
     get_square_scores_from_game,
 )
 from fairdiplomacy.data.data_fields import DataFields
-from fairdiplomacy.models.consts import MAX_SEQ_LEN, POWERS
+from fairdiplomacy.models.consts import POWERS
 from fairdiplomacy.models.diplomacy_model.load_model import load_diplomacy_model
-from fairdiplomacy.models.diplomacy_model.order_vocabulary import EOS_IDX
 from fairdiplomacy.selfplay.ckpt_syncer import CkptSyncer
 from fairdiplomacy.utils.timing_ctx import TimingCtx
 from fairdiplomacy.utils.exception_handling_process import ExceptionHandlingProcess
-from fairdiplomacy.utils.cat_pad_sequences import cat_pad_sequences
 from fairdiplomacy.utils.game_scoring import compute_game_scores_from_state
+from fairdiplomacy.utils.shared_game import SharedGame, SharedGameHandle, load_shared_game
 from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder
 
 
@@ -149,6 +148,9 @@ class MultiprocSearchAgent(BaseSearchAgent):
         - [7] float32 array of estimated final scores
         """
         B = x["x_board_state"].shape[0]
+        # Expanded inputs (see FeatureEncoder.encode_inputs_repeated) are sent
+        # as dense tensors
+        x = DataFields({k: v.contiguous() for k, v in x.items()})
         x["temperature"] = torch.zeros(B, 1).fill_(temperature)
         x["top_p"] = torch.zeros(B, 1).fill_(top_p)
         try:
@@ -193,31 +195,30 @@ class MultiprocSearchAgent(BaseSearchAgent):
             -> final_scores: Dict[power, supply count],
                e.g. {'AUSTRIA': 6, 'ENGLAND': 3, ...}
         """
-        game_json = game.to_json()
-
         # divide up the rollouts among the processes
-        all_results, all_timings = zip(
-            *self.proc_pool.map(
-                call,
-                [
-                    partial(
-                        self.do_rollout,
-                        game_json=game_json,
-                        set_orders_dict=d,
-                        hostport=self.hostports[i % self.n_server_procs],
-                        value_hostport=self.value_hostport,
-                        temperature=self.rollout_temperature,
-                        top_p=self.rollout_top_p,
-                        max_rollout_length=self.max_rollout_length,
-                        batch_size=average_n_rollouts,
-                        use_predicted_final_scores=self.use_predicted_final_scores,
-                        mix_square_ratio_scoring=self.mix_square_ratio_scoring,
-                        rollout_value_frac=self.rollout_value_frac,
-                    )
-                    for i, d in enumerate(set_orders_dicts)
-                ],
+        with SharedGame(game) as shared_game:
+            all_results, all_timings = zip(
+                *self.proc_pool.map(
+                    call,
+                    [
+                        partial(
+                            self.do_rollout,
+                            game_handle=shared_game.handle,
+                            set_orders_dict=d,
+                            hostport=self.hostports[i % self.n_server_procs],
+                            value_hostport=self.value_hostport,
+                            temperature=self.rollout_temperature,
+                            top_p=self.rollout_top_p,
+                            max_rollout_length=self.max_rollout_length,
+                            batch_size=average_n_rollouts,
+                            use_predicted_final_scores=self.use_predicted_final_scores,
+                            mix_square_ratio_scoring=self.mix_square_ratio_scoring,
+                            rollout_value_frac=self.rollout_value_frac,
+                        )
+                        for i, d in enumerate(set_orders_dicts)
+                    ],
+                )
             )
-        )
 
         if log_timings:
             TimingCtx.pprint_multi(all_timings, logging.getLogger("timings").info)
@@ -231,7 +232,7 @@ class MultiprocSearchAgent(BaseSearchAgent):
     def do_rollout(
         cls,
         *,
-        game_json,
+        game_handle: SharedGameHandle,
         hostport,
         set_orders_dict={},
         temperature,
@@ -248,7 +249,7 @@ class MultiprocSearchAgent(BaseSearchAgent):
         This method can safely be called in a subprocess
 
         Arguments:
-        - game_json: json-formatted game string, e.g. output of to_saved_game_format(game)
+        - game_handle: handle of the game published by a SharedGame
         - hostport: string, "{host}:{port}" of model server
         - set_orders_dict: Dict[power, orders] to set for current turn
         - temperature: model softmax temperature for rollout policy
@@ -278,7 +279,8 @@ class MultiprocSearchAgent(BaseSearchAgent):
             faulthandler.register(signal.SIGUSR2)
             torch.set_num_threads(1)
 
-            games = [pydipcc.Game.from_json(game_json) for _ in range(batch_size)]
+            root_game = load_shared_game(game_handle)
+            games = [pydipcc.Game(root_game) for _ in range(batch_size)]
             for i in range(len(games)):
                 games[i].game_id += f"_{i}"
 
@@ -601,16 +603,7 @@ def server_handler(
 
 # imported by RL code
 def cat_pad_inputs(xs: List[DataFields]) -> DataFields:
-    batch = DataFields({k: [x[k] for x in xs] for k in xs[0].keys()})
-    for k, v in batch.items():
-        if k == "x_possible_actions":
-            batch[k] = cat_pad_sequences(v, pad_value=-1, pad_to_len=MAX_SEQ_LEN)
-        elif k == "x_loc_idxs":
-            batch[k] = cat_pad_sequences(v, pad_value=EOS_IDX, pad_to_len=MAX_SEQ_LEN)
-        else:
-            batch[k] = torch.cat(v)
-
-    return batch
+    return FeatureEncoder().cat_pad_inputs(xs)
 
 
 def call(f):
@@ -0,0 +1,136 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""Rollouts sharded across worker hosts, over postman.
+
+A worker serves the do_rollouts of a search agent running on its own host,
+with its own ThreadPool and model:
+
+    python -m fairdiplomacy.agents.remote_rollouts \\
+        --agent_cfg conf/common/agents/searchbot_02_fastbot.prototxt --port 12345
+
+An agent with remote_rollout_addrs set sends each do_rollouts batch to all
+the workers at once, one shard each, and gets back a value vector per set of
+orders. The root game is sent once per shard with Game.to_bytes.
+"""
+import argparse
+import concurrent.futures
+import json
+import logging
+import time
+from typing import Dict, List, Sequence, Tuple
+
+import numpy as np
+import postman
+import torch
+
+from fairdiplomacy import pydipcc
+from fairdiplomacy.models.consts import POWERS
+
+
+def _bytes_to_tensor(data: bytes) -> torch.Tensor:
+    """[1, len(data)] uint8 tensor, with the batch dim of postman calls"""
+    return torch.from_numpy(np.frombuffer(data, dtype=np.uint8).copy()).unsqueeze(0)
+
+
+def _tensor_to_bytes(x: torch.Tensor) -> bytes:
+    return x.squeeze(0).numpy().tobytes()
+
+
+class RemoteRolloutBackend:
+    """Runs do_rollouts on rollout workers, see the module docstring"""
+
+    def __init__(self, hostports: Sequence[str], connect_timeout: float = 20):
+        assert hostports, "RemoteRolloutBackend needs at least one worker"
+        self.clients = []
+        for hostport in hostports:
+            client = postman.Client(hostport)
+            client.connect(connect_timeout)
+            logging.info(f"Connected to rollout worker {hostport}")
+            self.clients.append(client)
+        self.executor = concurrent.futures.ThreadPoolExecutor(len(self.clients))
+
+    def do_rollouts(
+        self, game_init, set_orders_dicts, average_n_rollouts=1
+    ) -> List[Tuple[Dict[str, Tuple[str, ...]], Dict[str, float]]]:
+        """Same as ThreadedSearchAgent.do_rollouts"""
+        game_bytes = _bytes_to_tensor(game_init.to_bytes())
+        n_rollouts = torch.LongTensor([average_n_rollouts])
+
+        def run_shard(client, shard):
+            orders_json = json.dumps([{p: list(orders) for p, orders in d.items()} for d in shard])
+            values = client.do_rollouts(
+                (game_bytes, _bytes_to_tensor(orders_json.encode()), n_rollouts)
+            )
+            return values.squeeze(0).numpy()
+
+        # Contiguous shards of at most ceil(n / n_workers) sets of orders
+        shard_size = -(-len(set_orders_dicts) // len(self.clients))
+        futures = [
+            self.executor.submit(run_shard, client, set_orders_dicts[i : i + shard_size])
+            for client, i in zip(self.clients, range(0, len(set_orders_dicts), shard_size))
+        ]
+        values = np.concatenate([f.result() for f in futures])
+        return [
+            (set_orders_dict, dict(zip(POWERS, map(float, game_values))))
+            for set_orders_dict, game_values in zip(set_orders_dicts, values)
+        ]
+
+
+def start_rollout_server(agent, address: str) -> postman.Server:
+    """Start serving the local do_rollouts of agent at address, e.g.
+    "0.0.0.0:12345" (port 0 picks a free port, see server.port())"""
+    assert agent.remote_rollouts is None, "A rollout worker must run its rollouts locally"
+
+    def do_rollouts(game_bytes, orders_json, n_rollouts):
+        game_init = pydipcc.Game.from_bytes(_tensor_to_bytes(game_bytes))
+        set_orders_dicts = [
+            {p: tuple(orders) for p, orders in d.items()}
+            for d in json.loads(_tensor_to_bytes(orders_json).decode())
+        ]
+        results = agent.do_rollouts(
+            game_init, set_orders_dicts, average_n_rollouts=int(n_rollouts.item())
+        )
+        values = [[scores[p] for p in POWERS] for _, scores in results]
+        return torch.tensor(values, dtype=torch.float32).unsqueeze(0)
+
+    server = postman.Server(address)
+    server.bind("do_rollouts", do_rollouts, batch_size=1)
+    server.run()
+    return server
+
+
+def run_rollout_worker(agent, port: int):
+    """Serve the local do_rollouts of agent on port until interrupted"""
+    server = start_rollout_server(agent, f"0.0.0.0:{port}")
+    logging.info(f"Rollout worker serving on port {server.port()}")
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        server.stop()
+        server.wait()
+
+
+def main():
+    import google.protobuf.text_format
+
+    import conf.agents_pb2
+    from fairdiplomacy.agents import build_agent_from_cfg
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--agent_cfg", required=True, help="Agent prototxt, e.g. a searchbot")
+    parser.add_argument("--port", type=int, required=True)
+    args = parser.parse_args()
+    logging.basicConfig(format="%(asctime)s [%(levelname)s]: %(message)s", level=logging.INFO)
+
+    agent_cfg = conf.agents_pb2.Agent()
+    with open(args.agent_cfg) as f:
+        google.protobuf.text_format.Merge(f.read(), agent_cfg)
+    run_rollout_worker(build_agent_from_cfg(agent_cfg), args.port)
+
+
+if __name__ == "__main__":
+    main()
@@ -13,7 +13,7 @@ class ReproAgent(BaseAgent):
             self.json = json.load(f)
 
     def get_orders(self, game, power):
-        phase = game.get_state()["name"]
+        phase = game.current_short_phase
         all_possible_orders_set = {
             x for lst in game.get_all_possible_orders().values() for x in lst
         }
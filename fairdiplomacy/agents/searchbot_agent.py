@@ -7,7 +7,6 @@ import logging
 from math import ceil
 import numpy as np
 import torch
-from collections import defaultdict
 from typing import List, Tuple, Dict
 import random
 import json
@@ -17,6 +16,7 @@ from fairdiplomacy.agents.base_search_agent import num_orderable_units
 from fairdiplomacy.agents.threaded_search_agent import ThreadedSearchAgent
 from fairdiplomacy.models.consts import POWERS
 from fairdiplomacy.utils.sampling import sample_p_dict
+from fairdiplomacy.utils.thread_pool_encoding import thread_pool_priority
 from fairdiplomacy.utils.timing_ctx import TimingCtx
 
 
@@ -25,14 +25,30 @@ Power = str
 
 
 class CFRData:
-    def __init__(self):
-        self.power_plausible_orders: Dict[Power, List[Action]] = {}
-        self.sigma: Dict[Tuple[Power, Action], float] = {}
-        self.cum_sigma: Dict[Tuple[Power, Action], float] = defaultdict(float)
-        self.cum_regrets: Dict[Tuple[Power, Action], float] = defaultdict(float)
-        self.cum_utility: Dict[Action, float] = defaultdict(float)
-        self.last_regrets: Dict[Tuple[Power, Action], float] = defaultdict(float)
-        self.bp_sigma: Dict[Tuple[Power, Action], float] = defaultdict(float)
+    """Plausible actions per power, and a pydipcc.CFRSolver over their positions"""
+
+    def __init__(self, power_plausible_orders: Dict[Power, Dict[Action, float]], optimistic):
+        self.all_plausible_orders: Dict[Power, List[Action]] = {
+            p: sorted(power_plausible_orders[p].keys()) for p in POWERS
+        }
+        self.power_plausible_orders: Dict[Power, List[Action]] = {
+            p: list(actions) for p, actions in self.all_plausible_orders.items()
+        }
+        self.solver = pydipcc.CFRSolver(
+            [
+                [float(np.exp(power_plausible_orders[p][a])) for a in actions]
+                for p, actions in self.all_plausible_orders.items()
+            ],
+            optimistic=optimistic,
+            # from np.random, so that seeding it makes searches reproducible
+            seed=int(np.random.randint(2 ** 62)),
+        )
+
+    def sync_pruned(self):
+        for pi, p in enumerate(POWERS):
+            self.power_plausible_orders[p] = [
+                self.all_plausible_orders[p][i] for i in self.solver.get_action_idxs(pi)
+            ]
 
 
 class SearchBotAgent(ThreadedSearchAgent):
@@ -59,6 +75,10 @@ class SearchBotAgent(ThreadedSearchAgent):
         loser_bp_value=0.0,
         loser_bp_iter=64,
         share_strategy=False,
+        log_final_nash_conv=False,
+        nash_conv_samples=100,
+        nash_conv_max_rows=0,
+        search_store_mb=0,
         n_gpu=None,  # deprecated
         n_server_procs=None,  # deprecated
         postman_sync_batches=None,  # deprecated
@@ -68,7 +88,12 @@ class SearchBotAgent(ThreadedSearchAgent):
         super().__init__(**kwargs, n_rollout_procs=n_rollout_procs, max_batch_size=max_batch_size)
 
         self.n_rollouts = n_rollouts
-        self.cache_rollout_results = cache_rollout_results
+        # plausible orders and rollout results kept across calls, so that
+        # searches of boards searched before start from what was learned
+        self.search_store = (
+            pydipcc.SearchStore(search_store_mb << 20) if search_store_mb > 0 else None
+        )
+        self.cache_rollout_results = cache_rollout_results or self.search_store is not None
         self.enable_compute_nash_conv = enable_compute_nash_conv
         self.n_plausible_orders = n_plausible_orders
         self.use_optimistic_cfr = use_optimistic_cfr
@@ -86,6 +111,9 @@ class SearchBotAgent(ThreadedSearchAgent):
         self.loser_bp_iter = loser_bp_iter
         self.loser_bp_value = loser_bp_value
         self.share_strategy = share_strategy
+        self.log_final_nash_conv = log_final_nash_conv
+        self.nash_conv_samples = nash_conv_samples
+        self.nash_conv_max_rows = nash_conv_max_rows
 
         self.reset_seed_on_rollout = reset_seed_on_rollout
 
@@ -161,29 +189,26 @@ class SearchBotAgent(ThreadedSearchAgent):
             timings = TimingCtx()
         timings.start("one-time")
 
-        cfr_data = CFRData()
-
-        game_state = game.get_state()
-        phase = game_state["name"]
+        phase = game.current_short_phase
 
         if self.cache_rollout_results:
-            rollout_results_cache = RolloutResultsCache()
+            rollout_results_cache = RolloutResultsCache(
+                table=self.search_store.get_rollout_cache() if self.search_store else None
+            )
 
+        if power_plausible_orders is None and self.search_store is not None:
+            power_plausible_orders = self.search_store.get_plausible_orders(game)
         if power_plausible_orders is None:
             power_plausible_orders = self.get_plausible_orders_helper(game)
+            if self.search_store is not None:
+                self.search_store.put_plausible_orders(game, power_plausible_orders)
 
         if extra_plausible_orders:
             for p, orders in extra_plausible_orders.items():
                 power_plausible_orders[p].update({order: 1.0 for order in orders})
                 logging.info(f"Adding extra plausible orders {p}: {orders}")
 
-        for p, orders_to_logprob in power_plausible_orders.items():
-            for o, prob in orders_to_logprob.items():
-                cfr_data.bp_sigma[(p, o)] = float(np.exp(prob))
-
-        cfr_data.power_plausible_orders = {
-            p: sorted(list(v.keys())) for p, v in power_plausible_orders.items()
-        }
+        cfr_data = CFRData(power_plausible_orders, optimistic=self.use_optimistic_cfr)
         del power_plausible_orders
 
         # If there are <=1 plausible orders, no need to search
@@ -222,54 +247,43 @@ class SearchBotAgent(ThreadedSearchAgent):
                 cfr_iter & (cfr_iter + 1) == 0  # and cfr_iter > self.n_rollouts / 8
             ) or cfr_iter == self.n_rollouts - 1
 
-            self.maybe_do_pruning(cfr_iter=cfr_iter, iter_weight=iter_weight, cfr_data=cfr_data)
+            self.maybe_do_pruning(cfr_iter=cfr_iter, cfr_data=cfr_data)
 
-            iter_weight = self.linear_cfr(cfr_data, cfr_iter, iter_weight)
+            iter_weight = cfr_data.solver.start_iter()
 
             timings.start("query_policy")
-            # get policy probs for all powers
+            # sample from the blueprint or the current strategy, per power
             power_is_loser = {
                 pwr: self.is_loser(cfr_data, pwr, cfr_iter, actions, iter_weight)
                 for (pwr, actions) in cfr_data.power_plausible_orders.items()
             }
-            power_action_ps: Dict[Power, List[float]] = {
-                pwr: (
-                    self.bp_strategy(cfr_data, pwr)
-                    if (
-                        cfr_iter < self.bp_iters
-                        or np.random.rand() < self.bp_prob
-                        or power_is_loser[pwr]
-                    )
-                    else self.strategy(cfr_data, pwr)
+            use_bp = [
+                bool(
+                    cfr_iter < self.bp_iters
+                    or np.random.rand() < self.bp_prob
+                    or power_is_loser[pwr]
                 )
-                for (pwr, actions) in cfr_data.power_plausible_orders.items()
-            }
+                for pwr in POWERS
+            ]
 
             timings.start("apply_orders")
             # sample policy for all powers
-            idxs = {
-                pwr: np.random.choice(range(len(action_ps)), p=action_ps)
-                for pwr, action_ps in power_action_ps.items()
-                if len(action_ps) > 0
-            }
-            power_sampled_orders: Dict[Power, Tuple[Action, float]] = {
-                pwr: (
-                    (cfr_data.power_plausible_orders[pwr][idxs[pwr]], action_ps[idxs[pwr]])
-                    if pwr in idxs
-                    else ((), 1.0)
-                )
-                for pwr, action_ps in power_action_ps.items()
-            }
+            cfr_data.solver.sample(use_bp)
 
             # for each power: compare all actions against sampled opponent action
             set_orders_dicts = [
-                {**{p: a for p, (a, _) in power_sampled_orders.items()}, pwr: action}
-                for pwr, actions in cfr_data.power_plausible_orders.items()
-                for action in actions
+                {
+                    pwr: (cfr_data.power_plausible_orders[pwr][i] if i >= 0 else ())
+                    for pwr, i in zip(POWERS, joint_idxs)
+                }
+                for joint_idxs in cfr_data.solver.get_joint_action_idxs()
             ]
 
-            # run rollouts or get from cache
-            def on_miss():
+            # run rollouts or get from cache: local rollouts look the cache up
+            # in the ThreadPool's threads, remote ones through get_multi
+            native_cache = self.cache_rollout_results and self.remote_rollouts is None
+
+            def on_miss(set_orders_dicts):
                 nonlocal timings
                 inner_timmings = TimingCtx()
                 ret = self.do_rollouts(
@@ -278,35 +292,31 @@ class SearchBotAgent(ThreadedSearchAgent):
                     average_n_rollouts=self.average_n_rollouts,
                     timings=inner_timmings,
                     log_timings=verbose_log_iter,
+                    rollout_cache=rollout_results_cache.table if native_cache else None,
                 )
                 timings += inner_timmings
                 return ret
 
             timings.stop()
             all_rollout_results = (
-                rollout_results_cache.get(set_orders_dicts, on_miss)
-                if self.cache_rollout_results
-                else on_miss()
+                rollout_results_cache.get(game, set_orders_dicts, on_miss)
+                if self.cache_rollout_results and not native_cache
+                else on_miss(set_orders_dicts)
             )
 
             timings.start("cfr")
-            for pwr, actions in cfr_data.power_plausible_orders.items():
-                if len(actions) == 0:
-                    continue
-
-                # pop this power's results
-                results, all_rollout_results = (
-                    all_rollout_results[: len(actions)],
-                    all_rollout_results[len(actions) :],
-                )
-
-                # calculate regrets
-                action_utilities: List[float] = [r[1][pwr] for r in results]
-                state_utility = np.dot(power_action_ps[pwr], action_utilities)
-                action_regrets = [(u - state_utility) for u in action_utilities]
-
-                # log some action values
-                if verbose_log_iter:
+            # update regrets and strategies of all powers
+            utilities = [[scores[p] for p in POWERS] for _, scores in all_rollout_results]
+            state_utilities = cfr_data.solver.update(utilities)
+
+            # log some action values
+            if verbose_log_iter:
+                for pwr, actions in cfr_data.power_plausible_orders.items():
+                    if len(actions) == 0:
+                        continue
+
+                    # pop this power's results
+                    results, utilities = utilities[: len(actions)], utilities[len(actions) :]
                     self.log_cfr_iter_state(
                         game=game,
                         pwr=pwr,
@@ -315,15 +325,10 @@ class SearchBotAgent(ThreadedSearchAgent):
                         cfr_iter=cfr_iter,
                         iter_weight=iter_weight,
                         power_is_loser=power_is_loser,
-                        state_utility=state_utility,
-                        action_utilities=action_utilities,
+                        state_utility=state_utilities[POWERS.index(pwr)],
+                        action_utilities=[u[POWERS.index(pwr)] for u in results],
                     )
 
-                # update cfr data structures
-                self.update_cfr_data(
-                    cfr_data, pwr, actions, state_utility, action_utilities, action_regrets
-                )
-
             if self.enable_compute_nash_conv and verbose_log_iter:
                 logging.info(f"Computing nash conv for iter {cfr_iter}")
                 self.compute_nash_conv(cfr_data, f"cfr iter {cfr_iter}", game, self.avg_strategy)
@@ -331,6 +336,15 @@ class SearchBotAgent(ThreadedSearchAgent):
             if self.cache_rollout_results and (cfr_iter + 1) % 10 == 0:
                 logging.info(f"{rollout_results_cache}")
 
+        if self.log_final_nash_conv and not self.enable_compute_nash_conv:
+            timings.start("nash_conv")
+            self.compute_nash_conv(
+                cfr_data,
+                "final",
+                game,
+                self.strategy if self.use_final_iter else self.avg_strategy,
+            )
+
         timings.start("to_dict")
 
         # return prob. distributions for each power
@@ -357,54 +371,15 @@ class SearchBotAgent(ThreadedSearchAgent):
 
     @classmethod
     def strategy(cls, cfr_data, power) -> List[float]:
-        actions = cfr_data.power_plausible_orders[power]
-        try:
-            return [cfr_data.sigma[(power, a)] for a in actions]
-        except KeyError:
-            return [1.0 / len(actions) for _ in actions]
+        return cfr_data.solver.strategy(POWERS.index(power))
 
     @classmethod
     def avg_strategy(cls, cfr_data, power) -> List[float]:
-        actions = cfr_data.power_plausible_orders[power]
-        sigmas = [cfr_data.cum_sigma[(power, a)] for a in actions]
-        sum_sigmas = sum(sigmas)
-        if sum_sigmas == 0:
-            return [1 / len(actions) for _ in actions]
-        else:
-            return [s / sum_sigmas for s in sigmas]
+        return cfr_data.solver.avg_strategy(POWERS.index(power))
 
     @classmethod
     def bp_strategy(cls, cfr_data, power, temperature=1.0) -> List[float]:
-        actions = cfr_data.power_plausible_orders[power]
-        sigmas = [cfr_data.bp_sigma[(power, a)] ** (1.0 / temperature) for a in actions]
-        sum_sigmas = sum(sigmas)
-        assert len(actions) == 0 or sum_sigmas > 0, f"{actions} {cfr_data.bp_sigma}"
-        return [s / sum_sigmas for s in sigmas]
-
-    def update_cfr_data(
-        self, cfr_data, pwr, actions, state_utility, action_utilities, action_regrets
-    ):
-        sigmas = self.strategy(cfr_data, pwr)
-        for action, regret, s in zip(actions, action_regrets, sigmas):
-            cfr_data.cum_regrets[(pwr, action)] += regret
-            cfr_data.last_regrets[(pwr, action)] = regret
-            cfr_data.cum_sigma[(pwr, action)] += s
-        cfr_data.cum_utility[pwr] += state_utility
-
-        if self.use_optimistic_cfr:
-            pos_regrets = [
-                max(0, cfr_data.cum_regrets[(pwr, a)] + cfr_data.last_regrets[(pwr, a)])
-                for a in actions
-            ]
-        else:
-            pos_regrets = [max(0, cfr_data.cum_regrets[(pwr, a)]) for a in actions]
-
-        sum_pos_regrets = sum(pos_regrets)
-        for action, pos_regret in zip(actions, pos_regrets):
-            if sum_pos_regrets == 0:
-                cfr_data.sigma[(pwr, action)] = 1.0 / len(actions)
-            else:
-                cfr_data.sigma[(pwr, action)] = pos_regret / sum_pos_regrets
+        return cfr_data.solver.bp_strategy(POWERS.index(power), temperature)
 
     def maybe_do_pruning(self, *, cfr_iter, **kwargs):
         if not self.use_pruning:
@@ -421,44 +396,16 @@ class SearchBotAgent(ThreadedSearchAgent):
             )
 
     @classmethod
-    def prune_actions(
-        cls, *, cfr_iter, iter_weight, cfr_data, ave_regret_thresh, ave_strat_thresh
-    ):
-        for pwr, actions in cfr_data.power_plausible_orders.items():
-            paired_list = []
-            for action in actions:
-                ave_regret = cfr_data.cum_regrets[(pwr, action)] / iter_weight
-                new_pair = (action, ave_regret)
-                paired_list.append(new_pair)
-            paired_list.sort(key=lambda tup: tup[1])
-            for (action, ave_regret) in paired_list:
-                ave_strat = cfr_data.cum_sigma[(pwr, action)] / iter_weight
-                if (
-                    ave_regret < ave_regret_thresh
-                    and ave_strat < ave_strat_thresh
-                    and cfr_data.sigma[(pwr, action)] == 0
-                ):
-                    cfr_data.cum_sigma[(pwr, action)] = 0
-                    logging.info(
-                        "pruning on iter {} action {} with ave regret {} and ave strat {}".format(
-                            cfr_iter, action, ave_regret, ave_strat
-                        )
-                    )
-                    actions.remove(action)
-
-    @classmethod
-    def linear_cfr(cls, cfr_data, cfr_iter, iter_weight) -> float:
-        discount_factor = (cfr_iter + 0.000001) / (cfr_iter + 1)
-
-        for pwr, actions in cfr_data.power_plausible_orders.items():
-            if len(actions) == 0:
-                continue
-            cfr_data.cum_utility[pwr] *= discount_factor
-            for action in actions:
-                cfr_data.cum_regrets[(pwr, action)] *= discount_factor
-                cfr_data.cum_sigma[(pwr, action)] *= discount_factor
-
-        return iter_weight * discount_factor + 1.0
+    def prune_actions(cls, *, cfr_iter, cfr_data, ave_regret_thresh, ave_strat_thresh):
+        pruned = cfr_data.solver.prune(ave_regret_thresh, ave_strat_thresh)
+        for pi, i in pruned:
+            logging.info(
+                "pruning on iter {} action {}".format(
+                    cfr_iter, cfr_data.all_plausible_orders[POWERS[pi]][i]
+                )
+            )
+        if pruned:
+            cfr_data.sync_pruned()
 
     def log_cfr_iter_state(
         self,
@@ -474,16 +421,13 @@ class SearchBotAgent(ThreadedSearchAgent):
         action_utilities,
     ):
         logging.info(
-            f"<> [ {cfr_iter+1} / {self.n_rollouts} ] {pwr} {game.phase} avg_utility={cfr_data.cum_utility[pwr] / iter_weight:.5f} cur_utility={state_utility:.5f} "
+            f"<> [ {cfr_iter+1} / {self.n_rollouts} ] {pwr} {game.phase} avg_utility={cfr_data.solver.avg_utility(POWERS.index(pwr)):.5f} cur_utility={state_utility:.5f} "
             f"is_loser= {int(power_is_loser[pwr])}"
         )
         logging.info(f"     {'probs':8s}  {'bp_p':8s}  {'avg_u':8s}  {'cur_u':8s}  orders")
         action_probs: List[float] = self.avg_strategy(cfr_data, pwr)
         bp_probs: List[float] = self.bp_strategy(cfr_data, pwr)
-        avg_utilities = [
-            (cfr_data.cum_regrets[(pwr, a)] + cfr_data.cum_utility[pwr]) / iter_weight
-            for a in actions
-        ]
+        avg_utilities = cfr_data.solver.avg_action_utilities(POWERS.index(pwr))
         sorted_metrics = sorted(
             zip(actions, action_probs, bp_probs, avg_utilities, action_utilities),
             key=lambda ac: -ac[1],
@@ -491,146 +435,81 @@ class SearchBotAgent(ThreadedSearchAgent):
         for orders, p, bp_p, avg_u, cur_u in sorted_metrics:
             logging.info(f"|>  {p:8.5f}  {bp_p:8.5f}  {avg_u:8.5f}  {cur_u:8.5f}  {orders}")
 
+    @thread_pool_priority(pydipcc.ThreadPoolPriority.BULK)
     def compute_nash_conv(self, cfr_data, label, game, strat_f):
         """For each power, compute EV of each action assuming opponent ave policies"""
 
         # get policy probs for all powers
         power_action_ps: Dict[Power, List[float]] = {
-            pwr: strat_f(cfr_data, pwr)
-            for (pwr, actions) in cfr_data.power_plausible_orders.items()
+            pwr: strat_f(cfr_data, pwr) for pwr in POWERS
         }
         logging.info("Policies: {}".format(power_action_ps))
 
-        total_action_utilities: Dict[Tuple[Power, Action], float] = defaultdict(float)
-        temp_action_utilities: Dict[Tuple[Power, Action], float] = defaultdict(float)
-        total_state_utility: Dict[Power, float] = defaultdict(float)
-        max_state_utility: Dict[Power, float] = defaultdict(float)
-        for pwr, actions in cfr_data.power_plausible_orders.items():
-            total_state_utility[pwr] = 0
-            max_state_utility[pwr] = 0
-        # total_state_utility = [0 for u in idxs]
-        nash_conv = 0
-        br_iters = 100
-        for _ in range(br_iters):
-            # sample policy for all powers
-            idxs = {
-                pwr: np.random.choice(range(len(action_ps)), p=action_ps)
-                for pwr, action_ps in power_action_ps.items()
-                if len(action_ps) > 0
-            }
-            power_sampled_orders: Dict[Power, Tuple[Action, float]] = {
-                pwr: (
-                    (cfr_data.power_plausible_orders[pwr][idxs[pwr]], action_ps[idxs[pwr]])
-                    if pwr in idxs
-                    else ((), 1.0)
-                )
-                for pwr, action_ps in power_action_ps.items()
-            }
-
-            # for each power: compare all actions against sampled opponent action
+        def joint_values(joint_idxs):
             set_orders_dicts = [
-                {**{p: a for p, (a, _) in power_sampled_orders.items()}, pwr: action}
-                for pwr, actions in cfr_data.power_plausible_orders.items()
-                for action in actions
+                {
+                    pwr: (cfr_data.power_plausible_orders[pwr][i] if i >= 0 else ())
+                    for pwr, i in zip(POWERS, idxs)
+                }
+                for idxs in joint_idxs
             ]
-            all_rollout_results = self.do_rollouts(
+            results = self.do_rollouts(
                 game, set_orders_dicts, average_n_rollouts=self.average_n_rollouts
             )
+            return [[scores[p] for p in POWERS] for _, scores in results]
+
+        # all samples' best responses are rolled out in batches of max_rows
+        r = pydipcc.compute_nash_conv(
+            [power_action_ps[p] for p in POWERS],
+            self.nash_conv_samples,
+            joint_values,
+            max_rows=self.nash_conv_max_rows,
+            seed=int(np.random.randint(2 ** 62)),
+        )
 
-            for pwr, actions in cfr_data.power_plausible_orders.items():
-                if len(actions) == 0:
-                    continue
-
-                # pop this power's results
-                results, all_rollout_results = (
-                    all_rollout_results[: len(actions)],
-                    all_rollout_results[len(actions) :],
-                )
-
-                for r in results:
-                    action = r[0][pwr]
-                    val = r[1][pwr]
-                    temp_action_utilities[(pwr, action)] = val
-                    total_action_utilities[(pwr, action)] += val
-                # logging.info("results for power={}".format(pwr))
-                # for i in range(len(cfr_data.power_plausible_orders[pwr])):
-                #     action = cfr_data.power_plausible_orders[pwr][i]
-                #     util = action_utilities[i]
-                #     logging.info("{} {} = {}".format(pwr,action,util))
-
-                # for action in cfr_data.power_plausible_orders[pwr]:
-                #     logging.info("{} {} = {}".format(pwr,action,action_utilities))
-                # logging.info("action utilities={}".format(action_utilities))
-                # logging.info("Results={}".format(results))
-                # state_utility = np.dot(power_action_ps[pwr], action_utilities)
-                # action_regrets = [(u - state_utility) for u in action_utilities]
-                # logging.info("Action utilities={}".format(temp_action_utilities))
-                # for action in actions:
-                #     total_action_utilities[(pwr,action)] += temp_action_utilities[(pwr,action)]
-                # logging.info("Total action utilities={}".format(total_action_utilities))
-                # total_state_utility[pwr] += state_utility
-        # total_state_utility[:] = [x / 100 for x in total_state_utility]
-        for pwr, actions in cfr_data.power_plausible_orders.items():
-            # ps = self.avg_strategy(pwr, cfr_data.power_plausible_orders[pwr])
-            for i in range(len(actions)):
-                action = actions[i]
-                total_action_utilities[(pwr, action)] /= br_iters
-                if total_action_utilities[(pwr, action)] > max_state_utility[pwr]:
-                    max_state_utility[pwr] = total_action_utilities[(pwr, action)]
-                total_state_utility[pwr] += (
-                    total_action_utilities[(pwr, action)] * power_action_ps[pwr][i]
-                )
-
-        for pwr, actions in cfr_data.power_plausible_orders.items():
+        for pi, (pwr, actions) in enumerate(cfr_data.power_plausible_orders.items()):
             logging.info(
                 "results for power={} value={} diff={}".format(
-                    pwr,
-                    total_state_utility[pwr],
-                    (max_state_utility[pwr] - total_state_utility[pwr]),
+                    pwr, r.values[pi], r.br_values[pi] - r.values[pi]
                 )
             )
-            nash_conv += max_state_utility[pwr] - total_state_utility[pwr]
-            for i in range(len(actions)):
-                action = actions[i]
-                logging.info(
-                    "{} {} = {} (prob {})".format(
-                        pwr, action, total_action_utilities[(pwr, action)], power_action_ps[pwr][i]
-                    )
-                )
+            for action, value, p in zip(actions, r.action_values[pi], power_action_ps[pwr]):
+                logging.info("{} {} = {} (prob {})".format(pwr, action, value, p))
 
-        logging.info(f"Nash conv for {label} = {nash_conv}")
+        logging.info(f"Nash conv for {label} = {r.nash_conv}")
+        return r.nash_conv
 
     def is_loser(self, cfr_data, pwr, cfr_iter, plausible_orders, iter_weight):
         if cfr_iter >= self.loser_bp_iter and self.loser_bp_value > 0:
-            for action in plausible_orders:
-                if (
-                    cfr_data.cum_regrets[(pwr, action)] + cfr_data.cum_utility[pwr]
-                ) / iter_weight > self.loser_bp_value:
-                    return False
-            return True
+            avg_utilities = cfr_data.solver.avg_action_utilities(POWERS.index(pwr))
+            return all(u <= self.loser_bp_value for u in avg_utilities)
         return False
 
 
 class RolloutResultsCache:
-    def __init__(self):
-        self.cache = {}
-        self.hits = 0
-        self.misses = 0
-
-    def get(self, set_orders_dicts, onmiss_fn):
-        key = frozenset(frozenset(d.items()) for d in set_orders_dicts)
-        if key in self.cache:
-            self.hits += 1
-            return self.cache[key]
-        else:
-            self.misses += 1
-            r = onmiss_fn()
-            self.cache[key] = r
-            return r
+    """Per joint action rollout results, keyed by (board hash, orders)"""
+
+    def __init__(self, capacity=1000000, table=None):
+        self.table = table if table is not None else pydipcc.RolloutCache(capacity)
+
+    def get(self, game, set_orders_dicts, onmiss_fn):
+        cached = self.table.get_multi(game, set_orders_dicts)
+        missing = [d for d, values in zip(set_orders_dicts, cached) if values is None]
+        fresh = iter(onmiss_fn(missing) if missing else [])
+        r = []
+        for set_orders_dict, values in zip(set_orders_dicts, cached):
+            if values is None:
+                _, scores = next(fresh)
+                self.table.put(game, set_orders_dict, [scores[p] for p in POWERS])
+            else:
+                scores = dict(zip(POWERS, values))
+            r.append((set_orders_dict, scores))
+        return r
 
     def __repr__(self):
+        hits, misses = self.table.get_hits(), self.table.get_misses()
         return "RolloutResultsCache[{} / {} = {:.3f}]".format(
-            self.hits, self.hits + self.misses, self.hits / (self.hits + self.misses)
+            hits, hits + misses, hits / max(hits + misses, 1)
         )
 
 
@@ -5,7 +5,10 @@
 
 import unittest
 
+from fairdiplomacy import pydipcc
 from fairdiplomacy.agents.base_search_agent import n_move_phases_later
+from fairdiplomacy.agents.remote_rollouts import RemoteRolloutBackend, start_rollout_server
+from fairdiplomacy.models.consts import POWERS
 
 
 class TestNMovePhaseLater(unittest.TestCase):
@@ -14,3 +17,45 @@ class TestNMovePhaseLater(unittest.TestCase):
 
     def test_0_from_winter(self):
         self.assertEqual(n_move_phases_later("W1901A", 0), "W1901A")
+
+
+class FakeRolloutAgent:
+    """Values each set of orders at 10 per order of a power, plus the number
+    of rollouts averaged"""
+
+    remote_rollouts = None
+
+    def __init__(self):
+        self.calls = []
+
+    def do_rollouts(self, game_init, set_orders_dicts, average_n_rollouts=1):
+        self.calls.append((game_init.current_short_phase, len(set_orders_dicts)))
+        return [
+            (d, {p: 10.0 * len(d.get(p, ())) + average_n_rollouts for p in POWERS})
+            for d in set_orders_dicts
+        ]
+
+
+class TestRemoteRollouts(unittest.TestCase):
+    def test_shards_across_workers(self):
+        agents = [FakeRolloutAgent(), FakeRolloutAgent()]
+        servers = [start_rollout_server(agent, "127.0.0.1:0") for agent in agents]
+        try:
+            backend = RemoteRolloutBackend([f"127.0.0.1:{s.port()}" for s in servers])
+            game = pydipcc.Game()
+            game.process()
+            set_orders_dicts = [
+                {"FRANCE": ("A PAR H",) * i, "ITALY": ("A VEN H",)} for i in range(5)
+            ]
+            results = backend.do_rollouts(game, set_orders_dicts, average_n_rollouts=3)
+        finally:
+            for server in servers:
+                server.stop()
+
+        # Contiguous shards, results in the order of set_orders_dicts
+        self.assertEqual([agent.calls for agent in agents], [[("F1901M", 3)], [("F1901M", 2)]])
+        self.assertEqual([d for d, _ in results], set_orders_dicts)
+        for i, (_, values) in enumerate(results):
+            self.assertEqual(values["FRANCE"], 10 * i + 3)
+            self.assertEqual(values["ITALY"], 13)
+            self.assertEqual(values["ENGLAND"], 3)
@@ -10,7 +10,6 @@ from typing import List, Tuple, Dict, Union, Sequence
 import numpy as np
 import torch
 
-from fairdiplomacy.game import sort_phase_key
 from fairdiplomacy import pydipcc
 from fairdiplomacy.agents.base_search_agent import (
     BaseSearchAgent,
@@ -18,15 +17,13 @@ from fairdiplomacy.agents.base_search_agent import (
     filter_keys,
     are_supports_coordinated,
     safe_idx,
-    n_move_phases_later,
-    get_square_scores_from_game,
     average_score_dicts,
 )
+from fairdiplomacy.agents.remote_rollouts import RemoteRolloutBackend
 from fairdiplomacy.data.dataset import DataFields
 from fairdiplomacy.models.consts import MAX_SEQ_LEN, POWERS
 from fairdiplomacy.models.diplomacy_model.load_model import load_diplomacy_model
 from fairdiplomacy.models.diplomacy_model.order_vocabulary import (
-    EOS_IDX,
     get_order_vocabulary,
     get_order_vocabulary_idxs_len,
 )
@@ -34,7 +31,7 @@ from fairdiplomacy.utils.parse_device import parse_device
 from fairdiplomacy.utils.timing_ctx import TimingCtx, DummyCtx
 from fairdiplomacy.utils.cat_pad_sequences import cat_pad_sequences
 from fairdiplomacy.utils.game_scoring import compute_game_scores_from_state
-from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder
+from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder, get_shared_thread_pool
 
 ORDER_VOCABULARY_TO_IDX = {order: idx for idx, order in enumerate(get_order_vocabulary())}
 
@@ -53,6 +50,7 @@ class ThreadedSearchAgent(BaseSearchAgent):
         device=0,
         mix_square_ratio_scoring=0,
         clear_old_all_possible_orders=False,
+        remote_rollout_addrs=None,
         **kwargs,
     ):
         super().__init__(**kwargs)
@@ -75,9 +73,12 @@ class ThreadedSearchAgent(BaseSearchAgent):
         else:
             self.value_model = self.model
 
-        self.thread_pool = pydipcc.ThreadPool(
-            n_rollout_procs, ORDER_VOCABULARY_TO_IDX, get_order_vocabulary_idxs_len()
-        )
+        self.thread_pool = get_shared_thread_pool(n_rollout_procs)
+
+        if remote_rollout_addrs:
+            self.remote_rollouts = RemoteRolloutBackend(remote_rollout_addrs)
+        else:
+            self.remote_rollouts = None
 
     def do_model_request(
         self,
@@ -86,7 +87,12 @@ class ThreadedSearchAgent(BaseSearchAgent):
         top_p: float,
         timings=DummyCtx(),
         values_only: bool = False,
+        decode: bool = True,
+        orders_on_device: bool = False,
     ):
+        """If orders_on_device, return (order_idxs, None, None) with order_idxs
+        left on the model's device, for dipcc calls that copy them to the host
+        compactly, e.g. run_rollouts"""
         with timings("model.pre"):
             B = x["x_board_state"].shape[0]
             x["temperature"] = torch.zeros(B, 1).fill_(temperature)
@@ -95,7 +101,7 @@ class ThreadedSearchAgent(BaseSearchAgent):
         # model forward / transform
         with torch.no_grad():
             with timings("to_cuda"):
-                x = {k: v.to(self.device) for k, v in x.items()}
+                x = {k: to_device_broadcast(v, self.device) for k, v in x.items()}
             with timings("model"):
                 if values_only:
                     y = self.value_model(**x, values_only=values_only)
@@ -106,15 +112,17 @@ class ThreadedSearchAgent(BaseSearchAgent):
                     return y.cpu().numpy()
             with timings("transform"):
                 y = model_output_transform(x, y)
+            if orders_on_device:
+                return (y[0], None, None)
             with timings("to_cpu"):
                 y = tuple(x.to("cpu") for x in y)
 
         order_idxs, order_logprobs, final_scores = y
+        if not decode:
+            return (order_idxs, order_logprobs, None)
 
         with timings("model.decode"):
             decoded = self.thread_pool.decode_order_idxs(order_idxs)
-        with timings("model.decode.tuple"):
-            decoded = [[tuple(orders) for orders in powers_orders] for powers_orders in decoded]
 
         # Returning None for values. Must call with values_only to get values.
         return (decoded, order_logprobs, None)
@@ -126,22 +134,92 @@ class ThreadedSearchAgent(BaseSearchAgent):
         )
         return batch_est_final_scores[0]
 
+    def get_plausible_orders(
+        self,
+        game,
+        *,
+        n=1000,
+        temperature=1.0,
+        limit: Union[int, Sequence[int]],  # limit, or list of limits per power
+        batch_size=500,
+        top_p=1.0,
+    ) -> Dict[str, Dict[Tuple[str], float]]:
+        """Same as BaseSearchAgent.get_plausible_orders, but the sampled order
+        idxs are counted and filtered natively, and only the plausible orders
+        are decoded"""
+        assert n % batch_size == 0, f"{n}, {batch_size}"
+        limits = [limit] * 7 if type(limit) == int else limit
+        assert len(limits) == 7
+        del limit
+
+        counter = pydipcc.PlausibleOrdersCounter(self.thread_pool)
+        x = FeatureEncoder().encode_inputs_repeated(game, batch_size)
+        for _ in range(n // batch_size):
+            order_idxs, order_logprobs, _ = self.do_model_request(
+                DataFields(x), temperature, top_p, decode=False
+            )
+            counter.add(order_idxs, order_logprobs)
+
+        logging.info(
+            "get_plausible_orders(n={}, t={}) found {} unique sets, choosing top {}".format(
+                n, temperature, [counter.get_n_unique(p) for p in range(7)], limits
+            )
+        )
+        most_common = {
+            power: counter.get_plausible_orders(p, limit, self.exclude_n_holds)
+            for p, (power, limit) in enumerate(zip(POWERS, limits))
+        }
+
+        logging.info("Plausible orders:")
+        logging.info("        count,count_frac,prob")
+        for power, actions in most_common.items():
+            logging.info(f"    {power}")
+            for orders, count, logprob in actions:
+                logging.info(
+                    f"        {count:5d} {count/n:10.5f} {np.exp(logprob):10.5f}  {orders}"
+                )
+
+        return {
+            power: {orders: logprob for orders, _, logprob in actions}
+            for power, actions in most_common.items()
+        }
+
     def do_rollouts(
-        self, game_init, set_orders_dicts, average_n_rollouts=1, timings=None, log_timings=False
+        self,
+        game_init,
+        set_orders_dicts,
+        average_n_rollouts=1,
+        timings=None,
+        log_timings=False,
+        rollout_cache=None,
     ):
+        """Return a list of (set_orders_dict, average scores dict)
+
+        If rollout_cache (a pydipcc.RolloutCache) is set, the results of the
+        set_orders_dicts found in it are not rolled out again, and those rolled
+        out are put in it. It is looked up in the ThreadPool's threads, and is
+        ignored with remote rollouts.
+        """
         if timings is None:
             timings = TimingCtx()
 
+        if self.remote_rollouts is not None:
+            with timings("remote_rollouts"):
+                r = self.remote_rollouts.do_rollouts(
+                    game_init, set_orders_dicts, average_n_rollouts=average_n_rollouts
+                )
+            if log_timings:
+                timings.pprint(logging.getLogger("timings").info)
+            return r
+
         if self.clear_old_all_possible_orders:
             with timings("clear_old_orders"):
                 game_init = pydipcc.Game(game_init)
                 game_init.clear_old_all_possible_orders()
         with timings("clone"):
-            games = [
-                pydipcc.Game(game_init)  # clones
-                for _ in set_orders_dicts
-                for _ in range(average_n_rollouts)
-            ]
+            games = self.thread_pool.clone_multi(
+                game_init, len(set_orders_dicts) * average_n_rollouts
+            )
         with timings("setup"):
             for i in range(len(games)):
                 games[i].game_id += f"_{i}"
@@ -152,72 +230,41 @@ class ThreadedSearchAgent(BaseSearchAgent):
                 for power, orders in set_orders_dict.items():
                     game.set_orders(power, list(orders))
 
-            # for each game, a list of powers whose orders need to be generated
-            # by the model on the first phase.
-            missing_start_orders = {
-                game.game_id: frozenset(p for p in POWERS if p not in set_orders_dict)
-                for game, set_orders_dict in zip(
-                    games, repeat(set_orders_dicts, average_n_rollouts)
+        # Keep only the games of the set_orders_dicts not in the cache
+        cached = None
+        if rollout_cache is not None:
+            with timings("rollout_cache"):
+                cached = self.thread_pool.lookup_rollout_cache(
+                    rollout_cache, games[::average_n_rollouts]
                 )
-            }
-
-        if self.max_rollout_length > 0:
-            rollout_end_phase_id = sort_phase_key(
-                n_move_phases_later(game_init.current_short_phase, self.max_rollout_length)
-            )
-            max_steps = 1000000
-        else:
-            # Really far ahead.
-            rollout_end_phase_id = sort_phase_key(
-                n_move_phases_later(game_init.current_short_phase, 10)
+                hits = cached["hits"].tolist()
+                games = [g for g, hit in zip(games, repeat(hits, average_n_rollouts)) if not hit]
+            if not games:
+                r = [
+                    (set_orders_dict, dict(zip(POWERS, values)))
+                    for set_orders_dict, values in zip(set_orders_dicts, cached["values"].tolist())
+                ]
+                if log_timings:
+                    timings.pprint(logging.getLogger("timings").info)
+                return r
+
+        def rollout_policy(batch_inputs):
+            batch_order_idxs, _, _ = self.do_model_request(
+                batch_inputs,
+                self.rollout_temperature,
+                self.rollout_top_p,
+                timings=timings,
+                decode=False,
+                orders_on_device=True,
             )
-            max_steps = 1
-
-        # This loop steps the games until one of the conditions is true:
-        #   - all games are done
-        #   - at least one game was stepped for max_steps steps
-        #   - all games are either completed or reach a phase such that
-        #     sort_phase_key(phase) >= rollout_end_phase_id
-        for step_id in range(max_steps):
-            ongoing_game_phases = [
-                game.current_short_phase for game in games if not game.is_game_done
-            ]
-
-            if len(ongoing_game_phases) == 0:
-                # all games are done
-                break
+            return batch_order_idxs
 
-            # step games together at the pace of the slowest game, e.g. process
-            # games with retreat phases alone before moving on to the next move phase
-            min_phase = min(ongoing_game_phases, key=sort_phase_key)
-
-            if sort_phase_key(min_phase) >= rollout_end_phase_id:
-                break
-
-            games_to_step = [
-                game
-                for game in games
-                if not game.is_game_done and game.current_short_phase == min_phase
-            ]
-
-            if step_id > 0 or any(missing_start_orders.values()):
-                with timings("encoding"):
-                    batch_inputs = FeatureEncoder().encode_inputs(games_to_step)
-
-                batch_orders, _, _ = self.do_model_request(
-                    batch_inputs, self.rollout_temperature, self.rollout_top_p, timings=timings
-                )
-
-                with timings("env.set_orders"):
-                    assert len(games_to_step) == len(batch_orders)
-                    for game, orders_per_power in zip(games_to_step, batch_orders):
-                        for power, orders in zip(POWERS, orders_per_power):
-                            if step_id == 0 and power not in missing_start_orders[game.game_id]:
-                                continue
-                            game.set_orders(power, list(orders))
-
-            with timings("env.step"):
-                self.thread_pool.process_multi([game for game in games_to_step])
+        # Steps the games together, at the pace of the slowest game, until all
+        # are done or reach the max_rollout_length-th move phase (or for one
+        # phase if max_rollout_length is 0). Powers in set_orders_dicts keep
+        # their orders on the first phase.
+        with timings("rollouts"):
+            pydipcc.run_rollouts(self.thread_pool, games, self.max_rollout_length, rollout_policy)
 
         # Compute SoS for done game and query the net for not-done games.
         not_done_games = [game for game in games if not game.is_game_done]
@@ -234,11 +281,14 @@ class ThreadedSearchAgent(BaseSearchAgent):
             )
             for game_idx, game in enumerate(not_done_games):
                 est_final_scores[game.game_id] = np.array(batch_est_final_scores[game_idx])
-        for game in games:
-            if game.is_game_done:
-                est_final_scores[game.game_id] = np.array(get_square_scores_from_game(game))
 
         with timings("final_scores"):
+            # [len(games), 7] square scores of the current states
+            square_scores = self.thread_pool.get_scores_multi(games)[:, 0].numpy()
+            for game, game_square_scores in zip(games, square_scores):
+                if game.is_game_done:
+                    est_final_scores[game.game_id] = game_square_scores
+
             final_game_scores = [
                 dict(zip(POWERS, est_final_scores[game.game_id])) for game in games
             ]
@@ -247,20 +297,33 @@ class ThreadedSearchAgent(BaseSearchAgent):
             # get GameScores objects for current game state
             if self.mix_square_ratio_scoring > 0:
 
-                for game, final_scores in zip(games, final_game_scores):
-                    current_scores = game.get_square_scores()
+                for current_scores, final_scores in zip(square_scores, final_game_scores):
                     for pi, p in enumerate(POWERS):
                         final_scores[p] = (1 - self.mix_square_ratio_scoring) * final_scores[p] + (
                             self.mix_square_ratio_scoring * current_scores[pi]
                         )
 
-            r = [
-                (set_orders_dict, average_score_dicts(scores_dicts))
-                for set_orders_dict, scores_dicts in zip(
-                    set_orders_dicts, groups_of(final_game_scores, average_n_rollouts)
-                )
+            rolled_out = [
+                average_score_dicts(scores_dicts)
+                for scores_dicts in groups_of(final_game_scores, average_n_rollouts)
             ]
 
+        if cached is not None:
+            with timings("rollout_cache"):
+                misses = ~cached["hits"]
+                rollout_cache.put_multi(
+                    cached["keys"][misses],
+                    torch.tensor([[d[p] for p in POWERS] for d in rolled_out]),
+                )
+                rolled_out = iter(rolled_out)
+                all_scores = [
+                    dict(zip(POWERS, values)) if hit else next(rolled_out)
+                    for hit, values in zip(hits, cached["values"].tolist())
+                ]
+        else:
+            all_scores = rolled_out
+        r = list(zip(set_orders_dicts, all_scores))
+
         if log_timings:
             timings.pprint(logging.getLogger("timings").info)
 
@@ -268,7 +331,16 @@ class ThreadedSearchAgent(BaseSearchAgent):
 
     @classmethod
     def cat_pad_inputs(cls, xs: List[DataFields]) -> DataFields:
-        return DataFields({k: torch.cat([x[k] for x in xs]) for k in xs[0].keys()})
+        return FeatureEncoder().cat_pad_inputs(xs)
+
+
+def to_device_broadcast(x: torch.Tensor, device) -> torch.Tensor:
+    """Same as x.to(device), but copy only one row of rows expanded with
+    stride 0 (see FeatureEncoder.encode_inputs_repeated), and expand it on
+    the device"""
+    if x.dim() > 0 and x.size(0) > 1 and x.stride(0) == 0:
+        return x[:1].to(device).expand_as(x).contiguous()
+    return x.to(device)
 
 
 def repeat(seq, n):
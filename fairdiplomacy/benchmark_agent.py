@@ -3,19 +3,25 @@
 # This source code is licensed under the MIT license found in the
 # LICENSE file in the root directory of this source tree.
 
-from typing import List
+from typing import Dict, List
+import inspect
 import json
 import logging
 import pathlib
 import random
+import threading
 import time
 
 import numpy as np
 import torch
 
+from fairdiplomacy import pydipcc
 from fairdiplomacy.pydipcc import Game
 from fairdiplomacy.models.consts import POWERS
 from fairdiplomacy.agents import build_agent_from_cfg
+from fairdiplomacy.utils.timing_ctx import TimingCtx
+
+PERCENTILES = (50, 90, 99)
 
 
 def load_games(game_jsons) -> List[Game]:
@@ -30,7 +36,7 @@ def load_games(game_jsons) -> List[Game]:
     return games
 
 
-def run(cfg: "conf.conf_pb2.BenchmarkAgent"):
+def run(cfg: "conf.conf_pb2.BenchmarkAgentTask"):
 
     logger = logging.getLogger("timing")
     logger.setLevel(logging.DEBUG)
@@ -38,9 +44,7 @@ def run(cfg: "conf.conf_pb2.BenchmarkAgent"):
     logger.info("Will write timing logs to %s", timing_outpath)
     logger.addHandler(logging.FileHandler(timing_outpath))
 
-    random.seed(cfg.seed)
-    np.random.seed(cfg.seed)
-    torch.manual_seed(cfg.seed)
+    set_seed(cfg.seed)
 
     agent = build_agent_from_cfg(cfg.agent)
     games = load_games(cfg.game_jsons)
@@ -48,6 +52,10 @@ def run(cfg: "conf.conf_pb2.BenchmarkAgent"):
     logger.info("Warmup")
     agent.get_orders(games[0], POWERS[0])
 
+    if cfg.throughput:
+        run_throughput(cfg, agent, games, logger)
+        return
+
     logger.info("Running benchmark")
     times = []
     for _ in range(cfg.repeats):
@@ -64,3 +72,159 @@ def run(cfg: "conf.conf_pb2.BenchmarkAgent"):
     logger.info("Total time per repeat: %s +- %s", per_repeat.mean(), per_repeat.std())
     per_call = times.flatten()
     logger.info("Total time per call: %s +- %s", per_call.mean(), per_call.std())
+
+
+def set_seed(seed):
+    random.seed(seed)
+    np.random.seed(seed)
+    torch.manual_seed(seed)
+
+
+def run_throughput(cfg, agent, games, logger):
+    """Time every call by stage, and write a JSON report to cfg.report_path
+
+    Stages come from the TimingCtx of the agent, if its get_orders_many_powers
+    accepts one, and from the native pydipcc counters. Each pass over the games
+    is reseeded, so passes run the same searches.
+    """
+    get_orders = _make_timed_get_orders(agent)
+    n_rollouts = _count_rollouts(agent)
+    gpu = GpuSampler(cfg.gpu_sample_period)
+
+    stage_samples: Dict[str, List[float]] = {}
+    call_times = []
+    pydipcc.set_perf_stats_enabled(True)
+    pydipcc.reset_perf_stats()
+    gpu.start()
+    start = time.perf_counter()
+    for _ in range(cfg.repeats):
+        set_seed(cfg.seed)
+        for game in games:
+            for power in POWERS:
+                timings = TimingCtx()
+                call_start = time.perf_counter()
+                get_orders(game, power, timings)
+                call_times.append(time.perf_counter() - call_start)
+                for stage, t in timings.items():
+                    stage_samples.setdefault(stage, []).append(t)
+    elapsed = time.perf_counter() - start
+    gpu.stop()
+    native = pydipcc.get_perf_stats()
+    pydipcc.set_perf_stats_enabled(False)
+
+    report = {
+        "agent": type(agent).__name__,
+        "seed": cfg.seed,
+        "repeats": cfg.repeats,
+        "n_games": len(games),
+        "n_calls": len(call_times),
+        "total_s": elapsed,
+        "calls_per_sec": len(call_times) / elapsed,
+        "rollouts": n_rollouts[0],
+        "rollouts_per_sec": n_rollouts[0] / elapsed,
+        "phases": native["process"]["count"],
+        "phases_per_sec": native["process"]["count"] / elapsed,
+        "gpu_utilization": gpu.mean(),
+        "call_s": _summarize(call_times),
+        # Per call: a stage missing from a call counts as 0
+        "stages_s": {
+            stage: _summarize(samples + [0.0] * (len(call_times) - len(samples)))
+            for stage, samples in sorted(stage_samples.items())
+        },
+        "native": {
+            name: _summarize_native(stats, elapsed)
+            for name, stats in native.items()
+            if stats["count"] > 0
+        },
+    }
+    report_path = pathlib.Path(cfg.report_path).resolve()
+    with open(report_path, "w") as f:
+        json.dump(report, f, indent=2)
+    logger.info("Throughput: %s", json.dumps({k: v for k, v in report.items() if k[-4:] != "_s"}))
+    logger.info("Wrote report to %s", report_path)
+
+
+def _make_timed_get_orders(agent):
+    many_powers = getattr(agent, "get_orders_many_powers", None)
+    if many_powers is not None and "timings" in inspect.signature(many_powers).parameters:
+        return lambda game, power, timings: many_powers(game, [power], timings=timings)
+
+    def get_orders(game, power, timings):
+        with timings("get_orders"):
+            agent.get_orders(game, power)
+
+    return get_orders
+
+
+def _count_rollouts(agent) -> List[int]:
+    """Count the rollouts of agent.do_rollouts, if any, in the returned cell"""
+    count = [0]
+    do_rollouts = getattr(agent, "do_rollouts", None)
+    if do_rollouts is None:
+        return count
+
+    def counted(game_init, set_orders_dicts, average_n_rollouts=1, **kwargs):
+        count[0] += len(set_orders_dicts) * average_n_rollouts
+        return do_rollouts(game_init, set_orders_dicts, average_n_rollouts, **kwargs)
+
+    agent.do_rollouts = counted
+    return count
+
+
+def _summarize(samples) -> Dict[str, float]:
+    r = {"mean": float(np.mean(samples)), "total": float(np.sum(samples))}
+    for q, v in zip(PERCENTILES, np.percentile(samples, PERCENTILES)):
+        r[f"p{q}"] = float(v)
+    return r
+
+
+def _summarize_native(stats, elapsed) -> Dict[str, float]:
+    """Seconds; percentiles are the upper bounds of their histogram buckets"""
+    r = {
+        "count": stats["count"],
+        "total": stats["total_ns"] * 1e-9,
+        "fraction": stats["total_ns"] * 1e-9 / elapsed,
+        "mean": stats["total_ns"] * 1e-9 / stats["count"],
+        "max": stats["max_ns"] * 1e-9,
+    }
+    cumsum = np.cumsum(stats["histogram"])
+    for q in PERCENTILES:
+        bucket = int(np.searchsorted(cumsum, cumsum[-1] * q / 100))
+        r[f"p{q}"] = min(2.0 ** (bucket + 1), stats["max_ns"]) * 1e-9
+    return r
+
+
+class GpuSampler:
+    """Sample the utilization of the current GPU in a background thread
+
+    mean() is None without a GPU, or if torch can't query it (needs pynvml).
+    """
+
+    def __init__(self, period):
+        self.period = period
+        self.samples = []
+        self._stop = threading.Event()
+        self._thread = None
+
+    def start(self):
+        if not torch.cuda.is_available():
+            return
+        try:
+            torch.cuda.utilization()
+        except Exception:
+            logging.warning("Can't query GPU utilization, not reporting it")
+            return
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        if self._thread is not None:
+            self._stop.set()
+            self._thread.join()
+
+    def mean(self):
+        return float(np.mean(self.samples)) if self.samples else None
+
+    def _run(self):
+        while not self._stop.wait(self.period):
+            self.samples.append(torch.cuda.utilization())
@@ -62,6 +62,9 @@ def build_db_cache_from_cfg(cfg):
             else build_agent_from_cfg(cfg.cf_agent)
         ),
         n_cf_agent_samples=cfg.n_cf_agent_samples,
+        native_encoding=no_press_cfg.native_encoding,
+        native_shard_dir=no_press_cfg.native_shard_dir or None,
+        dedup_phases=no_press_cfg.dedup_phases,
     )
 
     if len(val_game_ids) > 0:
@@ -6,6 +6,7 @@
 import json
 import logging
 import os
+import tempfile
 from itertools import combinations, product
 from typing import Any, Dict, Union, List, Optional, Sequence, Tuple
 
@@ -14,13 +15,14 @@ import torch
 import numpy as np
 
 from fairdiplomacy.data.data_fields import DataFields
+from fairdiplomacy import pydipcc
 from fairdiplomacy.pydipcc import Game
 from fairdiplomacy.models.consts import SEASONS, POWERS, MAX_SEQ_LEN, LOCS
 from fairdiplomacy.models.diplomacy_model.order_vocabulary import EOS_IDX
-from fairdiplomacy.utils.game_scoring import compute_game_scores, compute_game_scores_from_state
+from fairdiplomacy.utils.game_scoring import compute_game_scores
 from fairdiplomacy.utils.sampling import sample_p_dict
 from fairdiplomacy.utils.tensorlist import TensorList
-from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder
+from fairdiplomacy.utils.thread_pool_encoding import FeatureEncoder, get_shared_orders_encoder
 from fairdiplomacy.utils.cat_pad_sequences import cat_pad_sequences
 from fairdiplomacy.utils.order_idxs import (
     action_strs_to_global_idxs,
@@ -47,6 +49,9 @@ class Dataset(torch.utils.data.Dataset):
         n_cf_agent_samples=1,
         min_rating=None,
         exclude_n_holds=-1,
+        native_encoding=False,
+        native_shard_dir=None,
+        dedup_phases=False,
     ):
         self.game_ids = game_ids
         self.data_dir = data_dir
@@ -59,6 +64,9 @@ class Dataset(torch.utils.data.Dataset):
         self.n_cf_agent_samples = n_cf_agent_samples
         self.min_rating = min_rating
         self.exclude_n_holds = exclude_n_holds
+        self.native_encoding = native_encoding
+        self.native_shard_dir = native_shard_dir
+        self.dedup_phases = dedup_phases
         # Pre-processing populates these fields
         self.game_idxs = None
         self.phase_idxs = None
@@ -68,6 +76,8 @@ class Dataset(torch.utils.data.Dataset):
         self.num_games = None
         self.num_phases = None
         self.num_elements = None
+        # If dedup_phases, the number of occurrences of each row's position
+        self.phase_counts = None
         self._preprocessed = False
 
     @property
@@ -92,12 +102,39 @@ class Dataset(torch.utils.data.Dataset):
 
         return encoded_game_tuples
 
+    def native_encode_games(self) -> List[Tuple]:
+        """Same as mp_encode_games, with the games encoded by
+        encode_games_native on num_dataloader_workers threads. If
+        native_shard_dir is set, each encoded shard is also saved there."""
+        assert self.cf_agent is None and self.n_cf_agent_samples == 1, (
+            "native_encoding only encodes the games' orders"
+        )
+        encoded_game_tuples = []
+        shards = encode_games_native(
+            self.game_ids,
+            self.data_dir,
+            input_valid_power_idxs=[self.get_valid_power_idxs(g) for g in self.game_ids],
+            num_threads=self.n_jobs,
+            only_with_min_final_score=self.only_with_min_final_score,
+            value_decay_alpha=self.value_decay_alpha,
+            exclude_n_holds=self.exclude_n_holds,
+            position_hashes=self.dedup_phases,
+        )
+        for shard_i, (game_ids, n_phases, shard) in enumerate(shards):
+            if self.native_shard_dir:
+                os.makedirs(self.native_shard_dir, exist_ok=True)
+                shard_path = os.path.join(self.native_shard_dir, f"shard_{shard_i:05d}.pt")
+                torch.save((game_ids, n_phases, shard), shard_path)
+            encoded_game_tuples.extend(split_encoded_shard(game_ids, n_phases, shard))
+        return encoded_game_tuples
+
     def preprocess(self):
         """
         Pre-processes dataset
         :return:
         """
         assert not self.debug_only_opening_phase, "FIXME"
+        assert self.native_encoding or not self.dedup_phases, "dedup_phases needs native_encoding"
 
         logging.info(
             f"Building dataset from {len(self.game_ids)} games, "
@@ -107,7 +144,10 @@ class Dataset(torch.utils.data.Dataset):
 
         torch.set_num_threads(1)
         encoder = FeatureEncoder()
-        encoded_game_tuples = self.mp_encode_games()
+        if self.native_encoding:
+            encoded_game_tuples = self.native_encode_games()
+        else:
+            encoded_game_tuples = self.mp_encode_games()
 
         encoded_games = [
             g for (_, g) in encoded_game_tuples if g is not None
@@ -125,6 +165,17 @@ class Dataset(torch.utils.data.Dataset):
             if g_id is not None and g["valid_power_idxs"][0].any()
         ]
 
+        keep_phases = None
+        if self.dedup_phases:
+            keep_phases, self.phase_counts = dedup_positions(
+                torch.cat([g.pop("position_hashes") for g in encoded_games]),
+                torch.cat([g["valid_power_idxs"].any(dim=1) for g in encoded_games]),
+            )
+            logging.info(
+                f"Keeping {int(keep_phases.sum())} / {len(keep_phases)} phases: "
+                "the first of each position"
+            )
+
         game_idxs, phase_idxs, power_idxs, x_idxs = [], [], [], []
         x_idx = 0
         for game_idx, encoded_game in enumerate(encoded_games):
@@ -133,6 +184,9 @@ class Dataset(torch.utils.data.Dataset):
                     encoded_game["valid_power_idxs"].shape,
                     valid_power_idxs.shape,
                 )
+                if keep_phases is not None and not keep_phases[x_idx]:
+                    x_idx += 1
+                    continue
                 for power_idx in valid_power_idxs.nonzero()[:, 0]:
                     game_idxs.append(game_idx)
                     phase_idxs.append(phase_idx)
@@ -254,6 +308,8 @@ class Dataset(torch.utils.data.Dataset):
         merged.num_games = sum(d.num_games for d in datasets)
         merged.num_phases = sum(d.num_phases for d in datasets)
         merged.num_elements = sum(d.num_elements for d in datasets)
+        if all(getattr(d, "phase_counts", None) is not None for d in datasets):
+            merged.phase_counts = torch.cat([d.phase_counts for d in datasets])
         merged._preprocessed = True
 
         return merged
@@ -298,21 +354,16 @@ def encode_game(
     torch.set_num_threads(1)
     encoder = FeatureEncoder()
 
-    if isinstance(game_id, str):
-        game_path = game_id
-    else:  # Hacky fix to handle game_ids that are paths.
-        game_path = os.path.join(f"{data_dir}", f"game_{game_id}.json")
-
-    try:
-        with open(game_path) as f:
-            game = Game.from_json(f.read())
-    except (FileNotFoundError, json.decoder.JSONDecodeError) as e:
-        print(f"Error while loading game at {game_path}: {e}")
+    game = load_game(game_id, data_dir)
+    if game is None:
         return None, None
 
     num_phases = len(game.get_phase_history())
     logging.info(f"Encoding {game.game_id} with {num_phases} phases")
 
+    # [num_phases, 7] weighted sum-of-squares value targets, computed natively
+    sos_targets = game.get_sos_targets(value_decay_alpha)
+
     phase_encodings = [
         encode_phase(
             encoder,
@@ -322,7 +373,7 @@ def encode_game(
             only_with_min_final_score=only_with_min_final_score,
             cf_agent=cf_agent,
             n_cf_agent_samples=n_cf_agent_samples,
-            value_decay_alpha=value_decay_alpha,
+            y_final_scores=sos_targets[phase_idx : phase_idx + 1],
             input_valid_power_idxs=input_valid_power_idxs,
             exclude_n_holds=exclude_n_holds,
         )
@@ -334,6 +385,137 @@ def encode_game(
     return game_id, stacked_encodings.to_storage_fmt_()
 
 
+def load_game(game_id: Union[int, str], data_dir: str) -> Optional[Game]:
+    if isinstance(game_id, str):
+        game_path = game_id
+    else:  # Hacky fix to handle game_ids that are paths.
+        game_path = os.path.join(f"{data_dir}", f"game_{game_id}.json")
+
+    try:
+        with open(game_path) as f:
+            return Game.from_json(f.read())
+    except (FileNotFoundError, json.decoder.JSONDecodeError) as e:
+        print(f"Error while loading game at {game_path}: {e}")
+        return None
+
+
+# Games per GameCorpus and encode_dataset_games call of encode_games_native
+NATIVE_GAMES_PER_SHARD = 1000
+
+
+def encode_games_native(
+    game_ids: Sequence[Union[int, str]],
+    data_dir: str,
+    *,
+    input_valid_power_idxs,
+    num_threads: int,
+    only_with_min_final_score: Optional[int],
+    value_decay_alpha: float,
+    exclude_n_holds: int,
+    games_per_shard: int = NATIVE_GAMES_PER_SHARD,
+    position_hashes: bool = False,
+):
+    """Encode games as encode_game does with cf_agent=None, in C++.
+
+    Each shard of games is written to a pydipcc.GameCorpus in a temporary
+    directory, then all of its phases are encoded at once by
+    ThreadPool.encode_dataset_games. Games that fail to load are skipped.
+
+    Yields, per shard, (game_ids, n_phases, fields): the ids of the games
+    encoded, their number of phases, and a DataFields in storage format whose
+    rows are the phases of the games, in order. If position_hashes, fields
+    also has the [rows] int64 position hashes of ThreadPool.dedup_corpus,
+    which are the same for the same position in any shard.
+    """
+    pool = pydipcc.ThreadPool(num_threads, get_shared_orders_encoder())
+    with tempfile.TemporaryDirectory() as tmpdir:
+        corpus_path = os.path.join(tmpdir, "games.corpus")
+        for start in range(0, len(game_ids), games_per_shard):
+            shard_game_ids, games, masks = [], [], []
+            for i in range(start, min(start + games_per_shard, len(game_ids))):
+                game = load_game(game_ids[i], data_dir)
+                if game is not None:
+                    shard_game_ids.append(game_ids[i])
+                    games.append(game)
+                    masks.append(input_valid_power_idxs[i])
+            if not games:
+                continue
+
+            pydipcc.GameCorpus.write(corpus_path, games)
+            corpus = pydipcc.GameCorpus(corpus_path)
+            fields = pool.encode_dataset_games(
+                corpus,
+                list(range(len(games))),
+                value_decay_alpha=value_decay_alpha,
+                only_with_min_final_score=(
+                    -1 if only_with_min_final_score is None else only_with_min_final_score
+                ),
+                exclude_n_holds=exclude_n_holds,
+            )
+            if position_hashes:
+                fields["position_hashes"] = pool.dedup_corpus(corpus, list(range(len(games))))[
+                    "hashes"
+                ]
+            phase_ranges = [corpus.get_phase_range(i) for i in range(len(games))]
+            n_phases = [end - first for first, end in phase_ranges]
+            del corpus
+
+            fields["valid_power_idxs"] &= torch.tensor(masks, dtype=torch.bool).repeat_interleave(
+                torch.tensor(n_phases), dim=0
+            )
+            fields["y_final_scores"] = fields["y_final_scores"].unsqueeze(1)  # as encode_phase
+            fields["x_possible_actions"] = TensorList(
+                fields.pop("x_possible_actions_offsets"), fields.pop("x_possible_actions_values")
+            )
+            yield shard_game_ids, n_phases, DataFields(fields).to_storage_fmt_()
+
+
+def dedup_positions(
+    position_hashes: torch.Tensor, has_valid_powers: torch.Tensor
+) -> Tuple[torch.Tensor, torch.Tensor]:
+    """Dedup the rows of a dataset by position.
+
+    Arguments:
+    - position_hashes: [rows] int64, see ThreadPool.dedup_corpus
+    - has_valid_powers: [rows] bool, false for rows with no valid power
+
+    Returns (keep, counts): [rows] bool, true for the first row of each
+    position among the rows with valid powers, and [rows] int64, the number of
+    those rows with the same position (0 for rows with no valid power).
+    Duplicate rows are dropped with their targets, which may differ.
+    """
+    rows = has_valid_powers.nonzero()[:, 0].numpy()
+    _, first, inverse, counts = np.unique(
+        position_hashes.numpy()[rows], return_index=True, return_inverse=True, return_counts=True
+    )
+    keep = torch.zeros(len(position_hashes), dtype=torch.bool)
+    keep[rows[first]] = True
+    phase_counts = torch.zeros(len(position_hashes), dtype=torch.long)
+    phase_counts[rows] = torch.from_numpy(counts[inverse])
+    return keep, phase_counts
+
+
+def split_encoded_shard(game_ids, n_phases, fields: DataFields) -> List[Tuple]:
+    """Split an encode_games_native shard into encode_game results"""
+    r = []
+    start = 0
+    for game_id, n in zip(game_ids, n_phases):
+        rows = slice(start * len(POWERS) * MAX_SEQ_LEN, (start + n) * len(POWERS) * MAX_SEQ_LEN)
+        r.append(
+            (
+                game_id,
+                DataFields(
+                    {
+                        k: v[rows] if isinstance(v, TensorList) else v[start : start + n]
+                        for k, v in fields.items()
+                    }
+                ),
+            )
+        )
+        start += n
+    return r
+
+
 def encode_phase(
     encoder: FeatureEncoder,
     game: Game,
@@ -343,7 +525,7 @@ def encode_phase(
     only_with_min_final_score: Optional[int],
     cf_agent=None,
     n_cf_agent_samples=1,
-    value_decay_alpha,
+    y_final_scores: torch.Tensor,
     input_valid_power_idxs,
     exclude_n_holds,
 ):
@@ -352,6 +534,7 @@ def encode_phase(
     - game: Game object
     - game_id: unique id for game
     - phase_idx: int, the index of the phase to encode
+    - y_final_scores: [1, 7] value target of the phase, see Game.get_sos_targets
     - only_with_min_final_score: if specified, only encode for powers who
       finish the game with some # of supply centers (i.e. only learn from
       winners). MILA uses 7.
@@ -362,9 +545,6 @@ def encode_phase(
     rolled_back_game = game.rolled_back_to_phase_start(phase.name)
     data_fields = encoder.encode_inputs([rolled_back_game])
 
-    # encode final scores
-    y_final_scores = encode_weighted_sos_scores(game, phase_idx, value_decay_alpha)
-
     # encode actions
     valid_power_idxs = torch.tensor(input_valid_power_idxs, dtype=torch.bool)
     # print('valid_power_idxs', valid_power_idxs)
@@ -486,7 +666,7 @@ def get_valid_orders_impl(power, all_possible_orders, all_orderable_locations, g
 
 
 def get_cf_agent_order_samples(game, phase_name, cf_agent, n_cf_agent_samples):
-    assert game.get_state()["name"] == phase_name, f"{game.get_state()['name']} != {phase_name}"
+    assert game.current_short_phase == phase_name, f"{game.current_short_phase} != {phase_name}"
 
     if hasattr(cf_agent, "get_all_power_prob_distributions"):
         power_action_ps = cf_agent.get_all_power_prob_distributions(game)
@@ -577,50 +757,3 @@ def smarter_order_index(order):
             order = order.replace(suffix, "")
         return ORDER_VOCABULARY_TO_IDX[order]
 
-
-def encode_weighted_sos_scores(game, phase_idx, value_decay_alpha):
-    y_final_scores = torch.zeros(1, 7, dtype=torch.float)
-    phases = game.get_phase_history()
-
-    if phase_idx == len(phases) - 1:
-        # end of game
-        phase = phases[phase_idx]
-        y_final_scores[0, :] = torch.FloatTensor(
-            [
-                compute_game_scores_from_state(p, phase.state).square_score
-                for p in range(len(POWERS))
-            ]
-        )
-        return y_final_scores
-
-    # only weight scores at end of year, noting that not all years have a
-    # winter adjustment phase
-    end_of_year_phases = {}
-    for phase in phases:
-        end_of_year_phases[int(phase.name[1:-1])] = phase.name
-    end_of_year_phases = set(end_of_year_phases.values())
-
-    remaining = 1.0
-    weight = 1.0 - value_decay_alpha
-    for phase in phases[phase_idx + 1 :]:
-        if phase.name not in end_of_year_phases:
-            continue
-
-        # calculate sos score at this phase
-        sq_scores = torch.FloatTensor(
-            [
-                compute_game_scores_from_state(p, phase.state).square_score
-                for p in range(len(POWERS))
-            ]
-        )
-
-        # accumulate exp. weighted average
-        y_final_scores[0, :] += weight * sq_scores
-        remaining -= weight
-        weight *= value_decay_alpha
-
-    # fill in remaining weight with final score
-    final_sq_scores = torch.FloatTensor(game.get_square_scores())
-    y_final_scores[0, :] += remaining * final_sq_scores
-
-    return y_final_scores
@@ -16,7 +16,7 @@ import joblib
 import torch
 from typing import Optional, Union
 
-from fairdiplomacy.models.consts import POWERS
+from fairdiplomacy.models.consts import LOCS, POWERS
 from fairdiplomacy.pydipcc import Game
 from fairdiplomacy import pydipcc
 
@@ -67,9 +67,8 @@ def compute_xpower_supports(
             # This is required as, e.g., in retreat phase a single location
             # could be occupied by several powers and everything is weird.
             continue
-        loc_power = {
-            unit.split()[1]: power for power, units in state["units"].items() for unit in units
-        }
+        _, unit_owners = phase.get_unit_arrays()
+        loc_power = {LOCS[i]: POWERS[owner] for i, owner in enumerate(unit_owners) if owner >= 0}
         # If power owns, e.g., BUL/SC, make it also own BUL. Support targets do
         # not use "/SC" so we need both.
         for loc, power in list(loc_power.items()):
@@ -124,13 +123,13 @@ def compute_xpower_supports(
                     g_cf = game.rolled_back_to_phase_start(state["name"])
                     g_cf.set_orders(power, power_orders)
 
-                    assert g_cf.get_state()["name"] == state["name"]
+                    assert g_cf.current_short_phase == state["name"]
                     if not do_support:
                         hold_order = " ".join(order_tokens[:2] + ["H"])
                         g_cf.set_orders(power, [hold_order])
 
                     g_cf.process()
-                    assert g_cf.get_state()["name"] != state["name"]
+                    assert g_cf.current_short_phase != state["name"]
                     s = g_cf.get_state()
                     cf_states.append((s["name"], s["units"], s["retreats"]))
 
@@ -21,6 +21,20 @@ from fairdiplomacy.models.diplomacy_model.order_vocabulary import get_order_voca
 
 EOS_TOKEN = get_order_vocabulary()[EOS_IDX]
 
+BOARD_STATE_PACKED_WIDTH = 5
+
+
+def unpack_board_state(x: torch.Tensor) -> torch.Tensor:
+    """Return a board state field of any pydipcc.BoardStateFormat as [..., 35] float32
+
+    Same as pydipcc.unpack_board_state: PACKED fields hold channel c in bit
+    c % 8 of byte c / 8.
+    """
+    if x.dtype == torch.uint8 and x.shape[-1] == BOARD_STATE_PACKED_WIDTH:
+        masks = torch.tensor([1 << i for i in range(8)], dtype=torch.uint8, device=x.device)
+        x = (x.unsqueeze(-1) & masks).ne(0).flatten(-2)[..., :35]
+    return x.float()
+
 
 class DiplomacyModel(nn.Module):
     def __init__(
@@ -164,6 +178,8 @@ class DiplomacyModel(nn.Module):
         """
 
         # following https://arxiv.org/pdf/2006.04635.pdf , Appendix C
+        x_board_state = unpack_board_state(x_board_state)
+        x_prev_state = unpack_board_state(x_prev_state)
         B, NUM_LOCS, _ = x_board_state.shape
 
         # A. get season and prev order embs
@@ -0,0 +1,85 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""RolloutBatch rows in a shared-memory pydipcc.ReplayBuffer.
+
+Rollout workers append their batches to the buffer directly instead of
+pickling them through an mp.Queue, and the trainer samples rows from it:
+
+    buffer = create_buffer("/dev/shm/replay", capacity, example_batch)
+    # In each worker process:
+    append_rollouts("/dev/shm/replay", reward_kwargs, rollout_kwargs)
+    # In the trainer:
+    batch, sample_idxs, sample_probs = sample_batch(buffer, batch_size)
+
+Sampled rows are independent, so this suits off-policy training; V-trace
+over contiguous on-policy sequences keeps using DataLoader's queue.
+"""
+from typing import Dict, Tuple
+import logging
+
+import torch
+
+from fairdiplomacy.data.data_fields import DataFields
+from fairdiplomacy.pydipcc import ReplayBuffer
+from fairdiplomacy.selfplay.data_loader import RolloutBatch, yield_rewarded_rollouts
+
+OBSERVATION_PREFIX = "observations/"
+
+
+def rollout_batch_to_rows(batch: RolloutBatch) -> Dict[str, torch.Tensor]:
+    """Flatten a RolloutBatch into the buffer's [n, ...] fields."""
+    rows = {}
+    for k in RolloutBatch._fields:
+        if k == "observations":
+            for obs_k, v in batch.observations.items():
+                rows[OBSERVATION_PREFIX + obs_k] = v
+        else:
+            rows[k] = getattr(batch, k)
+    return rows
+
+
+def rows_to_rollout_batch(rows: Dict[str, torch.Tensor]) -> RolloutBatch:
+    """Inverse of rollout_batch_to_rows, ignoring the sampling fields."""
+    observations = DataFields(
+        {
+            k[len(OBSERVATION_PREFIX) :]: v
+            for k, v in rows.items()
+            if k.startswith(OBSERVATION_PREFIX)
+        }
+    )
+    return RolloutBatch(
+        observations=observations,
+        **{k: rows[k] for k in RolloutBatch._fields if k != "observations"},
+    )
+
+
+def create_buffer(path: str, capacity: int, example: RolloutBatch) -> ReplayBuffer:
+    """Create a buffer at path with the fields of example's rows."""
+    return ReplayBuffer(path, capacity, rollout_batch_to_rows(example))
+
+
+def append_rollouts(buffer_path: str, reward_kwargs, rollout_kwargs) -> None:
+    """A rollout worker function to append RolloutBatch's to the buffer."""
+    try:
+        buffer = ReplayBuffer(buffer_path)
+        for (batch, _), _ in yield_rewarded_rollouts(
+            reward_kwargs, rollout_kwargs, output_games=False
+        ):
+            buffer.append(rollout_batch_to_rows(batch))
+    except Exception as e:
+        logging.exception("Got an exception in append_rollouts: %s", e)
+        raise
+
+
+def sample_batch(
+    buffer: ReplayBuffer, batch_size: int, prioritized: bool = False, pin_memory: bool = True
+) -> Tuple[RolloutBatch, torch.Tensor, torch.Tensor]:
+    """Sample batch_size rows, with their slots and sampling probabilities.
+
+    Pass the slots to buffer.set_priorities to update prioritized sampling.
+    """
+    rows = buffer.sample(batch_size, prioritized=prioritized, pin_memory=pin_memory)
+    return rows_to_rollout_batch(rows), rows["sample_idxs"], rows["sample_probs"]
@@ -0,0 +1,53 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+from multiprocessing import shared_memory
+from typing import Tuple
+
+from fairdiplomacy import pydipcc
+
+# (shared memory segment name, size in bytes)
+SharedGameHandle = Tuple[str, int]
+
+
+class SharedGame:
+    """A game published once in a POSIX shared memory segment, in the
+    Game.to_bytes format, so that worker processes can load it without it
+    being pickled to each of them, and without parsing json.
+
+    Use as a context manager in the publishing process: the segment is
+    unlinked on exit.
+    """
+
+    def __init__(self, game: pydipcc.Game):
+        data = game.to_bytes()
+        self._shm = shared_memory.SharedMemory(create=True, size=max(len(data), 1))
+        self._shm.buf[: len(data)] = data
+        self.handle: SharedGameHandle = (self._shm.name, len(data))
+
+    def close(self):
+        if self._shm is not None:
+            self._shm.close()
+            self._shm.unlink()
+            self._shm = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def load_shared_game(handle: SharedGameHandle) -> pydipcc.Game:
+    """Return the game published at handle by a SharedGame"""
+    name, size = handle
+    # N.B. multiprocessing children share the publisher's resource tracker, so
+    # attaching here does not unlink the segment when this process exits
+    shm = shared_memory.SharedMemory(name=name)
+    try:
+        with shm.buf[:size] as data:
+            return pydipcc.Game.from_buffer(data)
+    finally:
+        shm.close()
@@ -3,12 +3,18 @@
 # This source code is licensed under the MIT license found in the
 # LICENSE file in the root directory of this source tree.
 
-from typing import Sequence, Optional
+import contextlib
+import hashlib
+import logging
+import os
+import threading
+from typing import Dict, List, Optional, Sequence
 import numpy as np
 import torch
 
 from fairdiplomacy import pydipcc
 from fairdiplomacy.data.data_fields import DataFields
+from fairdiplomacy.models.diplomacy_model.order_vocabulary import EOS_IDX
 from fairdiplomacy.utils.order_idxs import ORDER_VOCABULARY_TO_IDX, MAX_VALID_LEN
 
 KEYS_STATE_ONLY = [
@@ -22,35 +28,143 @@ KEYS_STATE_ONLY = [
 
 KEYS_ALL = KEYS_STATE_ONLY + ["x_loc_idxs", "x_possible_actions", "x_max_seq_len"]
 
+CAT_PAD_VALUES = {"x_possible_actions": -1, "x_loc_idxs": EOS_IDX}
 
-class FeatureEncoder:
 
-    nothread_pool_singleton: Optional[pydipcc.ThreadPool] = None
+_shared_pools: Dict[int, pydipcc.ThreadPool] = {}
+_shared_pools_lock = threading.Lock()
+_shared_orders_encoder: Optional[pydipcc.OrdersEncoder] = None
+_shared_orders_encoder_lock = threading.Lock()
 
-    def __init__(self, num_threads: int = 0):
-        if num_threads <= 0:
-            self.thread_pool = self._get_nothread_pool()
-        else:
-            self.thread_pool = pydipcc.ThreadPool(
-                num_threads, ORDER_VOCABULARY_TO_IDX, MAX_VALID_LEN
-            )
+# If set, the OrdersEncoder is loaded from this file, which is written on
+# first use, instead of being built from the order vocabulary
+ORDERS_ENCODER_PATH_ENV = "DIPCC_ORDERS_ENCODER_PATH"
+
+
+def _orders_encoder_fingerprint() -> bytes:
+    """Hash of what the OrdersEncoder is built from, stored as the first line
+    of the encoder file so that files built from another vocabulary or
+    max_cands are rebuilt rather than loaded"""
+    h = hashlib.sha256()
+    h.update(f"max_cands={MAX_VALID_LEN}\n".encode())
+    for order, idx in sorted(ORDER_VOCABULARY_TO_IDX.items(), key=lambda kv: kv[1]):
+        h.update(f"{idx} {order}\n".encode())
+    return h.hexdigest().encode() + b"\n"
+
+
+def _load_orders_encoder(path: str, fingerprint: bytes) -> Optional[pydipcc.OrdersEncoder]:
+    """Return the encoder saved at path, or None if it is missing, stale or
+    unreadable"""
+    try:
+        with open(path, "rb") as f:
+            if f.readline() != fingerprint:
+                logging.info(f"Rebuilding stale orders encoder: {path}")
+                return None
+            return pydipcc.OrdersEncoder.from_bytes(f.read())
+    except FileNotFoundError:
+        return None
+    except Exception:
+        logging.exception(f"Rebuilding unreadable orders encoder: {path}")
+        return None
+
+
+def get_shared_orders_encoder() -> pydipcc.OrdersEncoder:
+    """Return the process-wide OrdersEncoder, shared by all ThreadPools
+
+    Building the encoder parses the whole order vocabulary. Processes started
+    with DIPCC_ORDERS_ENCODER_PATH pointing at a saved encoder load it instead,
+    if it was built from the same vocabulary and max_cands.
+    """
+    global _shared_orders_encoder
+    with _shared_orders_encoder_lock:
+        if _shared_orders_encoder is None:
+            path = os.environ.get(ORDERS_ENCODER_PATH_ENV)
+            fingerprint = _orders_encoder_fingerprint() if path else b""
+            if path:
+                _shared_orders_encoder = _load_orders_encoder(path, fingerprint)
+            if _shared_orders_encoder is None:
+                _shared_orders_encoder = pydipcc.OrdersEncoder(
+                    ORDER_VOCABULARY_TO_IDX, MAX_VALID_LEN
+                )
+                if path:
+                    # Write-then-rename, as other processes may be loading it
+                    tmp_path = f"{path}.{os.getpid()}.tmp"
+                    with open(tmp_path, "wb") as f:
+                        f.write(fingerprint)
+                        f.write(_shared_orders_encoder.to_bytes())
+                    os.replace(tmp_path, path)
+        return _shared_orders_encoder
+
+
+def get_shared_thread_pool(num_threads: int) -> pydipcc.ThreadPool:
+    """Return the process-wide ThreadPool with num_threads workers
 
-    @classmethod
-    def _get_nothread_pool(cls) -> pydipcc.ThreadPool:
-        if cls.nothread_pool_singleton is None:
-            cls.nothread_pool_singleton = pydipcc.ThreadPool(
-                0, ORDER_VOCABULARY_TO_IDX, MAX_VALID_LEN
+    A ThreadPool runs batches from any number of Python threads at once, so
+    agents, value queries and encoding can share one pool instead of each
+    making their own. Callers must not change the pool's settings (e.g. its
+    encoding cache capacity).
+    """
+    num_threads = max(num_threads, 0)
+    with _shared_pools_lock:
+        if num_threads not in _shared_pools:
+            _shared_pools[num_threads] = pydipcc.ThreadPool(
+                num_threads, get_shared_orders_encoder()
             )
-        return cls.nothread_pool_singleton
+        return _shared_pools[num_threads]
+
+
+@contextlib.contextmanager
+def thread_pool_priority(priority: pydipcc.ThreadPoolPriority):
+    """Submit the calling thread's ThreadPool batches with priority
+
+    Workers run INTERACTIVE batches' jobs before those of queued BULK ones, so
+    background work (e.g. nash conv evaluation) should be marked BULK when it
+    shares a pool with latency-critical work. Also usable as a decorator.
+    """
+    prev = pydipcc.set_thread_pool_priority(priority)
+    try:
+        yield
+    finally:
+        pydipcc.set_thread_pool_priority(prev)
+
+
+class FeatureEncoder:
+    def __init__(self, num_threads: int = 0):
+        self.thread_pool = get_shared_thread_pool(num_threads)
 
     def encode_inputs(self, games: Sequence[pydipcc.Game]) -> DataFields:
         return DataFields(self.thread_pool.encode_inputs_multi(games))
 
+    def encode_inputs_powers(
+        self, games: Sequence[pydipcc.Game], powers: Sequence[str]
+    ) -> DataFields:
+        """Like encode_inputs, but x_possible_actions and x_loc_idxs only
+        have the rows of powers, e.g. for a single-power best response"""
+        return DataFields(self.thread_pool.encode_inputs_powers_multi(games, list(powers)))
+
+    def encode_inputs_repeated(self, game: pydipcc.Game, n: int) -> DataFields:
+        """Encode game once, as n rows of read-only expanded views"""
+        return DataFields(self.thread_pool.encode_inputs_repeated(game, n))
+
     def encode_inputs_state_only(self, games: Sequence[pydipcc.Game]) -> DataFields:
         return DataFields(self.thread_pool.encode_inputs_state_only_multi(games))
 
+    def cat_pad_inputs(self, xs: Sequence[DataFields]) -> DataFields:
+        """torch.cat encode_inputs results, padding x_possible_actions with -1
+        and x_loc_idxs with EOS_IDX where their max_seq_len differs"""
+        return DataFields(self.thread_pool.cat_pad_inputs(xs, CAT_PAD_VALUES))
+
     def decode_order_idxs(self, order_idxs):
         return self.thread_pool.decode_order_idxs(order_idxs)
 
-    def process_multi(self, games: Sequence[pydipcc.Game]) -> None:
-        self.thread_pool.process_multi(games)
+    def process_multi(
+        self, games: Sequence[pydipcc.Game], share_identical: bool = True
+    ) -> None:
+        self.thread_pool.process_multi(games, share_identical=share_identical)
+
+    def try_process_multi(
+        self, games: Sequence[pydipcc.Game], share_identical: bool = True
+    ) -> List["pydipcc.ProcessStatus"]:
+        """Same as process_multi, but return one pydipcc.ProcessStatus per game
+        instead of raising; games that are not OK are left unprocessed"""
+        return self.thread_pool.try_process_multi(games, share_identical=share_identical)